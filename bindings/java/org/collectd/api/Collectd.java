@@ -175,6 +175,15 @@ public class Collectd
   native public static int registerWrite (String name,
       CollectdWriteInterface object);
 
+  /**
+   * Registers a write callback which receives value lists in batches.
+   *
+   * @return Zero when successful, non-zero otherwise.
+   * @see CollectdBatchWriteInterface
+   */
+  native public static int registerBatchWrite (String name,
+      CollectdBatchWriteInterface object);
+
   /**
    * Java representation of collectd/src/plugin.h:plugin_register_flush
    *
@@ -0,0 +1,301 @@
+#!/bin/sh
+#
+# contrib/benchmark/ingest.sh
+#
+# End-to-end ingest benchmark: starts a private collectd instance which
+# receives values via the network plugin, drives it with collectd-tg and
+# reports the throughput, drops, write queue latency and memory usage for each
+# of the given write plugins.
+#
+# Usage: ingest.sh [-b builddir] [-s srcdir] [-w "plugin ..."] [-n series]
+#                  [-H hosts] [-r rate] [-t threads] [-l seconds]
+#                  [-i interval] [-p port] [-k]
+#
+
+BUILDDIR="."
+SRCDIR=""
+WRITERS="csv network write_graphite"
+NUM_SERIES=100000
+NUM_HOSTS=1000
+RATE=100000
+THREADS=2
+DURATION=30
+INTERVAL=10
+PORT=25900
+KEEP=0
+
+usage () {
+	cat <<EOF
+Usage: $0 [options]
+
+  -b <dir>       Build directory containing collectd, collectd-tg and
+                 collectdctl. (Default: $BUILDDIR)
+  -s <dir>       Source directory containing src/types.db.
+                 (Default: same as build directory)
+  -w <plugins>   Space separated list of write plugins to benchmark; any of
+                 "csv", "network", "write_graphite" and "none".
+                 (Default: "$WRITERS")
+  -n <number>    Number of series (value lists). (Default: $NUM_SERIES)
+  -H <number>    Number of hosts the series are spread over.
+                 (Default: $NUM_HOSTS)
+  -r <rate>      Values per second sent by collectd-tg. (Default: $RATE)
+  -t <number>    Number of collectd-tg sender threads. (Default: $THREADS)
+  -l <seconds>   Duration of each run. (Default: $DURATION)
+  -i <seconds>   Interval of the generated series. (Default: $INTERVAL)
+  -p <port>      First of three local ports to use. (Default: $PORT)
+  -k             Keep the working directories.
+EOF
+	exit $1
+}
+
+while getopts "b:s:w:n:H:r:t:l:i:p:kh" opt; do
+	case "$opt" in
+		b) BUILDDIR="$OPTARG" ;;
+		s) SRCDIR="$OPTARG" ;;
+		w) WRITERS="$OPTARG" ;;
+		n) NUM_SERIES="$OPTARG" ;;
+		H) NUM_HOSTS="$OPTARG" ;;
+		r) RATE="$OPTARG" ;;
+		t) THREADS="$OPTARG" ;;
+		l) DURATION="$OPTARG" ;;
+		i) INTERVAL="$OPTARG" ;;
+		p) PORT="$OPTARG" ;;
+		k) KEEP=1 ;;
+		h) usage 0 ;;
+		*) usage 1 >&2 ;;
+	esac
+done
+
+test -n "$SRCDIR" || SRCDIR="$BUILDDIR"
+
+COLLECTD="$BUILDDIR/collectd"
+COLLECTD_TG="$BUILDDIR/collectd-tg"
+COLLECTDCTL="$BUILDDIR/collectdctl"
+PLUGINDIR="$BUILDDIR/.libs"
+TYPESDB="$SRCDIR/src/types.db"
+
+for f in "$COLLECTD" "$COLLECTD_TG" "$COLLECTDCTL" "$TYPESDB"; do
+	if test ! -e "$f"; then
+		echo "$0: $f not found." >&2
+		exit 1
+	fi
+done
+
+LISTEN_PORT="$PORT"
+FORWARD_PORT=$(($PORT + 1))
+SINK_PORT=$(($PORT + 2))
+
+# udp_rcvbuf_errors
+#   Prints the number of datagrams the kernel dropped because a socket's
+#   receive buffer was full (Linux only; prints 0 elsewhere).
+udp_rcvbuf_errors () {
+	if test -r /proc/net/snmp; then
+		awk '/^Udp:/ { if (n++ == 0) { for (i = 1; i <= NF; i++) if ($i == "RcvbufErrors") col = i } else { print $col; exit } }' /proc/net/snmp
+	else
+		echo 0
+	fi
+}
+
+# getval <identifier>
+#   Prints the first value of <identifier> from the running daemon. Note that
+#   the daemon reports counters (DERIVE values) as rates.
+getval () {
+	"$COLLECTDCTL" -s "$WORKDIR/sock" getval "bench/$1" 2>/dev/null \
+		| sed -n -e '1s/^[^=]*=//p'
+}
+
+# write_config <plugin>
+write_config () {
+	cat >"$WORKDIR/collectd.conf" <<EOF
+Hostname "bench"
+FQDNLookup false
+BaseDir "$WORKDIR"
+PIDFile "$WORKDIR/collectd.pid"
+PluginDir "$PLUGINDIR"
+TypesDB "$TYPESDB"
+Interval 1
+CollectInternalStats true
+
+LoadPlugin logfile
+<Plugin logfile>
+  LogLevel info
+  File "$WORKDIR/collectd.log"
+</Plugin>
+
+LoadPlugin unixsock
+<Plugin unixsock>
+  SocketFile "$WORKDIR/sock"
+</Plugin>
+
+LoadPlugin network
+<Plugin network>
+  Listen "127.0.0.1" "$LISTEN_PORT"
+  ReportStats true
+EOF
+	case "$1" in
+		csv)
+			cat >>"$WORKDIR/collectd.conf" <<EOF
+</Plugin>
+
+LoadPlugin csv
+<Plugin csv>
+  DataDir "$WORKDIR/csv"
+</Plugin>
+EOF
+			;;
+		network)
+			cat >>"$WORKDIR/collectd.conf" <<EOF
+  Server "127.0.0.1" "$FORWARD_PORT"
+  Forward true
+</Plugin>
+EOF
+			;;
+		write_graphite)
+			cat >>"$WORKDIR/collectd.conf" <<EOF
+</Plugin>
+
+LoadPlugin write_graphite
+<Plugin write_graphite>
+  <Node "sink">
+    Host "127.0.0.1"
+    Port "$SINK_PORT"
+    Protocol "tcp"
+  </Node>
+</Plugin>
+EOF
+			;;
+		none)
+			echo "</Plugin>" >>"$WORKDIR/collectd.conf"
+			;;
+		*)
+			echo "$0: unsupported write plugin: $1" >&2
+			return 1
+			;;
+	esac
+	return 0
+}
+
+# start_sink
+#   Starts a TCP server on $SINK_PORT which discards everything it receives.
+start_sink () {
+	perl -MIO::Socket::INET -e '
+		my $srv = IO::Socket::INET->new (LocalAddr => "127.0.0.1",
+			LocalPort => $ARGV[0], Listen => 16, ReuseAddr => 1)
+			or die "listen: $!";
+		$SIG{CHLD} = "IGNORE";
+		while (my $c = $srv->accept ()) {
+			next if (fork ());
+			my $buf;
+			1 while (sysread ($c, $buf, 65536));
+			exit (0);
+		}' "$SINK_PORT" &
+	SINK_PID=$!
+}
+
+# run <plugin>
+#   Runs one benchmark and prints one line of results.
+run () {
+	WORKDIR=$(mktemp -d "${TMPDIR:-/tmp}/collectd-bench.XXXXXX") || exit 1
+	SINK_PID=""
+
+	write_config "$1" || return 1
+	test "$1" = "write_graphite" && start_sink
+
+	"$COLLECTD" -f -C "$WORKDIR/collectd.conf" >"$WORKDIR/stdout.log" 2>&1 &
+	DAEMON_PID=$!
+
+	i=0
+	while test ! -S "$WORKDIR/sock" && test $i -lt 50; do
+		sleep 0.1
+		i=$(($i + 1))
+	done
+	if test ! -S "$WORKDIR/sock"; then
+		echo "$0: collectd did not start; see $WORKDIR/collectd.log" >&2
+		kill $DAEMON_PID $SINK_PID 2>/dev/null
+		return 1
+	fi
+
+	udp_before=$(udp_rcvbuf_errors)
+
+	"$COLLECTD_TG" -n "$NUM_SERIES" -H "$NUM_HOSTS" -i "$INTERVAL" \
+		-t "$THREADS" -r "$RATE" -l "$DURATION" \
+		-d 127.0.0.1 -D "$LISTEN_PORT" >"$WORKDIR/tg.log" 2>&1 &
+	TG_PID=$!
+
+	# The daemon reports its statistics once per second; sample them while
+	# the traffic generator is running.
+	: >"$WORKDIR/samples"
+	while kill -0 $TG_PID 2>/dev/null; do
+		sleep 1
+		echo "$(getval network/total_values-dispatch-accepted)" \
+			"$(getval collectd-write_queue/derive-dropped)" \
+			"$(getval collectd-write_queue/duration-percentile-50)" \
+			"$(getval collectd-write_queue/duration-percentile-95)" \
+			"$(getval collectd-write_queue/duration-percentile-99)" \
+			>>"$WORKDIR/samples"
+	done
+	wait $TG_PID
+
+	# Give the daemon time to drain its queues.
+	sleep 3
+
+	udp_after=$(udp_rcvbuf_errors)
+	series=$(getval collectd-cache/cache_size)
+	rss=$(awk '/^VmRSS:/ { print $2 }' "/proc/$DAEMON_PID/status" 2>/dev/null)
+	sent=$(sed -n -e 's/^Sent \([0-9]*\) values in \([0-9.]*\) seconds.*/\1 \2/p' "$WORKDIR/tg.log")
+
+	kill $DAEMON_PID 2>/dev/null
+	wait $DAEMON_PID 2>/dev/null
+	if test -n "$SINK_PID"; then
+		kill $SINK_PID 2>/dev/null
+		wait $SINK_PID 2>/dev/null
+	fi
+
+	# Throughput and drop rates are averaged over all samples; for the write
+	# queue latency the worst sample of the run is reported.
+	echo "$1 ${sent:-0 0} $(($udp_after - $udp_before)) ${series:-0} ${rss:-0}" \
+		| cat - "$WORKDIR/samples" \
+		| awk '
+			function valid(v) {
+				return (v != "" && tolower(v) !~ /nan/);
+			}
+			function worst(cur, v) {
+				if (!valid(v)) return cur;
+				return (v + 0 > cur) ? v + 0 : cur;
+			}
+			NR == 1 {
+				plugin = $1; sent = $2; udp = $4; series = $5; rss = $6;
+				next
+			}
+			{
+				if (valid($1)) { accepted += $1; accepted_num++ }
+				if (valid($2)) { dropped += $2; dropped_num++ }
+				p50 = worst(p50, $3); p95 = worst(p95, $4); p99 = worst(p99, $5);
+			}
+			END {
+				rss_per_m = (series > 0) ? (rss / 1024.0) * 1000000.0 / series : 0;
+				printf "%-16s %10d %12.0f %10.1f %8d %10.3f %10.3f %10.3f %10d %12.1f\n",
+					plugin, sent,
+					(accepted_num > 0) ? accepted / accepted_num : 0,
+					(dropped_num > 0) ? dropped / dropped_num : 0,
+					udp, p50 * 1000.0, p95 * 1000.0, p99 * 1000.0,
+					series, rss_per_m;
+			}'
+
+	if test $KEEP -eq 0; then
+		rm -rf "$WORKDIR"
+	else
+		echo "# working directory: $WORKDIR"
+	fi
+}
+
+echo "# series=$NUM_SERIES hosts=$NUM_HOSTS rate=$RATE threads=$THREADS duration=${DURATION}s interval=${INTERVAL}s"
+printf "%-16s %10s %12s %10s %8s %10s %10s %10s %10s %12s\n" \
+	"# plugin" "sent" "accepted/s" "dropped/s" "udp-drop" \
+	"q-p50[ms]" "q-p95[ms]" "q-p99[ms]" "series" "MB/Mseries"
+
+status=0
+for writer in $WRITERS; do
+	run "$writer" || status=1
+done
+exit $status
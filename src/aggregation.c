@@ -30,12 +30,16 @@
 #include "meta_data.h"
 #include "plugin.h"
 #include "utils_cache.h" /* for uc_get_rate() */
+#include "utils_ddsketch.h"
 #include "utils_subst.h"
 #include "utils_vl_lookup.h"
 
 #define AGG_MATCHES_ALL(str) (strcmp("/.*/", str) == 0)
 #define AGG_FUNC_PLACEHOLDER "%{aggregation}"
 
+/* Relative accuracy of the percentiles. */
+#define AGG_SKETCH_ACCURACY 0.01
+
 struct aggregation_s /* {{{ */
 {
   lookup_identifier_t ident;
@@ -54,9 +58,29 @@ struct aggregation_s /* {{{ */
   _Bool calc_min;
   _Bool calc_max;
   _Bool calc_stddev;
+
+  gauge_t *percentiles;
+  size_t percentiles_num;
+
+  /* Number of intervals the aggregations are calculated over. */
+  size_t windows_num;
 }; /* }}} */
 typedef struct aggregation_s aggregation_t;
 
+/* Values received during one interval. */
+struct agg_window_s /* {{{ */
+{
+  derive_t num;
+  gauge_t sum;
+  gauge_t squares_sum;
+
+  gauge_t min;
+  gauge_t max;
+
+  ddsketch_t *sketch; /* NULL unless percentiles are calculated */
+}; /* }}} */
+typedef struct agg_window_s agg_window_t;
+
 struct agg_instance_s;
 typedef struct agg_instance_s agg_instance_t;
 struct agg_instance_s /* {{{ */
@@ -66,12 +90,16 @@ struct agg_instance_s /* {{{ */
 
   int ds_type;
 
-  derive_t num;
-  gauge_t sum;
-  gauge_t squares_sum;
+  /* Ring buffer of the last "windows_num" intervals; values are added to
+   * windows[window_current]. */
+  agg_window_t *windows;
+  size_t windows_num;
+  size_t window_current;
 
-  gauge_t min;
-  gauge_t max;
+  gauge_t *percentiles;
+  size_t percentiles_num;
+  /* Sketch of all windows; only used when windows_num > 1. */
+  ddsketch_t *sketch;
 
   rate_to_value_state_t *state_num;
   rate_to_value_state_t *state_sum;
@@ -79,6 +107,7 @@ struct agg_instance_s /* {{{ */
   rate_to_value_state_t *state_min;
   rate_to_value_state_t *state_max;
   rate_to_value_state_t *state_stddev;
+  rate_to_value_state_t *state_percentile; /* one per percentile */
 
   agg_instance_t *next;
 }; /* }}} */
@@ -107,6 +136,10 @@ static _Bool agg_is_regex(char const *str) /* {{{ */
 
 static void agg_destroy(aggregation_t *agg) /* {{{ */
 {
+  if (agg == NULL)
+    return;
+
+  sfree(agg->percentiles);
   sfree(agg);
 } /* }}} void agg_destroy */
 
@@ -135,13 +168,28 @@ static void agg_instance_destroy(agg_instance_t *inst) /* {{{ */
   sfree(inst->state_min);
   sfree(inst->state_max);
   sfree(inst->state_stddev);
+  sfree(inst->state_percentile);
+
+  for (size_t i = 0; i < inst->windows_num; i++)
+    ddsketch_destroy(inst->windows[i].sketch);
+  sfree(inst->windows);
+  ddsketch_destroy(inst->sketch);
+  sfree(inst->percentiles);
 
   memset(inst, 0, sizeof(*inst));
   inst->ds_type = -1;
-  inst->min = NAN;
-  inst->max = NAN;
 } /* }}} void agg_instance_destroy */
 
+static void agg_window_reset(agg_window_t *w) /* {{{ */
+{
+  w->num = 0;
+  w->sum = 0.0;
+  w->squares_sum = 0.0;
+  w->min = NAN;
+  w->max = NAN;
+  ddsketch_reset(w->sketch);
+} /* }}} void agg_window_reset */
+
 static int agg_instance_create_name(agg_instance_t *inst, /* {{{ */
                                     value_list_t const *vl,
                                     aggregation_t const *agg) {
@@ -244,8 +292,54 @@ static agg_instance_t *agg_instance_create(data_set_t const *ds, /* {{{ */
 
   agg_instance_create_name(inst, vl, agg);
 
-  inst->min = NAN;
-  inst->max = NAN;
+  inst->windows_num = agg->windows_num;
+  inst->windows = calloc(inst->windows_num, sizeof(*inst->windows));
+  if (inst->windows == NULL) {
+    inst->windows_num = 0;
+    agg_instance_destroy(inst);
+    free(inst);
+    ERROR("aggregation plugin: calloc() failed.");
+    return NULL;
+  }
+
+  if (agg->percentiles_num > 0) {
+    inst->percentiles =
+        calloc(agg->percentiles_num, sizeof(*inst->percentiles));
+    inst->state_percentile =
+        calloc(agg->percentiles_num, sizeof(*inst->state_percentile));
+    if ((inst->percentiles == NULL) || (inst->state_percentile == NULL)) {
+      agg_instance_destroy(inst);
+      free(inst);
+      ERROR("aggregation plugin: calloc() failed.");
+      return NULL;
+    }
+    memcpy(inst->percentiles, agg->percentiles,
+           agg->percentiles_num * sizeof(*inst->percentiles));
+    inst->percentiles_num = agg->percentiles_num;
+
+    for (size_t i = 0; i < inst->windows_num; i++) {
+      inst->windows[i].sketch = ddsketch_create(AGG_SKETCH_ACCURACY);
+      if (inst->windows[i].sketch == NULL) {
+        agg_instance_destroy(inst);
+        free(inst);
+        ERROR("aggregation plugin: ddsketch_create() failed.");
+        return NULL;
+      }
+    }
+
+    if (inst->windows_num > 1) {
+      inst->sketch = ddsketch_create(AGG_SKETCH_ACCURACY);
+      if (inst->sketch == NULL) {
+        agg_instance_destroy(inst);
+        free(inst);
+        ERROR("aggregation plugin: ddsketch_create() failed.");
+        return NULL;
+      }
+    }
+  }
+
+  for (size_t i = 0; i < inst->windows_num; i++)
+    agg_window_reset(inst->windows + i);
 
 #define INIT_STATE(field)                                                      \
   do {                                                                         \
@@ -284,7 +378,8 @@ static agg_instance_t *agg_instance_create(data_set_t const *ds, /* {{{ */
  * and non-zero otherwise. */
 static int agg_instance_update(agg_instance_t *inst, /* {{{ */
                                data_set_t const *ds, value_list_t const *vl) {
-  gauge_t *rate;
+  agg_window_t *w;
+  gauge_t rate;
 
   if (ds->ds_num != 1) {
     ERROR("aggregation plugin: The \"%s\" type (data set) has more than one "
@@ -294,34 +389,45 @@ static int agg_instance_update(agg_instance_t *inst, /* {{{ */
     return EINVAL;
   }
 
-  rate = uc_get_rate(ds, vl);
-  if (rate == NULL) {
-    char ident[6 * DATA_MAX_NAME_LEN];
-    FORMAT_VL(ident, sizeof(ident), vl);
-    ERROR("aggregation plugin: Unable to read the current rate of \"%s\".",
-          ident);
-    return ENOENT;
+  /* The rate of a gauge is its value; don't bother the cache. */
+  if (ds->ds[0].type == DS_TYPE_GAUGE) {
+    rate = vl->values[0].gauge;
+    if ((rate < ds->ds[0].min) || (rate > ds->ds[0].max))
+      rate = NAN;
+  } else {
+    gauge_t *rates = uc_get_rate(ds, vl);
+    if (rates == NULL) {
+      char ident[6 * DATA_MAX_NAME_LEN];
+      FORMAT_VL(ident, sizeof(ident), vl);
+      ERROR("aggregation plugin: Unable to read the current rate of \"%s\".",
+            ident);
+      return ENOENT;
+    }
+    rate = rates[0];
+    sfree(rates);
   }
 
-  if (isnan(rate[0])) {
-    sfree(rate);
+  if (isnan(rate))
     return 0;
-  }
 
   pthread_mutex_lock(&inst->lock);
 
-  inst->num++;
-  inst->sum += rate[0];
-  inst->squares_sum += (rate[0] * rate[0]);
+  w = inst->windows + inst->window_current;
+
+  w->num++;
+  w->sum += rate;
+  w->squares_sum += (rate * rate);
+
+  if (isnan(w->min) || (w->min > rate))
+    w->min = rate;
+  if (isnan(w->max) || (w->max < rate))
+    w->max = rate;
 
-  if (isnan(inst->min) || (inst->min > rate[0]))
-    inst->min = rate[0];
-  if (isnan(inst->max) || (inst->max < rate[0]))
-    inst->max = rate[0];
+  if (w->sketch != NULL)
+    ddsketch_add(w->sketch, rate);
 
   pthread_mutex_unlock(&inst->lock);
 
-  sfree(rate);
   return 0;
 } /* }}} int agg_instance_update */
 
@@ -365,6 +471,7 @@ static int agg_instance_read_func(agg_instance_t *inst, /* {{{ */
 static int agg_instance_read(agg_instance_t *inst, cdtime_t t) /* {{{ */
 {
   value_list_t vl = VALUE_LIST_INIT;
+  agg_window_t total = {.min = NAN, .max = NAN};
 
   /* Pre-set all the fields in the value list that will not change per
    * aggregation type (sum, average, ...). The struct will be re-used and must
@@ -396,26 +503,57 @@ static int agg_instance_read(agg_instance_t *inst, cdtime_t t) /* {{{ */
 
   pthread_mutex_lock(&inst->lock);
 
-  READ_FUNC(num, (gauge_t)inst->num);
+  /* Combine the windows. With a single window, its sketch is used as is. */
+  total.sketch =
+      (inst->windows_num > 1) ? inst->sketch : inst->windows[0].sketch;
+  if (inst->windows_num > 1)
+    ddsketch_reset(total.sketch);
+
+  for (size_t i = 0; i < inst->windows_num; i++) {
+    agg_window_t *w = inst->windows + i;
+
+    if (w->num == 0)
+      continue;
+
+    total.num += w->num;
+    total.sum += w->sum;
+    total.squares_sum += w->squares_sum;
+    if (isnan(total.min) || (total.min > w->min))
+      total.min = w->min;
+    if (isnan(total.max) || (total.max < w->max))
+      total.max = w->max;
+
+    if ((inst->windows_num > 1) && (w->sketch != NULL))
+      ddsketch_merge(total.sketch, w->sketch);
+  }
+
+  READ_FUNC(num, (gauge_t)total.num);
 
   /* All other aggregations are only defined when there have been any values
    * at all. */
-  if (inst->num > 0) {
-    READ_FUNC(sum, inst->sum);
-    READ_FUNC(average, (inst->sum / ((gauge_t)inst->num)));
-    READ_FUNC(min, inst->min);
-    READ_FUNC(max, inst->max);
-    READ_FUNC(stddev, sqrt((((gauge_t)inst->num) * inst->squares_sum) -
-                           (inst->sum * inst->sum)) /
-                          ((gauge_t)inst->num));
+  if (total.num > 0) {
+    READ_FUNC(sum, total.sum);
+    READ_FUNC(average, (total.sum / ((gauge_t)total.num)));
+    READ_FUNC(min, total.min);
+    READ_FUNC(max, total.max);
+    READ_FUNC(stddev, sqrt((((gauge_t)total.num) * total.squares_sum) -
+                           (total.sum * total.sum)) /
+                          ((gauge_t)total.num));
+
+    for (size_t i = 0; i < inst->percentiles_num; i++) {
+      char func[DATA_MAX_NAME_LEN];
+
+      ssnprintf(func, sizeof(func), "percentile-%g", inst->percentiles[i]);
+      agg_instance_read_func(
+          inst, func,
+          ddsketch_quantile(total.sketch, inst->percentiles[i] / 100.0),
+          inst->state_percentile + i, &vl, inst->ident.plugin_instance, t);
+    }
   }
 
-  /* Reset internal state. */
-  inst->num = 0;
-  inst->sum = 0.0;
-  inst->squares_sum = 0.0;
-  inst->min = NAN;
-  inst->max = NAN;
+  /* Start the next window, dropping the oldest one. */
+  inst->window_current = (inst->window_current + 1) % inst->windows_num;
+  agg_window_reset(inst->windows + inst->window_current);
 
   pthread_mutex_unlock(&inst->lock);
 
@@ -468,6 +606,9 @@ static void agg_lookup_free_obj_callback(void *user_obj) /* {{{ */
  *     CalculateMinimum true
  *     CalculateMaximum true
  *     CalculateStddev true
+ *     CalculatePercentile 50 95 99
+ *
+ *     SlidingWindow 1
  *   </Aggregation>
  * </Plugin>
  */
@@ -504,6 +645,49 @@ static int agg_config_handle_group_by(oconfig_item_t const *ci, /* {{{ */
   return 0;
 } /* }}} int agg_config_handle_group_by */
 
+static int agg_config_handle_percentile(oconfig_item_t const *ci, /* {{{ */
+                                        aggregation_t *agg) {
+  if (ci->values_num < 1) {
+    ERROR("aggregation plugin: The \"%s\" option requires at least one "
+          "numeric argument.",
+          ci->key);
+    return -1;
+  }
+
+  for (int i = 0; i < ci->values_num; i++) {
+    gauge_t *tmp;
+    double percent;
+
+    if (ci->values[i].type != OCONFIG_TYPE_NUMBER) {
+      ERROR("aggregation plugin: Argument %i of the \"%s\" option is not a "
+            "number.",
+            i + 1, ci->key);
+      continue;
+    }
+
+    percent = ci->values[i].value.number;
+    if ((percent <= 0.0) || (percent >= 100.0)) {
+      ERROR("aggregation plugin: The percentile %g is out of range; it must be "
+            "between 0 and 100 (exclusive). Use CalculateMinimum or "
+            "CalculateMaximum for the extremes.",
+            percent);
+      continue;
+    }
+
+    tmp = realloc(agg->percentiles,
+                  (agg->percentiles_num + 1) * sizeof(*agg->percentiles));
+    if (tmp == NULL) {
+      ERROR("aggregation plugin: realloc failed.");
+      return ENOMEM;
+    }
+    agg->percentiles = tmp;
+    agg->percentiles[agg->percentiles_num] = (gauge_t)percent;
+    agg->percentiles_num++;
+  } /* for (ci->values) */
+
+  return 0;
+} /* }}} int agg_config_handle_percentile */
+
 static int agg_config_aggregation(oconfig_item_t *ci) /* {{{ */
 {
   aggregation_t *agg;
@@ -522,7 +706,9 @@ static int agg_config_aggregation(oconfig_item_t *ci) /* {{{ */
            sizeof(agg->ident.plugin_instance));
   sstrncpy(agg->ident.type, "/.*/", sizeof(agg->ident.type));
   sstrncpy(agg->ident.type_instance, "/.*/", sizeof(agg->ident.type_instance));
+  agg->windows_num = 1;
 
+  is_valid = 1;
   for (int i = 0; i < ci->children_num; i++) {
     oconfig_item_t *child = ci->children + i;
 
@@ -563,7 +749,19 @@ static int agg_config_aggregation(oconfig_item_t *ci) /* {{{ */
       cf_util_get_boolean(child, &agg->calc_max);
     else if (strcasecmp("CalculateStddev", child->key) == 0)
       cf_util_get_boolean(child, &agg->calc_stddev);
-    else
+    else if (strcasecmp("CalculatePercentile", child->key) == 0)
+      agg_config_handle_percentile(child, agg);
+    else if (strcasecmp("SlidingWindow", child->key) == 0) {
+      int tmp = 0;
+      if (cf_util_get_int(child, &tmp) != 0)
+        continue;
+      if (tmp < 1) {
+        ERROR("aggregation plugin: \"SlidingWindow\" must be at least 1.");
+        is_valid = 0;
+        continue;
+      }
+      agg->windows_num = (size_t)tmp;
+    } else
       WARNING("aggregation plugin: The \"%s\" key is not allowed inside "
               "<Aggregation /> blocks and will be ignored.",
               child->key);
@@ -579,7 +777,6 @@ static int agg_config_aggregation(oconfig_item_t *ci) /* {{{ */
     agg->regex_fields |= LU_GROUP_BY_TYPE_INSTANCE;
 
   /* Sanity checking */
-  is_valid = 1;
   if (strcmp("/.*/", agg->ident.type) == 0) /* {{{ */
   {
     ERROR("aggregation plugin: It appears you did not specify the required "
@@ -623,7 +820,8 @@ static int agg_config_aggregation(oconfig_item_t *ci) /* {{{ */
   } /* }}} */
 
   if (!agg->calc_num && !agg->calc_sum && !agg->calc_average /* {{{ */
-      && !agg->calc_min && !agg->calc_max && !agg->calc_stddev) {
+      && !agg->calc_min && !agg->calc_max && !agg->calc_stddev &&
+      (agg->percentiles_num == 0)) {
     ERROR("aggregation plugin: No aggregation function has been specified. "
           "Without this, I don't know what I should be calculating. "
           "(Host \"%s\", Plugin \"%s\", PluginInstance \"%s\", "
@@ -635,14 +833,14 @@ static int agg_config_aggregation(oconfig_item_t *ci) /* {{{ */
 
   if (!is_valid) /* {{{ */
   {
-    sfree(agg);
+    agg_destroy(agg);
     return -1;
   } /* }}} */
 
   status = lookup_add(lookup, &agg->ident, agg->group_by, agg);
   if (status != 0) {
     ERROR("aggregation plugin: lookup_add failed with status %i.", status);
-    sfree(agg);
+    agg_destroy(agg);
     return -1;
   }
 
@@ -62,9 +62,50 @@ int amqp_socket_close(amqp_socket_t *);
 
 #define CAMQP_CHANNEL 1
 
+/* Upper limit of the "Channels" option. */
+#define CAMQP_CHANNELS_MAX 64
+
+/* Publisher confirms need to wait for frames with a timeout. */
+#if HAVE_AMQP_SIMPLE_WAIT_FRAME_NOBLOCK
+#define CAMQP_HAVE_CONFIRMS 1
+#else
+#define CAMQP_HAVE_CONFIRMS 0
+#endif
+
+/* Time to wait for the broker to confirm messages when the window is full or
+ * the plugin shuts down. */
+#define CAMQP_CONFIRM_TIMEOUT TIME_T_TO_CDTIME_T(10)
+
 /*
  * Data types
  */
+#define CAMQP_MSG_PENDING 0
+#define CAMQP_MSG_ACKED 1
+#define CAMQP_MSG_NACKED 2
+
+/* A published message the broker has not confirmed yet. A copy is kept so
+ * that the message can be published again if the broker rejects it or the
+ * connection is lost. */
+typedef struct {
+  uint64_t delivery_tag;
+  int state;
+  _Bool retried;
+  char *routing_key;
+  void *body;
+  size_t body_len;
+} camqp_message_t;
+
+typedef struct {
+  amqp_channel_t id;
+  /* Delivery tag of the next message published on this channel. */
+  uint64_t next_tag;
+
+  /* Unconfirmed messages, oldest first: a ring of "confirm_window" entries. */
+  camqp_message_t *unconfirmed;
+  size_t unconfirmed_head;
+  size_t unconfirmed_num;
+} camqp_channel_t;
+
 struct camqp_config_s {
   _Bool publish;
   char *name;
@@ -90,12 +131,30 @@ struct camqp_config_s {
   char *postfix;
   char escape_char;
   unsigned int graphite_flags;
+  /* publish, batching */
+  size_t buffer_size;
+  char *send_buffer;
+  size_t send_buffer_fill;
+  size_t send_buffer_free;
+  size_t send_buffer_values;
+  cdtime_t send_buffer_init_time;
+  char send_routing_key[6 * DATA_MAX_NAME_LEN];
+  /* publish, confirms */
+  _Bool confirm;
+  size_t confirm_window;
 
   /* subscribe only */
   char *exchange_type;
   char *queue;
   _Bool queue_durable;
   _Bool queue_auto_delete;
+  cmd_putval_parser_t *putval;
+  char *body;
+  size_t body_size;
+
+  camqp_channel_t *channels;
+  int channels_num;
+  int channel_next;
 
   amqp_connection_state_t connection;
   pthread_mutex_t lock;
@@ -128,13 +187,29 @@ static void camqp_close_connection(camqp_config_t *conf) /* {{{ */
     return;
 
   sockfd = amqp_get_sockfd(conf->connection);
-  amqp_channel_close(conf->connection, CAMQP_CHANNEL, AMQP_REPLY_SUCCESS);
+  for (int i = 0; i < conf->channels_num; i++)
+    amqp_channel_close(conf->connection, conf->channels[i].id,
+                       AMQP_REPLY_SUCCESS);
   amqp_connection_close(conf->connection, AMQP_REPLY_SUCCESS);
   amqp_destroy_connection(conf->connection);
   close(sockfd);
   conf->connection = NULL;
 } /* }}} void camqp_close_connection */
 
+static void camqp_message_free(camqp_message_t *m) /* {{{ */
+{
+  sfree(m->routing_key);
+  sfree(m->body);
+  m->body_len = 0;
+} /* }}} void camqp_message_free */
+
+static int camqp_flush_nolock(cdtime_t timeout, camqp_config_t *conf);
+static int camqp_republish(camqp_config_t *conf);
+#if CAMQP_HAVE_CONFIRMS
+static int camqp_wait_confirms(camqp_config_t *conf, camqp_channel_t *ch,
+                               size_t max_unconfirmed, cdtime_t timeout);
+#endif
+
 static void camqp_config_free(void *ptr) /* {{{ */
 {
   camqp_config_t *conf = ptr;
@@ -142,8 +217,42 @@ static void camqp_config_free(void *ptr) /* {{{ */
   if (conf == NULL)
     return;
 
+  /* Send what is left in the buffer and give the broker a chance to confirm
+   * the messages in flight. */
+  if (conf->publish) {
+    if (conf->send_buffer != NULL)
+      camqp_flush_nolock(/* timeout = */ 0, conf);
+#if CAMQP_HAVE_CONFIRMS
+    if (conf->confirm && (conf->connection != NULL))
+      camqp_wait_confirms(conf, /* ch = */ NULL, /* max_unconfirmed = */ 0,
+                          CAMQP_CONFIRM_TIMEOUT);
+#endif
+  }
+
   camqp_close_connection(conf);
 
+  for (int i = 0; (conf->channels != NULL) && (i < conf->channels_num); i++) {
+    camqp_channel_t *ch = conf->channels + i;
+
+    if (ch->unconfirmed == NULL)
+      continue;
+
+    for (size_t j = 0; j < ch->unconfirmed_num; j++)
+      camqp_message_free(ch->unconfirmed + ((ch->unconfirmed_head + j) %
+                                            conf->confirm_window));
+    if (ch->unconfirmed_num > 0)
+      WARNING("amqp plugin: %zu messages on channel %i of \"%s\" have "
+              "not been confirmed.",
+              ch->unconfirmed_num, (int)ch->id, conf->name);
+    sfree(ch->unconfirmed);
+  }
+  sfree(conf->channels);
+  sfree(conf->send_buffer);
+
+  if (conf->putval != NULL)
+    cmd_putval_parser_destroy(conf->putval);
+  sfree(conf->body);
+
   sfree(conf->name);
   sfree(conf->host);
   sfree(conf->vhost);
@@ -480,16 +589,33 @@ static int camqp_connect(camqp_config_t *conf) /* {{{ */
     return 1;
   }
 
-  amqp_channel_open(conf->connection, /* channel = */ 1);
-  /* FIXME: Is checking "reply.reply_type" really correct here? How does
-   * it get set? --octo */
-  if (reply.reply_type != AMQP_RESPONSE_NORMAL) {
-    ERROR("amqp plugin: amqp_channel_open failed.");
-    amqp_connection_close(conf->connection, AMQP_REPLY_SUCCESS);
-    amqp_destroy_connection(conf->connection);
-    CLOSE_SOCKET();
-    conf->connection = NULL;
-    return 1;
+  for (int i = 0; i < conf->channels_num; i++) {
+    camqp_channel_t *ch = conf->channels + i;
+
+    if ((amqp_channel_open(conf->connection, ch->id) == NULL) &&
+        camqp_is_error(conf)) {
+      char errbuf[1024];
+      ERROR("amqp plugin: amqp_channel_open failed: %s",
+            camqp_strerror(conf, errbuf, sizeof(errbuf)));
+      amqp_connection_close(conf->connection, AMQP_REPLY_SUCCESS);
+      amqp_destroy_connection(conf->connection);
+      CLOSE_SOCKET();
+      conf->connection = NULL;
+      return 1;
+    }
+
+#if CAMQP_HAVE_CONFIRMS
+    if (conf->confirm &&
+        (amqp_confirm_select(conf->connection, ch->id) == NULL) &&
+        camqp_is_error(conf)) {
+      char errbuf[1024];
+      ERROR("amqp plugin: amqp_confirm_select failed: %s",
+            camqp_strerror(conf, errbuf, sizeof(errbuf)));
+      camqp_close_connection(conf);
+      return 1;
+    }
+#endif
+    ch->next_tag = 1;
   }
 
   INFO("amqp plugin: Successfully opened connection to vhost \"%s\" "
@@ -502,7 +628,7 @@ static int camqp_connect(camqp_config_t *conf) /* {{{ */
 
   if (!conf->publish)
     return camqp_setup_queue(conf);
-  return 0;
+  return camqp_republish(conf);
 } /* }}} int camqp_connect */
 
 static int camqp_shutdown(void) /* {{{ */
@@ -530,15 +656,39 @@ static int camqp_shutdown(void) /* {{{ */
 /*
  * Subscribing code
  */
+static void camqp_putval_error(void *ud, cmd_status_t status, /* {{{ */
+                               const char *format, va_list ap) {
+  char msg[1024];
+
+  if (status == CMD_OK)
+    return;
+
+  vsnprintf(msg, sizeof(msg), format, ap);
+  ERROR("amqp plugin: Handling PUTVAL failed: %s", msg);
+} /* }}} void camqp_putval_error */
+
 static int camqp_read_body(camqp_config_t *conf, /* {{{ */
                            size_t body_size, const char *content_type) {
-  char body[body_size + 1];
+  char *body;
   char *body_ptr;
   size_t received;
   amqp_frame_t frame;
   int status;
 
-  memset(body, 0, sizeof(body));
+  /* Batched messages can be large, so the buffer lives on the heap and is
+   * reused for all messages. */
+  if (conf->body_size < (body_size + 1)) {
+    char *tmp = realloc(conf->body, body_size + 1);
+    if (tmp == NULL) {
+      ERROR("amqp plugin: realloc failed.");
+      camqp_close_connection(conf);
+      return ENOMEM;
+    }
+    conf->body = tmp;
+    conf->body_size = body_size + 1;
+  }
+  body = conf->body;
+  memset(body, 0, body_size + 1);
   body_ptr = &body[0];
   received = 0;
 
@@ -570,9 +720,17 @@ static int camqp_read_body(camqp_config_t *conf, /* {{{ */
   } /* while (received < body_size) */
 
   if (strcasecmp("text/collectd", content_type) == 0) {
-    status = cmd_handle_putval(stderr, body);
-    if (status != 0)
-      ERROR("amqp plugin: cmd_handle_putval failed with status %i.", status);
+    cmd_error_handler_t err = {camqp_putval_error, NULL};
+    char *saveptr = NULL;
+
+    /* A message holds one PUTVAL line per value list, see "BufferSize". */
+    status = 0;
+    for (char *line = strtok_r(body, "\r\n", &saveptr); line != NULL;
+         line = strtok_r(NULL, "\r\n", &saveptr)) {
+      if (cmd_putval_parser_dispatch(conf->putval, line, /* ret_num = */ NULL,
+                                     &err) != CMD_OK)
+        status = -1;
+    }
     return status;
   } else if (strcasecmp("application/json", content_type) == 0) {
     ERROR("amqp plugin: camqp_read_body: Parsing JSON data has not "
@@ -707,14 +865,14 @@ static int camqp_subscribe_init(camqp_config_t *conf) /* {{{ */
 /*
  * Publishing code
  */
-/* XXX: You must hold "conf->lock" when calling this function! */
-static int camqp_write_locked(camqp_config_t *conf, /* {{{ */
-                              const char *buffer, const char *routing_key) {
+/* XXX: You must hold "conf->lock" when calling the following functions! */
+static int camqp_publish(camqp_config_t *conf, /* {{{ */
+                         camqp_channel_t *ch, const char *routing_key,
+                         const void *body, size_t body_len) {
   int status;
 
-  status = camqp_connect(conf);
-  if (status != 0)
-    return status;
+  if (conf->connection == NULL)
+    return ENOTCONN;
 
   amqp_basic_properties_t props = {._flags = AMQP_BASIC_CONTENT_TYPE_FLAG |
                                              AMQP_BASIC_DELIVERY_MODE_FLAG |
@@ -732,19 +890,441 @@ static int camqp_write_locked(camqp_config_t *conf, /* {{{ */
     assert(23 == 42);
 
   status = amqp_basic_publish(
-      conf->connection,
-      /* channel = */ 1, amqp_cstring_bytes(CONF(conf, exchange)),
+      conf->connection, ch->id, amqp_cstring_bytes(CONF(conf, exchange)),
       amqp_cstring_bytes(routing_key),
       /* mandatory = */ 0,
-      /* immediate = */ 0, &props, amqp_cstring_bytes(buffer));
+      /* immediate = */ 0, &props,
+      (amqp_bytes_t){.len = body_len, .bytes = (void *)body});
   if (status != 0) {
     ERROR("amqp plugin: amqp_basic_publish failed with status %i.", status);
     camqp_close_connection(conf);
   }
 
   return status;
+} /* }}} int camqp_publish */
+
+#if CAMQP_HAVE_CONFIRMS
+/* Appends "m" to the unconfirmed messages of "ch" and publishes it, taking
+ * ownership of its routing key and body. The caller makes sure the window has
+ * room for the message. If publishing fails, the message stays in the window
+ * and is published again once the connection has been re-established. */
+static int camqp_publish_confirmed(camqp_config_t *conf, /* {{{ */
+                                   camqp_channel_t *ch, camqp_message_t m) {
+  camqp_message_t *slot =
+      ch->unconfirmed +
+      ((ch->unconfirmed_head + ch->unconfirmed_num) % conf->confirm_window);
+
+  m.delivery_tag = ch->next_tag++;
+  m.state = CAMQP_MSG_PENDING;
+  *slot = m;
+  ch->unconfirmed_num++;
+
+  return camqp_publish(conf, ch, slot->routing_key, slot->body,
+                       slot->body_len);
+} /* }}} int camqp_publish_confirmed */
+
+static void camqp_handle_confirm(camqp_config_t *conf, /* {{{ */
+                                 amqp_channel_t channel, uint64_t delivery_tag,
+                                 _Bool multiple, int state) {
+  camqp_channel_t *ch = NULL;
+
+  for (int i = 0; i < conf->channels_num; i++)
+    if (conf->channels[i].id == channel)
+      ch = conf->channels + i;
+  if (ch == NULL)
+    return;
+
+  /* Delivery tags increase monotonically within the window. */
+  for (size_t i = 0; i < ch->unconfirmed_num; i++) {
+    camqp_message_t *m =
+        ch->unconfirmed +
+        ((ch->unconfirmed_head + i) % conf->confirm_window);
+
+    if (m->delivery_tag > delivery_tag)
+      break;
+    if (multiple || (m->delivery_tag == delivery_tag))
+      m->state = state;
+  }
+
+  /* Release the confirmed messages at the start of the window and publish
+   * rejected ones once more. */
+  while (ch->unconfirmed_num > 0) {
+    camqp_message_t *slot = ch->unconfirmed + ch->unconfirmed_head;
+    camqp_message_t m = *slot;
+
+    if (m.state == CAMQP_MSG_PENDING)
+      break;
+
+    memset(slot, 0, sizeof(*slot));
+    ch->unconfirmed_head = (ch->unconfirmed_head + 1) % conf->confirm_window;
+    ch->unconfirmed_num--;
+
+    if (m.state == CAMQP_MSG_NACKED) {
+      if (!m.retried && (conf->connection != NULL)) {
+        m.retried = 1;
+        camqp_publish_confirmed(conf, ch, m);
+        continue;
+      }
+      WARNING("amqp plugin: The broker rejected a message with routing key "
+              "\"%s\". Dropping it.",
+              m.routing_key);
+    }
+    camqp_message_free(&m);
+  }
+} /* }}} void camqp_handle_confirm */
+
+/* Reads one frame, waiting at most "timeout", and handles the publisher
+ * confirms in it. Returns zero if a frame has been handled, EAGAIN if none
+ * arrived in time and an error code if the connection failed. */
+static int camqp_read_confirm(camqp_config_t *conf, cdtime_t timeout) /* {{{ */
+{
+  struct timeval tv = CDTIME_T_TO_TIMEVAL(timeout);
+  amqp_frame_t frame;
+  int status;
+
+  status = amqp_simple_wait_frame_noblock(conf->connection, &frame, &tv);
+  if (status == AMQP_STATUS_TIMEOUT)
+    return EAGAIN;
+  if (status != AMQP_STATUS_OK) {
+    ERROR("amqp plugin: amqp_simple_wait_frame_noblock failed: %s",
+          amqp_error_string2(status));
+    return -1;
+  }
+
+  if (frame.frame_type != AMQP_FRAME_METHOD)
+    return 0;
+
+  switch (frame.payload.method.id) {
+  case AMQP_BASIC_ACK_METHOD: {
+    amqp_basic_ack_t *m = frame.payload.method.decoded;
+    camqp_handle_confirm(conf, frame.channel, m->delivery_tag, m->multiple,
+                         CAMQP_MSG_ACKED);
+    break;
+  }
+  case AMQP_BASIC_NACK_METHOD: {
+    amqp_basic_nack_t *m = frame.payload.method.decoded;
+    camqp_handle_confirm(conf, frame.channel, m->delivery_tag, m->multiple,
+                         CAMQP_MSG_NACKED);
+    break;
+  }
+  case AMQP_CHANNEL_CLOSE_METHOD:
+  case AMQP_CONNECTION_CLOSE_METHOD:
+    ERROR("amqp plugin: The broker closed the %s.",
+          (frame.payload.method.id == AMQP_CHANNEL_CLOSE_METHOD)
+              ? "channel"
+              : "connection");
+    return -1;
+  default:
+    DEBUG("amqp plugin: Unexpected method id: %#" PRIx32,
+          frame.payload.method.id);
+  }
+
+  return 0;
+} /* }}} int camqp_read_confirm */
+
+/* Handles the confirms that have already arrived, without waiting. */
+static int camqp_poll_confirms(camqp_config_t *conf) /* {{{ */
+{
+  int status;
+
+  while ((conf->connection != NULL) &&
+         ((status = camqp_read_confirm(conf, /* timeout = */ 0)) == 0))
+    /* handle the next frame */;
+
+  if (conf->connection == NULL)
+    return ENOTCONN;
+  if (status != EAGAIN) {
+    camqp_close_connection(conf);
+    return status;
+  }
+
+  amqp_maybe_release_buffers(conf->connection);
+  return 0;
+} /* }}} int camqp_poll_confirms */
+
+/* Waits until no more than "max_unconfirmed" messages are unconfirmed on
+ * channel "ch", or on any channel if "ch" is NULL. */
+static int camqp_wait_confirms(camqp_config_t *conf, /* {{{ */
+                               camqp_channel_t *ch, size_t max_unconfirmed,
+                               cdtime_t timeout) {
+  cdtime_t end = cdtime() + timeout;
+
+  while (42) {
+    size_t unconfirmed = 0;
+    cdtime_t now;
+    int status;
+
+    for (int i = 0; i < conf->channels_num; i++) {
+      camqp_channel_t *c = conf->channels + i;
+      if (((ch == NULL) || (ch == c)) && (c->unconfirmed_num > unconfirmed))
+        unconfirmed = c->unconfirmed_num;
+    }
+    if (unconfirmed <= max_unconfirmed)
+      break;
+
+    if (conf->connection == NULL)
+      return ENOTCONN;
+
+    now = cdtime();
+    if (now >= end) {
+      ERROR("amqp plugin: The broker did not confirm %zu messages in time.",
+            unconfirmed);
+      camqp_close_connection(conf);
+      return ETIMEDOUT;
+    }
+
+    status = camqp_read_confirm(conf, end - now);
+    if ((status != 0) && (status != EAGAIN)) {
+      camqp_close_connection(conf);
+      return status;
+    }
+  }
+
+  if (conf->connection != NULL)
+    amqp_maybe_release_buffers(conf->connection);
+  return 0;
+} /* }}} int camqp_wait_confirms */
+#endif /* CAMQP_HAVE_CONFIRMS */
+
+/* Publishes the messages that have not been confirmed before the connection
+ * was lost once more. */
+static int camqp_republish(camqp_config_t *conf) /* {{{ */
+{
+#if CAMQP_HAVE_CONFIRMS
+  for (int i = 0; conf->confirm && (i < conf->channels_num); i++) {
+    camqp_channel_t *ch = conf->channels + i;
+    size_t num = ch->unconfirmed_num;
+
+    if (num > 0)
+      INFO("amqp plugin: Publishing %zu unconfirmed messages on channel %i "
+           "again.",
+           num, (int)ch->id);
+
+    for (size_t j = 0; j < num; j++) {
+      camqp_message_t *slot = ch->unconfirmed + ch->unconfirmed_head;
+      camqp_message_t m = *slot;
+      int status;
+
+      memset(slot, 0, sizeof(*slot));
+      ch->unconfirmed_head = (ch->unconfirmed_head + 1) % conf->confirm_window;
+      ch->unconfirmed_num--;
+
+      if (m.state == CAMQP_MSG_ACKED) {
+        camqp_message_free(&m);
+        continue;
+      }
+
+      status = camqp_publish_confirmed(conf, ch, m);
+      if (status != 0)
+        return status;
+    }
+  }
+#endif
+
+  return 0;
+} /* }}} int camqp_republish */
+
+static int camqp_write_locked(camqp_config_t *conf, /* {{{ */
+                              const char *buffer, size_t buffer_len,
+                              const char *routing_key) {
+  camqp_channel_t *ch;
+  int status;
+
+  status = camqp_connect(conf);
+  if (status != 0)
+    return status;
+
+  /* Spread the messages over all channels. */
+  ch = conf->channels + conf->channel_next;
+  conf->channel_next = (conf->channel_next + 1) % conf->channels_num;
+
+#if CAMQP_HAVE_CONFIRMS
+  if (conf->confirm) {
+    camqp_message_t m = {0};
+
+    status = camqp_wait_confirms(conf, ch, conf->confirm_window - 1,
+                                 CAMQP_CONFIRM_TIMEOUT);
+    if (status != 0)
+      return status;
+
+    m.routing_key = strdup(routing_key);
+    m.body = malloc(buffer_len);
+    if ((m.routing_key == NULL) || (m.body == NULL)) {
+      ERROR("amqp plugin: malloc failed.");
+      camqp_message_free(&m);
+      return ENOMEM;
+    }
+    memcpy(m.body, buffer, buffer_len);
+    m.body_len = buffer_len;
+
+    status = camqp_publish_confirmed(conf, ch, m);
+    if (status != 0)
+      return status;
+
+    return camqp_poll_confirms(conf);
+  }
+#endif
+
+  return camqp_publish(conf, ch, routing_key, buffer, buffer_len);
 } /* }}} int camqp_write_locked */
 
+static void camqp_reset_buffer(camqp_config_t *conf) /* {{{ */
+{
+  memset(conf->send_buffer, 0, conf->buffer_size);
+  conf->send_buffer_fill = 0;
+  conf->send_buffer_free = conf->buffer_size;
+  conf->send_buffer_values = 0;
+  conf->send_buffer_init_time = cdtime();
+  conf->send_routing_key[0] = 0;
+
+  if (conf->format == CAMQP_FORMAT_JSON)
+    format_json_initialize(conf->send_buffer, &conf->send_buffer_fill,
+                           &conf->send_buffer_free);
+} /* }}} void camqp_reset_buffer */
+
+static int camqp_flush_nolock(cdtime_t timeout, camqp_config_t *conf) /* {{{ */
+{
+  int status;
+
+  /* timeout == 0  => flush unconditionally */
+  if (timeout > 0) {
+    if ((conf->send_buffer_init_time + timeout) > cdtime())
+      return 0;
+  }
+
+  if (conf->send_buffer_values == 0) {
+    conf->send_buffer_init_time = cdtime();
+    return 0;
+  }
+
+  if (conf->format == CAMQP_FORMAT_JSON) {
+    status = format_json_finalize(conf->send_buffer, &conf->send_buffer_fill,
+                                  &conf->send_buffer_free);
+    if (status != 0) {
+      ERROR("amqp plugin: format_json_finalize failed.");
+      camqp_reset_buffer(conf);
+      return status;
+    }
+  }
+
+  status = camqp_write_locked(conf, conf->send_buffer, conf->send_buffer_fill,
+                              conf->send_routing_key);
+  camqp_reset_buffer(conf);
+
+  return status;
+} /* }}} int camqp_flush_nolock */
+
+static int camqp_flush(cdtime_t timeout, /* {{{ */
+                       const char *identifier __attribute__((unused)),
+                       user_data_t *user_data) {
+  camqp_config_t *conf;
+  int status;
+
+  if (user_data == NULL)
+    return -EINVAL;
+
+  conf = user_data->data;
+
+  pthread_mutex_lock(&conf->lock);
+  status = camqp_flush_nolock(timeout, conf);
+  pthread_mutex_unlock(&conf->lock);
+
+  return status;
+} /* }}} int camqp_flush */
+
+/* Appends a value list to the send buffer. Returns -ENOMEM if it does not
+ * fit. */
+static int camqp_buffer_add(camqp_config_t *conf, /* {{{ */
+                            const data_set_t *ds, const value_list_t *vl) {
+  char line[8192];
+  size_t line_len;
+  int status;
+
+  if (conf->format == CAMQP_FORMAT_JSON) {
+    /* Keep a byte for the closing bracket added by format_json_finalize. */
+    size_t bfree = conf->send_buffer_free - 1;
+
+    status = format_json_value_list(conf->send_buffer, &conf->send_buffer_fill,
+                                    &bfree, ds, vl, conf->store_rates);
+    conf->send_buffer_free = bfree + 1;
+    return status;
+  }
+
+  if (conf->format == CAMQP_FORMAT_COMMAND) {
+    status = cmd_create_putval(line, sizeof(line) - 1, ds, vl);
+    if (status != 0) {
+      ERROR("amqp plugin: cmd_create_putval failed with status %i.", status);
+      return status;
+    }
+    line_len = strlen(line);
+    line[line_len++] = '\n';
+    line[line_len] = 0;
+  } else {
+    status = format_graphite(line, sizeof(line), ds, vl, conf->prefix,
+                             conf->postfix, conf->escape_char,
+                             conf->graphite_flags);
+    if (status != 0) {
+      ERROR("amqp plugin: format_graphite failed with status %i.", status);
+      return status;
+    }
+    line_len = strlen(line);
+  }
+
+  if (line_len >= conf->send_buffer_free)
+    return -ENOMEM;
+
+  memcpy(conf->send_buffer + conf->send_buffer_fill, line, line_len + 1);
+  conf->send_buffer_fill += line_len;
+  conf->send_buffer_free -= line_len;
+
+  return 0;
+} /* }}} int camqp_buffer_add */
+
+static int camqp_write_buffered(camqp_config_t *conf, /* {{{ */
+                                const data_set_t *ds, const value_list_t *vl,
+                                const char *routing_key) {
+  int status;
+
+  pthread_mutex_lock(&conf->lock);
+
+  /* All value lists in a message share its routing key. */
+  if ((conf->send_buffer_values > 0) &&
+      (strcmp(conf->send_routing_key, routing_key) != 0)) {
+    status = camqp_flush_nolock(/* timeout = */ 0, conf);
+    if (status != 0) {
+      pthread_mutex_unlock(&conf->lock);
+      return status;
+    }
+  }
+
+  status = camqp_buffer_add(conf, ds, vl);
+  if ((status == -ENOMEM) && (conf->send_buffer_values > 0)) {
+    status = camqp_flush_nolock(/* timeout = */ 0, conf);
+    if (status != 0) {
+      pthread_mutex_unlock(&conf->lock);
+      return status;
+    }
+
+    status = camqp_buffer_add(conf, ds, vl);
+  }
+  if (status != 0) {
+    if (status == -ENOMEM)
+      ERROR("amqp plugin: The value list does not fit into a buffer of "
+            "%zu bytes. Please increase \"BufferSize\".",
+            conf->buffer_size);
+    pthread_mutex_unlock(&conf->lock);
+    return status;
+  }
+
+  if (conf->send_buffer_values == 0)
+    sstrncpy(conf->send_routing_key, routing_key,
+             sizeof(conf->send_routing_key));
+  conf->send_buffer_values++;
+
+  pthread_mutex_unlock(&conf->lock);
+  return 0;
+} /* }}} int camqp_write_buffered */
+
 static int camqp_write(const data_set_t *ds, const value_list_t *vl, /* {{{ */
                        user_data_t *user_data) {
   camqp_config_t *conf = user_data->data;
@@ -772,6 +1352,9 @@ static int camqp_write(const data_set_t *ds, const value_list_t *vl, /* {{{ */
     }
   }
 
+  if (conf->send_buffer != NULL)
+    return camqp_write_buffered(conf, ds, vl, routing_key);
+
   if (conf->format == CAMQP_FORMAT_COMMAND) {
     status = cmd_create_putval(buffer, sizeof(buffer), ds, vl);
     if (status != 0) {
@@ -799,7 +1382,7 @@ static int camqp_write(const data_set_t *ds, const value_list_t *vl, /* {{{ */
   }
 
   pthread_mutex_lock(&conf->lock);
-  status = camqp_write_locked(conf, buffer, routing_key);
+  status = camqp_write_locked(conf, buffer, strlen(buffer), routing_key);
   pthread_mutex_unlock(&conf->lock);
 
   return status;
@@ -866,12 +1449,17 @@ static int camqp_config_connection(oconfig_item_t *ci, /* {{{ */
   conf->prefix = NULL;
   conf->postfix = NULL;
   conf->escape_char = '_';
+  /* publish, batching & confirms */
+  conf->buffer_size = 0;
+  conf->confirm = 0;
+  conf->confirm_window = 1000;
   /* subscribe only */
   conf->exchange_type = NULL;
   conf->queue = NULL;
   conf->queue_durable = 0;
   conf->queue_auto_delete = 1;
   /* general */
+  conf->channels_num = 1;
   conf->connection = NULL;
   pthread_mutex_init(&conf->lock, /* attr = */ NULL);
   /* }}} */
@@ -947,6 +1535,32 @@ static int camqp_config_connection(oconfig_item_t *ci, /* {{{ */
                 "only one character. Others will be ignored.");
       conf->escape_char = tmp_buff[0];
       sfree(tmp_buff);
+    } else if ((strcasecmp("BufferSize", child->key) == 0) && publish) {
+      int tmp = 0;
+      status = cf_util_get_int(child, &tmp);
+      if ((status == 0) && (tmp < 0)) {
+        WARNING("amqp plugin: \"BufferSize\" must not be negative.");
+        status = -1;
+      }
+      conf->buffer_size = (size_t)tmp;
+    } else if ((strcasecmp("Channels", child->key) == 0) && publish) {
+      status = cf_util_get_int(child, &conf->channels_num);
+      if ((status == 0) && ((conf->channels_num < 1) ||
+                            (conf->channels_num > CAMQP_CHANNELS_MAX))) {
+        WARNING("amqp plugin: \"Channels\" must be between 1 and %i.",
+                CAMQP_CHANNELS_MAX);
+        status = -1;
+      }
+    } else if ((strcasecmp("Confirm", child->key) == 0) && publish)
+      status = cf_util_get_boolean(child, &conf->confirm);
+    else if ((strcasecmp("ConfirmWindow", child->key) == 0) && publish) {
+      int tmp = 0;
+      status = cf_util_get_int(child, &tmp);
+      if ((status == 0) && (tmp < 1)) {
+        WARNING("amqp plugin: \"ConfirmWindow\" must be at least 1.");
+        status = -1;
+      }
+      conf->confirm_window = (size_t)tmp;
     } else if (strcasecmp("ConnectionRetryDelay", child->key) == 0)
       status = cf_util_get_int(child, &conf->connection_retry_delay);
     else
@@ -978,6 +1592,57 @@ static int camqp_config_connection(oconfig_item_t *ci, /* {{{ */
           conf->exchange);
   }
 
+#if !CAMQP_HAVE_CONFIRMS
+  if (conf->confirm) {
+    WARNING("amqp plugin: This version of librabbitmq does not support "
+            "publisher confirms. The \"Confirm\" option will be ignored.");
+    conf->confirm = 0;
+  }
+#endif
+
+  conf->channels = calloc(conf->channels_num, sizeof(*conf->channels));
+  if (conf->channels == NULL) {
+    ERROR("amqp plugin: calloc failed.");
+    camqp_config_free(conf);
+    return ENOMEM;
+  }
+  for (int i = 0; i < conf->channels_num; i++) {
+    conf->channels[i].id = (amqp_channel_t)(CAMQP_CHANNEL + i);
+    if (!conf->confirm)
+      continue;
+
+    conf->channels[i].unconfirmed =
+        calloc(conf->confirm_window, sizeof(*conf->channels[i].unconfirmed));
+    if (conf->channels[i].unconfirmed == NULL) {
+      ERROR("amqp plugin: calloc failed.");
+      camqp_config_free(conf);
+      return ENOMEM;
+    }
+  }
+
+  if (publish && (conf->buffer_size > 0)) {
+    /* Make room for at least one value list. */
+    if (conf->buffer_size < 1024)
+      conf->buffer_size = 1024;
+
+    conf->send_buffer = malloc(conf->buffer_size);
+    if (conf->send_buffer == NULL) {
+      ERROR("amqp plugin: malloc failed.");
+      camqp_config_free(conf);
+      return ENOMEM;
+    }
+    camqp_reset_buffer(conf);
+  }
+
+  if (!publish) {
+    conf->putval = cmd_putval_parser_create(/* opts = */ NULL);
+    if (conf->putval == NULL) {
+      ERROR("amqp plugin: cmd_putval_parser_create failed.");
+      camqp_config_free(conf);
+      return ENOMEM;
+    }
+  }
+
   if (publish) {
     char cbname[128];
     ssnprintf(cbname, sizeof(cbname), "amqp/%s", conf->name);
@@ -990,6 +1655,12 @@ static int camqp_config_connection(oconfig_item_t *ci, /* {{{ */
       camqp_config_free(conf);
       return status;
     }
+
+    if (conf->send_buffer != NULL)
+      plugin_register_flush(cbname, camqp_flush,
+                            &(user_data_t){
+                                .data = conf,
+                            });
   } else {
     status = camqp_subscribe_init(conf);
     if (status != 0) {
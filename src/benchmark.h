@@ -0,0 +1,208 @@
+/**
+ * collectd - src/benchmark.h
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+/*
+ * Minimal microbenchmark harness, the counterpart of "testing.h".
+ *
+ * A benchmark is defined with DEF_BENCH() and performs "b->iterations"
+ * operations. RUN_BENCH() calls it from the given number of threads at once,
+ * increasing the number of iterations until a run takes at least
+ * COLLECTD_BENCH_TIME seconds (default 0.5), and prints one JSON object per
+ * line:
+ *
+ *   {"suite":"utils_heap","benchmark":"insert_get","threads":4,
+ *    "iterations":4000000,"ns_per_op":61.2,"ops_per_sec":16339869.3}
+ *
+ * "iterations" is the total over all threads, "ns_per_op" the wall clock time
+ * of one operation as seen by a single thread. COLLECTD_BENCH_THREADS sets the
+ * number of threads used by BENCH_THREADS (default: number of CPUs, at least
+ * two and at most eight) and COLLECTD_BENCH_FILTER restricts the run to
+ * benchmarks whose name contains the given string.
+ */
+
+#ifndef BENCHMARK_H
+#define BENCHMARK_H 1
+
+#include <inttypes.h>
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+
+typedef struct {
+  void *arg;           /* argument passed to RUN_BENCH() */
+  size_t thread;       /* index of the calling thread */
+  size_t threads_num;  /* number of threads running the benchmark */
+  uint64_t iterations; /* number of operations to perform */
+} bench_t;
+
+typedef void (*bench_func_t)(bench_t *);
+
+struct bench_thread_s {
+  bench_t b;
+  bench_func_t func;
+  pthread_barrier_t *barrier;
+  pthread_t tid;
+};
+
+/* Sink for results which would otherwise be optimized away. */
+static volatile uintptr_t bench_sink__;
+
+#define BENCH_KEEP(v) (bench_sink__ += (uintptr_t)(v))
+
+#define DEF_BENCH(func) static void bench_##func(bench_t *b)
+
+#define RUN_BENCH(func, threads, arg)                                          \
+  bench_run__(__FILE__, #func, bench_##func, (threads), (arg))
+
+#define BENCH_THREADS bench_threads__()
+
+static double bench_now__(void) {
+  struct timespec ts = {0};
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (double)ts.tv_sec + ((double)ts.tv_nsec) / 1e9;
+}
+
+static double bench_env_double__(char const *name, double def) {
+  char const *value = getenv(name);
+  char *endptr = NULL;
+  double ret;
+
+  if ((value == NULL) || (value[0] == 0))
+    return def;
+
+  ret = strtod(value, &endptr);
+  if ((endptr == value) || (ret <= 0.0))
+    return def;
+  return ret;
+}
+
+static size_t bench_threads__(void) {
+  long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+  double def;
+
+  if (cpus < 2)
+    cpus = 2;
+  else if (cpus > 8)
+    cpus = 8;
+  def = (double)cpus;
+
+  return (size_t)bench_env_double__("COLLECTD_BENCH_THREADS", def);
+}
+
+static void *bench_thread__(void *arg) {
+  struct bench_thread_s *t = arg;
+
+  pthread_barrier_wait(t->barrier);
+  t->func(&t->b);
+  return NULL;
+}
+
+/* Runs "func" with "iterations" operations per thread. Returns the elapsed
+ * wall clock time in seconds. */
+static double bench_run_once__(bench_func_t func, size_t threads_num,
+                               void *arg, uint64_t iterations) {
+  struct bench_thread_s threads[threads_num];
+  pthread_barrier_t barrier;
+  double start;
+
+  pthread_barrier_init(&barrier, NULL, (unsigned)(threads_num + 1));
+  for (size_t i = 0; i < threads_num; i++) {
+    threads[i] = (struct bench_thread_s){
+        .b =
+            {
+                .arg = arg,
+                .thread = i,
+                .threads_num = threads_num,
+                .iterations = iterations,
+            },
+        .func = func,
+        .barrier = &barrier,
+    };
+    if (pthread_create(&threads[i].tid, NULL, bench_thread__, threads + i) !=
+        0) {
+      fprintf(stderr, "pthread_create failed\n");
+      exit(EXIT_FAILURE);
+    }
+  }
+
+  pthread_barrier_wait(&barrier);
+  start = bench_now__();
+  for (size_t i = 0; i < threads_num; i++)
+    pthread_join(threads[i].tid, NULL);
+
+  pthread_barrier_destroy(&barrier);
+  return bench_now__() - start;
+}
+
+static void bench_run__(char const *file, char const *name, bench_func_t func,
+                        size_t threads_num, void *arg) {
+  double min_time = bench_env_double__("COLLECTD_BENCH_TIME", 0.5);
+  char const *filter = getenv("COLLECTD_BENCH_FILTER");
+  char suite[64];
+  char const *ptr;
+  uint64_t iterations = 1;
+  uint64_t total;
+  double elapsed;
+
+  if ((filter != NULL) && (strstr(name, filter) == NULL))
+    return;
+
+  if (threads_num < 1)
+    threads_num = 1;
+
+  /* "src/daemon/utils_heap_bench.c" -> "utils_heap" */
+  ptr = strrchr(file, '/');
+  snprintf(suite, sizeof(suite), "%s", (ptr != NULL) ? ptr + 1 : file);
+  if ((ptr = strstr(suite, "_bench.c")) != NULL)
+    suite[ptr - suite] = 0;
+
+  while (42) {
+    double predicted;
+
+    elapsed = bench_run_once__(func, threads_num, arg, iterations);
+    if ((elapsed >= min_time) || (iterations >= (UINT64_C(1) << 40)))
+      break;
+
+    /* Aim for 20% above the minimum time, but grow at most 100 fold per
+     * round so that a noisy first round can't cause a huge run. */
+    predicted = (elapsed > 0.0)
+                    ? ((double)iterations) * 1.2 * min_time / elapsed
+                    : ((double)iterations) * 100.0;
+    if (predicted > ((double)iterations) * 100.0)
+      predicted = ((double)iterations) * 100.0;
+    if (predicted < ((double)iterations) * 2.0)
+      predicted = ((double)iterations) * 2.0;
+    iterations = (uint64_t)predicted;
+  }
+
+  total = iterations * threads_num;
+  printf("{\"suite\":\"%s\",\"benchmark\":\"%s\",\"threads\":%zu,"
+         "\"iterations\":%" PRIu64 ",\"ns_per_op\":%.1f,"
+         "\"ops_per_sec\":%.1f}\n",
+         suite, name, threads_num, total,
+         1e9 * elapsed / ((double)iterations),
+         ((double)total) / elapsed);
+  fflush(stdout);
+}
+
+#endif /* BENCHMARK_H */
@@ -33,7 +33,9 @@
 #endif
 
 #include <errno.h>
+#include <inttypes.h>
 #include <math.h>
+#include <pthread.h>
 #include <signal.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -51,22 +53,47 @@
 #define DEF_NUM_PLUGINS 20
 #define DEF_NUM_VALUES 100000
 #define DEF_INTERVAL 10.0
+#define DEF_NUM_THREADS 1
+
+/* Senders publish their counters to the global statistics in batches of this
+ * many values so that the lock isn't taken for every single value. */
+#define STATS_BATCH_SIZE 1024
+
+struct sender_s {
+  pthread_t thread;
+  lcc_network_t *net;
+  c_heap_t *values_heap;
+
+  /* Values per second this thread sends, or zero to send each value list
+   * once per interval. */
+  double rate;
+
+  uint64_t values_sent;
+  uint64_t send_errors;
+};
+typedef struct sender_s sender_t;
 
 static int conf_num_hosts = DEF_NUM_HOSTS;
 static int conf_num_plugins = DEF_NUM_PLUGINS;
 static int conf_num_values = DEF_NUM_VALUES;
+static int conf_num_threads = DEF_NUM_THREADS;
 static double conf_interval = DEF_INTERVAL;
+static double conf_rate = 0.0;
+static double conf_duration = 0.0;
 static const char *conf_destination = NET_DEFAULT_V6_ADDR;
 static const char *conf_service = NET_DEFAULT_PORT;
 
-static lcc_network_t *net;
+static sender_t *senders = NULL;
 
-static c_heap_t *values_heap = NULL;
+static pthread_mutex_t stats_lock = PTHREAD_MUTEX_INITIALIZER;
+static uint64_t stats_values_sent = 0;
+static uint64_t stats_send_errors = 0;
+static double stats_lag_max = 0.0;
 
 static struct sigaction sigint_action;
 static struct sigaction sigterm_action;
 
-static _Bool loop = 1;
+static volatile _Bool loop = 1;
 
 __attribute__((noreturn)) static void exit_usage(int exit_status) /* {{{ */
 {
@@ -81,6 +108,10 @@ __attribute__((noreturn)) static void exit_usage(int exit_status) /* {{{ */
       "    -H <number>    Number of hosts to emulate. (Default: %i)\n"
       "    -p <number>    Number of plugins to emulate. (Default: %i)\n"
       "    -i <seconds>   Interval of each value in seconds. (Default: %.3f)\n"
+      "    -t <number>    Number of sender threads. (Default: %i)\n"
+      "    -r <rate>      Send this many values per second in total,\n"
+      "                   regardless of the interval. (Default: off)\n"
+      "    -l <seconds>   Stop after this many seconds. (Default: off)\n"
       "    -d <dest>      Destination address of the network packets.\n"
       "                   (Default: %s)\n"
       "    -D <port>      Destination port of the network packets.\n"
@@ -90,7 +121,7 @@ __attribute__((noreturn)) static void exit_usage(int exit_status) /* {{{ */
       "Copyright (C) 2010-2012  Florian Forster\n"
       "Licensed under the MIT license.\n",
       DEF_NUM_VALUES, DEF_NUM_HOSTS, DEF_NUM_PLUGINS, DEF_INTERVAL,
-      NET_DEFAULT_V6_ADDR, NET_DEFAULT_PORT);
+      DEF_NUM_THREADS, NET_DEFAULT_V6_ADDR, NET_DEFAULT_PORT);
   exit(exit_status);
 } /* }}} void exit_usage */
 
@@ -211,7 +242,7 @@ static void destroy_value_list(lcc_value_list_t *vl) /* {{{ */
   free(vl);
 } /* }}} void destroy_value_list */
 
-static int send_value(lcc_value_list_t *vl) /* {{{ */
+static int send_value(sender_t *s, lcc_value_list_t *vl) /* {{{ */
 {
   int status;
 
@@ -221,9 +252,11 @@ static int send_value(lcc_value_list_t *vl) /* {{{ */
   else
     vl->values[0].derive += (derive_t)get_boundet_random(0, 100);
 
-  status = lcc_network_values_send(net, vl);
-  if (status != 0)
+  status = lcc_network_values_send(s->net, vl);
+  if (status != 0) {
     fprintf(stderr, "lcc_network_values_send failed with status %i.\n", status);
+    s->send_errors++;
+  }
 
   vl->time += vl->interval;
 
@@ -282,7 +315,7 @@ static int read_options(int argc, char **argv) /* {{{ */
 {
   int opt;
 
-  while ((opt = getopt(argc, argv, "n:H:p:i:d:D:h")) != -1) {
+  while ((opt = getopt(argc, argv, "n:H:p:i:t:r:l:d:D:h")) != -1) {
     switch (opt) {
     case 'n':
       get_integer_opt(optarg, &conf_num_values);
@@ -300,6 +333,18 @@ static int read_options(int argc, char **argv) /* {{{ */
       get_double_opt(optarg, &conf_interval);
       break;
 
+    case 't':
+      get_integer_opt(optarg, &conf_num_threads);
+      break;
+
+    case 'r':
+      get_double_opt(optarg, &conf_rate);
+      break;
+
+    case 'l':
+      get_double_opt(optarg, &conf_duration);
+      break;
+
     case 'd':
       conf_destination = optarg;
       break;
@@ -316,13 +361,189 @@ static int read_options(int argc, char **argv) /* {{{ */
     } /* switch (opt) */
   }   /* while (getopt) */
 
+  if ((conf_num_values < 1) || (conf_num_threads < 1) || (conf_rate < 0.0) ||
+      (conf_duration < 0.0)) {
+    fprintf(stderr, "Invalid option value.\n");
+    exit_usage(EXIT_FAILURE);
+  }
+  if (conf_num_threads > conf_num_values)
+    conf_num_threads = conf_num_values;
+
   return 0;
 } /* }}} int read_options */
 
+static void sleep_until(double when) /* {{{ */
+{
+  double now = dtime();
+
+  while (loop && (now < when)) {
+    double diff = when - now;
+    struct timespec ts = {
+        .tv_sec = (time_t)diff,
+    };
+    ts.tv_nsec = (long)((diff - ((double)ts.tv_sec)) * 1e9);
+
+    nanosleep(&ts, /* remaining = */ NULL);
+    now = dtime();
+  }
+} /* }}} void sleep_until */
+
+static void sender_publish_stats(sender_t *s, double lag_max) /* {{{ */
+{
+  pthread_mutex_lock(&stats_lock);
+  stats_values_sent += s->values_sent;
+  stats_send_errors += s->send_errors;
+  if (stats_lag_max < lag_max)
+    stats_lag_max = lag_max;
+  pthread_mutex_unlock(&stats_lock);
+
+  s->values_sent = 0;
+  s->send_errors = 0;
+} /* }}} void sender_publish_stats */
+
+/* Sends each value list once per interval, in the order of their time
+ * stamps. */
+static void sender_loop_interval(sender_t *s) /* {{{ */
+{
+  double last_time = 0.0;
+  double lag_max = 0.0;
+
+  while (loop) {
+    lcc_value_list_t *vl = c_heap_get_root(s->values_heap);
+
+    if (vl == NULL)
+      break;
+
+    if (vl->time != last_time) {
+      double now = dtime();
+
+      if (now < vl->time) {
+        sender_publish_stats(s, lag_max);
+        sleep_until(vl->time);
+      } else if ((now - vl->time) > lag_max) {
+        lag_max = now - vl->time;
+      }
+      last_time = vl->time;
+    }
+
+    send_value(s, vl);
+    s->values_sent++;
+
+    c_heap_insert(s->values_heap, vl);
+
+    if (s->values_sent >= STATS_BATCH_SIZE)
+      sender_publish_stats(s, lag_max);
+  }
+
+  sender_publish_stats(s, lag_max);
+} /* }}} void sender_loop_interval */
+
+/* Open-loop rate control: value number n is due at start + n / rate, no matter
+ * how long sending the previous values took. If the sender falls behind, it
+ * sends as fast as it can until it has caught up; the lag is reported. */
+static void sender_loop_rate(sender_t *s) /* {{{ */
+{
+  double start = dtime();
+  double lag_max = 0.0;
+  uint64_t n = 0;
+
+  while (loop) {
+    lcc_value_list_t *vl = c_heap_get_root(s->values_heap);
+    double due = start + ((double)n) / s->rate;
+    double now = dtime();
+
+    if (vl == NULL)
+      break;
+
+    /* Don't sleep for less than a millisecond; the schedule is absolute,
+     * so the average rate is not affected by this. */
+    if ((due - now) > 0.001) {
+      sender_publish_stats(s, lag_max);
+      sleep_until(due);
+    } else if ((now - due) > lag_max) {
+      lag_max = now - due;
+    }
+
+    send_value(s, vl);
+    s->values_sent++;
+    n++;
+
+    c_heap_insert(s->values_heap, vl);
+
+    if (s->values_sent >= STATS_BATCH_SIZE)
+      sender_publish_stats(s, lag_max);
+  }
+
+  sender_publish_stats(s, lag_max);
+} /* }}} void sender_loop_rate */
+
+static void *sender_thread(void *arg) /* {{{ */
+{
+  sender_t *s = arg;
+
+  if (s->rate > 0.0)
+    sender_loop_rate(s);
+  else
+    sender_loop_interval(s);
+
+  return NULL;
+} /* }}} void *sender_thread */
+
+static int sender_init(sender_t *s) /* {{{ */
+{
+  lcc_server_t *srv;
+
+  s->values_heap = c_heap_create(compare_time);
+  if (s->values_heap == NULL) {
+    fprintf(stderr, "c_heap_create failed.\n");
+    return -1;
+  }
+
+  s->net = lcc_network_create();
+  if (s->net == NULL) {
+    fprintf(stderr, "lcc_network_create failed.\n");
+    return -1;
+  }
+
+  srv = lcc_server_create(s->net, conf_destination, conf_service);
+  if (srv == NULL) {
+    fprintf(stderr, "lcc_server_create failed.\n");
+    return -1;
+  }
+
+  lcc_server_set_ttl(srv, 42);
+#if 0
+  lcc_server_set_security_level (srv, ENCRYPT,
+      "admin", "password1");
+#endif
+
+  s->rate = conf_rate / ((double)conf_num_threads);
+  return 0;
+} /* }}} int sender_init */
+
+static void sender_destroy(sender_t *s) /* {{{ */
+{
+  if (s->values_heap != NULL) {
+    while (42) {
+      lcc_value_list_t *vl = c_heap_get_root(s->values_heap);
+      if (vl == NULL)
+        break;
+      destroy_value_list(vl);
+    }
+    c_heap_destroy(s->values_heap);
+  }
+
+  if (s->net != NULL)
+    lcc_network_destroy(s->net);
+} /* }}} void sender_destroy */
+
 int main(int argc, char **argv) /* {{{ */
 {
-  double last_time;
-  int values_sent = 0;
+  double start_time;
+  double elapsed;
+  uint64_t values_sent;
+  uint64_t send_errors;
+  double lag_max;
 
   read_options(argc, argv);
 
@@ -332,30 +553,15 @@ int main(int argc, char **argv) /* {{{ */
   sigterm_action.sa_handler = signal_handler;
   sigaction(SIGTERM, &sigterm_action, /* old = */ NULL);
 
-  values_heap = c_heap_create(compare_time);
-  if (values_heap == NULL) {
-    fprintf(stderr, "c_heap_create failed.\n");
+  senders = calloc((size_t)conf_num_threads, sizeof(*senders));
+  if (senders == NULL) {
+    fprintf(stderr, "calloc failed.\n");
     exit(EXIT_FAILURE);
   }
 
-  net = lcc_network_create();
-  if (net == NULL) {
-    fprintf(stderr, "lcc_network_create failed.\n");
-    exit(EXIT_FAILURE);
-  } else {
-    lcc_server_t *srv;
-
-    srv = lcc_server_create(net, conf_destination, conf_service);
-    if (srv == NULL) {
-      fprintf(stderr, "lcc_server_create failed.\n");
+  for (int i = 0; i < conf_num_threads; i++) {
+    if (sender_init(senders + i) != 0)
       exit(EXIT_FAILURE);
-    }
-
-    lcc_server_set_ttl(srv, 42);
-#if 0
-    lcc_server_set_security_level (srv, ENCRYPT,
-        "admin", "password1");
-#endif
   }
 
   fprintf(stdout, "Creating %i values ... ", conf_num_values);
@@ -369,56 +575,61 @@ int main(int argc, char **argv) /* {{{ */
       exit(EXIT_FAILURE);
     }
 
-    c_heap_insert(values_heap, vl);
+    c_heap_insert(senders[i % conf_num_threads].values_heap, vl);
   }
   fprintf(stdout, "done\n");
 
-  last_time = 0;
-  while (loop) {
-    lcc_value_list_t *vl = c_heap_get_root(values_heap);
-
-    if (vl == NULL)
-      break;
-
-    if (vl->time != last_time) {
-      printf("%i values have been sent.\n", values_sent);
-
-      /* Check if we need to sleep */
-      double now = dtime();
+  start_time = dtime();
+  for (int i = 0; i < conf_num_threads; i++) {
+    int status = pthread_create(&senders[i].thread, /* attr = */ NULL,
+                                sender_thread, senders + i);
+    if (status != 0) {
+      fprintf(stderr, "pthread_create failed: %s\n", strerror(status));
+      exit(EXIT_FAILURE);
+    }
+  }
 
-      while (now < vl->time) {
-        double diff = vl->time - now;
-        struct timespec ts = {
-            .tv_sec = (time_t)diff,
-        };
-        ts.tv_nsec = (long)((diff - ((double)ts.tv_sec)) * 1e9);
+  while (loop) {
+    double next = dtime() + 1.0;
 
-        nanosleep(&ts, /* remaining = */ NULL);
-        now = dtime();
+    if ((conf_duration > 0.0) && (next > (start_time + conf_duration)))
+      next = start_time + conf_duration;
 
-        if (!loop)
-          break;
-      }
-      last_time = vl->time;
-    }
+    sleep_until(next);
 
-    send_value(vl);
-    values_sent++;
+    pthread_mutex_lock(&stats_lock);
+    values_sent = stats_values_sent;
+    pthread_mutex_unlock(&stats_lock);
+    printf("%" PRIu64 " values have been sent.\n", values_sent);
+    fflush(stdout);
 
-    c_heap_insert(values_heap, vl);
+    if ((conf_duration > 0.0) && (dtime() >= (start_time + conf_duration)))
+      loop = 0;
   }
 
   fprintf(stdout, "Shutting down.\n");
   fflush(stdout);
 
-  while (42) {
-    lcc_value_list_t *vl = c_heap_get_root(values_heap);
-    if (vl == NULL)
-      break;
-    destroy_value_list(vl);
-  }
-  c_heap_destroy(values_heap);
+  for (int i = 0; i < conf_num_threads; i++)
+    pthread_join(senders[i].thread, /* retval = */ NULL);
+  elapsed = dtime() - start_time;
+
+  for (int i = 0; i < conf_num_threads; i++)
+    sender_destroy(senders + i);
+  free(senders);
+
+  pthread_mutex_lock(&stats_lock);
+  values_sent = stats_values_sent;
+  send_errors = stats_send_errors;
+  lag_max = stats_lag_max;
+  pthread_mutex_unlock(&stats_lock);
+
+  fprintf(stdout,
+          "Sent %" PRIu64 " values in %.3f seconds (%.1f values/s); "
+          "%" PRIu64 " send errors; maximum lag %.3f seconds.\n",
+          values_sent, elapsed,
+          (elapsed > 0.0) ? ((double)values_sent) / elapsed : 0.0, send_errors,
+          lag_max);
 
-  lcc_network_destroy(net);
   exit(EXIT_SUCCESS);
 } /* }}} int main */
@@ -175,6 +175,9 @@ extern PyTypeObject ValuesType;
 #define Values_New()                                                           \
   PyObject_CallFunctionObjArgs((PyObject *)&ValuesType, (void *)0)
 
+/* Convert a Values object to a value list, see pyvalues.c. */
+int cpy_values_to_value_list(PyObject *obj, value_list_t *vl);
+
 typedef struct {
   PluginData data;
   int severity;
@@ -25,17 +25,65 @@
 
 #include "common.h"
 #include "plugin.h"
+#include "utils_avltree.h"
 #include "utils_cache.h"
 
+/*
+ * Private data types
+ */
+/* An open CSV file. Files are kept open and looked up by name, so that writing
+ * a value list doesn't have to stat(2), open(2) and close(2) the file each
+ * time. Lines may be collected in a per-file buffer and appended in one go. */
+typedef struct csv_file_s csv_file_t;
+struct csv_file_s {
+  char *filename;
+  int fd;
+  dev_t dev;
+  ino_t ino;
+
+  /* "lock" protects the file and the buffer, so that writing a line doesn't
+   * block writers of other files. */
+  pthread_mutex_t lock;
+  char *buffer;
+  size_t buffer_fill;
+  cdtime_t buffer_since;
+
+  /* Protected by files_lock. The number of csv_write() calls using the file
+   * and whether it has been removed from the cache. A removed file is closed
+   * by its last user. */
+  size_t refs;
+  _Bool removed;
+
+  /* LRU list, most recently written file first. */
+  csv_file_t *prev;
+  csv_file_t *next;
+};
+
 /*
  * Private variables
  */
-static const char *config_keys[] = {"DataDir", "StoreRates"};
+static const char *config_keys[] = {"DataDir", "StoreRates", "MaxOpenFiles",
+                                    "WriteBufferSize", "FlushTimeout"};
 static int config_keys_num = STATIC_ARRAY_SIZE(config_keys);
 
 static char *datadir = NULL;
 static int store_rates = 0;
 static int use_stdio = 0;
+static size_t max_open_files = 128;
+static size_t write_buffer_size = 0;
+static cdtime_t flush_timeout = 0;
+
+/* files_lock protects all of the following. */
+static pthread_mutex_t files_lock = PTHREAD_MUTEX_INITIALIZER;
+static c_avl_tree_t *files_tree = NULL;
+static csv_file_t *files_head = NULL;
+static csv_file_t *files_tail = NULL;
+static size_t files_num = 0;
+static cdtime_t files_next_sweep = 0;
+
+/* "-2013-07-12" of the current day and the time at which it becomes stale. */
+static char date_suffix[16] = "";
+static time_t date_valid_until = 0;
 
 static int value_list_to_string(char *buffer, int buffer_len,
                                 const data_set_t *ds, const value_list_t *vl) {
@@ -103,8 +151,6 @@ static int value_list_to_filename(char *buffer, size_t buffer_size,
 
   char *ptr = buffer;
   size_t ptr_size = buffer_size;
-  time_t now;
-  struct tm struct_tm;
 
   if (datadir != NULL) {
     size_t len = strlen(datadir) + 1;
@@ -130,53 +176,326 @@ static int value_list_to_filename(char *buffer, size_t buffer_size,
   ptr_size -= strlen(ptr);
   ptr += strlen(ptr);
 
-  /* "-2013-07-12" => 11 bytes */
-  if (ptr_size < 12) {
+  /* The suffix is maintained by csv_update_date(), which must have been
+   * called with files_lock held. */
+  if (ptr_size <= strlen(date_suffix)) {
     ERROR("csv plugin: Buffer too small.");
     return ENOMEM;
   }
+  sstrncpy(ptr, date_suffix, ptr_size);
 
-  /* TODO: Find a way to minimize the calls to `localtime_r',
-   * since they are pretty expensive.. */
-  now = time(NULL);
-  if (localtime_r(&now, &struct_tm) == NULL) {
-    ERROR("csv plugin: localtime_r failed");
+  return 0;
+} /* int value_list_to_filename */
+
+/* Writes "data" to "fd" while holding a write lock on the file. */
+static int csv_write_fd(int fd, const char *filename, const char *data,
+                        size_t data_len) {
+  struct flock fl = {0};
+  int status = 0;
+
+  fl.l_pid = getpid();
+  fl.l_type = F_WRLCK;
+  fl.l_whence = SEEK_SET;
+
+  if (fcntl(fd, F_SETLK, &fl) != 0) {
+    char errbuf[1024];
+    ERROR("csv plugin: flock (%s) failed: %s", filename,
+          sstrerror(errno, errbuf, sizeof(errbuf)));
     return -1;
   }
 
-  status = strftime(ptr, ptr_size, "-%Y-%m-%d", &struct_tm);
-  if (status == 0) /* yep, it returns zero on error. */
-  {
-    ERROR("csv plugin: strftime failed");
-    return -1;
+  while (data_len > 0) {
+    ssize_t written = write(fd, data, data_len);
+    if (written < 0) {
+      char errbuf[1024];
+
+      if (errno == EINTR)
+        continue;
+
+      ERROR("csv plugin: write (%s) failed: %s", filename,
+            sstrerror(errno, errbuf, sizeof(errbuf)));
+      status = -1;
+      break;
+    }
+
+    data += written;
+    data_len -= (size_t)written;
   }
 
-  return 0;
-} /* int value_list_to_filename */
+  fl.l_type = F_UNLCK;
+  fcntl(fd, F_SETLK, &fl);
 
-static int csv_create_file(const char *filename, const data_set_t *ds) {
-  FILE *csv;
+  return status;
+} /* int csv_write_fd */
+
+/* Opens "filename" for appending, creating it (and writing the header line)
+ * if it doesn't exist yet. */
+static int csv_open_file(const char *filename, const data_set_t *ds) {
+  char header[4096];
+  size_t header_len;
+  int fd;
+
+  fd = open(filename, O_WRONLY | O_APPEND);
+  if ((fd >= 0) || (errno != ENOENT))
+    return fd;
 
   if (check_create_dir(filename))
     return -1;
 
-  csv = fopen(filename, "w");
-  if (csv == NULL) {
+  fd = open(filename, O_WRONLY | O_APPEND | O_CREAT | O_EXCL, 0666);
+  if ((fd < 0) && (errno == EEXIST)) /* somebody else was quicker */
+    return open(filename, O_WRONLY | O_APPEND);
+  else if (fd < 0)
+    return -1;
+
+  sstrncpy(header, "epoch", sizeof(header));
+  for (size_t i = 0; i < ds->ds_num; i++) {
+    header_len = strlen(header);
+    ssnprintf(header + header_len, sizeof(header) - header_len, ",%s",
+              ds->ds[i].name);
+  }
+  header_len = strlen(header);
+  if (header_len < sizeof(header) - 1)
+    header[header_len++] = '\n';
+
+  if (csv_write_fd(fd, filename, header, header_len) != 0) {
+    close(fd);
+    return -1;
+  }
+
+  return fd;
+} /* int csv_open_file */
+
+/* Appends the buffered lines of "f" to the file. */
+static int csv_file_flush(csv_file_t *f) {
+  int status;
+
+  if (f->buffer_fill == 0)
+    return 0;
+
+  status = csv_write_fd(f->fd, f->filename, f->buffer, f->buffer_fill);
+  f->buffer_fill = 0;
+  return status;
+} /* int csv_file_flush */
+
+/* Flushes and closes "f". The caller must be its last user. */
+static void csv_file_close(csv_file_t *f) {
+  csv_file_flush(f);
+  close(f->fd);
+  pthread_mutex_destroy(&f->lock);
+
+  sfree(f->filename);
+  sfree(f->buffer);
+  sfree(f);
+} /* void csv_file_close */
+
+/* Removes "f" from the cache. */
+static void csv_file_remove(csv_file_t *f) {
+  if (f->removed)
+    return;
+
+  if (f->prev != NULL)
+    f->prev->next = f->next;
+  else
+    files_head = f->next;
+  if (f->next != NULL)
+    f->next->prev = f->prev;
+  else
+    files_tail = f->prev;
+
+  c_avl_remove(files_tree, f->filename, NULL, NULL);
+  files_num--;
+  f->removed = 1;
+} /* void csv_file_remove */
+
+/* Removes "f" from the cache and closes it, unless it is still being written
+ * to. */
+static void csv_file_destroy(csv_file_t *f) {
+  csv_file_remove(f);
+  if (f->refs == 0)
+    csv_file_close(f);
+} /* void csv_file_destroy */
+
+static void csv_close_all(void) {
+  while (files_head != NULL)
+    csv_file_destroy(files_head);
+} /* void csv_close_all */
+
+/* Returns the cache entry of "filename", opening the file if necessary, and
+ * makes it the most recently used one. */
+static csv_file_t *csv_file_get(const char *filename, const data_set_t *ds) {
+  csv_file_t *f = NULL;
+  struct stat statbuf;
+
+  if (c_avl_get(files_tree, filename, (void *)&f) == 0) {
+    if (f != files_head) {
+      f->prev->next = f->next;
+      if (f->next != NULL)
+        f->next->prev = f->prev;
+      else
+        files_tail = f->prev;
+
+      f->prev = NULL;
+      f->next = files_head;
+      files_head->prev = f;
+      files_head = f;
+    }
+    return f;
+  }
+
+  f = calloc(1, sizeof(*f));
+  if (f == NULL) {
+    ERROR("csv plugin: calloc failed.");
+    return NULL;
+  }
+
+  f->fd = csv_open_file(filename, ds);
+  if (f->fd < 0) {
     char errbuf[1024];
-    ERROR("csv plugin: fopen (%s) failed: %s", filename,
+    ERROR("csv plugin: open (%s) failed: %s", filename,
           sstrerror(errno, errbuf, sizeof(errbuf)));
+    sfree(f);
+    return NULL;
+  }
+
+  if (fstat(f->fd, &statbuf) != 0) {
+    char errbuf[1024];
+    ERROR("stat(%s) failed: %s", filename,
+          sstrerror(errno, errbuf, sizeof(errbuf)));
+    close(f->fd);
+    sfree(f);
+    return NULL;
+  } else if (!S_ISREG(statbuf.st_mode)) {
+    ERROR("stat(%s): Not a regular file!", filename);
+    close(f->fd);
+    sfree(f);
+    return NULL;
+  }
+  f->dev = statbuf.st_dev;
+  f->ino = statbuf.st_ino;
+
+  f->filename = strdup(filename);
+  if (f->filename == NULL) {
+    ERROR("csv plugin: strdup failed.");
+    close(f->fd);
+    sfree(f);
+    return NULL;
+  }
+
+  if (c_avl_insert(files_tree, f->filename, f) != 0) {
+    ERROR("csv plugin: c_avl_insert failed.");
+    close(f->fd);
+    sfree(f->filename);
+    sfree(f);
+    return NULL;
+  }
+  pthread_mutex_init(&f->lock, /* attr = */ NULL);
+
+  f->next = files_head;
+  if (files_head != NULL)
+    files_head->prev = f;
+  else
+    files_tail = f;
+  files_head = f;
+  files_num++;
+
+  return f;
+} /* csv_file_t *csv_file_get */
+
+/* Appends one line to "f", either directly or via the write buffer. */
+static int csv_file_append(csv_file_t *f, const char *line, size_t line_len,
+                           cdtime_t now) {
+  if (write_buffer_size == 0)
+    return csv_write_fd(f->fd, f->filename, line, line_len);
+
+  if ((f->buffer_fill + line_len) > write_buffer_size) {
+    if (csv_file_flush(f) != 0)
+      return -1;
+  }
+
+  if (line_len > write_buffer_size)
+    return csv_write_fd(f->fd, f->filename, line, line_len);
+
+  if (f->buffer == NULL) {
+    f->buffer = malloc(write_buffer_size);
+    if (f->buffer == NULL) {
+      ERROR("csv plugin: malloc failed.");
+      return -1;
+    }
+  }
+
+  if (f->buffer_fill == 0)
+    f->buffer_since = now;
+  memcpy(f->buffer + f->buffer_fill, line, line_len);
+  f->buffer_fill += line_len;
+
+  return 0;
+} /* int csv_file_append */
+
+/* Updates date_suffix if the day changed. Files of the previous day are
+ * closed, since nothing is going to be appended to them anymore. */
+static int csv_update_date(time_t now) {
+  struct tm struct_tm;
+  char suffix[sizeof(date_suffix)];
+  time_t valid_until;
+
+  if (now < date_valid_until)
+    return 0;
+
+  if (localtime_r(&now, &struct_tm) == NULL) {
+    ERROR("csv plugin: localtime_r failed");
+    return -1;
+  }
+
+  if (strftime(suffix, sizeof(suffix), "-%Y-%m-%d", &struct_tm) ==
+      0) /* yep, it returns zero on error. */
+  {
+    ERROR("csv plugin: strftime failed");
     return -1;
   }
 
-  fprintf(csv, "epoch");
-  for (size_t i = 0; i < ds->ds_num; i++)
-    fprintf(csv, ",%s", ds->ds[i].name);
+  if (strcmp(suffix, date_suffix) != 0) {
+    csv_close_all();
+    sstrncpy(date_suffix, suffix, sizeof(date_suffix));
+  }
 
-  fprintf(csv, "\n");
-  fclose(csv);
+  /* Midnight of the next day; mktime() normalizes the date and takes care of
+   * daylight saving time. */
+  struct_tm.tm_sec = 0;
+  struct_tm.tm_min = 0;
+  struct_tm.tm_hour = 0;
+  struct_tm.tm_mday++;
+  struct_tm.tm_isdst = -1;
+  valid_until = mktime(&struct_tm);
+  date_valid_until = (valid_until > now) ? valid_until : now + 1;
 
   return 0;
-} /* int csv_create_file */
+} /* int csv_update_date */
+
+/* Flushes all write buffers and closes files which have been removed or
+ * replaced, e.g. by log rotation, so that they are recreated. */
+static void csv_sweep(void) {
+  csv_file_t *next;
+
+  for (csv_file_t *f = files_head; f != NULL; f = next) {
+    struct stat statbuf;
+    int status;
+
+    next = f->next;
+
+    if ((stat(f->filename, &statbuf) != 0) || (statbuf.st_dev != f->dev) ||
+        (statbuf.st_ino != f->ino)) {
+      csv_file_destroy(f);
+      continue;
+    }
+
+    pthread_mutex_lock(&f->lock);
+    status = csv_file_flush(f);
+    pthread_mutex_unlock(&f->lock);
+    if (status != 0)
+      csv_file_destroy(f);
+  }
+} /* void csv_sweep */
 
 static int csv_config(const char *key, const char *value) {
   if (strcasecmp("DataDir", key) == 0) {
@@ -208,20 +527,58 @@ static int csv_config(const char *key, const char *value) {
       store_rates = 1;
     else
       store_rates = 0;
+  } else if (strcasecmp("MaxOpenFiles", key) == 0) {
+    int tmp = atoi(value);
+    if (tmp < 0) {
+      WARNING("csv plugin: Invalid value for MaxOpenFiles: %s", value);
+      return 1;
+    }
+    max_open_files = (size_t)tmp;
+  } else if (strcasecmp("WriteBufferSize", key) == 0) {
+    int tmp = atoi(value);
+    if (tmp < 0) {
+      WARNING("csv plugin: Invalid value for WriteBufferSize: %s", value);
+      return 1;
+    }
+    write_buffer_size = (size_t)tmp;
+  } else if (strcasecmp("FlushTimeout", key) == 0) {
+    double tmp = atof(value);
+    if (tmp <= 0.0) {
+      WARNING("csv plugin: Invalid value for FlushTimeout: %s", value);
+      return 1;
+    }
+    flush_timeout = DOUBLE_TO_CDTIME_T(tmp);
   } else {
     return -1;
   }
   return 0;
 } /* int csv_config */
 
+static int csv_init(void) {
+  pthread_mutex_lock(&files_lock);
+  if (files_tree == NULL)
+    files_tree = c_avl_create((int (*)(const void *, const void *))strcmp);
+  pthread_mutex_unlock(&files_lock);
+
+  if (files_tree == NULL) {
+    ERROR("csv plugin: c_avl_create failed.");
+    return -1;
+  }
+
+  if (flush_timeout == 0)
+    flush_timeout = TIME_T_TO_CDTIME_T(10);
+
+  return 0;
+} /* int csv_init */
+
 static int csv_write(const data_set_t *ds, const value_list_t *vl,
                      user_data_t __attribute__((unused)) * user_data) {
-  struct stat statbuf;
   char filename[512];
   char values[4096];
-  FILE *csv;
-  int csv_fd;
-  struct flock fl = {0};
+  size_t values_len;
+  csv_file_t *f;
+  _Bool close_file;
+  cdtime_t now;
   int status;
 
   if (0 != strcmp(ds->type, vl->type)) {
@@ -229,16 +586,14 @@ static int csv_write(const data_set_t *ds, const value_list_t *vl,
     return -1;
   }
 
-  status = value_list_to_filename(filename, sizeof(filename), vl);
-  if (status != 0)
-    return -1;
-
-  DEBUG("csv plugin: csv_write: filename = %s;", filename);
-
   if (value_list_to_string(values, sizeof(values), ds, vl) != 0)
     return -1;
 
   if (use_stdio) {
+    status = value_list_to_filename(filename, sizeof(filename), vl);
+    if (status != 0)
+      return -1;
+
     escape_string(filename, sizeof(filename));
 
     /* Replace commas by colons for PUTVAL compatible output. */
@@ -254,53 +609,114 @@ static int csv_write(const data_set_t *ds, const value_list_t *vl,
     return 0;
   }
 
-  if (stat(filename, &statbuf) == -1) {
-    if (errno == ENOENT) {
-      if (csv_create_file(filename, ds))
-        return -1;
-    } else {
-      char errbuf[1024];
-      ERROR("stat(%s) failed: %s", filename,
-            sstrerror(errno, errbuf, sizeof(errbuf)));
-      return -1;
-    }
-  } else if (!S_ISREG(statbuf.st_mode)) {
-    ERROR("stat(%s): Not a regular file!", filename);
+  values_len = strlen(values);
+  if (values_len >= sizeof(values) - 1)
     return -1;
-  }
+  values[values_len++] = '\n';
 
-  csv = fopen(filename, "a");
-  if (csv == NULL) {
-    char errbuf[1024];
-    ERROR("csv plugin: fopen (%s) failed: %s", filename,
-          sstrerror(errno, errbuf, sizeof(errbuf)));
+  now = cdtime();
+
+  pthread_mutex_lock(&files_lock);
+
+  if (files_tree == NULL) {
+    pthread_mutex_unlock(&files_lock);
     return -1;
   }
-  csv_fd = fileno(csv);
 
-  fl.l_pid = getpid();
-  fl.l_type = F_WRLCK;
-  fl.l_whence = SEEK_SET;
+  if (now >= files_next_sweep) {
+    if (files_next_sweep != 0)
+      csv_sweep();
+    files_next_sweep = now + flush_timeout;
+  }
 
-  status = fcntl(csv_fd, F_SETLK, &fl);
+  status = csv_update_date(CDTIME_T_TO_TIME_T(now));
+  if (status == 0)
+    status = value_list_to_filename(filename, sizeof(filename), vl);
   if (status != 0) {
-    char errbuf[1024];
-    ERROR("csv plugin: flock (%s) failed: %s", filename,
-          sstrerror(errno, errbuf, sizeof(errbuf)));
-    fclose(csv);
+    pthread_mutex_unlock(&files_lock);
     return -1;
   }
 
-  fprintf(csv, "%s\n", values);
+  DEBUG("csv plugin: csv_write: filename = %s;", filename);
 
-  /* The lock is implicitely released. I we don't release it explicitely
-   * because the `FILE *' may need to flush a cache first */
-  fclose(csv);
+  f = csv_file_get(filename, ds);
+  if (f == NULL) {
+    pthread_mutex_unlock(&files_lock);
+    return -1;
+  }
+  f->refs++;
 
-  return 0;
+  while (files_num > max_open_files)
+    csv_file_destroy(files_tail);
+
+  pthread_mutex_unlock(&files_lock);
+
+  pthread_mutex_lock(&f->lock);
+  status = csv_file_append(f, values, values_len, now);
+  pthread_mutex_unlock(&f->lock);
+
+  pthread_mutex_lock(&files_lock);
+  f->refs--;
+  if (status != 0)
+    csv_file_remove(f);
+  close_file = f->removed && (f->refs == 0);
+  pthread_mutex_unlock(&files_lock);
+
+  if (close_file)
+    csv_file_close(f);
+
+  return status;
 } /* int csv_write */
 
+static int csv_flush(cdtime_t timeout, const char *identifier,
+                     user_data_t __attribute__((unused)) * user_data) {
+  size_t prefix_len = (datadir != NULL) ? strlen(datadir) + 1 : 0;
+  size_t identifier_len = (identifier != NULL) ? strlen(identifier) : 0;
+  cdtime_t now = cdtime();
+  csv_file_t *next;
+  int status;
+
+  pthread_mutex_lock(&files_lock);
+  for (csv_file_t *f = files_head; f != NULL; f = next) {
+    next = f->next;
+
+    /* The file name is "<DataDir>/<identifier><date suffix>". */
+    if ((identifier != NULL) &&
+        ((strncmp(f->filename + prefix_len, identifier, identifier_len) !=
+          0) ||
+         (strcmp(f->filename + prefix_len + identifier_len, date_suffix) !=
+          0)))
+      continue;
+
+    status = 0;
+    pthread_mutex_lock(&f->lock);
+    if ((timeout == 0) || ((f->buffer_since + timeout) <= now))
+      status = csv_file_flush(f);
+    pthread_mutex_unlock(&f->lock);
+    if (status != 0)
+      csv_file_destroy(f);
+  }
+  pthread_mutex_unlock(&files_lock);
+
+  return 0;
+} /* int csv_flush */
+
+static int csv_shutdown(void) {
+  pthread_mutex_lock(&files_lock);
+  csv_close_all();
+  if (files_tree != NULL) {
+    c_avl_destroy(files_tree);
+    files_tree = NULL;
+  }
+  pthread_mutex_unlock(&files_lock);
+
+  return 0;
+} /* int csv_shutdown */
+
 void module_register(void) {
   plugin_register_config("csv", csv_config, config_keys, config_keys_num);
+  plugin_register_init("csv", csv_init);
   plugin_register_write("csv", csv_write, /* user_data = */ NULL);
+  plugin_register_flush("csv", csv_flush, /* user_data = */ NULL);
+  plugin_register_shutdown("csv", csv_shutdown);
 } /* void module_register */
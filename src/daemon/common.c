@@ -1011,57 +1011,53 @@ int parse_identifier_vl(const char *str, value_list_t *vl) /* {{{ */
 } /* }}} int parse_identifier_vl */
 
 int parse_value(const char *value_orig, value_t *ret_value, int ds_type) {
-  char *value;
   char *endptr = NULL;
-  size_t value_len;
 
   if (value_orig == NULL)
     return EINVAL;
 
-  value = strdup(value_orig);
-  if (value == NULL)
-    return ENOMEM;
-  value_len = strlen(value);
-
-  while ((value_len > 0) && isspace((int)value[value_len - 1])) {
-    value[value_len - 1] = 0;
-    value_len--;
-  }
-
+  /* Parse the string in place; trailing white space is skipped below rather
+   * than stripped from a copy, so that the hot PUTVAL path does not need to
+   * allocate memory for every value. */
   switch (ds_type) {
   case DS_TYPE_COUNTER:
-    ret_value->counter = (counter_t)strtoull(value, &endptr, 0);
+    ret_value->counter = (counter_t)strtoull(value_orig, &endptr, 0);
     break;
 
   case DS_TYPE_GAUGE:
-    ret_value->gauge = (gauge_t)strtod(value, &endptr);
+    ret_value->gauge = (gauge_t)strtod(value_orig, &endptr);
     break;
 
   case DS_TYPE_DERIVE:
-    ret_value->derive = (derive_t)strtoll(value, &endptr, 0);
+    ret_value->derive = (derive_t)strtoll(value_orig, &endptr, 0);
     break;
 
   case DS_TYPE_ABSOLUTE:
-    ret_value->absolute = (absolute_t)strtoull(value, &endptr, 0);
+    ret_value->absolute = (absolute_t)strtoull(value_orig, &endptr, 0);
     break;
 
   default:
-    sfree(value);
     ERROR("parse_value: Invalid data source type: %i.", ds_type);
     return -1;
   }
 
-  if (value == endptr) {
+  if (value_orig == endptr) {
     ERROR("parse_value: Failed to parse string as %s: \"%s\".",
-          DS_TYPE_TO_STRING(ds_type), value);
-    sfree(value);
+          DS_TYPE_TO_STRING(ds_type), value_orig);
     return -1;
-  } else if ((NULL != endptr) && ('\0' != *endptr))
-    INFO("parse_value: Ignoring trailing garbage \"%s\" after %s value. "
-         "Input string was \"%s\".",
-         endptr, DS_TYPE_TO_STRING(ds_type), value_orig);
+  }
+
+  if (endptr != NULL) {
+    char const *garbage = endptr;
+
+    while (isspace((int)*endptr))
+      endptr++;
+    if (*endptr != '\0')
+      INFO("parse_value: Ignoring trailing garbage \"%s\" after %s value. "
+           "Input string was \"%s\".",
+           garbage, DS_TYPE_TO_STRING(ds_type), value_orig);
+  }
 
-  sfree(value);
   return 0;
 } /* int parse_value */
 
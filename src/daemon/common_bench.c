@@ -0,0 +1,86 @@
+/**
+ * collectd - src/daemon/common_bench.c
+ *
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include "collectd.h"
+
+#include "benchmark.h"
+#include "common.h"
+
+static value_list_t vl_bench = {
+    .host = "host0042.example.com",
+    .plugin = "interface",
+    .plugin_instance = "eth0",
+    .type = "if_octets",
+    .type_instance = "",
+};
+
+static char const *identifier_bench =
+    "host0042.example.com/interface-eth0/if_octets";
+
+/* Formats the identifier of a value list, as done by the value cache and
+ * most write plugins for every value. */
+DEF_BENCH(format_name) {
+  for (uint64_t i = 0; i < b->iterations; i++) {
+    char name[6 * DATA_MAX_NAME_LEN];
+
+    FORMAT_VL(name, sizeof(name), &vl_bench);
+    BENCH_KEEP(name[0]);
+  }
+}
+
+/* Parses an identifier, as done by the unixsock and exec plugins for every
+ * PUTVAL command. The identifier is copied first since parsing modifies it. */
+DEF_BENCH(parse_identifier) {
+  for (uint64_t i = 0; i < b->iterations; i++) {
+    char buffer[6 * DATA_MAX_NAME_LEN];
+    char *host;
+    char *plugin;
+    char *plugin_instance;
+    char *type;
+    char *type_instance;
+
+    sstrncpy(buffer, identifier_bench, sizeof(buffer));
+    parse_identifier(buffer, &host, &plugin, &plugin_instance, &type,
+                     &type_instance, /* default_host = */ NULL);
+    BENCH_KEEP(type);
+  }
+}
+
+DEF_BENCH(parse_identifier_vl) {
+  for (uint64_t i = 0; i < b->iterations; i++) {
+    value_list_t vl = VALUE_LIST_INIT;
+
+    parse_identifier_vl(identifier_bench, &vl);
+    BENCH_KEEP(vl.type[0]);
+  }
+}
+
+int main(void) {
+  RUN_BENCH(format_name, 1, NULL);
+  RUN_BENCH(format_name, BENCH_THREADS, NULL);
+  RUN_BENCH(parse_identifier, 1, NULL);
+  RUN_BENCH(parse_identifier, BENCH_THREADS, NULL);
+  RUN_BENCH(parse_identifier_vl, 1, NULL);
+
+  return 0;
+}
@@ -34,6 +34,7 @@
 #include "filter_chain.h"
 #include "plugin.h"
 #include "types_list.h"
+#include "utils_cache.h"
 
 #if HAVE_WORDEXP_H
 #include <wordexp.h>
@@ -110,12 +111,17 @@ static cf_global_option_t cf_global_options[] = {
     {"WriteThreads", NULL, 0, "5"},
     {"WriteQueueLimitHigh", NULL, 0, NULL},
     {"WriteQueueLimitLow", NULL, 0, NULL},
+    {"LogQueueLength", NULL, 0, NULL},
+    {"LogRateLimit", NULL, 0, NULL},
+    {"NotificationQueueLength", NULL, 0, NULL},
     {"Timeout", NULL, 0, "2"},
     {"AutoLoadPlugin", NULL, 0, "false"},
     {"CollectInternalStats", NULL, 0, "false"},
     {"PreCacheChain", NULL, 0, "PreCache"},
     {"PostCacheChain", NULL, 0, "PostCache"},
-    {"MaxReadInterval", NULL, 0, "86400"}};
+    {"MaxReadInterval", NULL, 0, "86400"},
+    {"CacheFile", NULL, 0, NULL},
+    {"CacheSnapshotInterval", NULL, 0, "0"}};
 static int cf_global_options_num = STATIC_ARRAY_SIZE(cf_global_options);
 
 static int cf_default_typesdb = 1;
@@ -277,7 +283,17 @@ static int dispatch_loadplugin(oconfig_item_t *ci) {
       cf_util_get_cdtime(child, &ctx.flush_interval);
     else if (strcasecmp("FlushTimeout", child->key) == 0)
       cf_util_get_cdtime(child, &ctx.flush_timeout);
-    else {
+    else if (strcasecmp("ReadThreads", child->key) == 0) {
+      int read_threads = 0;
+      if ((cf_util_get_int(child, &read_threads) != 0) ||
+          (read_threads < 1)) {
+        WARNING("The \"ReadThreads\" option of plugin \"%s\" requires a "
+                "positive integer argument.",
+                ci->values[0].value.string);
+        continue;
+      }
+      ctx.read_pool = plugin_read_pool_create(name, (size_t)read_threads);
+    } else {
       WARNING("Ignoring unknown LoadPlugin option \"%s\" "
               "for plugin \"%s\"",
               child->key, ci->values[0].value.string);
@@ -423,6 +439,8 @@ static int dispatch_block(oconfig_item_t *ci) {
     return dispatch_block_plugin(ci);
   else if (strcasecmp(ci->key, "Chain") == 0)
     return fc_configure(ci);
+  else if (strcasecmp(ci->key, "History") == 0)
+    return uc_configure_history(ci);
 
   return 0;
 }
@@ -0,0 +1,171 @@
+/**
+ * collectd - src/daemon/filter_chain_bench.c
+ *
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include "collectd.h"
+
+#include "benchmark.h"
+#include "common.h"
+#include "filter_chain.h"
+
+/* The filter chain is linked in directly; these are the parts of the daemon
+ * it needs. The plugin mock can't be used since it provides a fake
+ * fc_configure(). */
+char hostname_g[] = "example.com";
+
+void plugin_log(int level, char const *format, ...) {
+  char buffer[1024];
+  va_list ap;
+
+  if (level > LOG_WARNING)
+    return;
+
+  va_start(ap, format);
+  vsnprintf(buffer, sizeof(buffer), format, ap);
+  va_end(ap);
+
+  fprintf(stderr, "plugin_log (%i, \"%s\");\n", level, buffer);
+}
+
+int plugin_write(const char *plugin, const data_set_t *ds,
+                 const value_list_t *vl) {
+  BENCH_KEEP(vl->values[0].gauge);
+  return 0;
+}
+
+void plugin_log_available_writers(void) { /* nop */
+}
+
+const data_set_t *plugin_get_ds(const char *name) { return NULL; }
+
+cdtime_t plugin_get_interval(void) { return TIME_T_TO_CDTIME_T(10); }
+
+gauge_t *uc_get_rate(const data_set_t *ds, const value_list_t *vl) {
+  errno = ENOTSUP;
+  return NULL;
+}
+
+/* A trivial match comparing the plugin name, standing in for the matches
+ * provided by plugins such as match_regex. */
+static int match_plugin_create(const oconfig_item_t *ci, void **user_data) {
+  for (int i = 0; i < ci->children_num; i++) {
+    oconfig_item_t *child = ci->children + i;
+
+    if ((strcasecmp("Plugin", child->key) != 0) || (child->values_num != 1) ||
+        (child->values[0].type != OCONFIG_TYPE_STRING))
+      continue;
+
+    *user_data = strdup(child->values[0].value.string);
+    return (*user_data == NULL) ? -1 : 0;
+  }
+  return -1;
+}
+
+static int match_plugin_destroy(void **user_data) {
+  sfree(*user_data);
+  return 0;
+}
+
+static int match_plugin_match(const data_set_t *ds, const value_list_t *vl,
+                              notification_meta_t **meta, void **user_data) {
+  return (strcmp(vl->plugin, *user_data) == 0) ? FC_MATCH_MATCHES
+                                               : FC_MATCH_NO_MATCH;
+}
+
+static data_source_t dsrc_gauge = {"value", DS_TYPE_GAUGE, 0.0, NAN};
+static data_set_t const ds_gauge = {"gauge", 1, &dsrc_gauge};
+
+/* Runs a value list through a chain of ten rules, none of which match, and
+ * the default "write" target. */
+DEF_BENCH(fc_process_chain) {
+  fc_chain_t *chain = b->arg;
+  value_t value = {.gauge = 42.0};
+  value_list_t vl = VALUE_LIST_INIT;
+
+  vl.values = &value;
+  vl.values_len = 1;
+  sstrncpy(vl.host, "example.com", sizeof(vl.host));
+  sstrncpy(vl.plugin, "cpu", sizeof(vl.plugin));
+  sstrncpy(vl.plugin_instance, "0", sizeof(vl.plugin_instance));
+  sstrncpy(vl.type, "gauge", sizeof(vl.type));
+
+  for (uint64_t i = 0; i < b->iterations; i++)
+    fc_process_chain(&ds_gauge, &vl, chain);
+}
+
+static fc_chain_t *create_chain(void) {
+  char file[] = "/tmp/collectd-bench.XXXXXX";
+  oconfig_item_t *ci;
+  FILE *fh;
+  int fd;
+
+  fd = mkstemp(file);
+  if (fd < 0)
+    return NULL;
+
+  fh = fdopen(fd, "w");
+  fprintf(fh, "<Chain \"bench\">\n");
+  for (int i = 0; i < 10; i++)
+    fprintf(fh,
+            "  <Rule \"rule%d\">\n"
+            "    <Match \"plugin\">\n"
+            "      Plugin \"plugin%02d\"\n"
+            "    </Match>\n"
+            "    Target \"stop\"\n"
+            "  </Rule>\n",
+            i, i);
+  fprintf(fh, "  Target \"write\"\n</Chain>\n");
+  fclose(fh);
+
+  ci = oconfig_parse_file(file);
+  unlink(file);
+  if (ci == NULL)
+    return NULL;
+
+  for (int i = 0; i < ci->children_num; i++)
+    fc_configure(ci->children + i);
+  oconfig_free(ci);
+
+  return fc_chain_get_by_name("bench");
+}
+
+int main(void) {
+  match_proc_t mproc = {
+      .create = match_plugin_create,
+      .destroy = match_plugin_destroy,
+      .match = match_plugin_match,
+  };
+  fc_chain_t *chain;
+
+  fc_register_match("plugin", mproc);
+
+  chain = create_chain();
+  if (chain == NULL) {
+    fprintf(stderr, "Creating the filter chain failed.\n");
+    return 1;
+  }
+
+  RUN_BENCH(fc_process_chain, 1, chain);
+  RUN_BENCH(fc_process_chain, BENCH_THREADS, chain);
+
+  return 0;
+}
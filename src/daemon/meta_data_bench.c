@@ -0,0 +1,99 @@
+/**
+ * collectd - src/daemon/meta_data_bench.c
+ *
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include "collectd.h"
+
+#include "benchmark.h"
+#include "meta_data.h"
+
+/* Adds a string, an integer and a boolean and reads them back, the way the
+ * network and aggregation plugins tag value lists. One operation is one
+ * complete create/add/get/destroy cycle. */
+DEF_BENCH(create_add_get) {
+  for (uint64_t i = 0; i < b->iterations; i++) {
+    meta_data_t *md = meta_data_create();
+    char *s = NULL;
+    int64_t si = 0;
+    _Bool flag = 0;
+
+    meta_data_add_string(md, "network:received_from", "192.0.2.1");
+    meta_data_add_signed_int(md, "aggregation:count", (int64_t)i);
+    meta_data_add_boolean(md, "network:received", 1);
+
+    meta_data_get_string(md, "network:received_from", &s);
+    meta_data_get_signed_int(md, "aggregation:count", &si);
+    meta_data_get_boolean(md, "network:received", &flag);
+    BENCH_KEEP(si + flag);
+
+    free(s);
+    meta_data_destroy(md);
+  }
+}
+
+/* Reads from a meta data object shared by all threads; the object's
+ * internal lock is contended in the threaded variant. */
+DEF_BENCH(get_shared) {
+  meta_data_t *md = b->arg;
+
+  for (uint64_t i = 0; i < b->iterations; i++) {
+    int64_t si = 0;
+
+    meta_data_get_signed_int(md, "key5", &si);
+    BENCH_KEEP(si);
+  }
+}
+
+/* Clones a meta data object with ten entries, as done for every value list
+ * that is put into the write queue. */
+DEF_BENCH(clone) {
+  meta_data_t *md = b->arg;
+
+  for (uint64_t i = 0; i < b->iterations; i++) {
+    meta_data_t *copy = meta_data_clone(md);
+    meta_data_destroy(copy);
+  }
+}
+
+int main(void) {
+  meta_data_t *md = meta_data_create();
+
+  for (int i = 0; i < 10; i++) {
+    char key[16];
+
+    snprintf(key, sizeof(key), "key%d", i);
+    if (i % 2)
+      meta_data_add_signed_int(md, key, (int64_t)i);
+    else
+      meta_data_add_string(md, key, "some string value");
+  }
+
+  RUN_BENCH(create_add_get, 1, NULL);
+  RUN_BENCH(create_add_get, BENCH_THREADS, NULL);
+  RUN_BENCH(get_shared, 1, md);
+  RUN_BENCH(get_shared, BENCH_THREADS, md);
+  RUN_BENCH(clone, 1, md);
+  RUN_BENCH(clone, BENCH_THREADS, md);
+
+  meta_data_destroy(md);
+  return 0;
+}
@@ -38,8 +38,10 @@
 #include "utils_cache.h"
 #include "utils_complain.h"
 #include "utils_heap.h"
+#include "utils_latency.h"
 #include "utils_llist.h"
 #include "utils_random.h"
+#include "utils_ring.h"
 #include "utils_time.h"
 
 #if HAVE_PTHREAD_NP_H
@@ -74,14 +76,36 @@ struct read_func_s {
   cdtime_t rf_interval;
   cdtime_t rf_effective_interval;
   cdtime_t rf_next_read;
+
+  /* Statistics, protected by `read_lock'. */
+  derive_t rf_calls;
+  derive_t rf_failures;
+  latency_counter_t *rf_duration;
+  cdtime_t rf_lag_sum;
+  cdtime_t rf_lag_max;
+  size_t rf_lag_num;
 };
 typedef struct read_func_s read_func_t;
 
+/* A set of read threads and the heap of read functions they handle. The
+ * `default_read_pool' handles all read functions, except those of plugins
+ * loaded with a "ReadThreads" option in their <LoadPlugin /> block. */
+struct read_pool_s {
+  char *name;
+  c_heap_t *heap;
+  pthread_cond_t cond;
+  pthread_t *threads;
+  size_t threads_num;
+  size_t threads_wanted;
+  read_pool_t *next;
+};
+
 struct write_queue_s;
 typedef struct write_queue_s write_queue_t;
 struct write_queue_s {
   value_list_t *vl;
   plugin_ctx_t ctx;
+  cdtime_t time; /* when the entry was enqueued; only set with statistics */
   write_queue_t *next;
 };
 
@@ -91,6 +115,56 @@ struct flush_callback_s {
 };
 typedef struct flush_callback_s flush_callback_t;
 
+/* A message passed from plugin_log() to the log thread. */
+struct log_record_s {
+  int level;
+  char msg[1024];
+};
+typedef struct log_record_s log_record_t;
+
+/* Rate limit of one call site of plugin_log(), identified by the address of
+ * its format string. Bridges to other languages and c_complain() pass every
+ * message through a "%s" format, so for these the message itself identifies
+ * the call site. */
+struct log_limit_s {
+  const char *format;
+  uint64_t key; /* hash of the message for "%s" formats, zero otherwise */
+  cdtime_t window_start;
+  unsigned int count;      /* messages logged since window_start */
+  unsigned int suppressed; /* messages suppressed since window_start */
+};
+typedef struct log_limit_s log_limit_t;
+
+/* A notification queued for one or more notification callbacks. */
+struct notif_entry_s {
+  notification_t n;
+  uint32_t hash; /* of the fields compared by notif_equal() */
+  cdtime_t enqueued;
+  unsigned int refs; /* updated atomically */
+};
+typedef struct notif_entry_s notif_entry_t;
+
+/* Queue and worker thread of one notification callback. */
+struct notif_queue_s {
+  char *name;
+  callback_func_t *cf;
+  pthread_t thread;
+
+  pthread_mutex_t lock;
+  pthread_cond_t cond;
+  _Bool loop;
+  notif_entry_t **entries; /* circular buffer */
+  size_t size;
+  size_t head;
+  size_t num;
+
+  /* Statistics, protected by `lock'. */
+  derive_t dropped;
+  derive_t coalesced;
+  latency_counter_t *latency;
+};
+typedef struct notif_queue_s notif_queue_t;
+
 /*
  * Private variables
  */
@@ -114,13 +188,14 @@ static char *plugindir = NULL;
 #ifndef DEFAULT_MAX_READ_INTERVAL
 #define DEFAULT_MAX_READ_INTERVAL TIME_T_TO_CDTIME_T_STATIC(86400)
 #endif
-static c_heap_t *read_heap = NULL;
+/* Additional pools, created by plugin_read_pool_create(), are linked to the
+ * default pool via the `next' member. */
+static read_pool_t default_read_pool = {
+    .name = NULL, .heap = NULL, .cond = PTHREAD_COND_INITIALIZER,
+};
 static llist_t *read_list;
 static int read_loop = 1;
 static pthread_mutex_t read_lock = PTHREAD_MUTEX_INITIALIZER;
-static pthread_cond_t read_cond = PTHREAD_COND_INITIALIZER;
-static pthread_t *read_threads = NULL;
-static size_t read_threads_num = 0;
 static cdtime_t max_read_interval = DEFAULT_MAX_READ_INTERVAL;
 
 static write_queue_t *write_queue_head;
@@ -131,6 +206,8 @@ static pthread_mutex_t write_lock = PTHREAD_MUTEX_INITIALIZER;
 static pthread_cond_t write_cond = PTHREAD_COND_INITIALIZER;
 static pthread_t *write_threads = NULL;
 static size_t write_threads_num = 0;
+/* Time values spent in the write queue. Protected by `write_lock'. */
+static latency_counter_t *write_queue_latency = NULL;
 
 static pthread_key_t plugin_ctx_key;
 static _Bool plugin_ctx_key_initialized = 0;
@@ -141,6 +218,38 @@ static long write_limit_low = 0;
 static derive_t stats_values_dropped = 0;
 static _Bool record_statistics = 0;
 
+#ifndef LOG_LIMIT_SLOTS
+#define LOG_LIMIT_SLOTS 1024
+#endif
+
+/* While the log thread is running, plugin_log() only formats the message into
+ * `log_ring' and the thread calls the log callbacks. `log_producers' counts
+ * the threads currently writing to the ring, so that it is not freed under
+ * their feet. */
+static ring_t *log_ring = NULL;
+static unsigned int log_producers = 0;
+static pthread_t log_thread;
+static _Bool log_thread_running = 0;
+static _Bool log_loop = 0;
+static _Bool log_thread_waiting = 0;
+static pthread_mutex_t log_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t log_cond = PTHREAD_COND_INITIALIZER;
+
+/* Messages per second and call site, zero for no limit. */
+static long log_rate_limit = 0;
+static log_limit_t log_limits[LOG_LIMIT_SLOTS];
+static pthread_mutex_t log_limit_lock = PTHREAD_MUTEX_INITIALIZER;
+/* Protected by `log_limit_lock'. */
+static derive_t stats_log_suppressed = 0;
+/* Messages dropped because `log_ring' was full. Updated atomically. */
+static derive_t stats_log_dropped = 0;
+
+/* Queues of the notification callbacks registered when the daemon was
+ * initialized. Callbacks registered later are called synchronously. */
+static notif_queue_t **notif_queues = NULL;
+static size_t notif_queues_num = 0;
+static pthread_rwlock_t notif_queues_lock = PTHREAD_RWLOCK_INITIALIZER;
+
 /*
  * Static functions
  */
@@ -153,8 +262,207 @@ static const char *plugin_get_dir(void) {
     return plugindir;
 }
 
+/* Dispatches the per read function statistics. The values are copied while
+ * holding `read_lock' and dispatched afterwards. */
+static void plugin_update_read_statistics(value_list_t *vl) /* {{{ */
+{
+  struct {
+    char name[DATA_MAX_NAME_LEN];
+    derive_t calls;
+    derive_t failures;
+    gauge_t duration_average;
+    gauge_t duration_max;
+    gauge_t duration_p99;
+    gauge_t lag_average;
+    gauge_t lag_max;
+  } *stats = NULL;
+  size_t stats_num = 0;
+
+  pthread_mutex_lock(&read_lock);
+  if (read_list != NULL)
+    stats = calloc((size_t)llist_size(read_list), sizeof(*stats));
+  if (stats == NULL) {
+    pthread_mutex_unlock(&read_lock);
+    return;
+  }
+
+  for (llentry_t *le = llist_head(read_list); le != NULL; le = le->next) {
+    read_func_t *rf = le->value;
+
+    sstrncpy(stats[stats_num].name, rf->rf_name,
+             sizeof(stats[stats_num].name));
+    stats[stats_num].calls = rf->rf_calls;
+    stats[stats_num].failures = rf->rf_failures;
+
+    stats[stats_num].duration_average = NAN;
+    stats[stats_num].duration_max = NAN;
+    stats[stats_num].duration_p99 = NAN;
+    if (latency_counter_get_num(rf->rf_duration) > 0) {
+      stats[stats_num].duration_average = CDTIME_T_TO_DOUBLE(
+          latency_counter_get_average(rf->rf_duration));
+      stats[stats_num].duration_max =
+          CDTIME_T_TO_DOUBLE(latency_counter_get_max(rf->rf_duration));
+      stats[stats_num].duration_p99 = CDTIME_T_TO_DOUBLE(
+          latency_counter_get_percentile(rf->rf_duration, 99.0));
+    }
+    latency_counter_reset(rf->rf_duration);
+
+    stats[stats_num].lag_average = NAN;
+    stats[stats_num].lag_max = NAN;
+    if (rf->rf_lag_num > 0) {
+      stats[stats_num].lag_average =
+          CDTIME_T_TO_DOUBLE(rf->rf_lag_sum) / ((double)rf->rf_lag_num);
+      stats[stats_num].lag_max = CDTIME_T_TO_DOUBLE(rf->rf_lag_max);
+    }
+    rf->rf_lag_sum = 0;
+    rf->rf_lag_max = 0;
+    rf->rf_lag_num = 0;
+
+    stats_num++;
+  }
+  pthread_mutex_unlock(&read_lock);
+
+  vl->values_len = 1;
+  for (size_t i = 0; i < stats_num; i++) {
+    ssnprintf(vl->plugin_instance, sizeof(vl->plugin_instance), "read-%s",
+              stats[i].name);
+
+    sstrncpy(vl->type, "derive", sizeof(vl->type));
+    vl->values = &(value_t){.derive = stats[i].calls};
+    sstrncpy(vl->type_instance, "calls", sizeof(vl->type_instance));
+    plugin_dispatch_values(vl);
+
+    vl->values = &(value_t){.derive = stats[i].failures};
+    sstrncpy(vl->type_instance, "failures", sizeof(vl->type_instance));
+    plugin_dispatch_values(vl);
+
+    sstrncpy(vl->type, "duration", sizeof(vl->type));
+    vl->values = &(value_t){.gauge = stats[i].duration_average};
+    sstrncpy(vl->type_instance, "average", sizeof(vl->type_instance));
+    plugin_dispatch_values(vl);
+
+    vl->values = &(value_t){.gauge = stats[i].duration_max};
+    sstrncpy(vl->type_instance, "max", sizeof(vl->type_instance));
+    plugin_dispatch_values(vl);
+
+    vl->values = &(value_t){.gauge = stats[i].duration_p99};
+    sstrncpy(vl->type_instance, "percentile-99", sizeof(vl->type_instance));
+    plugin_dispatch_values(vl);
+
+    vl->values = &(value_t){.gauge = stats[i].lag_average};
+    sstrncpy(vl->type_instance, "lag-average", sizeof(vl->type_instance));
+    plugin_dispatch_values(vl);
+
+    vl->values = &(value_t){.gauge = stats[i].lag_max};
+    sstrncpy(vl->type_instance, "lag-max", sizeof(vl->type_instance));
+    plugin_dispatch_values(vl);
+  }
+
+  sfree(stats);
+} /* }}} void plugin_update_read_statistics */
+
+/* Dispatches the per notification callback queue statistics. Like
+ * plugin_update_read_statistics(), the values are copied first so that no lock
+ * is held while dispatching. */
+static void plugin_update_notification_statistics(value_list_t *vl) /* {{{ */
+{
+  struct {
+    char name[DATA_MAX_NAME_LEN];
+    gauge_t length;
+    derive_t dropped;
+    derive_t coalesced;
+    gauge_t latency_average;
+    gauge_t latency_max;
+  } *stats = NULL;
+  size_t stats_num = 0;
+
+  pthread_rwlock_rdlock(&notif_queues_lock);
+  if (notif_queues_num > 0)
+    stats = calloc(notif_queues_num, sizeof(*stats));
+  if (stats == NULL) {
+    pthread_rwlock_unlock(&notif_queues_lock);
+    return;
+  }
+
+  for (size_t i = 0; i < notif_queues_num; i++) {
+    notif_queue_t *q = notif_queues[i];
+
+    pthread_mutex_lock(&q->lock);
+    sstrncpy(stats[i].name, q->name, sizeof(stats[i].name));
+    stats[i].length = (gauge_t)q->num;
+    stats[i].dropped = q->dropped;
+    stats[i].coalesced = q->coalesced;
+    stats[i].latency_average = NAN;
+    stats[i].latency_max = NAN;
+    if (latency_counter_get_num(q->latency) > 0) {
+      stats[i].latency_average =
+          CDTIME_T_TO_DOUBLE(latency_counter_get_average(q->latency));
+      stats[i].latency_max =
+          CDTIME_T_TO_DOUBLE(latency_counter_get_max(q->latency));
+    }
+    latency_counter_reset(q->latency);
+    pthread_mutex_unlock(&q->lock);
+  }
+  stats_num = notif_queues_num;
+  pthread_rwlock_unlock(&notif_queues_lock);
+
+  vl->values_len = 1;
+  for (size_t i = 0; i < stats_num; i++) {
+    ssnprintf(vl->plugin_instance, sizeof(vl->plugin_instance),
+              "notification-%s", stats[i].name);
+
+    vl->values = &(value_t){.gauge = stats[i].length};
+    sstrncpy(vl->type, "queue_length", sizeof(vl->type));
+    vl->type_instance[0] = 0;
+    plugin_dispatch_values(vl);
+
+    sstrncpy(vl->type, "derive", sizeof(vl->type));
+    vl->values = &(value_t){.derive = stats[i].dropped};
+    sstrncpy(vl->type_instance, "dropped", sizeof(vl->type_instance));
+    plugin_dispatch_values(vl);
+
+    vl->values = &(value_t){.derive = stats[i].coalesced};
+    sstrncpy(vl->type_instance, "coalesced", sizeof(vl->type_instance));
+    plugin_dispatch_values(vl);
+
+    /* Time notifications spent in the queue */
+    sstrncpy(vl->type, "duration", sizeof(vl->type));
+    vl->values = &(value_t){.gauge = stats[i].latency_average};
+    sstrncpy(vl->type_instance, "average", sizeof(vl->type_instance));
+    plugin_dispatch_values(vl);
+
+    vl->values = &(value_t){.gauge = stats[i].latency_max};
+    sstrncpy(vl->type_instance, "max", sizeof(vl->type_instance));
+    plugin_dispatch_values(vl);
+  }
+
+  sfree(stats);
+} /* }}} void plugin_update_notification_statistics */
+
 static int plugin_update_internal_statistics(void) { /* {{{ */
   gauge_t copy_write_queue_length = (gauge_t)write_queue_length;
+  gauge_t queue_average = NAN;
+  gauge_t queue_max = NAN;
+  gauge_t queue_p50 = NAN;
+  gauge_t queue_p95 = NAN;
+  gauge_t queue_p99 = NAN;
+
+  pthread_mutex_lock(&write_lock);
+  if ((write_queue_latency != NULL) &&
+      (latency_counter_get_num(write_queue_latency) > 0)) {
+    queue_average =
+        CDTIME_T_TO_DOUBLE(latency_counter_get_average(write_queue_latency));
+    queue_max = CDTIME_T_TO_DOUBLE(latency_counter_get_max(write_queue_latency));
+    queue_p50 = CDTIME_T_TO_DOUBLE(
+        latency_counter_get_percentile(write_queue_latency, 50.0));
+    queue_p95 = CDTIME_T_TO_DOUBLE(
+        latency_counter_get_percentile(write_queue_latency, 95.0));
+    queue_p99 = CDTIME_T_TO_DOUBLE(
+        latency_counter_get_percentile(write_queue_latency, 99.0));
+  }
+  if (write_queue_latency != NULL)
+    latency_counter_reset(write_queue_latency);
+  pthread_mutex_unlock(&write_lock);
 
   /* Initialize `vl' */
   value_list_t vl = VALUE_LIST_INIT;
@@ -172,12 +480,34 @@ static int plugin_update_internal_statistics(void) { /* {{{ */
   plugin_dispatch_values(&vl);
 
   /* Write queue : Values dropped (queue length > low limit) */
-  vl.values = &(value_t){.gauge = (gauge_t)stats_values_dropped};
+  vl.values = &(value_t){.derive = stats_values_dropped};
   vl.values_len = 1;
   sstrncpy(vl.type, "derive", sizeof(vl.type));
   sstrncpy(vl.type_instance, "dropped", sizeof(vl.type_instance));
   plugin_dispatch_values(&vl);
 
+  /* Write queue : Time values spent in the queue */
+  sstrncpy(vl.type, "duration", sizeof(vl.type));
+  vl.values = &(value_t){.gauge = queue_average};
+  sstrncpy(vl.type_instance, "average", sizeof(vl.type_instance));
+  plugin_dispatch_values(&vl);
+
+  vl.values = &(value_t){.gauge = queue_max};
+  sstrncpy(vl.type_instance, "max", sizeof(vl.type_instance));
+  plugin_dispatch_values(&vl);
+
+  vl.values = &(value_t){.gauge = queue_p50};
+  sstrncpy(vl.type_instance, "percentile-50", sizeof(vl.type_instance));
+  plugin_dispatch_values(&vl);
+
+  vl.values = &(value_t){.gauge = queue_p95};
+  sstrncpy(vl.type_instance, "percentile-95", sizeof(vl.type_instance));
+  plugin_dispatch_values(&vl);
+
+  vl.values = &(value_t){.gauge = queue_p99};
+  sstrncpy(vl.type_instance, "percentile-99", sizeof(vl.type_instance));
+  plugin_dispatch_values(&vl);
+
   /* Cache */
   sstrncpy(vl.plugin_instance, "cache", sizeof(vl.plugin_instance));
 
@@ -188,6 +518,29 @@ static int plugin_update_internal_statistics(void) { /* {{{ */
   vl.type_instance[0] = 0;
   plugin_dispatch_values(&vl);
 
+  /* Log messages */
+  derive_t log_suppressed;
+  pthread_mutex_lock(&log_limit_lock);
+  log_suppressed = stats_log_suppressed;
+  pthread_mutex_unlock(&log_limit_lock);
+
+  sstrncpy(vl.plugin_instance, "log", sizeof(vl.plugin_instance));
+  sstrncpy(vl.type, "derive", sizeof(vl.type));
+
+  /* Log messages : suppressed by the rate limit */
+  vl.values = &(value_t){.derive = log_suppressed};
+  sstrncpy(vl.type_instance, "suppressed", sizeof(vl.type_instance));
+  plugin_dispatch_values(&vl);
+
+  /* Log messages : dropped because the log queue was full */
+  vl.values = &(value_t){
+      .derive = __atomic_load_n(&stats_log_dropped, __ATOMIC_RELAXED)};
+  sstrncpy(vl.type_instance, "dropped", sizeof(vl.type_instance));
+  plugin_dispatch_values(&vl);
+
+  plugin_update_notification_statistics(&vl);
+  plugin_update_read_statistics(&vl);
+
   return 0;
 } /* }}} int plugin_update_internal_statistics */
 
@@ -228,24 +581,65 @@ static void destroy_all_callbacks(llist_t **list) /* {{{ */
   *list = NULL;
 } /* }}} void destroy_all_callbacks */
 
-static void destroy_read_heap(void) /* {{{ */
+static void destroy_read_func(read_func_t *rf) /* {{{ */
 {
-  if (read_heap == NULL)
+  if (rf == NULL)
     return;
 
-  while (42) {
-    read_func_t *rf;
+  sfree(rf->rf_name);
+  latency_counter_destroy(rf->rf_duration);
+  rf->rf_duration = NULL;
+  destroy_callback((callback_func_t *)rf);
+} /* }}} void destroy_read_func */
 
-    rf = c_heap_get_root(read_heap);
-    if (rf == NULL)
-      break;
-    sfree(rf->rf_name);
-    destroy_callback((callback_func_t *)rf);
+static void destroy_read_heaps(void) /* {{{ */
+{
+  for (read_pool_t *pool = &default_read_pool; pool != NULL;
+       pool = pool->next) {
+    if (pool->heap == NULL)
+      continue;
+
+    while (42) {
+      read_func_t *rf;
+
+      rf = c_heap_get_root(pool->heap);
+      if (rf == NULL)
+        break;
+      destroy_read_func(rf);
+    }
+
+    c_heap_destroy(pool->heap);
+    pool->heap = NULL;
   }
+} /* }}} void destroy_read_heaps */
 
-  c_heap_destroy(read_heap);
-  read_heap = NULL;
-} /* }}} void destroy_read_heap */
+static void destroy_read_pools(void) /* {{{ */
+{
+  read_pool_t *pool = default_read_pool.next;
+
+  while (pool != NULL) {
+    read_pool_t *next = pool->next;
+
+    assert(pool->heap == NULL);
+    assert(pool->threads == NULL);
+    pthread_cond_destroy(&pool->cond);
+    sfree(pool->name);
+    sfree(pool);
+
+    pool = next;
+  }
+  default_read_pool.next = NULL;
+} /* }}} void destroy_read_pools */
+
+static _Bool have_read_funcs(void) /* {{{ */
+{
+  for (read_pool_t *pool = &default_read_pool; pool != NULL;
+       pool = pool->next)
+    if (pool->heap != NULL)
+      return 1;
+
+  return 0;
+} /* }}} _Bool have_read_funcs */
 
 static int register_callback(llist_t **list, /* {{{ */
                              const char *name, callback_func_t *cf) {
@@ -430,7 +824,9 @@ static int plugin_load_file(const char *file, _Bool global) {
   return 0;
 }
 
-static void *plugin_read_thread(void __attribute__((unused)) * args) {
+static void *plugin_read_thread(void *args) {
+  read_pool_t *pool = args;
+
   while (read_loop != 0) {
     read_func_t *rf;
     plugin_ctx_t old_ctx;
@@ -446,9 +842,9 @@ static void *plugin_read_thread(void __attribute__((unused)) * args) {
      * to call c_heap_get_root() and pthread_cond_wait() in the
      * same protected block. */
     pthread_mutex_lock(&read_lock);
-    rf = c_heap_get_root(read_heap);
+    rf = c_heap_get_root(pool->heap);
     if (rf == NULL) {
-      pthread_cond_wait(&read_cond, &read_lock);
+      pthread_cond_wait(&pool->cond, &read_lock);
       pthread_mutex_unlock(&read_lock);
       continue;
     }
@@ -473,7 +869,7 @@ static void *plugin_read_thread(void __attribute__((unused)) * args) {
      * pthread_cond_timedwait returns. */
     rc = 0;
     while ((read_loop != 0) && (cdtime() < rf->rf_next_read) && rc == 0) {
-      rc = pthread_cond_timedwait(&read_cond, &read_lock,
+      rc = pthread_cond_timedwait(&pool->cond, &read_lock,
                                   &CDTIME_T_TO_TIMESPEC(rf->rf_next_read));
     }
 
@@ -485,7 +881,7 @@ static void *plugin_read_thread(void __attribute__((unused)) * args) {
      * the sleep, too. */
     if (read_loop == 0) {
       /* Insert `rf' again, so it can be free'd correctly */
-      c_heap_insert(read_heap, rf);
+      c_heap_insert(pool->heap, rf);
       break;
     }
 
@@ -497,8 +893,7 @@ static void *plugin_read_thread(void __attribute__((unused)) * args) {
       DEBUG("plugin_read_thread: Destroying the `%s' "
             "callback.",
             rf->rf_name);
-      sfree(rf->rf_name);
-      destroy_callback((callback_func_t *)rf);
+      destroy_read_func(rf);
       rf = NULL;
       continue;
     }
@@ -546,6 +941,22 @@ static void *plugin_read_thread(void __attribute__((unused)) * args) {
     /* calculate the time spent in the read function */
     elapsed = (now - start);
 
+    if (record_statistics) {
+      /* how late the read function was started */
+      cdtime_t lag = (start > rf->rf_next_read) ? start - rf->rf_next_read : 0;
+
+      pthread_mutex_lock(&read_lock);
+      rf->rf_calls++;
+      if (status != 0)
+        rf->rf_failures++;
+      latency_counter_add(rf->rf_duration, elapsed);
+      rf->rf_lag_sum += lag;
+      if (rf->rf_lag_max < lag)
+        rf->rf_lag_max = lag;
+      rf->rf_lag_num++;
+      pthread_mutex_unlock(&read_lock);
+    }
+
     if (elapsed > rf->rf_effective_interval)
       WARNING(
           "plugin_read_thread: read-function of the `%s' plugin took %.3f "
@@ -578,7 +989,7 @@ static void *plugin_read_thread(void __attribute__((unused)) * args) {
           rf->rf_name, CDTIME_T_TO_DOUBLE(rf->rf_next_read));
 
     /* Re-insert this read function into the heap again. */
-    c_heap_insert(read_heap, rf);
+    c_heap_insert(pool->heap, rf);
   } /* while (read_loop) */
 
   pthread_exit(NULL);
@@ -615,22 +1026,22 @@ static void set_thread_name(pthread_t tid, char const *name) {
 #endif
 }
 
-static void start_read_threads(size_t num) /* {{{ */
+static void start_read_threads(read_pool_t *pool, size_t num) /* {{{ */
 {
-  if (read_threads != NULL)
+  if (pool->threads != NULL)
     return;
 
-  read_threads = (pthread_t *)calloc(num, sizeof(pthread_t));
-  if (read_threads == NULL) {
+  pool->threads = (pthread_t *)calloc(num, sizeof(pthread_t));
+  if (pool->threads == NULL) {
     ERROR("plugin: start_read_threads: calloc failed.");
     return;
   }
 
-  read_threads_num = 0;
+  pool->threads_num = 0;
   for (size_t i = 0; i < num; i++) {
-    int status = pthread_create(read_threads + read_threads_num,
+    int status = pthread_create(pool->threads + pool->threads_num,
                                 /* attr = */ NULL, plugin_read_thread,
-                                /* arg = */ NULL);
+                                /* arg = */ pool);
     if (status != 0) {
       char errbuf[1024];
       ERROR("plugin: start_read_threads: pthread_create failed "
@@ -640,33 +1051,48 @@ static void start_read_threads(size_t num) /* {{{ */
     }
 
     char name[THREAD_NAME_MAX];
-    ssnprintf(name, sizeof(name), "reader#%zu", read_threads_num);
-    set_thread_name(read_threads[read_threads_num], name);
+    if (pool->name == NULL)
+      ssnprintf(name, sizeof(name), "reader#%zu", pool->threads_num);
+    else
+      ssnprintf(name, sizeof(name), "r%zu:%s", pool->threads_num,
+                pool->name);
+    set_thread_name(pool->threads[pool->threads_num], name);
 
-    read_threads_num++;
+    pool->threads_num++;
   } /* for (i) */
 } /* }}} void start_read_threads */
 
 static void stop_read_threads(void) {
-  if (read_threads == NULL)
+  size_t threads_num = 0;
+
+  for (read_pool_t *pool = &default_read_pool; pool != NULL;
+       pool = pool->next)
+    threads_num += pool->threads_num;
+
+  if (threads_num == 0)
     return;
 
-  INFO("collectd: Stopping %zu read threads.", read_threads_num);
+  INFO("collectd: Stopping %zu read threads.", threads_num);
 
   pthread_mutex_lock(&read_lock);
   read_loop = 0;
   DEBUG("plugin: stop_read_threads: Signalling `read_cond'");
-  pthread_cond_broadcast(&read_cond);
+  for (read_pool_t *pool = &default_read_pool; pool != NULL;
+       pool = pool->next)
+    pthread_cond_broadcast(&pool->cond);
   pthread_mutex_unlock(&read_lock);
 
-  for (size_t i = 0; i < read_threads_num; i++) {
-    if (pthread_join(read_threads[i], NULL) != 0) {
-      ERROR("plugin: stop_read_threads: pthread_join failed.");
+  for (read_pool_t *pool = &default_read_pool; pool != NULL;
+       pool = pool->next) {
+    for (size_t i = 0; i < pool->threads_num; i++) {
+      if (pthread_join(pool->threads[i], NULL) != 0) {
+        ERROR("plugin: stop_read_threads: pthread_join failed.");
+      }
+      pool->threads[i] = (pthread_t)0;
     }
-    read_threads[i] = (pthread_t)0;
+    sfree(pool->threads);
+    pool->threads_num = 0;
   }
-  sfree(read_threads);
-  read_threads_num = 0;
 } /* void stop_read_threads */
 
 static void plugin_value_list_free(value_list_t *vl) /* {{{ */
@@ -756,6 +1182,8 @@ static int plugin_write_enqueue(value_list_t const *vl) /* {{{ */
    * value-list later on. */
   q->ctx = plugin_get_ctx();
 
+  q->time = record_statistics ? cdtime() : 0;
+
   pthread_mutex_lock(&write_lock);
 
   if (write_queue_tail == NULL) {
@@ -797,6 +1225,9 @@ static value_list_t *plugin_write_dequeue(void) /* {{{ */
     assert(0 == write_queue_length);
   }
 
+  if ((write_queue_latency != NULL) && (q->time != 0))
+    latency_counter_add(write_queue_latency, cdtime() - q->time);
+
   pthread_mutex_unlock(&write_lock);
 
   (void)plugin_set_ctx(q->ctx);
@@ -900,6 +1331,436 @@ static void stop_write_threads(void) /* {{{ */
   }
 } /* }}} void stop_write_threads */
 
+static void plugin_log_dispatch(int level, const char *msg) /* {{{ */
+{
+  llentry_t *le;
+
+  if (list_log == NULL) {
+    fprintf(stderr, "%s\n", msg);
+    return;
+  }
+
+  le = llist_head(list_log);
+  while (le != NULL) {
+    callback_func_t *cf;
+    plugin_log_cb callback;
+
+    cf = le->value;
+    callback = cf->cf_callback;
+
+    /* do not switch plugin context; rather keep the context
+     * (interval) information of the calling plugin */
+
+    (*callback)(level, msg, &cf->cf_udata);
+
+    le = le->next;
+  }
+} /* }}} void plugin_log_dispatch */
+
+/* "arg" is the ring; `log_ring' is reset before the thread is stopped. */
+static void *plugin_log_thread(void *arg) /* {{{ */
+{
+  ring_t *ring = arg;
+  derive_t dropped_reported = 0;
+  log_record_t rec;
+
+  while (42) {
+    log_record_t *slot = ring_peek(ring);
+    derive_t dropped;
+
+    if (slot != NULL) {
+      /* Release the slot first, so that plugin_log_pending() only reports
+       * the messages after this one and log callbacks flush at the end of a
+       * burst. */
+      memcpy(&rec, slot, sizeof(rec));
+      ring_release(ring);
+      plugin_log_dispatch(rec.level, rec.msg);
+      continue;
+    }
+
+    /* Caught up: tell the log callbacks about messages lost meanwhile. */
+    dropped = __atomic_load_n(&stats_log_dropped, __ATOMIC_RELAXED);
+    if (dropped != dropped_reported) {
+      char msg[128];
+      snprintf(msg, sizeof(msg),
+               "plugin_log: Dropped %" PRIi64 " messages because the log "
+               "queue was full.",
+               (int64_t)(dropped - dropped_reported));
+      plugin_log_dispatch(LOG_WARNING, msg);
+      dropped_reported = dropped;
+    }
+
+    pthread_mutex_lock(&log_lock);
+    if (!log_loop) {
+      pthread_mutex_unlock(&log_lock);
+      break;
+    }
+
+    __atomic_store_n(&log_thread_waiting, 1, __ATOMIC_SEQ_CST);
+    if (ring_is_empty(ring)) {
+      /* The timeout only matters if a wakeup got lost. */
+      cdtime_t until = cdtime() + MS_TO_CDTIME_T(100);
+      struct timespec ts = CDTIME_T_TO_TIMESPEC(until);
+      pthread_cond_timedwait(&log_cond, &log_lock, &ts);
+    }
+    __atomic_store_n(&log_thread_waiting, 0, __ATOMIC_SEQ_CST);
+    pthread_mutex_unlock(&log_lock);
+  }
+
+  return NULL;
+} /* }}} void *plugin_log_thread */
+
+/* A forked child, e.g. the exec plugin's before calling exec(2), has no log
+ * thread. It logs synchronously, so that its last messages are not lost.
+ * `log_limit_lock' is held across fork(2), so the child does not inherit it
+ * locked. */
+static void plugin_log_atfork_prepare(void) /* {{{ */
+{
+  pthread_mutex_lock(&log_limit_lock);
+} /* }}} void plugin_log_atfork_prepare */
+
+static void plugin_log_atfork_parent(void) /* {{{ */
+{
+  pthread_mutex_unlock(&log_limit_lock);
+} /* }}} void plugin_log_atfork_parent */
+
+static void plugin_log_atfork_child(void) /* {{{ */
+{
+  log_ring = NULL;
+  log_producers = 0;
+  log_thread_running = 0;
+  pthread_mutex_unlock(&log_limit_lock);
+} /* }}} void plugin_log_atfork_child */
+
+static void start_log_thread(size_t queue_length) /* {{{ */
+{
+  static _Bool atfork_registered = 0;
+  int status;
+
+  if (log_thread_running || (queue_length == 0))
+    return;
+
+  if (!atfork_registered) {
+    status = pthread_atfork(plugin_log_atfork_prepare,
+                            plugin_log_atfork_parent, plugin_log_atfork_child);
+    if (status != 0) {
+      char errbuf[1024];
+      ERROR("plugin: start_log_thread: pthread_atfork failed: %s",
+            sstrerror(status, errbuf, sizeof(errbuf)));
+      return;
+    }
+    atfork_registered = 1;
+  }
+
+  log_ring = ring_create(sizeof(log_record_t), queue_length);
+  if (log_ring == NULL) {
+    ERROR("plugin: start_log_thread: ring_create failed.");
+    return;
+  }
+
+  log_loop = 1;
+  status = pthread_create(&log_thread, /* attr = */ NULL, plugin_log_thread,
+                          /* arg = */ log_ring);
+  if (status != 0) {
+    char errbuf[1024];
+    ring_destroy(log_ring);
+    log_ring = NULL;
+    ERROR("plugin: start_log_thread: pthread_create failed with status %i "
+          "(%s).",
+          status, sstrerror(status, errbuf, sizeof(errbuf)));
+    return;
+  }
+  set_thread_name(log_thread, "log");
+  log_thread_running = 1;
+} /* }}} void start_log_thread */
+
+/* Switches back to calling the log callbacks synchronously, after the log
+ * thread has passed on all queued messages. */
+static void stop_log_thread(void) /* {{{ */
+{
+  ring_t *ring = log_ring;
+
+  if (!log_thread_running)
+    return;
+
+  __atomic_store_n(&log_ring, NULL, __ATOMIC_SEQ_CST);
+  while (__atomic_load_n(&log_producers, __ATOMIC_SEQ_CST) != 0)
+    sched_yield();
+
+  pthread_mutex_lock(&log_lock);
+  log_loop = 0;
+  pthread_cond_broadcast(&log_cond);
+  pthread_mutex_unlock(&log_lock);
+
+  pthread_join(log_thread, NULL);
+  log_thread_running = 0;
+
+  ring_destroy(ring);
+} /* }}} void stop_log_thread */
+
+/* FNV-1a over the fields compared by notif_equal(). */
+static uint32_t notif_hash(notification_t const *n) /* {{{ */
+{
+  char const *fields[] = {n->host,          n->plugin, n->plugin_instance,
+                          n->type,          n->type_instance,
+                          n->message};
+  uint32_t hash = 2166136261u ^ (uint32_t)n->severity;
+
+  for (size_t i = 0; i < STATIC_ARRAY_SIZE(fields); i++) {
+    /* Include the terminating null byte to separate the fields. */
+    unsigned char const *ptr = (unsigned char const *)fields[i];
+    do {
+      hash = (hash ^ *ptr) * 16777619u;
+    } while (*(ptr++) != 0);
+  }
+
+  return hash;
+} /* }}} uint32_t notif_hash */
+
+/* Notifications are identical if they differ in time and meta data only. */
+static _Bool notif_equal(notification_t const *a, /* {{{ */
+                         notification_t const *b) {
+  return (a->severity == b->severity) && (strcmp(a->host, b->host) == 0) &&
+         (strcmp(a->plugin, b->plugin) == 0) &&
+         (strcmp(a->plugin_instance, b->plugin_instance) == 0) &&
+         (strcmp(a->type, b->type) == 0) &&
+         (strcmp(a->type_instance, b->type_instance) == 0) &&
+         (strcmp(a->message, b->message) == 0);
+} /* }}} _Bool notif_equal */
+
+static notif_entry_t *notif_entry_create(notification_t const *n, /* {{{ */
+                                         uint32_t hash) {
+  notif_entry_t *e = calloc(1, sizeof(*e));
+  if (e == NULL)
+    return NULL;
+
+  memcpy(&e->n, n, sizeof(e->n));
+  e->n.meta = NULL;
+  if ((n->meta != NULL) && (plugin_notification_meta_copy(&e->n, n) != 0)) {
+    plugin_notification_meta_free(e->n.meta);
+    free(e);
+    return NULL;
+  }
+
+  e->hash = hash;
+  e->enqueued = cdtime();
+  e->refs = 1;
+  return e;
+} /* }}} notif_entry_t *notif_entry_create */
+
+static void notif_entry_unref(notif_entry_t *e) /* {{{ */
+{
+  if (e == NULL)
+    return;
+  if (__atomic_sub_fetch(&e->refs, 1, __ATOMIC_ACQ_REL) != 0)
+    return;
+
+  plugin_notification_meta_free(e->n.meta);
+  free(e);
+} /* }}} void notif_entry_unref */
+
+/* Appends the notification to the queue, unless an identical one is already
+ * waiting in there or the queue is full. The entry is created when it is
+ * first needed and shared by all queues; "entry" holds the caller's
+ * reference. */
+static void notif_queue_push(notif_queue_t *q, /* {{{ */
+                             notification_t const *n, uint32_t hash,
+                             notif_entry_t **entry) {
+  pthread_mutex_lock(&q->lock);
+
+  for (size_t i = 0; i < q->num; i++) {
+    notif_entry_t *e = q->entries[(q->head + i) % q->size];
+    if ((e->hash == hash) && notif_equal(&e->n, n)) {
+      q->coalesced++;
+      pthread_mutex_unlock(&q->lock);
+      return;
+    }
+  }
+
+  if (q->num >= q->size) {
+    q->dropped++;
+    pthread_mutex_unlock(&q->lock);
+    return;
+  }
+
+  if (*entry == NULL)
+    *entry = notif_entry_create(n, hash);
+  if (*entry == NULL) {
+    q->dropped++;
+    pthread_mutex_unlock(&q->lock);
+    return;
+  }
+
+  __atomic_add_fetch(&(*entry)->refs, 1, __ATOMIC_RELAXED);
+  q->entries[(q->head + q->num) % q->size] = *entry;
+  q->num++;
+
+  pthread_cond_signal(&q->cond);
+  pthread_mutex_unlock(&q->lock);
+} /* }}} void notif_queue_push */
+
+static void *notif_queue_thread(void *arg) /* {{{ */
+{
+  notif_queue_t *q = arg;
+  plugin_notification_cb callback = q->cf->cf_callback;
+
+  plugin_set_ctx(q->cf->cf_ctx);
+
+  pthread_mutex_lock(&q->lock);
+  while (42) {
+    notif_entry_t *e;
+    int status;
+
+    while (q->loop && (q->num == 0))
+      pthread_cond_wait(&q->cond, &q->lock);
+    /* Deliver everything queued before exiting. */
+    if (q->num == 0)
+      break;
+
+    e = q->entries[q->head];
+    q->head = (q->head + 1) % q->size;
+    q->num--;
+    latency_counter_add(q->latency, cdtime() - e->enqueued);
+    pthread_mutex_unlock(&q->lock);
+
+    status = (*callback)(&e->n, &q->cf->cf_udata);
+    if (status != 0) {
+      WARNING("plugin_dispatch_notification: Notification "
+              "callback %s returned %i.",
+              q->name, status);
+    }
+    notif_entry_unref(e);
+
+    pthread_mutex_lock(&q->lock);
+  }
+  pthread_mutex_unlock(&q->lock);
+
+  return NULL;
+} /* }}} void *notif_queue_thread */
+
+static void notif_queue_destroy(notif_queue_t *q) /* {{{ */
+{
+  if (q == NULL)
+    return;
+
+  for (size_t i = 0; i < q->num; i++)
+    notif_entry_unref(q->entries[(q->head + i) % q->size]);
+
+  pthread_cond_destroy(&q->cond);
+  pthread_mutex_destroy(&q->lock);
+  latency_counter_destroy(q->latency);
+  sfree(q->entries);
+  sfree(q->name);
+  sfree(q);
+} /* }}} void notif_queue_destroy */
+
+static notif_queue_t *notif_queue_create(char const *name, /* {{{ */
+                                         callback_func_t *cf, size_t size) {
+  notif_queue_t *q = calloc(1, sizeof(*q));
+  if (q == NULL)
+    return NULL;
+
+  pthread_mutex_init(&q->lock, /* attr = */ NULL);
+  pthread_cond_init(&q->cond, /* attr = */ NULL);
+  q->name = strdup(name);
+  q->cf = cf;
+  q->size = size;
+  q->entries = calloc(size, sizeof(*q->entries));
+  q->latency = latency_counter_create();
+  if ((q->name == NULL) || (q->entries == NULL) || (q->latency == NULL)) {
+    notif_queue_destroy(q);
+    return NULL;
+  }
+
+  q->loop = 1;
+  return q;
+} /* }}} notif_queue_t *notif_queue_create */
+
+/* Waits for the queue's thread to deliver the queued notifications and
+ * frees the queue. */
+static void notif_queue_stop(notif_queue_t *q) /* {{{ */
+{
+  pthread_mutex_lock(&q->lock);
+  q->loop = 0;
+  pthread_cond_broadcast(&q->cond);
+  pthread_mutex_unlock(&q->lock);
+
+  pthread_join(q->thread, NULL);
+  notif_queue_destroy(q);
+} /* }}} void notif_queue_stop */
+
+static void start_notification_threads(size_t queue_length) /* {{{ */
+{
+  notif_queue_t **queues;
+  size_t queues_num = 0;
+
+  if ((queue_length == 0) || (list_notification == NULL) ||
+      (notif_queues != NULL))
+    return;
+
+  queues = calloc((size_t)llist_size(list_notification), sizeof(*queues));
+  if (queues == NULL) {
+    ERROR("plugin: start_notification_threads: calloc failed.");
+    return;
+  }
+
+  for (llentry_t *le = llist_head(list_notification); le != NULL;
+       le = le->next) {
+    notif_queue_t *q = notif_queue_create(le->key, le->value, queue_length);
+    int status;
+
+    if (q == NULL) {
+      ERROR("plugin: start_notification_threads: Creating the queue of "
+            "\"%s\" failed.",
+            le->key);
+      continue;
+    }
+
+    status = pthread_create(&q->thread, /* attr = */ NULL, notif_queue_thread,
+                            q);
+    if (status != 0) {
+      char errbuf[1024];
+      ERROR("plugin: start_notification_threads: pthread_create failed "
+            "with status %i (%s).",
+            status, sstrerror(status, errbuf, sizeof(errbuf)));
+      notif_queue_destroy(q);
+      continue;
+    }
+
+    char name[THREAD_NAME_MAX];
+    ssnprintf(name, sizeof(name), "notify#%zu", queues_num);
+    set_thread_name(q->thread, name);
+
+    queues[queues_num] = q;
+    queues_num++;
+  }
+
+  pthread_rwlock_wrlock(&notif_queues_lock);
+  notif_queues = queues;
+  notif_queues_num = queues_num;
+  pthread_rwlock_unlock(&notif_queues_lock);
+} /* }}} void start_notification_threads */
+
+static void stop_notification_threads(void) /* {{{ */
+{
+  notif_queue_t **queues;
+  size_t queues_num;
+
+  pthread_rwlock_wrlock(&notif_queues_lock);
+  queues = notif_queues;
+  queues_num = notif_queues_num;
+  notif_queues = NULL;
+  notif_queues_num = 0;
+  pthread_rwlock_unlock(&notif_queues_lock);
+
+  if (queues_num > 0)
+    INFO("collectd: Stopping %zu notification threads.", queues_num);
+
+  for (size_t i = 0; i < queues_num; i++)
+    notif_queue_stop(queues[i]);
+  sfree(queues);
+} /* }}} void stop_notification_threads */
+
 /*
  * Public functions
  */
@@ -1092,10 +1953,20 @@ static int plugin_compare_read_func(const void *arg0, const void *arg1) {
 static int plugin_insert_read(read_func_t *rf) {
   int status;
   llentry_t *le;
+  read_pool_t *pool = rf->rf_ctx.read_pool;
+
+  if (pool == NULL)
+    pool = &default_read_pool;
 
   rf->rf_next_read = cdtime();
   rf->rf_effective_interval = rf->rf_interval;
 
+  rf->rf_duration = latency_counter_create();
+  if (rf->rf_duration == NULL) {
+    ERROR("plugin_insert_read: latency_counter_create failed.");
+    return -1;
+  }
+
   pthread_mutex_lock(&read_lock);
 
   if (read_list == NULL) {
@@ -1103,16 +1974,18 @@ static int plugin_insert_read(read_func_t *rf) {
     if (read_list == NULL) {
       pthread_mutex_unlock(&read_lock);
       ERROR("plugin_insert_read: read_list failed.");
-      return -1;
+      status = -1;
+      goto failure;
     }
   }
 
-  if (read_heap == NULL) {
-    read_heap = c_heap_create(plugin_compare_read_func);
-    if (read_heap == NULL) {
+  if (pool->heap == NULL) {
+    pool->heap = c_heap_create(plugin_compare_read_func);
+    if (pool->heap == NULL) {
       pthread_mutex_unlock(&read_lock);
       ERROR("plugin_insert_read: c_heap_create failed.");
-      return -1;
+      status = -1;
+      goto failure;
     }
   }
 
@@ -1123,31 +1996,39 @@ static int plugin_insert_read(read_func_t *rf) {
             "Check for duplicate \"LoadPlugin\" lines "
             "in your configuration!",
             rf->rf_name);
-    return EINVAL;
+    status = EINVAL;
+    goto failure;
   }
 
   le = llentry_create(rf->rf_name, rf);
   if (le == NULL) {
     pthread_mutex_unlock(&read_lock);
     ERROR("plugin_insert_read: llentry_create failed.");
-    return -1;
+    status = -1;
+    goto failure;
   }
 
-  status = c_heap_insert(read_heap, rf);
+  status = c_heap_insert(pool->heap, rf);
   if (status != 0) {
     pthread_mutex_unlock(&read_lock);
     ERROR("plugin_insert_read: c_heap_insert failed.");
     llentry_destroy(le);
-    return -1;
+    status = -1;
+    goto failure;
   }
 
   /* This does not fail. */
   llist_append(read_list, le);
 
   /* Wake up all the read threads. */
-  pthread_cond_broadcast(&read_cond);
+  pthread_cond_broadcast(&pool->cond);
   pthread_mutex_unlock(&read_lock);
   return 0;
+
+failure:
+  latency_counter_destroy(rf->rf_duration);
+  rf->rf_duration = NULL;
+  return status;
 } /* int plugin_insert_read */
 
 int plugin_register_read(const char *name, int (*callback)(void)) {
@@ -1218,6 +2099,47 @@ int plugin_register_complex_read(const char *group, const char *name,
   return status;
 } /* int plugin_register_complex_read */
 
+read_pool_t *plugin_read_pool_create(const char *name, size_t threads) /* {{{ */
+{
+  read_pool_t *pool;
+
+  if ((name == NULL) || (threads < 1))
+    return NULL;
+
+  pthread_mutex_lock(&read_lock);
+  for (pool = default_read_pool.next; pool != NULL; pool = pool->next)
+    if (strcasecmp(name, pool->name) == 0)
+      break;
+
+  if (pool != NULL) {
+    pthread_mutex_unlock(&read_lock);
+    return pool;
+  }
+
+  pool = calloc(1, sizeof(*pool));
+  if (pool == NULL) {
+    pthread_mutex_unlock(&read_lock);
+    ERROR("plugin_read_pool_create: calloc failed.");
+    return NULL;
+  }
+
+  pool->name = strdup(name);
+  if (pool->name == NULL) {
+    pthread_mutex_unlock(&read_lock);
+    ERROR("plugin_read_pool_create: strdup failed.");
+    sfree(pool);
+    return NULL;
+  }
+  pthread_cond_init(&pool->cond, /* attr = */ NULL);
+  pool->threads_wanted = threads;
+
+  pool->next = default_read_pool.next;
+  default_read_pool.next = pool;
+  pthread_mutex_unlock(&read_lock);
+
+  return pool;
+} /* }}} read_pool_t *plugin_read_pool_create */
+
 int plugin_register_write(const char *name, plugin_write_cb callback,
                           user_data_t const *ud) {
   return create_register_callback(&list_write, name, (void *)callback, ud);
@@ -1544,6 +2466,25 @@ int plugin_unregister_log(const char *name) {
 }
 
 int plugin_unregister_notification(const char *name) {
+  notif_queue_t *q = NULL;
+
+  /* Stop the callback's queue first; its thread uses the callback. */
+  pthread_rwlock_wrlock(&notif_queues_lock);
+  for (size_t i = 0; i < notif_queues_num; i++) {
+    if (strcasecmp(notif_queues[i]->name, name) != 0)
+      continue;
+
+    q = notif_queues[i];
+    memmove(notif_queues + i, notif_queues + i + 1,
+            sizeof(*notif_queues) * (notif_queues_num - (i + 1)));
+    notif_queues_num--;
+    break;
+  }
+  pthread_rwlock_unlock(&notif_queues_lock);
+
+  if (q != NULL)
+    notif_queue_stop(q);
+
   return plugin_unregister(list_notification, name);
 }
 
@@ -1558,6 +2499,9 @@ int plugin_init_all(void) {
 
   if (IS_TRUE(global_option_get("CollectInternalStats"))) {
     record_statistics = 1;
+    write_queue_latency = latency_counter_create();
+    if (write_queue_latency == NULL)
+      ERROR("plugin_init_all: latency_counter_create failed.");
     plugin_register_read("collectd", plugin_update_internal_statistics);
   }
 
@@ -1586,6 +2530,20 @@ int plugin_init_all(void) {
     write_limit_low = write_limit_high;
   }
 
+  log_rate_limit = global_option_get_long("LogRateLimit", /* default = */ 0);
+  if (log_rate_limit < 0) {
+    ERROR("LogRateLimit must be positive or zero.");
+    log_rate_limit = 0;
+  }
+
+  long log_queue_length =
+      global_option_get_long("LogQueueLength", /* default = */ 1024);
+  if (log_queue_length < 0) {
+    ERROR("LogQueueLength must be positive or zero.");
+    log_queue_length = 1024;
+  }
+  start_log_thread((size_t)log_queue_length);
+
   write_threads_num = global_option_get_long("WriteThreads",
                                              /* default = */ 5);
   if (write_threads_num < 1) {
@@ -1593,7 +2551,7 @@ int plugin_init_all(void) {
     write_threads_num = 5;
   }
 
-  if ((list_init == NULL) && (read_heap == NULL))
+  if ((list_init == NULL) && !have_read_funcs())
     return ret;
 
   /* Calling all init callbacks before checking if read callbacks
@@ -1629,18 +2587,34 @@ int plugin_init_all(void) {
 
   start_write_threads((size_t)write_threads_num);
 
+  long notification_queue_length =
+      global_option_get_long("NotificationQueueLength", /* default = */ 1024);
+  if (notification_queue_length < 0) {
+    ERROR("NotificationQueueLength must be positive or zero.");
+    notification_queue_length = 1024;
+  }
+  start_notification_threads((size_t)notification_queue_length);
+
   max_read_interval =
       global_option_get_time("MaxReadInterval", DEFAULT_MAX_READ_INTERVAL);
 
   /* Start read-threads */
-  if (read_heap != NULL) {
+  if (have_read_funcs()) {
     const char *rt;
     int num;
 
     rt = global_option_get("ReadThreads");
     num = atoi(rt);
-    if (num != -1)
-      start_read_threads((num > 0) ? ((size_t)num) : 5);
+    if (num != -1) {
+      if (default_read_pool.heap != NULL)
+        start_read_threads(&default_read_pool,
+                           (num > 0) ? ((size_t)num) : 5);
+
+      for (read_pool_t *pool = default_read_pool.next; pool != NULL;
+           pool = pool->next)
+        if (pool->heap != NULL)
+          start_read_threads(pool, pool->threads_wanted);
+    }
   }
   return ret;
 } /* void plugin_init_all */
@@ -1648,6 +2622,7 @@ int plugin_init_all(void) {
 /* TODO: Rename this function. */
 void plugin_read_all(void) {
   uc_check_timeout();
+  uc_check_snapshot();
 
   return;
 } /* void plugin_read_all */
@@ -1657,42 +2632,54 @@ int plugin_read_all_once(void) {
   int status;
   int return_status = 0;
 
-  if (read_heap == NULL) {
+  if (!have_read_funcs()) {
     NOTICE("No read-functions are registered.");
     return 0;
   }
 
-  while (42) {
-    read_func_t *rf;
-    plugin_ctx_t old_ctx;
+  for (read_pool_t *pool = &default_read_pool; pool != NULL;
+       pool = pool->next) {
+    while (pool->heap != NULL) {
+      read_func_t *rf;
+      plugin_ctx_t old_ctx;
 
-    rf = c_heap_get_root(read_heap);
-    if (rf == NULL)
-      break;
+      rf = c_heap_get_root(pool->heap);
+      if (rf == NULL)
+        break;
 
-    old_ctx = plugin_set_ctx(rf->rf_ctx);
+      old_ctx = plugin_set_ctx(rf->rf_ctx);
 
-    if (rf->rf_type == RF_SIMPLE) {
-      int (*callback)(void);
+      if (rf->rf_type == RF_SIMPLE) {
+        int (*callback)(void);
 
-      callback = rf->rf_callback;
-      status = (*callback)();
-    } else {
-      plugin_read_cb callback;
+        callback = rf->rf_callback;
+        status = (*callback)();
+      } else {
+        plugin_read_cb callback;
 
-      callback = rf->rf_callback;
-      status = (*callback)(&rf->rf_udata);
-    }
+        callback = rf->rf_callback;
+        status = (*callback)(&rf->rf_udata);
+      }
 
-    plugin_set_ctx(old_ctx);
+      plugin_set_ctx(old_ctx);
 
-    if (status != 0) {
-      NOTICE("read-function of plugin `%s' failed.", rf->rf_name);
-      return_status = -1;
-    }
+      if (status != 0) {
+        NOTICE("read-function of plugin `%s' failed.", rf->rf_name);
+        return_status = -1;
+      }
 
-    sfree(rf->rf_name);
-    destroy_callback((void *)rf);
+      /* Remove `rf' from the list, too, so the internal statistics don't
+       * access it after it has been freed. */
+      pthread_mutex_lock(&read_lock);
+      llentry_t *le = llist_search(read_list, rf->rf_name);
+      if (le != NULL) {
+        llist_remove(read_list, le);
+        llentry_destroy(le);
+      }
+      pthread_mutex_unlock(&read_lock);
+
+      destroy_read_func(rf);
+    }
   }
 
   return return_status;
@@ -1816,16 +2803,22 @@ int plugin_shutdown_all(void) {
   read_list = NULL;
   pthread_mutex_unlock(&read_lock);
 
-  destroy_read_heap();
+  destroy_read_heaps();
 
   /* blocks until all write threads have shut down. */
   stop_write_threads();
 
+  /* write the final cache snapshot while the data sets are still known. */
+  uc_shutdown();
+
   /* ask all plugins to write out the state they kept. */
   plugin_flush(/* plugin = */ NULL,
                /* timeout = */ 0,
                /* identifier = */ NULL);
 
+  /* deliver the queued notifications before the plugins shut down. */
+  stop_notification_threads();
+
   le = NULL;
   if (list_shutdown != NULL)
     le = llist_head(list_shutdown);
@@ -1862,10 +2855,17 @@ int plugin_shutdown_all(void) {
 
   destroy_all_callbacks(&list_notification);
   destroy_all_callbacks(&list_shutdown);
+
+  /* pass on the queued messages before the log callbacks are gone. */
+  stop_log_thread();
   destroy_all_callbacks(&list_log);
 
   plugin_free_loaded();
   plugin_free_data_sets();
+  destroy_read_pools();
+
+  latency_counter_destroy(write_queue_latency);
+  write_queue_latency = NULL;
   return ret;
 } /* void plugin_shutdown_all */
 
@@ -2014,6 +3014,10 @@ static int plugin_dispatch_values_internal(value_list_t *vl) {
   } else
     fc_default_action(ds, vl);
 
+  /* The caller may free "vl" now and the next value list may get the same
+   * addresses and time. Don't let uc_get_rate() return these rates for it. */
+  uc_clear_last_rate();
+
   if ((free_meta_data != 0) && (vl->meta != NULL)) {
     meta_data_destroy(vl->meta);
     vl->meta = NULL;
@@ -2196,65 +3200,226 @@ int plugin_dispatch_notification(const notification_t *notif) {
   if (list_notification == NULL)
     return -1;
 
+  notif_entry_t *entry = NULL;
+  uint32_t hash = 0;
+
+  pthread_rwlock_rdlock(&notif_queues_lock);
+  if (notif_queues_num > 0)
+    hash = notif_hash(notif);
+
   le = llist_head(list_notification);
   while (le != NULL) {
+    char const *name = le->key;
     callback_func_t *cf;
     plugin_notification_cb callback;
+    notif_queue_t *q = NULL;
     int status;
 
+    cf = le->value;
+    le = le->next;
+
+    for (size_t i = 0; i < notif_queues_num; i++) {
+      if (notif_queues[i]->cf == cf) {
+        q = notif_queues[i];
+        break;
+      }
+    }
+    if (q != NULL) {
+      notif_queue_push(q, notif, hash, &entry);
+      continue;
+    }
+
     /* do not switch plugin context; rather keep the context
      * (interval) information of the calling plugin */
 
-    cf = le->value;
     callback = cf->cf_callback;
     status = (*callback)(notif, &cf->cf_udata);
     if (status != 0) {
       WARNING("plugin_dispatch_notification: Notification "
               "callback %s returned %i.",
-              le->key, status);
+              name, status);
     }
-
-    le = le->next;
   }
+  pthread_rwlock_unlock(&notif_queues_lock);
+
+  /* Drop the reference of notif_entry_create(). */
+  notif_entry_unref(entry);
 
   return 0;
 } /* int plugin_dispatch_notification */
 
-void plugin_log(int level, const char *format, ...) {
-  char msg[1024];
-  va_list ap;
-  llentry_t *le;
+_Bool plugin_log_pending(void) /* {{{ */
+{
+  ring_t *ring = __atomic_load_n(&log_ring, __ATOMIC_ACQUIRE);
 
-#if !COLLECT_DEBUG
-  if (level >= LOG_DEBUG)
+  return (ring != NULL) && !ring_is_empty(ring);
+} /* }}} _Bool plugin_log_pending */
+
+/* Returns the key identifying the call site among the callers using "format",
+ * see log_limit_t. */
+static uint64_t plugin_log_site_key(const char *format, va_list ap) /* {{{ */
+{
+  uint64_t hash = 14695981039346656037ULL;
+  const char *msg;
+  va_list aq;
+
+  if ((format[0] != '%') || (format[1] != 's') || (format[2] != 0))
+    return 0;
+
+  va_copy(aq, ap);
+  msg = va_arg(aq, const char *);
+  va_end(aq);
+
+  if (msg == NULL)
+    return 0;
+
+  /* FNV-1a */
+  for (const unsigned char *ptr = (const unsigned char *)msg; *ptr != 0; ptr++)
+    hash = (hash ^ *ptr) * 1099511628211ULL;
+  return hash;
+} /* }}} uint64_t plugin_log_site_key */
+
+/* Returns true if a message of the call site "format"/"key" may be logged. If
+ * messages of the call site have been suppressed before, their number is
+ * returned in "suppressed". If the slot of another call site with suppressed
+ * messages is taken over, their number is returned in "evicted". */
+static _Bool plugin_log_check_rate(int level, const char *format, /* {{{ */
+                                   uint64_t key, unsigned int *suppressed,
+                                   unsigned int *evicted) {
+  log_limit_t *l;
+  uint64_t site;
+  cdtime_t now;
+  _Bool same_site;
+  _Bool ret;
+
+  *suppressed = 0;
+  *evicted = 0;
+  if ((log_rate_limit <= 0) || (level >= LOG_DEBUG))
+    return 1;
+
+  /* Fibonacci hashing of the address; the low bits are mostly alignment. */
+  site = ((uint64_t)(uintptr_t)format) ^ key;
+  l = log_limits +
+      ((site * UINT64_C(11400714819323198485)) >> 54) % LOG_LIMIT_SLOTS;
+  now = cdtime();
+
+  pthread_mutex_lock(&log_limit_lock);
+  same_site = (l->format == format) && (l->key == key);
+  if (!same_site || ((now - l->window_start) >= TIME_T_TO_CDTIME_T(1))) {
+    if (same_site)
+      *suppressed = l->suppressed;
+    else
+      *evicted = l->suppressed;
+    l->format = format;
+    l->key = key;
+    l->window_start = now;
+    l->count = 0;
+    l->suppressed = 0;
+  }
+
+  if (l->count < (unsigned int)log_rate_limit) {
+    l->count++;
+    ret = 1;
+  } else {
+    l->suppressed++;
+    stats_log_suppressed++;
+    ret = 0;
+  }
+  pthread_mutex_unlock(&log_limit_lock);
+
+  return ret;
+} /* }}} _Bool plugin_log_check_rate */
+
+static void plugin_vlog(int level, const char *format, va_list ap) /* {{{ */
+{
+  ring_t *ring;
+
+  __atomic_add_fetch(&log_producers, 1, __ATOMIC_SEQ_CST);
+  ring = __atomic_load_n(&log_ring, __ATOMIC_SEQ_CST);
+
+  if (ring != NULL) {
+    uint64_t ticket;
+    log_record_t *rec = ring_reserve(ring, &ticket);
+
+    if (rec == NULL) {
+      __atomic_add_fetch(&stats_log_dropped, 1, __ATOMIC_RELAXED);
+    } else {
+      rec->level = level;
+      vsnprintf(rec->msg, sizeof(rec->msg), format, ap);
+      rec->msg[sizeof(rec->msg) - 1] = '\0';
+      ring_commit(ring, ticket);
+
+      /* Pairs with the log thread setting `log_thread_waiting' before
+       * checking the ring once more. */
+      __atomic_thread_fence(__ATOMIC_SEQ_CST);
+      if (__atomic_load_n(&log_thread_waiting, __ATOMIC_RELAXED)) {
+        pthread_mutex_lock(&log_lock);
+        pthread_cond_signal(&log_cond);
+        pthread_mutex_unlock(&log_lock);
+      }
+    }
+
+    __atomic_sub_fetch(&log_producers, 1, __ATOMIC_SEQ_CST);
     return;
-#endif
+  }
+  __atomic_sub_fetch(&log_producers, 1, __ATOMIC_SEQ_CST);
 
-  va_start(ap, format);
+  char msg[1024];
   vsnprintf(msg, sizeof(msg), format, ap);
   msg[sizeof(msg) - 1] = '\0';
+
+  plugin_log_dispatch(level, msg);
+} /* }}} void plugin_vlog */
+
+static void plugin_log_unlimited(int level, const char *format, ...) /* {{{ */
+{
+  va_list ap;
+
+  va_start(ap, format);
+  plugin_vlog(level, format, ap);
   va_end(ap);
+} /* }}} void plugin_log_unlimited */
 
-  if (list_log == NULL) {
-    fprintf(stderr, "%s\n", msg);
+void plugin_log(int level, const char *format, ...) {
+  unsigned int suppressed;
+  unsigned int evicted;
+  uint64_t key = 0;
+  _Bool ok;
+  va_list ap;
+
+#if !COLLECT_DEBUG
+  if (level >= LOG_DEBUG)
     return;
+#endif
+
+  if (log_rate_limit > 0) {
+    va_start(ap, format);
+    key = plugin_log_site_key(format, ap);
+    va_end(ap);
   }
 
-  le = llist_head(list_log);
-  while (le != NULL) {
-    callback_func_t *cf;
-    plugin_log_cb callback;
+  ok = plugin_log_check_rate(level, format, key, &suppressed, &evicted);
 
-    cf = le->value;
-    callback = cf->cf_callback;
+  /* Report the messages of the call site whose slot has been taken over, or
+   * they would never be accounted for. */
+  if (evicted > 0)
+    plugin_log_unlimited(LOG_NOTICE,
+                         "plugin_log: Suppressed %u messages of another "
+                         "rate limited call site.",
+                         evicted);
 
-    /* do not switch plugin context; rather keep the context
-     * (interval) information of the calling plugin */
+  if (!ok)
+    return;
 
-    (*callback)(level, msg, &cf->cf_udata);
+  if (suppressed > 0)
+    plugin_log_unlimited(level,
+                         "plugin_log: Suppressed %u messages like the "
+                         "following one.",
+                         suppressed);
 
-    le = le->next;
-  }
+  va_start(ap, format);
+  plugin_vlog(level, format, ap);
+  va_end(ap);
 } /* void plugin_log */
 
 int parse_log_severity(const char *severity) {
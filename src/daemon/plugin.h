@@ -174,10 +174,15 @@ struct user_data_s {
 };
 typedef struct user_data_s user_data_t;
 
+struct read_pool_s;
+typedef struct read_pool_s read_pool_t;
+
 struct plugin_ctx_s {
   cdtime_t interval;
   cdtime_t flush_interval;
   cdtime_t flush_timeout;
+  /* read threads used for the read callbacks, NULL for the global ones. */
+  read_pool_t *read_pool;
 };
 typedef struct plugin_ctx_s plugin_ctx_t;
 
@@ -236,6 +241,22 @@ void plugin_set_dir(const char *dir);
  */
 int plugin_load(const char *name, _Bool global);
 
+/*
+ * NAME
+ *  plugin_read_pool_create
+ *
+ * DESCRIPTION
+ *  Returns a pool of `threads' read threads named `name', creating it if it
+ *  does not exist yet. Read callbacks registered while a plugin context with
+ *  this pool is active are handled by these threads only, so that slow
+ *  plugins cannot delay the read callbacks of other plugins. The threads are
+ *  started by `plugin_init_all'.
+ *
+ * RETURN VALUE
+ *  Returns the pool or NULL if an error occurred.
+ */
+read_pool_t *plugin_read_pool_create(const char *name, size_t threads);
+
 int plugin_init_all(void);
 void plugin_read_all(void);
 int plugin_read_all_once(void);
@@ -388,6 +409,11 @@ int plugin_dispatch_notification(const notification_t *notif);
 void plugin_log(int level, const char *format, ...)
     __attribute__((format(printf, 2, 3)));
 
+/* Returns true if log messages are queued which have not been passed to the
+ * log callbacks yet. Log callbacks may use this to write messages in batches,
+ * e.g. by flushing buffered output only when this returns false. */
+_Bool plugin_log_pending(void);
+
 /* These functions return the parsed severity or less than zero on failure. */
 int parse_log_severity(const char *severity);
 int parse_notif_severity(const char *severity);
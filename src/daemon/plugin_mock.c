@@ -67,6 +67,30 @@ int plugin_register_shutdown(const char *name, int (*callback)(void)) {
   return ENOTSUP;
 }
 
+int plugin_register_write(const char *name, plugin_write_cb callback,
+                          user_data_t const *user_data) {
+  return ENOTSUP;
+}
+
+int plugin_register_flush(const char *name, plugin_flush_cb callback,
+                          user_data_t const *user_data) {
+  return ENOTSUP;
+}
+
+int plugin_register_notification(const char *name,
+                                 plugin_notification_cb callback,
+                                 user_data_t const *user_data) {
+  return ENOTSUP;
+}
+
+int plugin_unregister_config(const char *name) { return ENOTSUP; }
+
+int plugin_unregister_init(const char *name) { return ENOTSUP; }
+
+int plugin_unregister_write(const char *name) { return ENOTSUP; }
+
+int plugin_unregister_shutdown(const char *name) { return ENOTSUP; }
+
 int plugin_register_data_set(const data_set_t *ds) { return ENOTSUP; }
 
 int plugin_dispatch_values(value_list_t const *vl) { return ENOTSUP; }
@@ -75,6 +99,22 @@ int plugin_flush(const char *plugin, cdtime_t timeout, const char *identifier) {
   return ENOTSUP;
 }
 
+int plugin_dispatch_notification(const notification_t *notif) {
+  return ENOTSUP;
+}
+
+int plugin_notification_meta_add_string(notification_t *n, const char *name,
+                                        const char *value) {
+  return ENOTSUP;
+}
+
+int plugin_notification_meta_add_boolean(notification_t *n, const char *name,
+                                         _Bool value) {
+  return ENOTSUP;
+}
+
+int plugin_notification_meta_free(notification_meta_t *n) { return 0; }
+
 static data_source_t magic_ds[] = {{"value", DS_TYPE_DERIVE, 0.0, NAN}};
 static data_set_t magic = {"MAGIC", 1, magic_ds};
 const data_set_t *plugin_get_ds(const char *name) {
@@ -112,6 +152,12 @@ plugin_ctx_t plugin_set_ctx(plugin_ctx_t ctx) {
 
 cdtime_t plugin_get_interval(void) { return mock_context.interval; }
 
+int plugin_thread_create(pthread_t *thread, const pthread_attr_t *attr,
+                         void *(*start_routine)(void *), void *arg,
+                         char const *name) {
+  return pthread_create(thread, attr, start_routine, arg);
+}
+
 /* TODO(octo): this function is actually from filter_chain.h, but in order not
  * to tumble down that rabbit hole, we're declaring it here. A better solution
  * would be to hard-code the top-level config keys in daemon/collectd.c to avoid
@@ -0,0 +1,141 @@
+/**
+ * collectd - src/daemon/utils_avltree_bench.c
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include "collectd.h"
+
+#include "benchmark.h"
+#include "utils_avltree.h"
+
+/* Number of keys, roughly the number of series in a mid-sized setup. Keys
+ * look like the identifiers used by the value cache. */
+#define KEYS_NUM 100000
+
+static char *keys[KEYS_NUM];
+
+/* The tree itself is not thread-safe; like the value cache, the shared tree
+ * is protected by a mutex. */
+static c_avl_tree_t *shared_tree;
+static pthread_mutex_t shared_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static void keys_create(void) {
+  for (size_t i = 0; i < KEYS_NUM; i++) {
+    char buffer[128];
+
+    snprintf(buffer, sizeof(buffer), "host%04zu/plugin%02zu-%zu/gauge-ti%zu",
+             (i * 7919) % 1000, i % 20, i % 7, i);
+    keys[i] = strdup(buffer);
+  }
+}
+
+static void keys_destroy(void) {
+  for (size_t i = 0; i < KEYS_NUM; i++)
+    free(keys[i]);
+}
+
+static int compare(void const *a, void const *b) { return strcmp(a, b); }
+
+/* Inserts KEYS_NUM keys into a private tree and removes them again. One
+ * operation is one insert or one remove. */
+DEF_BENCH(insert_remove) {
+  c_avl_tree_t *t = c_avl_create(compare);
+  uint64_t i = 0;
+
+  while (i < b->iterations) {
+    size_t n = 0;
+
+    for (; (n < KEYS_NUM) && (i < b->iterations); n++, i++)
+      c_avl_insert(t, keys[n], keys[n]);
+
+    for (size_t j = 0; (j < n) && (i < b->iterations); j++, i++)
+      c_avl_remove(t, keys[j], NULL, NULL);
+  }
+
+  c_avl_destroy(t);
+}
+
+/* Looks up existing keys in the shared tree without locking. */
+DEF_BENCH(get) {
+  size_t k = b->thread * (KEYS_NUM / b->threads_num);
+
+  for (uint64_t i = 0; i < b->iterations; i++) {
+    void *value = NULL;
+
+    c_avl_get(shared_tree, keys[k], &value);
+    BENCH_KEEP(value);
+
+    k = (k + 7919) % KEYS_NUM;
+  }
+}
+
+/* Like "get", but takes the lock around each lookup, the way the value cache
+ * uses the tree. */
+DEF_BENCH(get_locked) {
+  size_t k = b->thread * (KEYS_NUM / b->threads_num);
+
+  for (uint64_t i = 0; i < b->iterations; i++) {
+    void *value = NULL;
+
+    pthread_mutex_lock(&shared_lock);
+    c_avl_get(shared_tree, keys[k], &value);
+    pthread_mutex_unlock(&shared_lock);
+    BENCH_KEEP(value);
+
+    k = (k + 7919) % KEYS_NUM;
+  }
+}
+
+/* Walks the shared tree. One operation is one step of the iterator. */
+DEF_BENCH(iterate) {
+  uint64_t i = 0;
+
+  while (i < b->iterations) {
+    c_avl_iterator_t *iter = c_avl_get_iterator(shared_tree);
+    void *key;
+    void *value;
+
+    while ((i < b->iterations) &&
+           (c_avl_iterator_next(iter, &key, &value) == 0)) {
+      BENCH_KEEP(value);
+      i++;
+    }
+    c_avl_iterator_destroy(iter);
+  }
+}
+
+int main(void) {
+  keys_create();
+
+  shared_tree = c_avl_create(compare);
+  for (size_t i = 0; i < KEYS_NUM; i++)
+    c_avl_insert(shared_tree, keys[i], keys[i]);
+
+  RUN_BENCH(insert_remove, 1, NULL);
+  RUN_BENCH(get, 1, NULL);
+  RUN_BENCH(get, BENCH_THREADS, NULL);
+  RUN_BENCH(get_locked, 1, NULL);
+  RUN_BENCH(get_locked, BENCH_THREADS, NULL);
+  RUN_BENCH(iterate, 1, NULL);
+
+  c_avl_destroy(shared_tree);
+  keys_destroy();
+  return 0;
+}
@@ -29,12 +29,46 @@
 #include "collectd.h"
 
 #include "common.h"
+#include "configfile.h"
 #include "meta_data.h"
 #include "plugin.h"
 #include "utils_avltree.h"
 #include "utils_cache.h"
+#include "utils_complain.h"
 
 #include <assert.h>
+#include <regex.h>
+
+/* Maximum number of aggregated tiers, see uc_configure_history(). */
+#define UC_HISTORY_TIERS_MAX 8
+
+/* One aggregated tier of a series' history: a ring of "buckets" buckets, each
+ * covering "resolution" of time and holding the minimum, average and maximum
+ * of the values received in that time. Buckets are aligned to multiples of the
+ * resolution and are contiguous, so only the start of the newest one is
+ * stored. */
+typedef struct {
+  cdtime_t start; /* start of the newest bucket */
+  uint32_t index; /* position of the newest bucket */
+  uint32_t num;   /* number of buckets in use */
+  float *min;     /* buckets * values_num */
+  float *avg;
+  float *max;
+  uint16_t *count; /* number of non-NaN values per bucket and data source */
+} uc_tier_t;
+
+/* Tiered history of a series. All arrays live in the same allocation as the
+ * header. The raw points only store the time difference to the previous
+ * point, in milliseconds. */
+typedef struct {
+  size_t size; /* bytes counted against the memory limit */
+  cdtime_t last_time;
+  uint32_t raw_index; /* points to the next position to write to. */
+  uint32_t raw_num;   /* number of raw points in use */
+  float *raw;         /* raw_points * values_num */
+  uint32_t *raw_delta;
+  uc_tier_t tiers[];
+} uc_tiered_t;
 
 typedef struct cache_entry_s {
   char name[6 * DATA_MAX_NAME_LEN];
@@ -66,6 +100,9 @@ typedef struct cache_entry_s {
   size_t history_index; /* points to the next position to write to. */
   size_t history_length;
 
+  /* Only allocated for series matching the <History> configuration. */
+  uc_tiered_t *tiered;
+
   meta_data_t *meta;
 } cache_entry_t;
 
@@ -79,6 +116,89 @@ struct uc_iter_s {
 static c_avl_tree_t *cache_tree = NULL;
 static pthread_mutex_t cache_lock = PTHREAD_MUTEX_INITIALIZER;
 
+/* Snapshot file, see uc_snapshot_write() for the format. */
+#define UC_SNAPSHOT_MAGIC 0x63644331 /* "cdC1" */
+#define UC_SNAPSHOT_VERSION 1
+
+static char *snapshot_file = NULL;
+static cdtime_t snapshot_interval = 0;
+static cdtime_t snapshot_next = 0;
+
+/* Tiered history configuration. */
+typedef struct {
+  char *pattern;
+  regex_t *re; /* NULL if the identifier has to match "pattern" exactly */
+} uc_history_match_t;
+
+static uc_history_match_t *history_match = NULL;
+static size_t history_match_num = 0;
+static uint32_t history_raw_points = 60;
+static struct {
+  cdtime_t resolution;
+  uint32_t buckets;
+} history_tiers[UC_HISTORY_TIERS_MAX] = {
+    {TIME_T_TO_CDTIME_T_STATIC(60), 60},
+};
+static size_t history_tiers_num = 1;
+/* Enough for one million series with one data source each and the default
+ * tiers. */
+static uint64_t history_memory_limit = 2147483648ULL;
+static uint64_t history_memory_used = 0;
+static c_complain_t history_complaint = C_COMPLAIN_INIT_STATIC;
+
+/* Rates calculated by the last call of uc_update() in this thread. Write
+ * callbacks run in the thread that updated the cache, right after the update,
+ * so uc_get_rate() can usually answer from here without formatting the
+ * identifier, taking cache_lock and searching the tree. */
+#define UC_LAST_RATE_MAX 8
+typedef struct {
+  const value_list_t *vl; /* NULL if the last update did not succeed */
+  const value_t *values;
+  cdtime_t time;
+  size_t values_num;
+  gauge_t values_gauge[UC_LAST_RATE_MAX];
+} uc_last_rate_t;
+
+static pthread_key_t last_rate_key;
+static pthread_once_t last_rate_once = PTHREAD_ONCE_INIT;
+
+static void uc_last_rate_key_create(void) /* {{{ */
+{
+  pthread_key_create(&last_rate_key, free);
+} /* }}} void uc_last_rate_key_create */
+
+static uc_last_rate_t *uc_last_rate(void) /* {{{ */
+{
+  uc_last_rate_t *lr;
+
+  pthread_once(&last_rate_once, uc_last_rate_key_create);
+
+  lr = pthread_getspecific(last_rate_key);
+  if (lr == NULL) {
+    lr = calloc(1, sizeof(*lr));
+    if (lr == NULL)
+      return NULL;
+    if (pthread_setspecific(last_rate_key, lr) != 0) {
+      free(lr);
+      return NULL;
+    }
+  }
+
+  return lr;
+} /* }}} uc_last_rate_t *uc_last_rate */
+
+void uc_clear_last_rate(void) /* {{{ */
+{
+  uc_last_rate_t *lr;
+
+  pthread_once(&last_rate_once, uc_last_rate_key_create);
+
+  /* Don't allocate the record just to clear it. */
+  lr = pthread_getspecific(last_rate_key);
+  if (lr != NULL)
+    lr->vl = NULL;
+} /* }}} void uc_clear_last_rate */
+
 static int cache_compare(const cache_entry_t *a, const cache_entry_t *b) {
 #if COLLECT_DEBUG
   assert((a != NULL) && (b != NULL));
@@ -86,6 +206,189 @@ static int cache_compare(const cache_entry_t *a, const cache_entry_t *b) {
   return strcmp(a->name, b->name);
 } /* int cache_compare */
 
+static _Bool uc_history_matches(const char *name) /* {{{ */
+{
+  for (size_t i = 0; i < history_match_num; i++) {
+    uc_history_match_t *m = history_match + i;
+
+    if (m->re != NULL) {
+      if (regexec(m->re, name, /* nmatch = */ 0, NULL, /* eflags = */ 0) == 0)
+        return 1;
+    } else if (strcmp(m->pattern, name) == 0) {
+      return 1;
+    }
+  }
+
+  return 0;
+} /* }}} _Bool uc_history_matches */
+
+static size_t uc_tiered_size(size_t values_num) /* {{{ */
+{
+  size_t size = sizeof(uc_tiered_t) + history_tiers_num * sizeof(uc_tier_t);
+
+  size += history_raw_points * (values_num * sizeof(float) + sizeof(uint32_t));
+  for (size_t i = 0; i < history_tiers_num; i++)
+    size += history_tiers[i].buckets * values_num *
+            (3 * sizeof(float) + sizeof(uint16_t));
+
+  return size;
+} /* }}} size_t uc_tiered_size */
+
+/* Allocates the tiered history of "ce" if its name matches the configuration
+ * and the memory limit permits. `cache_lock' must be held. */
+static void uc_tiered_attach(cache_entry_t *ce) /* {{{ */
+{
+  uc_tiered_t *h;
+  size_t size;
+  char *ptr;
+
+  if ((history_match_num == 0) || !uc_history_matches(ce->name))
+    return;
+
+  size = uc_tiered_size(ce->values_num);
+  if ((history_memory_used + size) > history_memory_limit) {
+    c_complain(LOG_WARNING, &history_complaint,
+               "utils_cache: The history memory limit of %" PRIu64
+               " bytes has been reached. No history is kept for %s (and "
+               "possibly other series).",
+               history_memory_limit, ce->name);
+    return;
+  }
+
+  h = calloc(1, size);
+  if (h == NULL) {
+    ERROR("utils_cache: uc_tiered_attach: calloc failed.");
+    return;
+  }
+  h->size = size;
+
+  /* The floats come first, then the 32 bit and then the 16 bit integers, so
+   * all arrays are aligned. */
+  ptr = (char *)(h->tiers + history_tiers_num);
+  h->raw = (float *)ptr;
+  ptr += history_raw_points * ce->values_num * sizeof(float);
+  for (size_t i = 0; i < history_tiers_num; i++) {
+    size_t n = history_tiers[i].buckets * ce->values_num;
+
+    h->tiers[i].min = (float *)ptr;
+    h->tiers[i].avg = h->tiers[i].min + n;
+    h->tiers[i].max = h->tiers[i].avg + n;
+    ptr += 3 * n * sizeof(float);
+  }
+  h->raw_delta = (uint32_t *)ptr;
+  ptr += history_raw_points * sizeof(uint32_t);
+  for (size_t i = 0; i < history_tiers_num; i++) {
+    h->tiers[i].count = (uint16_t *)ptr;
+    ptr += history_tiers[i].buckets * ce->values_num * sizeof(uint16_t);
+  }
+  assert(ptr == ((char *)h) + size);
+
+  history_memory_used += size;
+  c_release(LOG_INFO, &history_complaint,
+            "utils_cache: The history memory limit is no longer exceeded.");
+
+  ce->tiered = h;
+} /* }}} void uc_tiered_attach */
+
+/* `cache_lock' must be held. */
+static void uc_tiered_free(uc_tiered_t *h) /* {{{ */
+{
+  if (h == NULL)
+    return;
+
+  assert(history_memory_used >= h->size);
+  history_memory_used -= h->size;
+  free(h);
+} /* }}} void uc_tiered_free */
+
+static void uc_tier_clear(uc_tier_t *tier, size_t values_num) /* {{{ */
+{
+  size_t offset = tier->index * values_num;
+
+  for (size_t i = offset; i < offset + values_num; i++) {
+    tier->min[i] = NAN;
+    tier->avg[i] = NAN;
+    tier->max[i] = NAN;
+    tier->count[i] = 0;
+  }
+} /* }}} void uc_tier_clear */
+
+/* Adds the current rates of "ce" to its tiered history. `cache_lock' must be
+ * held. */
+static void uc_tiered_update(cache_entry_t *ce, cdtime_t time) /* {{{ */
+{
+  uc_tiered_t *h = ce->tiered;
+  size_t values_num = ce->values_num;
+
+  if (history_raw_points > 0) {
+    uint64_t delta = 0;
+
+    if (h->raw_num > 0)
+      delta = CDTIME_T_TO_MS(time) - CDTIME_T_TO_MS(h->last_time);
+    h->raw_delta[h->raw_index] =
+        (delta > UINT32_MAX) ? UINT32_MAX : (uint32_t)delta;
+
+    for (size_t i = 0; i < values_num; i++)
+      h->raw[h->raw_index * values_num + i] = (float)ce->values_gauge[i];
+
+    h->raw_index = (h->raw_index + 1) % history_raw_points;
+    if (h->raw_num < history_raw_points)
+      h->raw_num++;
+  }
+  h->last_time = time;
+
+  for (size_t t = 0; t < history_tiers_num; t++) {
+    uc_tier_t *tier = h->tiers + t;
+    cdtime_t resolution = history_tiers[t].resolution;
+    uint32_t buckets = history_tiers[t].buckets;
+    cdtime_t start = time - (time % resolution);
+
+    if (tier->num == 0) {
+      tier->index = 0;
+      tier->num = 1;
+      tier->start = start;
+      uc_tier_clear(tier, values_num);
+    } else if (start > tier->start) {
+      /* Skip (and clear) the buckets for which no value was received. */
+      uint64_t steps = (start - tier->start) / resolution;
+
+      if (steps > buckets)
+        steps = buckets;
+      for (uint64_t i = 0; i < steps; i++) {
+        tier->index = (tier->index + 1) % buckets;
+        uc_tier_clear(tier, values_num);
+      }
+      if ((tier->num + steps) > buckets)
+        tier->num = buckets;
+      else
+        tier->num += (uint32_t)steps;
+      tier->start = start;
+    } else if (start < tier->start) {
+      continue;
+    }
+
+    for (size_t i = 0; i < values_num; i++) {
+      size_t idx = tier->index * values_num + i;
+      gauge_t v = ce->values_gauge[i];
+      uint16_t count = tier->count[idx];
+
+      if (isnan(v) || (count == UINT16_MAX))
+        continue;
+
+      if (count == 0) {
+        tier->min[idx] = tier->avg[idx] = tier->max[idx] = (float)v;
+      } else {
+        if (v < tier->min[idx])
+          tier->min[idx] = (float)v;
+        if (v > tier->max[idx])
+          tier->max[idx] = (float)v;
+        tier->avg[idx] += (float)((v - tier->avg[idx]) / (count + 1));
+      }
+      tier->count[idx] = count + 1;
+    }
+  }
+} /* }}} void uc_tiered_update */
+
 static cache_entry_t *cache_alloc(size_t values_num) {
   cache_entry_t *ce;
 
@@ -108,6 +411,7 @@ static cache_entry_t *cache_alloc(size_t values_num) {
 
   ce->history = NULL;
   ce->history_length = 0;
+  ce->tiered = NULL;
   ce->meta = NULL;
 
   return ce;
@@ -120,6 +424,7 @@ static void cache_free(cache_entry_t *ce) {
   sfree(ce->values_gauge);
   sfree(ce->values_raw);
   sfree(ce->history);
+  uc_tiered_free(ce->tiered);
   if (ce->meta != NULL) {
     meta_data_destroy(ce->meta);
     ce->meta = NULL;
@@ -203,8 +508,13 @@ static int uc_insert(const data_set_t *ds, const value_list_t *vl,
   ce->interval = vl->interval;
   ce->state = STATE_OKAY;
 
+  uc_tiered_attach(ce);
+  if (ce->tiered != NULL)
+    uc_tiered_update(ce, vl->time);
+
   if (c_avl_insert(cache_tree, key_copy, ce) != 0) {
     sfree(key_copy);
+    cache_free(ce);
     ERROR("uc_insert: c_avl_insert failed.");
     return -1;
   }
@@ -213,14 +523,210 @@ static int uc_insert(const data_set_t *ds, const value_list_t *vl,
   return 0;
 } /* int uc_insert */
 
+static int uc_history_add_match(const oconfig_item_t *ci) /* {{{ */
+{
+  uc_history_match_t *tmp;
+  uc_history_match_t m = {0};
+  const char *pattern;
+  size_t len;
+
+  if ((ci->values_num != 1) || (ci->values[0].type != OCONFIG_TYPE_STRING)) {
+    ERROR("utils_cache: The `%s' option requires exactly one string argument.",
+          ci->key);
+    return -1;
+  }
+  pattern = ci->values[0].value.string;
+  len = strlen(pattern);
+
+  m.pattern = strdup(pattern);
+  if (m.pattern == NULL) {
+    ERROR("utils_cache: strdup failed.");
+    return -1;
+  }
+
+  /* Like the ignorelists, treat "/.../" as a regular expression. */
+  if ((len > 2) && (pattern[0] == '/') && (pattern[len - 1] == '/')) {
+    int status;
+
+    m.re = calloc(1, sizeof(*m.re));
+    if (m.re == NULL) {
+      ERROR("utils_cache: calloc failed.");
+      sfree(m.pattern);
+      return -1;
+    }
+
+    m.pattern[len - 1] = 0;
+    status = regcomp(m.re, m.pattern + 1, REG_EXTENDED | REG_NOSUB);
+    if (status != 0) {
+      char errbuf[1024];
+      regerror(status, m.re, errbuf, sizeof(errbuf));
+      ERROR("utils_cache: Compiling the regular expression \"%s\" failed: %s",
+            m.pattern + 1, errbuf);
+      sfree(m.re);
+      sfree(m.pattern);
+      return -1;
+    }
+  }
+
+  tmp = realloc(history_match, (history_match_num + 1) * sizeof(*tmp));
+  if (tmp == NULL) {
+    ERROR("utils_cache: realloc failed.");
+    if (m.re != NULL)
+      regfree(m.re);
+    sfree(m.re);
+    sfree(m.pattern);
+    return -1;
+  }
+  history_match = tmp;
+  history_match[history_match_num] = m;
+  history_match_num++;
+
+  return 0;
+} /* }}} int uc_history_add_match */
+
+static int uc_history_get_number(const oconfig_item_t *ci, /* {{{ */
+                                 int index, double min, double max,
+                                 double *ret) {
+  double d;
+
+  if ((index >= ci->values_num) ||
+      (ci->values[index].type != OCONFIG_TYPE_NUMBER)) {
+    ERROR("utils_cache: Argument %i of the `%s' option must be a number.",
+          index + 1, ci->key);
+    return -1;
+  }
+
+  d = ci->values[index].value.number;
+  if (!(d >= min) || !(d <= max)) {
+    ERROR("utils_cache: Argument %i of the `%s' option must be between %.0f "
+          "and %.0f.",
+          index + 1, ci->key, min, max);
+    return -1;
+  }
+
+  *ret = d;
+  return 0;
+} /* }}} int uc_history_get_number */
+
+int uc_configure_history(oconfig_item_t *ci) /* {{{ */
+{
+  _Bool tiers_set = 0;
+
+  for (int i = 0; i < ci->children_num; i++) {
+    oconfig_item_t *child = ci->children + i;
+    double d0, d1;
+    int status = 0;
+
+    if (strcasecmp("Series", child->key) == 0) {
+      status = uc_history_add_match(child);
+    } else if (strcasecmp("RawPoints", child->key) == 0) {
+      if (child->values_num != 1) {
+        ERROR("utils_cache: The `RawPoints' option requires one argument.");
+        status = -1;
+      } else {
+        status = uc_history_get_number(child, 0, 0, UINT32_MAX, &d0);
+        if (status == 0)
+          history_raw_points = (uint32_t)d0;
+      }
+    } else if (strcasecmp("Tier", child->key) == 0) {
+      if (child->values_num != 2) {
+        ERROR("utils_cache: The `Tier' option requires two arguments: "
+              "the resolution in seconds and the number of buckets.");
+        status = -1;
+      } else if ((uc_history_get_number(child, 0, 1, 86400 * 366, &d0) != 0) ||
+                 (uc_history_get_number(child, 1, 1, UINT32_MAX, &d1) != 0)) {
+        status = -1;
+      } else {
+        /* The first Tier option replaces the default tiers. */
+        if (!tiers_set)
+          history_tiers_num = 0;
+        tiers_set = 1;
+
+        if (history_tiers_num >= UC_HISTORY_TIERS_MAX) {
+          ERROR("utils_cache: At most %i tiers may be configured.",
+                UC_HISTORY_TIERS_MAX);
+          status = -1;
+        } else {
+          history_tiers[history_tiers_num].resolution = DOUBLE_TO_CDTIME_T(d0);
+          history_tiers[history_tiers_num].buckets = (uint32_t)d1;
+          history_tiers_num++;
+        }
+      }
+    } else if (strcasecmp("MemoryLimit", child->key) == 0) {
+      if (child->values_num != 1) {
+        ERROR("utils_cache: The `MemoryLimit' option requires one argument.");
+        status = -1;
+      } else {
+        status = uc_history_get_number(child, 0, 0, 1e18, &d0);
+        if (status == 0)
+          history_memory_limit = (uint64_t)d0;
+      }
+    } else {
+      WARNING("utils_cache: Ignoring unknown <History> option `%s'.",
+              child->key);
+    }
+
+    if (status != 0)
+      return status;
+  }
+
+  return 0;
+} /* }}} int uc_configure_history */
+
 int uc_init(void) {
+  char const *file;
+
   if (cache_tree == NULL)
     cache_tree =
         c_avl_create((int (*)(const void *, const void *))cache_compare);
 
+  file = global_option_get("CacheFile");
+  if ((file == NULL) || (file[0] == 0) || (snapshot_file != NULL))
+    return 0;
+
+  snapshot_file = strdup(file);
+  if (snapshot_file == NULL) {
+    ERROR("uc_init: strdup failed.");
+    return -1;
+  }
+
+  snapshot_interval = global_option_get_time("CacheSnapshotInterval",
+                                             /* default = */ 0);
+  if (snapshot_interval > 0)
+    snapshot_next = cdtime() + snapshot_interval;
+
+  uc_snapshot_read(snapshot_file);
+
   return 0;
 } /* int uc_init */
 
+int uc_check_snapshot(void) {
+  cdtime_t now;
+
+  if ((snapshot_file == NULL) || (snapshot_interval == 0))
+    return 0;
+
+  now = cdtime();
+  if (now < snapshot_next)
+    return 0;
+
+  snapshot_next = now + snapshot_interval;
+  return uc_snapshot_write(snapshot_file);
+} /* int uc_check_snapshot */
+
+int uc_shutdown(void) {
+  int status = 0;
+
+  if (snapshot_file != NULL)
+    status = uc_snapshot_write(snapshot_file);
+
+  sfree(snapshot_file);
+  snapshot_interval = 0;
+  snapshot_next = 0;
+
+  return status;
+} /* int uc_shutdown */
+
 int uc_check_timeout(void) {
   cdtime_t now = cdtime();
 
@@ -316,8 +822,13 @@ int uc_check_timeout(void) {
 int uc_update(const data_set_t *ds, const value_list_t *vl) {
   char name[6 * DATA_MAX_NAME_LEN];
   cache_entry_t *ce = NULL;
+  uc_last_rate_t *lr;
   int status;
 
+  lr = uc_last_rate();
+  if (lr != NULL)
+    lr->vl = NULL;
+
   if (FORMAT_VL(name, sizeof(name), vl) != 0) {
     ERROR("uc_update: FORMAT_VL failed.");
     return -1;
@@ -400,10 +911,23 @@ int uc_update(const data_set_t *ds, const value_list_t *vl) {
   /* Prune invalid gauge data */
   uc_check_range(ds, ce);
 
+  if (ce->tiered != NULL)
+    uc_tiered_update(ce, vl->time);
+
   ce->last_time = vl->time;
   ce->last_update = cdtime();
   ce->interval = vl->interval;
 
+  if ((lr != NULL) && (ce->state != STATE_MISSING) &&
+      (ce->values_num <= UC_LAST_RATE_MAX)) {
+    lr->vl = vl;
+    lr->values = vl->values;
+    lr->time = vl->time;
+    lr->values_num = ce->values_num;
+    memcpy(lr->values_gauge, ce->values_gauge,
+           ce->values_num * sizeof(*lr->values_gauge));
+  }
+
   pthread_mutex_unlock(&cache_lock);
 
   return 0;
@@ -453,8 +977,23 @@ gauge_t *uc_get_rate(const data_set_t *ds, const value_list_t *vl) {
   char name[6 * DATA_MAX_NAME_LEN];
   gauge_t *ret = NULL;
   size_t ret_num = 0;
+  uc_last_rate_t *lr;
   int status;
 
+  /* Fast path: the value list was just used to update the cache in this
+   * thread, e.g. because we're being called from a write callback. */
+  lr = uc_last_rate();
+  if ((lr != NULL) && (lr->vl == vl) && (lr->values == vl->values) &&
+      (lr->time == vl->time) && (lr->values_num == ds->ds_num)) {
+    ret = malloc(lr->values_num * sizeof(*ret));
+    if (ret == NULL) {
+      ERROR("utils_cache: uc_get_rate: malloc failed.");
+      return NULL;
+    }
+    memcpy(ret, lr->values_gauge, lr->values_num * sizeof(*ret));
+    return ret;
+  }
+
   if (FORMAT_VL(name, sizeof(name), vl) != 0) {
     ERROR("utils_cache: uc_get_rate: FORMAT_VL failed.");
     return NULL;
@@ -753,6 +1292,137 @@ int uc_get_history(const data_set_t *ds, const value_list_t *vl,
   return uc_get_history_by_name(name, ret_history, num_steps, num_ds);
 } /* int uc_get_history */
 
+int uc_get_history_tier_info(size_t tier, cdtime_t *ret_resolution,
+                             size_t *ret_points) {
+  if (tier > history_tiers_num)
+    return -EINVAL;
+
+  if (tier == 0) {
+    if (ret_resolution != NULL)
+      *ret_resolution = 0;
+    if (ret_points != NULL)
+      *ret_points = history_raw_points;
+  } else {
+    if (ret_resolution != NULL)
+      *ret_resolution = history_tiers[tier - 1].resolution;
+    if (ret_points != NULL)
+      *ret_points = history_tiers[tier - 1].buckets;
+  }
+
+  return 0;
+} /* int uc_get_history_tier_info */
+
+int uc_get_history_tier_by_name(const char *name, size_t tier,
+                                cdtime_t **ret_times, gauge_t **ret_values,
+                                size_t *ret_points_num, size_t *ret_ds_num) {
+  cache_entry_t *ce = NULL;
+  cdtime_t *times;
+  gauge_t *values;
+  size_t points_num;
+  size_t values_num;
+
+  if ((ret_times == NULL) || (ret_values == NULL) || (ret_points_num == NULL))
+    return -EINVAL;
+  if (tier > history_tiers_num)
+    return -EINVAL;
+
+  pthread_mutex_lock(&cache_lock);
+
+  if ((c_avl_get(cache_tree, name, (void *)&ce) != 0) ||
+      (ce->tiered == NULL)) {
+    pthread_mutex_unlock(&cache_lock);
+    return -ENOENT;
+  }
+
+  values_num = ce->values_num;
+  if (tier == 0)
+    points_num = ce->tiered->raw_num;
+  else
+    points_num = ce->tiered->tiers[tier - 1].num;
+
+  times = calloc(points_num + 1, sizeof(*times));
+  values = calloc(3 * points_num * values_num + 1, sizeof(*values));
+  if ((times == NULL) || (values == NULL)) {
+    pthread_mutex_unlock(&cache_lock);
+    sfree(times);
+    sfree(values);
+    return -ENOMEM;
+  }
+
+  /* Walk backwards from the newest point, so that the times of the raw points
+   * can be reconstructed from their deltas. */
+  if (tier == 0) {
+    uc_tiered_t *h = ce->tiered;
+    uint64_t ms = CDTIME_T_TO_MS(h->last_time);
+    size_t src = h->raw_index;
+
+    for (size_t i = points_num; i > 0; i--) {
+      src = (src + history_raw_points - 1) % history_raw_points;
+
+      times[i - 1] = (i == points_num) ? h->last_time : MS_TO_CDTIME_T(ms);
+      for (size_t j = 0; j < values_num; j++) {
+        gauge_t *dst = values + 3 * ((i - 1) * values_num + j);
+        dst[0] = dst[1] = dst[2] = h->raw[src * values_num + j];
+      }
+
+      ms = (ms > h->raw_delta[src]) ? (ms - h->raw_delta[src]) : 0;
+    }
+  } else {
+    uc_tier_t *t = ce->tiered->tiers + (tier - 1);
+    uint32_t buckets = history_tiers[tier - 1].buckets;
+    cdtime_t resolution = history_tiers[tier - 1].resolution;
+    size_t src = t->index;
+
+    for (size_t i = points_num; i > 0; i--) {
+      times[i - 1] = t->start - (points_num - i) * resolution;
+      for (size_t j = 0; j < values_num; j++) {
+        gauge_t *dst = values + 3 * ((i - 1) * values_num + j);
+        dst[0] = t->min[src * values_num + j];
+        dst[1] = t->avg[src * values_num + j];
+        dst[2] = t->max[src * values_num + j];
+      }
+
+      src = (src + buckets - 1) % buckets;
+    }
+  }
+
+  pthread_mutex_unlock(&cache_lock);
+
+  *ret_times = times;
+  *ret_values = values;
+  *ret_points_num = points_num;
+  if (ret_ds_num != NULL)
+    *ret_ds_num = values_num;
+
+  return 0;
+} /* int uc_get_history_tier_by_name */
+
+int uc_get_history_tier(const data_set_t *ds, const value_list_t *vl,
+                        size_t tier, cdtime_t **ret_times, gauge_t **ret_values,
+                        size_t *ret_points_num) {
+  char name[6 * DATA_MAX_NAME_LEN];
+  size_t ds_num = 0;
+  int status;
+
+  if (FORMAT_VL(name, sizeof(name), vl) != 0) {
+    ERROR("utils_cache: uc_get_history_tier: FORMAT_VL failed.");
+    return -1;
+  }
+
+  status = uc_get_history_tier_by_name(name, tier, ret_times, ret_values,
+                                       ret_points_num, &ds_num);
+  if (status != 0)
+    return status;
+
+  if (ds_num != ds->ds_num) {
+    sfree(*ret_times);
+    sfree(*ret_values);
+    return -EINVAL;
+  }
+
+  return 0;
+} /* int uc_get_history_tier */
+
 int uc_get_hits(const data_set_t *ds, const value_list_t *vl) {
   char name[6 * DATA_MAX_NAME_LEN];
   cache_entry_t *ce = NULL;
@@ -821,6 +1491,595 @@ int uc_inc_hits(const data_set_t *ds, const value_list_t *vl, int step) {
   return ret;
 } /* int uc_inc_hits */
 
+/*
+ * Snapshot interface
+ */
+static int snap_write(FILE *fh, void const *buf, size_t len) /* {{{ */
+{
+  if (len == 0)
+    return 0;
+  return (fwrite(buf, len, 1, fh) == 1) ? 0 : -1;
+} /* }}} int snap_write */
+
+static int snap_read(FILE *fh, void *buf, size_t len) /* {{{ */
+{
+  if (len == 0)
+    return 0;
+  return (fread(buf, len, 1, fh) == 1) ? 0 : -1;
+} /* }}} int snap_read */
+
+static int snap_write_string(FILE *fh, char const *str) /* {{{ */
+{
+  uint32_t len = (uint32_t)strlen(str);
+
+  if (snap_write(fh, &len, sizeof(len)) != 0)
+    return -1;
+  return snap_write(fh, str, len);
+} /* }}} int snap_write_string */
+
+/* Reads a string written by snap_write_string(). The returned string has to
+ * be freed by the caller. */
+static char *snap_read_string(FILE *fh, uint32_t max_len) /* {{{ */
+{
+  uint32_t len;
+  char *str;
+
+  if (snap_read(fh, &len, sizeof(len)) != 0)
+    return NULL;
+  if (len > max_len)
+    return NULL;
+
+  str = malloc(len + 1);
+  if (str == NULL)
+    return NULL;
+
+  if (snap_read(fh, str, len) != 0) {
+    sfree(str);
+    return NULL;
+  }
+  str[len] = 0;
+
+  return str;
+} /* }}} char *snap_read_string */
+
+static int snap_write_meta(FILE *fh, meta_data_t *meta) /* {{{ */
+{
+  char **toc = NULL;
+  uint32_t toc_num = 0;
+  int status = 0;
+
+  if (meta != NULL) {
+    int num = meta_data_toc(meta, &toc);
+    if (num < 0)
+      return -1;
+    toc_num = (uint32_t)num;
+  }
+
+  if (snap_write(fh, &toc_num, sizeof(toc_num)) != 0)
+    status = -1;
+
+  for (uint32_t i = 0; (i < toc_num) && (status == 0); i++) {
+    int8_t type = (int8_t)meta_data_type(meta, toc[i]);
+
+    if ((snap_write_string(fh, toc[i]) != 0) ||
+        (snap_write(fh, &type, sizeof(type)) != 0)) {
+      status = -1;
+      break;
+    }
+
+    switch (type) {
+    case MD_TYPE_STRING: {
+      char *value = NULL;
+      status = meta_data_get_string(meta, toc[i], &value);
+      if (status == 0)
+        status = snap_write_string(fh, value);
+      sfree(value);
+    } break;
+    case MD_TYPE_SIGNED_INT: {
+      int64_t value = 0;
+      status = meta_data_get_signed_int(meta, toc[i], &value);
+      if (status == 0)
+        status = snap_write(fh, &value, sizeof(value));
+    } break;
+    case MD_TYPE_UNSIGNED_INT: {
+      uint64_t value = 0;
+      status = meta_data_get_unsigned_int(meta, toc[i], &value);
+      if (status == 0)
+        status = snap_write(fh, &value, sizeof(value));
+    } break;
+    case MD_TYPE_DOUBLE: {
+      double value = 0.0;
+      status = meta_data_get_double(meta, toc[i], &value);
+      if (status == 0)
+        status = snap_write(fh, &value, sizeof(value));
+    } break;
+    case MD_TYPE_BOOLEAN: {
+      _Bool value = 0;
+      status = meta_data_get_boolean(meta, toc[i], &value);
+      if (status == 0) {
+        uint8_t tmp = value ? 1 : 0;
+        status = snap_write(fh, &tmp, sizeof(tmp));
+      }
+    } break;
+    default:
+      status = -1;
+    }
+  }
+
+  for (uint32_t i = 0; i < toc_num; i++)
+    sfree(toc[i]);
+  sfree(toc);
+
+  return status;
+} /* }}} int snap_write_meta */
+
+static int snap_read_meta(FILE *fh, meta_data_t **ret_meta) /* {{{ */
+{
+  meta_data_t *meta = NULL;
+  uint32_t toc_num;
+  int status = 0;
+
+  if (snap_read(fh, &toc_num, sizeof(toc_num)) != 0)
+    return -1;
+
+  if (toc_num == 0) {
+    *ret_meta = NULL;
+    return 0;
+  }
+
+  meta = meta_data_create();
+  if (meta == NULL)
+    return -1;
+
+  for (uint32_t i = 0; (i < toc_num) && (status == 0); i++) {
+    char *key;
+    int8_t type;
+
+    key = snap_read_string(fh, DATA_MAX_NAME_LEN * 6);
+    if (key == NULL) {
+      status = -1;
+      break;
+    }
+
+    if (snap_read(fh, &type, sizeof(type)) != 0) {
+      sfree(key);
+      status = -1;
+      break;
+    }
+
+    switch (type) {
+    case MD_TYPE_STRING: {
+      char *value = snap_read_string(fh, UINT16_MAX);
+      if (value == NULL)
+        status = -1;
+      else
+        status = meta_data_add_string(meta, key, value);
+      sfree(value);
+    } break;
+    case MD_TYPE_SIGNED_INT: {
+      int64_t value;
+      status = snap_read(fh, &value, sizeof(value));
+      if (status == 0)
+        status = meta_data_add_signed_int(meta, key, value);
+    } break;
+    case MD_TYPE_UNSIGNED_INT: {
+      uint64_t value;
+      status = snap_read(fh, &value, sizeof(value));
+      if (status == 0)
+        status = meta_data_add_unsigned_int(meta, key, value);
+    } break;
+    case MD_TYPE_DOUBLE: {
+      double value;
+      status = snap_read(fh, &value, sizeof(value));
+      if (status == 0)
+        status = meta_data_add_double(meta, key, value);
+    } break;
+    case MD_TYPE_BOOLEAN: {
+      uint8_t value;
+      status = snap_read(fh, &value, sizeof(value));
+      if (status == 0)
+        status = meta_data_add_boolean(meta, key, value ? 1 : 0);
+    } break;
+    default:
+      status = -1;
+    }
+
+    sfree(key);
+  }
+
+  if (status != 0) {
+    meta_data_destroy(meta);
+    return -1;
+  }
+
+  *ret_meta = meta;
+  return 0;
+} /* }}} int snap_read_meta */
+
+/* Entries are written in host byte order, one after the other, and are
+ * terminated by an entry with an empty name:
+ *
+ *   header:  uint32 magic, uint32 version
+ *   entry:   string name, uint32 values_num,
+ *            values_num * { int8 ds_type, value_t raw, gauge_t rate },
+ *            cdtime_t last_time, cdtime_t interval, int32 state, int32 hits,
+ *            uint32 history_length, uint32 history_index,
+ *            (history_length * values_num) * gauge_t,
+ *            uint32 meta_num, meta_num * { string key, int8 type, value }
+ *
+ * Strings are stored as uint32 length followed by the (unterminated)
+ * characters. The snapshot is first written to "<file>.tmp" and then renamed,
+ * so a crash while writing never leaves a truncated snapshot behind. */
+static int snap_write_entry(FILE *fh, cache_entry_t *ce) /* {{{ */
+{
+  const data_set_t *ds;
+  value_list_t vl = VALUE_LIST_INIT;
+  uint32_t values_num = (uint32_t)ce->values_num;
+  int32_t state = (int32_t)ce->state;
+  int32_t hits = (int32_t)ce->hits;
+  uint32_t history_length = (uint32_t)ce->history_length;
+  uint32_t history_index = (uint32_t)ce->history_index;
+
+  /* The data source types are not stored in the cache entry itself. */
+  if (parse_identifier_vl(ce->name, &vl) != 0)
+    return EINVAL;
+  ds = plugin_get_ds(vl.type);
+  if ((ds == NULL) || (ds->ds_num != ce->values_num))
+    return EINVAL;
+
+  if ((snap_write_string(fh, ce->name) != 0) ||
+      (snap_write(fh, &values_num, sizeof(values_num)) != 0))
+    return -1;
+
+  for (size_t i = 0; i < ce->values_num; i++) {
+    int8_t ds_type = (int8_t)ds->ds[i].type;
+
+    if ((snap_write(fh, &ds_type, sizeof(ds_type)) != 0) ||
+        (snap_write(fh, &ce->values_raw[i], sizeof(ce->values_raw[i])) != 0) ||
+        (snap_write(fh, &ce->values_gauge[i], sizeof(ce->values_gauge[i])) !=
+         0))
+      return -1;
+  }
+
+  if ((snap_write(fh, &ce->last_time, sizeof(ce->last_time)) != 0) ||
+      (snap_write(fh, &ce->interval, sizeof(ce->interval)) != 0) ||
+      (snap_write(fh, &state, sizeof(state)) != 0) ||
+      (snap_write(fh, &hits, sizeof(hits)) != 0) ||
+      (snap_write(fh, &history_length, sizeof(history_length)) != 0) ||
+      (snap_write(fh, &history_index, sizeof(history_index)) != 0) ||
+      (snap_write(fh, ce->history, sizeof(*ce->history) * ce->history_length *
+                                       ce->values_num) != 0))
+    return -1;
+
+  return snap_write_meta(fh, ce->meta);
+} /* }}} int snap_write_entry */
+
+/* Copies the parts of "ce" that are written to a snapshot, so that it can be
+ * written without holding "cache_lock". The caller must hold the lock. */
+static cache_entry_t *snap_copy_entry(cache_entry_t const *ce) /* {{{ */
+{
+  cache_entry_t *copy;
+
+  copy = cache_alloc(ce->values_num);
+  if (copy == NULL)
+    return NULL;
+
+  sstrncpy(copy->name, ce->name, sizeof(copy->name));
+  memcpy(copy->values_gauge, ce->values_gauge,
+         ce->values_num * sizeof(*copy->values_gauge));
+  memcpy(copy->values_raw, ce->values_raw,
+         ce->values_num * sizeof(*copy->values_raw));
+  copy->last_time = ce->last_time;
+  copy->interval = ce->interval;
+  copy->state = ce->state;
+  copy->hits = ce->hits;
+
+  if (ce->history_length > 0) {
+    size_t size = ce->history_length * ce->values_num * sizeof(*ce->history);
+
+    copy->history = malloc(size);
+    if (copy->history == NULL) {
+      cache_free(copy);
+      return NULL;
+    }
+    memcpy(copy->history, ce->history, size);
+    copy->history_length = ce->history_length;
+    copy->history_index = ce->history_index;
+  }
+
+  if (ce->meta != NULL) {
+    copy->meta = meta_data_clone(ce->meta);
+    if (copy->meta == NULL) {
+      cache_free(copy);
+      return NULL;
+    }
+  }
+
+  return copy;
+} /* }}} cache_entry_t *snap_copy_entry */
+
+/* Reads one entry. Returns zero on success, a positive value when the end of
+ * the snapshot has been reached and a negative value on error. When the entry
+ * does not match the currently loaded types, `*ret_ce' is set to NULL. */
+static int snap_read_entry(FILE *fh, cache_entry_t **ret_ce) /* {{{ */
+{
+  const data_set_t *ds = NULL;
+  value_list_t vl = VALUE_LIST_INIT;
+  cache_entry_t *ce;
+  char *name;
+  uint32_t values_num;
+  int32_t state;
+  int32_t hits;
+  uint32_t history_length;
+  uint32_t history_index;
+  _Bool valid = 1;
+
+  name = snap_read_string(fh, sizeof(ce->name) - 1);
+  if (name == NULL)
+    return -1;
+  if (name[0] == 0) {
+    sfree(name);
+    return 1;
+  }
+
+  if ((snap_read(fh, &values_num, sizeof(values_num)) != 0) ||
+      (values_num == 0) || (values_num > UINT16_MAX)) {
+    sfree(name);
+    return -1;
+  }
+
+  ce = cache_alloc(values_num);
+  if (ce == NULL) {
+    sfree(name);
+    return -1;
+  }
+  sstrncpy(ce->name, name, sizeof(ce->name));
+
+  /* Validate against the types database: the type must still exist and
+   * have the same data sources. */
+  if (parse_identifier_vl(name, &vl) == 0)
+    ds = plugin_get_ds(vl.type);
+  if ((ds == NULL) || (ds->ds_num != values_num))
+    valid = 0;
+  sfree(name);
+
+  for (uint32_t i = 0; i < values_num; i++) {
+    int8_t ds_type;
+
+    if ((snap_read(fh, &ds_type, sizeof(ds_type)) != 0) ||
+        (snap_read(fh, &ce->values_raw[i], sizeof(ce->values_raw[i])) != 0) ||
+        (snap_read(fh, &ce->values_gauge[i], sizeof(ce->values_gauge[i])) !=
+         0)) {
+      cache_free(ce);
+      return -1;
+    }
+
+    if (valid && (ds->ds[i].type != ds_type))
+      valid = 0;
+  }
+
+  if ((snap_read(fh, &ce->last_time, sizeof(ce->last_time)) != 0) ||
+      (snap_read(fh, &ce->interval, sizeof(ce->interval)) != 0) ||
+      (snap_read(fh, &state, sizeof(state)) != 0) ||
+      (snap_read(fh, &hits, sizeof(hits)) != 0) ||
+      (snap_read(fh, &history_length, sizeof(history_length)) != 0) ||
+      (snap_read(fh, &history_index, sizeof(history_index)) != 0) ||
+      ((history_length > 0) && (history_index >= history_length)) ||
+      (history_length > UINT16_MAX)) {
+    cache_free(ce);
+    return -1;
+  }
+  ce->state = (int)state;
+  ce->hits = (int)hits;
+
+  if (history_length > 0) {
+    ce->history = calloc(history_length * values_num, sizeof(*ce->history));
+    if ((ce->history == NULL) ||
+        (snap_read(fh, ce->history, sizeof(*ce->history) * history_length *
+                                        values_num) != 0)) {
+      cache_free(ce);
+      return -1;
+    }
+    ce->history_length = history_length;
+    ce->history_index = history_index;
+  }
+
+  if (snap_read_meta(fh, &ce->meta) != 0) {
+    cache_free(ce);
+    return -1;
+  }
+
+  if (!valid) {
+    DEBUG("utils_cache: snap_read_entry: Ignoring %s: it does not match the "
+          "types database.",
+          ce->name);
+    cache_free(ce);
+    ce = NULL;
+  } else {
+    /* The entry is considered fresh until it has not been updated for
+     * `Timeout' intervals after the restart. */
+    ce->last_update = cdtime();
+  }
+
+  *ret_ce = ce;
+  return 0;
+} /* }}} int snap_read_entry */
+
+int uc_snapshot_write(const char *file) /* {{{ */
+{
+  char tmpfile[PATH_MAX];
+  uint32_t header[2] = {UC_SNAPSHOT_MAGIC, UC_SNAPSHOT_VERSION};
+  c_avl_iterator_t *iter;
+  char *key;
+  cache_entry_t *ce;
+  cache_entry_t **copies;
+  size_t copies_num = 0;
+  size_t entries_num = 0;
+  FILE *fh;
+  int status = 0;
+
+  if (file == NULL)
+    return EINVAL;
+
+  /* Only the copying happens while holding `cache_lock'; looking up the data
+   * sets and writing the file doesn't block updates of the cache. */
+  pthread_mutex_lock(&cache_lock);
+  copies = calloc((size_t)c_avl_size(cache_tree) + 1, sizeof(*copies));
+  if (copies == NULL) {
+    pthread_mutex_unlock(&cache_lock);
+    ERROR("uc_snapshot_write: calloc failed.");
+    return -1;
+  }
+
+  iter = c_avl_get_iterator(cache_tree);
+  while (c_avl_iterator_next(iter, (void *)&key, (void *)&ce) == 0) {
+    cache_entry_t *copy = snap_copy_entry(ce);
+    if (copy == NULL) {
+      status = ENOMEM;
+      break;
+    }
+    copies[copies_num++] = copy;
+  }
+  c_avl_iterator_destroy(iter);
+  pthread_mutex_unlock(&cache_lock);
+
+  if (status != 0) {
+    ERROR("uc_snapshot_write: Copying the cache entries failed.");
+    for (size_t i = 0; i < copies_num; i++)
+      cache_free(copies[i]);
+    sfree(copies);
+    return -1;
+  }
+
+  ssnprintf(tmpfile, sizeof(tmpfile), "%s.tmp", file);
+
+  fh = fopen(tmpfile, "w");
+  if (fh == NULL) {
+    char errbuf[1024];
+    ERROR("uc_snapshot_write: fopen (%s) failed: %s", tmpfile,
+          sstrerror(errno, errbuf, sizeof(errbuf)));
+    for (size_t i = 0; i < copies_num; i++)
+      cache_free(copies[i]);
+    sfree(copies);
+    return -1;
+  }
+
+  status = snap_write(fh, header, sizeof(header));
+
+  for (size_t i = 0; i < copies_num; i++) {
+    if (status == 0) {
+      int tmp = snap_write_entry(fh, copies[i]);
+      if (tmp != EINVAL) { /* EINVAL: type no longer known; skip the entry */
+        status = tmp;
+        entries_num++;
+      }
+    }
+    cache_free(copies[i]);
+  }
+  sfree(copies);
+
+  if (status == 0)
+    status = snap_write_string(fh, "");
+
+  if ((fclose(fh) != 0) && (status == 0))
+    status = -1;
+
+  if (status != 0) {
+    char errbuf[1024];
+    ERROR("uc_snapshot_write: Writing to %s failed: %s", tmpfile,
+          sstrerror(errno, errbuf, sizeof(errbuf)));
+    unlink(tmpfile);
+    return -1;
+  }
+
+  if (rename(tmpfile, file) != 0) {
+    char errbuf[1024];
+    ERROR("uc_snapshot_write: rename (%s, %s) failed: %s", tmpfile, file,
+          sstrerror(errno, errbuf, sizeof(errbuf)));
+    unlink(tmpfile);
+    return -1;
+  }
+
+  DEBUG("uc_snapshot_write: Wrote %zu entries to %s.", entries_num, file);
+  return 0;
+} /* }}} int uc_snapshot_write */
+
+int uc_snapshot_read(const char *file) /* {{{ */
+{
+  uint32_t header[2];
+  size_t entries_num = 0;
+  size_t ignored_num = 0;
+  FILE *fh;
+  int status;
+
+  if (file == NULL)
+    return EINVAL;
+
+  fh = fopen(file, "r");
+  if (fh == NULL) {
+    char errbuf[1024];
+    if (errno == ENOENT)
+      return ENOENT;
+    ERROR("uc_snapshot_read: fopen (%s) failed: %s", file,
+          sstrerror(errno, errbuf, sizeof(errbuf)));
+    return -1;
+  }
+
+  if ((snap_read(fh, header, sizeof(header)) != 0) ||
+      (header[0] != UC_SNAPSHOT_MAGIC) || (header[1] != UC_SNAPSHOT_VERSION)) {
+    ERROR("uc_snapshot_read: %s is not a valid cache snapshot.", file);
+    fclose(fh);
+    return -1;
+  }
+
+  pthread_mutex_lock(&cache_lock);
+  while (42) {
+    cache_entry_t *ce = NULL;
+    char *key;
+
+    status = snap_read_entry(fh, &ce);
+    if (status != 0)
+      break;
+
+    if (ce == NULL) {
+      ignored_num++;
+      continue;
+    }
+
+    /* Values received before the snapshot was loaded take precedence. */
+    if (c_avl_get(cache_tree, ce->name, NULL) == 0) {
+      cache_free(ce);
+      ignored_num++;
+      continue;
+    }
+
+    uc_tiered_attach(ce);
+
+    key = strdup(ce->name);
+    if ((key == NULL) || (c_avl_insert(cache_tree, key, ce) != 0)) {
+      ERROR("uc_snapshot_read: Inserting %s failed.", ce->name);
+      sfree(key);
+      cache_free(ce);
+      continue;
+    }
+    entries_num++;
+  }
+  pthread_mutex_unlock(&cache_lock);
+
+  fclose(fh);
+
+  if (status < 0) {
+    ERROR("uc_snapshot_read: %s is truncated or corrupt; restored %zu entries "
+          "before the error.",
+          file, entries_num);
+    return -1;
+  }
+
+  INFO("uc_snapshot_read: Restored %zu entries from %s (%zu ignored).",
+       entries_num, file, ignored_num);
+  return 0;
+} /* }}} int uc_snapshot_read */
+
 /*
  * Iterator interface
  */
@@ -38,7 +38,12 @@
 
 int uc_init(void);
 int uc_check_timeout(void);
+int uc_check_snapshot(void);
+int uc_shutdown(void);
 int uc_update(const data_set_t *ds, const value_list_t *vl);
+/* Forgets the rates remembered by the last uc_update() of this thread. Must be
+ * called before the value list passed to it is freed. */
+void uc_clear_last_rate(void);
 int uc_get_rate_by_name(const char *name, gauge_t **ret_values,
                         size_t *ret_values_num);
 gauge_t *uc_get_rate(const data_set_t *ds, const value_list_t *vl);
@@ -59,6 +64,91 @@ int uc_get_history(const data_set_t *ds, const value_list_t *vl,
 int uc_get_history_by_name(const char *name, gauge_t *ret_history,
                            size_t num_steps, size_t num_ds);
 
+/*
+ * Tiered history interface
+ */
+
+/*
+ * NAME
+ *   uc_configure_history
+ *
+ * DESCRIPTION
+ *   Handles the global <History> block. Only series matching one of its
+ *   `Series' options keep a tiered history: tier 0 holds the last raw rates,
+ *   tiers 1 and up hold the minimum, average and maximum of the rates per
+ *   fixed time interval.
+ */
+int uc_configure_history(oconfig_item_t *ci);
+
+/*
+ * NAME
+ *   uc_get_history_tier_info
+ *
+ * DESCRIPTION
+ *   Returns the resolution (zero for the raw tier) and the maximum number of
+ *   points of tier `tier'.
+ *
+ * RETURN VALUE
+ *   Zero upon success or -EINVAL if there is no such tier.
+ */
+int uc_get_history_tier_info(size_t tier, cdtime_t *ret_resolution,
+                             size_t *ret_points);
+
+/*
+ * NAME
+ *   uc_get_history_tier_by_name
+ *
+ * DESCRIPTION
+ *   Returns the points of tier `tier' of a series' history, oldest first. For
+ *   every point, `ret_times' holds its time (the start of the interval for
+ *   aggregated tiers) and `ret_values' holds the minimum, average and maximum
+ *   for each data source, i.e. `3 * ret_ds_num' values. For the raw tier, the
+ *   three values are identical. Both arrays have to be freed by the caller.
+ *
+ * RETURN VALUE
+ *   Zero upon success, -ENOENT if the series does not exist or has no history
+ *   and another negative error code otherwise.
+ */
+int uc_get_history_tier_by_name(const char *name, size_t tier,
+                                cdtime_t **ret_times, gauge_t **ret_values,
+                                size_t *ret_points_num, size_t *ret_ds_num);
+int uc_get_history_tier(const data_set_t *ds, const value_list_t *vl,
+                        size_t tier, cdtime_t **ret_times, gauge_t **ret_values,
+                        size_t *ret_points_num);
+
+/*
+ * Snapshot interface
+ */
+
+/*
+ * NAME
+ *   uc_snapshot_write
+ *
+ * DESCRIPTION
+ *   Writes the raw values, rates, timestamps, state, hits, history and meta
+ *   data of all cache entries to `file'. The file is replaced atomically.
+ *
+ * RETURN VALUE
+ *   Zero upon success or non-zero if an error occurred.
+ */
+int uc_snapshot_write(const char *file);
+
+/*
+ * NAME
+ *   uc_snapshot_read
+ *
+ * DESCRIPTION
+ *   Adds the entries of a snapshot written by `uc_snapshot_write' to the
+ *   cache. Entries whose type is unknown or whose data sources differ from
+ *   the current types database are ignored, as are entries which are already
+ *   present in the cache.
+ *
+ * RETURN VALUE
+ *   Zero upon success, ENOENT if `file' does not exist or another non-zero
+ *   value if an error occurred.
+ */
+int uc_snapshot_read(const char *file);
+
 /*
  * Iterator interface
  */
@@ -0,0 +1,104 @@
+/**
+ * collectd - src/daemon/utils_cache_bench.c
+ *
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include "collectd.h"
+
+#include "benchmark.h"
+#include "common.h"
+#include "utils_cache.h"
+
+/* Number of series in the cache. Each thread updates its own share. */
+#define SERIES_NUM 100000
+
+/* The value cache is linked in directly; these are the parts of the daemon it
+ * needs. */
+int timeout_g = 2;
+
+const char *global_option_get(const char *option) { return NULL; }
+
+cdtime_t global_option_get_time(const char *option, cdtime_t default_value) {
+  return default_value;
+}
+
+int plugin_dispatch_missing(const value_list_t *vl) { return 0; }
+
+static data_source_t dsrc_derive = {"value", DS_TYPE_DERIVE, 0.0, NAN};
+static data_set_t const ds_derive = {"derive", 1, &dsrc_derive};
+
+static value_list_t series[SERIES_NUM];
+static value_t values[SERIES_NUM];
+
+/* Updates a series with a new value and a later time stamp. Each series is
+ * only updated by one thread; the threaded variant measures the contention on
+ * the cache lock. */
+DEF_BENCH(uc_update) {
+  size_t share = SERIES_NUM / b->threads_num;
+  size_t first = b->thread * share;
+
+  for (uint64_t i = 0; i < b->iterations; i++) {
+    value_list_t *vl = series + first + (i % share);
+
+    vl->time += TIME_T_TO_CDTIME_T_STATIC(1);
+    vl->values[0].derive += 42;
+    uc_update(&ds_derive, vl);
+  }
+}
+
+DEF_BENCH(uc_get_rate) {
+  size_t share = SERIES_NUM / b->threads_num;
+  size_t first = b->thread * share;
+
+  for (uint64_t i = 0; i < b->iterations; i++) {
+    gauge_t *rates = uc_get_rate(&ds_derive, series + first + (i % share));
+
+    BENCH_KEEP(rates != NULL);
+    sfree(rates);
+  }
+}
+
+int main(void) {
+  uc_init();
+
+  for (size_t i = 0; i < SERIES_NUM; i++) {
+    value_list_t *vl = series + i;
+
+    *vl = (value_list_t)VALUE_LIST_INIT;
+    vl->values = values + i;
+    vl->values_len = 1;
+    vl->time = TIME_T_TO_CDTIME_T_STATIC(1);
+    vl->interval = TIME_T_TO_CDTIME_T_STATIC(10);
+    snprintf(vl->host, sizeof(vl->host), "host%04zu", i % 1000);
+    snprintf(vl->plugin, sizeof(vl->plugin), "plugin%02zu", i % 20);
+    sstrncpy(vl->type, "derive", sizeof(vl->type));
+    snprintf(vl->type_instance, sizeof(vl->type_instance), "ti%zu", i);
+
+    uc_update(&ds_derive, vl);
+  }
+
+  RUN_BENCH(uc_update, 1, NULL);
+  RUN_BENCH(uc_update, BENCH_THREADS, NULL);
+  RUN_BENCH(uc_get_rate, 1, NULL);
+  RUN_BENCH(uc_get_rate, BENCH_THREADS, NULL);
+
+  return 0;
+}
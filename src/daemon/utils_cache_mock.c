@@ -24,7 +24,9 @@
  *   Florian octo Forster <octo at collectd.org>
  */
 
-#include <errno.h>
+#include "collectd.h"
+
+#include "common.h"
 #include "utils_cache.h"
 
 gauge_t *uc_get_rate(__attribute__((unused)) data_set_t const *ds,
@@ -33,6 +35,9 @@ gauge_t *uc_get_rate(__attribute__((unused)) data_set_t const *ds,
   return NULL;
 }
 
+void uc_clear_last_rate(void) { /* nop */
+}
+
 int uc_get_rate_by_name(const char *name, gauge_t **ret_values,
                         size_t *ret_values_num) {
   return ENOTSUP;
@@ -41,3 +46,82 @@ int uc_get_rate_by_name(const char *name, gauge_t **ret_values,
 int uc_get_names(char ***ret_names, cdtime_t **ret_times, size_t *ret_number) {
   return ENOTSUP;
 }
+
+int uc_meta_data_add_unsigned_int(const value_list_t *vl, const char *key,
+                                  uint64_t value) {
+  return ENOTSUP;
+}
+
+int uc_meta_data_get_unsigned_int(const value_list_t *vl, const char *key,
+                                  uint64_t *value) {
+  return ENOTSUP;
+}
+
+int uc_configure_history(oconfig_item_t *ci) { return ENOTSUP; }
+
+/* The mock knows two tiers and the history of "myhost/magic/MAGIC", whose
+ * type has one data source, see plugin_mock.c. */
+int uc_get_history_tier_info(size_t tier, cdtime_t *ret_resolution,
+                             size_t *ret_points) {
+  if (tier > 1)
+    return -EINVAL;
+
+  if (ret_resolution != NULL)
+    *ret_resolution = (tier == 0) ? 0 : TIME_T_TO_CDTIME_T(60);
+  if (ret_points != NULL)
+    *ret_points = 2;
+  return 0;
+}
+
+int uc_get_history_tier_by_name(const char *name, size_t tier,
+                                cdtime_t **ret_times, gauge_t **ret_values,
+                                size_t *ret_points_num, size_t *ret_ds_num) {
+  cdtime_t *times;
+  gauge_t *values;
+
+  if (tier > 1)
+    return -EINVAL;
+  if (strcmp("myhost/magic/MAGIC", name) != 0)
+    return -ENOENT;
+
+  times = calloc(2, sizeof(*times));
+  values = calloc(2 * 3, sizeof(*values));
+  if ((times == NULL) || (values == NULL)) {
+    free(times);
+    free(values);
+    return -ENOMEM;
+  }
+
+  if (tier == 0) {
+    times[0] = TIME_T_TO_CDTIME_T(1480000000);
+    times[1] = TIME_T_TO_CDTIME_T(1480000010);
+    values[0] = values[1] = values[2] = 1.0;
+    values[3] = values[4] = values[5] = 2.0;
+  } else {
+    times[0] = TIME_T_TO_CDTIME_T(1480000000);
+    times[1] = TIME_T_TO_CDTIME_T(1480000060);
+    values[0] = 1.0;
+    values[1] = 2.0;
+    values[2] = 3.0;
+    values[3] = values[4] = values[5] = NAN;
+  }
+
+  *ret_times = times;
+  *ret_values = values;
+  *ret_points_num = 2;
+  if (ret_ds_num != NULL)
+    *ret_ds_num = 1;
+  return 0;
+}
+
+int uc_get_history_tier(const data_set_t *ds, const value_list_t *vl,
+                        size_t tier, cdtime_t **ret_times, gauge_t **ret_values,
+                        size_t *ret_points_num) {
+  char name[6 * DATA_MAX_NAME_LEN];
+
+  if (FORMAT_VL(name, sizeof(name), vl) != 0)
+    return -1;
+
+  return uc_get_history_tier_by_name(name, tier, ret_times, ret_values,
+                                     ret_points_num, NULL);
+}
@@ -0,0 +1,321 @@
+/**
+ * collectd - src/daemon/utils_cache_test.c
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include "collectd.h"
+
+#include "common.h"
+#include "testing.h"
+#include "utils_cache.h"
+
+/* The value cache is linked in directly; these are the parts of the daemon it
+ * needs. */
+int timeout_g = 2;
+
+const char *global_option_get(const char *option) { return NULL; }
+
+cdtime_t global_option_get_time(const char *option, cdtime_t default_value) {
+  return default_value;
+}
+
+int plugin_dispatch_missing(const value_list_t *vl) { return 0; }
+
+static data_source_t dsrc_if_octets[] = {
+    {"rx", DS_TYPE_GAUGE, NAN, NAN}, {"tx", DS_TYPE_GAUGE, NAN, NAN},
+};
+static data_set_t const ds_if_octets = {"if_octets", 2, dsrc_if_octets};
+
+/* Keeps the history of "example.com/test/if_octets" with four raw points and
+ * one tier of four ten second buckets. */
+static int configure_history(void) {
+  oconfig_value_t series = {.value.string = "example.com/test/if_octets",
+                            .type = OCONFIG_TYPE_STRING};
+  oconfig_value_t raw_points = {.value.number = 4,
+                                .type = OCONFIG_TYPE_NUMBER};
+  oconfig_value_t tier[] = {
+      {.value.number = 10, .type = OCONFIG_TYPE_NUMBER},
+      {.value.number = 4, .type = OCONFIG_TYPE_NUMBER},
+  };
+  oconfig_item_t children[] = {
+      {.key = "Series", .values = &series, .values_num = 1},
+      {.key = "RawPoints", .values = &raw_points, .values_num = 1},
+      {.key = "Tier", .values = tier, .values_num = 2},
+  };
+  oconfig_item_t ci = {.key = "History",
+                       .children = children,
+                       .children_num = STATIC_ARRAY_SIZE(children)};
+
+  return uc_configure_history(&ci);
+}
+
+/* Updates the series with "rx" = "v" and "tx" = 10 * "v" at "t" seconds. */
+static int update(char const *plugin, time_t t, gauge_t v) {
+  value_t values[] = {{.gauge = v}, {.gauge = 10 * v}};
+  value_list_t vl = {
+      .values = values,
+      .values_len = STATIC_ARRAY_SIZE(values),
+      .time = TIME_T_TO_CDTIME_T(t),
+      .interval = TIME_T_TO_CDTIME_T(5),
+      .host = "example.com",
+      .type = "if_octets",
+  };
+
+  sstrncpy(vl.plugin, plugin, sizeof(vl.plugin));
+  return uc_update(&ds_if_octets, &vl);
+}
+
+/* Checks the points of "tier". "want" holds the time and the minimum, average
+ * and maximum of "rx" for each point; "tx" is expected to be ten times that.
+ * A NaN average marks a bucket without values. */
+static int check_tier(size_t tier, gauge_t want[][4], size_t want_num) {
+  cdtime_t *times = NULL;
+  gauge_t *values = NULL;
+  size_t points_num = 0;
+  size_t ds_num = 0;
+
+  CHECK_ZERO(uc_get_history_tier_by_name("example.com/test/if_octets", tier,
+                                         &times, &values, &points_num,
+                                         &ds_num));
+  EXPECT_EQ_UINT64(want_num, points_num);
+  EXPECT_EQ_UINT64(2, ds_num);
+
+  for (size_t i = 0; i < want_num; i++) {
+    EXPECT_EQ_UINT64(TIME_T_TO_CDTIME_T((time_t)want[i][0]), times[i]);
+
+    for (size_t j = 0; j < ds_num; j++) {
+      gauge_t factor = (j == 0) ? 1.0 : 10.0;
+      gauge_t *got = values + 3 * (i * ds_num + j);
+
+      if (isnan(want[i][2])) {
+        OK(isnan(got[0]) && isnan(got[1]) && isnan(got[2]));
+        continue;
+      }
+      EXPECT_EQ_DOUBLE(factor * want[i][1], got[0]);
+      EXPECT_EQ_DOUBLE(factor * want[i][2], got[1]);
+      EXPECT_EQ_DOUBLE(factor * want[i][3], got[2]);
+    }
+  }
+
+  sfree(times);
+  sfree(values);
+  return 0;
+}
+
+DEF_TEST(tiered_history) {
+  cdtime_t resolution = 0;
+  size_t points = 0;
+  cdtime_t *times = NULL;
+  gauge_t *values = NULL;
+  size_t points_num = 0;
+
+  CHECK_ZERO(configure_history());
+  CHECK_ZERO(uc_init());
+
+  CHECK_ZERO(uc_get_history_tier_info(0, &resolution, &points));
+  EXPECT_EQ_UINT64(0, resolution);
+  EXPECT_EQ_UINT64(4, points);
+  CHECK_ZERO(uc_get_history_tier_info(1, &resolution, &points));
+  EXPECT_EQ_UINT64(TIME_T_TO_CDTIME_T(10), resolution);
+  EXPECT_EQ_UINT64(4, points);
+  EXPECT_EQ_INT(-EINVAL, uc_get_history_tier_info(2, NULL, NULL));
+
+  /* Two buckets with two values each, then a gap of one bucket. */
+  CHECK_ZERO(update("test", 100, 1));
+  CHECK_ZERO(update("test", 105, 3));
+  CHECK_ZERO(update("test", 110, 5));
+  CHECK_ZERO(update("test", 115, 7));
+  CHECK_ZERO(update("test", 132, 9));
+
+  gauge_t want_raw[][4] = {
+      {105, 3, 3, 3}, {110, 5, 5, 5}, {115, 7, 7, 7}, {132, 9, 9, 9},
+  };
+  CHECK_ZERO(check_tier(0, want_raw, STATIC_ARRAY_SIZE(want_raw)));
+
+  gauge_t want_tier[][4] = {
+      {100, 1, 2, 3}, {110, 5, 6, 7}, {120, NAN, NAN, NAN}, {130, 9, 9, 9},
+  };
+  CHECK_ZERO(check_tier(1, want_tier, STATIC_ARRAY_SIZE(want_tier)));
+
+  /* The next bucket pushes the oldest one out of the ring. */
+  CHECK_ZERO(update("test", 141, 4));
+  CHECK_ZERO(update("test", 148, 2));
+
+  gauge_t want_raw_wrapped[][4] = {
+      {115, 7, 7, 7}, {132, 9, 9, 9}, {141, 4, 4, 4}, {148, 2, 2, 2},
+  };
+  CHECK_ZERO(
+      check_tier(0, want_raw_wrapped, STATIC_ARRAY_SIZE(want_raw_wrapped)));
+
+  gauge_t want_tier_wrapped[][4] = {
+      {110, 5, 6, 7}, {120, NAN, NAN, NAN}, {130, 9, 9, 9}, {140, 2, 3, 4},
+  };
+  CHECK_ZERO(
+      check_tier(1, want_tier_wrapped, STATIC_ARRAY_SIZE(want_tier_wrapped)));
+
+  /* A gap longer than the tier clears all of its buckets. */
+  CHECK_ZERO(update("test", 300, 8));
+
+  gauge_t want_tier_gap[][4] = {
+      {270, NAN, NAN, NAN},
+      {280, NAN, NAN, NAN},
+      {290, NAN, NAN, NAN},
+      {300, 8, 8, 8},
+  };
+  CHECK_ZERO(check_tier(1, want_tier_gap, STATIC_ARRAY_SIZE(want_tier_gap)));
+
+  EXPECT_EQ_INT(-EINVAL, uc_get_history_tier_by_name(
+                             "example.com/test/if_octets", 2, &times, &values,
+                             &points_num, NULL));
+
+  /* Series not matching the configuration have no history. */
+  CHECK_ZERO(update("other", 100, 1));
+  EXPECT_EQ_INT(-ENOENT, uc_get_history_tier_by_name(
+                             "example.com/other/if_octets", 0, &times, &values,
+                             &points_num, NULL));
+  EXPECT_EQ_INT(-ENOENT, uc_get_history_tier_by_name(
+                             "example.com/unknown/if_octets", 0, &times,
+                             &values, &points_num, NULL));
+
+  return 0;
+}
+
+DEF_TEST(last_rate) {
+  value_t values[] = {{.gauge = 42}, {.gauge = 23}};
+  value_list_t vl = {
+      .values = values,
+      .values_len = STATIC_ARRAY_SIZE(values),
+      .time = TIME_T_TO_CDTIME_T(1000),
+      .interval = TIME_T_TO_CDTIME_T(10),
+      .host = "example.com",
+      .plugin = "last_rate",
+      .type = "if_octets",
+  };
+  gauge_t *rates;
+
+  CHECK_ZERO(uc_init());
+  CHECK_ZERO(uc_update(&ds_if_octets, &vl));
+
+  CHECK_NOT_NULL(rates = uc_get_rate(&ds_if_octets, &vl));
+  EXPECT_EQ_DOUBLE(42.0, rates[0]);
+  EXPECT_EQ_DOUBLE(23.0, rates[1]);
+  sfree(rates);
+
+  /* Another series at the same addresses and with the same time, like the
+   * next value list of a packet, must not get the rates of the first. */
+  uc_clear_last_rate();
+  sstrncpy(vl.plugin, "not_cached", sizeof(vl.plugin));
+  OK(uc_get_rate(&ds_if_octets, &vl) == NULL);
+
+  return 0;
+}
+
+/* Same as the "MAGIC" type of the plugin mock. */
+static data_source_t dsrc_magic[] = {{"value", DS_TYPE_DERIVE, 0.0, NAN}};
+static data_set_t const ds_magic = {"MAGIC", 1, dsrc_magic};
+
+DEF_TEST(snapshot) {
+  char file[] = "/tmp/utils_cache_test.XXXXXX";
+  value_t values[] = {{.derive = 100}};
+  value_list_t vl = {
+      .values = values,
+      .values_len = STATIC_ARRAY_SIZE(values),
+      .time = TIME_T_TO_CDTIME_T(1000),
+      .interval = TIME_T_TO_CDTIME_T(10),
+      .host = "example.com",
+      .plugin = "snapshot",
+      .type = "MAGIC",
+  };
+  gauge_t want_history[3];
+  gauge_t history[3];
+  value_t *ret_values = NULL;
+  gauge_t *rates = NULL;
+  size_t num = 0;
+  char *str = NULL;
+  int fd;
+
+  CHECK_ZERO(uc_init());
+  CHECK_ZERO(uc_update(&ds_magic, &vl));
+  CHECK_ZERO(uc_get_history(&ds_magic, &vl, want_history, 3, 1));
+  values[0].derive = 150;
+  vl.time = TIME_T_TO_CDTIME_T(1010);
+  CHECK_ZERO(uc_update(&ds_magic, &vl));
+  CHECK_ZERO(uc_set_state(&ds_magic, &vl, STATE_WARNING) < 0);
+  CHECK_ZERO(uc_set_hits(&ds_magic, &vl, 3) < 0);
+  CHECK_ZERO(uc_meta_data_add_string(&vl, "key", "value"));
+  CHECK_ZERO(uc_get_history(&ds_magic, &vl, want_history, 3, 1));
+
+  fd = mkstemp(file);
+  OK(fd >= 0);
+  close(fd);
+
+  /* Entries of types the plugin mock doesn't know are left out. */
+  CHECK_ZERO(uc_snapshot_write(file));
+
+  /* Empty the cache by letting all entries time out. */
+  timeout_g = 0;
+  CHECK_ZERO(uc_check_timeout());
+  timeout_g = 2;
+  EXPECT_EQ_UINT64(0, uc_get_size());
+
+  CHECK_ZERO(uc_snapshot_read(file));
+  unlink(file);
+  EXPECT_EQ_UINT64(1, uc_get_size());
+
+  CHECK_ZERO(uc_get_value_by_name("example.com/snapshot/MAGIC", &ret_values,
+                                  &num));
+  EXPECT_EQ_UINT64(1, num);
+  EXPECT_EQ_UINT64(150, ret_values[0].derive);
+  sfree(ret_values);
+
+  CHECK_ZERO(uc_get_rate_by_name("example.com/snapshot/MAGIC", &rates, &num));
+  EXPECT_EQ_UINT64(1, num);
+  EXPECT_EQ_DOUBLE(5.0, rates[0]);
+  sfree(rates);
+
+  EXPECT_EQ_INT(STATE_WARNING, uc_get_state(&ds_magic, &vl));
+  EXPECT_EQ_INT(3, uc_get_hits(&ds_magic, &vl));
+
+  CHECK_ZERO(uc_meta_data_get_string(&vl, "key", &str));
+  EXPECT_EQ_STR("value", str);
+  sfree(str);
+
+  CHECK_ZERO(uc_get_history(&ds_magic, &vl, history, 3, 1));
+  for (size_t i = 0; i < STATIC_ARRAY_SIZE(history); i++)
+    EXPECT_EQ_DOUBLE(want_history[i], history[i]);
+
+  /* Values received after the restart are kept. */
+  values[0].derive = 170;
+  vl.time = TIME_T_TO_CDTIME_T(1020);
+  CHECK_ZERO(uc_update(&ds_magic, &vl));
+  CHECK_NOT_NULL(rates = uc_get_rate(&ds_magic, &vl));
+  EXPECT_EQ_DOUBLE(2.0, rates[0]);
+  sfree(rates);
+
+  return 0;
+}
+
+int main(void) {
+  RUN_TEST(tiered_history);
+  RUN_TEST(last_rate);
+  RUN_TEST(snapshot);
+
+  END_TEST;
+}
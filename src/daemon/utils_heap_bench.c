@@ -0,0 +1,74 @@
+/**
+ * collectd - src/daemon/utils_heap_bench.c
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include "collectd.h"
+
+#include "benchmark.h"
+#include "utils_heap.h"
+
+/* Number of entries kept in the heap, e.g. the number of read callbacks. */
+#define ENTRIES_NUM 1000
+
+static uint64_t entries[ENTRIES_NUM];
+
+static int compare(void const *v0, void const *v1) {
+  uint64_t const *i0 = v0;
+  uint64_t const *i1 = v1;
+
+  if ((*i0) < (*i1))
+    return -1;
+  else if ((*i0) > (*i1))
+    return 1;
+  else
+    return 0;
+}
+
+/* Removes the root and inserts it again with a later "time stamp", the way
+ * the read threads use the heap. The heap locks internally, so the threaded
+ * variant measures the contention on that lock. */
+DEF_BENCH(get_root_insert) {
+  c_heap_t *h = b->arg;
+
+  for (uint64_t i = 0; i < b->iterations; i++) {
+    uint64_t *e = c_heap_get_root(h);
+    if (e == NULL)
+      continue;
+
+    *e += ENTRIES_NUM;
+    c_heap_insert(h, e);
+  }
+}
+
+int main(void) {
+  c_heap_t *h = c_heap_create(compare);
+
+  for (size_t i = 0; i < ENTRIES_NUM; i++) {
+    entries[i] = (uint64_t)((i * 7919) % ENTRIES_NUM);
+    c_heap_insert(h, entries + i);
+  }
+
+  RUN_BENCH(get_root_insert, 1, h);
+  RUN_BENCH(get_root_insert, BENCH_THREADS, h);
+
+  c_heap_destroy(h);
+  return 0;
+}
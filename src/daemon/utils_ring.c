@@ -0,0 +1,158 @@
+/**
+ * collectd - src/daemon/utils_ring.c
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ **/
+
+#include "collectd.h"
+
+#include "utils_ring.h"
+
+/* Keep the producer and consumer positions on separate cache lines. */
+#define RING_CACHE_LINE 64
+
+/*
+ * Every slot carries a sequence number (after D. Vyukov's bounded queue):
+ * slot "i" is free for the producer with ticket "t" (t % capacity == i) when
+ * its sequence is "t", and holds a committed element for the consumer when it
+ * is "t + 1". Releasing the slot sets it to "t + capacity", i.e. makes it
+ * free for the ticket one round later.
+ */
+typedef struct {
+  uint64_t seq;
+} ring_slot_t;
+
+struct ring_s {
+  uint64_t head; /* next ticket handed to a producer */
+  char pad0[RING_CACHE_LINE - sizeof(uint64_t)];
+  uint64_t tail; /* next ticket read by the consumer */
+  char pad1[RING_CACHE_LINE - sizeof(uint64_t)];
+
+  uint64_t mask;
+  size_t slot_size;
+  char *slots;
+};
+
+static ring_slot_t *ring_slot(ring_t const *r, uint64_t ticket) /* {{{ */
+{
+  return (ring_slot_t *)(r->slots + ((ticket & r->mask) * r->slot_size));
+} /* }}} ring_slot_t *ring_slot */
+
+ring_t *ring_create(size_t elem_size, size_t capacity) /* {{{ */
+{
+  ring_t *r;
+  size_t size = 1;
+
+  if ((elem_size == 0) || (capacity == 0))
+    return NULL;
+
+  while (size < capacity)
+    size *= 2;
+
+  r = calloc(1, sizeof(*r));
+  if (r == NULL)
+    return NULL;
+
+  /* The element follows the sequence number, aligned like the sequence. */
+  r->slot_size = sizeof(ring_slot_t) +
+                 ((elem_size + sizeof(uint64_t) - 1) & ~(sizeof(uint64_t) - 1));
+  r->mask = (uint64_t)(size - 1);
+
+  r->slots = calloc(size, r->slot_size);
+  if (r->slots == NULL) {
+    free(r);
+    return NULL;
+  }
+
+  for (uint64_t i = 0; i < (uint64_t)size; i++)
+    ring_slot(r, i)->seq = i;
+
+  return r;
+} /* }}} ring_t *ring_create */
+
+void ring_destroy(ring_t *r) /* {{{ */
+{
+  if (r == NULL)
+    return;
+
+  free(r->slots);
+  free(r);
+} /* }}} void ring_destroy */
+
+size_t ring_capacity(ring_t const *r) /* {{{ */
+{
+  return (r != NULL) ? (size_t)(r->mask + 1) : 0;
+} /* }}} size_t ring_capacity */
+
+void *ring_reserve(ring_t *r, uint64_t *ticket) /* {{{ */
+{
+  uint64_t pos = __atomic_load_n(&r->head, __ATOMIC_RELAXED);
+
+  while (42) {
+    ring_slot_t *slot = ring_slot(r, pos);
+    uint64_t seq = __atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE);
+    int64_t diff = (int64_t)(seq - pos);
+
+    if (diff == 0) {
+      /* On failure, "pos" is updated to the current head. */
+      if (__atomic_compare_exchange_n(&r->head, &pos, pos + 1,
+                                      /* weak = */ 1, __ATOMIC_RELAXED,
+                                      __ATOMIC_RELAXED)) {
+        *ticket = pos;
+        return slot + 1;
+      }
+    } else if (diff < 0) {
+      /* The slot still holds the element of the previous round. */
+      return NULL;
+    } else {
+      pos = __atomic_load_n(&r->head, __ATOMIC_RELAXED);
+    }
+  }
+} /* }}} void *ring_reserve */
+
+void ring_commit(ring_t *r, uint64_t ticket) /* {{{ */
+{
+  __atomic_store_n(&ring_slot(r, ticket)->seq, ticket + 1, __ATOMIC_RELEASE);
+} /* }}} void ring_commit */
+
+void *ring_peek(ring_t *r) /* {{{ */
+{
+  ring_slot_t *slot = ring_slot(r, r->tail);
+
+  if (__atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE) != r->tail + 1)
+    return NULL;
+
+  return slot + 1;
+} /* }}} void *ring_peek */
+
+void ring_release(ring_t *r) /* {{{ */
+{
+  ring_slot_t *slot = ring_slot(r, r->tail);
+
+  __atomic_store_n(&slot->seq, r->tail + r->mask + 1, __ATOMIC_RELEASE);
+  __atomic_store_n(&r->tail, r->tail + 1, __ATOMIC_RELAXED);
+} /* }}} void ring_release */
+
+_Bool ring_is_empty(ring_t *r) /* {{{ */
+{
+  uint64_t tail = __atomic_load_n(&r->tail, __ATOMIC_RELAXED);
+
+  return __atomic_load_n(&ring_slot(r, tail)->seq, __ATOMIC_ACQUIRE) !=
+         tail + 1;
+} /* }}} _Bool ring_is_empty */
@@ -0,0 +1,64 @@
+/**
+ * collectd - src/daemon/utils_ring.h
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ **/
+
+#ifndef UTILS_RING_H
+#define UTILS_RING_H 1
+
+#include "collectd.h"
+
+/*
+ * Bounded multi-producer, single-consumer queue of fixed size elements.
+ *
+ * Producers reserve a slot, fill it in place and commit it; they never block
+ * and never take a lock. If the ring is full, reserving fails and the caller
+ * decides what to do with the element. The single consumer peeks at the
+ * oldest committed slot and releases it once it is done with it. Elements are
+ * consumed in the order their slots were reserved.
+ */
+
+struct ring_s;
+typedef struct ring_s ring_t;
+
+/* Creates a ring of at least "capacity" elements of "elem_size" bytes each.
+ * The capacity is rounded up to the next power of two. */
+ring_t *ring_create(size_t elem_size, size_t capacity);
+void ring_destroy(ring_t *r);
+
+size_t ring_capacity(ring_t const *r);
+
+/* Reserves the next free slot and returns a pointer to it, or NULL if the ring
+ * is full. The slot must be handed to ring_commit() together with "ticket"
+ * as soon as it has been filled. */
+void *ring_reserve(ring_t *r, uint64_t *ticket);
+void ring_commit(ring_t *r, uint64_t ticket);
+
+/* Returns the oldest committed slot or NULL if there is none. The slot stays
+ * valid until it is passed to ring_release(). Must only be called by the
+ * consumer. */
+void *ring_peek(ring_t *r);
+void ring_release(ring_t *r);
+
+/* Returns true if there is no committed element. May be called by any
+ * thread, the result is only a hint if producers are active. */
+_Bool ring_is_empty(ring_t *r);
+
+#endif /* UTILS_RING_H */
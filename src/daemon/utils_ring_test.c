@@ -0,0 +1,171 @@
+/**
+ * collectd - src/daemon/utils_ring_test.c
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ **/
+
+#include "collectd.h"
+
+#include "testing.h"
+#include "utils_ring.h"
+
+#define PRODUCERS 4
+#define PER_PRODUCER 100000
+
+typedef struct {
+  int producer;
+  int seq;
+} elem_t;
+
+DEF_TEST(fifo) {
+  ring_t *r;
+  uint64_t ticket;
+  elem_t *e;
+
+  CHECK_NOT_NULL(r = ring_create(sizeof(elem_t), 3));
+  EXPECT_EQ_UINT64(4, ring_capacity(r));
+  OK(ring_is_empty(r));
+  OK(ring_peek(r) == NULL);
+
+  for (int round = 0; round < 3; round++) {
+    for (int i = 0; i < 4; i++) {
+      CHECK_NOT_NULL(e = ring_reserve(r, &ticket));
+      e->seq = 10 * round + i;
+      ring_commit(r, ticket);
+    }
+    /* full */
+    OK(ring_reserve(r, &ticket) == NULL);
+    OK(!ring_is_empty(r));
+
+    for (int i = 0; i < 4; i++) {
+      CHECK_NOT_NULL(e = ring_peek(r));
+      EXPECT_EQ_INT(10 * round + i, e->seq);
+      ring_release(r);
+    }
+    OK(ring_is_empty(r));
+    OK(ring_peek(r) == NULL);
+  }
+
+  ring_destroy(r);
+  return 0;
+}
+
+DEF_TEST(uncommitted) {
+  ring_t *r;
+  uint64_t t0, t1;
+  elem_t *e0, *e1;
+
+  CHECK_NOT_NULL(r = ring_create(sizeof(elem_t), 4));
+
+  CHECK_NOT_NULL(e0 = ring_reserve(r, &t0));
+  CHECK_NOT_NULL(e1 = ring_reserve(r, &t1));
+  e1->seq = 1;
+  ring_commit(r, t1);
+
+  /* The first slot has not been committed yet, so it blocks the second. */
+  OK(ring_peek(r) == NULL);
+
+  e0->seq = 0;
+  ring_commit(r, t0);
+
+  CHECK_NOT_NULL(e0 = ring_peek(r));
+  EXPECT_EQ_INT(0, e0->seq);
+  ring_release(r);
+  CHECK_NOT_NULL(e1 = ring_peek(r));
+  EXPECT_EQ_INT(1, e1->seq);
+  ring_release(r);
+
+  ring_destroy(r);
+  return 0;
+}
+
+typedef struct {
+  ring_t *r;
+  int id;
+} producer_arg_t;
+
+static void *produce(void *arg) {
+  producer_arg_t *pa = arg;
+
+  for (int i = 0; i < PER_PRODUCER; i++) {
+    uint64_t ticket;
+    elem_t *e;
+
+    while ((e = ring_reserve(pa->r, &ticket)) == NULL)
+      sched_yield();
+
+    e->producer = pa->id;
+    e->seq = i;
+    ring_commit(pa->r, ticket);
+  }
+
+  return NULL;
+}
+
+DEF_TEST(concurrent) {
+  producer_arg_t args[PRODUCERS];
+  pthread_t threads[PRODUCERS];
+  int next[PRODUCERS] = {0};
+  ring_t *r;
+  int received = 0;
+
+  CHECK_NOT_NULL(r = ring_create(sizeof(elem_t), 256));
+
+  for (int i = 0; i < PRODUCERS; i++) {
+    args[i] = (producer_arg_t){.r = r, .id = i};
+    CHECK_ZERO(pthread_create(threads + i, NULL, produce, args + i));
+  }
+
+  /* Every producer's elements must arrive complete and in order. */
+  while (received < PRODUCERS * PER_PRODUCER) {
+    elem_t *e = ring_peek(r);
+
+    if (e == NULL) {
+      sched_yield();
+      continue;
+    }
+
+    if ((e->producer < 0) || (e->producer >= PRODUCERS) ||
+        (e->seq != next[e->producer])) {
+      printf("not ok - element %d of producer %d out of order\n", e->seq,
+             e->producer);
+      return -1;
+    }
+    next[e->producer]++;
+    ring_release(r);
+    received++;
+  }
+
+  for (int i = 0; i < PRODUCERS; i++) {
+    CHECK_ZERO(pthread_join(threads[i], NULL));
+    EXPECT_EQ_INT(PER_PRODUCER, next[i]);
+  }
+  OK(ring_is_empty(r));
+
+  ring_destroy(r);
+  return 0;
+}
+
+int main(void) {
+  RUN_TEST(fifo);
+  RUN_TEST(uncommitted);
+  RUN_TEST(concurrent);
+
+  END_TEST;
+}
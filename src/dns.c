@@ -38,95 +38,96 @@
 #include <sys/capability.h>
 #endif
 
+#if KERNEL_LINUX
+#include <arpa/inet.h>
+#include <linux/filter.h>
+#include <linux/if_ether.h>
+#include <linux/if_packet.h>
+#include <net/if.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#if defined(TPACKET3_HDRLEN) && defined(PACKET_FANOUT)
+#define DNS_HAVE_RING 1
+#endif
+#endif
+
+#ifndef DNS_HAVE_RING
+#define DNS_HAVE_RING 0
+#endif
+
 /*
  * Private data types
  */
-struct counter_list_s {
-  unsigned int key;
-  unsigned int value;
-  struct counter_list_s *next;
-};
-typedef struct counter_list_s counter_list_t;
+/* The counters of one capture thread. The header fields opcode and rcode are
+ * four bits wide, so all counters can be indexed directly. */
+typedef struct {
+  derive_t tr_queries;
+  derive_t tr_responses;
+  derive_t qtype[T_MAX];
+  derive_t opcode[16];
+  derive_t rcode[16];
+} dns_counters_t;
+
+typedef struct {
+  /* Held by the capture thread while it processes packets and by dns_read()
+   * while it sums up the counters. */
+  pthread_mutex_t lock;
+  dns_counters_t counters;
+
+  pthread_t thread;
+  _Bool thread_started;
+
+#if DNS_HAVE_RING
+  int fd;
+  void *ring;
+  size_t ring_size;
+  derive_t drops;
+#endif
+} dns_capture_t;
 
 /*
  * Private variables
  */
-static const char *config_keys[] = {"Interface", "IgnoreSource",
-                                    "SelectNumericQueryTypes"};
+static const char *config_keys[] = {"Interface",      "IgnoreSource",
+                                    "SelectNumericQueryTypes",
+                                    "CaptureMethod",  "CaptureThreads",
+                                    "PcapFile"};
 static int config_keys_num = STATIC_ARRAY_SIZE(config_keys);
 static int select_numeric_qtype = 1;
 
 #define PCAP_SNAPLEN 1460
 static char *pcap_device = NULL;
+static char *pcap_file = NULL;
+
+/* Settings of the TPACKET_V3 ring of each capture thread. A block is handed
+ * to user space when it is full or after DNS_RING_BLOCK_TIMEOUT
+ * milliseconds. */
+#define DNS_RING_BLOCK_SIZE (1 << 20)
+#define DNS_RING_BLOCKS 64
+#define DNS_RING_FRAME_SIZE 2048
+#define DNS_RING_BLOCK_TIMEOUT 100
+
+static _Bool use_ring = 0;
+static size_t capture_threads_num = 1;
+#if DNS_HAVE_RING
+/* Packets on the loopback device are seen twice, once outgoing and once
+ * incoming; like libpcap, only the latter is counted. */
+static int lo_ifindex = 0;
+#endif
 
-static derive_t tr_queries;
-static derive_t tr_responses;
-static counter_list_t *qtype_list;
-static counter_list_t *opcode_list;
-static counter_list_t *rcode_list;
+static dns_capture_t *captures = NULL;
+static size_t captures_num = 0;
+static _Bool capture_shutdown = 0;
 
-static pthread_t listen_thread;
-static int listen_thread_init = 0;
-/* The `traffic' mutex if for `tr_queries' and `tr_responses' */
-static pthread_mutex_t traffic_mutex = PTHREAD_MUTEX_INITIALIZER;
-static pthread_mutex_t qtype_mutex = PTHREAD_MUTEX_INITIALIZER;
-static pthread_mutex_t opcode_mutex = PTHREAD_MUTEX_INITIALIZER;
-static pthread_mutex_t rcode_mutex = PTHREAD_MUTEX_INITIALIZER;
+/* The counters of the calling capture thread, see dns_child_callback(). */
+static pthread_key_t counters_key;
+
+/* Sum of all capture threads' counters, only used by dns_read(). */
+static dns_counters_t *totals = NULL;
 
 /*
  * Private functions
  */
-static counter_list_t *counter_list_search(counter_list_t **list,
-                                           unsigned int key) {
-  counter_list_t *entry;
-
-  for (entry = *list; entry != NULL; entry = entry->next)
-    if (entry->key == key)
-      break;
-
-  return entry;
-}
-
-static counter_list_t *counter_list_create(counter_list_t **list,
-                                           unsigned int key,
-                                           unsigned int value) {
-  counter_list_t *entry;
-
-  entry = calloc(1, sizeof(*entry));
-  if (entry == NULL)
-    return NULL;
-
-  entry->key = key;
-  entry->value = value;
-
-  if (*list == NULL) {
-    *list = entry;
-  } else {
-    counter_list_t *last;
-
-    last = *list;
-    while (last->next != NULL)
-      last = last->next;
-
-    last->next = entry;
-  }
-
-  return entry;
-}
-
-static void counter_list_add(counter_list_t **list, unsigned int key,
-                             unsigned int increment) {
-  counter_list_t *entry;
-
-  entry = counter_list_search(list, key);
-
-  if (entry != NULL) {
-    entry->value += increment;
-  } else {
-    counter_list_create(list, key, increment);
-  }
-}
-
 static int dns_config(const char *key, const char *value) {
   if (strcasecmp(key, "Interface") == 0) {
     if (pcap_device != NULL)
@@ -141,6 +142,32 @@ static int dns_config(const char *key, const char *value) {
       select_numeric_qtype = 0;
     else
       select_numeric_qtype = 1;
+  } else if (strcasecmp(key, "CaptureMethod") == 0) {
+    if (strcasecmp("pcap", value) == 0)
+      use_ring = 0;
+    else if (strcasecmp("ring", value) == 0) {
+#if DNS_HAVE_RING
+      use_ring = 1;
+#else
+      WARNING("dns plugin: The \"ring\" capture method is not available on "
+              "this system. Falling back to \"pcap\".");
+      use_ring = 0;
+#endif
+    } else {
+      ERROR("dns plugin: Invalid capture method: \"%s\".", value);
+      return -1;
+    }
+  } else if (strcasecmp(key, "CaptureThreads") == 0) {
+    int tmp = atoi(value);
+    if (tmp < 1) {
+      ERROR("dns plugin: \"CaptureThreads\" must be at least 1.");
+      return -1;
+    }
+    capture_threads_num = (size_t)tmp;
+  } else if (strcasecmp(key, "PcapFile") == 0) {
+    sfree(pcap_file);
+    if ((pcap_file = strdup(value)) == NULL)
+      return 1;
   } else {
     return -1;
   }
@@ -148,7 +175,13 @@ static int dns_config(const char *key, const char *value) {
   return 0;
 }
 
+/* Called for each DNS message, with the capture thread's lock held. */
 static void dns_child_callback(const rfc1035_header_t *dns) {
+  dns_counters_t *c = pthread_getspecific(counters_key);
+
+  if (c == NULL)
+    return;
+
   if (dns->qr == 0) {
     /* This is a query */
     int skip = 0;
@@ -158,33 +191,30 @@ static void dns_child_callback(const rfc1035_header_t *dns) {
         skip = 1;
     }
 
-    pthread_mutex_lock(&traffic_mutex);
-    tr_queries += dns->length;
-    pthread_mutex_unlock(&traffic_mutex);
+    c->tr_queries += dns->length;
 
-    if (skip == 0) {
-      pthread_mutex_lock(&qtype_mutex);
-      counter_list_add(&qtype_list, dns->qtype, 1);
-      pthread_mutex_unlock(&qtype_mutex);
-    }
+    if (skip == 0)
+      c->qtype[dns->qtype]++;
   } else {
     /* This is a reply */
-    pthread_mutex_lock(&traffic_mutex);
-    tr_responses += dns->length;
-    pthread_mutex_unlock(&traffic_mutex);
-
-    pthread_mutex_lock(&rcode_mutex);
-    counter_list_add(&rcode_list, dns->rcode, 1);
-    pthread_mutex_unlock(&rcode_mutex);
+    c->tr_responses += dns->length;
+    c->rcode[dns->rcode]++;
   }
 
   /* FIXME: Are queries, replies or both interesting? */
-  pthread_mutex_lock(&opcode_mutex);
-  counter_list_add(&opcode_list, dns->opcode, 1);
-  pthread_mutex_unlock(&opcode_mutex);
+  c->opcode[dns->opcode]++;
 }
 
-static int dns_run_pcap_loop(void) {
+static void dns_pcap_callback(u_char *user, const struct pcap_pkthdr *hdr,
+                              const u_char *pkt) {
+  dns_capture_t *c = (void *)user;
+
+  pthread_mutex_lock(&c->lock);
+  handle_pcap(NULL, hdr, pkt);
+  pthread_mutex_unlock(&c->lock);
+}
+
+static int dns_run_pcap_loop(dns_capture_t *c) {
   pcap_t *pcap_obj;
   char pcap_error[PCAP_ERRBUF_SIZE];
   struct bpf_program fp = {0};
@@ -198,17 +228,27 @@ static int dns_run_pcap_loop(void) {
     pthread_sigmask(SIG_SETMASK, &sigmask, NULL);
   }
 
-  /* Passing `pcap_device == NULL' is okay and the same as passign "any" */
-  DEBUG("dns plugin: Creating PCAP object..");
-  pcap_obj = pcap_open_live((pcap_device != NULL) ? pcap_device : "any",
-                            PCAP_SNAPLEN, 0 /* Not promiscuous */,
-                            (int)CDTIME_T_TO_MS(plugin_get_interval() / 2),
-                            pcap_error);
-  if (pcap_obj == NULL) {
-    ERROR("dns plugin: Opening interface `%s' "
-          "failed: %s",
-          (pcap_device != NULL) ? pcap_device : "any", pcap_error);
-    return PCAP_ERROR;
+  if (pcap_file != NULL) {
+    DEBUG("dns plugin: Opening capture file \"%s\".", pcap_file);
+    pcap_obj = pcap_open_offline(pcap_file, pcap_error);
+    if (pcap_obj == NULL) {
+      ERROR("dns plugin: Opening capture file `%s' failed: %s", pcap_file,
+            pcap_error);
+      return PCAP_ERROR;
+    }
+  } else {
+    /* Passing `pcap_device == NULL' is okay and the same as passign "any" */
+    DEBUG("dns plugin: Creating PCAP object..");
+    pcap_obj = pcap_open_live((pcap_device != NULL) ? pcap_device : "any",
+                              PCAP_SNAPLEN, 0 /* Not promiscuous */,
+                              (int)CDTIME_T_TO_MS(plugin_get_interval() / 2),
+                              pcap_error);
+    if (pcap_obj == NULL) {
+      ERROR("dns plugin: Opening interface `%s' "
+            "failed: %s",
+            (pcap_device != NULL) ? pcap_device : "any", pcap_error);
+      return PCAP_ERROR;
+    }
   }
 
   status = pcap_compile(pcap_obj, &fp, "udp port 53", 1, 0);
@@ -226,16 +266,16 @@ static int dns_run_pcap_loop(void) {
   DEBUG("dns plugin: PCAP object created.");
 
   dnstop_set_pcap_obj(pcap_obj);
-  dnstop_set_callback(dns_child_callback);
 
   status = pcap_loop(pcap_obj, -1 /* loop forever */,
-                     handle_pcap /* callback */, NULL /* user data */);
+                     dns_pcap_callback /* callback */, (void *)c);
   INFO("dns plugin: pcap_loop exited with status %i.", status);
   /* We need to handle "PCAP_ERROR" specially because libpcap currently
    * doesn't return PCAP_ERROR_IFACE_NOT_UP for compatibility reasons. */
-  if (status == PCAP_ERROR)
+  if ((status == PCAP_ERROR) && (pcap_file == NULL))
     status = PCAP_ERROR_IFACE_NOT_UP;
 
+  pcap_freecode(&fp);
   pcap_close(pcap_obj);
   return status;
 } /* int dns_run_pcap_loop */
@@ -253,50 +293,273 @@ static int dns_sleep_one_interval(void) /* {{{ */
   return 0;
 } /* }}} int dns_sleep_one_interval */
 
-static void *dns_child_loop(__attribute__((unused)) void *dummy) /* {{{ */
+static void *dns_child_loop(void *arg) /* {{{ */
 {
+  dns_capture_t *c = arg;
   int status;
 
+  pthread_setspecific(counters_key, &c->counters);
+
   while (42) {
-    status = dns_run_pcap_loop();
+    status = dns_run_pcap_loop(c);
     if (status != PCAP_ERROR_IFACE_NOT_UP)
       break;
 
     dns_sleep_one_interval();
   }
 
-  if (status != PCAP_ERROR_BREAK)
+  /* pcap_loop() returns zero when it reaches the end of a capture file. */
+  if ((status == 0) && (pcap_file != NULL))
+    INFO("dns plugin: Finished reading \"%s\".", pcap_file);
+  else if (status != PCAP_ERROR_BREAK)
     ERROR("dns plugin: PCAP returned error %s.", pcap_statustostr(status));
 
-  listen_thread_init = 0;
   return NULL;
 } /* }}} void *dns_child_loop */
 
-static int dns_init(void) {
-  /* clean up an old thread */
+#if DNS_HAVE_RING
+static void dns_ring_close(dns_capture_t *c) /* {{{ */
+{
+  if (c->ring != NULL) {
+    munmap(c->ring, c->ring_size);
+    c->ring = NULL;
+  }
+  if (c->fd >= 0) {
+    close(c->fd);
+    c->fd = -1;
+  }
+} /* }}} void dns_ring_close */
+
+/* Attaches the "udp port 53" filter. Packet sockets of type SOCK_DGRAM pass
+ * the packet starting at the network header to the filter, which is what
+ * libpcap calls DLT_RAW. */
+static int dns_ring_set_filter(int fd) /* {{{ */
+{
+  struct bpf_program fp = {0};
+  struct sock_fprog prog;
+  pcap_t *pcap_obj;
   int status;
 
-  pthread_mutex_lock(&traffic_mutex);
-  tr_queries = 0;
-  tr_responses = 0;
-  pthread_mutex_unlock(&traffic_mutex);
+  pcap_obj = pcap_open_dead(DLT_RAW, PCAP_SNAPLEN);
+  if (pcap_obj == NULL) {
+    ERROR("dns plugin: pcap_open_dead failed.");
+    return -1;
+  }
 
-  if (listen_thread_init != 0)
+  status = pcap_compile(pcap_obj, &fp, "udp port 53", 1, 0);
+  if (status < 0) {
+    ERROR("dns plugin: pcap_compile failed: %s", pcap_geterr(pcap_obj));
+    pcap_close(pcap_obj);
     return -1;
+  }
 
-  status = plugin_thread_create(&listen_thread, NULL, dns_child_loop, (void *)0,
-                                "dns listen");
+  prog.len = (unsigned short)fp.bf_len;
+  prog.filter = (struct sock_filter *)fp.bf_insns;
+  status = setsockopt(fd, SOL_SOCKET, SO_ATTACH_FILTER, &prog, sizeof(prog));
   if (status != 0) {
     char errbuf[1024];
-    ERROR("dns plugin: pthread_create failed: %s",
+    ERROR("dns plugin: setsockopt(SO_ATTACH_FILTER) failed: %s",
+          sstrerror(errno, errbuf, sizeof(errbuf)));
+  }
+
+  pcap_freecode(&fp);
+  pcap_close(pcap_obj);
+  return status;
+} /* }}} int dns_ring_set_filter */
+
+static int dns_ring_open(dns_capture_t *c) /* {{{ */
+{
+  char errbuf[1024];
+  int version = TPACKET_V3;
+  struct tpacket_req3 req = {
+      .tp_block_size = DNS_RING_BLOCK_SIZE,
+      .tp_block_nr = DNS_RING_BLOCKS,
+      .tp_frame_size = DNS_RING_FRAME_SIZE,
+      .tp_frame_nr =
+          (DNS_RING_BLOCK_SIZE / DNS_RING_FRAME_SIZE) * DNS_RING_BLOCKS,
+      .tp_retire_blk_tov = DNS_RING_BLOCK_TIMEOUT,
+  };
+  struct sockaddr_ll sll = {
+      .sll_family = AF_PACKET, .sll_protocol = htons(ETH_P_ALL),
+  };
+
+  if ((pcap_device != NULL) && (strcmp("any", pcap_device) != 0)) {
+    sll.sll_ifindex = (int)if_nametoindex(pcap_device);
+    if (sll.sll_ifindex == 0) {
+      ERROR("dns plugin: Unknown interface \"%s\".", pcap_device);
+      return -1;
+    }
+  }
+
+  c->fd = socket(AF_PACKET, SOCK_DGRAM, htons(ETH_P_ALL));
+  if (c->fd < 0) {
+    ERROR("dns plugin: socket(AF_PACKET) failed: %s",
+          sstrerror(errno, errbuf, sizeof(errbuf)));
+    return -1;
+  }
+
+  /* Attach the filter before binding, so no other traffic gets queued. */
+  if (dns_ring_set_filter(c->fd) != 0) {
+    dns_ring_close(c);
+    return -1;
+  }
+
+  if ((setsockopt(c->fd, SOL_PACKET, PACKET_VERSION, &version,
+                  sizeof(version)) != 0) ||
+      (setsockopt(c->fd, SOL_PACKET, PACKET_RX_RING, &req, sizeof(req)) !=
+       0)) {
+    ERROR("dns plugin: Setting up the TPACKET_V3 ring failed: %s",
+          sstrerror(errno, errbuf, sizeof(errbuf)));
+    dns_ring_close(c);
+    return -1;
+  }
+
+  c->ring_size = (size_t)req.tp_block_size * (size_t)req.tp_block_nr;
+  c->ring = mmap(NULL, c->ring_size, PROT_READ | PROT_WRITE, MAP_SHARED, c->fd,
+                 0);
+  if (c->ring == MAP_FAILED) {
+    ERROR("dns plugin: mmap failed: %s",
           sstrerror(errno, errbuf, sizeof(errbuf)));
+    c->ring = NULL;
+    dns_ring_close(c);
+    return -1;
+  }
+
+  if (bind(c->fd, (struct sockaddr *)&sll, sizeof(sll)) != 0) {
+    ERROR("dns plugin: bind(AF_PACKET) failed: %s",
+          sstrerror(errno, errbuf, sizeof(errbuf)));
+    dns_ring_close(c);
+    return -1;
+  }
+
+  /* Spread the packets over all capture threads; packets of one flow always
+   * end up in the same thread. */
+  if (captures_num > 1) {
+    int fanout = (int)(getpid() & 0xffff) | (PACKET_FANOUT_HASH << 16);
+    if (setsockopt(c->fd, SOL_PACKET, PACKET_FANOUT, &fanout,
+                   sizeof(fanout)) != 0) {
+      ERROR("dns plugin: setsockopt(PACKET_FANOUT) failed: %s",
+            sstrerror(errno, errbuf, sizeof(errbuf)));
+      dns_ring_close(c);
+      return -1;
+    }
+  }
+
+  return 0;
+} /* }}} int dns_ring_open */
+
+static void dns_ring_handle_block(dns_capture_t *c, /* {{{ */
+                                  struct tpacket_block_desc *bd) {
+  struct tpacket3_hdr *ppd =
+      (void *)((char *)bd + bd->hdr.bh1.offset_to_first_pkt);
+
+  pthread_mutex_lock(&c->lock);
+  for (uint32_t i = 0; i < bd->hdr.bh1.num_pkts; i++) {
+    struct sockaddr_ll const *sll =
+        (void *)((char *)ppd + TPACKET_ALIGN(sizeof(*ppd)));
+
+    if ((sll->sll_pkttype != PACKET_OUTGOING) ||
+        (sll->sll_ifindex != lo_ifindex))
+      handle_packet(DLT_RAW, (u_char *)ppd + ppd->tp_mac,
+                    (int)ppd->tp_snaplen);
+    ppd = (void *)((char *)ppd + ppd->tp_next_offset);
+  }
+  pthread_mutex_unlock(&c->lock);
+} /* }}} void dns_ring_handle_block */
+
+static void *dns_ring_loop(void *arg) /* {{{ */
+{
+  dns_capture_t *c = arg;
+  size_t block = 0;
+
+  pthread_setspecific(counters_key, &c->counters);
+
+  while (!capture_shutdown) {
+    struct tpacket_block_desc *bd =
+        (void *)((char *)c->ring + block * DNS_RING_BLOCK_SIZE);
+
+    if ((bd->hdr.bh1.block_status & TP_STATUS_USER) == 0) {
+      struct pollfd pfd = {.fd = c->fd, .events = POLLIN | POLLERR};
+      /* Time out regularly to notice shutdown. */
+      poll(&pfd, 1, DNS_RING_BLOCK_TIMEOUT);
+      continue;
+    }
+
+    dns_ring_handle_block(c, bd);
+
+    /* Hand the block back to the kernel. */
+    __sync_synchronize();
+    bd->hdr.bh1.block_status = TP_STATUS_KERNEL;
+    block = (block + 1) % DNS_RING_BLOCKS;
+  }
+
+  return NULL;
+} /* }}} void *dns_ring_loop */
+#endif /* DNS_HAVE_RING */
+
+static int dns_init(void) {
+  int status;
+
+  if (captures != NULL)
+    return 0;
+
+  status = pthread_key_create(&counters_key, /* destructor = */ NULL);
+  if (status != 0) {
+    ERROR("dns plugin: pthread_key_create failed.");
+    return -1;
+  }
+
+  /* Only the ring can be read by several threads. */
+  captures_num = (use_ring && (pcap_file == NULL)) ? capture_threads_num : 1;
+  if (use_ring && (pcap_file != NULL))
+    WARNING("dns plugin: Reading from a capture file; ignoring "
+            "CaptureMethod \"ring\".");
+
+  totals = malloc(sizeof(*totals));
+  captures = calloc(captures_num, sizeof(*captures));
+  if ((totals == NULL) || (captures == NULL)) {
+    ERROR("dns plugin: calloc failed.");
+    sfree(totals);
+    sfree(captures);
     return -1;
   }
 
-  listen_thread_init = 1;
+  dnstop_set_callback(dns_child_callback);
+#if DNS_HAVE_RING
+  lo_ifindex = (int)if_nametoindex("lo");
+#endif
+
+  for (size_t i = 0; i < captures_num; i++) {
+    dns_capture_t *c = captures + i;
+    char name[16];
+
+    pthread_mutex_init(&c->lock, /* attr = */ NULL);
+
+#if DNS_HAVE_RING
+    c->fd = -1;
+    if (use_ring && (pcap_file == NULL)) {
+      if (dns_ring_open(c) != 0)
+        return -1;
+
+      snprintf(name, sizeof(name), "dns ring#%u", (unsigned)(i % 1000));
+      status = plugin_thread_create(&c->thread, NULL, dns_ring_loop, c, name);
+    } else
+#endif
+    {
+      snprintf(name, sizeof(name), "dns listen");
+      status = plugin_thread_create(&c->thread, NULL, dns_child_loop, c, name);
+    }
+    if (status != 0) {
+      char errbuf[1024];
+      ERROR("dns plugin: pthread_create failed: %s",
+            sstrerror(errno, errbuf, sizeof(errbuf)));
+      return -1;
+    }
+    c->thread_started = 1;
+  }
 
 #if defined(HAVE_SYS_CAPABILITY_H) && defined(CAP_NET_RAW)
-  if (check_capability(CAP_NET_RAW) != 0) {
+  if ((pcap_file == NULL) && (check_capability(CAP_NET_RAW) != 0)) {
     if (getuid() == 0)
       WARNING("dns plugin: Running collectd as root, but the CAP_NET_RAW "
               "capability is missing. The plugin's read function will probably "
@@ -339,64 +602,104 @@ static void submit_octets(derive_t queries, derive_t responses) {
 } /* void submit_octets */
 
 static int dns_read(void) {
-  unsigned int keys[T_MAX];
-  unsigned int values[T_MAX];
-  int len;
-
-  counter_list_t *ptr;
+  if (totals == NULL)
+    return -1;
 
-  pthread_mutex_lock(&traffic_mutex);
-  values[0] = tr_queries;
-  values[1] = tr_responses;
-  pthread_mutex_unlock(&traffic_mutex);
+  /* Sum up the counters of all capture threads. */
+  memset(totals, 0, sizeof(*totals));
+  for (size_t i = 0; i < captures_num; i++) {
+    dns_capture_t *c = captures + i;
+
+    pthread_mutex_lock(&c->lock);
+    totals->tr_queries += c->counters.tr_queries;
+    totals->tr_responses += c->counters.tr_responses;
+    for (size_t j = 0; j < STATIC_ARRAY_SIZE(totals->qtype); j++)
+      totals->qtype[j] += c->counters.qtype[j];
+    for (size_t j = 0; j < STATIC_ARRAY_SIZE(totals->opcode); j++)
+      totals->opcode[j] += c->counters.opcode[j];
+    for (size_t j = 0; j < STATIC_ARRAY_SIZE(totals->rcode); j++)
+      totals->rcode[j] += c->counters.rcode[j];
+    pthread_mutex_unlock(&c->lock);
+  }
 
-  if ((values[0] != 0) || (values[1] != 0))
-    submit_octets(values[0], values[1]);
+  if ((totals->tr_queries != 0) || (totals->tr_responses != 0))
+    submit_octets(totals->tr_queries, totals->tr_responses);
 
-  pthread_mutex_lock(&qtype_mutex);
-  for (ptr = qtype_list, len = 0; (ptr != NULL) && (len < T_MAX);
-       ptr = ptr->next, len++) {
-    keys[len] = ptr->key;
-    values[len] = ptr->value;
+  for (size_t i = 0; i < STATIC_ARRAY_SIZE(totals->qtype); i++) {
+    if (totals->qtype[i] == 0)
+      continue;
+    DEBUG("dns plugin: qtype = %zu; counter = %" PRIi64 ";", i,
+          totals->qtype[i]);
+    submit_derive("dns_qtype", qtype_str((int)i), totals->qtype[i]);
   }
-  pthread_mutex_unlock(&qtype_mutex);
 
-  for (int i = 0; i < len; i++) {
-    DEBUG("dns plugin: qtype = %u; counter = %u;", keys[i], values[i]);
-    submit_derive("dns_qtype", qtype_str(keys[i]), values[i]);
+  for (size_t i = 0; i < STATIC_ARRAY_SIZE(totals->opcode); i++) {
+    if (totals->opcode[i] == 0)
+      continue;
+    DEBUG("dns plugin: opcode = %zu; counter = %" PRIi64 ";", i,
+          totals->opcode[i]);
+    submit_derive("dns_opcode", opcode_str((int)i), totals->opcode[i]);
   }
 
-  pthread_mutex_lock(&opcode_mutex);
-  for (ptr = opcode_list, len = 0; (ptr != NULL) && (len < T_MAX);
-       ptr = ptr->next, len++) {
-    keys[len] = ptr->key;
-    values[len] = ptr->value;
+  for (size_t i = 0; i < STATIC_ARRAY_SIZE(totals->rcode); i++) {
+    if (totals->rcode[i] == 0)
+      continue;
+    DEBUG("dns plugin: rcode = %zu; counter = %" PRIi64 ";", i,
+          totals->rcode[i]);
+    submit_derive("dns_rcode", rcode_str((int)i), totals->rcode[i]);
   }
-  pthread_mutex_unlock(&opcode_mutex);
 
-  for (int i = 0; i < len; i++) {
-    DEBUG("dns plugin: opcode = %u; counter = %u;", keys[i], values[i]);
-    submit_derive("dns_opcode", opcode_str(keys[i]), values[i]);
-  }
+#if DNS_HAVE_RING
+  if (use_ring && (pcap_file == NULL)) {
+    derive_t drops = 0;
+
+    /* Reading the statistics resets them in the kernel. */
+    for (size_t i = 0; i < captures_num; i++) {
+      dns_capture_t *c = captures + i;
+      struct tpacket_stats_v3 stats = {0};
+      socklen_t len = sizeof(stats);
+
+      if ((c->fd >= 0) &&
+          (getsockopt(c->fd, SOL_PACKET, PACKET_STATISTICS, &stats, &len) ==
+           0))
+        c->drops += (derive_t)stats.tp_drops;
+      drops += c->drops;
+    }
 
-  pthread_mutex_lock(&rcode_mutex);
-  for (ptr = rcode_list, len = 0; (ptr != NULL) && (len < T_MAX);
-       ptr = ptr->next, len++) {
-    keys[len] = ptr->key;
-    values[len] = ptr->value;
+    submit_derive("if_rx_dropped", "", drops);
   }
-  pthread_mutex_unlock(&rcode_mutex);
+#endif
+
+  return 0;
+} /* int dns_read */
+
+static int dns_shutdown(void) {
+#if DNS_HAVE_RING
+  if (!use_ring || (pcap_file != NULL) || (captures == NULL))
+    return 0;
 
-  for (int i = 0; i < len; i++) {
-    DEBUG("dns plugin: rcode = %u; counter = %u;", keys[i], values[i]);
-    submit_derive("dns_rcode", rcode_str(keys[i]), values[i]);
+  capture_shutdown = 1;
+  for (size_t i = 0; i < captures_num; i++) {
+    dns_capture_t *c = captures + i;
+
+    if (c->thread_started)
+      pthread_join(c->thread, NULL);
+    c->thread_started = 0;
+    dns_ring_close(c);
+    pthread_mutex_destroy(&c->lock);
   }
 
+  sfree(captures);
+  captures_num = 0;
+  sfree(totals);
+#endif
+
   return 0;
-} /* int dns_read */
+} /* int dns_shutdown */
 
 void module_register(void) {
   plugin_register_config("dns", dns_config, config_keys, config_keys_num);
   plugin_register_init("dns", dns_init);
   plugin_register_read("dns", dns_read);
+  plugin_register_shutdown("dns", dns_shutdown);
 } /* void module_register */
@@ -25,6 +25,7 @@
 
 #define _DEFAULT_SOURCE
 #define _BSD_SOURCE /* For setgroups */
+#define _GNU_SOURCE /* For posix_spawn_file_actions_addclosefrom_np */
 
 #include "collectd.h"
 
@@ -33,21 +34,37 @@
 
 #include "utils_cmd_putnotif.h"
 #include "utils_cmd_putval.h"
+#include "utils_complain.h"
 
 #include <grp.h>
+#include <poll.h>
 #include <pwd.h>
 #include <signal.h>
 #include <sys/types.h>
 
+#if defined(HAVE_POSIX_SPAWN) &&                                               \
+    defined(HAVE_POSIX_SPAWN_FILE_ACTIONS_ADDCLOSEFROM_NP)
+#define EXEC_HAVE_SPAWN 1
+#include <spawn.h>
+extern char **environ;
+#else
+#define EXEC_HAVE_SPAWN 0
+#endif
+
 #ifdef HAVE_SYS_CAPABILITY_H
 #include <sys/capability.h>
 #endif
 
 #define PL_NORMAL 0x01
 #define PL_NOTIF_ACTION 0x02
+#define PL_PERSISTENT 0x04
 
 #define PL_RUNNING 0x10
 
+/* Upper limit of notifications queued for a persistent notification program,
+ * in bytes of PUTNOTIF lines. */
+#define EXEC_COPROC_BUFFER_MAX (1024 * 1024)
+
 /*
  * Private data types
  */
@@ -58,9 +75,35 @@
  * The `pid' and `status' fields are thus unused if the `PL_NOTIF_ACTION' flag
  * is set.
  * The `PL_RUNNING' flag is set in `exec_read' and unset in `exec_read_one'.
+ * Programs with the `PL_PERSISTENT' flag are the exception: their `pid' is
+ * owned by the thread writing to them, see `exec_coproc_t'.
  */
 struct program_list_s;
 typedef struct program_list_s program_list_t;
+
+/*
+ * A persistent notification program (`PersistentNotificationExec') is started
+ * once and receives all notifications as PUTNOTIF lines on its STDIN.
+ * `exec_notification' appends the lines to `buffer'; a thread of its own swaps
+ * the buffer with its private one and writes all lines queued so far in one
+ * go, (re)starting the program when necessary. `fd' and the `pid' of the
+ * program are only used by that thread.
+ */
+typedef struct {
+  pthread_mutex_t lock;
+  pthread_cond_t cond;
+  char *buffer;
+  size_t buffer_len;
+  size_t buffer_size;
+  _Bool stop;
+  uint64_t dropped;
+  c_complain_t complaint;
+
+  pthread_t thread;
+  _Bool thread_running;
+  int fd; /* STDIN of the program or -1 */
+} exec_coproc_t;
+
 struct program_list_s {
   char *user;
   char *group;
@@ -69,6 +112,7 @@ struct program_list_s {
   int pid;
   int status;
   int flags;
+  exec_coproc_t *coproc;
   program_list_t *next;
 };
 
@@ -132,6 +176,8 @@ static int exec_config_exec(oconfig_item_t *ci) /* {{{ */
 
   if (strcasecmp("NotificationExec", ci->key) == 0)
     pl->flags |= PL_NOTIF_ACTION;
+  else if (strcasecmp("PersistentNotificationExec", ci->key) == 0)
+    pl->flags |= PL_NOTIF_ACTION | PL_PERSISTENT;
   else
     pl->flags |= PL_NORMAL;
 
@@ -220,6 +266,24 @@ static int exec_config_exec(oconfig_item_t *ci) /* {{{ */
     DEBUG("exec plugin: argv[%i] = %s", i, pl->argv[i]);
   }
 
+  if (pl->flags & PL_PERSISTENT) {
+    pl->coproc = calloc(1, sizeof(*pl->coproc));
+    if (pl->coproc == NULL) {
+      ERROR("exec plugin: calloc failed.");
+      for (i = 0; pl->argv[i] != NULL; i++)
+        sfree(pl->argv[i]);
+      sfree(pl->argv);
+      sfree(pl->exec);
+      sfree(pl->user);
+      sfree(pl);
+      return -1;
+    }
+    pthread_mutex_init(&pl->coproc->lock, /* attr = */ NULL);
+    pthread_cond_init(&pl->coproc->cond, /* attr = */ NULL);
+    C_COMPLAIN_INIT(&pl->coproc->complaint);
+    pl->coproc->fd = -1;
+  }
+
   pl->next = pl_head;
   pl_head = pl;
 
@@ -231,7 +295,8 @@ static int exec_config(oconfig_item_t *ci) /* {{{ */
   for (int i = 0; i < ci->children_num; i++) {
     oconfig_item_t *child = ci->children + i;
     if ((strcasecmp("Exec", child->key) == 0) ||
-        (strcasecmp("NotificationExec", child->key) == 0))
+        (strcasecmp("NotificationExec", child->key) == 0) ||
+        (strcasecmp("PersistentNotificationExec", child->key) == 0))
       exec_config_exec(child);
     else {
       WARNING("exec plugin: Unknown config option `%s'.", child->key);
@@ -347,11 +412,88 @@ static void close_pipe(int fd_pipe[2]) /* {{{ */
     close(fd_pipe[1]);
 } /* }}} void close_pipe */
 
+#if EXEC_HAVE_SPAWN
+/*
+ * Starts the program with posix_spawn(3), which does not copy the daemon's
+ * address space like fork(2) does. The child gets the same file descriptors,
+ * environment and signal mask that `fork_child' sets up for a forked child.
+ * It cannot change credentials, so this is only used if the program runs as
+ * the user and group collectd runs as.
+ */
+static int spawn_child(program_list_t *pl, int fd_in, int fd_out,
+                       int fd_err) /* {{{ */
+{
+  posix_spawn_file_actions_t actions;
+  posix_spawnattr_t attr;
+  sigset_t ss;
+  char interval[64];
+  char hostname[DATA_MAX_NAME_LEN + 32];
+  char **envp;
+  size_t envp_num = 0;
+  pid_t pid;
+  int status;
+
+  ssnprintf(interval, sizeof(interval), "COLLECTD_INTERVAL=%.3f",
+            CDTIME_T_TO_DOUBLE(plugin_get_interval()));
+  ssnprintf(hostname, sizeof(hostname), "COLLECTD_HOSTNAME=%s", hostname_g);
+
+  for (char **e = environ; *e != NULL; e++)
+    envp_num++;
+
+  envp = calloc(envp_num + 3, sizeof(*envp));
+  if (envp == NULL) {
+    ERROR("exec plugin: calloc failed.");
+    return -1;
+  }
+
+  envp_num = 0;
+  for (char **e = environ; *e != NULL; e++) {
+    if ((strncmp("COLLECTD_INTERVAL=", *e, strlen("COLLECTD_INTERVAL=")) ==
+         0) ||
+        (strncmp("COLLECTD_HOSTNAME=", *e, strlen("COLLECTD_HOSTNAME=")) == 0))
+      continue;
+    envp[envp_num++] = *e;
+  }
+  envp[envp_num++] = interval;
+  envp[envp_num++] = hostname;
+  envp[envp_num] = NULL;
+
+  posix_spawn_file_actions_init(&actions);
+  posix_spawn_file_actions_adddup2(&actions, fd_in, STDIN_FILENO);
+  posix_spawn_file_actions_adddup2(&actions, fd_out, STDOUT_FILENO);
+  posix_spawn_file_actions_adddup2(&actions, fd_err, STDERR_FILENO);
+  /* Close all other file descriptors, including the pipe ends above. */
+  posix_spawn_file_actions_addclosefrom_np(&actions, STDERR_FILENO + 1);
+
+  /* Unblock all signals */
+  posix_spawnattr_init(&attr);
+  sigemptyset(&ss);
+  posix_spawnattr_setsigmask(&attr, &ss);
+  posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETSIGMASK);
+
+  status = posix_spawnp(&pid, pl->exec, &actions, &attr, pl->argv, envp);
+
+  posix_spawnattr_destroy(&attr);
+  posix_spawn_file_actions_destroy(&actions);
+  sfree(envp);
+
+  if (status != 0) {
+    char errbuf[1024];
+    ERROR("exec plugin: Failed to execute ``%s'': %s", pl->exec,
+          sstrerror(status, errbuf, sizeof(errbuf)));
+    return -1;
+  }
+
+  return (int)pid;
+} /* }}} int spawn_child */
+#endif /* EXEC_HAVE_SPAWN */
+
 /*
  * Creates three pipes (one for reading, one for writing and one for errors),
  * forks a child, sets up the pipes so that fd_in is connected to STDIN of
  * the child and fd_out is connected to STDOUT and fd_err is connected to STDERR
- * of the child. Then is calls `exec_child'.
+ * of the child. Then is calls `exec_child'. If the program runs with the
+ * credentials of the daemon, it is started by `spawn_child' instead.
  */
 static int fork_child(program_list_t *pl, int *fd_in, int *fd_out,
                       int *fd_err) /* {{{ */
@@ -424,7 +566,17 @@ static int fork_child(program_list_t *pl, int *fd_in, int *fd_out,
     }
   } /* if (pl->group == NULL) */
 
-  pid = fork();
+#if EXEC_HAVE_SPAWN
+  if ((uid == (int)getuid()) && (uid == (int)geteuid()) &&
+      (gid == (int)getgid()) && (gid == (int)getegid()) &&
+      ((egid == -1) || (egid == gid))) {
+    pid = spawn_child(pl, fd_pipe_in[0], fd_pipe_out[1], fd_pipe_err[1]);
+    if (pid < 0)
+      goto failed;
+  } else
+#endif
+    pid = fork();
+
   if (pid < 0) {
     ERROR("exec plugin: fork failed: %s",
           sstrerror(errno, errbuf, sizeof(errbuf)));
@@ -497,10 +649,10 @@ failed:
   return -1;
 } /* int fork_child }}} */
 
-static int parse_line(char *buffer) /* {{{ */
+static int parse_line(cmd_putval_parser_t *putval, char *buffer) /* {{{ */
 {
   if (strncasecmp("PUTVAL", buffer, strlen("PUTVAL")) == 0)
-    return cmd_handle_putval(stdout, buffer);
+    return cmd_putval_parser_handle(putval, stdout, buffer);
   else if (strncasecmp("PUTNOTIF", buffer, strlen("PUTNOTIF")) == 0)
     return handle_putnotif(stdout, buffer);
   else {
@@ -516,10 +668,21 @@ static void *exec_read_one(void *arg) /* {{{ */
   int fd, fd_err, highest_fd;
   fd_set fdset, copy;
   int status;
-  char buffer[1200]; /* if not completely read */
+  /* Large enough to pick up many lines with one read(2). */
+  char buffer[8192]; /* if not completely read */
   char buffer_err[1024];
   char *pbuffer = buffer;
   char *pbuffer_err = buffer_err;
+  cmd_putval_parser_t *putval;
+
+  putval = cmd_putval_parser_create(/* opts = */ NULL);
+  if (putval == NULL) {
+    ERROR("exec plugin: cmd_putval_parser_create failed.");
+    pthread_mutex_lock(&pl_lock);
+    pl->flags &= ~PL_RUNNING;
+    pthread_mutex_unlock(&pl_lock);
+    pthread_exit((void *)1);
+  }
 
   status = fork_child(pl, NULL, &fd, &fd_err);
   if (status < 0) {
@@ -527,6 +690,7 @@ static void *exec_read_one(void *arg) /* {{{ */
     pthread_mutex_lock(&pl_lock);
     pl->flags &= ~PL_RUNNING;
     pthread_mutex_unlock(&pl_lock);
+    cmd_putval_parser_destroy(putval);
     pthread_exit((void *)1);
   }
   pl->pid = status;
@@ -575,7 +739,7 @@ static void *exec_read_one(void *arg) /* {{{ */
         if (*(pnl - 1) == '\r')
           *(pnl - 1) = '\0';
 
-        parse_line(pbuffer);
+        parse_line(putval, pbuffer);
 
         pbuffer = ++pnl;
       }
@@ -654,6 +818,7 @@ static void *exec_read_one(void *arg) /* {{{ */
   if (fd_err >= 0)
     close(fd_err);
 
+  cmd_putval_parser_destroy(putval);
   pthread_exit((void *)0);
   return NULL;
 } /* void *exec_read_one }}} */
@@ -740,6 +905,159 @@ static void *exec_notification_one(void *arg) /* {{{ */
   return NULL;
 } /* void *exec_notification_one }}} */
 
+/* Returns true if the program reading from "fd" has gone away. */
+static _Bool exec_coproc_gone(int fd) /* {{{ */
+{
+  struct pollfd pfd = {.fd = fd, .events = POLLOUT};
+
+  if (poll(&pfd, 1, /* timeout = */ 0) <= 0)
+    return 0;
+
+  return (pfd.revents & (POLLERR | POLLHUP | POLLNVAL)) != 0;
+} /* }}} _Bool exec_coproc_gone */
+
+static void exec_coproc_close(program_list_t *pl) /* {{{ */
+{
+  exec_coproc_t *cp = pl->coproc;
+
+  if (cp->fd >= 0)
+    close(cp->fd);
+  cp->fd = -1;
+
+  /* The child is reaped by `sigchld_handler' once it exits. */
+  pl->pid = 0;
+} /* }}} void exec_coproc_close */
+
+/* Writes a batch of PUTNOTIF lines to the program, starting it first if it is
+ * not running. If the program went away, it is restarted once. */
+static int exec_coproc_write(program_list_t *pl, const char *data,
+                             size_t data_len) /* {{{ */
+{
+  exec_coproc_t *cp = pl->coproc;
+  char errbuf[1024];
+
+  for (int attempt = 0; attempt < 2; attempt++) {
+    if ((cp->fd >= 0) && exec_coproc_gone(cp->fd)) {
+      WARNING("exec plugin: Persistent notification program `%s' (pid %i) "
+              "went away; restarting it.",
+              pl->exec, pl->pid);
+      exec_coproc_close(pl);
+    }
+
+    if (cp->fd < 0) {
+      int fd;
+      int pid = fork_child(pl, &fd, NULL, NULL);
+      if (pid < 0)
+        return -1;
+
+      pl->pid = pid;
+      cp->fd = fd;
+      DEBUG("exec plugin: Started persistent notification program `%s' "
+            "(pid %i).",
+            pl->exec, pid);
+    }
+
+    if (swrite(cp->fd, data, data_len) == 0)
+      return 0;
+
+    WARNING("exec plugin: Writing to persistent notification program `%s' "
+            "failed: %s",
+            pl->exec, sstrerror(errno, errbuf, sizeof(errbuf)));
+    exec_coproc_close(pl);
+  }
+
+  return -1;
+} /* }}} int exec_coproc_write */
+
+static void *exec_coproc_thread(void *arg) /* {{{ */
+{
+  program_list_t *pl = arg;
+  exec_coproc_t *cp = pl->coproc;
+  char *batch = NULL;
+  size_t batch_size = 0;
+
+  pthread_mutex_lock(&cp->lock);
+  while (42) {
+    char *tmp;
+    size_t tmp_size;
+    size_t batch_len;
+
+    while (!cp->stop && (cp->buffer_len == 0))
+      pthread_cond_wait(&cp->cond, &cp->lock);
+
+    /* Everything queued before shutdown has been written. */
+    if (cp->buffer_len == 0)
+      break;
+
+    /* Swap the buffers, so that notifications can be queued while the batch
+     * is being written. */
+    tmp = cp->buffer;
+    tmp_size = cp->buffer_size;
+    batch_len = cp->buffer_len;
+
+    cp->buffer = batch;
+    cp->buffer_size = batch_size;
+    cp->buffer_len = 0;
+
+    batch = tmp;
+    batch_size = tmp_size;
+    pthread_mutex_unlock(&cp->lock);
+
+    if (exec_coproc_write(pl, batch, batch_len) != 0)
+      ERROR("exec plugin: Dropping %zu bytes of notifications for `%s'.",
+            batch_len, pl->exec);
+
+    pthread_mutex_lock(&cp->lock);
+  }
+  pthread_mutex_unlock(&cp->lock);
+
+  sfree(batch);
+  return NULL;
+} /* }}} void *exec_coproc_thread */
+
+/* Queues a PUTNOTIF line for the persistent notification program. */
+static int exec_coproc_enqueue(program_list_t *pl, const char *line,
+                               size_t line_len) /* {{{ */
+{
+  exec_coproc_t *cp = pl->coproc;
+
+  pthread_mutex_lock(&cp->lock);
+
+  if ((cp->buffer_len + line_len) > EXEC_COPROC_BUFFER_MAX) {
+    cp->dropped++;
+    c_complain(LOG_WARNING, &cp->complaint,
+               "exec plugin: Persistent notification program `%s' does not "
+               "keep up; %" PRIu64 " notifications dropped so far.",
+               pl->exec, cp->dropped);
+    pthread_mutex_unlock(&cp->lock);
+    return ENOBUFS;
+  }
+
+  if ((cp->buffer_len + line_len) > cp->buffer_size) {
+    size_t new_size = (cp->buffer_size > 0) ? (2 * cp->buffer_size) : 4096;
+    char *tmp;
+
+    while (new_size < (cp->buffer_len + line_len))
+      new_size *= 2;
+
+    tmp = realloc(cp->buffer, new_size);
+    if (tmp == NULL) {
+      pthread_mutex_unlock(&cp->lock);
+      ERROR("exec plugin: realloc failed.");
+      return ENOMEM;
+    }
+    cp->buffer = tmp;
+    cp->buffer_size = new_size;
+  }
+
+  memcpy(cp->buffer + cp->buffer_len, line, line_len);
+  cp->buffer_len += line_len;
+
+  pthread_cond_signal(&cp->cond);
+  pthread_mutex_unlock(&cp->lock);
+  return 0;
+} /* }}} int exec_coproc_enqueue */
+
 static int exec_init(void) /* {{{ */
 {
   struct sigaction sa = {.sa_handler = sigchld_handler};
@@ -763,6 +1081,22 @@ static int exec_init(void) /* {{{ */
   }
 #endif
 
+  for (program_list_t *pl = pl_head; pl != NULL; pl = pl->next) {
+    int status;
+
+    if ((pl->flags & PL_PERSISTENT) == 0)
+      continue;
+
+    /* The program is started with the first notification. */
+    status = plugin_thread_create(&pl->coproc->thread, /* attr = */ NULL,
+                                  exec_coproc_thread, pl, "exec notif");
+    if (status != 0) {
+      ERROR("exec plugin: Starting a thread for `%s' failed.", pl->exec);
+      continue;
+    }
+    pl->coproc->thread_running = 1;
+  }
+
   return 0;
 } /* int exec_init }}} */
 
@@ -797,6 +1131,8 @@ static int exec_read(void) /* {{{ */
 static int exec_notification(const notification_t *n, /* {{{ */
                              user_data_t __attribute__((unused)) * user_data) {
   program_list_and_notification_t *pln;
+  char line[8192];
+  size_t line_len = 0;
 
   for (program_list_t *pl = pl_head; pl != NULL; pl = pl->next) {
     pthread_t t;
@@ -806,6 +1142,24 @@ static int exec_notification(const notification_t *n, /* {{{ */
     if ((pl->flags & PL_NOTIF_ACTION) == 0)
       continue;
 
+    if (pl->flags & PL_PERSISTENT) {
+      /* Format the notification only once for all persistent programs. */
+      if (line_len == 0) {
+        int status = cmd_create_putnotif(line, sizeof(line) - 1, n);
+        if (status != 0) {
+          ERROR("exec plugin: cmd_create_putnotif failed with status %i.",
+                status);
+          continue;
+        }
+        line_len = strlen(line);
+        line[line_len++] = '\n';
+        line[line_len] = 0;
+      }
+
+      exec_coproc_enqueue(pl, line, line_len);
+      continue;
+    }
+
     /* Skip if a child is already running. */
     if (pl->pid != 0)
       continue;
@@ -839,10 +1193,51 @@ static int exec_shutdown(void) /* {{{ */
   program_list_t *pl;
   program_list_t *next;
 
+  /* Let the persistent notification programs read the remaining notifications
+   * and exit once their STDIN is closed. */
+  for (pl = pl_head; pl != NULL; pl = pl->next) {
+    exec_coproc_t *cp = pl->coproc;
+    pid_t pid;
+
+    if ((cp == NULL) || !cp->thread_running)
+      continue;
+
+    pthread_mutex_lock(&cp->lock);
+    cp->stop = 1;
+    pthread_cond_signal(&cp->cond);
+    pthread_mutex_unlock(&cp->lock);
+
+    pthread_join(cp->thread, /* retval = */ NULL);
+    cp->thread_running = 0;
+
+    if (cp->fd < 0)
+      continue;
+
+    pid = (pid_t)pl->pid;
+    close(cp->fd);
+    cp->fd = -1;
+
+    /* waitpid fails with ECHILD if `sigchld_handler' reaped the child. */
+    for (int i = 0; i < 100; i++) {
+      if (waitpid(pid, &pl->status, WNOHANG) != 0) {
+        pl->pid = 0;
+        break;
+      }
+      usleep(10000);
+    }
+  }
+
   pl = pl_head;
   while (pl != NULL) {
     next = pl->next;
 
+    if (pl->coproc != NULL) {
+      pthread_mutex_destroy(&pl->coproc->lock);
+      pthread_cond_destroy(&pl->coproc->cond);
+      sfree(pl->coproc->buffer);
+      sfree(pl->coproc);
+    }
+
     if (pl->pid > 0) {
       kill(pl->pid, SIGTERM);
       INFO("exec plugin: Sent SIGTERM to %hu", (unsigned short int)pl->pid);
@@ -49,8 +49,11 @@ extern "C" {
 
 using collectd::Collectd;
 
+using collectd::HistoryPoint;
 using collectd::PutValuesRequest;
 using collectd::PutValuesResponse;
+using collectd::QueryHistoryRequest;
+using collectd::QueryHistoryResponse;
 using collectd::QueryValuesRequest;
 using collectd::QueryValuesResponse;
 
@@ -306,6 +309,59 @@ public:
     return grpc::Status::OK;
   }
 
+  grpc::Status QueryHistory(grpc::ServerContext *ctx,
+                            QueryHistoryRequest const *req,
+                            QueryHistoryResponse *res) override {
+    value_list_t vl = {0};
+    auto status = unmarshal_ident(req->identifier(), &vl, true);
+    if (!status.ok())
+      return status;
+
+    cdtime_t resolution = 0;
+    if (uc_get_history_tier_info(req->tier(), &resolution, NULL) != 0)
+      return grpc::Status(grpc::StatusCode::INVALID_ARGUMENT,
+                          grpc::string("no such tier"));
+
+    auto ds = plugin_get_ds(vl.type);
+    if (ds == NULL)
+      return grpc::Status(grpc::StatusCode::NOT_FOUND,
+                          grpc::string("unknown type"));
+
+    cdtime_t *times = NULL;
+    gauge_t *values = NULL;
+    size_t points_num = 0;
+    int err = uc_get_history_tier(ds, &vl, req->tier(), &times, &values,
+                                  &points_num);
+    if (err == -ENOENT)
+      return grpc::Status(grpc::StatusCode::NOT_FOUND,
+                          grpc::string("no history found"));
+    else if (err != 0)
+      return grpc::Status(grpc::StatusCode::INTERNAL,
+                          grpc::string("failed to retrieve history"));
+
+    auto d = TimeUtil::NanosecondsToDuration(CDTIME_T_TO_NS(resolution));
+    res->set_allocated_resolution(new google::protobuf::Duration(d));
+    for (size_t i = 0; i < ds->ds_num; i++)
+      res->add_ds_names(ds->ds[i].name);
+
+    for (size_t i = 0; i < points_num; i++) {
+      HistoryPoint *p = res->add_points();
+      auto t = TimeUtil::NanosecondsToTimestamp(CDTIME_T_TO_NS(times[i]));
+      p->set_allocated_time(new google::protobuf::Timestamp(t));
+
+      for (size_t j = 0; j < ds->ds_num; j++) {
+        gauge_t *v = values + 3 * (i * ds->ds_num + j);
+        p->add_min(v[0]);
+        p->add_avg(v[1]);
+        p->add_max(v[2]);
+      }
+    }
+
+    sfree(times);
+    sfree(values);
+    return grpc::Status::OK;
+  }
+
 private:
   grpc::Status queryValuesRead(value_list_t const *match,
                                std::queue<value_list_t> *value_lists) {
@@ -26,6 +26,7 @@
 #include "common.h"
 #include "filter_chain.h"
 #include "plugin.h"
+#include "utils_avltree.h"
 
 #include <jni.h>
 
@@ -63,6 +64,7 @@ typedef struct java_plugin_class_s java_plugin_class_t;
 #define CB_TYPE_NOTIFICATION 8
 #define CB_TYPE_MATCH 9
 #define CB_TYPE_TARGET 10
+#define CB_TYPE_WRITE_BATCH 11
 struct cjni_callback_info_s /* {{{ */
 {
   char *name;
@@ -70,10 +72,77 @@ struct cjni_callback_info_s /* {{{ */
   jclass class;
   jobject object;
   jmethodID method;
+
+  /* DataSet objects passed to this callback, see `ctoj_data_set_cached'.
+   * Protected by `datasets_lock'. */
+  c_avl_tree_t *datasets;
 };
 typedef struct cjni_callback_info_s cjni_callback_info_t;
 /* }}} */
 
+/* State of a CB_TYPE_WRITE_BATCH callback. Value lists are converted to Java
+ * objects when they are written and kept as global references until the
+ * batch is handed to Java as one `ValueList[]'. */
+struct cjni_batch_writer_s /* {{{ */
+{
+  cjni_callback_info_t *cbi;
+
+  pthread_mutex_t lock;
+  jobject *values;
+  size_t values_num;
+  size_t values_max;
+  cdtime_t first_time;
+};
+typedef struct cjni_batch_writer_s cjni_batch_writer_t;
+/* }}} */
+
+/* Global references to the API classes and the IDs of all methods used by the
+ * conversion functions. Looking these up is expensive, so this is done once
+ * in `cjni_init_native'. */
+struct cjni_api_cache_s /* {{{ */
+{
+  jclass c_long;
+  jmethodID m_long_init;
+  jclass c_double;
+  jmethodID m_double_init;
+
+  jclass c_datasource;
+  jmethodID m_datasource_init;
+  jmethodID m_datasource_set_name;
+  jmethodID m_datasource_set_type;
+  jmethodID m_datasource_set_min;
+  jmethodID m_datasource_set_max;
+
+  jclass c_dataset;
+  jmethodID m_dataset_init;
+  jmethodID m_dataset_add;
+
+  jclass c_valuelist;
+  jmethodID m_valuelist_init;
+  jmethodID m_valuelist_set_dataset;
+  jmethodID m_valuelist_set_host;
+  jmethodID m_valuelist_set_plugin;
+  jmethodID m_valuelist_set_plugin_instance;
+  jmethodID m_valuelist_set_type;
+  jmethodID m_valuelist_set_type_instance;
+  jmethodID m_valuelist_set_time;
+  jmethodID m_valuelist_set_interval;
+  jmethodID m_valuelist_add_value;
+
+  jclass c_notification;
+  jmethodID m_notification_init;
+  jmethodID m_notification_set_host;
+  jmethodID m_notification_set_plugin;
+  jmethodID m_notification_set_plugin_instance;
+  jmethodID m_notification_set_type;
+  jmethodID m_notification_set_type_instance;
+  jmethodID m_notification_set_message;
+  jmethodID m_notification_set_time;
+  jmethodID m_notification_set_severity;
+};
+typedef struct cjni_api_cache_s cjni_api_cache_t;
+/* }}} */
+
 /*
  * Global variables
  */
@@ -95,6 +164,16 @@ static pthread_mutex_t java_callbacks_lock = PTHREAD_MUTEX_INITIALIZER;
 
 static oconfig_item_t *config_block = NULL;
 
+static cjni_api_cache_t api_cache;
+
+/* Protects the `datasets' trees of all callbacks. */
+static pthread_mutex_t datasets_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* List of batch write callbacks; protected by `java_callbacks_lock'. */
+static cjni_batch_writer_t **batch_writers = NULL;
+static size_t batch_writers_num = 0;
+static size_t write_batch_size = 64;
+
 /*
  * Prototypes
  *
@@ -111,6 +190,12 @@ static int cjni_callback_register(JNIEnv *jvm_env, jobject o_name,
 static int cjni_read(user_data_t *user_data);
 static int cjni_write(const data_set_t *ds, const value_list_t *vl,
                       user_data_t *ud);
+static int cjni_write_batch(const data_set_t *ds, const value_list_t *vl,
+                            user_data_t *ud);
+static int cjni_flush_batch(cdtime_t timeout, const char *identifier,
+                            user_data_t *ud);
+static int cjni_read_batch(user_data_t *ud);
+static void cjni_batch_writer_destroy(void *arg);
 static int cjni_flush(cdtime_t timeout, const char *identifier,
                       user_data_t *ud);
 static void cjni_log(int severity, const char *message, user_data_t *ud);
@@ -128,9 +213,8 @@ static int cjni_match_target_invoke(const data_set_t *ds, value_list_t *vl,
  * C to Java conversion functions
  */
 static int ctoj_string(JNIEnv *jvm_env, /* {{{ */
-                       const char *string, jclass class_ptr, jobject object_ptr,
-                       const char *method_name) {
-  jmethodID m_set;
+                       const char *string, jobject object_ptr,
+                       jmethodID m_set) {
   jstring o_string;
 
   /* Create a java.lang.String */
@@ -140,17 +224,7 @@ static int ctoj_string(JNIEnv *jvm_env, /* {{{ */
     return -1;
   }
 
-  /* Search for the `void setFoo (String s)' method. */
-  m_set = (*jvm_env)->GetMethodID(jvm_env, class_ptr, method_name,
-                                  "(Ljava/lang/String;)V");
-  if (m_set == NULL) {
-    ERROR("java plugin: ctoj_string: Cannot find method `void %s (String)'.",
-          method_name);
-    (*jvm_env)->DeleteLocalRef(jvm_env, o_string);
-    return -1;
-  }
-
-  /* Call the method. */
+  /* Call the `void setFoo (String s)' method. */
   (*jvm_env)->CallVoidMethod(jvm_env, object_ptr, m_set, o_string);
 
   /* Decrease reference counter on the java.lang.String object. */
@@ -173,108 +247,18 @@ static jstring ctoj_output_string(JNIEnv *jvm_env, /* {{{ */
   return o_string;
 } /* }}} int ctoj_output_string */
 
-static int ctoj_int(JNIEnv *jvm_env, /* {{{ */
-                    jint value, jclass class_ptr, jobject object_ptr,
-                    const char *method_name) {
-  jmethodID m_set;
-
-  /* Search for the `void setFoo (int i)' method. */
-  m_set = (*jvm_env)->GetMethodID(jvm_env, class_ptr, method_name, "(I)V");
-  if (m_set == NULL) {
-    ERROR("java plugin: ctoj_int: Cannot find method `void %s (int)'.",
-          method_name);
-    return -1;
-  }
-
-  (*jvm_env)->CallVoidMethod(jvm_env, object_ptr, m_set, value);
-
-  return 0;
-} /* }}} int ctoj_int */
-
-static int ctoj_long(JNIEnv *jvm_env, /* {{{ */
-                     jlong value, jclass class_ptr, jobject object_ptr,
-                     const char *method_name) {
-  jmethodID m_set;
-
-  /* Search for the `void setFoo (long l)' method. */
-  m_set = (*jvm_env)->GetMethodID(jvm_env, class_ptr, method_name, "(J)V");
-  if (m_set == NULL) {
-    ERROR("java plugin: ctoj_long: Cannot find method `void %s (long)'.",
-          method_name);
-    return -1;
-  }
-
-  (*jvm_env)->CallVoidMethod(jvm_env, object_ptr, m_set, value);
-
-  return 0;
-} /* }}} int ctoj_long */
-
-static int ctoj_double(JNIEnv *jvm_env, /* {{{ */
-                       jdouble value, jclass class_ptr, jobject object_ptr,
-                       const char *method_name) {
-  jmethodID m_set;
-
-  /* Search for the `void setFoo (double d)' method. */
-  m_set = (*jvm_env)->GetMethodID(jvm_env, class_ptr, method_name, "(D)V");
-  if (m_set == NULL) {
-    ERROR("java plugin: ctoj_double: Cannot find method `void %s (double)'.",
-          method_name);
-    return -1;
-  }
-
-  (*jvm_env)->CallVoidMethod(jvm_env, object_ptr, m_set, value);
-
-  return 0;
-} /* }}} int ctoj_double */
-
 /* Convert a jlong to a java.lang.Number */
 static jobject ctoj_jlong_to_number(JNIEnv *jvm_env, jlong value) /* {{{ */
 {
-  jclass c_long;
-  jmethodID m_long_constructor;
-
-  /* Look up the java.lang.Long class */
-  c_long = (*jvm_env)->FindClass(jvm_env, "java/lang/Long");
-  if (c_long == NULL) {
-    ERROR("java plugin: ctoj_jlong_to_number: Looking up the "
-          "java.lang.Long class failed.");
-    return NULL;
-  }
-
-  m_long_constructor =
-      (*jvm_env)->GetMethodID(jvm_env, c_long, "<init>", "(J)V");
-  if (m_long_constructor == NULL) {
-    ERROR("java plugin: ctoj_jlong_to_number: Looking up the "
-          "`Long (long)' constructor failed.");
-    return NULL;
-  }
-
-  return (*jvm_env)->NewObject(jvm_env, c_long, m_long_constructor, value);
+  return (*jvm_env)->NewObject(jvm_env, api_cache.c_long,
+                               api_cache.m_long_init, value);
 } /* }}} jobject ctoj_jlong_to_number */
 
 /* Convert a jdouble to a java.lang.Number */
 static jobject ctoj_jdouble_to_number(JNIEnv *jvm_env, jdouble value) /* {{{ */
 {
-  jclass c_double;
-  jmethodID m_double_constructor;
-
-  /* Look up the java.lang.Long class */
-  c_double = (*jvm_env)->FindClass(jvm_env, "java/lang/Double");
-  if (c_double == NULL) {
-    ERROR("java plugin: ctoj_jdouble_to_number: Looking up the "
-          "java.lang.Double class failed.");
-    return NULL;
-  }
-
-  m_double_constructor =
-      (*jvm_env)->GetMethodID(jvm_env, c_double, "<init>", "(D)V");
-  if (m_double_constructor == NULL) {
-    ERROR("java plugin: ctoj_jdouble_to_number: Looking up the "
-          "`Double (double)' constructor failed.");
-    return NULL;
-  }
-
-  return (*jvm_env)->NewObject(jvm_env, c_double, m_double_constructor, value);
+  return (*jvm_env)->NewObject(jvm_env, api_cache.c_double,
+                               api_cache.m_double_init, value);
 } /* }}} jobject ctoj_jdouble_to_number */
 
 /* Convert a value_t to a java.lang.Number */
@@ -295,31 +279,12 @@ static jobject ctoj_value_to_number(JNIEnv *jvm_env, /* {{{ */
 /* Convert a data_source_t to a org/collectd/api/DataSource */
 static jobject ctoj_data_source(JNIEnv *jvm_env, /* {{{ */
                                 const data_source_t *dsrc) {
-  jclass c_datasource;
-  jmethodID m_datasource_constructor;
   jobject o_datasource;
   int status;
 
-  /* Look up the DataSource class */
-  c_datasource = (*jvm_env)->FindClass(jvm_env, "org/collectd/api/DataSource");
-  if (c_datasource == NULL) {
-    ERROR("java plugin: ctoj_data_source: "
-          "FindClass (org/collectd/api/DataSource) failed.");
-    return NULL;
-  }
-
-  /* Lookup the `ValueList ()' constructor. */
-  m_datasource_constructor =
-      (*jvm_env)->GetMethodID(jvm_env, c_datasource, "<init>", "()V");
-  if (m_datasource_constructor == NULL) {
-    ERROR("java plugin: ctoj_data_source: Cannot find the "
-          "`DataSource ()' constructor.");
-    return NULL;
-  }
-
   /* Create a new instance. */
-  o_datasource =
-      (*jvm_env)->NewObject(jvm_env, c_datasource, m_datasource_constructor);
+  o_datasource = (*jvm_env)->NewObject(jvm_env, api_cache.c_datasource,
+                                       api_cache.m_datasource_init);
   if (o_datasource == NULL) {
     ERROR("java plugin: ctoj_data_source: "
           "Creating a new DataSource instance failed.");
@@ -327,8 +292,8 @@ static jobject ctoj_data_source(JNIEnv *jvm_env, /* {{{ */
   }
 
   /* Set name via `void setName (String name)' */
-  status =
-      ctoj_string(jvm_env, dsrc->name, c_datasource, o_datasource, "setName");
+  status = ctoj_string(jvm_env, dsrc->name, o_datasource,
+                       api_cache.m_datasource_set_name);
   if (status != 0) {
     ERROR("java plugin: ctoj_data_source: "
           "ctoj_string (setName) failed.");
@@ -337,33 +302,18 @@ static jobject ctoj_data_source(JNIEnv *jvm_env, /* {{{ */
   }
 
   /* Set type via `void setType (int type)' */
-  status = ctoj_int(jvm_env, dsrc->type, c_datasource, o_datasource, "setType");
-  if (status != 0) {
-    ERROR("java plugin: ctoj_data_source: "
-          "ctoj_int (setType) failed.");
-    (*jvm_env)->DeleteLocalRef(jvm_env, o_datasource);
-    return NULL;
-  }
+  (*jvm_env)->CallVoidMethod(jvm_env, o_datasource,
+                             api_cache.m_datasource_set_type, (jint)dsrc->type);
 
   /* Set min via `void setMin (double min)' */
-  status =
-      ctoj_double(jvm_env, dsrc->min, c_datasource, o_datasource, "setMin");
-  if (status != 0) {
-    ERROR("java plugin: ctoj_data_source: "
-          "ctoj_double (setMin) failed.");
-    (*jvm_env)->DeleteLocalRef(jvm_env, o_datasource);
-    return NULL;
-  }
+  (*jvm_env)->CallVoidMethod(jvm_env, o_datasource,
+                             api_cache.m_datasource_set_min,
+                             (jdouble)dsrc->min);
 
   /* Set max via `void setMax (double max)' */
-  status =
-      ctoj_double(jvm_env, dsrc->max, c_datasource, o_datasource, "setMax");
-  if (status != 0) {
-    ERROR("java plugin: ctoj_data_source: "
-          "ctoj_double (setMax) failed.");
-    (*jvm_env)->DeleteLocalRef(jvm_env, o_datasource);
-    return NULL;
-  }
+  (*jvm_env)->CallVoidMethod(jvm_env, o_datasource,
+                             api_cache.m_datasource_set_max,
+                             (jdouble)dsrc->max);
 
   return o_datasource;
 } /* }}} jobject ctoj_data_source */
@@ -558,45 +508,17 @@ static jobject ctoj_oconfig_item(JNIEnv *jvm_env, /* {{{ */
 /* Convert a data_set_t to a org/collectd/api/DataSet */
 static jobject ctoj_data_set(JNIEnv *jvm_env, const data_set_t *ds) /* {{{ */
 {
-  jclass c_dataset;
-  jmethodID m_constructor;
-  jmethodID m_add;
   jobject o_type;
   jobject o_dataset;
 
-  /* Look up the org/collectd/api/DataSet class */
-  c_dataset = (*jvm_env)->FindClass(jvm_env, "org/collectd/api/DataSet");
-  if (c_dataset == NULL) {
-    ERROR("java plugin: ctoj_data_set: Looking up the "
-          "org/collectd/api/DataSet class failed.");
-    return NULL;
-  }
-
-  /* Search for the `DataSet (String type)' constructor. */
-  m_constructor = (*jvm_env)->GetMethodID(jvm_env, c_dataset, "<init>",
-                                          "(Ljava/lang/String;)V");
-  if (m_constructor == NULL) {
-    ERROR("java plugin: ctoj_data_set: Looking up the "
-          "`DataSet (String)' constructor failed.");
-    return NULL;
-  }
-
-  /* Search for the `void addDataSource (DataSource)' method. */
-  m_add = (*jvm_env)->GetMethodID(jvm_env, c_dataset, "addDataSource",
-                                  "(Lorg/collectd/api/DataSource;)V");
-  if (m_add == NULL) {
-    ERROR("java plugin: ctoj_data_set: Looking up the "
-          "`addDataSource (DataSource)' method failed.");
-    return NULL;
-  }
-
   o_type = (*jvm_env)->NewStringUTF(jvm_env, ds->type);
   if (o_type == NULL) {
     ERROR("java plugin: ctoj_data_set: Creating a String object failed.");
     return NULL;
   }
 
-  o_dataset = (*jvm_env)->NewObject(jvm_env, c_dataset, m_constructor, o_type);
+  o_dataset = (*jvm_env)->NewObject(jvm_env, api_cache.c_dataset,
+                                    api_cache.m_dataset_init, o_type);
   if (o_dataset == NULL) {
     ERROR("java plugin: ctoj_data_set: Creating a DataSet object failed.");
     (*jvm_env)->DeleteLocalRef(jvm_env, o_type);
@@ -617,7 +539,8 @@ static jobject ctoj_data_set(JNIEnv *jvm_env, const data_set_t *ds) /* {{{ */
       return NULL;
     }
 
-    (*jvm_env)->CallVoidMethod(jvm_env, o_dataset, m_add, o_datasource);
+    (*jvm_env)->CallVoidMethod(jvm_env, o_dataset, api_cache.m_dataset_add,
+                               o_datasource);
 
     (*jvm_env)->DeleteLocalRef(jvm_env, o_datasource);
   } /* for (i = 0; i < ds->ds_num; i++) */
@@ -625,20 +548,85 @@ static jobject ctoj_data_set(JNIEnv *jvm_env, const data_set_t *ds) /* {{{ */
   return o_dataset;
 } /* }}} jobject ctoj_data_set */
 
+/* Like `ctoj_data_set', but returns a (local reference to a) DataSet object
+ * shared by all calls of the callback `cbi' for the same type. The data sets
+ * are read from the types.db files during startup and never change
+ * afterwards, so the Java objects only have to be created once. Every
+ * callback gets its own objects, so that a plugin modifying them doesn't
+ * affect the others. */
+static jobject ctoj_data_set_cached(JNIEnv *jvm_env, /* {{{ */
+                                    cjni_callback_info_t *cbi,
+                                    const data_set_t *ds) {
+  jobject o_dataset = NULL;
+  jobject o_global;
+  char *key;
+
+  pthread_mutex_lock(&datasets_lock);
+
+  if (cbi->datasets == NULL) {
+    cbi->datasets = c_avl_create((int (*)(const void *, const void *))strcmp);
+    if (cbi->datasets == NULL) {
+      pthread_mutex_unlock(&datasets_lock);
+      ERROR("java plugin: ctoj_data_set_cached: c_avl_create failed.");
+      return NULL;
+    }
+  }
+
+  if (c_avl_get(cbi->datasets, ds->type, (void *)&o_global) == 0) {
+    o_dataset = (*jvm_env)->NewLocalRef(jvm_env, o_global);
+    pthread_mutex_unlock(&datasets_lock);
+    return o_dataset;
+  }
+
+  o_dataset = ctoj_data_set(jvm_env, ds);
+  if (o_dataset == NULL) {
+    pthread_mutex_unlock(&datasets_lock);
+    return NULL;
+  }
+
+  /* Failing to cache the object is not fatal: the caller still gets its
+   * (uncached) DataSet. */
+  key = strdup(ds->type);
+  o_global = (*jvm_env)->NewGlobalRef(jvm_env, o_dataset);
+  if ((key == NULL) || (o_global == NULL) ||
+      (c_avl_insert(cbi->datasets, key, o_global) != 0)) {
+    ERROR("java plugin: ctoj_data_set_cached: Caching the DataSet of type "
+          "\"%s\" failed.",
+          ds->type);
+    sfree(key);
+    if (o_global != NULL)
+      (*jvm_env)->DeleteGlobalRef(jvm_env, o_global);
+  }
+
+  pthread_mutex_unlock(&datasets_lock);
+  return o_dataset;
+} /* }}} jobject ctoj_data_set_cached */
+
+/* Release the DataSet objects of `cbi'. `jvm_env' is NULL if the JVM is
+ * gone, and with it the objects. */
+static void cjni_datasets_free(JNIEnv *jvm_env, /* {{{ */
+                               cjni_callback_info_t *cbi) {
+  char *key;
+  jobject o_dataset;
+
+  pthread_mutex_lock(&datasets_lock);
+  if (cbi->datasets != NULL) {
+    while (c_avl_pick(cbi->datasets, (void *)&key, (void *)&o_dataset) == 0) {
+      sfree(key);
+      if (jvm_env != NULL)
+        (*jvm_env)->DeleteGlobalRef(jvm_env, o_dataset);
+    }
+    c_avl_destroy(cbi->datasets);
+    cbi->datasets = NULL;
+  }
+  pthread_mutex_unlock(&datasets_lock);
+} /* }}} void cjni_datasets_free */
+
 static int ctoj_value_list_add_value(JNIEnv *jvm_env, /* {{{ */
                                      value_t value, int ds_type,
-                                     jclass class_ptr, jobject object_ptr) {
-  jmethodID m_addvalue;
+                                     jobject object_ptr) {
   jobject o_number;
 
-  m_addvalue = (*jvm_env)->GetMethodID(jvm_env, class_ptr, "addValue",
-                                       "(Ljava/lang/Number;)V");
-  if (m_addvalue == NULL) {
-    ERROR("java plugin: ctoj_value_list_add_value: "
-          "Cannot find method `void addValue (Number)'.");
-    return -1;
-  }
-
   o_number = ctoj_value_to_number(jvm_env, value, ds_type);
   if (o_number == NULL) {
     ERROR("java plugin: ctoj_value_list_add_value: "
@@ -646,7 +634,8 @@ static int ctoj_value_list_add_value(JNIEnv *jvm_env, /* {{{ */
     return -1;
   }
 
-  (*jvm_env)->CallVoidMethod(jvm_env, object_ptr, m_addvalue, o_number);
+  (*jvm_env)->CallVoidMethod(jvm_env, object_ptr,
+                             api_cache.m_valuelist_add_value, o_number);
 
   (*jvm_env)->DeleteLocalRef(jvm_env, o_number);
 
@@ -654,74 +643,48 @@ static int ctoj_value_list_add_value(JNIEnv *jvm_env, /* {{{ */
 } /* }}} int ctoj_value_list_add_value */
 
 static int ctoj_value_list_add_data_set(JNIEnv *jvm_env, /* {{{ */
-                                        jclass c_valuelist, jobject o_valuelist,
+                                        jobject o_valuelist,
+                                        cjni_callback_info_t *cbi,
                                         const data_set_t *ds) {
-  jmethodID m_setdataset;
   jobject o_dataset;
 
-  /* Look for the `void setDataSource (List<DataSource> ds)' method. */
-  m_setdataset = (*jvm_env)->GetMethodID(jvm_env, c_valuelist, "setDataSet",
-                                         "(Lorg/collectd/api/DataSet;)V");
-  if (m_setdataset == NULL) {
-    ERROR("java plugin: ctoj_value_list_add_data_set: "
-          "Cannot find the `void setDataSet (DataSet)' method.");
-    return -1;
-  }
-
-  /* Create a DataSet object. */
-  o_dataset = ctoj_data_set(jvm_env, ds);
+  /* Get the (shared) DataSet object. */
+  o_dataset = ctoj_data_set_cached(jvm_env, cbi, ds);
   if (o_dataset == NULL) {
     ERROR("java plugin: ctoj_value_list_add_data_set: "
-          "ctoj_data_set (%s) failed.",
+          "ctoj_data_set_cached (%s) failed.",
           ds->type);
     return -1;
   }
 
-  /* Actually call the method. */
-  (*jvm_env)->CallVoidMethod(jvm_env, o_valuelist, m_setdataset, o_dataset);
+  /* Call the `void setDataSet (DataSet ds)' method. */
+  (*jvm_env)->CallVoidMethod(jvm_env, o_valuelist,
+                             api_cache.m_valuelist_set_dataset, o_dataset);
 
-  /* Decrease reference counter on the List<DataSource> object. */
+  /* Decrease reference counter on the DataSet object. */
   (*jvm_env)->DeleteLocalRef(jvm_env, o_dataset);
 
   return 0;
 } /* }}} int ctoj_value_list_add_data_set */
 
-/* Convert a value_list_t (and data_set_t) to a org/collectd/api/ValueList */
+/* Convert a value_list_t (and data_set_t) to a org/collectd/api/ValueList
+ * passed to the callback `cbi'. */
 static jobject ctoj_value_list(JNIEnv *jvm_env, /* {{{ */
-                               const data_set_t *ds, const value_list_t *vl) {
-  jclass c_valuelist;
-  jmethodID m_valuelist_constructor;
+                               cjni_callback_info_t *cbi, const data_set_t *ds,
+                               const value_list_t *vl) {
   jobject o_valuelist;
   int status;
 
-  /* First, create a new ValueList instance..
-   * Look up the class.. */
-  c_valuelist = (*jvm_env)->FindClass(jvm_env, "org/collectd/api/ValueList");
-  if (c_valuelist == NULL) {
-    ERROR("java plugin: ctoj_value_list: "
-          "FindClass (org/collectd/api/ValueList) failed.");
-    return NULL;
-  }
-
-  /* Lookup the `ValueList ()' constructor. */
-  m_valuelist_constructor =
-      (*jvm_env)->GetMethodID(jvm_env, c_valuelist, "<init>", "()V");
-  if (m_valuelist_constructor == NULL) {
-    ERROR("java plugin: ctoj_value_list: Cannot find the "
-          "`ValueList ()' constructor.");
-    return NULL;
-  }
-
   /* Create a new instance. */
-  o_valuelist =
-      (*jvm_env)->NewObject(jvm_env, c_valuelist, m_valuelist_constructor);
+  o_valuelist = (*jvm_env)->NewObject(jvm_env, api_cache.c_valuelist,
+                                      api_cache.m_valuelist_init);
   if (o_valuelist == NULL) {
     ERROR("java plugin: ctoj_value_list: Creating a new ValueList instance "
           "failed.");
     return NULL;
   }
 
-  status = ctoj_value_list_add_data_set(jvm_env, c_valuelist, o_valuelist, ds);
+  status = ctoj_value_list_add_data_set(jvm_env, o_valuelist, cbi, ds);
   if (status != 0) {
     ERROR("java plugin: ctoj_value_list: "
           "ctoj_value_list_add_data_set failed.");
@@ -730,46 +693,38 @@ static jobject ctoj_value_list(JNIEnv *jvm_env, /* {{{ */
   }
 
 /* Set the strings.. */
-#define SET_STRING(str, method_name)                                           \
+#define SET_STRING(str, method)                                                \
   do {                                                                         \
-    status = ctoj_string(jvm_env, str, c_valuelist, o_valuelist, method_name); \
+    status = ctoj_string(jvm_env, str, o_valuelist, api_cache.method);         \
     if (status != 0) {                                                         \
       ERROR("java plugin: ctoj_value_list: ctoj_string (%s) failed.",          \
-            method_name);                                                      \
+            #method);                                                          \
       (*jvm_env)->DeleteLocalRef(jvm_env, o_valuelist);                        \
       return NULL;                                                             \
     }                                                                          \
   } while (0)
 
-  SET_STRING(vl->host, "setHost");
-  SET_STRING(vl->plugin, "setPlugin");
-  SET_STRING(vl->plugin_instance, "setPluginInstance");
-  SET_STRING(vl->type, "setType");
-  SET_STRING(vl->type_instance, "setTypeInstance");
+  SET_STRING(vl->host, m_valuelist_set_host);
+  SET_STRING(vl->plugin, m_valuelist_set_plugin);
+  SET_STRING(vl->plugin_instance, m_valuelist_set_plugin_instance);
+  SET_STRING(vl->type, m_valuelist_set_type);
+  SET_STRING(vl->type_instance, m_valuelist_set_type_instance);
 
 #undef SET_STRING
 
   /* Set the `time' member. Java stores time in milliseconds. */
-  status = ctoj_long(jvm_env, (jlong)CDTIME_T_TO_MS(vl->time), c_valuelist,
-                     o_valuelist, "setTime");
-  if (status != 0) {
-    ERROR("java plugin: ctoj_value_list: ctoj_long (setTime) failed.");
-    (*jvm_env)->DeleteLocalRef(jvm_env, o_valuelist);
-    return NULL;
-  }
+  (*jvm_env)->CallVoidMethod(jvm_env, o_valuelist,
+                             api_cache.m_valuelist_set_time,
+                             (jlong)CDTIME_T_TO_MS(vl->time));
 
   /* Set the `interval' member.. */
-  status = ctoj_long(jvm_env, (jlong)CDTIME_T_TO_MS(vl->interval), c_valuelist,
-                     o_valuelist, "setInterval");
-  if (status != 0) {
-    ERROR("java plugin: ctoj_value_list: ctoj_long (setInterval) failed.");
-    (*jvm_env)->DeleteLocalRef(jvm_env, o_valuelist);
-    return NULL;
-  }
+  (*jvm_env)->CallVoidMethod(jvm_env, o_valuelist,
+                             api_cache.m_valuelist_set_interval,
+                             (jlong)CDTIME_T_TO_MS(vl->interval));
 
   for (size_t i = 0; i < vl->values_len; i++) {
     status = ctoj_value_list_add_value(jvm_env, vl->values[i], ds->ds[i].type,
-                                       c_valuelist, o_valuelist);
+                                       o_valuelist);
     if (status != 0) {
       ERROR("java plugin: ctoj_value_list: "
             "ctoj_value_list_add_value failed.");
@@ -784,33 +739,12 @@ static jobject ctoj_value_list(JNIEnv *jvm_env, /* {{{ */
 /* Convert a notification_t to a org/collectd/api/Notification */
 static jobject ctoj_notification(JNIEnv *jvm_env, /* {{{ */
                                  const notification_t *n) {
-  jclass c_notification;
-  jmethodID m_constructor;
   jobject o_notification;
   int status;
 
-  /* First, create a new Notification instance..
-   * Look up the class.. */
-  c_notification =
-      (*jvm_env)->FindClass(jvm_env, "org/collectd/api/Notification");
-  if (c_notification == NULL) {
-    ERROR("java plugin: ctoj_notification: "
-          "FindClass (org/collectd/api/Notification) failed.");
-    return NULL;
-  }
-
-  /* Lookup the `Notification ()' constructor. */
-  m_constructor =
-      (*jvm_env)->GetMethodID(jvm_env, c_notification, "<init>", "()V");
-  if (m_constructor == NULL) {
-    ERROR("java plugin: ctoj_notification: Cannot find the "
-          "`Notification ()' constructor.");
-    return NULL;
-  }
-
   /* Create a new instance. */
-  o_notification =
-      (*jvm_env)->NewObject(jvm_env, c_notification, m_constructor);
+  o_notification = (*jvm_env)->NewObject(jvm_env, api_cache.c_notification,
+                                         api_cache.m_notification_init);
   if (o_notification == NULL) {
     ERROR("java plugin: ctoj_notification: Creating a new Notification "
           "instance failed.");
@@ -818,44 +752,35 @@ static jobject ctoj_notification(JNIEnv *jvm_env, /* {{{ */
   }
 
 /* Set the strings.. */
-#define SET_STRING(str, method_name)                                           \
+#define SET_STRING(str, method)                                                \
   do {                                                                         \
-    status = ctoj_string(jvm_env, str, c_notification, o_notification,         \
-                         method_name);                                         \
+    status = ctoj_string(jvm_env, str, o_notification, api_cache.method);      \
     if (status != 0) {                                                         \
       ERROR("java plugin: ctoj_notification: ctoj_string (%s) failed.",        \
-            method_name);                                                      \
+            #method);                                                          \
       (*jvm_env)->DeleteLocalRef(jvm_env, o_notification);                     \
       return NULL;                                                             \
     }                                                                          \
   } while (0)
 
-  SET_STRING(n->host, "setHost");
-  SET_STRING(n->plugin, "setPlugin");
-  SET_STRING(n->plugin_instance, "setPluginInstance");
-  SET_STRING(n->type, "setType");
-  SET_STRING(n->type_instance, "setTypeInstance");
-  SET_STRING(n->message, "setMessage");
+  SET_STRING(n->host, m_notification_set_host);
+  SET_STRING(n->plugin, m_notification_set_plugin);
+  SET_STRING(n->plugin_instance, m_notification_set_plugin_instance);
+  SET_STRING(n->type, m_notification_set_type);
+  SET_STRING(n->type_instance, m_notification_set_type_instance);
+  SET_STRING(n->message, m_notification_set_message);
 
 #undef SET_STRING
 
   /* Set the `time' member. Java stores time in milliseconds. */
-  status = ctoj_long(jvm_env, (jlong)CDTIME_T_TO_MS(n->time), c_notification,
-                     o_notification, "setTime");
-  if (status != 0) {
-    ERROR("java plugin: ctoj_notification: ctoj_long (setTime) failed.");
-    (*jvm_env)->DeleteLocalRef(jvm_env, o_notification);
-    return NULL;
-  }
+  (*jvm_env)->CallVoidMethod(jvm_env, o_notification,
+                             api_cache.m_notification_set_time,
+                             (jlong)CDTIME_T_TO_MS(n->time));
 
   /* Set the `severity' member.. */
-  status = ctoj_int(jvm_env, (jint)n->severity, c_notification, o_notification,
-                    "setSeverity");
-  if (status != 0) {
-    ERROR("java plugin: ctoj_notification: ctoj_int (setSeverity) failed.");
-    (*jvm_env)->DeleteLocalRef(jvm_env, o_notification);
-    return NULL;
-  }
+  (*jvm_env)->CallVoidMethod(jvm_env, o_notification,
+                             api_cache.m_notification_set_severity,
+                             (jint)n->severity);
 
   return o_notification;
 } /* }}} jobject ctoj_notification */
@@ -1337,6 +1262,68 @@ static jint JNICALL cjni_api_register_write(JNIEnv *jvm_env, /* {{{ */
   return 0;
 } /* }}} jint cjni_api_register_write */
 
+static jint JNICALL cjni_api_register_write_batch(JNIEnv *jvm_env, /* {{{ */
+                                                  jobject this, jobject o_name,
+                                                  jobject o_write) {
+  cjni_batch_writer_t *bw;
+  cjni_batch_writer_t **tmp;
+  char read_name[DATA_MAX_NAME_LEN + 16];
+
+  bw = calloc(1, sizeof(*bw));
+  if (bw == NULL) {
+    ERROR("java plugin: cjni_api_register_write_batch: calloc failed.");
+    return -1;
+  }
+  pthread_mutex_init(&bw->lock, /* attr = */ NULL);
+
+  bw->cbi =
+      cjni_callback_info_create(jvm_env, o_name, o_write, CB_TYPE_WRITE_BATCH);
+  if (bw->cbi == NULL) {
+    pthread_mutex_destroy(&bw->lock);
+    sfree(bw);
+    return -1;
+  }
+
+  pthread_mutex_lock(&java_callbacks_lock);
+  tmp = realloc(batch_writers, (batch_writers_num + 1) * sizeof(*tmp));
+  if (tmp == NULL) {
+    pthread_mutex_unlock(&java_callbacks_lock);
+    ERROR("java plugin: cjni_api_register_write_batch: realloc failed.");
+    cjni_batch_writer_destroy(bw);
+    return -1;
+  }
+  batch_writers = tmp;
+  batch_writers[batch_writers_num] = bw;
+  batch_writers_num++;
+  pthread_mutex_unlock(&java_callbacks_lock);
+
+  DEBUG("java plugin: Registering new batch write callback: %s",
+        bw->cbi->name);
+
+  /* The write callback owns `bw'; the flush and read callbacks only borrow
+   * it. The read callback delivers batches which haven't filled up within an
+   * interval, even if no more values are written. */
+  plugin_register_flush(bw->cbi->name, cjni_flush_batch,
+                        &(user_data_t){
+                            .data = bw,
+                        });
+  ssnprintf(read_name, sizeof(read_name), "java/batch/%s", bw->cbi->name);
+  plugin_register_complex_read(/* group = */ "java", read_name,
+                               cjni_read_batch, /* interval = */ 0,
+                               &(user_data_t){
+                                   .data = bw,
+                               });
+  plugin_register_write(
+      bw->cbi->name, cjni_write_batch,
+      &(user_data_t){
+          .data = bw, .free_func = cjni_batch_writer_destroy,
+      });
+
+  (*jvm_env)->DeleteLocalRef(jvm_env, o_write);
+
+  return 0;
+} /* }}} jint cjni_api_register_write_batch */
+
 static jint JNICALL cjni_api_register_flush(JNIEnv *jvm_env, /* {{{ */
                                             jobject this, jobject o_name,
                                             jobject o_flush) {
@@ -1532,6 +1519,10 @@ static JNINativeMethod jni_api_functions[] = /* {{{ */
          "(Ljava/lang/String;Lorg/collectd/api/CollectdWriteInterface;)I",
          cjni_api_register_write},
 
+        {"registerBatchWrite",
+         "(Ljava/lang/String;Lorg/collectd/api/CollectdBatchWriteInterface;)I",
+         cjni_api_register_write_batch},
+
         {"registerFlush",
          "(Ljava/lang/String;Lorg/collectd/api/CollectdFlushInterface;)I",
          cjni_api_register_flush},
@@ -1599,6 +1590,11 @@ cjni_callback_info_create(JNIEnv *jvm_env, /* {{{ */
     method_signature = "(Lorg/collectd/api/ValueList;)I";
     break;
 
+  case CB_TYPE_WRITE_BATCH:
+    method_name = "write";
+    method_signature = "([Lorg/collectd/api/ValueList;)I";
+    break;
+
   case CB_TYPE_FLUSH:
     method_name = "flush";
     method_signature = "(Ljava/lang/Number;Ljava/lang/String;)I";
@@ -1787,6 +1783,117 @@ static void cjni_jvm_env_destroy(void *args) /* {{{ */
   free(cjni_env);
 } /* }}} void cjni_jvm_env_destroy */
 
+/* Look up the classes and methods stored in `api_cache'. Class references are
+ * converted to global references so they stay valid in all threads. */
+static int cjni_api_cache_init(JNIEnv *jvm_env) /* {{{ */
+{
+  jclass c_local;
+
+#define CACHE_CLASS(member, name)                                              \
+  do {                                                                         \
+    c_local = (*jvm_env)->FindClass(jvm_env, name);                            \
+    if (c_local == NULL) {                                                     \
+      ERROR("java plugin: cjni_api_cache_init: FindClass (%s) failed.",        \
+            name);                                                             \
+      return -1;                                                               \
+    }                                                                          \
+    api_cache.member = (*jvm_env)->NewGlobalRef(jvm_env, c_local);             \
+    (*jvm_env)->DeleteLocalRef(jvm_env, c_local);                              \
+    if (api_cache.member == NULL) {                                            \
+      ERROR("java plugin: cjni_api_cache_init: NewGlobalRef (%s) failed.",     \
+            name);                                                             \
+      return -1;                                                               \
+    }                                                                          \
+  } while (0)
+
+#define CACHE_METHOD(member, class, name, signature)                           \
+  do {                                                                         \
+    api_cache.member = (*jvm_env)->GetMethodID(jvm_env, api_cache.class, name, \
+                                               signature);                     \
+    if (api_cache.member == NULL) {                                            \
+      ERROR("java plugin: cjni_api_cache_init: Cannot find method "            \
+            "`%s' with signature `%s'.",                                       \
+            name, signature);                                                  \
+      return -1;                                                               \
+    }                                                                          \
+  } while (0)
+
+  CACHE_CLASS(c_long, "java/lang/Long");
+  CACHE_METHOD(m_long_init, c_long, "<init>", "(J)V");
+  CACHE_CLASS(c_double, "java/lang/Double");
+  CACHE_METHOD(m_double_init, c_double, "<init>", "(D)V");
+
+  CACHE_CLASS(c_datasource, "org/collectd/api/DataSource");
+  CACHE_METHOD(m_datasource_init, c_datasource, "<init>", "()V");
+  CACHE_METHOD(m_datasource_set_name, c_datasource, "setName",
+               "(Ljava/lang/String;)V");
+  CACHE_METHOD(m_datasource_set_type, c_datasource, "setType", "(I)V");
+  CACHE_METHOD(m_datasource_set_min, c_datasource, "setMin", "(D)V");
+  CACHE_METHOD(m_datasource_set_max, c_datasource, "setMax", "(D)V");
+
+  CACHE_CLASS(c_dataset, "org/collectd/api/DataSet");
+  CACHE_METHOD(m_dataset_init, c_dataset, "<init>", "(Ljava/lang/String;)V");
+  CACHE_METHOD(m_dataset_add, c_dataset, "addDataSource",
+               "(Lorg/collectd/api/DataSource;)V");
+
+  CACHE_CLASS(c_valuelist, "org/collectd/api/ValueList");
+  CACHE_METHOD(m_valuelist_init, c_valuelist, "<init>", "()V");
+  CACHE_METHOD(m_valuelist_set_dataset, c_valuelist, "setDataSet",
+               "(Lorg/collectd/api/DataSet;)V");
+  CACHE_METHOD(m_valuelist_set_host, c_valuelist, "setHost",
+               "(Ljava/lang/String;)V");
+  CACHE_METHOD(m_valuelist_set_plugin, c_valuelist, "setPlugin",
+               "(Ljava/lang/String;)V");
+  CACHE_METHOD(m_valuelist_set_plugin_instance, c_valuelist,
+               "setPluginInstance", "(Ljava/lang/String;)V");
+  CACHE_METHOD(m_valuelist_set_type, c_valuelist, "setType",
+               "(Ljava/lang/String;)V");
+  CACHE_METHOD(m_valuelist_set_type_instance, c_valuelist, "setTypeInstance",
+               "(Ljava/lang/String;)V");
+  CACHE_METHOD(m_valuelist_set_time, c_valuelist, "setTime", "(J)V");
+  CACHE_METHOD(m_valuelist_set_interval, c_valuelist, "setInterval", "(J)V");
+  CACHE_METHOD(m_valuelist_add_value, c_valuelist, "addValue",
+               "(Ljava/lang/Number;)V");
+
+  CACHE_CLASS(c_notification, "org/collectd/api/Notification");
+  CACHE_METHOD(m_notification_init, c_notification, "<init>", "()V");
+  CACHE_METHOD(m_notification_set_host, c_notification, "setHost",
+               "(Ljava/lang/String;)V");
+  CACHE_METHOD(m_notification_set_plugin, c_notification, "setPlugin",
+               "(Ljava/lang/String;)V");
+  CACHE_METHOD(m_notification_set_plugin_instance, c_notification,
+               "setPluginInstance", "(Ljava/lang/String;)V");
+  CACHE_METHOD(m_notification_set_type, c_notification, "setType",
+               "(Ljava/lang/String;)V");
+  CACHE_METHOD(m_notification_set_type_instance, c_notification,
+               "setTypeInstance", "(Ljava/lang/String;)V");
+  CACHE_METHOD(m_notification_set_message, c_notification, "setMessage",
+               "(Ljava/lang/String;)V");
+  CACHE_METHOD(m_notification_set_time, c_notification, "setTime", "(J)V");
+  CACHE_METHOD(m_notification_set_severity, c_notification, "setSeverity",
+               "(I)V");
+
+#undef CACHE_METHOD
+#undef CACHE_CLASS
+
+  return 0;
+} /* }}} int cjni_api_cache_init */
+
+/* Release the global references held by `api_cache'. */
+static void cjni_api_cache_free(JNIEnv *jvm_env) /* {{{ */
+{
+  jclass *classes[] = {&api_cache.c_long,       &api_cache.c_double,
+                       &api_cache.c_datasource, &api_cache.c_dataset,
+                       &api_cache.c_valuelist,  &api_cache.c_notification};
+
+  for (size_t i = 0; i < STATIC_ARRAY_SIZE(classes); i++) {
+    if (*classes[i] != NULL)
+      (*jvm_env)->DeleteGlobalRef(jvm_env, *classes[i]);
+  }
+
+  memset(&api_cache, 0, sizeof(api_cache));
+} /* }}} void cjni_api_cache_free */
+
 /* Register ``native'' functions with the JVM. Native functions are C-functions
  * that can be called by Java code. */
 static int cjni_init_native(JNIEnv *jvm_env) /* {{{ */
@@ -1809,6 +1916,13 @@ static int cjni_init_native(JNIEnv *jvm_env) /* {{{ */
     return -1;
   }
 
+  status = cjni_api_cache_init(jvm_env);
+  if (status != 0) {
+    ERROR("cjni_init_native: cjni_api_cache_init failed.");
+    cjni_api_cache_free(jvm_env);
+    return -1;
+  }
+
   return 0;
 } /* }}} int cjni_init_native */
 
@@ -2177,6 +2291,18 @@ static int cjni_config_perform(oconfig_item_t *ci) /* {{{ */
         success++;
       else
         errors++;
+    } else if (strcasecmp("WriteBatchSize", child->key) == 0) {
+      int tmp = 0;
+      status = cf_util_get_int(child, &tmp);
+      if ((status == 0) && (tmp < 1)) {
+        WARNING("java plugin: WriteBatchSize must be at least 1.");
+        status = -1;
+      }
+      if (status == 0) {
+        write_batch_size = (size_t)tmp;
+        success++;
+      } else
+        errors++;
     } else {
       WARNING("java plugin: Option `%s' not allowed here.", child->key);
       errors++;
@@ -2254,6 +2380,8 @@ static void cjni_callback_info_destroy(void *arg) /* {{{ */
 
   /* This condition can occur when shutting down. */
   if (jvm == NULL) {
+    if (cbi != NULL)
+      cjni_datasets_free(/* jvm_env = */ NULL, cbi);
     sfree(cbi);
     return;
   }
@@ -2268,6 +2396,7 @@ static void cjni_callback_info_destroy(void *arg) /* {{{ */
     return;
   }
 
+  cjni_datasets_free(jvm_env, cbi);
   (*jvm_env)->DeleteGlobalRef(jvm_env, cbi->object);
 
   cbi->method = NULL;
@@ -2331,7 +2460,7 @@ static int cjni_write(const data_set_t *ds, const value_list_t *vl, /* {{{ */
 
   cbi = (cjni_callback_info_t *)ud->data;
 
-  vl_java = ctoj_value_list(jvm_env, ds, vl);
+  vl_java = ctoj_value_list(jvm_env, cbi, ds, vl);
   if (vl_java == NULL) {
     ERROR("java plugin: cjni_write: ctoj_value_list failed.");
     cjni_thread_detach();
@@ -2347,6 +2476,198 @@ static int cjni_write(const data_set_t *ds, const value_list_t *vl, /* {{{ */
   return ret_status;
 } /* }}} int cjni_write */
 
+/* Pass all queued value lists of `bw' to the Java object as one array. The
+ * caller must hold `bw->lock'. */
+static int cjni_batch_writer_send(JNIEnv *jvm_env, /* {{{ */
+                                  cjni_batch_writer_t *bw) {
+  jobjectArray o_array;
+  size_t values_num;
+  int ret_status;
+
+  if (bw->values_num == 0)
+    return 0;
+
+  o_array = (*jvm_env)->NewObjectArray(jvm_env, (jsize)bw->values_num,
+                                       api_cache.c_valuelist, NULL);
+  for (size_t i = 0; i < bw->values_num; i++) {
+    if (o_array != NULL)
+      (*jvm_env)->SetObjectArrayElement(jvm_env, o_array, (jsize)i,
+                                        bw->values[i]);
+    (*jvm_env)->DeleteGlobalRef(jvm_env, bw->values[i]);
+    bw->values[i] = NULL;
+  }
+  values_num = bw->values_num;
+  bw->values_num = 0;
+
+  if (o_array == NULL) {
+    ERROR("java plugin: cjni_batch_writer_send: NewObjectArray failed. "
+          "Dropping %zu value list(s) for `%s'.",
+          values_num, bw->cbi->name);
+    return -1;
+  }
+
+  ret_status = (*jvm_env)->CallIntMethod(jvm_env, bw->cbi->object,
+                                         bw->cbi->method, o_array);
+
+  (*jvm_env)->DeleteLocalRef(jvm_env, o_array);
+
+  return ret_status;
+} /* }}} int cjni_batch_writer_send */
+
+/* Call the CB_TYPE_WRITE_BATCH callback pointed to by the `user_data_t'
+ * pointer once enough value lists have been queued. */
+static int cjni_write_batch(const data_set_t *ds, /* {{{ */
+                            const value_list_t *vl, user_data_t *ud) {
+  JNIEnv *jvm_env;
+  cjni_batch_writer_t *bw;
+  jobject vl_java;
+  jobject vl_global;
+  int ret_status = 0;
+
+  if (jvm == NULL) {
+    ERROR("java plugin: cjni_write_batch: jvm == NULL");
+    return -1;
+  }
+
+  if ((ud == NULL) || (ud->data == NULL)) {
+    ERROR("java plugin: cjni_write_batch: Invalid user data.");
+    return -1;
+  }
+
+  jvm_env = cjni_thread_attach();
+  if (jvm_env == NULL)
+    return -1;
+
+  bw = (cjni_batch_writer_t *)ud->data;
+
+  vl_java = ctoj_value_list(jvm_env, bw->cbi, ds, vl);
+  if (vl_java == NULL) {
+    ERROR("java plugin: cjni_write_batch: ctoj_value_list failed.");
+    cjni_thread_detach();
+    return -1;
+  }
+
+  /* The object has to outlive this call, so keep a global reference. */
+  vl_global = (*jvm_env)->NewGlobalRef(jvm_env, vl_java);
+  (*jvm_env)->DeleteLocalRef(jvm_env, vl_java);
+  if (vl_global == NULL) {
+    ERROR("java plugin: cjni_write_batch: NewGlobalRef failed.");
+    cjni_thread_detach();
+    return -1;
+  }
+
+  pthread_mutex_lock(&bw->lock);
+
+  if (bw->values == NULL) {
+    bw->values = calloc(write_batch_size, sizeof(*bw->values));
+    if (bw->values == NULL) {
+      pthread_mutex_unlock(&bw->lock);
+      ERROR("java plugin: cjni_write_batch: calloc failed.");
+      (*jvm_env)->DeleteGlobalRef(jvm_env, vl_global);
+      cjni_thread_detach();
+      return -1;
+    }
+    bw->values_max = write_batch_size;
+  }
+
+  if (bw->values_num == 0)
+    bw->first_time = cdtime();
+  bw->values[bw->values_num] = vl_global;
+  bw->values_num++;
+
+  if ((bw->values_num >= bw->values_max) ||
+      ((cdtime() - bw->first_time) >= plugin_get_interval()))
+    ret_status = cjni_batch_writer_send(jvm_env, bw);
+
+  pthread_mutex_unlock(&bw->lock);
+
+  cjni_thread_detach();
+  return ret_status;
+} /* }}} int cjni_write_batch */
+
+/* Deliver the value lists queued for a CB_TYPE_WRITE_BATCH callback when they
+ * are older than `timeout'. */
+static int cjni_flush_batch(cdtime_t timeout, /* {{{ */
+                            __attribute__((unused)) const char *identifier,
+                            user_data_t *ud) {
+  JNIEnv *jvm_env;
+  cjni_batch_writer_t *bw;
+  int ret_status = 0;
+
+  if (jvm == NULL) {
+    ERROR("java plugin: cjni_flush_batch: jvm == NULL");
+    return -1;
+  }
+
+  if ((ud == NULL) || (ud->data == NULL)) {
+    ERROR("java plugin: cjni_flush_batch: Invalid user data.");
+    return -1;
+  }
+
+  jvm_env = cjni_thread_attach();
+  if (jvm_env == NULL)
+    return -1;
+
+  bw = (cjni_batch_writer_t *)ud->data;
+
+  pthread_mutex_lock(&bw->lock);
+  if ((bw->values_num > 0) &&
+      ((timeout == 0) || ((cdtime() - bw->first_time) >= timeout)))
+    ret_status = cjni_batch_writer_send(jvm_env, bw);
+  pthread_mutex_unlock(&bw->lock);
+
+  cjni_thread_detach();
+  return ret_status;
+} /* }}} int cjni_flush_batch */
+
+/* Deliver the value lists queued for a CB_TYPE_WRITE_BATCH callback when they
+ * are older than the read interval. */
+static int cjni_read_batch(user_data_t *ud) /* {{{ */
+{
+  /* Errors are the Java callback's, not this timer's, so don't let the
+   * daemon suspend it. */
+  cjni_flush_batch(plugin_get_interval(), /* identifier = */ NULL, ud);
+  return 0;
+} /* }}} int cjni_read_batch */
+
+/* Free a `cjni_batch_writer_t', delivering value lists still queued. */
+static void cjni_batch_writer_destroy(void *arg) /* {{{ */
+{
+  cjni_batch_writer_t *bw = arg;
+
+  if (bw == NULL)
+    return;
+
+  pthread_mutex_lock(&java_callbacks_lock);
+  for (size_t i = 0; i < batch_writers_num; i++) {
+    if (batch_writers[i] != bw)
+      continue;
+
+    memmove(batch_writers + i, batch_writers + i + 1,
+            (batch_writers_num - (i + 1)) * sizeof(*batch_writers));
+    batch_writers_num--;
+    break;
+  }
+  pthread_mutex_unlock(&java_callbacks_lock);
+
+  /* If the JVM is gone, so are the queued objects. `cjni_shutdown' sends them
+   * before destroying the JVM. */
+  if ((jvm != NULL) && (bw->values_num > 0)) {
+    JNIEnv *jvm_env = cjni_thread_attach();
+    if (jvm_env != NULL) {
+      pthread_mutex_lock(&bw->lock);
+      cjni_batch_writer_send(jvm_env, bw);
+      pthread_mutex_unlock(&bw->lock);
+      cjni_thread_detach();
+    }
+  }
+
+  cjni_callback_info_destroy(bw->cbi);
+  sfree(bw->values);
+  pthread_mutex_destroy(&bw->lock);
+  sfree(bw);
+} /* }}} void cjni_batch_writer_destroy */
+
 /* Call the CB_TYPE_FLUSH callback pointed to by the `user_data_t' pointer. */
 static int cjni_flush(cdtime_t timeout, const char *identifier, /* {{{ */
                       user_data_t *ud) {
@@ -2649,7 +2970,7 @@ static int cjni_match_target_invoke(const data_set_t *ds, /* {{{ */
 
   cbi = (cjni_callback_info_t *)*user_data;
 
-  o_vl = ctoj_value_list(jvm_env, ds, vl);
+  o_vl = ctoj_value_list(jvm_env, cbi, ds, vl);
   if (o_vl == NULL) {
     ERROR("java plugin: cjni_match_target_invoke: ctoj_value_list failed.");
     cjni_thread_detach();
@@ -2763,6 +3084,15 @@ static int cjni_shutdown(void) /* {{{ */
   /* Execute all the shutdown functions registered by plugins. */
   cjni_shutdown_plugins(jvm_env);
 
+  /* Deliver value lists still queued for batch write callbacks. */
+  pthread_mutex_lock(&java_callbacks_lock);
+  for (size_t i = 0; i < batch_writers_num; i++) {
+    pthread_mutex_lock(&batch_writers[i]->lock);
+    cjni_batch_writer_send(jvm_env, batch_writers[i]);
+    pthread_mutex_unlock(&batch_writers[i]->lock);
+  }
+  pthread_mutex_unlock(&java_callbacks_lock);
+
   /* Release all the global references to callback functions */
   for (size_t i = 0; i < java_callbacks_num; i++) {
     if (java_callbacks[i].object != NULL) {
@@ -2785,6 +3115,9 @@ static int cjni_shutdown(void) /* {{{ */
   java_classes_list_len = 0;
   sfree(java_classes_list);
 
+  /* Release the cached API classes and DataSet objects. */
+  cjni_api_cache_free(jvm_env);
+
   /* Destroy the JVM */
   DEBUG("java plugin: Destroying the JVM.");
   (*jvm)->DestroyJavaVM(jvm);
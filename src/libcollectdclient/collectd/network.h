@@ -45,6 +45,15 @@ typedef struct lcc_server_s lcc_server_t;
 enum lcc_security_level_e { NONE, SIGN, ENCRYPT };
 typedef enum lcc_security_level_e lcc_security_level_t;
 
+/* Compression of the compact value list format, see
+ * lcc_server_set_compact(). */
+enum lcc_compression_e {
+  LCC_COMPRESSION_NONE = 0,
+  LCC_COMPRESSION_LZ4 = 1,
+  LCC_COMPRESSION_ZSTD = 2
+};
+typedef enum lcc_compression_e lcc_compression_t;
+
 /*
  * Create / destroy object
  */
@@ -63,6 +72,11 @@ int lcc_server_set_ttl(lcc_server_t *srv, uint8_t ttl);
 int lcc_server_set_interface(lcc_server_t *srv, char const *interface);
 int lcc_server_set_security_level(lcc_server_t *srv, lcc_security_level_t level,
                                   const char *username, const char *password);
+/* Sends value lists in the network plugin's compact format, which only
+ * receivers supporting it can read. Returns ENOTSUP if the compression is not
+ * available. */
+int lcc_server_set_compact(lcc_server_t *srv, int enable,
+                           lcc_compression_t compression);
 
 /*
  * Send data
@@ -45,6 +45,9 @@ int lcc_network_buffer_set_security_level(lcc_network_buffer_t *nb,
                                           const char *user,
                                           const char *password);
 
+int lcc_network_buffer_set_compact(lcc_network_buffer_t *nb, int enable,
+                                   lcc_compression_t compression);
+
 int lcc_network_buffer_initialize(lcc_network_buffer_t *nb);
 int lcc_network_buffer_finalize(lcc_network_buffer_t *nb);
 
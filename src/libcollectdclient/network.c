@@ -436,6 +436,14 @@ int lcc_server_set_security_level(lcc_server_t *srv, /* {{{ */
                                                password);
 } /* }}} int lcc_server_set_security_level */
 
+int lcc_server_set_compact(lcc_server_t *srv, int enable, /* {{{ */
+                           lcc_compression_t compression) {
+  if (srv == NULL)
+    return EINVAL;
+
+  return lcc_network_buffer_set_compact(srv->buffer, enable, compression);
+} /* }}} int lcc_server_set_compact */
+
 int lcc_network_values_send(lcc_network_t *net, /* {{{ */
                             const lcc_value_list_t *vl) {
   if ((net == NULL) || (vl == NULL))
@@ -58,6 +58,13 @@ GCRY_THREAD_OPTION_PTHREAD_IMPL;
 #endif
 #endif
 
+#if HAVE_LIBLZ4
+#include <lz4.h>
+#endif
+#if HAVE_LIBZSTD
+#include <zstd.h>
+#endif
+
 #include "collectd/network_buffer.h"
 
 #define TYPE_HOST 0x0000
@@ -78,6 +85,20 @@ GCRY_THREAD_OPTION_PTHREAD_IMPL;
 #define TYPE_SIGN_SHA256 0x0200
 #define TYPE_ENCR_AES256 0x0210
 
+/* Compact value lists, see src/network.c for a description. */
+#define TYPE_COMPACT 0x0300
+
+#define COMPACT_FIELD_TIME 0x20
+#define COMPACT_FIELD_INTERVAL 0x40
+#define COMPACT_VALUE_GAUGE_INT 0x04
+
+#define COMPACT_DICT_SIZE 512
+#define COMPACT_HASH_SIZE (2 * COMPACT_DICT_SIZE)
+/* Part header plus compression, reserved byte and uncompressed length. */
+#define COMPACT_PART_HEADER_SIZE 8
+#define COMPACT_CHECK_MARGIN 32
+#define COMPACT_ZSTD_LEVEL 3
+
 #define PART_SIGNATURE_SHA256_SIZE 36
 #define PART_ENCRYPTION_AES256_SIZE 42
 
@@ -94,6 +115,42 @@ GCRY_THREAD_OPTION_PTHREAD_IMPL;
 /*
  * Data types
  */
+struct nb_compact_s {
+  lcc_compression_t compression;
+  /* Space available for the (compressed) records in the packet. */
+  size_t payload_size;
+
+  char *raw;
+  size_t raw_alloc;
+  size_t raw_size;
+  size_t raw_fill;
+  size_t values_num;
+
+  /* As in the network plugin: "compressed" holds the compressed records for
+   * "compressed_fill" bytes of "raw"; attempts go to "scratch". */
+  size_t check_at;
+  char *compressed;
+  char *scratch;
+  size_t compressed_alloc;
+  size_t compressed_size;
+  size_t compressed_fill;
+#if HAVE_LIBZSTD
+  ZSTD_CCtx *zstd;
+#endif
+
+  uint16_t dict_pos[COMPACT_DICT_SIZE];
+  uint8_t dict_len[COMPACT_DICT_SIZE];
+  size_t dict_num;
+  uint16_t hash[COMPACT_HASH_SIZE];
+
+  /* Identifier strings, time and interval of the previous record. */
+  uint16_t prev_pos[5];
+  uint8_t prev_len[5];
+  uint64_t prev_time;
+  uint64_t prev_interval;
+};
+typedef struct nb_compact_s nb_compact_t;
+
 struct lcc_network_buffer_s {
   char *buffer;
   size_t size;
@@ -106,6 +163,9 @@ struct lcc_network_buffer_s {
   char *username;
   char *password;
 
+  /* NULL unless the compact format is used. */
+  nb_compact_t *compact;
+
 #if HAVE_GCRYPT_H
   gcry_cipher_hd_t encr_cypher;
   size_t encr_header_len;
@@ -475,6 +535,409 @@ static int nb_add_value_list(lcc_network_buffer_t *nb, /* {{{ */
   return 0;
 } /* }}} int nb_add_value_list */
 
+static uint32_t nb_compact_hash(const char *str, size_t len) /* {{{ */
+{
+  /* FNV-1a */
+  uint32_t hash = 2166136261U;
+
+  for (size_t i = 0; i < len; i++) {
+    hash ^= (uint8_t)str[i];
+    hash *= 16777619U;
+  }
+
+  return hash;
+} /* }}} uint32_t nb_compact_hash */
+
+static void nb_compact_destroy(nb_compact_t *c) /* {{{ */
+{
+  if (c == NULL)
+    return;
+
+#if HAVE_LIBZSTD
+  if (c->zstd != NULL)
+    ZSTD_freeCCtx(c->zstd);
+#endif
+  free(c->raw);
+  free(c->compressed);
+  free(c->scratch);
+  free(c);
+} /* }}} void nb_compact_destroy */
+
+/* Empties the compact buffer of a packet with "free" bytes of space left. */
+static void nb_compact_reset(nb_compact_t *c, size_t free) /* {{{ */
+{
+  c->payload_size = 0;
+  if (free > COMPACT_PART_HEADER_SIZE)
+    c->payload_size = free - COMPACT_PART_HEADER_SIZE;
+
+  if (c->compression == LCC_COMPRESSION_NONE) {
+    c->raw_size = c->payload_size;
+    c->check_at = SIZE_MAX;
+  } else {
+    c->raw_size = 8 * c->payload_size;
+    c->check_at = c->payload_size;
+  }
+  if (c->raw_size > c->raw_alloc)
+    c->raw_size = c->raw_alloc;
+
+  c->raw_fill = 0;
+  c->values_num = 0;
+  c->compressed_size = 0;
+  c->compressed_fill = SIZE_MAX;
+
+  c->dict_num = 0;
+  memset(c->hash, 0, sizeof(c->hash));
+  memset(c->prev_pos, 0, sizeof(c->prev_pos));
+  memset(c->prev_len, 0, sizeof(c->prev_len));
+  c->prev_time = 0;
+  c->prev_interval = 0;
+} /* }}} void nb_compact_reset */
+
+static nb_compact_t *nb_compact_create(lcc_compression_t compression, /* {{{ */
+                                       size_t size) {
+  nb_compact_t *c;
+
+  c = calloc(1, sizeof(*c));
+  if (c == NULL)
+    return NULL;
+
+  c->compression = compression;
+  c->raw_alloc = size;
+  if (compression != LCC_COMPRESSION_NONE) {
+    c->raw_alloc = 8 * size;
+    if (c->raw_alloc > UINT16_MAX)
+      c->raw_alloc = UINT16_MAX;
+
+    c->compressed_alloc = size;
+    c->compressed = malloc(size);
+    c->scratch = malloc(size);
+    if ((c->compressed == NULL) || (c->scratch == NULL)) {
+      nb_compact_destroy(c);
+      return NULL;
+    }
+  }
+
+#if HAVE_LIBZSTD
+  if (compression == LCC_COMPRESSION_ZSTD) {
+    c->zstd = ZSTD_createCCtx();
+    if (c->zstd == NULL) {
+      nb_compact_destroy(c);
+      return NULL;
+    }
+  }
+#endif
+
+  c->raw = malloc(c->raw_alloc);
+  if (c->raw == NULL) {
+    nb_compact_destroy(c);
+    return NULL;
+  }
+
+  nb_compact_reset(c, size);
+  return c;
+} /* }}} nb_compact_t *nb_compact_create */
+
+static int nb_compact_put_varint(nb_compact_t *c, uint64_t value) /* {{{ */
+{
+  while (42) {
+    if (c->raw_fill >= c->raw_size)
+      return -1;
+
+    if (value < 0x80) {
+      c->raw[c->raw_fill++] = (char)value;
+      return 0;
+    }
+
+    c->raw[c->raw_fill++] = (char)(0x80 | (value & 0x7f));
+    value >>= 7;
+  }
+} /* }}} int nb_compact_put_varint */
+
+static int nb_compact_put_signed(nb_compact_t *c, int64_t value) /* {{{ */
+{
+  return nb_compact_put_varint(c, (((uint64_t)value) << 1) ^
+                                      ((uint64_t)(value >> 63)));
+} /* }}} int nb_compact_put_signed */
+
+static int nb_compact_put_bytes(nb_compact_t *c, /* {{{ */
+                                const void *data, size_t size) {
+  if (size > (c->raw_size - c->raw_fill))
+    return -1;
+
+  memcpy(c->raw + c->raw_fill, data, size);
+  c->raw_fill += size;
+  return 0;
+} /* }}} int nb_compact_put_bytes */
+
+static int nb_compact_put_string(nb_compact_t *c, int field, /* {{{ */
+                                 const char *str, uint8_t *flags) {
+  size_t len = strlen(str);
+  uint32_t slot;
+  size_t pos;
+
+  if (len > UINT8_MAX)
+    return EINVAL;
+
+  if ((len == c->prev_len[field]) &&
+      (memcmp(c->raw + c->prev_pos[field], str, len) == 0))
+    return 0;
+
+  *flags |= (uint8_t)(1 << field);
+
+  slot = nb_compact_hash(str, len) % COMPACT_HASH_SIZE;
+  while (c->hash[slot] != 0) {
+    size_t idx = c->hash[slot] - 1;
+
+    if ((c->dict_len[idx] == len) &&
+        (memcmp(c->raw + c->dict_pos[idx], str, len) == 0)) {
+      if (nb_compact_put_varint(c, (uint64_t)idx + 1) != 0)
+        return -1;
+      c->prev_pos[field] = c->dict_pos[idx];
+      c->prev_len[field] = (uint8_t)len;
+      return 0;
+    }
+
+    slot = (slot + 1) % COMPACT_HASH_SIZE;
+  }
+
+  if ((nb_compact_put_varint(c, 0) != 0) ||
+      (nb_compact_put_varint(c, (uint64_t)len) != 0))
+    return -1;
+  pos = c->raw_fill;
+  if (nb_compact_put_bytes(c, str, len) != 0)
+    return -1;
+
+  if (c->dict_num < COMPACT_DICT_SIZE) {
+    c->dict_pos[c->dict_num] = (uint16_t)pos;
+    c->dict_len[c->dict_num] = (uint8_t)len;
+    c->dict_num++;
+    c->hash[slot] = (uint16_t)c->dict_num;
+  }
+
+  c->prev_pos[field] = (uint16_t)pos;
+  c->prev_len[field] = (uint8_t)len;
+  return 0;
+} /* }}} int nb_compact_put_string */
+
+static int nb_compact_put_values(nb_compact_t *c, /* {{{ */
+                                 const lcc_value_list_t *vl) {
+  if (nb_compact_put_varint(c, (uint64_t)vl->values_len) != 0)
+    return -1;
+
+  for (size_t i = 0; i < vl->values_len; i++) {
+    uint8_t tag = (uint8_t)vl->values_types[i];
+    int status;
+
+    switch (vl->values_types[i]) {
+    case LCC_TYPE_COUNTER:
+      status = nb_compact_put_bytes(c, &tag, sizeof(tag)) ||
+               nb_compact_put_varint(c, (uint64_t)vl->values[i].counter);
+      break;
+
+    case LCC_TYPE_GAUGE: {
+      gauge_t gauge = vl->values[i].gauge;
+
+      if ((gauge >= -9007199254740992.0) && (gauge <= 9007199254740992.0) &&
+          (gauge == (gauge_t)(int64_t)gauge) &&
+          ((gauge != 0.0) || !signbit(gauge))) {
+        tag = COMPACT_VALUE_GAUGE_INT;
+        status = nb_compact_put_bytes(c, &tag, sizeof(tag)) ||
+                 nb_compact_put_signed(c, (int64_t)gauge);
+      } else {
+        gauge = htond(gauge);
+        status = nb_compact_put_bytes(c, &tag, sizeof(tag)) ||
+                 nb_compact_put_bytes(c, &gauge, sizeof(gauge));
+      }
+      break;
+    }
+
+    case LCC_TYPE_DERIVE:
+      status = nb_compact_put_bytes(c, &tag, sizeof(tag)) ||
+               nb_compact_put_signed(c, (int64_t)vl->values[i].derive);
+      break;
+
+    case LCC_TYPE_ABSOLUTE:
+      status = nb_compact_put_bytes(c, &tag, sizeof(tag)) ||
+               nb_compact_put_varint(c, (uint64_t)vl->values[i].absolute);
+      break;
+
+    default:
+      return EINVAL;
+    }
+
+    if (status != 0)
+      return -1;
+  }
+
+  return 0;
+} /* }}} int nb_compact_put_values */
+
+/* Compresses all records into "c->compressed". Returns non-zero if they
+ * don't fit into the packet. */
+static int nb_compact_compress(nb_compact_t *c) /* {{{ */
+{
+  size_t size = 0;
+  char *tmp;
+
+  if (c->compressed_fill == c->raw_fill)
+    return 0;
+  if (c->payload_size > c->compressed_alloc)
+    return -1;
+
+#if HAVE_LIBLZ4
+  if (c->compression == LCC_COMPRESSION_LZ4) {
+    int status = LZ4_compress_default(c->raw, c->scratch, (int)c->raw_fill,
+                                      (int)c->payload_size);
+    if (status <= 0)
+      return -1;
+    size = (size_t)status;
+  }
+#endif
+#if HAVE_LIBZSTD
+  if (c->compression == LCC_COMPRESSION_ZSTD) {
+    size_t status = ZSTD_compressCCtx(c->zstd, c->scratch, c->payload_size,
+                                      c->raw, c->raw_fill, COMPACT_ZSTD_LEVEL);
+    if (ZSTD_isError(status))
+      return -1;
+    size = status;
+  }
+#endif
+
+  if ((size == 0) || (size > c->payload_size))
+    return -1;
+
+  tmp = c->compressed;
+  c->compressed = c->scratch;
+  c->scratch = tmp;
+  c->compressed_size = size;
+  c->compressed_fill = c->raw_fill;
+  return 0;
+} /* }}} int nb_compact_compress */
+
+static int nb_compact_add(nb_compact_t *c, /* {{{ */
+                          const lcc_value_list_t *vl) {
+  size_t raw_fill = c->raw_fill;
+  size_t dict_num = c->dict_num;
+  uint16_t prev_pos[5];
+  uint8_t prev_len[5];
+  uint64_t prev_time = c->prev_time;
+  uint64_t prev_interval = c->prev_interval;
+  /* Convert to collectd's "cdtime" representation. */
+  uint64_t time = (uint64_t)(vl->time * 1073741824.0);
+  uint64_t interval = (uint64_t)(vl->interval * 1073741824.0);
+  uint8_t flags = 0;
+  int status;
+
+  memcpy(prev_pos, c->prev_pos, sizeof(prev_pos));
+  memcpy(prev_len, c->prev_len, sizeof(prev_len));
+
+  if (nb_compact_put_bytes(c, &flags, sizeof(flags)) != 0)
+    return -1;
+
+  status = nb_compact_put_string(c, 0, vl->identifier.host, &flags) ||
+           nb_compact_put_string(c, 1, vl->identifier.plugin, &flags) ||
+           nb_compact_put_string(c, 2, vl->identifier.plugin_instance,
+                                 &flags) ||
+           nb_compact_put_string(c, 3, vl->identifier.type, &flags) ||
+           nb_compact_put_string(c, 4, vl->identifier.type_instance, &flags);
+
+  if ((status == 0) && (time != c->prev_time)) {
+    flags |= COMPACT_FIELD_TIME;
+    status = nb_compact_put_signed(c, (int64_t)(time - c->prev_time));
+    c->prev_time = time;
+  }
+
+  if ((status == 0) && (interval != c->prev_interval)) {
+    flags |= COMPACT_FIELD_INTERVAL;
+    status = nb_compact_put_varint(c, interval);
+    c->prev_interval = interval;
+  }
+
+  if (status == 0) {
+    c->raw[raw_fill] = (char)flags;
+    status = nb_compact_put_values(c, vl);
+  }
+
+  if ((status == 0) && (c->raw_fill > c->check_at)) {
+    status = nb_compact_compress(c);
+    if (status == 0) {
+      size_t gap = c->payload_size - c->compressed_size;
+
+      c->check_at = c->raw_fill;
+      if (gap > COMPACT_CHECK_MARGIN)
+        c->check_at += (gap - COMPACT_CHECK_MARGIN) - (gap / 8);
+    }
+  }
+
+  if (status != 0) {
+    /* Strings added by this record were inserted into the hash table last,
+     * so removing them doesn't break other probe sequences. */
+    for (size_t idx = dict_num; idx < c->dict_num; idx++) {
+      uint32_t slot =
+          nb_compact_hash(c->raw + c->dict_pos[idx], c->dict_len[idx]) %
+          COMPACT_HASH_SIZE;
+
+      while (c->hash[slot] != (uint16_t)(idx + 1))
+        slot = (slot + 1) % COMPACT_HASH_SIZE;
+      c->hash[slot] = 0;
+    }
+
+    c->raw_fill = raw_fill;
+    c->dict_num = dict_num;
+    memcpy(c->prev_pos, prev_pos, sizeof(prev_pos));
+    memcpy(c->prev_len, prev_len, sizeof(prev_len));
+    c->prev_time = prev_time;
+    c->prev_interval = prev_interval;
+    return -1;
+  }
+
+  c->values_num++;
+  return 0;
+} /* }}} int nb_compact_add */
+
+/* Appends the compact part holding all records to the packet. */
+static int nb_add_compact(lcc_network_buffer_t *nb) /* {{{ */
+{
+  nb_compact_t *c = nb->compact;
+  const char *payload = c->raw;
+  size_t payload_size = c->raw_fill;
+  uint8_t compression = LCC_COMPRESSION_NONE;
+  uint16_t tmp16;
+  size_t part_size;
+
+  if (c->values_num == 0)
+    return 0;
+
+  if (c->compression != LCC_COMPRESSION_NONE) {
+    if ((nb_compact_compress(c) == 0) && (c->compressed_size < c->raw_fill)) {
+      payload = c->compressed;
+      payload_size = c->compressed_size;
+      compression = (uint8_t)c->compression;
+    } else if (c->raw_fill > c->payload_size) {
+      return -1;
+    }
+  }
+
+  part_size = COMPACT_PART_HEADER_SIZE + payload_size;
+  if (part_size > nb->free)
+    return -1;
+
+  tmp16 = htons(TYPE_COMPACT);
+  memcpy(nb->ptr, &tmp16, sizeof(tmp16));
+  tmp16 = htons((uint16_t)part_size);
+  memcpy(nb->ptr + 2, &tmp16, sizeof(tmp16));
+  nb->ptr[4] = (char)compression;
+  nb->ptr[5] = 0;
+  tmp16 = htons((uint16_t)c->raw_fill);
+  memcpy(nb->ptr + 6, &tmp16, sizeof(tmp16));
+  memcpy(nb->ptr + COMPACT_PART_HEADER_SIZE, payload, payload_size);
+
+  nb->ptr += part_size;
+  nb->free -= part_size;
+  c->values_num = 0;
+  return 0;
+} /* }}} int nb_add_compact */
+
 #if HAVE_GCRYPT_H
 static int nb_add_signature(lcc_network_buffer_t *nb) /* {{{ */
 {
@@ -636,6 +1099,7 @@ void lcc_network_buffer_destroy(lcc_network_buffer_t *nb) /* {{{ */
   if (nb == NULL)
     return;
 
+  nb_compact_destroy(nb->compact);
   free(nb->buffer);
   free(nb);
 } /* }}} void lcc_network_buffer_destroy */
@@ -678,6 +1142,43 @@ int lcc_network_buffer_set_security_level(lcc_network_buffer_t *nb, /* {{{ */
   return 0;
 } /* }}} int lcc_network_buffer_set_security_level */
 
+int lcc_network_buffer_set_compact(lcc_network_buffer_t *nb, /* {{{ */
+                                   int enable, lcc_compression_t compression) {
+  nb_compact_t *c = NULL;
+
+  if (nb == NULL)
+    return EINVAL;
+
+  switch (compression) {
+  case LCC_COMPRESSION_NONE:
+    break;
+  case LCC_COMPRESSION_LZ4:
+#if !HAVE_LIBLZ4
+    return ENOTSUP;
+#endif
+    break;
+  case LCC_COMPRESSION_ZSTD:
+#if !HAVE_LIBZSTD
+    return ENOTSUP;
+#endif
+    break;
+  default:
+    return EINVAL;
+  }
+
+  if (enable || (compression != LCC_COMPRESSION_NONE)) {
+    c = nb_compact_create(compression, nb->size);
+    if (c == NULL)
+      return ENOMEM;
+  }
+
+  nb_compact_destroy(nb->compact);
+  nb->compact = c;
+
+  lcc_network_buffer_initialize(nb);
+  return 0;
+} /* }}} int lcc_network_buffer_set_compact */
+
 int lcc_network_buffer_initialize(lcc_network_buffer_t *nb) /* {{{ */
 {
   if (nb == NULL)
@@ -731,6 +1232,9 @@ int lcc_network_buffer_initialize(lcc_network_buffer_t *nb) /* {{{ */
   }
 #endif
 
+  if (nb->compact != NULL)
+    nb_compact_reset(nb->compact, nb->free);
+
   return 0;
 } /* }}} int lcc_network_buffer_initialize */
 
@@ -739,6 +1243,9 @@ int lcc_network_buffer_finalize(lcc_network_buffer_t *nb) /* {{{ */
   if (nb == NULL)
     return EINVAL;
 
+  if ((nb->compact != NULL) && (nb_add_compact(nb) != 0))
+    return -1;
+
 #if HAVE_GCRYPT_H
   if (nb->seclevel == SIGN)
     return nb_add_signature(nb);
@@ -756,7 +1263,10 @@ int lcc_network_buffer_add_value(lcc_network_buffer_t *nb, /* {{{ */
   if ((nb == NULL) || (vl == NULL))
     return EINVAL;
 
-  status = nb_add_value_list(nb, vl);
+  if (nb->compact != NULL)
+    status = nb_compact_add(nb->compact, vl);
+  else
+    status = nb_add_value_list(nb, vl);
   return status;
 } /* }}} int lcc_network_buffer_add_value */
 
@@ -49,6 +49,11 @@ static int log_level = LOG_INFO;
 
 static pthread_mutex_t file_lock = PTHREAD_MUTEX_INITIALIZER;
 
+/* The file is kept open and reopened when the path no longer refers to it,
+ * e.g. after log rotation. Protected by "file_lock". */
+static FILE *log_fh = NULL;
+static cdtime_t log_fh_checked = 0;
+
 static char *log_file = NULL;
 
 static const char *config_keys[] = {"LogLevel", "File"};
@@ -64,18 +69,53 @@ static int log_logstash_config(const char *key, const char *value) {
       return 1;
     }
   } else if (0 == strcasecmp(key, "File")) {
+    pthread_mutex_lock(&file_lock);
     sfree(log_file);
     log_file = strdup(value);
+    if (log_fh != NULL) {
+      fclose(log_fh);
+      log_fh = NULL;
+    }
+    pthread_mutex_unlock(&file_lock);
   } else {
     return -1;
   }
   return 0;
 } /* int log_logstash_config (const char *, const char *) */
 
+/* Returns the handle of "log_file", opening it if necessary. The caller must
+ * hold "file_lock". */
+static FILE *log_logstash_open(cdtime_t now) {
+  if ((log_file == NULL) || (strcasecmp(log_file, "stderr") == 0))
+    return stderr;
+  else if (strcasecmp(log_file, "stdout") == 0)
+    return stdout;
+
+  if ((log_fh != NULL) && ((now - log_fh_checked) >= TIME_T_TO_CDTIME_T(1))) {
+    struct stat path_stat;
+    struct stat fh_stat;
+
+    log_fh_checked = now;
+    if ((stat(log_file, &path_stat) != 0) ||
+        (fstat(fileno(log_fh), &fh_stat) != 0) ||
+        (path_stat.st_dev != fh_stat.st_dev) ||
+        (path_stat.st_ino != fh_stat.st_ino)) {
+      fclose(log_fh);
+      log_fh = NULL;
+    }
+  }
+
+  if (log_fh == NULL) {
+    log_fh = fopen(log_file, "a");
+    log_fh_checked = now;
+  }
+
+  return log_fh;
+} /* FILE *log_logstash_open */
+
 static void log_logstash_print(yajl_gen g, int severity,
                                cdtime_t timestamp_time) {
   FILE *fh;
-  _Bool do_close = 0;
   struct tm timestamp_tm;
   char timestamp_str[64];
   const unsigned char *buf;
@@ -146,18 +186,7 @@ static void log_logstash_print(yajl_gen g, int severity,
     goto err;
   pthread_mutex_lock(&file_lock);
 
-  if (log_file == NULL) {
-    fh = stderr;
-  } else if (strcasecmp(log_file, "stdout") == 0) {
-    fh = stdout;
-    do_close = 0;
-  } else if (strcasecmp(log_file, "stderr") == 0) {
-    fh = stderr;
-    do_close = 0;
-  } else {
-    fh = fopen(log_file, "a");
-    do_close = 1;
-  }
+  fh = log_logstash_open(cdtime());
 
   if (fh == NULL) {
     char errbuf[1024];
@@ -165,11 +194,9 @@ static void log_logstash_print(yajl_gen g, int severity,
             sstrerror(errno, errbuf, sizeof(errbuf)));
   } else {
     fprintf(fh, "%s\n", buf);
-    if (do_close) {
-      fclose(fh);
-    } else {
+    /* If more messages are queued, they will be flushed together. */
+    if (!plugin_log_pending())
       fflush(fh);
-    }
   }
   pthread_mutex_unlock(&file_lock);
   yajl_gen_free(g);
@@ -39,6 +39,12 @@ static int log_level = LOG_INFO;
 
 static pthread_mutex_t file_lock = PTHREAD_MUTEX_INITIALIZER;
 
+/* The file is kept open; at most once per second, it is checked whether the
+ * path still refers to it, so that it is reopened after log rotation. All
+ * protected by "file_lock". */
+static FILE *log_fh = NULL;
+static cdtime_t log_fh_checked = 0;
+
 static char *log_file = NULL;
 static int print_timestamp = 1;
 static int print_severity = 0;
@@ -56,8 +62,14 @@ static int logfile_config(const char *key, const char *value) {
       return 1;
     }
   } else if (0 == strcasecmp(key, "File")) {
+    pthread_mutex_lock(&file_lock);
     sfree(log_file);
     log_file = strdup(value);
+    if (log_fh != NULL) {
+      fclose(log_fh);
+      log_fh = NULL;
+    }
+    pthread_mutex_unlock(&file_lock);
   } else if (0 == strcasecmp(key, "Timestamp")) {
     if (IS_FALSE(value))
       print_timestamp = 0;
@@ -74,10 +86,39 @@ static int logfile_config(const char *key, const char *value) {
   return 0;
 } /* int logfile_config (const char *, const char *) */
 
+/* Returns the handle of "log_file", opening it if necessary. The caller must
+ * hold "file_lock". */
+static FILE *logfile_open(cdtime_t now) {
+  if ((log_file == NULL) || (strcasecmp(log_file, "stderr") == 0))
+    return stderr;
+  else if (strcasecmp(log_file, "stdout") == 0)
+    return stdout;
+
+  if ((log_fh != NULL) && ((now - log_fh_checked) >= TIME_T_TO_CDTIME_T(1))) {
+    struct stat path_stat;
+    struct stat fh_stat;
+
+    log_fh_checked = now;
+    if ((stat(log_file, &path_stat) != 0) ||
+        (fstat(fileno(log_fh), &fh_stat) != 0) ||
+        (path_stat.st_dev != fh_stat.st_dev) ||
+        (path_stat.st_ino != fh_stat.st_ino)) {
+      fclose(log_fh);
+      log_fh = NULL;
+    }
+  }
+
+  if (log_fh == NULL) {
+    log_fh = fopen(log_file, "a");
+    log_fh_checked = now;
+  }
+
+  return log_fh;
+} /* FILE *logfile_open */
+
 static void logfile_print(const char *msg, int severity,
                           cdtime_t timestamp_time) {
   FILE *fh;
-  _Bool do_close = 0;
   char timestamp_str[64];
   char level_str[16] = "";
 
@@ -114,16 +155,7 @@ static void logfile_print(const char *msg, int severity,
 
   pthread_mutex_lock(&file_lock);
 
-  if (log_file == NULL) {
-    fh = stderr;
-  } else if (strcasecmp(log_file, "stderr") == 0)
-    fh = stderr;
-  else if (strcasecmp(log_file, "stdout") == 0)
-    fh = stdout;
-  else {
-    fh = fopen(log_file, "a");
-    do_close = 1;
-  }
+  fh = logfile_open(cdtime());
 
   if (fh == NULL) {
     char errbuf[1024];
@@ -135,11 +167,9 @@ static void logfile_print(const char *msg, int severity,
     else
       fprintf(fh, "%s%s\n", level_str, msg);
 
-    if (do_close) {
-      fclose(fh);
-    } else {
+    /* If more messages are queued, they will be flushed together. */
+    if (!plugin_log_pending())
       fflush(fh);
-    }
   }
 
   pthread_mutex_unlock(&file_lock);
@@ -197,9 +227,37 @@ static int logfile_notification(const notification_t *n,
   return 0;
 } /* int logfile_notification */
 
+/* The exec plugin's children close all file descriptors before they may log
+ * a last message, so a child has to check "log_fh" before using it. Holding
+ * "file_lock" across fork(2) keeps the child from inheriting it locked. */
+static void logfile_atfork_prepare(void) { pthread_mutex_lock(&file_lock); }
+
+static void logfile_atfork_parent(void) { pthread_mutex_unlock(&file_lock); }
+
+static void logfile_atfork_child(void) {
+  log_fh_checked = 0;
+  pthread_mutex_unlock(&file_lock);
+}
+
+static int logfile_init(void) {
+  int status;
+
+  /* Only forked children are affected, so keep logging if this fails. */
+  status = pthread_atfork(logfile_atfork_prepare, logfile_atfork_parent,
+                          logfile_atfork_child);
+  if (status != 0) {
+    char errbuf[1024];
+    WARNING("logfile plugin: pthread_atfork failed: %s",
+            sstrerror(status, errbuf, sizeof(errbuf)));
+  }
+
+  return 0;
+} /* int logfile_init */
+
 void module_register(void) {
   plugin_register_config("logfile", logfile_config, config_keys,
                          config_keys_num);
+  plugin_register_init("logfile", logfile_init);
   plugin_register_log("logfile", logfile_log, /* user_data = */ NULL);
   plugin_register_notification("logfile", logfile_notification,
                                /* user_data = */ NULL);
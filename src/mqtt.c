@@ -33,6 +33,7 @@
 
 #include "common.h"
 #include "plugin.h"
+#include "utils_cmd_putval.h"
 #include "utils_complain.h"
 
 #include <mosquitto.h>
@@ -43,9 +44,12 @@
 #define MQTT_DEFAULT_PORT 1883
 #define MQTT_DEFAULT_TOPIC_PREFIX "collectd"
 #define MQTT_DEFAULT_TOPIC "collectd/#"
+#define MQTT_DEFAULT_QUEUE_LIMIT 10000
 #ifndef MQTT_KEEPALIVE
 #define MQTT_KEEPALIVE 60
 #endif
+/* Time the publisher thread waits before connecting again. */
+#define MQTT_RETRY_INTERVAL TIME_T_TO_CDTIME_T(1)
 #ifndef SSL_VERIFY_PEER
 #define SSL_VERIFY_PEER 1
 #endif
@@ -53,6 +57,17 @@
 /*
  * Data types
  */
+/* A message waiting to be published. "topic" is NULL for PUTVAL lines that
+ * are batched, see "BufferSize". */
+typedef struct mqtt_message_s mqtt_message_t;
+struct mqtt_message_s {
+  mqtt_message_t *next;
+  cdtime_t time; /* when the message was queued */
+  char *topic;
+  char *payload;
+  size_t payload_len;
+};
+
 struct mqtt_client_conf {
   _Bool publish;
   char *name;
@@ -76,12 +91,37 @@ struct mqtt_client_conf {
   char *topic_prefix;
   _Bool store_rates;
   _Bool retain;
-
-  /* For subscribing */
+  size_t queue_limit;
+  size_t buffer_size;
+  char *buffer;
+  char *batch_topic;
+  _Bool collect_stats;
+  _Bool threaded; /* network loop runs in libmosquitto's thread */
+
+  /* Messages are handed to the publisher thread through this queue, so that
+   * write callbacks never wait for the broker. */
+  mqtt_message_t *queue_head;
+  mqtt_message_t *queue_tail;
+  size_t queue_length;
+  pthread_mutex_t queue_lock;
+  pthread_cond_t queue_cond;
+  c_complain_t complaint_queue_full;
+
+  /* Statistics, protected by "queue_lock". */
+  derive_t stats_published;
+  derive_t stats_dropped;
+  cdtime_t stats_latency_sum;
+  cdtime_t stats_latency_max;
+  uint64_t stats_latency_num;
+
+  /* The publisher or subscriber thread */
   pthread_t thread;
   _Bool loop;
+
+  /* For subscribing */
   char *topic;
   _Bool clean_session;
+  cmd_putval_parser_t *putval;
 
   c_complain_t complaint_cantpublish;
   pthread_mutex_t lock;
@@ -91,6 +131,9 @@ typedef struct mqtt_client_conf mqtt_client_conf_t;
 static mqtt_client_conf_t **subscribers = NULL;
 static size_t subscribers_num = 0;
 
+static mqtt_client_conf_t **publishers = NULL;
+static size_t publishers_num = 0;
+
 /*
  * Functions
  */
@@ -142,16 +185,35 @@ static void mqtt_free(mqtt_client_conf_t *conf) {
   if (conf->connected)
     (void)mosquitto_disconnect(conf->mosq);
   conf->connected = 0;
+#if LIBMOSQUITTO_MAJOR != 0
+  if (conf->threaded && (conf->mosq != NULL))
+    (void)mosquitto_loop_stop(conf->mosq, /* force = */ false);
+#endif
   (void)mosquitto_destroy(conf->mosq);
 
+  while (conf->queue_head != NULL) {
+    mqtt_message_t *next = conf->queue_head->next;
+    sfree(conf->queue_head);
+    conf->queue_head = next;
+  }
+
+  if (conf->putval != NULL)
+    cmd_putval_parser_destroy(conf->putval);
+
+  sfree(conf->name);
   sfree(conf->host);
   sfree(conf->username);
   sfree(conf->password);
   sfree(conf->client_id);
   sfree(conf->topic_prefix);
+  sfree(conf->topic);
+  sfree(conf->buffer);
+  sfree(conf->batch_topic);
   sfree(conf);
 }
 
+static void mqtt_free_cb(void *arg) { mqtt_free(arg); }
+
 static char *strip_prefix(char *topic) {
   size_t num = 0;
 
@@ -173,12 +235,46 @@ static char *strip_prefix(char *topic) {
   return topic;
 }
 
+static void putval_error(__attribute__((unused)) void *ud, cmd_status_t status,
+                         const char *format, va_list ap) {
+  char msg[1024];
+
+  if (status == CMD_OK)
+    return;
+
+  vsnprintf(msg, sizeof(msg), format, ap);
+  ERROR("mqtt plugin: Handling PUTVAL failed: %s", msg);
+} /* void putval_error */
+
+/* Batches, see "BufferSize", hold one PUTVAL line per value list. */
+static void on_message_batch(mqtt_client_conf_t *conf,
+                             const struct mosquitto_message *msg) {
+  cmd_error_handler_t err = {putval_error, NULL};
+  char *payload;
+  char *saveptr = NULL;
+
+  payload = malloc(msg->payloadlen + 1);
+  if (payload == NULL) {
+    ERROR("mqtt plugin: malloc for payload buffer failed.");
+    return;
+  }
+  memmove(payload, msg->payload, msg->payloadlen);
+  payload[msg->payloadlen] = 0;
+
+  for (char *line = strtok_r(payload, "\r\n", &saveptr); line != NULL;
+       line = strtok_r(NULL, "\r\n", &saveptr))
+    cmd_putval_parser_dispatch(conf->putval, line, /* ret_num = */ NULL, &err);
+
+  sfree(payload);
+} /* void on_message_batch */
+
 static void on_message(
 #if LIBMOSQUITTO_MAJOR == 0
 #else
     __attribute__((unused)) struct mosquitto *m,
 #endif
-    __attribute__((unused)) void *arg, const struct mosquitto_message *msg) {
+    void *arg, const struct mosquitto_message *msg) {
+  mqtt_client_conf_t *conf = arg;
   value_list_t vl = VALUE_LIST_INIT;
   data_set_t const *ds;
   char *topic;
@@ -191,6 +287,12 @@ static void on_message(
     return;
   }
 
+  if ((msg->payloadlen > 7) &&
+      (strncmp("PUTVAL ", (char const *)msg->payload, 7) == 0)) {
+    on_message_batch(conf, msg);
+    return;
+  }
+
   topic = strdup(msg->topic);
   name = strip_prefix(topic);
 
@@ -238,10 +340,50 @@ static void on_message(
   sfree(vl.values);
 } /* void on_message */
 
+#if LIBMOSQUITTO_MAJOR != 0
+/* Called by libmosquitto's thread, see mosquitto_loop_start(). */
+static void on_connect(__attribute__((unused)) struct mosquitto *m, void *arg,
+                       int rc) {
+  mqtt_client_conf_t *conf = arg;
+
+  if (rc != 0)
+    return;
+
+  __atomic_store_n(&conf->connected, 1, __ATOMIC_RELEASE);
+
+  /* Wake up the publisher thread in case it is waiting for the broker. */
+  pthread_mutex_lock(&conf->queue_lock);
+  pthread_cond_signal(&conf->queue_cond);
+  pthread_mutex_unlock(&conf->queue_lock);
+} /* void on_connect */
+
+static void on_disconnect(__attribute__((unused)) struct mosquitto *m,
+                          void *arg, __attribute__((unused)) int rc) {
+  mqtt_client_conf_t *conf = arg;
+
+  __atomic_store_n(&conf->connected, 0, __ATOMIC_RELEASE);
+} /* void on_disconnect */
+#endif
+
 /* must hold conf->lock when calling. */
 static int mqtt_reconnect(mqtt_client_conf_t *conf) {
   int status;
 
+  /* libmosquitto's thread reconnects on its own. */
+  if (conf->threaded) {
+    if (!__atomic_load_n(&conf->connected, __ATOMIC_ACQUIRE)) {
+      c_complain(LOG_ERR, &conf->complaint_cantpublish,
+                 "mqtt plugin: not connected to broker \"%s:%d\", "
+                 "waiting for the connection to be re-established",
+                 conf->host, conf->port);
+      return -1;
+    }
+    c_release(LOG_INFO, &conf->complaint_cantpublish,
+              "mqtt plugin: successfully reconnected to broker \"%s:%d\"",
+              conf->host, conf->port);
+    return 0;
+  }
+
   if (conf->connected)
     return 0;
 
@@ -321,6 +463,13 @@ static int mqtt_connect(mqtt_client_conf_t *conf) {
   }
 #endif
 
+#if LIBMOSQUITTO_MAJOR != 0
+  if (conf->publish) {
+    mosquitto_connect_callback_set(conf->mosq, on_connect);
+    mosquitto_disconnect_callback_set(conf->mosq, on_disconnect);
+  }
+#endif
+
   if (conf->username && conf->password) {
     status =
         mosquitto_username_pw_set(conf->mosq, conf->username, conf->password);
@@ -374,6 +523,22 @@ static int mqtt_connect(mqtt_client_conf_t *conf) {
   }
 
   conf->connected = 1;
+
+#if LIBMOSQUITTO_MAJOR != 0
+  /* Let libmosquitto handle acknowledgements, keep-alive messages and
+   * reconnects in its own thread. From then on, "connected" is maintained by
+   * the on_connect() and on_disconnect() callbacks. */
+  if (conf->publish) {
+    status = mosquitto_loop_start(conf->mosq);
+    if (status == MOSQ_ERR_SUCCESS)
+      conf->threaded = 1;
+    else
+      NOTICE("mqtt plugin: mosquitto_loop_start failed: %s. Running the "
+             "network loop in the publisher thread instead.",
+             mosquitto_strerror(status));
+  }
+#endif
+
   return 0;
 } /* mqtt_connect */
 
@@ -417,19 +582,11 @@ static void *subscribers_thread(void *arg) {
   pthread_exit(0);
 } /* void *subscribers_thread */
 
+/* must hold conf->lock when calling. */
 static int publish(mqtt_client_conf_t *conf, char const *topic,
                    void const *payload, size_t payload_len) {
   int status;
 
-  pthread_mutex_lock(&conf->lock);
-
-  status = mqtt_connect(conf);
-  if (status != 0) {
-    pthread_mutex_unlock(&conf->lock);
-    ERROR("mqtt plugin: unable to reconnect to broker");
-    return status;
-  }
-
   status = mosquitto_publish(conf->mosq, /* message_id */ NULL, topic,
 #if LIBMOSQUITTO_MAJOR == 0
                              (uint32_t)payload_len, payload,
@@ -437,27 +594,262 @@ static int publish(mqtt_client_conf_t *conf, char const *topic,
                              (int)payload_len, payload,
 #endif
                              conf->qos, conf->retain);
-  if (status != MOSQ_ERR_SUCCESS) {
+  if ((status == MOSQ_ERR_INVAL) || (status == MOSQ_ERR_NOMEM) ||
+      (status == MOSQ_ERR_PAYLOAD_SIZE)) {
+    /* Retrying would fail the same way. */
+    ERROR("mqtt plugin: mosquitto_publish failed for topic \"%s\": %s", topic,
+          mosquitto_strerror(status));
+    return EINVAL;
+  } else if (status != MOSQ_ERR_SUCCESS) {
     char errbuf[1024];
     c_complain(LOG_ERR, &conf->complaint_cantpublish,
                "mqtt plugin: mosquitto_publish failed: %s",
                (status == MOSQ_ERR_ERRNO)
                    ? sstrerror(errno, errbuf, sizeof(errbuf))
                    : mosquitto_strerror(status));
+    /* libmosquitto's thread takes care of the connection, see
+     * mosquitto_loop_start(). */
+    if (conf->threaded)
+      return -1;
+
     /* Mark our connection "down" regardless of the error as a safety
      * measure; we will try to reconnect the next time we have to publish a
      * message */
     conf->connected = 0;
     mosquitto_disconnect(conf->mosq);
-
-    pthread_mutex_unlock(&conf->lock);
     return -1;
   }
 
-  pthread_mutex_unlock(&conf->lock);
   return 0;
 } /* int publish */
 
+/* Processes incoming packets, e.g. acknowledgements and keep-alive responses,
+ * unless libmosquitto's thread does so. Must hold conf->lock when calling. */
+static void mqtt_loop(mqtt_client_conf_t *conf) {
+  int status;
+
+  if (conf->threaded || !conf->connected)
+    return;
+
+#if LIBMOSQUITTO_MAJOR == 0
+  status = mosquitto_loop(conf->mosq, /* timeout = */ 1 /* ms */);
+#else
+  status = mosquitto_loop(conf->mosq,
+                          /* timeout[ms] = */ 1,
+                          /* max_packets = */ 100);
+#endif
+  if (status != MOSQ_ERR_SUCCESS) {
+    c_complain(LOG_ERR, &conf->complaint_cantpublish,
+               "mqtt plugin: mosquitto_loop failed: %s",
+               mosquitto_strerror(status));
+    conf->connected = 0;
+    mosquitto_disconnect(conf->mosq);
+  }
+} /* void mqtt_loop */
+
+/* Publishes the messages of the list "head" points to and removes them from
+ * the list. Consecutive PUTVAL lines are sent in batches of up to
+ * "buffer_size" bytes. Messages the library rejects are dropped. Returns
+ * non-zero if the broker is unavailable; the remaining messages are left in
+ * the list. */
+static int publish_messages(mqtt_client_conf_t *conf, mqtt_message_t **head) {
+  derive_t published = 0;
+  derive_t dropped = 0;
+  cdtime_t latency_sum = 0;
+  cdtime_t latency_max = 0;
+  int status;
+
+  pthread_mutex_lock(&conf->lock);
+
+  status = mqtt_connect(conf);
+  while ((status == 0) && (*head != NULL)) {
+    mqtt_message_t *end = (*head)->next;
+    cdtime_t now;
+
+    if ((*head)->topic != NULL) {
+      status = publish(conf, (*head)->topic, (*head)->payload,
+                       (*head)->payload_len);
+    } else {
+      size_t fill = (*head)->payload_len;
+
+      memcpy(conf->buffer, (*head)->payload, fill);
+      while ((end != NULL) && (end->topic == NULL) &&
+             ((fill + end->payload_len) <= conf->buffer_size)) {
+        memcpy(conf->buffer + fill, end->payload, end->payload_len);
+        fill += end->payload_len;
+        end = end->next;
+      }
+
+      status = publish(conf, conf->batch_topic, conf->buffer, fill);
+    }
+    if ((status != 0) && (status != EINVAL))
+      break;
+
+    now = cdtime();
+    while (*head != end) {
+      mqtt_message_t *m = *head;
+      cdtime_t latency = now - m->time;
+
+      if (status == EINVAL) {
+        dropped++;
+      } else {
+        latency_sum += latency;
+        if (latency_max < latency)
+          latency_max = latency;
+        published++;
+      }
+
+      *head = m->next;
+      sfree(m);
+    }
+    status = 0;
+  }
+
+  mqtt_loop(conf);
+
+  pthread_mutex_unlock(&conf->lock);
+
+  if ((published > 0) || (dropped > 0)) {
+    pthread_mutex_lock(&conf->queue_lock);
+    conf->queue_length -= (size_t)(published + dropped);
+    conf->stats_dropped += dropped;
+    conf->stats_published += published;
+    conf->stats_latency_sum += latency_sum;
+    conf->stats_latency_num += (uint64_t)published;
+    if (conf->stats_latency_max < latency_max)
+      conf->stats_latency_max = latency_max;
+    pthread_mutex_unlock(&conf->queue_lock);
+  }
+
+  return status;
+} /* int publish_messages */
+
+/* Puts the messages "head" points to back to the front of the queue. Must
+ * hold conf->queue_lock when calling. */
+static void requeue_messages(mqtt_client_conf_t *conf, mqtt_message_t *head) {
+  mqtt_message_t *tail = head;
+
+  if (head == NULL)
+    return;
+
+  while (tail->next != NULL)
+    tail = tail->next;
+
+  tail->next = conf->queue_head;
+  if (conf->queue_head == NULL)
+    conf->queue_tail = tail;
+  conf->queue_head = head;
+} /* void requeue_messages */
+
+static void *publisher_thread(void *arg) {
+  mqtt_client_conf_t *conf = arg;
+  mqtt_message_t *head;
+  _Bool ready = 1;
+
+  pthread_mutex_lock(&conf->queue_lock);
+  while (conf->loop) {
+    /* Without a broker, retry once per MQTT_RETRY_INTERVAL. The timeout also
+     * lets publish_messages() connect and process incoming packets while
+     * there is nothing to publish. */
+    if (!ready) {
+      /* New messages don't end this wait, a reconnect by libmosquitto's thread
+       * does. Publishing may also fail while connected, e.g. if the message
+       * is rejected; then wait the full interval instead of spinning. */
+      cdtime_t until = cdtime() + MQTT_RETRY_INTERVAL;
+      struct timespec ts = CDTIME_T_TO_TIMESPEC(until);
+      _Bool was_connected =
+          conf->threaded && __atomic_load_n(&conf->connected, __ATOMIC_ACQUIRE);
+
+      while (conf->loop && (cdtime() < until) &&
+             (was_connected ||
+              !(conf->threaded &&
+                __atomic_load_n(&conf->connected, __ATOMIC_ACQUIRE))))
+        pthread_cond_timedwait(&conf->queue_cond, &conf->queue_lock, &ts);
+    } else if (conf->queue_head == NULL) {
+      struct timespec ts =
+          CDTIME_T_TO_TIMESPEC(cdtime() + MQTT_RETRY_INTERVAL);
+      pthread_cond_timedwait(&conf->queue_cond, &conf->queue_lock, &ts);
+    }
+    if (!conf->loop)
+      break;
+
+    head = conf->queue_head;
+    conf->queue_head = NULL;
+    conf->queue_tail = NULL;
+    pthread_mutex_unlock(&conf->queue_lock);
+
+    ready = (publish_messages(conf, &head) == 0);
+
+    pthread_mutex_lock(&conf->queue_lock);
+    requeue_messages(conf, head);
+  }
+
+  head = conf->queue_head;
+  conf->queue_head = NULL;
+  conf->queue_tail = NULL;
+  pthread_mutex_unlock(&conf->queue_lock);
+
+  /* Make a last attempt to publish what is left, unless that means waiting
+   * for a connection. */
+  if ((head != NULL) && __atomic_load_n(&conf->connected, __ATOMIC_ACQUIRE))
+    publish_messages(conf, &head);
+
+  pthread_mutex_lock(&conf->queue_lock);
+  requeue_messages(conf, head);
+  pthread_mutex_unlock(&conf->queue_lock);
+
+  return NULL;
+} /* void *publisher_thread */
+
+static int enqueue_message(mqtt_client_conf_t *conf, char const *topic,
+                           char const *payload, size_t payload_len) {
+  size_t topic_size = (topic != NULL) ? (strlen(topic) + 1) : 0;
+  mqtt_message_t *m;
+
+  m = malloc(sizeof(*m) + payload_len + topic_size);
+  if (m == NULL) {
+    ERROR("mqtt plugin: malloc failed.");
+    return ENOMEM;
+  }
+  m->next = NULL;
+  m->time = cdtime();
+  m->payload = (char *)(m + 1);
+  m->payload_len = payload_len;
+  memcpy(m->payload, payload, payload_len);
+  m->topic = NULL;
+  if (topic != NULL) {
+    m->topic = m->payload + payload_len;
+    memcpy(m->topic, topic, topic_size);
+  }
+
+  pthread_mutex_lock(&conf->queue_lock);
+
+  if (conf->queue_length >= conf->queue_limit) {
+    conf->stats_dropped++;
+    c_complain(LOG_WARNING, &conf->complaint_queue_full,
+               "mqtt plugin: The queue of \"%s\" is full; %" PRIi64
+               " values dropped so far.",
+               conf->name, conf->stats_dropped);
+    pthread_mutex_unlock(&conf->queue_lock);
+    sfree(m);
+    return ENOBUFS;
+  }
+
+  if (conf->queue_tail == NULL)
+    conf->queue_head = m;
+  else
+    conf->queue_tail->next = m;
+  conf->queue_tail = m;
+  conf->queue_length++;
+
+  /* The publisher thread only waits for new messages if the queue is empty. */
+  if (conf->queue_head == m)
+    pthread_cond_signal(&conf->queue_cond);
+  pthread_mutex_unlock(&conf->queue_lock);
+
+  return 0;
+} /* int enqueue_message */
+
 static int format_topic(char *buf, size_t buf_len, data_set_t const *ds,
                         value_list_t const *vl, mqtt_client_conf_t *conf) {
   char name[MQTT_MAX_TOPIC_SIZE];
@@ -493,6 +885,20 @@ static int mqtt_write(const data_set_t *ds, const value_list_t *vl,
     return EINVAL;
   conf = user_data->data;
 
+  if (conf->buffer_size > 0) {
+    size_t len;
+
+    status = cmd_create_putval(payload, sizeof(payload) - 1, ds, vl);
+    if (status != 0) {
+      ERROR("mqtt plugin: cmd_create_putval failed with status %d.", status);
+      return status;
+    }
+    len = strlen(payload);
+    payload[len] = '\n';
+
+    return enqueue_message(conf, /* topic = */ NULL, payload, len + 1);
+  }
+
   status = format_topic(topic, sizeof(topic), ds, vl, conf);
   if (status != 0) {
     ERROR("mqtt plugin: format_topic failed with status %d.", status);
@@ -505,15 +911,68 @@ static int mqtt_write(const data_set_t *ds, const value_list_t *vl,
     return status;
   }
 
-  status = publish(conf, topic, payload, strlen(payload) + 1);
-  if (status != 0) {
-    ERROR("mqtt plugin: publish failed: %s", mosquitto_strerror(status));
-    return status;
-  }
-
-  return status;
+  return enqueue_message(conf, topic, payload, strlen(payload) + 1);
 } /* mqtt_write */
 
+static int mqtt_stats_read(user_data_t *user_data) {
+  mqtt_client_conf_t *conf = user_data->data;
+  value_list_t vl = VALUE_LIST_INIT;
+  size_t queue_length;
+  derive_t published;
+  derive_t dropped;
+  cdtime_t latency_sum;
+  cdtime_t latency_max;
+  uint64_t latency_num;
+
+  pthread_mutex_lock(&conf->queue_lock);
+  queue_length = conf->queue_length;
+  published = conf->stats_published;
+  dropped = conf->stats_dropped;
+  latency_sum = conf->stats_latency_sum;
+  latency_max = conf->stats_latency_max;
+  latency_num = conf->stats_latency_num;
+  conf->stats_latency_sum = 0;
+  conf->stats_latency_max = 0;
+  conf->stats_latency_num = 0;
+  pthread_mutex_unlock(&conf->queue_lock);
+
+  vl.values_len = 1;
+  sstrncpy(vl.plugin, "mqtt", sizeof(vl.plugin));
+  sstrncpy(vl.plugin_instance, conf->name, sizeof(vl.plugin_instance));
+
+  vl.values = &(value_t){.gauge = (gauge_t)queue_length};
+  sstrncpy(vl.type, "queue_length", sizeof(vl.type));
+  plugin_dispatch_values(&vl);
+
+  vl.values = &(value_t){.derive = published};
+  sstrncpy(vl.type, "total_values", sizeof(vl.type));
+  sstrncpy(vl.type_instance, "published", sizeof(vl.type_instance));
+  plugin_dispatch_values(&vl);
+
+  vl.values = &(value_t){.derive = dropped};
+  sstrncpy(vl.type_instance, "dropped", sizeof(vl.type_instance));
+  plugin_dispatch_values(&vl);
+
+  /* Latencies are reset on every read, i.e. they describe the values
+   * published during the last interval only. */
+  vl.values =
+      &(value_t){.gauge = (latency_num > 0)
+                              ? CDTIME_T_TO_DOUBLE(latency_sum) /
+                                    (gauge_t)latency_num
+                              : NAN};
+  sstrncpy(vl.type, "latency", sizeof(vl.type));
+  sstrncpy(vl.type_instance, "average", sizeof(vl.type_instance));
+  plugin_dispatch_values(&vl);
+
+  vl.values = &(value_t){.gauge = (latency_num > 0)
+                                      ? CDTIME_T_TO_DOUBLE(latency_max)
+                                      : NAN};
+  sstrncpy(vl.type_instance, "max", sizeof(vl.type_instance));
+  plugin_dispatch_values(&vl);
+
+  return 0;
+} /* int mqtt_stats_read */
+
 /*
  * <Publish "name">
  *   Host "example.com"
@@ -529,9 +988,13 @@ static int mqtt_write(const data_set_t *ds, const value_list_t *vl,
  *   CertificateFile "client-cert.pem"		optional
  *   CertificateKeyFile "client-key.pem"		optional
  *   TLSProtocol "tlsv1.2"		optional
+ *   QueueLimit 10000
+ *   BufferSize 0
+ *   CollectStatistics false
  * </Publish>
  */
 static int mqtt_config_publisher(oconfig_item_t *ci) {
+  mqtt_client_conf_t **tmp;
   mqtt_client_conf_t *conf;
   char cb_name[1024];
   int status;
@@ -556,14 +1019,18 @@ static int mqtt_config_publisher(oconfig_item_t *ci) {
   conf->qos = 0;
   conf->topic_prefix = strdup(MQTT_DEFAULT_TOPIC_PREFIX);
   conf->store_rates = 1;
+  conf->queue_limit = MQTT_DEFAULT_QUEUE_LIMIT;
 
   status = pthread_mutex_init(&conf->lock, NULL);
   if (status != 0) {
     mqtt_free(conf);
     return status;
   }
+  pthread_mutex_init(&conf->queue_lock, NULL);
+  pthread_cond_init(&conf->queue_cond, NULL);
 
   C_COMPLAIN_INIT(&conf->complaint_cantpublish);
+  C_COMPLAIN_INIT(&conf->complaint_queue_full);
 
   for (int i = 0; i < ci->children_num; i++) {
     oconfig_item_t *child = ci->children + i;
@@ -604,13 +1071,73 @@ static int mqtt_config_publisher(oconfig_item_t *ci) {
       cf_util_get_string(child, &conf->tlsprotocol);
     else if (strcasecmp("CipherSuite", child->key) == 0)
       cf_util_get_string(child, &conf->ciphersuite);
+    else if (strcasecmp("QueueLimit", child->key) == 0) {
+      int tmp = 0;
+      status = cf_util_get_int(child, &tmp);
+      if ((status != 0) || (tmp < 1))
+        ERROR("mqtt plugin: QueueLimit must be a positive number.");
+      else
+        conf->queue_limit = (size_t)tmp;
+    } else if (strcasecmp("BufferSize", child->key) == 0) {
+      int tmp = 0;
+      status = cf_util_get_int(child, &tmp);
+      if ((status != 0) || (tmp < 0))
+        ERROR("mqtt plugin: Not a valid BufferSize setting.");
+      else
+        conf->buffer_size = (size_t)tmp;
+    } else if (strcasecmp("CollectStatistics", child->key) == 0)
+      cf_util_get_boolean(child, &conf->collect_stats);
     else
       ERROR("mqtt plugin: Unknown config option: %s", child->key);
   }
 
+  if ((conf->buffer_size > 0) && (conf->qos != 0)) {
+    WARNING("mqtt plugin: BufferSize is only supported with QoS 0. Sending "
+            "one message per value list in publisher \"%s\".",
+            conf->name);
+    conf->buffer_size = 0;
+  }
+
+  if (conf->buffer_size > 0) {
+    char topic[MQTT_MAX_TOPIC_SIZE];
+
+    /* Every PUTVAL line has to fit into the buffer. */
+    if (conf->buffer_size < MQTT_MAX_MESSAGE_SIZE)
+      conf->buffer_size = MQTT_MAX_MESSAGE_SIZE;
+
+    if ((conf->topic_prefix == NULL) || (conf->topic_prefix[0] == 0))
+      sstrncpy(topic, "batch", sizeof(topic));
+    else
+      ssnprintf(topic, sizeof(topic), "%s/batch", conf->topic_prefix);
+
+    conf->buffer = malloc(conf->buffer_size);
+    conf->batch_topic = strdup(topic);
+    if ((conf->buffer == NULL) || (conf->batch_topic == NULL)) {
+      ERROR("mqtt plugin: malloc failed.");
+      mqtt_free(conf);
+      return -1;
+    }
+  }
+
+  tmp = realloc(publishers, sizeof(*publishers) * (publishers_num + 1));
+  if (tmp == NULL) {
+    ERROR("mqtt plugin: realloc failed.");
+    mqtt_free(conf);
+    return -1;
+  }
+  publishers = tmp;
+  publishers[publishers_num] = conf;
+  publishers_num++;
+
   ssnprintf(cb_name, sizeof(cb_name), "mqtt/%s", conf->name);
+  if (conf->collect_stats)
+    plugin_register_complex_read(/* group = */ NULL, cb_name, mqtt_stats_read,
+                                 /* interval = */ 0, &(user_data_t){
+                                                        .data = conf,
+                                                    });
   plugin_register_write(cb_name, mqtt_write, &(user_data_t){
                                                  .data = conf,
+                                                 .free_func = mqtt_free_cb,
                                              });
   return 0;
 } /* mqtt_config_publisher */
@@ -651,6 +1178,13 @@ static int mqtt_config_subscriber(oconfig_item_t *ci) {
   conf->topic = strdup(MQTT_DEFAULT_TOPIC);
   conf->clean_session = 1;
 
+  conf->putval = cmd_putval_parser_create(/* opts = */ NULL);
+  if (conf->putval == NULL) {
+    ERROR("mqtt plugin: cmd_putval_parser_create failed.");
+    mqtt_free(conf);
+    return -1;
+  }
+
   status = pthread_mutex_init(&conf->lock, NULL);
   if (status != 0) {
     mqtt_free(conf);
@@ -750,10 +1284,60 @@ static int mqtt_init(void) {
     }
   }
 
+  for (size_t i = 0; i < publishers_num; i++) {
+    mqtt_client_conf_t *conf = publishers[i];
+    char name[16];
+    int status;
+
+    if (conf->loop)
+      continue;
+
+    conf->loop = 1;
+    ssnprintf(name, sizeof(name), "mqtt pub %zu", i);
+    status = plugin_thread_create(&conf->thread, /* attrs = */ NULL,
+                                  publisher_thread, conf, name);
+    if (status != 0) {
+      char errbuf[1024];
+      ERROR("mqtt plugin: pthread_create failed: %s",
+            sstrerror(errno, errbuf, sizeof(errbuf)));
+      conf->loop = 0;
+      continue;
+    }
+  }
+
   return 0;
 } /* mqtt_init */
 
+static int mqtt_shutdown(void) {
+  for (size_t i = 0; i < publishers_num; i++) {
+    mqtt_client_conf_t *conf = publishers[i];
+
+    pthread_mutex_lock(&conf->queue_lock);
+    if (!conf->loop) {
+      pthread_mutex_unlock(&conf->queue_lock);
+      continue;
+    }
+    conf->loop = 0;
+    pthread_cond_signal(&conf->queue_cond);
+    pthread_mutex_unlock(&conf->queue_lock);
+
+    pthread_join(conf->thread, NULL);
+
+    if (conf->queue_length > 0)
+      WARNING("mqtt plugin: Publisher \"%s\": %zu values could not be "
+              "published before shutdown.",
+              conf->name, conf->queue_length);
+  }
+
+  /* The configurations are freed together with the write callbacks. */
+  sfree(publishers);
+  publishers_num = 0;
+
+  return 0;
+} /* mqtt_shutdown */
+
 void module_register(void) {
   plugin_register_complex_config("mqtt", mqtt_config);
   plugin_register_init("mqtt", mqtt_init);
+  plugin_register_shutdown("mqtt", mqtt_shutdown);
 } /* void module_register */
@@ -50,6 +50,22 @@
 #if HAVE_NET_IF_H
 #include <net/if.h>
 #endif
+#if HAVE_NETINET_TCP_H
+#include <netinet/tcp.h>
+#endif
+#if HAVE_SYS_EPOLL_H
+#include <sys/epoll.h>
+#endif
+#if HAVE_LIBLZ4
+#include <lz4.h>
+#endif
+#if HAVE_LIBZSTD
+#include <zstd.h>
+#endif
+#if HAVE_LIBSSL
+#include <openssl/err.h>
+#include <openssl/ssl.h>
+#endif
 
 #if HAVE_GCRYPT_H
 #if defined __APPLE__
@@ -92,6 +108,55 @@ GCRY_THREAD_OPTION_PTHREAD_IMPL;
  */
 #define BUFF_SIG_SIZE 106
 
+/*
+ * Size of the header of a compact part, in addition to the part header:
+ *
+ *   1 byte  compression
+ * + 1 byte  reserved
+ * + 2 bytes length of the uncompressed records
+ * -----------
+ * = 4 bytes
+ */
+#define COMPACT_HEADER_SIZE 4
+
+/* Slots of the hash table used to look up dictionary entries; twice the size
+ * of the dictionary, so that probe sequences stay short. */
+#define COMPACT_HASH_SIZE (2 * COMPACT_DICT_SIZE)
+
+/* With compression, the records are compressed and the size is checked
+ * whenever this many bytes less than the remaining space of the packet have
+ * been added since the last check. */
+#define COMPACT_CHECK_MARGIN 32
+
+#define COMPACT_ZSTD_LEVEL 3
+
+/*
+ * With the stream (TCP) transport, every packet is preceded by its length:
+ *
+ *   4 bytes length of the packet, in network byte order
+ * + (length) bytes packet, exactly as it would be sent via UDP
+ */
+#define STREAM_FRAME_HEADER_SIZE 4
+
+#define STREAM_DEFAULT_QUEUE_SIZE (1024 * 1024)
+#define STREAM_DEFAULT_THREADS 2
+#define STREAM_MAX_THREADS 64
+
+/* Time a connection attempt may take and the limits of the time to wait
+ * between failed attempts. */
+#define STREAM_CONNECT_TIMEOUT_MS 5000
+#define STREAM_BACKOFF_MIN TIME_T_TO_CDTIME_T_STATIC(1)
+#define STREAM_BACKOFF_MAX TIME_T_TO_CDTIME_T_STATIC(60)
+
+/* Stream connections stop reading while the receive list holds more than
+ * STREAM_RECEIVE_HIGH packets and resume once it is down to
+ * STREAM_RECEIVE_LOW, so that TCP's flow control slows down the senders. */
+#define STREAM_RECEIVE_HIGH 8192
+#define STREAM_RECEIVE_LOW 4096
+
+#define STREAM_INPUT_MIN_SIZE 16384
+#define STREAM_EPOLL_EVENTS 64
+
 /*
  * Private data types
  */
@@ -100,10 +165,36 @@ GCRY_THREAD_OPTION_PTHREAD_IMPL;
 #define SECURITY_LEVEL_SIGN 1
 #define SECURITY_LEVEL_ENCRYPT 2
 #endif
+#define SOCKENT_PROTOCOL_UDP 0
+#define SOCKENT_PROTOCOL_TCP 1
+
+struct compact_buffer_s;
+typedef struct compact_buffer_s compact_buffer_t;
+struct stream_client_s;
+typedef struct stream_client_s stream_client_t;
+
+struct sockent_tls {
+  _Bool enabled;
+  char *ca_file;
+  char *cert_file;
+  char *key_file;
+  _Bool verify_peer;
+#if HAVE_LIBSSL
+  SSL_CTX *ctx;
+#endif
+};
+
 struct sockent_client {
   int fd;
   struct sockaddr_storage *addr;
   socklen_t addrlen;
+  _Bool compact;
+  int compression;
+  compact_buffer_t *compact_buffer;
+  /* Only used with the stream transport. The stream's thread owns "fd" and
+   * "addr" then. */
+  stream_client_t *stream;
+  size_t stream_queue_size;
 #if HAVE_GCRYPT_H
   int security_level;
   char *username;
@@ -134,6 +225,8 @@ typedef struct sockent {
   char *node;
   char *service;
   int interface;
+  int protocol;
+  struct sockent_tls tls;
 
   union {
     struct sockent_client client;
@@ -250,6 +343,75 @@ struct part_encryption_aes256_s {
 };
 typedef struct part_encryption_aes256_s part_encryption_aes256_t;
 
+/*                      1 1 1 1 1 1 1 1 1 1 2 2 2 2 2 2 2 2 2 2 3 3
+ *  0 1 2 3 4 5 6 7 8 9 0 1 2 3 4 5 6 7 8 9 0 1 2 3 4 5 6 7 8 9 0 1
+ * +-------------------------------+-------------------------------+
+ * ! Type                          ! Length                        !
+ * +---------------+---------------+-------------------------------+
+ * ! Compression   ! Reserved      ! Uncompressed length           !
+ * +---------------+---------------+-------------------------------+
+ * : Records, compressed as a single block if Compression != 0     :
+ * +---------------------------------------------------------------+
+ *
+ * A record holds one value list. It starts with a byte of COMPACT_FIELD_*
+ * flags naming the fields that differ from the previous record of the part,
+ * followed by those fields in the order of the flags, followed by the values.
+ * All integers are variable length integers (7 bits per byte, least
+ * significant group first); signed integers are zig-zag encoded.
+ *
+ * - Strings are a reference: zero if a literal, the length followed by the
+ *   bytes, follows, or one plus the index of the string in the dictionary.
+ *   Literals are added to the dictionary until it holds COMPACT_DICT_SIZE
+ *   strings. Every part starts with an empty dictionary and empty strings.
+ * - The time is the signed difference to the previous record's time, which is
+ *   zero at the start of the part. The interval is sent as is. Both use
+ *   collectd's high resolution time format.
+ * - The values are their number followed by a type tag and the value for
+ *   each: counters and absolutes as unsigned integers, derives and integral
+ *   gauges (COMPACT_VALUE_GAUGE_INT) as signed integers and other gauges as
+ *   eight bytes, just like in TYPE_VALUES parts.
+ */
+struct compact_record_s {
+  uint16_t pos[5]; /* position of the identifier strings in "raw" */
+  uint8_t len[5];
+  cdtime_t time;
+  cdtime_t interval;
+};
+typedef struct compact_record_s compact_record_t;
+
+struct compact_buffer_s {
+  int compression;
+  /* Space available for the (compressed) records in a packet. */
+  size_t payload_size;
+
+  char *raw;
+  size_t raw_size;
+  size_t raw_fill;
+  size_t values_num;
+
+  /* The records are compressed and their size is checked once "raw_fill"
+   * exceeds "check_at". "compressed_fill" is the value of "raw_fill" for
+   * which "compressed" holds the compressed records, SIZE_MAX if none.
+   * Attempts go to "scratch", so that a failed one doesn't lose the last
+   * result known to fit. */
+  size_t check_at;
+  char *compressed;
+  char *scratch;
+  size_t compressed_size;
+  size_t compressed_fill;
+#if HAVE_LIBZSTD
+  ZSTD_CCtx *zstd;
+#endif
+
+  uint16_t dict_pos[COMPACT_DICT_SIZE];
+  uint8_t dict_len[COMPACT_DICT_SIZE];
+  size_t dict_num;
+  /* Dictionary index plus one, zero for unused slots. */
+  uint16_t hash[COMPACT_HASH_SIZE];
+
+  compact_record_t prev;
+};
+
 struct receive_list_entry_s {
   char *data;
   int data_len;
@@ -258,6 +420,72 @@ struct receive_list_entry_s {
 };
 typedef struct receive_list_entry_s receive_list_entry_t;
 
+/* Sending side of a stream connection. Writers append frames to "queue";
+ * the stream's thread swaps it with "batch" and writes the whole batch at
+ * once. */
+struct stream_client_s {
+  pthread_t thread;
+  _Bool running;
+  _Bool shutdown;
+
+  /* "cond" is signalled when frames have been queued and on shutdown. */
+  pthread_mutex_t lock;
+  pthread_cond_t cond;
+  c_complain_t connect_complaint;
+  c_complain_t queue_complaint;
+
+  char *queue;
+  size_t queue_size;
+  size_t queue_fill;
+
+  /* Only accessed by the stream's thread. */
+  char *batch;
+  size_t batch_fill;
+  size_t batch_sent;
+  cdtime_t backoff;
+#if HAVE_LIBSSL
+  SSL *ssl;
+#endif
+};
+
+#if HAVE_SYS_EPOLL_H
+/* Receiving side of a stream connection. A connection is only ever handled
+ * by the worker it was assigned to. */
+struct stream_conn_s;
+typedef struct stream_conn_s stream_conn_t;
+struct stream_conn_s {
+  int fd;
+  /* The listening socket the connection was accepted on; identifies the
+   * sockent in the dispatch thread. */
+  int listen_fd;
+  uint32_t events; /* registered with epoll */
+  _Bool paused;
+#if HAVE_LIBSSL
+  SSL *ssl;
+  _Bool want_write;
+#endif
+
+  char *in;
+  size_t in_size;
+  size_t in_len;
+
+  stream_conn_t *prev;
+  stream_conn_t *next;
+};
+
+typedef struct {
+  pthread_t thread;
+  _Bool running;
+  int epoll_fd;
+
+  /* "lock" protects the list, which is only modified when connections are
+   * added or closed. */
+  stream_conn_t *conns;
+  size_t paused_num;
+  pthread_mutex_t lock;
+} stream_worker_t;
+#endif /* HAVE_SYS_EPOLL_H */
+
 /*
  * Private variables
  */
@@ -279,6 +507,19 @@ static sockent_t *listen_sockets = NULL;
 static struct pollfd *listen_sockets_pollfd = NULL;
 static size_t listen_sockets_num = 0;
 
+/* Listening stream sockets, handled by the stream threads. */
+static struct pollfd *stream_listen_pollfd = NULL;
+static size_t stream_listen_num = 0;
+static int stream_threads = STREAM_DEFAULT_THREADS;
+#if HAVE_SYS_EPOLL_H
+static stream_worker_t *stream_workers = NULL;
+static size_t stream_workers_num = 0;
+static pthread_t stream_accept_thread_id;
+static _Bool stream_accept_thread_running = 0;
+/* Written to on shutdown; the read end is polled by all stream threads. */
+static int stream_shutdown_pipe[2] = {-1, -1};
+#endif
+
 /* The receive and dispatch threads will run as long as `listen_loop' is set to
  * zero. */
 static int listen_loop = 0;
@@ -293,6 +534,8 @@ static char *send_buffer_ptr;
 static int send_buffer_fill;
 static cdtime_t send_buffer_last_update;
 static value_list_t send_buffer_vl = VALUE_LIST_INIT;
+/* Set if at least one server receives the classic format. */
+static _Bool send_buffer_classic = 1;
 static pthread_mutex_t send_buffer_lock = PTHREAD_MUTEX_INITIALIZER;
 
 /* XXX: These counters are incremented from one place only. The spot in which
@@ -304,6 +547,11 @@ static pthread_mutex_t send_buffer_lock = PTHREAD_MUTEX_INITIALIZER;
 static derive_t stats_octets_rx = 0;
 static derive_t stats_octets_tx = 0;
 static derive_t stats_packets_rx = 0;
+/* Received by the stream threads; incremented under receive_list_lock. */
+static derive_t stats_stream_octets_rx = 0;
+static derive_t stats_stream_packets_rx = 0;
+/* Packets not fitting into the send queue of a stream. Updated atomically. */
+static derive_t stats_stream_packets_dropped = 0;
 static derive_t stats_packets_tx = 0;
 static derive_t stats_values_dispatched = 0;
 static derive_t stats_values_not_dispatched = 0;
@@ -736,6 +984,400 @@ static int write_part_string(char **ret_buffer, size_t *ret_buffer_len,
   return 0;
 } /* int write_part_string */
 
+static uint32_t compact_hash(const char *str, size_t len) /* {{{ */
+{
+  /* FNV-1a */
+  uint32_t hash = 2166136261U;
+
+  for (size_t i = 0; i < len; i++) {
+    hash ^= (uint8_t)str[i];
+    hash *= 16777619U;
+  }
+
+  return hash;
+} /* }}} uint32_t compact_hash */
+
+static void compact_buffer_reset(compact_buffer_t *cb) /* {{{ */
+{
+  cb->raw_fill = 0;
+  cb->values_num = 0;
+  cb->compressed_fill = SIZE_MAX;
+  cb->compressed_size = 0;
+
+  if (cb->compression == COMPACT_COMPRESSION_NONE)
+    cb->check_at = SIZE_MAX;
+  else
+    cb->check_at = cb->payload_size;
+
+  cb->dict_num = 0;
+  memset(cb->hash, 0, sizeof(cb->hash));
+  memset(&cb->prev, 0, sizeof(cb->prev));
+} /* }}} void compact_buffer_reset */
+
+static void compact_buffer_destroy(compact_buffer_t *cb) /* {{{ */
+{
+  if (cb == NULL)
+    return;
+
+#if HAVE_LIBZSTD
+  if (cb->zstd != NULL)
+    ZSTD_freeCCtx(cb->zstd);
+#endif
+  sfree(cb->raw);
+  sfree(cb->compressed);
+  sfree(cb->scratch);
+  sfree(cb);
+} /* }}} void compact_buffer_destroy */
+
+/* Creates a buffer for the compact parts of packets of "packet_size" bytes. */
+static compact_buffer_t *compact_buffer_create(int compression, /* {{{ */
+                                               size_t packet_size) {
+  compact_buffer_t *cb;
+
+  cb = calloc(1, sizeof(*cb));
+  if (cb == NULL)
+    return NULL;
+
+  cb->compression = compression;
+  cb->payload_size = packet_size - (BUFF_SIG_SIZE + sizeof(part_header_t) +
+                                    COMPACT_HEADER_SIZE);
+
+  /* Without compression the records have to fit into the packet as they are.
+   * With compression, collect as many records as are likely to fit once
+   * compressed; the "Uncompressed length" field limits the size. */
+  if (compression == COMPACT_COMPRESSION_NONE) {
+    cb->raw_size = cb->payload_size;
+  } else {
+    cb->raw_size = 8 * cb->payload_size;
+    if (cb->raw_size > UINT16_MAX)
+      cb->raw_size = UINT16_MAX;
+
+    cb->compressed = malloc(cb->payload_size);
+    cb->scratch = malloc(cb->payload_size);
+    if ((cb->compressed == NULL) || (cb->scratch == NULL)) {
+      compact_buffer_destroy(cb);
+      return NULL;
+    }
+  }
+
+#if HAVE_LIBZSTD
+  if (compression == COMPACT_COMPRESSION_ZSTD) {
+    cb->zstd = ZSTD_createCCtx();
+    if (cb->zstd == NULL) {
+      compact_buffer_destroy(cb);
+      return NULL;
+    }
+  }
+#endif
+
+  cb->raw = malloc(cb->raw_size);
+  if (cb->raw == NULL) {
+    compact_buffer_destroy(cb);
+    return NULL;
+  }
+
+  compact_buffer_reset(cb);
+  return cb;
+} /* }}} compact_buffer_t *compact_buffer_create */
+
+static int compact_put_varint(compact_buffer_t *cb, uint64_t value) /* {{{ */
+{
+  while (42) {
+    if (cb->raw_fill >= cb->raw_size)
+      return -1;
+
+    if (value < 0x80) {
+      cb->raw[cb->raw_fill++] = (char)value;
+      return 0;
+    }
+
+    cb->raw[cb->raw_fill++] = (char)(0x80 | (value & 0x7f));
+    value >>= 7;
+  }
+} /* }}} int compact_put_varint */
+
+static int compact_put_signed(compact_buffer_t *cb, int64_t value) /* {{{ */
+{
+  return compact_put_varint(cb, (((uint64_t)value) << 1) ^
+                                    ((uint64_t)(value >> 63)));
+} /* }}} int compact_put_signed */
+
+static int compact_put_bytes(compact_buffer_t *cb, /* {{{ */
+                             const void *data, size_t size) {
+  if (size > (cb->raw_size - cb->raw_fill))
+    return -1;
+
+  memcpy(cb->raw + cb->raw_fill, data, size);
+  cb->raw_fill += size;
+  return 0;
+} /* }}} int compact_put_bytes */
+
+/* Writes the reference to the "field"th identifier string, if it differs
+ * from the previous record's, and sets the field's flag. */
+static int compact_put_string(compact_buffer_t *cb, int field, /* {{{ */
+                              const char *str, uint8_t *flags) {
+  size_t len = strlen(str);
+  uint32_t slot;
+  size_t pos;
+
+  if ((len == cb->prev.len[field]) &&
+      (memcmp(cb->raw + cb->prev.pos[field], str, len) == 0))
+    return 0;
+
+  *flags |= (uint8_t)(1 << field);
+
+  slot = compact_hash(str, len) % COMPACT_HASH_SIZE;
+  while (cb->hash[slot] != 0) {
+    size_t idx = cb->hash[slot] - 1;
+
+    if ((cb->dict_len[idx] == len) &&
+        (memcmp(cb->raw + cb->dict_pos[idx], str, len) == 0)) {
+      if (compact_put_varint(cb, (uint64_t)idx + 1) != 0)
+        return -1;
+      cb->prev.pos[field] = cb->dict_pos[idx];
+      cb->prev.len[field] = (uint8_t)len;
+      return 0;
+    }
+
+    slot = (slot + 1) % COMPACT_HASH_SIZE;
+  }
+
+  if ((compact_put_varint(cb, 0) != 0) ||
+      (compact_put_varint(cb, (uint64_t)len) != 0))
+    return -1;
+  pos = cb->raw_fill;
+  if (compact_put_bytes(cb, str, len) != 0)
+    return -1;
+
+  if (cb->dict_num < COMPACT_DICT_SIZE) {
+    cb->dict_pos[cb->dict_num] = (uint16_t)pos;
+    cb->dict_len[cb->dict_num] = (uint8_t)len;
+    cb->dict_num++;
+    cb->hash[slot] = (uint16_t)cb->dict_num;
+  }
+
+  cb->prev.pos[field] = (uint16_t)pos;
+  cb->prev.len[field] = (uint8_t)len;
+  return 0;
+} /* }}} int compact_put_string */
+
+static int compact_put_values(compact_buffer_t *cb, /* {{{ */
+                              const data_set_t *ds, const value_list_t *vl) {
+  if (compact_put_varint(cb, (uint64_t)vl->values_len) != 0)
+    return -1;
+
+  for (size_t i = 0; i < vl->values_len; i++) {
+    uint8_t tag = (uint8_t)ds->ds[i].type;
+    int status;
+
+    switch (ds->ds[i].type) {
+    case DS_TYPE_COUNTER:
+      status = compact_put_bytes(cb, &tag, sizeof(tag)) ||
+               compact_put_varint(cb, (uint64_t)vl->values[i].counter);
+      break;
+
+    case DS_TYPE_GAUGE: {
+      gauge_t gauge = vl->values[i].gauge;
+
+      /* Integral gauges, such as numbers of processes or users, are sent
+       * as integers. The range check also rules out NaN. */
+      if ((gauge >= -9007199254740992.0) && (gauge <= 9007199254740992.0) &&
+          (gauge == (gauge_t)(int64_t)gauge) &&
+          ((gauge != 0.0) || !signbit(gauge))) {
+        tag = COMPACT_VALUE_GAUGE_INT;
+        status = compact_put_bytes(cb, &tag, sizeof(tag)) ||
+                 compact_put_signed(cb, (int64_t)gauge);
+      } else {
+        gauge = htond(gauge);
+        status = compact_put_bytes(cb, &tag, sizeof(tag)) ||
+                 compact_put_bytes(cb, &gauge, sizeof(gauge));
+      }
+      break;
+    }
+
+    case DS_TYPE_DERIVE:
+      status = compact_put_bytes(cb, &tag, sizeof(tag)) ||
+               compact_put_signed(cb, (int64_t)vl->values[i].derive);
+      break;
+
+    case DS_TYPE_ABSOLUTE:
+      status = compact_put_bytes(cb, &tag, sizeof(tag)) ||
+               compact_put_varint(cb, (uint64_t)vl->values[i].absolute);
+      break;
+
+    default:
+      ERROR("network plugin: compact_put_values: "
+            "Unknown data source type: %i",
+            ds->ds[i].type);
+      return -1;
+    }
+
+    if (status != 0)
+      return -1;
+  }
+
+  return 0;
+} /* }}} int compact_put_values */
+
+/* Compresses all records into "cb->compressed". Returns non-zero if they
+ * don't fit into a packet. */
+static int compact_compress(compact_buffer_t *cb) /* {{{ */
+{
+  size_t size = 0;
+  char *tmp;
+
+  if (cb->compressed_fill == cb->raw_fill)
+    return 0;
+
+#if HAVE_LIBLZ4
+  if (cb->compression == COMPACT_COMPRESSION_LZ4) {
+    int status = LZ4_compress_default(cb->raw, cb->scratch,
+                                      (int)cb->raw_fill, (int)cb->payload_size);
+    if (status <= 0)
+      return -1;
+    size = (size_t)status;
+  }
+#endif
+#if HAVE_LIBZSTD
+  if (cb->compression == COMPACT_COMPRESSION_ZSTD) {
+    size_t status =
+        ZSTD_compressCCtx(cb->zstd, cb->scratch, cb->payload_size, cb->raw,
+                          cb->raw_fill, COMPACT_ZSTD_LEVEL);
+    if (ZSTD_isError(status))
+      return -1;
+    size = status;
+  }
+#endif
+
+  if ((size == 0) || (size > cb->payload_size))
+    return -1;
+
+  tmp = cb->compressed;
+  cb->compressed = cb->scratch;
+  cb->scratch = tmp;
+  cb->compressed_size = size;
+  cb->compressed_fill = cb->raw_fill;
+  return 0;
+} /* }}} int compact_compress */
+
+/* Restores the state saved before adding a record. */
+static void compact_rollback(compact_buffer_t *cb, /* {{{ */
+                             size_t raw_fill, size_t dict_num,
+                             const compact_record_t *prev) {
+  /* The strings added to the dictionary by the record were inserted into the
+   * hash table last, so removing them doesn't break other probe sequences. */
+  for (size_t idx = dict_num; idx < cb->dict_num; idx++) {
+    uint32_t slot =
+        compact_hash(cb->raw + cb->dict_pos[idx], cb->dict_len[idx]) %
+        COMPACT_HASH_SIZE;
+
+    while (cb->hash[slot] != (uint16_t)(idx + 1))
+      slot = (slot + 1) % COMPACT_HASH_SIZE;
+    cb->hash[slot] = 0;
+  }
+
+  cb->raw_fill = raw_fill;
+  cb->dict_num = dict_num;
+  cb->prev = *prev;
+} /* }}} void compact_rollback */
+
+/* Appends a record for "vl". Returns non-zero, leaving the buffer unchanged,
+ * if the record doesn't fit into the packet anymore. */
+static int compact_buffer_add(compact_buffer_t *cb, /* {{{ */
+                              const data_set_t *ds, const value_list_t *vl) {
+  size_t raw_fill = cb->raw_fill;
+  size_t dict_num = cb->dict_num;
+  compact_record_t prev = cb->prev;
+  uint8_t flags = 0;
+  int status;
+
+  /* The flags are filled in once the fields are known. */
+  if (compact_put_bytes(cb, &flags, sizeof(flags)) != 0)
+    return -1;
+
+  status = compact_put_string(cb, 0, vl->host, &flags) ||
+           compact_put_string(cb, 1, vl->plugin, &flags) ||
+           compact_put_string(cb, 2, vl->plugin_instance, &flags) ||
+           compact_put_string(cb, 3, vl->type, &flags) ||
+           compact_put_string(cb, 4, vl->type_instance, &flags);
+
+  if ((status == 0) && (vl->time != cb->prev.time)) {
+    flags |= COMPACT_FIELD_TIME;
+    status = compact_put_signed(cb, (int64_t)(vl->time - cb->prev.time));
+    cb->prev.time = vl->time;
+  }
+
+  if ((status == 0) && (vl->interval != cb->prev.interval)) {
+    flags |= COMPACT_FIELD_INTERVAL;
+    status = compact_put_varint(cb, (uint64_t)vl->interval);
+    cb->prev.interval = vl->interval;
+  }
+
+  if (status == 0) {
+    cb->raw[raw_fill] = (char)flags;
+    status = compact_put_values(cb, ds, vl);
+  }
+
+  if ((status == 0) && (cb->raw_fill > cb->check_at)) {
+    status = compact_compress(cb);
+    if (status == 0) {
+      size_t gap = cb->payload_size - cb->compressed_size;
+
+      cb->check_at = cb->raw_fill;
+      if (gap > COMPACT_CHECK_MARGIN)
+        cb->check_at += (gap - COMPACT_CHECK_MARGIN) - (gap / 8);
+    }
+  }
+
+  if (status != 0) {
+    compact_rollback(cb, raw_fill, dict_num, &prev);
+    return -1;
+  }
+
+  cb->values_num++;
+  return 0;
+} /* }}} int compact_buffer_add */
+
+/* Writes the compact part holding all records to "buffer". Returns the number
+ * of bytes written or -1 on failure. */
+static int compact_buffer_finalize(compact_buffer_t *cb, /* {{{ */
+                                   char *buffer, size_t buffer_size) {
+  const char *payload = cb->raw;
+  size_t payload_size = cb->raw_fill;
+  uint8_t compression = COMPACT_COMPRESSION_NONE;
+  uint16_t tmp16;
+  size_t offset;
+
+  if (cb->compression != COMPACT_COMPRESSION_NONE) {
+    if ((compact_compress(cb) == 0) && (cb->compressed_size < cb->raw_fill)) {
+      payload = cb->compressed;
+      payload_size = cb->compressed_size;
+      compression = (uint8_t)cb->compression;
+    } else if (cb->raw_fill > cb->payload_size) {
+      ERROR("network plugin: The compressed value lists don't fit into a "
+            "packet. Dropping %zu value lists.",
+            cb->values_num);
+      return -1;
+    }
+  }
+
+  offset = sizeof(part_header_t) + COMPACT_HEADER_SIZE + payload_size;
+  if (offset > buffer_size)
+    return -1;
+
+  tmp16 = htons(TYPE_COMPACT);
+  memcpy(buffer, &tmp16, sizeof(tmp16));
+  tmp16 = htons((uint16_t)offset);
+  memcpy(buffer + 2, &tmp16, sizeof(tmp16));
+  buffer[4] = (char)compression;
+  buffer[5] = 0;
+  tmp16 = htons((uint16_t)cb->raw_fill);
+  memcpy(buffer + 6, &tmp16, sizeof(tmp16));
+  memcpy(buffer + 8, payload, payload_size);
+
+  return (int)offset;
+} /* }}} int compact_buffer_finalize */
+
 static int parse_part_values(void **ret_buffer, size_t *ret_buffer_len,
                              value_t **ret_values, size_t *ret_num_values) {
   char *buffer = *ret_buffer;
@@ -965,74 +1607,398 @@ static int parse_part_string(void **ret_buffer, size_t *ret_buffer_len,
   return 0;
 } /* int parse_part_string */
 
-/* Forward declaration: parse_part_sign_sha256 and parse_part_encr_aes256 call
- * parse_packet and vice versa. */
-#define PP_SIGNED 0x01
-#define PP_ENCRYPTED 0x02
-static int parse_packet(sockent_t *se, void *buffer, size_t buffer_size,
-                        int flags, const char *username);
-
-#define BUFFER_READ(p, s)                                                      \
-  do {                                                                         \
-    memcpy((p), buffer + buffer_offset, (s));                                  \
-    buffer_offset += (s);                                                      \
-  } while (0)
+static int compact_get_varint(const char **ptr, const char *end, /* {{{ */
+                              uint64_t *ret_value) {
+  uint64_t value = 0;
 
-#if HAVE_GCRYPT_H
-static int parse_part_sign_sha256(sockent_t *se, /* {{{ */
-                                  void **ret_buffer, size_t *ret_buffer_len,
-                                  int flags) {
-  static c_complain_t complain_no_users = C_COMPLAIN_INIT_STATIC;
+  for (unsigned int shift = 0; shift < 64; shift += 7) {
+    uint8_t byte;
 
-  char *buffer;
-  size_t buffer_len;
-  size_t buffer_offset;
+    if (*ptr >= end)
+      return -1;
+    byte = (uint8_t)(**ptr);
+    (*ptr)++;
 
-  size_t username_len;
-  char *secret;
+    value |= ((uint64_t)(byte & 0x7f)) << shift;
+    if ((byte & 0x80) == 0) {
+      *ret_value = value;
+      return 0;
+    }
+  }
 
-  part_signature_sha256_t pss;
-  uint16_t pss_head_length;
-  char hash[sizeof(pss.hash)];
+  return -1;
+} /* }}} int compact_get_varint */
 
-  gcry_md_hd_t hd;
-  gcry_error_t err;
-  unsigned char *hash_ptr;
+static int compact_get_signed(const char **ptr, const char *end, /* {{{ */
+                              int64_t *ret_value) {
+  uint64_t tmp;
 
-  buffer = *ret_buffer;
-  buffer_len = *ret_buffer_len;
-  buffer_offset = 0;
+  if (compact_get_varint(ptr, end, &tmp) != 0)
+    return -1;
 
-  /* Check if the buffer has enough data for this structure. */
-  if (buffer_len <= PART_SIGNATURE_SHA256_SIZE)
-    return -ENOMEM;
+  *ret_value = (int64_t)((tmp >> 1) ^ (~(tmp & 1) + 1));
+  return 0;
+} /* }}} int compact_get_signed */
 
-  /* Read type and length header */
-  BUFFER_READ(&pss.head.type, sizeof(pss.head.type));
-  BUFFER_READ(&pss.head.length, sizeof(pss.head.length));
-  pss_head_length = ntohs(pss.head.length);
+static int compact_get_string(const char **ptr, const char *end, /* {{{ */
+                              const char **dict, size_t *dict_len,
+                              size_t *dict_num, char *output,
+                              size_t output_size) {
+  uint64_t ref;
+  const char *str;
+  size_t len;
 
-  /* Check if the `pss_head_length' is within bounds. */
-  if ((pss_head_length <= PART_SIGNATURE_SHA256_SIZE) ||
-      (pss_head_length > buffer_len)) {
-    ERROR("network plugin: HMAC-SHA-256 with invalid length received.");
+  if (compact_get_varint(ptr, end, &ref) != 0)
     return -1;
-  }
 
-  if (se->data.server.userdb == NULL) {
-    c_complain(
-        LOG_NOTICE, &complain_no_users,
-        "network plugin: Received signed network packet but can't verify it "
-        "because no user DB has been configured. Will accept it.");
+  if (ref == 0) {
+    uint64_t tmp;
 
-    *ret_buffer = buffer + pss_head_length;
-    *ret_buffer_len -= pss_head_length;
+    if ((compact_get_varint(ptr, end, &tmp) != 0) ||
+        (tmp > (uint64_t)(end - *ptr)))
+      return -1;
+    str = *ptr;
+    len = (size_t)tmp;
+    *ptr += len;
+
+    if (*dict_num < COMPACT_DICT_SIZE) {
+      dict[*dict_num] = str;
+      dict_len[*dict_num] = len;
+      (*dict_num)++;
+    }
+  } else if (ref <= *dict_num) {
+    str = dict[ref - 1];
+    len = dict_len[ref - 1];
+  } else {
+    WARNING("network plugin: parse_part_compact: "
+            "Reference to unknown string %" PRIu64 ".",
+            ref);
+    return -1;
+  }
 
-    return 0;
+  if (len >= output_size) {
+    WARNING("network plugin: parse_part_compact: "
+            "Received string of %zu bytes is too long.",
+            len);
+    return -1;
   }
 
-  /* Copy the hash. */
-  BUFFER_READ(pss.hash, sizeof(pss.hash));
+  memcpy(output, str, len);
+  output[len] = 0;
+  return 0;
+} /* }}} int compact_get_string */
+
+static int compact_get_values(const char **ptr, const char *end, /* {{{ */
+                              value_list_t *vl) {
+  uint64_t num;
+
+  /* Every value takes at least two bytes. */
+  if ((compact_get_varint(ptr, end, &num) != 0) || (num == 0) ||
+      (num > (uint64_t)(end - *ptr) / 2))
+    return -1;
+
+  vl->values = calloc((size_t)num, sizeof(*vl->values));
+  if (vl->values == NULL) {
+    ERROR("network plugin: parse_part_compact: calloc failed.");
+    return -1;
+  }
+  vl->values_len = (size_t)num;
+
+  for (size_t i = 0; i < vl->values_len; i++) {
+    uint8_t tag;
+    uint64_t tmp;
+    int64_t stmp;
+    gauge_t gauge;
+
+    if (*ptr >= end)
+      return -1;
+    tag = (uint8_t)(**ptr);
+    (*ptr)++;
+
+    switch (tag) {
+    case DS_TYPE_COUNTER:
+      if (compact_get_varint(ptr, end, &tmp) != 0)
+        return -1;
+      vl->values[i].counter = (counter_t)tmp;
+      break;
+
+    case DS_TYPE_GAUGE:
+      if ((size_t)(end - *ptr) < sizeof(gauge))
+        return -1;
+      memcpy(&gauge, *ptr, sizeof(gauge));
+      *ptr += sizeof(gauge);
+      vl->values[i].gauge = ntohd(gauge);
+      break;
+
+    case COMPACT_VALUE_GAUGE_INT:
+      if (compact_get_signed(ptr, end, &stmp) != 0)
+        return -1;
+      vl->values[i].gauge = (gauge_t)stmp;
+      break;
+
+    case DS_TYPE_DERIVE:
+      if (compact_get_signed(ptr, end, &stmp) != 0)
+        return -1;
+      vl->values[i].derive = (derive_t)stmp;
+      break;
+
+    case DS_TYPE_ABSOLUTE:
+      if (compact_get_varint(ptr, end, &tmp) != 0)
+        return -1;
+      vl->values[i].absolute = (absolute_t)tmp;
+      break;
+
+    default:
+      NOTICE("network plugin: parse_part_compact: "
+             "Don't know how to handle data source type %" PRIu8,
+             tag);
+      return -1;
+    }
+  }
+
+  return 0;
+} /* }}} int compact_get_values */
+
+/* Decodes the records of a compact part and dispatches their value lists. */
+static int compact_parse_records(const char *raw, size_t raw_size, /* {{{ */
+                                 const char *username) {
+  const char *ptr = raw;
+  const char *end = raw + raw_size;
+
+  const char *dict[COMPACT_DICT_SIZE];
+  size_t dict_len[COMPACT_DICT_SIZE];
+  size_t dict_num = 0;
+
+  value_list_t vl = VALUE_LIST_INIT;
+  char *fields[] = {vl.host, vl.plugin, vl.plugin_instance, vl.type,
+                    vl.type_instance};
+  size_t const fields_size[] = {sizeof(vl.host), sizeof(vl.plugin),
+                                sizeof(vl.plugin_instance), sizeof(vl.type),
+                                sizeof(vl.type_instance)};
+
+  while (ptr < end) {
+    uint8_t flags = (uint8_t)(*ptr);
+    int status = 0;
+
+    ptr++;
+    if (flags & ~(COMPACT_FIELD_HOST | COMPACT_FIELD_PLUGIN |
+                  COMPACT_FIELD_PLUGIN_INSTANCE | COMPACT_FIELD_TYPE |
+                  COMPACT_FIELD_TYPE_INSTANCE | COMPACT_FIELD_TIME |
+                  COMPACT_FIELD_INTERVAL)) {
+      WARNING("network plugin: parse_part_compact: "
+              "Unknown record flags 0x%02" PRIx8 ".",
+              flags);
+      return -1;
+    }
+
+    for (size_t i = 0; (status == 0) && (i < STATIC_ARRAY_SIZE(fields)); i++)
+      if (flags & (1 << i))
+        status = compact_get_string(&ptr, end, dict, dict_len, &dict_num,
+                                    fields[i], fields_size[i]);
+
+    if ((status == 0) && (flags & COMPACT_FIELD_TIME)) {
+      int64_t delta = 0;
+      status = compact_get_signed(&ptr, end, &delta);
+      vl.time = (cdtime_t)(vl.time + (uint64_t)delta);
+    }
+
+    if ((status == 0) && (flags & COMPACT_FIELD_INTERVAL)) {
+      uint64_t tmp = 0;
+      status = compact_get_varint(&ptr, end, &tmp);
+      vl.interval = (cdtime_t)tmp;
+    }
+
+    if (status == 0)
+      status = compact_get_values(&ptr, end, &vl);
+
+    if (status != 0) {
+      WARNING("network plugin: parse_part_compact: "
+              "Received malformed record.");
+      sfree(vl.values);
+      return -1;
+    }
+
+    network_dispatch_values(&vl, username);
+    sfree(vl.values);
+    vl.values_len = 0;
+  }
+
+  return 0;
+} /* }}} int compact_parse_records */
+
+static int parse_part_compact(void **ret_buffer, size_t *ret_buffer_len,
+                              const char *username) /* {{{ */
+{
+  static c_complain_t complain_compression = C_COMPLAIN_INIT_STATIC;
+
+  char *buffer = *ret_buffer;
+  size_t buffer_len = *ret_buffer_len;
+  size_t const header_size = sizeof(part_header_t) + COMPACT_HEADER_SIZE;
+
+  uint16_t tmp16;
+  uint16_t pkg_length;
+  uint8_t compression;
+  size_t raw_size;
+
+  char *payload;
+  size_t payload_size;
+  char *raw;
+  int status;
+
+  if (buffer_len < header_size) {
+    WARNING("network plugin: parse_part_compact: "
+            "Packet too short: "
+            "Chunk of at least size %zu expected, "
+            "but buffer has only %zu bytes left.",
+            header_size, buffer_len);
+    return -1;
+  }
+
+  memcpy((void *)&tmp16, buffer + sizeof(uint16_t), sizeof(tmp16));
+  pkg_length = ntohs(tmp16);
+  if ((pkg_length < header_size) || (pkg_length > buffer_len)) {
+    WARNING("network plugin: parse_part_compact: "
+            "Invalid part length %" PRIu16 ".",
+            pkg_length);
+    return -1;
+  }
+
+  compression = (uint8_t)buffer[sizeof(part_header_t)];
+  memcpy((void *)&tmp16, buffer + sizeof(part_header_t) + 2, sizeof(tmp16));
+  raw_size = (size_t)ntohs(tmp16);
+
+  payload = buffer + header_size;
+  payload_size = ((size_t)pkg_length) - header_size;
+
+  *ret_buffer = buffer + pkg_length;
+  *ret_buffer_len = buffer_len - pkg_length;
+
+  if (compression == COMPACT_COMPRESSION_NONE) {
+    if (payload_size != raw_size) {
+      WARNING("network plugin: parse_part_compact: "
+              "Length of the records doesn't match the part's length.");
+      return -1;
+    }
+    return compact_parse_records(payload, raw_size, username);
+  }
+
+  if ((compression != COMPACT_COMPRESSION_LZ4) &&
+      (compression != COMPACT_COMPRESSION_ZSTD)) {
+    WARNING("network plugin: parse_part_compact: "
+            "Unknown compression %" PRIu8 ".",
+            compression);
+    return -1;
+  }
+
+  raw = malloc(raw_size + 1);
+  if (raw == NULL) {
+    ERROR("network plugin: parse_part_compact: malloc failed.");
+    return -1;
+  }
+
+  status = ENOTSUP;
+#if HAVE_LIBLZ4
+  if (compression == COMPACT_COMPRESSION_LZ4) {
+    int size = LZ4_decompress_safe(payload, raw, (int)payload_size,
+                                   (int)raw_size);
+    status = (size == (int)raw_size) ? 0 : -1;
+  }
+#endif
+#if HAVE_LIBZSTD
+  if (compression == COMPACT_COMPRESSION_ZSTD) {
+    size_t size = ZSTD_decompress(raw, raw_size, payload, payload_size);
+    status = (!ZSTD_isError(size) && (size == raw_size)) ? 0 : -1;
+  }
+#endif
+
+  if (status == ENOTSUP) {
+    /* The remaining parts may still be usable. */
+    c_complain(LOG_WARNING, &complain_compression,
+               "network plugin: Ignoring value lists compressed with %s, "
+               "which this build of collectd doesn't support.",
+               (compression == COMPACT_COMPRESSION_LZ4) ? "LZ4" : "Zstd");
+    sfree(raw);
+    return 0;
+  } else if (status != 0) {
+    WARNING("network plugin: parse_part_compact: "
+            "Decompressing the records failed.");
+    sfree(raw);
+    return -1;
+  }
+
+  status = compact_parse_records(raw, raw_size, username);
+  sfree(raw);
+  return status;
+} /* }}} int parse_part_compact */
+
+/* Forward declaration: parse_part_sign_sha256 and parse_part_encr_aes256 call
+ * parse_packet and vice versa. */
+#define PP_SIGNED 0x01
+#define PP_ENCRYPTED 0x02
+static int parse_packet(sockent_t *se, void *buffer, size_t buffer_size,
+                        int flags, const char *username);
+
+#define BUFFER_READ(p, s)                                                      \
+  do {                                                                         \
+    memcpy((p), buffer + buffer_offset, (s));                                  \
+    buffer_offset += (s);                                                      \
+  } while (0)
+
+#if HAVE_GCRYPT_H
+static int parse_part_sign_sha256(sockent_t *se, /* {{{ */
+                                  void **ret_buffer, size_t *ret_buffer_len,
+                                  int flags) {
+  static c_complain_t complain_no_users = C_COMPLAIN_INIT_STATIC;
+
+  char *buffer;
+  size_t buffer_len;
+  size_t buffer_offset;
+
+  size_t username_len;
+  char *secret;
+
+  part_signature_sha256_t pss;
+  uint16_t pss_head_length;
+  char hash[sizeof(pss.hash)];
+
+  gcry_md_hd_t hd;
+  gcry_error_t err;
+  unsigned char *hash_ptr;
+
+  buffer = *ret_buffer;
+  buffer_len = *ret_buffer_len;
+  buffer_offset = 0;
+
+  /* Check if the buffer has enough data for this structure. */
+  if (buffer_len <= PART_SIGNATURE_SHA256_SIZE)
+    return -ENOMEM;
+
+  /* Read type and length header */
+  BUFFER_READ(&pss.head.type, sizeof(pss.head.type));
+  BUFFER_READ(&pss.head.length, sizeof(pss.head.length));
+  pss_head_length = ntohs(pss.head.length);
+
+  /* Check if the `pss_head_length' is within bounds. */
+  if ((pss_head_length <= PART_SIGNATURE_SHA256_SIZE) ||
+      (pss_head_length > buffer_len)) {
+    ERROR("network plugin: HMAC-SHA-256 with invalid length received.");
+    return -1;
+  }
+
+  if (se->data.server.userdb == NULL) {
+    c_complain(
+        LOG_NOTICE, &complain_no_users,
+        "network plugin: Received signed network packet but can't verify it "
+        "because no user DB has been configured. Will accept it.");
+
+    *ret_buffer = buffer + pss_head_length;
+    *ret_buffer_len -= pss_head_length;
+
+    return 0;
+  }
+
+  /* Copy the hash. */
+  BUFFER_READ(pss.hash, sizeof(pss.hash));
 
   /* Calculate username length (without null byte) and allocate memory */
   username_len = pss_head_length - PART_SIGNATURE_SHA256_SIZE;
@@ -1480,6 +2446,8 @@ static int parse_packet(sockent_t *se, /* {{{ */
       status = parse_part_number(&buffer, &buffer_size, &tmp);
       if (status == 0)
         n.severity = (int)tmp;
+    } else if (pkg_type == TYPE_COMPACT) {
+      status = parse_part_compact(&buffer, &buffer_size, username);
     } else {
       DEBUG("network plugin: parse_packet: Unknown part"
             " type: 0x%04hx",
@@ -1496,6 +2464,23 @@ static int parse_packet(sockent_t *se, /* {{{ */
   return status;
 } /* }}} int parse_packet */
 
+/* The stream's thread must have been stopped. */
+static void stream_client_destroy(stream_client_t *sc) /* {{{ */
+{
+  if (sc == NULL)
+    return;
+
+#if HAVE_LIBSSL
+  if (sc->ssl != NULL)
+    SSL_free(sc->ssl);
+#endif
+  pthread_mutex_destroy(&sc->lock);
+  pthread_cond_destroy(&sc->cond);
+  sfree(sc->queue);
+  sfree(sc->batch);
+  sfree(sc);
+} /* }}} void stream_client_destroy */
+
 static void free_sockent_client(struct sockent_client *sec) /* {{{ */
 {
   if (sec->fd >= 0) {
@@ -1503,6 +2488,10 @@ static void free_sockent_client(struct sockent_client *sec) /* {{{ */
     sec->fd = -1;
   }
   sfree(sec->addr);
+  compact_buffer_destroy(sec->compact_buffer);
+  sec->compact_buffer = NULL;
+  stream_client_destroy(sec->stream);
+  sec->stream = NULL;
 #if HAVE_GCRYPT_H
   sfree(sec->username);
   sfree(sec->password);
@@ -1540,6 +2529,13 @@ static void sockent_destroy(sockent_t *se) /* {{{ */
 
     sfree(se->node);
     sfree(se->service);
+    sfree(se->tls.ca_file);
+    sfree(se->tls.cert_file);
+    sfree(se->tls.key_file);
+#if HAVE_LIBSSL
+    if (se->tls.ctx != NULL)
+      SSL_CTX_free(se->tls.ctx);
+#endif
 
     if (se->type == SOCKENT_TYPE_CLIENT)
       free_sockent_client(&se->data.client);
@@ -1845,6 +2841,8 @@ static sockent_t *sockent_create(int type) /* {{{ */
   se->node = NULL;
   se->service = NULL;
   se->interface = 0;
+  se->protocol = SOCKENT_PROTOCOL_UDP;
+  se->tls.verify_peer = 1;
   se->next = NULL;
 
   if (type == SOCKENT_TYPE_SERVER) {
@@ -1861,6 +2859,11 @@ static sockent_t *sockent_create(int type) /* {{{ */
     se->data.client.addr = NULL;
     se->data.client.resolve_interval = 0;
     se->data.client.next_resolve_reconnect = 0;
+    se->data.client.compact = 0;
+    se->data.client.compression = COMPACT_COMPRESSION_NONE;
+    se->data.client.compact_buffer = NULL;
+    se->data.client.stream = NULL;
+    se->data.client.stream_queue_size = STREAM_DEFAULT_QUEUE_SIZE;
 #if HAVE_GCRYPT_H
     se->data.client.security_level = SECURITY_LEVEL_NONE;
     se->data.client.username = NULL;
@@ -1922,6 +2925,99 @@ static int sockent_init_crypto(sockent_t *se) /* {{{ */
   return 0;
 } /* }}} int sockent_init_crypto */
 
+#if HAVE_LIBSSL
+static void network_tls_error(const char *func) /* {{{ */
+{
+  char errbuf[256];
+
+  ERR_error_string_n(ERR_get_error(), errbuf, sizeof(errbuf));
+  ERR_clear_error();
+  ERROR("network plugin: %s failed: %s", func, errbuf);
+} /* }}} void network_tls_error */
+#endif
+
+static int sockent_init_tls(sockent_t *se) /* {{{ */
+{
+  if (!se->tls.enabled)
+    return 0;
+
+#if HAVE_LIBSSL
+  _Bool client = (se->type == SOCKENT_TYPE_CLIENT);
+  SSL_CTX *ctx;
+
+#if OPENSSL_VERSION_NUMBER < 0x10100000L
+  static _Bool have_init = 0;
+  if (!have_init) {
+    SSL_library_init();
+    SSL_load_error_strings();
+    have_init = 1;
+  }
+  ctx = SSL_CTX_new(client ? SSLv23_client_method() : SSLv23_server_method());
+#else
+  ctx = SSL_CTX_new(client ? TLS_client_method() : TLS_server_method());
+#endif
+  if (ctx == NULL) {
+    network_tls_error("SSL_CTX_new");
+    return -1;
+  }
+  SSL_CTX_set_options(ctx, SSL_OP_NO_SSLv2 | SSL_OP_NO_SSLv3 |
+                               SSL_OP_NO_COMPRESSION);
+
+  if (!client && (se->tls.cert_file == NULL)) {
+    ERROR("network plugin: Listening with TLS requires the \"TLSCertFile\" "
+          "option.");
+    SSL_CTX_free(ctx);
+    return -1;
+  }
+
+  if (se->tls.cert_file != NULL) {
+    const char *key_file =
+        (se->tls.key_file != NULL) ? se->tls.key_file : se->tls.cert_file;
+
+    if (SSL_CTX_use_certificate_chain_file(ctx, se->tls.cert_file) != 1) {
+      network_tls_error("SSL_CTX_use_certificate_chain_file");
+      SSL_CTX_free(ctx);
+      return -1;
+    }
+    if ((SSL_CTX_use_PrivateKey_file(ctx, key_file, SSL_FILETYPE_PEM) != 1) ||
+        (SSL_CTX_check_private_key(ctx) != 1)) {
+      network_tls_error("Loading the private key");
+      SSL_CTX_free(ctx);
+      return -1;
+    }
+  }
+
+  if (se->tls.ca_file != NULL) {
+    if (SSL_CTX_load_verify_locations(ctx, se->tls.ca_file, NULL) != 1) {
+      network_tls_error("SSL_CTX_load_verify_locations");
+      SSL_CTX_free(ctx);
+      return -1;
+    }
+  } else if (client) {
+    SSL_CTX_set_default_verify_paths(ctx);
+  }
+
+  /* Clients verify the server unless told otherwise; servers verify clients
+   * only if a CA has been configured. */
+  if (client && se->tls.verify_peer)
+    SSL_CTX_set_verify(ctx, SSL_VERIFY_PEER, NULL);
+  else if (!client && (se->tls.ca_file != NULL))
+    SSL_CTX_set_verify(ctx, SSL_VERIFY_PEER | SSL_VERIFY_FAIL_IF_NO_PEER_CERT,
+                       NULL);
+
+  /* Writes are resumed at the first unsent byte after a timeout. */
+  if (client)
+    SSL_CTX_set_mode(ctx, SSL_MODE_ENABLE_PARTIAL_WRITE);
+
+  se->tls.ctx = ctx;
+  return 0;
+#else
+  ERROR("network plugin: TLS was requested, but the network plugin was built "
+        "without OpenSSL.");
+  return -1;
+#endif
+} /* }}} int sockent_init_tls */
+
 static int sockent_client_disconnect(sockent_t *se) /* {{{ */
 {
   struct sockent_client *client;
@@ -2059,6 +3155,10 @@ static int sockent_server_listen(sockent_t *se) /* {{{ */
                               .ai_flags = AI_ADDRCONFIG | AI_PASSIVE,
                               .ai_protocol = IPPROTO_UDP,
                               .ai_socktype = SOCK_DGRAM};
+  if (se->protocol == SOCKENT_PROTOCOL_TCP) {
+    ai_hints.ai_protocol = IPPROTO_TCP;
+    ai_hints.ai_socktype = SOCK_STREAM;
+  }
 
   status = getaddrinfo(node, service, &ai_hints, &ai_list);
   if (status != 0) {
@@ -2096,6 +3196,20 @@ static int sockent_server_listen(sockent_t *se) /* {{{ */
       continue;
     }
 
+    if (se->protocol == SOCKENT_PROTOCOL_TCP) {
+      int flags = fcntl(*tmp, F_GETFL);
+
+      if ((listen(*tmp, SOMAXCONN) != 0) || (flags < 0) ||
+          (fcntl(*tmp, F_SETFL, flags | O_NONBLOCK) != 0)) {
+        char errbuf[1024];
+        ERROR("network plugin: listen(2) failed: %s",
+              sstrerror(errno, errbuf, sizeof(errbuf)));
+        close(*tmp);
+        *tmp = -1;
+        continue;
+      }
+    }
+
     se->data.server.fd_num++;
     continue;
   } /* for (ai_list) */
@@ -2116,16 +3230,21 @@ static int sockent_add(sockent_t *se) /* {{{ */
     return -1;
 
   if (se->type == SOCKENT_TYPE_SERVER) {
+    /* Stream sockets are polled by the stream threads. */
+    _Bool stream = (se->protocol == SOCKENT_PROTOCOL_TCP);
+    struct pollfd **pollfd_ptr =
+        stream ? &stream_listen_pollfd : &listen_sockets_pollfd;
+    size_t *num_ptr = stream ? &stream_listen_num : &listen_sockets_num;
     struct pollfd *tmp;
 
-    tmp = realloc(listen_sockets_pollfd,
-                  sizeof(*tmp) * (listen_sockets_num + se->data.server.fd_num));
+    tmp = realloc(*pollfd_ptr,
+                  sizeof(*tmp) * (*num_ptr + se->data.server.fd_num));
     if (tmp == NULL) {
       ERROR("network plugin: realloc failed.");
       return -1;
     }
-    listen_sockets_pollfd = tmp;
-    tmp = listen_sockets_pollfd + listen_sockets_num;
+    *pollfd_ptr = tmp;
+    tmp = *pollfd_ptr + *num_ptr;
 
     for (size_t i = 0; i < se->data.server.fd_num; i++) {
       memset(tmp + i, 0, sizeof(*tmp));
@@ -2134,7 +3253,7 @@ static int sockent_add(sockent_t *se) /* {{{ */
       tmp[i].revents = 0;
     }
 
-    listen_sockets_num += se->data.server.fd_num;
+    *num_ptr += se->data.server.fd_num;
 
     if (listen_sockets == NULL) {
       listen_sockets = se;
@@ -2157,6 +3276,17 @@ static int sockent_add(sockent_t *se) /* {{{ */
   return 0;
 } /* }}} int sockent_add */
 
+/* Looks up the listening `sockent_t' which "fd" belongs to. */
+static sockent_t *listen_sockent_by_fd(int fd) /* {{{ */
+{
+  for (sockent_t *se = listen_sockets; se != NULL; se = se->next)
+    for (size_t i = 0; i < se->data.server.fd_num; i++)
+      if (se->data.server.fd[i] == fd)
+        return se;
+
+  return NULL;
+} /* }}} sockent_t *listen_sockent_by_fd */
+
 static void *dispatch_thread(void __attribute__((unused)) * arg) /* {{{ */
 {
   while (42) {
@@ -2180,21 +3310,7 @@ static void *dispatch_thread(void __attribute__((unused)) * arg) /* {{{ */
     if (ent == NULL)
       break;
 
-    /* Look for the correct `sockent_t' */
-    se = listen_sockets;
-    while (se != NULL) {
-      size_t i;
-
-      for (i = 0; i < se->data.server.fd_num; i++)
-        if (se->data.server.fd[i] == ent->fd)
-          break;
-
-      if (i < se->data.server.fd_num)
-        break;
-
-      se = se->next;
-    }
-
+    se = listen_sockent_by_fd(ent->fd);
     if (se == NULL) {
       ERROR("network plugin: Got packet from FD %i, but can't "
             "find an appropriate socket entry.",
@@ -2342,19 +3458,1051 @@ static void *receive_thread(void __attribute__((unused)) * arg) {
   return network_receive() ? (void *)1 : (void *)0;
 } /* void *receive_thread */
 
-static void network_init_buffer(void) {
-  memset(send_buffer, 0, network_config_packet_size);
-  send_buffer_ptr = send_buffer;
-  send_buffer_fill = 0;
-  send_buffer_last_update = 0;
+#if HAVE_SYS_EPOLL_H
+/*
+ * Stream transport, receiving side
+ *
+ * The accept thread distributes new connections round-robin among the
+ * workers. Each worker reads the frames of its connections with epoll and
+ * appends the packets to the receive list, which is handled by the dispatch
+ * thread like packets received via UDP. While the receive list is longer than
+ * STREAM_RECEIVE_HIGH, workers stop reading, so that senders are slowed down
+ * by TCP's flow control instead of packets being dropped.
+ */
+static void stream_conn_close(stream_worker_t *w, stream_conn_t *conn) /* {{{ */
+{
+  pthread_mutex_lock(&w->lock);
+  if (conn->prev != NULL)
+    conn->prev->next = conn->next;
+  else
+    w->conns = conn->next;
+  if (conn->next != NULL)
+    conn->next->prev = conn->prev;
+  pthread_mutex_unlock(&w->lock);
+
+  if (conn->paused)
+    w->paused_num--;
+
+  /* Closing the file descriptor removes it from the epoll set. */
+#if HAVE_LIBSSL
+  if (conn->ssl != NULL)
+    SSL_free(conn->ssl);
+#endif
+  close(conn->fd);
+  sfree(conn->in);
+  sfree(conn);
+} /* }}} void stream_conn_close */
+
+/* Moves all complete frames of the input buffer to the receive list. Returns
+ * non-zero if the stream is invalid. */
+static int stream_conn_dispatch(stream_conn_t *conn) /* {{{ */
+{
+  receive_list_entry_t *private_list_head = NULL;
+  receive_list_entry_t *private_list_tail = NULL;
+  uint64_t private_list_length = 0;
+  derive_t octets = 0;
+  size_t offset = 0;
+  int status = 0;
 
-  memset(&send_buffer_vl, 0, sizeof(send_buffer_vl));
-} /* int network_init_buffer */
+  while (conn->in_len - offset >= STREAM_FRAME_HEADER_SIZE) {
+    receive_list_entry_t *ent;
+    uint32_t frame_size;
+
+    memcpy(&frame_size, conn->in + offset, sizeof(frame_size));
+    frame_size = ntohl(frame_size);
+    if (frame_size > network_config_packet_size) {
+      NOTICE("network plugin: Received a frame of %" PRIu32 " bytes, but "
+             "the maximum packet size is %zu bytes. Closing the connection.",
+             frame_size, network_config_packet_size);
+      status = -1;
+      break;
+    }
 
-static void network_send_buffer_plain(sockent_t *se, /* {{{ */
-                                      const char *buffer, size_t buffer_size) {
+    if (conn->in_len - offset - STREAM_FRAME_HEADER_SIZE < frame_size)
+      break;
+    offset += STREAM_FRAME_HEADER_SIZE;
+
+    if (frame_size == 0)
+      continue;
+
+    ent = calloc(1, sizeof(*ent));
+    if (ent == NULL) {
+      ERROR("network plugin: calloc failed.");
+      status = ENOMEM;
+      break;
+    }
+
+    ent->data = malloc(frame_size);
+    if (ent->data == NULL) {
+      sfree(ent);
+      ERROR("network plugin: malloc failed.");
+      status = ENOMEM;
+      break;
+    }
+    memcpy(ent->data, conn->in + offset, frame_size);
+    ent->data_len = (int)frame_size;
+    ent->fd = conn->listen_fd;
+    ent->next = NULL;
+    offset += frame_size;
+
+    if (private_list_head == NULL)
+      private_list_head = ent;
+    else
+      private_list_tail->next = ent;
+    private_list_tail = ent;
+    private_list_length++;
+    octets += (derive_t)frame_size;
+  }
+
+  if (private_list_head != NULL) {
+    pthread_mutex_lock(&receive_list_lock);
+
+    if (receive_list_head == NULL)
+      receive_list_head = private_list_head;
+    else
+      receive_list_tail->next = private_list_head;
+    receive_list_tail = private_list_tail;
+    receive_list_length += private_list_length;
+
+    stats_stream_octets_rx += octets;
+    stats_stream_packets_rx += (derive_t)private_list_length;
+
+    pthread_cond_signal(&receive_list_cond);
+    pthread_mutex_unlock(&receive_list_lock);
+  }
+
+  memmove(conn->in, conn->in + offset, conn->in_len - offset);
+  conn->in_len -= offset;
+
+  return status;
+} /* }}} int stream_conn_dispatch */
+
+/* Behaves like read(2). */
+static ssize_t stream_conn_recv(stream_conn_t *conn) /* {{{ */
+{
+  char *buffer = conn->in + conn->in_len;
+  size_t buffer_size = conn->in_size - conn->in_len;
+
+#if HAVE_LIBSSL
+  if (conn->ssl != NULL) {
+    int status;
+
+    conn->want_write = 0;
+
+    /* Performs the handshake first, if necessary. */
+    ERR_clear_error();
+    status = SSL_read(conn->ssl, buffer, (int)buffer_size);
+    if (status > 0)
+      return status;
+
+    switch (SSL_get_error(conn->ssl, status)) {
+    case SSL_ERROR_WANT_WRITE:
+      conn->want_write = 1;
+    /* fall through */
+    case SSL_ERROR_WANT_READ:
+      errno = EAGAIN;
+      return -1;
+    case SSL_ERROR_ZERO_RETURN:
+      return 0;
+    case SSL_ERROR_SYSCALL:
+      /* The peer closed the connection without "close notify". */
+      if (ERR_peek_error() == 0)
+        return (errno == 0) ? 0 : -1;
+    /* fall through */
+    default: {
+      char errbuf[256];
+      ERR_error_string_n(ERR_get_error(), errbuf, sizeof(errbuf));
+      NOTICE("network plugin: Closing TLS connection: %s", errbuf);
+      ERR_clear_error();
+      errno = EPROTO;
+      return -1;
+    }
+    }
+  }
+#endif
+
+  return read(conn->fd, buffer, buffer_size);
+} /* }}} ssize_t stream_conn_recv */
+
+/* Returns the length of the receive list, read under receive_list_lock. */
+static uint64_t stream_receive_list_length(void) /* {{{ */
+{
+  uint64_t length;
+
+  pthread_mutex_lock(&receive_list_lock);
+  length = receive_list_length;
+  pthread_mutex_unlock(&receive_list_lock);
+
+  return length;
+} /* }}} uint64_t stream_receive_list_length */
+
+/* Reads from the connection until it would block or the receive list is too
+ * long; the latter pauses the connection unless "force" is set. Returns
+ * non-zero if the connection has to be closed. */
+static int stream_conn_read(stream_conn_t *conn, _Bool force) /* {{{ */
+{
+  while (42) {
+    ssize_t status;
+
+    if (!force && (stream_receive_list_length() >= STREAM_RECEIVE_HIGH)) {
+      conn->paused = 1;
+      return 0;
+    }
+
+    errno = 0;
+    status = stream_conn_recv(conn);
+    if (status < 0) {
+      char errbuf[1024];
+
+      if (errno == EINTR)
+        continue;
+      if ((errno == EAGAIN) || (errno == EWOULDBLOCK))
+        return 0;
+
+      if ((errno != ECONNRESET) && (errno != EPROTO))
+        WARNING("network plugin: Reading from stream connection failed: %s",
+                sstrerror(errno, errbuf, sizeof(errbuf)));
+      return -1;
+    } else if (status == 0) {
+      /* Incomplete frames are discarded. */
+      return -1;
+    }
+
+    conn->in_len += (size_t)status;
+    if (stream_conn_dispatch(conn) != 0)
+      return -1;
+  }
+} /* }}} int stream_conn_read */
+
+static int stream_conn_update(stream_worker_t *w, stream_conn_t *conn) /* {{{ */
+{
+  struct epoll_event ev = {.data.ptr = conn};
+
+  ev.events = conn->paused ? 0 : EPOLLIN;
+#if HAVE_LIBSSL
+  if (conn->want_write)
+    ev.events = EPOLLOUT;
+#endif
+
+  if (ev.events == conn->events)
+    return 0;
+
+  if (epoll_ctl(w->epoll_fd, EPOLL_CTL_MOD, conn->fd, &ev) != 0) {
+    char errbuf[1024];
+    ERROR("network plugin: epoll_ctl failed: %s",
+          sstrerror(errno, errbuf, sizeof(errbuf)));
+    return -1;
+  }
+
+  conn->events = ev.events;
+  return 0;
+} /* }}} int stream_conn_update */
+
+static int stream_conn_handle(stream_worker_t *w, stream_conn_t *conn,
+                              uint32_t revents) /* {{{ */
+{
+  _Bool was_paused = conn->paused;
+
+  /* A closed connection is read to the end, even if paused. */
+  conn->paused = 0;
+  if (stream_conn_read(conn, (revents & (EPOLLHUP | EPOLLERR)) != 0) != 0) {
+    conn->paused = was_paused;
+    return -1;
+  }
+
+  if (conn->paused && !was_paused)
+    w->paused_num++;
+  else if (!conn->paused && was_paused)
+    w->paused_num--;
+
+  return stream_conn_update(w, conn);
+} /* }}} int stream_conn_handle */
+
+/* Resumes the paused connections of a worker. */
+static void stream_worker_resume(stream_worker_t *w) /* {{{ */
+{
+  stream_conn_t *conn;
+
+  /* Only this thread removes connections from the list; the accept thread
+   * only adds to its head. */
+  pthread_mutex_lock(&w->lock);
+  conn = w->conns;
+  pthread_mutex_unlock(&w->lock);
+
+  while ((conn != NULL) && (w->paused_num > 0) &&
+         (stream_receive_list_length() < STREAM_RECEIVE_LOW)) {
+    stream_conn_t *next = conn->next;
+
+    if (conn->paused && (stream_conn_handle(w, conn, 0) != 0))
+      stream_conn_close(w, conn);
+
+    conn = next;
+  }
+} /* }}} void stream_worker_resume */
+
+static void *stream_worker_thread(void *arg) /* {{{ */
+{
+  stream_worker_t *w = arg;
+  struct epoll_event events[STREAM_EPOLL_EVENTS];
+
+  while (42) {
+    /* Paused connections are resumed by polling the receive list. */
+    int timeout = (w->paused_num > 0) ? 100 : -1;
+    int status;
+
+    status = epoll_wait(w->epoll_fd, events, STREAM_EPOLL_EVENTS, timeout);
+    if (status < 0) {
+      char errbuf[1024];
+
+      if (errno == EINTR)
+        continue;
+
+      ERROR("network plugin: epoll_wait failed: %s",
+            sstrerror(errno, errbuf, sizeof(errbuf)));
+      break;
+    }
+
+    for (int i = 0; i < status; i++) {
+      stream_conn_t *conn = events[i].data.ptr;
+
+      /* The shutdown pipe. */
+      if (conn == NULL)
+        goto out;
+
+      if (stream_conn_handle(w, conn, events[i].events) != 0)
+        stream_conn_close(w, conn);
+    }
+
+    if ((w->paused_num > 0) &&
+        (stream_receive_list_length() < STREAM_RECEIVE_LOW))
+      stream_worker_resume(w);
+  }
+
+out:
+  while (w->conns != NULL)
+    stream_conn_close(w, w->conns);
+
+  return NULL;
+} /* }}} void *stream_worker_thread */
+
+static int stream_add_conn(stream_worker_t *w, int fd, int listen_fd) /* {{{ */
+{
+  stream_conn_t *conn;
+  struct epoll_event ev = {.events = EPOLLIN};
+  int flags;
+
+  flags = fcntl(fd, F_GETFL);
+  if ((flags < 0) || (fcntl(fd, F_SETFL, flags | O_NONBLOCK) != 0)) {
+    char errbuf[1024];
+    ERROR("network plugin: fcntl failed: %s",
+          sstrerror(errno, errbuf, sizeof(errbuf)));
+    close(fd);
+    return -1;
+  }
+
+  conn = calloc(1, sizeof(*conn));
+  if (conn == NULL) {
+    ERROR("network plugin: calloc failed.");
+    close(fd);
+    return ENOMEM;
+  }
+  conn->fd = fd;
+  conn->listen_fd = listen_fd;
+  conn->events = ev.events;
+
+  /* Always room for the largest frame. */
+  conn->in_size = STREAM_FRAME_HEADER_SIZE + network_config_packet_size;
+  if (conn->in_size < STREAM_INPUT_MIN_SIZE)
+    conn->in_size = STREAM_INPUT_MIN_SIZE;
+  conn->in = malloc(conn->in_size);
+  if (conn->in == NULL) {
+    ERROR("network plugin: malloc failed.");
+    sfree(conn);
+    close(fd);
+    return ENOMEM;
+  }
+
+#if HAVE_LIBSSL
+  {
+    sockent_t *se = listen_sockent_by_fd(listen_fd);
+
+    if ((se != NULL) && (se->tls.ctx != NULL)) {
+      conn->ssl = SSL_new(se->tls.ctx);
+      if (conn->ssl == NULL) {
+        network_tls_error("SSL_new");
+        sfree(conn->in);
+        sfree(conn);
+        close(fd);
+        return -1;
+      }
+      SSL_set_fd(conn->ssl, fd);
+      SSL_set_accept_state(conn->ssl);
+    }
+  }
+#endif
+
+  /* Registered while holding the lock, so that the worker either sees the
+   * connection in its list or not at all. */
+  pthread_mutex_lock(&w->lock);
+  ev.data.ptr = conn;
+  if (epoll_ctl(w->epoll_fd, EPOLL_CTL_ADD, fd, &ev) != 0) {
+    char errbuf[1024];
+    pthread_mutex_unlock(&w->lock);
+    ERROR("network plugin: epoll_ctl failed: %s",
+          sstrerror(errno, errbuf, sizeof(errbuf)));
+#if HAVE_LIBSSL
+    if (conn->ssl != NULL)
+      SSL_free(conn->ssl);
+#endif
+    sfree(conn->in);
+    sfree(conn);
+    close(fd);
+    return -1;
+  }
+
+  conn->next = w->conns;
+  if (w->conns != NULL)
+    w->conns->prev = conn;
+  w->conns = conn;
+  pthread_mutex_unlock(&w->lock);
+
+  return 0;
+} /* }}} int stream_add_conn */
+
+static void *stream_accept_thread(void __attribute__((unused)) * arg) /* {{{ */
+{
+  size_t pollfd_num = stream_listen_num + 1;
+  struct pollfd pollfd[pollfd_num];
+  size_t next_worker = 0;
+  c_complain_t complaint = C_COMPLAIN_INIT_STATIC;
+
+  memcpy(pollfd, stream_listen_pollfd,
+         stream_listen_num * sizeof(*stream_listen_pollfd));
+  pollfd[stream_listen_num] = (struct pollfd){
+      .fd = stream_shutdown_pipe[0], .events = POLLIN,
+  };
+
+  while (42) {
+    int status = poll(pollfd, pollfd_num, /* timeout = */ -1);
+    if (status < 0) {
+      char errbuf[1024];
+
+      if (errno == EINTR)
+        continue;
+
+      ERROR("network plugin: poll(2) failed: %s",
+            sstrerror(errno, errbuf, sizeof(errbuf)));
+      break;
+    }
+
+    if (pollfd[stream_listen_num].revents != 0)
+      break;
+
+    for (size_t i = 0; i < stream_listen_num; i++) {
+      if ((pollfd[i].revents & POLLIN) == 0)
+        continue;
+
+      while (42) {
+        int fd = accept(pollfd[i].fd, NULL, NULL);
+        if (fd < 0) {
+          char errbuf[1024];
+
+          if (errno == EINTR)
+            continue;
+          if ((errno == EAGAIN) || (errno == EWOULDBLOCK) ||
+              (errno == ECONNABORTED))
+            break;
+
+          c_complain(LOG_ERR, &complaint,
+                     "network plugin: accept(2) failed: %s",
+                     sstrerror(errno, errbuf, sizeof(errbuf)));
+          /* Don't spin while out of file descriptors. */
+          nanosleep(&CDTIME_T_TO_TIMESPEC(MS_TO_CDTIME_T(100)), NULL);
+          break;
+        }
+        c_release(LOG_NOTICE, &complaint,
+                  "network plugin: accept(2) succeeded again.");
+
+        stream_add_conn(stream_workers + next_worker, fd, pollfd[i].fd);
+        next_worker = (next_worker + 1) % stream_workers_num;
+      }
+    }
+  }
+
+  return NULL;
+} /* }}} void *stream_accept_thread */
+
+static void stream_stop_threads(void) /* {{{ */
+{
+  if (stream_shutdown_pipe[1] >= 0) {
+    char c = 0;
+    /* The pipe stays readable, waking up all threads. */
+    if (write(stream_shutdown_pipe[1], &c, sizeof(c)) < 0) {
+      char errbuf[1024];
+      ERROR("network plugin: Waking up the stream threads failed: %s",
+            sstrerror(errno, errbuf, sizeof(errbuf)));
+    }
+  }
+
+  if (stream_accept_thread_running) {
+    pthread_join(stream_accept_thread_id, NULL);
+    stream_accept_thread_running = 0;
+  }
+
+  for (size_t i = 0; i < stream_workers_num; i++) {
+    stream_worker_t *w = stream_workers + i;
+
+    if (w->running)
+      pthread_join(w->thread, NULL);
+    if (w->epoll_fd >= 0)
+      close(w->epoll_fd);
+    pthread_mutex_destroy(&w->lock);
+  }
+  sfree(stream_workers);
+  stream_workers_num = 0;
+
+  for (size_t i = 0; i < STATIC_ARRAY_SIZE(stream_shutdown_pipe); i++) {
+    if (stream_shutdown_pipe[i] >= 0)
+      close(stream_shutdown_pipe[i]);
+    stream_shutdown_pipe[i] = -1;
+  }
+} /* }}} void stream_stop_threads */
+
+static int stream_start_threads(void) /* {{{ */
+{
+  struct epoll_event ev = {.events = EPOLLIN, .data.ptr = NULL};
+  int status;
+
+  if (pipe(stream_shutdown_pipe) != 0) {
+    char errbuf[1024];
+    ERROR("network plugin: pipe failed: %s",
+          sstrerror(errno, errbuf, sizeof(errbuf)));
+    return -1;
+  }
+
+  stream_workers = calloc((size_t)stream_threads, sizeof(*stream_workers));
+  if (stream_workers == NULL) {
+    ERROR("network plugin: calloc failed.");
+    return ENOMEM;
+  }
+
+  for (int i = 0; i < stream_threads; i++) {
+    stream_worker_t *w = stream_workers + i;
+    char name[24];
+
+    pthread_mutex_init(&w->lock, NULL);
+    stream_workers_num++;
+
+    w->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if ((w->epoll_fd < 0) ||
+        (epoll_ctl(w->epoll_fd, EPOLL_CTL_ADD, stream_shutdown_pipe[0],
+                   &ev) != 0)) {
+      char errbuf[1024];
+      ERROR("network plugin: Setting up epoll failed: %s",
+            sstrerror(errno, errbuf, sizeof(errbuf)));
+      return -1;
+    }
+
+    snprintf(name, sizeof(name), "network recv#%d", i);
+    status = plugin_thread_create(&w->thread, NULL, stream_worker_thread, w,
+                                  name);
+    if (status != 0) {
+      ERROR("network plugin: pthread_create failed with status %i.", status);
+      return status;
+    }
+    w->running = 1;
+  }
+
+  status = plugin_thread_create(&stream_accept_thread_id, NULL,
+                                stream_accept_thread, NULL, "network accept");
+  if (status != 0) {
+    ERROR("network plugin: pthread_create failed with status %i.", status);
+    return status;
+  }
+  stream_accept_thread_running = 1;
+
+  return 0;
+} /* }}} int stream_start_threads */
+#endif /* HAVE_SYS_EPOLL_H */
+
+static void network_init_buffer(void) {
+  memset(send_buffer, 0, network_config_packet_size);
+  send_buffer_ptr = send_buffer;
+  send_buffer_fill = 0;
+  send_buffer_last_update = 0;
+
+  memset(&send_buffer_vl, 0, sizeof(send_buffer_vl));
+} /* int network_init_buffer */
+
+/*
+ * Stream transport, sending side
+ */
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+
+static void stream_client_disconnect(sockent_t *se) /* {{{ */
+{
+  stream_client_t *sc = se->data.client.stream;
+
+#if HAVE_LIBSSL
+  if (sc->ssl != NULL) {
+    SSL_free(sc->ssl);
+    sc->ssl = NULL;
+  }
+#endif
+  sockent_client_disconnect(se);
+} /* }}} void stream_client_disconnect */
+
+/* Connects "fd" to "ai" within STREAM_CONNECT_TIMEOUT_MS. */
+static int stream_connect_timeout(int fd, const struct addrinfo *ai) /* {{{ */
+{
+  int flags = fcntl(fd, F_GETFL);
+  int status;
+
+  if ((flags < 0) || (fcntl(fd, F_SETFL, flags | O_NONBLOCK) != 0))
+    return -1;
+
+  status = connect(fd, ai->ai_addr, ai->ai_addrlen);
+  if ((status != 0) && (errno == EINPROGRESS)) {
+    struct pollfd pfd = {.fd = fd, .events = POLLOUT};
+    int error = 0;
+    socklen_t error_len = sizeof(error);
+
+    do {
+      status = poll(&pfd, 1, STREAM_CONNECT_TIMEOUT_MS);
+    } while ((status < 0) && (errno == EINTR));
+
+    if (status == 0) {
+      errno = ETIMEDOUT;
+      return -1;
+    } else if (status < 0) {
+      return -1;
+    }
+
+    if (getsockopt(fd, SOL_SOCKET, SO_ERROR, &error, &error_len) != 0)
+      return -1;
+    if (error != 0) {
+      errno = error;
+      return -1;
+    }
+  } else if (status != 0) {
+    return -1;
+  }
+
+  return fcntl(fd, F_SETFL, flags);
+} /* }}} int stream_connect_timeout */
+
+#if HAVE_LIBSSL
+static int stream_client_handshake(sockent_t *se) /* {{{ */
+{
+  stream_client_t *sc = se->data.client.stream;
+  cdtime_t deadline =
+      cdtime() + MS_TO_CDTIME_T(STREAM_CONNECT_TIMEOUT_MS);
+  int status;
+
+  sc->ssl = SSL_new(se->tls.ctx);
+  if (sc->ssl == NULL) {
+    network_tls_error("SSL_new");
+    return -1;
+  }
+  SSL_set_fd(sc->ssl, se->data.client.fd);
+
+  if (se->node != NULL) {
+    SSL_set_tlsext_host_name(sc->ssl, se->node);
+#if OPENSSL_VERSION_NUMBER >= 0x10100000L
+    if (se->tls.verify_peer)
+      SSL_set1_host(sc->ssl, se->node);
+#endif
+  }
+
+  /* The socket's timeouts make SSL_connect() return regularly. */
+  while (42) {
+    ERR_clear_error();
+    status = SSL_connect(sc->ssl);
+    if (status == 1)
+      return 0;
+
+    status = SSL_get_error(sc->ssl, status);
+    if (((status == SSL_ERROR_WANT_READ) || (status == SSL_ERROR_WANT_WRITE)) &&
+        (cdtime() < deadline) && !sc->shutdown)
+      continue;
+
+    break;
+  }
+
+  if (SSL_get_verify_result(sc->ssl) != X509_V_OK)
+    c_complain(LOG_ERR, &sc->connect_complaint,
+               "network plugin: Verifying the certificate of \"%s\" "
+               "failed: %s",
+               se->node,
+               X509_verify_cert_error_string(SSL_get_verify_result(sc->ssl)));
+  else
+    network_tls_error("SSL_connect");
+
+  SSL_free(sc->ssl);
+  sc->ssl = NULL;
+  return -1;
+} /* }}} int stream_client_handshake */
+#endif /* HAVE_LIBSSL */
+
+static int stream_client_connect(sockent_t *se) /* {{{ */
+{
+  struct sockent_client *client = &se->data.client;
+  stream_client_t *sc = client->stream;
+  struct addrinfo *ai_list;
+  struct timeval tv = {.tv_sec = 1, .tv_usec = 0};
+  int yes = 1;
+  int error = 0;
+  int status;
+
+  struct addrinfo ai_hints = {.ai_family = AF_UNSPEC,
+                              .ai_flags = AI_ADDRCONFIG,
+                              .ai_protocol = IPPROTO_TCP,
+                              .ai_socktype = SOCK_STREAM};
+
+  status = getaddrinfo(se->node,
+                       (se->service != NULL) ? se->service : NET_DEFAULT_PORT,
+                       &ai_hints, &ai_list);
+  if (status != 0) {
+    c_complain(
+        LOG_ERR, &sc->connect_complaint,
+        "network plugin: getaddrinfo (%s, %s) failed: %s",
+        (se->node == NULL) ? "(null)" : se->node,
+        (se->service == NULL) ? "(null)" : se->service, gai_strerror(status));
+    return -1;
+  }
+
+  for (struct addrinfo *ai_ptr = ai_list; ai_ptr != NULL;
+       ai_ptr = ai_ptr->ai_next) {
+    client->fd =
+        socket(ai_ptr->ai_family, ai_ptr->ai_socktype, ai_ptr->ai_protocol);
+    if (client->fd < 0) {
+      error = errno;
+      continue;
+    }
+
+    network_set_ttl(se, ai_ptr);
+    network_set_interface(se, ai_ptr);
+
+    if (stream_connect_timeout(client->fd, ai_ptr) != 0) {
+      error = errno;
+      close(client->fd);
+      client->fd = -1;
+      continue;
+    }
+
+    client->addr = calloc(1, sizeof(*client->addr));
+    if (client->addr != NULL) {
+      assert(sizeof(*client->addr) >= ai_ptr->ai_addrlen);
+      memcpy(client->addr, ai_ptr->ai_addr, ai_ptr->ai_addrlen);
+      client->addrlen = ai_ptr->ai_addrlen;
+    }
+    break;
+  }
+
+  freeaddrinfo(ai_list);
+
+  if (client->fd < 0) {
+    char errbuf[1024];
+    c_complain(LOG_ERR, &sc->connect_complaint,
+               "network plugin: Connecting to %s failed: %s", se->node,
+               sstrerror(error, errbuf, sizeof(errbuf)));
+    return -1;
+  }
+
+  /* Blocking writes time out regularly, so that the stream's thread notices
+   * a shutdown. */
+  setsockopt(client->fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+  setsockopt(client->fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+  setsockopt(client->fd, SOL_SOCKET, SO_KEEPALIVE, &yes, sizeof(yes));
+#ifdef TCP_NODELAY
+  /* Batches are written at once; don't delay the last segment. */
+  setsockopt(client->fd, IPPROTO_TCP, TCP_NODELAY, &yes, sizeof(yes));
+#endif
+
+#if HAVE_LIBSSL
+  if ((se->tls.ctx != NULL) && (stream_client_handshake(se) != 0)) {
+    sockent_client_disconnect(se);
+    return -1;
+  }
+#endif
+
+  c_release(LOG_NOTICE, &sc->connect_complaint,
+            "network plugin: Successfully connected to \"%s\".", se->node);
+
+  if (client->resolve_interval > 0)
+    client->next_resolve_reconnect = cdtime() + client->resolve_interval;
+
+  return 0;
+} /* }}} int stream_client_connect */
+
+/* Returns true if the peer has closed the connection. The receiver never
+ * sends data of its own, so this is only reliable without TLS. */
+static _Bool stream_client_closed(sockent_t *se) /* {{{ */
+{
+  char c;
+  ssize_t status;
+
+  status = recv(se->data.client.fd, &c, sizeof(c), MSG_PEEK | MSG_DONTWAIT);
+  if (status == 0)
+    return 1;
+  if ((status < 0) && (errno != EAGAIN) && (errno != EWOULDBLOCK) &&
+      (errno != EINTR))
+    return 1;
+  return 0;
+} /* }}} _Bool stream_client_closed */
+
+/* Writes the rest of the batch. Returns non-zero if the connection failed. */
+static int stream_client_write(sockent_t *se) /* {{{ */
+{
+  stream_client_t *sc = se->data.client.stream;
+
+  while (sc->batch_sent < sc->batch_fill) {
+    const char *buffer = sc->batch + sc->batch_sent;
+    size_t buffer_size = sc->batch_fill - sc->batch_sent;
+    ssize_t status;
+
+#if HAVE_LIBSSL
+    if (sc->ssl != NULL) {
+      ERR_clear_error();
+      status = SSL_write(sc->ssl, buffer,
+                         (buffer_size > INT_MAX) ? INT_MAX : (int)buffer_size);
+      if (status <= 0) {
+        int error = SSL_get_error(sc->ssl, (int)status);
+
+        if ((error == SSL_ERROR_WANT_READ) || (error == SSL_ERROR_WANT_WRITE))
+          errno = EAGAIN;
+        else if (error != SSL_ERROR_SYSCALL)
+          errno = EPROTO;
+        status = -1;
+      }
+    } else
+#endif
+      status = send(se->data.client.fd, buffer, buffer_size, MSG_NOSIGNAL);
+
+    if (status < 0) {
+      char errbuf[1024];
+
+      if (errno == EINTR)
+        continue;
+      /* The send timeout expired: the receiver is slow, which is what the
+       * queue is for. Only give up when shutting down. */
+      if ((errno == EAGAIN) || (errno == EWOULDBLOCK)) {
+        if (sc->shutdown)
+          return -1;
+        continue;
+      }
+
+      c_complain(LOG_ERR, &sc->connect_complaint,
+                 "network plugin: Sending to \"%s\" failed: %s", se->node,
+                 sstrerror(errno, errbuf, sizeof(errbuf)));
+      return -1;
+    }
+
+    sc->batch_sent += (size_t)status;
+  }
+
+  return 0;
+} /* }}} int stream_client_write */
+
+/* Drops the frames of the batch which have been sent completely; the others
+ * are sent again over the next connection. */
+static void stream_client_rewind(stream_client_t *sc) /* {{{ */
+{
+  size_t offset = 0;
+
+  while (offset + STREAM_FRAME_HEADER_SIZE <= sc->batch_sent) {
+    uint32_t frame_size;
+
+    memcpy(&frame_size, sc->batch + offset, sizeof(frame_size));
+    frame_size = ntohl(frame_size);
+    if (offset + STREAM_FRAME_HEADER_SIZE + frame_size > sc->batch_sent)
+      break;
+    offset += STREAM_FRAME_HEADER_SIZE + frame_size;
+  }
+
+  memmove(sc->batch, sc->batch + offset, sc->batch_fill - offset);
+  sc->batch_fill -= offset;
+  sc->batch_sent = 0;
+} /* }}} void stream_client_rewind */
+
+/* Waits for "timeout" or until shutdown. */
+static void stream_client_sleep(stream_client_t *sc, cdtime_t timeout) /* {{{ */
+{
+  struct timespec ts = CDTIME_T_TO_TIMESPEC(cdtime() + timeout);
+
+  pthread_mutex_lock(&sc->lock);
+  while (!sc->shutdown)
+    if (pthread_cond_timedwait(&sc->cond, &sc->lock, &ts) == ETIMEDOUT)
+      break;
+  pthread_mutex_unlock(&sc->lock);
+} /* }}} void stream_client_sleep */
+
+static void *stream_client_thread(void *arg) /* {{{ */
+{
+  sockent_t *se = arg;
+  struct sockent_client *client = &se->data.client;
+  stream_client_t *sc = client->stream;
+
+  while (42) {
+    _Bool shutdown;
+
+    pthread_mutex_lock(&sc->lock);
+    while (!sc->shutdown && (sc->batch_fill == 0) && (sc->queue_fill == 0))
+      pthread_cond_wait(&sc->cond, &sc->lock);
+
+    /* Take everything queued so far, unless a batch is still pending. */
+    if ((sc->batch_fill == 0) && (sc->queue_fill > 0)) {
+      char *tmp = sc->batch;
+      sc->batch = sc->queue;
+      sc->batch_fill = sc->queue_fill;
+      sc->batch_sent = 0;
+      sc->queue = tmp;
+      sc->queue_fill = 0;
+    }
+    shutdown = sc->shutdown;
+    pthread_mutex_unlock(&sc->lock);
+
+    if (sc->batch_fill == 0)
+      break;
+
+    if ((client->fd >= 0) &&
+        (((client->resolve_interval != 0) &&
+          (client->next_resolve_reconnect < cdtime())) ||
+         stream_client_closed(se)))
+      stream_client_disconnect(se);
+
+    if (client->fd < 0) {
+      if (shutdown)
+        break;
+
+      if (stream_client_connect(se) != 0) {
+        stream_client_sleep(sc, sc->backoff);
+        sc->backoff *= 2;
+        if (sc->backoff > STREAM_BACKOFF_MAX)
+          sc->backoff = STREAM_BACKOFF_MAX;
+        continue;
+      }
+      sc->backoff = STREAM_BACKOFF_MIN;
+    }
+
+    if (stream_client_write(se) != 0) {
+      stream_client_rewind(sc);
+      stream_client_disconnect(se);
+      continue;
+    }
+
+    sc->batch_fill = 0;
+    sc->batch_sent = 0;
+  }
+
+  if ((sc->batch_fill > 0) || (sc->queue_fill > 0))
+    WARNING("network plugin: Dropping %zu bytes queued for \"%s\" on "
+            "shutdown.",
+            sc->batch_fill + sc->queue_fill, se->node);
+
+  if (client->fd >= 0)
+    stream_client_disconnect(se);
+  return NULL;
+} /* }}} void *stream_client_thread */
+
+/* Appends a packet to the send queue. Called with `send_buffer_lock' held, so
+ * this never waits for the stream's thread: if the queue is full, because the
+ * server is slow or unreachable, the packet is dropped right away. */
+static void stream_client_send(sockent_t *se, /* {{{ */
+                               const char *buffer, size_t buffer_size) {
+  stream_client_t *sc = se->data.client.stream;
+  size_t frame_size = STREAM_FRAME_HEADER_SIZE + buffer_size;
+  uint32_t tmp = htonl((uint32_t)buffer_size);
+
+  if (sc == NULL)
+    return;
+
+  pthread_mutex_lock(&sc->lock);
+  if (sc->queue_fill + frame_size > sc->queue_size) {
+    __atomic_add_fetch(&stats_stream_packets_dropped, 1, __ATOMIC_RELAXED);
+    c_complain(LOG_WARNING, &sc->queue_complaint,
+               "network plugin: The send queue of \"%s\" is full. Dropping "
+               "packets.",
+               se->node);
+    pthread_mutex_unlock(&sc->lock);
+    return;
+  }
+
+  memcpy(sc->queue + sc->queue_fill, &tmp, sizeof(tmp));
+  memcpy(sc->queue + sc->queue_fill + STREAM_FRAME_HEADER_SIZE, buffer,
+         buffer_size);
+  sc->queue_fill += frame_size;
+
+  c_release(LOG_NOTICE, &sc->queue_complaint,
+            "network plugin: The send queue of \"%s\" accepts packets again.",
+            se->node);
+  pthread_cond_broadcast(&sc->cond);
+  pthread_mutex_unlock(&sc->lock);
+} /* }}} void stream_client_send */
+
+static int stream_client_start(sockent_t *se) /* {{{ */
+{
+  stream_client_t *sc;
+  int status;
+
+  sc = calloc(1, sizeof(*sc));
+  if (sc == NULL)
+    return ENOMEM;
+
+  /* A queue holds at least one packet. */
+  sc->queue_size = se->data.client.stream_queue_size;
+  if (sc->queue_size < STREAM_FRAME_HEADER_SIZE + network_config_packet_size)
+    sc->queue_size = STREAM_FRAME_HEADER_SIZE + network_config_packet_size;
+
+  pthread_mutex_init(&sc->lock, NULL);
+  pthread_cond_init(&sc->cond, NULL);
+  C_COMPLAIN_INIT(&sc->connect_complaint);
+  C_COMPLAIN_INIT(&sc->queue_complaint);
+  sc->backoff = STREAM_BACKOFF_MIN;
+  se->data.client.stream = sc;
+
+  sc->queue = malloc(sc->queue_size);
+  sc->batch = malloc(sc->queue_size);
+  if ((sc->queue == NULL) || (sc->batch == NULL))
+    return ENOMEM;
+
+  status = plugin_thread_create(&sc->thread, NULL, stream_client_thread, se,
+                                "network stream");
+  if (status != 0)
+    return status;
+
+  sc->running = 1;
+  return 0;
+} /* }}} int stream_client_start */
+
+/* Sends what has been queued, if connected, and stops the stream's thread. */
+static void stream_client_stop(sockent_t *se) /* {{{ */
+{
+  stream_client_t *sc = se->data.client.stream;
+
+  if ((sc == NULL) || !sc->running)
+    return;
+
+  pthread_mutex_lock(&sc->lock);
+  sc->shutdown = 1;
+  pthread_cond_broadcast(&sc->cond);
+  pthread_mutex_unlock(&sc->lock);
+
+  pthread_join(sc->thread, NULL);
+  sc->running = 0;
+} /* }}} void stream_client_stop */
+
+static void network_send_buffer_plain(sockent_t *se, /* {{{ */
+                                      const char *buffer, size_t buffer_size) {
   int status;
 
+  if (se->protocol == SOCKENT_PROTOCOL_TCP) {
+    stream_client_send(se, buffer, buffer_size);
+    return;
+  }
+
   while (42) {
     status = sockent_client_connect(se);
     if (status != 0)
@@ -2531,20 +4679,24 @@ static void network_send_buffer_encrypted(sockent_t *se, /* {{{ */
 #undef BUFFER_ADD
 #endif /* HAVE_GCRYPT_H */
 
+static void network_send_buffer_socket(sockent_t *se, /* {{{ */
+                                       const char *buffer, size_t buffer_len) {
+#if HAVE_GCRYPT_H
+  if (se->data.client.security_level == SECURITY_LEVEL_ENCRYPT)
+    network_send_buffer_encrypted(se, buffer, buffer_len);
+  else if (se->data.client.security_level == SECURITY_LEVEL_SIGN)
+    network_send_buffer_signed(se, buffer, buffer_len);
+  else /* if (se->data.client.security_level == SECURITY_LEVEL_NONE) */
+#endif /* HAVE_GCRYPT_H */
+    network_send_buffer_plain(se, buffer, buffer_len);
+} /* }}} void network_send_buffer_socket */
+
 static void network_send_buffer(char *buffer, size_t buffer_len) /* {{{ */
 {
   DEBUG("network plugin: network_send_buffer: buffer_len = %zu", buffer_len);
 
-  for (sockent_t *se = sending_sockets; se != NULL; se = se->next) {
-#if HAVE_GCRYPT_H
-    if (se->data.client.security_level == SECURITY_LEVEL_ENCRYPT)
-      network_send_buffer_encrypted(se, buffer, buffer_len);
-    else if (se->data.client.security_level == SECURITY_LEVEL_SIGN)
-      network_send_buffer_signed(se, buffer, buffer_len);
-    else /* if (se->data.client.security_level == SECURITY_LEVEL_NONE) */
-#endif   /* HAVE_GCRYPT_H */
-      network_send_buffer_plain(se, buffer, buffer_len);
-  } /* for (sending_sockets) */
+  for (sockent_t *se = sending_sockets; se != NULL; se = se->next)
+    network_send_buffer_socket(se, buffer, buffer_len);
 } /* }}} void network_send_buffer */
 
 static int add_to_buffer(char *buffer, size_t buffer_size, /* {{{ */
@@ -2614,7 +4766,10 @@ static void flush_buffer(void) {
   DEBUG("network plugin: flush_buffer: send_buffer_fill = %i",
         send_buffer_fill);
 
-  network_send_buffer(send_buffer, (size_t)send_buffer_fill);
+  /* Servers using the compact format have buffers of their own. */
+  for (sockent_t *se = sending_sockets; se != NULL; se = se->next)
+    if (se->data.client.compact_buffer == NULL)
+      network_send_buffer_socket(se, send_buffer, (size_t)send_buffer_fill);
 
   stats_octets_tx += ((uint64_t)send_buffer_fill);
   stats_packets_tx++;
@@ -2622,9 +4777,99 @@ static void flush_buffer(void) {
   network_init_buffer();
 }
 
+static void flush_compact_buffer(sockent_t *se) /* {{{ */
+{
+  compact_buffer_t *cb = se->data.client.compact_buffer;
+  char buffer[network_config_packet_size];
+  int status;
+
+  if (cb->values_num == 0)
+    return;
+
+  DEBUG("network plugin: flush_compact_buffer: %zu value lists, "
+        "%zu bytes uncompressed",
+        cb->values_num, cb->raw_fill);
+
+  status = compact_buffer_finalize(cb, buffer, sizeof(buffer) - BUFF_SIG_SIZE);
+  if (status > 0) {
+    network_send_buffer_socket(se, buffer, (size_t)status);
+
+    stats_octets_tx += ((uint64_t)status);
+    stats_packets_tx++;
+  } else {
+    stats_values_not_sent += (derive_t)cb->values_num;
+  }
+
+  compact_buffer_reset(cb);
+} /* }}} void flush_compact_buffer */
+
+static void flush_buffers(void) /* {{{ */
+{
+  if (send_buffer_fill > 0)
+    flush_buffer();
+
+  for (sockent_t *se = sending_sockets; se != NULL; se = se->next)
+    if (se->data.client.compact_buffer != NULL)
+      flush_compact_buffer(se);
+} /* }}} void flush_buffers */
+
+static _Bool network_buffers_empty(void) /* {{{ */
+{
+  if (send_buffer_fill > 0)
+    return 0;
+
+  for (sockent_t *se = sending_sockets; se != NULL; se = se->next)
+    if ((se->data.client.compact_buffer != NULL) &&
+        (se->data.client.compact_buffer->values_num > 0))
+      return 0;
+
+  return 1;
+} /* }}} _Bool network_buffers_empty */
+
+static int network_write_classic(const data_set_t *ds, /* {{{ */
+                                 const value_list_t *vl) {
+  int status;
+
+  status =
+      add_to_buffer(send_buffer_ptr, network_config_packet_size -
+                                         (send_buffer_fill + BUFF_SIG_SIZE),
+                    &send_buffer_vl, ds, vl);
+  if (status < 0) {
+    flush_buffer();
+
+    status =
+        add_to_buffer(send_buffer_ptr, network_config_packet_size -
+                                           (send_buffer_fill + BUFF_SIG_SIZE),
+                      &send_buffer_vl, ds, vl);
+  }
+
+  if (status < 0)
+    return -1;
+
+  /* status == bytes added to the buffer */
+  send_buffer_fill += status;
+  send_buffer_ptr += status;
+
+  if ((network_config_packet_size - send_buffer_fill) < 15)
+    flush_buffer();
+
+  return 0;
+} /* }}} int network_write_classic */
+
+static int network_write_compact(sockent_t *se, /* {{{ */
+                                 const data_set_t *ds, const value_list_t *vl) {
+  compact_buffer_t *cb = se->data.client.compact_buffer;
+
+  if (compact_buffer_add(cb, ds, vl) == 0)
+    return 0;
+
+  flush_compact_buffer(se);
+  return compact_buffer_add(cb, ds, vl);
+} /* }}} int network_write_compact */
+
 static int network_write(const data_set_t *ds, const value_list_t *vl,
                          user_data_t __attribute__((unused)) * user_data) {
-  int status;
+  int status = 0;
 
   /* listen_loop is set to non-zero in the shutdown callback, which is
    * guaranteed to be called *after* all the write threads have been shut
@@ -2652,38 +4897,20 @@ static int network_write(const data_set_t *ds, const value_list_t *vl,
 
   pthread_mutex_lock(&send_buffer_lock);
 
-  status =
-      add_to_buffer(send_buffer_ptr, network_config_packet_size -
-                                         (send_buffer_fill + BUFF_SIG_SIZE),
-                    &send_buffer_vl, ds, vl);
-  if (status >= 0) {
-    /* status == bytes added to the buffer */
-    send_buffer_fill += status;
-    send_buffer_ptr += status;
-    send_buffer_last_update = cdtime();
-
-    stats_values_sent++;
-  } else {
-    flush_buffer();
-
-    status =
-        add_to_buffer(send_buffer_ptr, network_config_packet_size -
-                                           (send_buffer_fill + BUFF_SIG_SIZE),
-                      &send_buffer_vl, ds, vl);
-
-    if (status >= 0) {
-      send_buffer_fill += status;
-      send_buffer_ptr += status;
+  if (send_buffer_classic)
+    status = network_write_classic(ds, vl);
 
-      stats_values_sent++;
-    }
-  }
+  for (sockent_t *se = sending_sockets; se != NULL; se = se->next)
+    if ((se->data.client.compact_buffer != NULL) &&
+        (network_write_compact(se, ds, vl) != 0))
+      status = -1;
 
   if (status < 0) {
     ERROR("network plugin: Unable to append to the "
           "buffer for some weird reason");
-  } else if ((network_config_packet_size - send_buffer_fill) < 15) {
-    flush_buffer();
+  } else {
+    send_buffer_last_update = cdtime();
+    stats_values_sent++;
   }
 
   pthread_mutex_unlock(&send_buffer_lock);
@@ -2735,6 +4962,31 @@ static int network_config_set_buffer_size(const oconfig_item_t *ci) /* {{{ */
   return 0;
 } /* }}} int network_config_set_buffer_size */
 
+static int network_config_set_compression(const oconfig_item_t *ci, /* {{{ */
+                                          int *retval) {
+  char str[16];
+
+  if (cf_util_get_string_buffer(ci, str, sizeof(str)) != 0)
+    return -1;
+
+  if (strcasecmp("None", str) == 0)
+    *retval = COMPACT_COMPRESSION_NONE;
+#if HAVE_LIBLZ4
+  else if (strcasecmp("LZ4", str) == 0)
+    *retval = COMPACT_COMPRESSION_LZ4;
+#endif
+#if HAVE_LIBZSTD
+  else if (strcasecmp("Zstd", str) == 0)
+    *retval = COMPACT_COMPRESSION_ZSTD;
+#endif
+  else {
+    WARNING("network plugin: Unknown or unsupported compression: %s.", str);
+    return -1;
+  }
+
+  return 0;
+} /* }}} int network_config_set_compression */
+
 #if HAVE_GCRYPT_H
 static int network_config_set_security_level(oconfig_item_t *ci, /* {{{ */
                                              int *retval) {
@@ -2761,6 +5013,57 @@ static int network_config_set_security_level(oconfig_item_t *ci, /* {{{ */
 } /* }}} int network_config_set_security_level */
 #endif /* HAVE_GCRYPT_H */
 
+static int network_config_set_protocol(const oconfig_item_t *ci, /* {{{ */
+                                       int *retval) {
+  char str[16];
+
+  if (cf_util_get_string_buffer(ci, str, sizeof(str)) != 0)
+    return -1;
+
+  if (strcasecmp("UDP", str) == 0)
+    *retval = SOCKENT_PROTOCOL_UDP;
+  else if (strcasecmp("TCP", str) == 0)
+    *retval = SOCKENT_PROTOCOL_TCP;
+  else {
+    WARNING("network plugin: Unknown protocol: %s.", str);
+    return -1;
+  }
+
+  return 0;
+} /* }}} int network_config_set_protocol */
+
+static int network_config_set_queue_size(const oconfig_item_t *ci, /* {{{ */
+                                         size_t *retval) {
+  int tmp = 0;
+
+  if (cf_util_get_int(ci, &tmp) != 0)
+    return -1;
+  else if (tmp <= 0) {
+    WARNING("network plugin: The `SendQueueSize' must be positive.");
+    return -1;
+  }
+
+  *retval = (size_t)tmp;
+  return 0;
+} /* }}} int network_config_set_queue_size */
+
+static int network_config_set_stream_threads(const oconfig_item_t *ci) /* {{{ */
+{
+  int tmp = 0;
+
+  if (cf_util_get_int(ci, &tmp) != 0)
+    return -1;
+  else if ((tmp >= 1) && (tmp <= STREAM_MAX_THREADS))
+    stream_threads = tmp;
+  else {
+    WARNING("network plugin: The `StreamThreads' must be between 1 and %i.",
+            STREAM_MAX_THREADS);
+    return -1;
+  }
+
+  return 0;
+} /* }}} int network_config_set_stream_threads */
+
 static int network_config_add_listen(const oconfig_item_t *ci) /* {{{ */
 {
   sockent_t *se;
@@ -2797,11 +5100,34 @@ static int network_config_add_listen(const oconfig_item_t *ci) /* {{{ */
 #endif /* HAVE_GCRYPT_H */
         if (strcasecmp("Interface", child->key) == 0)
       network_config_set_interface(child, &se->interface);
+    else if (strcasecmp("Protocol", child->key) == 0)
+      network_config_set_protocol(child, &se->protocol);
+    else if (strcasecmp("TLS", child->key) == 0)
+      cf_util_get_boolean(child, &se->tls.enabled);
+    else if (strcasecmp("TLSCAFile", child->key) == 0)
+      cf_util_get_string(child, &se->tls.ca_file);
+    else if (strcasecmp("TLSCertFile", child->key) == 0)
+      cf_util_get_string(child, &se->tls.cert_file);
+    else if (strcasecmp("TLSKeyFile", child->key) == 0)
+      cf_util_get_string(child, &se->tls.key_file);
     else {
       WARNING("network plugin: Option `%s' is not allowed here.", child->key);
     }
   }
 
+  /* TLS is only available over TCP. */
+  if (se->tls.enabled)
+    se->protocol = SOCKENT_PROTOCOL_TCP;
+
+#if !HAVE_SYS_EPOLL_H
+  if (se->protocol == SOCKENT_PROTOCOL_TCP) {
+    ERROR("network plugin: Listening with protocol TCP is not supported on "
+          "this system.");
+    sockent_destroy(se);
+    return -1;
+  }
+#endif
+
 #if HAVE_GCRYPT_H
   if ((se->data.server.security_level > SECURITY_LEVEL_NONE) &&
       (se->data.server.auth_file == NULL)) {
@@ -2821,6 +5147,14 @@ static int network_config_add_listen(const oconfig_item_t *ci) /* {{{ */
     return -1;
   }
 
+  status = sockent_init_tls(se);
+  if (status != 0) {
+    ERROR("network plugin: network_config_add_listen: sockent_init_tls() "
+          "failed.");
+    sockent_destroy(se);
+    return -1;
+  }
+
   status = sockent_server_listen(se);
   if (status != 0) {
     ERROR("network plugin: network_config_add_listen: sockent_server_listen "
@@ -2879,6 +5213,24 @@ static int network_config_add_server(const oconfig_item_t *ci) /* {{{ */
       network_config_set_interface(child, &se->interface);
     else if (strcasecmp("ResolveInterval", child->key) == 0)
       cf_util_get_cdtime(child, &se->data.client.resolve_interval);
+    else if (strcasecmp("Compact", child->key) == 0)
+      cf_util_get_boolean(child, &se->data.client.compact);
+    else if (strcasecmp("Compression", child->key) == 0)
+      network_config_set_compression(child, &se->data.client.compression);
+    else if (strcasecmp("Protocol", child->key) == 0)
+      network_config_set_protocol(child, &se->protocol);
+    else if (strcasecmp("SendQueueSize", child->key) == 0)
+      network_config_set_queue_size(child, &se->data.client.stream_queue_size);
+    else if (strcasecmp("TLS", child->key) == 0)
+      cf_util_get_boolean(child, &se->tls.enabled);
+    else if (strcasecmp("TLSCAFile", child->key) == 0)
+      cf_util_get_string(child, &se->tls.ca_file);
+    else if (strcasecmp("TLSCertFile", child->key) == 0)
+      cf_util_get_string(child, &se->tls.cert_file);
+    else if (strcasecmp("TLSKeyFile", child->key) == 0)
+      cf_util_get_string(child, &se->tls.key_file);
+    else if (strcasecmp("TLSVerifyPeer", child->key) == 0)
+      cf_util_get_boolean(child, &se->tls.verify_peer);
     else {
       WARNING("network plugin: Option `%s' is not allowed here.", child->key);
     }
@@ -2896,6 +5248,14 @@ static int network_config_add_server(const oconfig_item_t *ci) /* {{{ */
   }
 #endif /* HAVE_GCRYPT_H */
 
+  /* Compression applies to the compact format only. */
+  if (se->data.client.compression != COMPACT_COMPRESSION_NONE)
+    se->data.client.compact = 1;
+
+  /* TLS is only available over TCP. */
+  if (se->tls.enabled)
+    se->protocol = SOCKENT_PROTOCOL_TCP;
+
   status = sockent_init_crypto(se);
   if (status != 0) {
     ERROR("network plugin: network_config_add_server: sockent_init_crypto() "
@@ -2904,8 +5264,17 @@ static int network_config_add_server(const oconfig_item_t *ci) /* {{{ */
     return -1;
   }
 
+  status = sockent_init_tls(se);
+  if (status != 0) {
+    ERROR("network plugin: network_config_add_server: sockent_init_tls() "
+          "failed.");
+    sockent_destroy(se);
+    return -1;
+  }
+
   /* No call to sockent_client_connect() here -- it is called from
-   * network_send_buffer_plain(). */
+   * network_send_buffer_plain(). Stream connections are established by the
+   * stream's thread, started in network_init(). */
 
   status = sockent_add(se);
   if (status != 0) {
@@ -2941,6 +5310,8 @@ static int network_config(oconfig_item_t *ci) /* {{{ */
       cf_util_get_boolean(child, &network_config_forward);
     else if (strcasecmp("ReportStats", child->key) == 0)
       cf_util_get_boolean(child, &network_config_stats);
+    else if (strcasecmp("StreamThreads", child->key) == 0)
+      network_config_set_stream_threads(child);
     else {
       WARNING("network plugin: Option `%s' is not allowed here.", child->key);
     }
@@ -3029,6 +5400,14 @@ static int network_shutdown(void) {
     receive_thread_running = 0;
   }
 
+#if HAVE_SYS_EPOLL_H
+  /* Stop accepting and reading stream connections. */
+  if (stream_workers_num > 0) {
+    INFO("network plugin: Stopping stream threads.");
+    stream_stop_threads();
+  }
+#endif
+
   /* Shutdown the dispatching thread */
   if (dispatch_thread_running != 0) {
     INFO("network plugin: Stopping dispatch thread.");
@@ -3041,11 +5420,14 @@ static int network_shutdown(void) {
 
   sockent_destroy(listen_sockets);
 
-  if (send_buffer_fill > 0)
-    flush_buffer();
+  flush_buffers();
 
   sfree(send_buffer);
 
+  /* Stream threads send what has been queued before exiting. */
+  for (sockent_t *se = sending_sockets; se != NULL; se = se->next)
+    stream_client_stop(se);
+
   for (sockent_t *se = sending_sockets; se != NULL; se = se->next)
     sockent_client_disconnect(se);
   sockent_destroy(sending_sockets);
@@ -3072,9 +5454,9 @@ static int network_stats_read(void) /* {{{ */
   value_list_t vl = VALUE_LIST_INIT;
   value_t values[2];
 
-  copy_octets_rx = stats_octets_rx;
+  copy_octets_rx = stats_octets_rx + stats_stream_octets_rx;
   copy_octets_tx = stats_octets_tx;
-  copy_packets_rx = stats_packets_rx;
+  copy_packets_rx = stats_packets_rx + stats_stream_packets_rx;
   copy_packets_tx = stats_packets_tx;
   copy_values_dispatched = stats_values_dispatched;
   copy_values_not_dispatched = stats_values_not_dispatched;
@@ -3120,6 +5502,13 @@ static int network_stats_read(void) /* {{{ */
   sstrncpy(vl.type_instance, "send-rejected", sizeof(vl.type_instance));
   plugin_dispatch_values(&vl);
 
+  /* Packets dropped because a stream's send queue was full */
+  vl.values[0].derive =
+      __atomic_load_n(&stats_stream_packets_dropped, __ATOMIC_RELAXED);
+  sstrncpy(vl.type, "packets", sizeof(vl.type));
+  sstrncpy(vl.type_instance, "stream-dropped", sizeof(vl.type_instance));
+  plugin_dispatch_values(&vl);
+
   /* Receive queue length */
   vl.values[0].gauge = (gauge_t)copy_receive_list_length;
   sstrncpy(vl.type, "queue_length", sizeof(vl.type));
@@ -3150,6 +5539,37 @@ static int network_init(void) {
   }
   network_init_buffer();
 
+  /* The packet size is known only now that the config has been read. */
+  send_buffer_classic = 0;
+  for (sockent_t *se = sending_sockets; se != NULL; se = se->next) {
+    if (!se->data.client.compact) {
+      send_buffer_classic = 1;
+      continue;
+    }
+
+    se->data.client.compact_buffer = compact_buffer_create(
+        se->data.client.compression, network_config_packet_size);
+    if (se->data.client.compact_buffer == NULL) {
+      ERROR("network plugin: compact_buffer_create failed.");
+      return -1;
+    }
+  }
+
+  for (sockent_t *se = sending_sockets; se != NULL; se = se->next) {
+    int status;
+
+    if (se->protocol != SOCKENT_PROTOCOL_TCP)
+      continue;
+
+    status = stream_client_start(se);
+    if (status != 0) {
+      ERROR("network plugin: Starting the stream to \"%s\" failed with "
+            "status %i.",
+            se->node, status);
+      return -1;
+    }
+  }
+
   /* setup socket(s) and so on */
   if (sending_sockets != NULL) {
     plugin_register_write("network", network_write,
@@ -3159,8 +5579,7 @@ static int network_init(void) {
   }
 
   /* If no threads need to be started, return here. */
-  if ((listen_sockets_num == 0) ||
-      ((dispatch_thread_running != 0) && (receive_thread_running != 0)))
+  if ((listen_sockets_num == 0) && (stream_listen_num == 0))
     return 0;
 
   if (dispatch_thread_running == 0) {
@@ -3177,7 +5596,7 @@ static int network_init(void) {
     }
   }
 
-  if (receive_thread_running == 0) {
+  if ((listen_sockets_num > 0) && (receive_thread_running == 0)) {
     int status;
     status = plugin_thread_create(&receive_thread_id, NULL /* no attributes */,
                                   receive_thread, NULL /* no argument */,
@@ -3191,6 +5610,16 @@ static int network_init(void) {
     }
   }
 
+#if HAVE_SYS_EPOLL_H
+  if ((stream_listen_num > 0) && (stream_workers_num == 0)) {
+    if (stream_start_threads() != 0) {
+      ERROR("network plugin: Starting the stream threads failed.");
+      stream_stop_threads();
+      return -1;
+    }
+  }
+#endif
+
   return 0;
 } /* int network_init */
 
@@ -3206,7 +5635,7 @@ static int network_flush(cdtime_t timeout,
                          __attribute__((unused)) user_data_t *user_data) {
   pthread_mutex_lock(&send_buffer_lock);
 
-  if (send_buffer_fill > 0) {
+  if (!network_buffers_empty()) {
     if (timeout > 0) {
       cdtime_t now = cdtime();
       if ((send_buffer_last_update + timeout) > now) {
@@ -3214,7 +5643,7 @@ static int network_flush(cdtime_t timeout,
         return 0;
       }
     }
-    flush_buffer();
+    flush_buffers();
   }
   pthread_mutex_unlock(&send_buffer_lock);
 
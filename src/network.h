@@ -77,4 +77,28 @@
 #define TYPE_SIGN_SHA256 0x0200
 #define TYPE_ENCR_AES256 0x0210
 
+/* Value lists using an identifier dictionary and variable length integers,
+ * optionally compressed. Receivers not knowing this type skip it. */
+#define TYPE_COMPACT 0x0300
+
+#define COMPACT_COMPRESSION_NONE 0x00
+#define COMPACT_COMPRESSION_LZ4 0x01
+#define COMPACT_COMPRESSION_ZSTD 0x02
+
+/* Flags of a compact record: the fields that differ from the previous
+ * record of the same part. */
+#define COMPACT_FIELD_HOST 0x01
+#define COMPACT_FIELD_PLUGIN 0x02
+#define COMPACT_FIELD_PLUGIN_INSTANCE 0x04
+#define COMPACT_FIELD_TYPE 0x08
+#define COMPACT_FIELD_TYPE_INSTANCE 0x10
+#define COMPACT_FIELD_TIME 0x20
+#define COMPACT_FIELD_INTERVAL 0x40
+
+/* Value tags: the data source types plus gauges with an integer value. */
+#define COMPACT_VALUE_GAUGE_INT 0x04
+
+/* Number of strings a part's dictionary holds at most. */
+#define COMPACT_DICT_SIZE 512
+
 #endif /* NETWORK_H */
@@ -0,0 +1,226 @@
+/**
+ * collectd - src/network_bench.c
+ *
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include "network.c" /* sic */
+
+#include "benchmark.h"
+
+/* The configuration functions of the network plugin are never called. */
+int cf_util_get_string(const oconfig_item_t *ci, char **ret_string) {
+  return ENOTSUP;
+}
+
+int cf_util_get_string_buffer(const oconfig_item_t *ci, char *buffer,
+                              size_t buffer_size) {
+  return ENOTSUP;
+}
+
+int cf_util_get_int(const oconfig_item_t *ci, int *ret_value) {
+  return ENOTSUP;
+}
+
+int cf_util_get_boolean(const oconfig_item_t *ci, _Bool *ret_bool) {
+  return ENOTSUP;
+}
+
+int cf_util_get_cdtime(const oconfig_item_t *ci, cdtime_t *ret_value) {
+  return ENOTSUP;
+}
+
+#define SERIES_NUM 1000
+
+static data_source_t dsrc_if_octets[] = {
+    {"rx", DS_TYPE_DERIVE, 0.0, NAN}, {"tx", DS_TYPE_DERIVE, 0.0, NAN},
+};
+static data_set_t ds_if_octets = {"if_octets", 2, dsrc_if_octets};
+
+static value_t values_bench[] = {{.derive = 123456789}, {.derive = 987654}};
+static value_list_t series[SERIES_NUM];
+
+/* A packet filled with as many value lists as fit, and their number. */
+static char packet[1452];
+static size_t packet_size;
+static size_t packet_values;
+
+/* The same for a compact part without compression. */
+static char compact_packet[1452];
+static size_t compact_packet_size;
+static size_t compact_packet_values;
+
+/* Serializes value lists into a packet-sized buffer, starting over when the
+ * buffer is full. Consecutive value lists share host and plugin, as they
+ * usually do. One operation is one value list. */
+DEF_BENCH(add_to_buffer) {
+  char buffer[sizeof(packet)];
+  size_t fill = 0;
+  value_list_t vl_def = VALUE_LIST_INIT;
+
+  for (uint64_t i = 0; i < b->iterations; i++) {
+    value_list_t *vl = series + (i % SERIES_NUM);
+    int status;
+
+    status = add_to_buffer(buffer + fill, sizeof(buffer) - fill, &vl_def,
+                           &ds_if_octets, vl);
+    if (status < 0) {
+      fill = 0;
+      memset(&vl_def, 0, sizeof(vl_def));
+      status = add_to_buffer(buffer, sizeof(buffer), &vl_def, &ds_if_octets,
+                             vl);
+    }
+    fill += (size_t)status;
+  }
+  BENCH_KEEP(fill);
+}
+
+/* Like add_to_buffer, but adding records to a compact part and finalizing it
+ * whenever it is full. Every thread has a buffer of its own. */
+static void compact_add_bench(bench_t *b, int compression) {
+  compact_buffer_t *cb = compact_buffer_create(compression, sizeof(packet));
+  char buffer[sizeof(packet)];
+
+  for (uint64_t i = 0; i < b->iterations; i++) {
+    value_list_t *vl = series + (i % SERIES_NUM);
+
+    if (compact_buffer_add(cb, &ds_if_octets, vl) != 0) {
+      BENCH_KEEP(compact_buffer_finalize(cb, buffer, sizeof(buffer)));
+      compact_buffer_reset(cb);
+      compact_buffer_add(cb, &ds_if_octets, vl);
+    }
+  }
+  BENCH_KEEP(cb->raw_fill);
+
+  compact_buffer_destroy(cb);
+}
+
+DEF_BENCH(compact_add) { compact_add_bench(b, COMPACT_COMPRESSION_NONE); }
+
+#if HAVE_LIBLZ4
+DEF_BENCH(compact_add_lz4) { compact_add_bench(b, COMPACT_COMPRESSION_LZ4); }
+#endif
+
+#if HAVE_LIBZSTD
+DEF_BENCH(compact_add_zstd) { compact_add_bench(b, COMPACT_COMPRESSION_ZSTD); }
+#endif
+
+/* Parses a full packet and dispatches the value lists it contains. One
+ * operation is one value list. */
+DEF_BENCH(parse_packet) {
+  sockent_t se = {
+      .type = SOCKENT_TYPE_SERVER,
+  };
+
+  se.data.server.security_level = SECURITY_LEVEL_NONE;
+
+  for (uint64_t i = 0; i < b->iterations; i += packet_values) {
+    char buffer[sizeof(packet)];
+
+    /* parse_packet() may modify the buffer. */
+    memcpy(buffer, packet, packet_size);
+    parse_packet(&se, buffer, packet_size, /* flags = */ 0,
+                 /* username = */ NULL);
+  }
+}
+
+DEF_BENCH(parse_packet_compact) {
+  sockent_t se = {
+      .type = SOCKENT_TYPE_SERVER,
+  };
+
+  se.data.server.security_level = SECURITY_LEVEL_NONE;
+
+  for (uint64_t i = 0; i < b->iterations; i += compact_packet_values) {
+    char buffer[sizeof(compact_packet)];
+
+    memcpy(buffer, compact_packet, compact_packet_size);
+    parse_packet(&se, buffer, compact_packet_size, /* flags = */ 0,
+                 /* username = */ NULL);
+  }
+}
+
+/* The write callback, without any sockets to send to. All threads share the
+ * send buffer and its lock. */
+DEF_BENCH(network_write) {
+  for (uint64_t i = 0; i < b->iterations; i++)
+    network_write(&ds_if_octets, series + (i % SERIES_NUM),
+                  /* user_data = */ NULL);
+}
+
+int main(void) {
+  value_list_t vl_def = VALUE_LIST_INIT;
+
+  for (size_t i = 0; i < SERIES_NUM; i++) {
+    value_list_t *vl = series + i;
+
+    *vl = (value_list_t)VALUE_LIST_INIT;
+    vl->values = values_bench;
+    vl->values_len = 2;
+    vl->time = TIME_T_TO_CDTIME_T_STATIC(1480063672);
+    vl->interval = TIME_T_TO_CDTIME_T_STATIC(10);
+    snprintf(vl->host, sizeof(vl->host), "host%04zu.example.com", i / 50);
+    sstrncpy(vl->plugin, "interface", sizeof(vl->plugin));
+    snprintf(vl->plugin_instance, sizeof(vl->plugin_instance), "eth%zu",
+             i % 50);
+    sstrncpy(vl->type, "if_octets", sizeof(vl->type));
+  }
+
+  while (42) {
+    int status = add_to_buffer(packet + packet_size,
+                               sizeof(packet) - packet_size, &vl_def,
+                               &ds_if_octets, series + packet_values);
+    if (status < 0)
+      break;
+    packet_size += (size_t)status;
+    packet_values++;
+  }
+
+  compact_buffer_t *cb =
+      compact_buffer_create(COMPACT_COMPRESSION_NONE, sizeof(compact_packet));
+  while (compact_buffer_add(cb, &ds_if_octets,
+                            series + compact_packet_values) == 0)
+    compact_packet_values++;
+  compact_packet_size = (size_t)compact_buffer_finalize(
+      cb, compact_packet, sizeof(compact_packet));
+  compact_buffer_destroy(cb);
+
+  send_buffer = calloc(1, network_config_packet_size);
+  network_init_buffer();
+
+  RUN_BENCH(add_to_buffer, 1, NULL);
+  RUN_BENCH(add_to_buffer, BENCH_THREADS, NULL);
+  RUN_BENCH(parse_packet, 1, NULL);
+  RUN_BENCH(parse_packet, BENCH_THREADS, NULL);
+  RUN_BENCH(compact_add, 1, NULL);
+#if HAVE_LIBLZ4
+  RUN_BENCH(compact_add_lz4, 1, NULL);
+#endif
+#if HAVE_LIBZSTD
+  RUN_BENCH(compact_add_zstd, 1, NULL);
+#endif
+  RUN_BENCH(parse_packet_compact, 1, NULL);
+  RUN_BENCH(parse_packet_compact, BENCH_THREADS, NULL);
+  RUN_BENCH(network_write, 1, NULL);
+  RUN_BENCH(network_write, BENCH_THREADS, NULL);
+
+  free(send_buffer);
+  return 0;
+}
@@ -0,0 +1,651 @@
+/**
+ * collectd - src/network_test.c
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+/* Value lists decoded by the tests are captured instead of dispatched. */
+#define plugin_dispatch_values network_test_dispatch_values
+
+#include "network.c" /* sic */
+
+#include "testing.h"
+
+/* Defined in network_test_client.c, which uses libcollectdclient's headers.
+ * Writes a packet with the value lists checked by "compact_client". */
+int network_test_client_packet(void *buffer, size_t *buffer_size);
+
+static value_list_t dispatched[16];
+static value_t dispatched_values[16][4];
+static size_t dispatched_num = 0;
+
+int network_test_dispatch_values(value_list_t const *vl) {
+  if ((dispatched_num >= STATIC_ARRAY_SIZE(dispatched)) ||
+      (vl->values_len > STATIC_ARRAY_SIZE(dispatched_values[0])))
+    return ENOMEM;
+
+  dispatched[dispatched_num] = *vl;
+  memcpy(dispatched_values[dispatched_num], vl->values,
+         vl->values_len * sizeof(*vl->values));
+  dispatched[dispatched_num].values = dispatched_values[dispatched_num];
+  dispatched[dispatched_num].meta = NULL;
+  dispatched_num++;
+  return 0;
+}
+
+/* The configuration functions of the network plugin are never called. */
+int cf_util_get_string(const oconfig_item_t *ci, char **ret_string) {
+  return ENOTSUP;
+}
+
+int cf_util_get_string_buffer(const oconfig_item_t *ci, char *buffer,
+                              size_t buffer_size) {
+  return ENOTSUP;
+}
+
+int cf_util_get_int(const oconfig_item_t *ci, int *ret_value) {
+  return ENOTSUP;
+}
+
+int cf_util_get_boolean(const oconfig_item_t *ci, _Bool *ret_bool) {
+  return ENOTSUP;
+}
+
+int cf_util_get_cdtime(const oconfig_item_t *ci, cdtime_t *ret_value) {
+  return ENOTSUP;
+}
+
+/* Appends a frame holding "size" times the byte "c" to "buffer". */
+static size_t append_frame(char *buffer, size_t offset, uint32_t size,
+                           char c) {
+  uint32_t tmp = htonl(size);
+
+  memcpy(buffer + offset, &tmp, sizeof(tmp));
+  memset(buffer + offset + STREAM_FRAME_HEADER_SIZE, c, size);
+  return offset + STREAM_FRAME_HEADER_SIZE + size;
+}
+
+#if HAVE_SYS_EPOLL_H
+/* Frees the receive list and returns the number of entries it held. */
+static size_t receive_list_clear(void) {
+  size_t num = 0;
+
+  while (receive_list_head != NULL) {
+    receive_list_entry_t *ent = receive_list_head;
+    receive_list_head = ent->next;
+    sfree(ent->data);
+    sfree(ent);
+    num++;
+  }
+  receive_list_tail = NULL;
+  receive_list_length = 0;
+
+  return num;
+}
+
+static void conn_feed(stream_conn_t *conn, char const *data, size_t size) {
+  memcpy(conn->in + conn->in_len, data, size);
+  conn->in_len += size;
+}
+
+DEF_TEST(stream_conn_dispatch_partial) {
+  char frame[64];
+  size_t frame_len = append_frame(frame, 0, 10, 'a');
+  char in[128];
+  stream_conn_t conn = {.in = in, .in_size = sizeof(in), .listen_fd = 42};
+
+  /* Half a header: nothing is dispatched or consumed. */
+  conn_feed(&conn, frame, 2);
+  EXPECT_EQ_INT(0, stream_conn_dispatch(&conn));
+  EXPECT_EQ_UINT64(2, conn.in_len);
+  OK(receive_list_head == NULL);
+
+  /* The header and part of the payload. */
+  conn_feed(&conn, frame + 2, STREAM_FRAME_HEADER_SIZE + 3 - 2);
+  EXPECT_EQ_INT(0, stream_conn_dispatch(&conn));
+  EXPECT_EQ_UINT64(STREAM_FRAME_HEADER_SIZE + 3, conn.in_len);
+  OK(receive_list_head == NULL);
+
+  /* The rest of the frame. */
+  conn_feed(&conn, frame + STREAM_FRAME_HEADER_SIZE + 3,
+            frame_len - (STREAM_FRAME_HEADER_SIZE + 3));
+  EXPECT_EQ_INT(0, stream_conn_dispatch(&conn));
+  EXPECT_EQ_UINT64(0, conn.in_len);
+  CHECK_NOT_NULL(receive_list_head);
+  EXPECT_EQ_INT(10, receive_list_head->data_len);
+  EXPECT_EQ_INT(42, receive_list_head->fd);
+  OK(memcmp(receive_list_head->data, "aaaaaaaaaa", 10) == 0);
+  EXPECT_EQ_UINT64(1, receive_list_length);
+
+  EXPECT_EQ_UINT64(1, receive_list_clear());
+  return 0;
+}
+
+DEF_TEST(stream_conn_dispatch_multiple) {
+  char in[256];
+  stream_conn_t conn = {.in = in, .in_size = sizeof(in)};
+  size_t offset = 0;
+
+  /* Three complete frames, one of them empty, and the start of a fourth. */
+  offset = append_frame(in, offset, 3, 'a');
+  offset = append_frame(in, offset, 0, 'b');
+  offset = append_frame(in, offset, 5, 'c');
+  offset = append_frame(in, offset, 7, 'd');
+  conn.in_len = offset - 5;
+
+  EXPECT_EQ_INT(0, stream_conn_dispatch(&conn));
+
+  /* Empty frames are skipped. */
+  EXPECT_EQ_UINT64(2, receive_list_length);
+  CHECK_NOT_NULL(receive_list_head);
+  EXPECT_EQ_INT(3, receive_list_head->data_len);
+  OK(memcmp(receive_list_head->data, "aaa", 3) == 0);
+  CHECK_NOT_NULL(receive_list_head->next);
+  EXPECT_EQ_INT(5, receive_list_head->next->data_len);
+  OK(memcmp(receive_list_head->next->data, "ccccc", 5) == 0);
+  OK(receive_list_tail == receive_list_head->next);
+
+  /* The incomplete frame is moved to the start of the buffer. */
+  EXPECT_EQ_UINT64(STREAM_FRAME_HEADER_SIZE + 2, conn.in_len);
+  OK(memcmp(in + STREAM_FRAME_HEADER_SIZE, "dd", 2) == 0);
+
+  EXPECT_EQ_UINT64(2, receive_list_clear());
+  return 0;
+}
+
+DEF_TEST(stream_conn_dispatch_oversized) {
+  char in[64];
+  stream_conn_t conn = {.in = in, .in_size = sizeof(in)};
+  uint32_t tmp = htonl((uint32_t)network_config_packet_size + 1);
+  size_t offset = 0;
+
+  /* A valid frame followed by the header of one larger than any packet. */
+  offset = append_frame(in, offset, 4, 'a');
+  memcpy(in + offset, &tmp, sizeof(tmp));
+  conn.in_len = offset + sizeof(tmp);
+
+  OK(stream_conn_dispatch(&conn) != 0);
+
+  /* Frames before the invalid one are still dispatched. */
+  EXPECT_EQ_UINT64(1, receive_list_length);
+  EXPECT_EQ_UINT64(sizeof(tmp), conn.in_len);
+
+  EXPECT_EQ_UINT64(1, receive_list_clear());
+  return 0;
+}
+#endif /* HAVE_SYS_EPOLL_H */
+
+DEF_TEST(stream_client_rewind) {
+  struct {
+    size_t sent;
+    size_t want_fill;
+    uint32_t want_first; /* size of the first remaining frame */
+  } cases[] = {
+      /* Nothing sent. */
+      {0, 3 * STREAM_FRAME_HEADER_SIZE + 60, 10},
+      /* Part of the first header. */
+      {2, 3 * STREAM_FRAME_HEADER_SIZE + 60, 10},
+      /* The first frame, but for its last byte. */
+      {STREAM_FRAME_HEADER_SIZE + 9, 3 * STREAM_FRAME_HEADER_SIZE + 60, 10},
+      /* Exactly the first frame. */
+      {STREAM_FRAME_HEADER_SIZE + 10, 2 * STREAM_FRAME_HEADER_SIZE + 50, 20},
+      /* The first frame and the header of the second. */
+      {2 * STREAM_FRAME_HEADER_SIZE + 10, 2 * STREAM_FRAME_HEADER_SIZE + 50,
+       20},
+      /* Two frames and part of the third. */
+      {3 * STREAM_FRAME_HEADER_SIZE + 45, STREAM_FRAME_HEADER_SIZE + 30, 30},
+      /* Everything. */
+      {3 * STREAM_FRAME_HEADER_SIZE + 60, 0, 0},
+  };
+
+  for (size_t i = 0; i < STATIC_ARRAY_SIZE(cases); i++) {
+    char batch[256];
+    stream_client_t sc = {.batch = batch};
+
+    sc.batch_fill = append_frame(batch, sc.batch_fill, 10, 'a');
+    sc.batch_fill = append_frame(batch, sc.batch_fill, 20, 'b');
+    sc.batch_fill = append_frame(batch, sc.batch_fill, 30, 'c');
+    sc.batch_sent = cases[i].sent;
+
+    printf("## Case %zu: %zu bytes sent\n", i, cases[i].sent);
+
+    stream_client_rewind(&sc);
+
+    EXPECT_EQ_UINT64(cases[i].want_fill, sc.batch_fill);
+    EXPECT_EQ_UINT64(0, sc.batch_sent);
+
+    /* Only whole frames remain, starting with a header. */
+    if (cases[i].want_first != 0) {
+      uint32_t size;
+
+      memcpy(&size, batch, sizeof(size));
+      EXPECT_EQ_UINT64(cases[i].want_first, ntohl(size));
+      OK(batch[STREAM_FRAME_HEADER_SIZE] ==
+         "abc"[cases[i].want_first / 10 - 1]);
+    }
+  }
+
+  return 0;
+}
+
+DEF_TEST(stream_client_send_full) {
+  char queue[2 * STREAM_FRAME_HEADER_SIZE + 20];
+  char payload[10] = "0123456789";
+  stream_client_t sc = {.queue = queue, .queue_size = sizeof(queue)};
+  sockent_t se = {.node = "test"};
+  uint32_t size;
+
+  se.data.client.stream = &sc;
+  pthread_mutex_init(&sc.lock, NULL);
+  pthread_cond_init(&sc.cond, NULL);
+  C_COMPLAIN_INIT(&sc.queue_complaint);
+  stats_stream_packets_dropped = 0;
+
+  stream_client_send(&se, payload, sizeof(payload));
+  stream_client_send(&se, payload, sizeof(payload));
+  EXPECT_EQ_UINT64(sizeof(queue), sc.queue_fill);
+  EXPECT_EQ_UINT64(0, (uint64_t)stats_stream_packets_dropped);
+
+  /* A full queue drops the packet without waiting. */
+  stream_client_send(&se, payload, sizeof(payload));
+  EXPECT_EQ_UINT64(sizeof(queue), sc.queue_fill);
+  EXPECT_EQ_UINT64(1, (uint64_t)stats_stream_packets_dropped);
+
+  memcpy(&size, queue + STREAM_FRAME_HEADER_SIZE + sizeof(payload),
+         sizeof(size));
+  EXPECT_EQ_UINT64(sizeof(payload), ntohl(size));
+  OK(memcmp(queue + 2 * STREAM_FRAME_HEADER_SIZE + sizeof(payload), payload,
+            sizeof(payload)) == 0);
+
+  pthread_cond_destroy(&sc.cond);
+  pthread_mutex_destroy(&sc.lock);
+  return 0;
+}
+
+static data_source_t dsrc_compact[] = {
+    {"counter", DS_TYPE_COUNTER, 0, NAN},
+    {"gauge", DS_TYPE_GAUGE, NAN, NAN},
+    {"derive", DS_TYPE_DERIVE, NAN, NAN},
+    {"absolute", DS_TYPE_ABSOLUTE, 0, NAN},
+};
+static data_set_t const ds_compact = {"compact", 4, dsrc_compact};
+
+struct compact_test_record_s {
+  char const *host;
+  char const *plugin;
+  char const *plugin_instance;
+  char const *type_instance;
+  cdtime_t time;
+  cdtime_t interval;
+  counter_t counter;
+  gauge_t gauge;
+  derive_t derive;
+  absolute_t absolute;
+};
+typedef struct compact_test_record_s compact_test_record_t;
+
+static int compact_test_add(compact_buffer_t *cb,
+                            compact_test_record_t const *r) {
+  value_t values[] = {{.counter = r->counter},
+                      {.gauge = r->gauge},
+                      {.derive = r->derive},
+                      {.absolute = r->absolute}};
+  value_list_t vl = {
+      .values = values,
+      .values_len = STATIC_ARRAY_SIZE(values),
+      .time = r->time,
+      .interval = r->interval,
+      .type = "compact",
+  };
+
+  sstrncpy(vl.host, r->host, sizeof(vl.host));
+  sstrncpy(vl.plugin, r->plugin, sizeof(vl.plugin));
+  sstrncpy(vl.plugin_instance, r->plugin_instance,
+           sizeof(vl.plugin_instance));
+  sstrncpy(vl.type_instance, r->type_instance, sizeof(vl.type_instance));
+
+  return compact_buffer_add(cb, &ds_compact, &vl);
+}
+
+/* Checks the "idx"th dispatched value list against "r". */
+static int compact_test_check(size_t idx, compact_test_record_t const *r) {
+  value_list_t const *vl = dispatched + idx;
+
+  printf("## Value list %zu\n", idx);
+  EXPECT_EQ_STR(r->host, vl->host);
+  EXPECT_EQ_STR(r->plugin, vl->plugin);
+  EXPECT_EQ_STR(r->plugin_instance, vl->plugin_instance);
+  EXPECT_EQ_STR("compact", vl->type);
+  EXPECT_EQ_STR(r->type_instance, vl->type_instance);
+  EXPECT_EQ_UINT64(r->time, vl->time);
+  EXPECT_EQ_UINT64(r->interval, vl->interval);
+  EXPECT_EQ_UINT64(4, vl->values_len);
+  EXPECT_EQ_UINT64(r->counter, vl->values[0].counter);
+  EXPECT_EQ_DOUBLE(r->gauge, vl->values[1].gauge);
+  OK(!signbit(r->gauge) == !signbit(vl->values[1].gauge));
+  EXPECT_EQ_UINT64(r->derive, vl->values[2].derive);
+  EXPECT_EQ_UINT64(r->absolute, vl->values[3].absolute);
+
+  return 0;
+}
+
+/* Returns the number of times "str" occurs in "buffer". */
+static size_t count_string(char const *buffer, size_t buffer_size,
+                           char const *str) {
+  size_t len = strlen(str);
+  size_t num = 0;
+
+  for (size_t i = 0; i + len <= buffer_size; i++)
+    if (memcmp(buffer + i, str, len) == 0)
+      num++;
+
+  return num;
+}
+
+/* Encodes "records" into one packet, parses it and checks that the same value
+ * lists are dispatched. The packet is left in "buffer". */
+static int compact_round_trip(compact_test_record_t const *records,
+                              size_t records_num, char *buffer,
+                              size_t *buffer_size) {
+  sockent_t se = {.type = SOCKENT_TYPE_SERVER};
+  compact_buffer_t *cb;
+  int size;
+
+  CHECK_NOT_NULL(cb = compact_buffer_create(COMPACT_COMPRESSION_NONE, 1452));
+  for (size_t i = 0; i < records_num; i++)
+    CHECK_ZERO(compact_test_add(cb, records + i));
+  EXPECT_EQ_UINT64(records_num, cb->values_num);
+
+  size = compact_buffer_finalize(cb, buffer, *buffer_size);
+  compact_buffer_destroy(cb);
+  OK(size > 0);
+  *buffer_size = (size_t)size;
+
+  dispatched_num = 0;
+  CHECK_ZERO(parse_packet(&se, buffer, *buffer_size, /* flags = */ 0,
+                          /* username = */ NULL));
+  EXPECT_EQ_UINT64(records_num, dispatched_num);
+  for (size_t i = 0; i < records_num; i++)
+    CHECK_ZERO(compact_test_check(i, records + i));
+
+  return 0;
+}
+
+DEF_TEST(compact_round_trip) {
+  cdtime_t t0 = TIME_T_TO_CDTIME_T(1500000000) + 12345;
+  cdtime_t interval = TIME_T_TO_CDTIME_T(10);
+  char buffer[1452];
+  size_t buffer_size;
+
+  /* Every string that changes is new and sent as a literal. Strings equal to
+   * the previous record's, initially empty, are left out. */
+  compact_test_record_t literals[] = {
+      {"host-a.example.com", "cpu", "", "user", t0, interval, 42, 3.0, -7,
+       UINT64_MAX},
+      {"host-b.example.com", "memory", "0", "used", t0 + 1, interval / 2, 0,
+       0.25, INT64_MIN, 0},
+  };
+  buffer_size = sizeof(buffer);
+  CHECK_ZERO(compact_round_trip(literals, STATIC_ARRAY_SIZE(literals), buffer,
+                                &buffer_size));
+
+  /* Strings seen earlier in the part are references to the dictionary. The
+   * time goes back and forth, and gauges that aren't integers are sent as
+   * doubles. */
+  compact_test_record_t references[] = {
+      {"host-a.example.com", "cpu", "0", "user", t0, interval, 1, -3.0, 0, 1},
+      {"host-b.example.com", "cpu", "1", "user", t0 + 7, interval, 2, NAN,
+       INT64_MAX, 2},
+      {"host-a.example.com", "cpu", "0", "user", t0 - 5, interval, 3, -0.0, 5,
+       3},
+      {"host-b.example.com", "cpu", "1", "system", t0, 0, UINT64_MAX, 1e300,
+       -1, 4},
+      {"host-b.example.com", "cpu", "1", "system", t0, 0, 5, 0.5, 1, 5},
+  };
+  buffer_size = sizeof(buffer);
+  CHECK_ZERO(compact_round_trip(references, STATIC_ARRAY_SIZE(references),
+                                buffer, &buffer_size));
+  EXPECT_EQ_UINT64(1, count_string(buffer, buffer_size, "host-a.example.com"));
+  EXPECT_EQ_UINT64(1, count_string(buffer, buffer_size, "host-b.example.com"));
+  EXPECT_EQ_UINT64(1, count_string(buffer, buffer_size, "user"));
+
+  return 0;
+}
+
+DEF_TEST(compact_rollback) {
+  sockent_t se = {.type = SOCKENT_TYPE_SERVER};
+  cdtime_t t0 = TIME_T_TO_CDTIME_T(1500000000);
+  cdtime_t interval = TIME_T_TO_CDTIME_T(10);
+  /* Room for 112 bytes of records: the first two records and the last one
+   * fit, the third one doesn't. */
+  size_t packet_size =
+      112 + BUFF_SIG_SIZE + sizeof(part_header_t) + COMPACT_HEADER_SIZE;
+  char long_name[48];
+  compact_buffer_t *cb;
+  char buffer[128];
+  int size;
+
+  memset(long_name, 'x', sizeof(long_name) - 1);
+  long_name[sizeof(long_name) - 1] = 0;
+
+  compact_test_record_t records[] = {
+      {"example.com", "cpu", "0", "user", t0, interval, 1, 2.0, 3, 4},
+      {"example.com", "cpu", "1", "user", t0, interval, 5, 6.0, 7, 8},
+      /* Adds "memory" to the dictionary before running out of space. */
+      {"example.com", "memory", "", long_name, t0 + 1, interval, 0, 0.0, 0, 0},
+      /* "memory" must be a literal again. */
+      {"example.com", "memory", "", "used", t0 + 1, interval, 9, 10.0, 11, 12},
+  };
+
+  CHECK_NOT_NULL(cb = compact_buffer_create(COMPACT_COMPRESSION_NONE,
+                                            packet_size));
+  CHECK_ZERO(compact_test_add(cb, records + 0));
+  CHECK_ZERO(compact_test_add(cb, records + 1));
+
+  size_t raw_fill = cb->raw_fill;
+  size_t dict_num = cb->dict_num;
+  compact_record_t prev = cb->prev;
+  uint16_t hash[COMPACT_HASH_SIZE];
+  memcpy(hash, cb->hash, sizeof(hash));
+
+  OK(compact_test_add(cb, records + 2) != 0);
+  EXPECT_EQ_UINT64(raw_fill, cb->raw_fill);
+  EXPECT_EQ_UINT64(dict_num, cb->dict_num);
+  EXPECT_EQ_UINT64(2, cb->values_num);
+  OK(memcmp(&prev, &cb->prev, sizeof(prev)) == 0);
+  OK(memcmp(hash, cb->hash, sizeof(hash)) == 0);
+
+  CHECK_ZERO(compact_test_add(cb, records + 3));
+  EXPECT_EQ_UINT64(3, cb->values_num);
+
+  size = compact_buffer_finalize(cb, buffer, sizeof(buffer));
+  compact_buffer_destroy(cb);
+  OK(size > 0);
+  OK((size_t)size <= packet_size - BUFF_SIG_SIZE);
+
+  dispatched_num = 0;
+  CHECK_ZERO(parse_packet(&se, buffer, (size_t)size, /* flags = */ 0,
+                          /* username = */ NULL));
+  EXPECT_EQ_UINT64(3, dispatched_num);
+  CHECK_ZERO(compact_test_check(0, records + 0));
+  CHECK_ZERO(compact_test_check(1, records + 1));
+  CHECK_ZERO(compact_test_check(2, records + 3));
+
+  return 0;
+}
+
+/* Writes the header of a compact part followed by "payload" to "buffer". */
+static size_t compact_part(char *buffer, uint16_t part_size,
+                           uint8_t compression, uint16_t raw_size,
+                           char const *payload, size_t payload_size) {
+  uint16_t tmp16;
+
+  tmp16 = htons(TYPE_COMPACT);
+  memcpy(buffer, &tmp16, sizeof(tmp16));
+  tmp16 = htons(part_size);
+  memcpy(buffer + 2, &tmp16, sizeof(tmp16));
+  buffer[4] = (char)compression;
+  buffer[5] = 0;
+  tmp16 = htons(raw_size);
+  memcpy(buffer + 6, &tmp16, sizeof(tmp16));
+  memcpy(buffer + 8, payload, payload_size);
+
+  return 8 + payload_size;
+}
+
+DEF_TEST(compact_parse_malformed) {
+  /* A valid record: host "h", plugin "p" and type "t" are the dictionary's
+   * entries 1 to 3, the time is 2 and the value an integral gauge of 1. */
+  char const valid[] = {0x2b, 0, 1, 'h', 0, 1, 'p', 0, 1, 't', 4, 1, 4, 2};
+  struct {
+    char const *name;
+    unsigned char record[16];
+    size_t record_size;
+    int want_status;
+  } cases[] = {
+      {"reference to the last string", {0x01, 3, 1, 4, 2}, 5, 0},
+      {"reference past the dictionary", {0x01, 4, 1, 4, 2}, 5, -1},
+      {"truncated varint", {0x20, 0x80}, 2, -1},
+      {"varint longer than 64 bits",
+       {0x20, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0},
+       11,
+       -1},
+      {"truncated string", {0x01, 0, 5, 'a', 'b'}, 5, -1},
+      {"truncated string length", {0x01, 0}, 2, -1},
+      {"unknown flag", {0x80, 1, 4, 2}, 4, -1},
+      {"missing values", {0x00, 2, 4, 2}, 4, -1},
+      {"unknown value type", {0x00, 1, 0x7f, 2}, 4, -1},
+  };
+
+  for (size_t i = 0; i < STATIC_ARRAY_SIZE(cases); i++) {
+    char raw[64];
+    char buffer[128];
+    void *ptr = buffer;
+    size_t raw_size = sizeof(valid) + cases[i].record_size;
+    size_t size;
+
+    printf("## Case %zu: %s\n", i, cases[i].name);
+
+    memcpy(raw, valid, sizeof(valid));
+    memcpy(raw + sizeof(valid), cases[i].record, cases[i].record_size);
+    size = compact_part(buffer, (uint16_t)(8 + raw_size),
+                        COMPACT_COMPRESSION_NONE, (uint16_t)raw_size, raw,
+                        raw_size);
+
+    dispatched_num = 0;
+    EXPECT_EQ_INT(cases[i].want_status,
+                  parse_part_compact(&ptr, &size, /* username = */ NULL));
+    EXPECT_EQ_UINT64(0, size);
+
+    /* Records before the malformed one are dispatched. */
+    EXPECT_EQ_UINT64((cases[i].want_status == 0) ? 2 : 1, dispatched_num);
+    EXPECT_EQ_STR("h", dispatched[0].host);
+    EXPECT_EQ_STR("p", dispatched[0].plugin);
+    EXPECT_EQ_STR("t", dispatched[0].type);
+    EXPECT_EQ_UINT64(2, dispatched[0].time);
+    EXPECT_EQ_DOUBLE(1.0, dispatched[0].values[0].gauge);
+  }
+
+  return 0;
+}
+
+DEF_TEST(compact_part_length) {
+  char const valid[] = {0x2b, 0, 1, 'h', 0, 1, 'p', 0, 1, 't', 4, 1, 4, 2};
+  uint16_t const valid_size = (uint16_t)sizeof(valid);
+  struct {
+    char const *name;
+    uint16_t part_size;
+    uint8_t compression;
+    uint16_t raw_size;
+    int want_status;
+  } cases[] = {
+      {"valid part", 8 + valid_size, COMPACT_COMPRESSION_NONE, valid_size, 0},
+      {"records longer than the part", 8 + valid_size,
+       COMPACT_COMPRESSION_NONE, valid_size + 1, -1},
+      {"records shorter than the part", 8 + valid_size,
+       COMPACT_COMPRESSION_NONE, valid_size - 1, -1},
+      {"part shorter than its header", 6, COMPACT_COMPRESSION_NONE, 0, -1},
+      {"part longer than the packet", 9 + valid_size, COMPACT_COMPRESSION_NONE,
+       valid_size, -1},
+      {"unknown compression", 8 + valid_size, 0x7f, valid_size, -1},
+  };
+
+  for (size_t i = 0; i < STATIC_ARRAY_SIZE(cases); i++) {
+    char buffer[64];
+    void *ptr = buffer;
+    size_t size;
+
+    printf("## Case %zu: %s\n", i, cases[i].name);
+
+    size = compact_part(buffer, cases[i].part_size, cases[i].compression,
+                        cases[i].raw_size, valid, sizeof(valid));
+
+    dispatched_num = 0;
+    EXPECT_EQ_INT(cases[i].want_status,
+                  parse_part_compact(&ptr, &size, /* username = */ NULL));
+    EXPECT_EQ_UINT64((cases[i].want_status == 0) ? 1 : 0, dispatched_num);
+  }
+
+  return 0;
+}
+
+DEF_TEST(compact_client) {
+  sockent_t se = {.type = SOCKENT_TYPE_SERVER};
+  char buffer[1452];
+  size_t buffer_size = sizeof(buffer);
+
+  /* The value lists written by network_test_client_packet. */
+  compact_test_record_t const want[] = {
+      {"example.com", "client", "", "a", DOUBLE_TO_CDTIME_T(1500000000.5),
+       TIME_T_TO_CDTIME_T(10), 1, 2.0, 3, 4},
+      {"example.com", "client", "", "b", DOUBLE_TO_CDTIME_T(1500000000.5),
+       TIME_T_TO_CDTIME_T(10), 5, 0.125, 7, 8},
+      {"example.com", "client", "", "a", DOUBLE_TO_CDTIME_T(1500000010.5),
+       TIME_T_TO_CDTIME_T(10), 9, -10.0, 11, 12},
+  };
+
+  CHECK_ZERO(network_test_client_packet(buffer, &buffer_size));
+  OK(buffer_size <= sizeof(buffer));
+
+  dispatched_num = 0;
+  CHECK_ZERO(parse_packet(&se, buffer, buffer_size, /* flags = */ 0,
+                          /* username = */ NULL));
+  EXPECT_EQ_UINT64(STATIC_ARRAY_SIZE(want), dispatched_num);
+  for (size_t i = 0; i < STATIC_ARRAY_SIZE(want); i++)
+    CHECK_ZERO(compact_test_check(i, want + i));
+
+  return 0;
+}
+
+int main(void) {
+#if HAVE_SYS_EPOLL_H
+  RUN_TEST(stream_conn_dispatch_partial);
+  RUN_TEST(stream_conn_dispatch_multiple);
+  RUN_TEST(stream_conn_dispatch_oversized);
+#endif
+  RUN_TEST(stream_client_rewind);
+  RUN_TEST(stream_client_send_full);
+  RUN_TEST(compact_round_trip);
+  RUN_TEST(compact_rollback);
+  RUN_TEST(compact_parse_malformed);
+  RUN_TEST(compact_part_length);
+  RUN_TEST(compact_client);
+
+  END_TEST;
+}
@@ -0,0 +1,91 @@
+/**
+ * collectd - src/network_test_client.c
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+/* The client library's types clash with the daemon's, so its packets are
+ * written in this file, separate from network_test.c. */
+
+#include "config.h"
+
+#include <errno.h>
+#include <string.h>
+
+#include "libcollectdclient/collectd/client.h"
+#include "libcollectdclient/collectd/network_buffer.h"
+
+int network_test_client_packet(void *buffer, size_t *buffer_size);
+
+static int add_value(lcc_network_buffer_t *nb, char const *type_instance,
+                     double time, value_t const *values) {
+  value_t tmp[4];
+  int values_types[] = {LCC_TYPE_COUNTER, LCC_TYPE_GAUGE, LCC_TYPE_DERIVE,
+                        LCC_TYPE_ABSOLUTE};
+  lcc_value_list_t vl = {
+      .values = tmp,
+      .values_types = values_types,
+      .values_len = 4,
+      .time = time,
+      .interval = 10.0,
+      .identifier =
+          {
+              .host = "example.com", .plugin = "client", .type = "compact",
+          },
+  };
+
+  memcpy(tmp, values, sizeof(tmp));
+  strncpy(vl.identifier.type_instance, type_instance,
+          sizeof(vl.identifier.type_instance) - 1);
+
+  return lcc_network_buffer_add_value(nb, &vl);
+}
+
+/* Writes a packet with three value lists in the compact encoding. The second
+ * and third share most of their identifier with the first. */
+int network_test_client_packet(void *buffer, size_t *buffer_size) {
+  value_t a[] = {{.counter = 1}, {.gauge = 2.0}, {.derive = 3},
+                 {.absolute = 4}};
+  value_t b[] = {{.counter = 5}, {.gauge = 0.125}, {.derive = 7},
+                 {.absolute = 8}};
+  value_t c[] = {{.counter = 9}, {.gauge = -10.0}, {.derive = 11},
+                 {.absolute = 12}};
+  lcc_network_buffer_t *nb;
+  int status;
+
+  nb = lcc_network_buffer_create(*buffer_size);
+  if (nb == NULL)
+    return ENOMEM;
+
+  status = lcc_network_buffer_set_compact(nb, /* enable = */ 1,
+                                          LCC_COMPRESSION_NONE);
+  if (status == 0)
+    status = add_value(nb, "a", 1500000000.5, a);
+  if (status == 0)
+    status = add_value(nb, "b", 1500000000.5, b);
+  if (status == 0)
+    status = add_value(nb, "a", 1500000010.5, c);
+  if (status == 0)
+    status = lcc_network_buffer_finalize(nb);
+  if (status == 0)
+    status = lcc_network_buffer_get(nb, buffer, buffer_size);
+
+  lcc_network_buffer_destroy(nb);
+  return status;
+}
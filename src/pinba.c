@@ -23,6 +23,9 @@
  *   Florian Forster <octo at collectd.org>
  **/
 
+/* _GNU_SOURCE is needed in Linux to use recvmmsg */
+#define _GNU_SOURCE
+
 #include "collectd.h"
 
 #include "common.h"
@@ -38,6 +41,12 @@
 #define MSG_DONTWAIT MSG_NONBLOCK
 #endif
 
+#if KERNEL_LINUX && defined(MSG_WAITFORONE)
+#define PINBA_HAVE_RECVMMSG 1
+#else
+#define PINBA_HAVE_RECVMMSG 0
+#endif
+
 /*
  * Defines
  */
@@ -57,6 +66,20 @@
 #define PINBA_MAX_SOCKETS 16
 #endif
 
+/* Number of packets received with one recvmmsg(2) call. */
+#ifndef PINBA_RECV_BATCH
+#define PINBA_RECV_BATCH 16
+#endif
+
+#ifndef PINBA_MAX_THREADS
+#define PINBA_MAX_THREADS 64
+#endif
+
+/* Values of pinba_statnode_t.match[] other than an index into
+ * match_strings[]. */
+#define PINBA_MATCH_ANY -1
+#define PINBA_MATCH_NONE -2
+
 /*
  * Private data structures
  */
@@ -74,6 +97,21 @@ struct float_counter_s {
 };
 typedef struct float_counter_s float_counter_t;
 
+enum pinba_field_e {
+  PINBA_FIELD_HOST = 0,
+  PINBA_FIELD_SERVER,
+  PINBA_FIELD_SCRIPT,
+  PINBA_FIELD_MAX
+};
+
+/* The distinct strings one field of a request is compared to. */
+struct pinba_match_list_s {
+  char **strings;
+  uint32_t *hashes;
+  size_t num;
+};
+typedef struct pinba_match_list_s pinba_match_list_t;
+
 struct pinba_statnode_s {
   /* collector name, used as plugin instance */
   char *name;
@@ -83,6 +121,10 @@ struct pinba_statnode_s {
   char *server;
   char *script;
 
+  /* Per field, the index of the configured string in match_strings[] or
+   * PINBA_MATCH_ANY. */
+  int match[PINBA_FIELD_MAX];
+
   derive_t req_count;
 
   float_counter_t req_time;
@@ -93,6 +135,18 @@ struct pinba_statnode_s {
   gauge_t mem_peak;
 };
 typedef struct pinba_statnode_s pinba_statnode_t;
+
+/* A receiving thread. Each thread has its own sockets and accounts the
+ * requests it receives in its own copy of the counters, which are added up in
+ * service_statnode_collect(). The lock is thus only contended while reading. */
+struct pinba_receiver_s {
+  pthread_t thread;
+  _Bool thread_started;
+
+  pthread_mutex_t lock;
+  pinba_statnode_t *nodes; /* stat_nodes_num elements */
+};
+typedef struct pinba_receiver_s pinba_receiver_t;
 /* }}} */
 
 /*
@@ -101,14 +155,17 @@ typedef struct pinba_statnode_s pinba_statnode_t;
 /* {{{ */
 static pinba_statnode_t *stat_nodes = NULL;
 static unsigned int stat_nodes_num = 0;
-static pthread_mutex_t stat_nodes_lock;
+static pthread_mutex_t stat_nodes_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static pinba_match_list_t match_strings[PINBA_FIELD_MAX];
 
 static char *conf_node = NULL;
 static char *conf_service = NULL;
+static size_t conf_threads = 1;
 
-static _Bool collector_thread_running = 0;
+static pinba_receiver_t *receivers = NULL;
+static size_t receivers_num = 0;
 static _Bool collector_thread_do_shutdown = 0;
-static pthread_t collector_thread_id;
 /* }}} */
 
 /*
@@ -134,6 +191,17 @@ static void float_counter_add(float_counter_t *fc, float val) /* {{{ */
   }
 } /* }}} void float_counter_add */
 
+static void float_counter_merge(float_counter_t *dst, /* {{{ */
+                                const float_counter_t *src) {
+  dst->i += src->i;
+  dst->n += src->n;
+
+  if (dst->n >= 1000000000) {
+    dst->i += 1;
+    dst->n -= 1000000000;
+  }
+} /* }}} void float_counter_merge */
+
 static derive_t float_counter_get(const float_counter_t *fc, /* {{{ */
                                   uint64_t factor) {
   derive_t ret;
@@ -159,6 +227,66 @@ static void strset(char **str, const char *new) /* {{{ */
   *str = tmp;
 } /* }}} void strset */
 
+/* FNV-1a */
+static uint32_t pinba_hash(const char *str) /* {{{ */
+{
+  uint32_t hash = 2166136261u;
+
+  for (const unsigned char *ptr = (const unsigned char *)str; *ptr != 0; ptr++)
+    hash = (hash ^ *ptr) * 16777619u;
+
+  return hash;
+} /* }}} uint32_t pinba_hash */
+
+/* Returns the index of "str" in the list or PINBA_MATCH_NONE. */
+static int pinba_match_lookup(const pinba_match_list_t *l, /* {{{ */
+                              const char *str) {
+  uint32_t hash;
+
+  if ((l->num == 0) || (str == NULL))
+    return PINBA_MATCH_NONE;
+
+  hash = pinba_hash(str);
+  for (size_t i = 0; i < l->num; i++)
+    if ((l->hashes[i] == hash) && (strcmp(l->strings[i], str) == 0))
+      return (int)i;
+
+  return PINBA_MATCH_NONE;
+} /* }}} int pinba_match_lookup */
+
+/* Adds "str" to the list unless it is already in there. Returns the index of
+ * "str", PINBA_MATCH_ANY if it is NULL or PINBA_MATCH_NONE on error. */
+static int pinba_match_add(pinba_match_list_t *l, const char *str) /* {{{ */
+{
+  char **strings;
+  uint32_t *hashes;
+  int index;
+
+  if (str == NULL)
+    return PINBA_MATCH_ANY;
+
+  index = pinba_match_lookup(l, str);
+  if (index >= 0)
+    return index;
+
+  strings = realloc(l->strings, sizeof(*l->strings) * (l->num + 1));
+  if (strings == NULL)
+    return PINBA_MATCH_NONE;
+  l->strings = strings;
+
+  hashes = realloc(l->hashes, sizeof(*l->hashes) * (l->num + 1));
+  if (hashes == NULL)
+    return PINBA_MATCH_NONE;
+  l->hashes = hashes;
+
+  l->strings[l->num] = strdup(str);
+  if (l->strings[l->num] == NULL)
+    return PINBA_MATCH_NONE;
+  l->hashes[l->num] = pinba_hash(str);
+
+  return (int)(l->num++);
+} /* }}} int pinba_match_add */
+
 static void service_statnode_add(const char *name, /* {{{ */
                                  const char *host, const char *server,
                                  const char *script) {
@@ -188,35 +316,57 @@ static void service_statnode_add(const char *name, /* {{{ */
   strset(&node->server, server);
   strset(&node->script, script);
 
+  node->match[PINBA_FIELD_HOST] =
+      pinba_match_add(&match_strings[PINBA_FIELD_HOST], node->host);
+  node->match[PINBA_FIELD_SERVER] =
+      pinba_match_add(&match_strings[PINBA_FIELD_SERVER], node->server);
+  node->match[PINBA_FIELD_SCRIPT] =
+      pinba_match_add(&match_strings[PINBA_FIELD_SCRIPT], node->script);
+  for (size_t i = 0; i < PINBA_FIELD_MAX; i++)
+    if (node->match[i] == PINBA_MATCH_NONE)
+      ERROR("pinba plugin: Adding the match of view \"%s\" failed; the "
+            "view will not match any request.",
+            name);
+
   /* increment counter */
   stat_nodes_num++;
 } /* }}} void service_statnode_add */
 
+static void service_statnode_merge(pinba_statnode_t *dst, /* {{{ */
+                                   const pinba_statnode_t *src) {
+  dst->req_count += src->req_count;
+
+  float_counter_merge(&dst->req_time, &src->req_time);
+  float_counter_merge(&dst->ru_utime, &src->ru_utime);
+  float_counter_merge(&dst->ru_stime, &src->ru_stime);
+
+  dst->doc_size += src->doc_size;
+
+  if (!isnan(src->mem_peak) &&
+      (isnan(dst->mem_peak) || (dst->mem_peak < src->mem_peak)))
+    dst->mem_peak = src->mem_peak;
+} /* }}} void service_statnode_merge */
+
 /* Copy the data from the global "stat_nodes" list into the buffer pointed to
- * by "res", doing the derivation in the process. Returns the next index or
- * zero if the end of the list has been reached. */
+ * by "res" and add the counters of all receiving threads, doing the
+ * derivation in the process. Returns the next index or zero if the end of the
+ * list has been reached. */
 static unsigned int service_statnode_collect(pinba_statnode_t *res, /* {{{ */
                                              unsigned int index) {
-  pinba_statnode_t *node;
-
-  if (stat_nodes_num == 0)
+  if (index >= stat_nodes_num)
     return 0;
 
-  /* begin collecting */
-  if (index == 0)
-    pthread_mutex_lock(&stat_nodes_lock);
+  memcpy(res, stat_nodes + index, sizeof(*res));
 
-  /* end collecting */
-  if (index >= stat_nodes_num) {
-    pthread_mutex_unlock(&stat_nodes_lock);
-    return 0;
-  }
+  for (size_t i = 0; i < receivers_num; i++) {
+    pinba_receiver_t *r = receivers + i;
 
-  node = stat_nodes + index;
-  memcpy(res, node, sizeof(*res));
-
-  /* reset node */
-  node->mem_peak = NAN;
+    pthread_mutex_lock(&r->lock);
+    service_statnode_merge(res, r->nodes + index);
+    /* reset node */
+    r->nodes[index].mem_peak = NAN;
+    pthread_mutex_unlock(&r->lock);
+  }
 
   return index + 1;
 } /* }}} unsigned int service_statnode_collect */
@@ -237,27 +387,34 @@ static void service_statnode_process(pinba_statnode_t *node, /* {{{ */
 
 } /* }}} void service_statnode_process */
 
-static void service_process_request(Pinba__Request *request) /* {{{ */
-{
-  pthread_mutex_lock(&stat_nodes_lock);
+/* Accounts "request" in all matching elements of "nodes", the receiving
+ * thread's copy of "stat_nodes". The caller must hold the receiver's lock. */
+static void service_process_request(pinba_statnode_t *nodes, /* {{{ */
+                                    Pinba__Request *request) {
+  int match[PINBA_FIELD_MAX];
 
-  for (unsigned int i = 0; i < stat_nodes_num; i++) {
-    if ((stat_nodes[i].host != NULL) &&
-        (strcmp(request->hostname, stat_nodes[i].host) != 0))
-      continue;
+  /* Look up each field once instead of comparing it to every view. */
+  match[PINBA_FIELD_HOST] =
+      pinba_match_lookup(&match_strings[PINBA_FIELD_HOST], request->hostname);
+  match[PINBA_FIELD_SERVER] = pinba_match_lookup(
+      &match_strings[PINBA_FIELD_SERVER], request->server_name);
+  match[PINBA_FIELD_SCRIPT] = pinba_match_lookup(
+      &match_strings[PINBA_FIELD_SCRIPT], request->script_name);
 
-    if ((stat_nodes[i].server != NULL) &&
-        (strcmp(request->server_name, stat_nodes[i].server) != 0))
-      continue;
+  for (unsigned int i = 0; i < stat_nodes_num; i++) {
+    int const *want = stat_nodes[i].match;
+    _Bool matches = 1;
 
-    if ((stat_nodes[i].script != NULL) &&
-        (strcmp(request->script_name, stat_nodes[i].script) != 0))
-      continue;
+    for (size_t j = 0; j < PINBA_FIELD_MAX; j++) {
+      if ((want[j] != PINBA_MATCH_ANY) && (want[j] != match[j])) {
+        matches = 0;
+        break;
+      }
+    }
 
-    service_statnode_process(&stat_nodes[i], request);
+    if (matches)
+      service_statnode_process(nodes + i, request);
   }
-
-  pthread_mutex_unlock(&stat_nodes_lock);
 } /* }}} void service_process_request */
 
 static int pb_del_socket(pinba_socket_t *s, /* {{{ */
@@ -279,7 +436,7 @@ static int pb_del_socket(pinba_socket_t *s, /* {{{ */
 } /* }}} int pb_del_socket */
 
 static int pb_add_socket(pinba_socket_t *s, /* {{{ */
-                         const struct addrinfo *ai) {
+                         const struct addrinfo *ai, _Bool reuse_port) {
   int fd;
   int tmp;
   int status;
@@ -308,6 +465,24 @@ static int pb_add_socket(pinba_socket_t *s, /* {{{ */
             sstrerror(errno, errbuf, sizeof(errbuf)));
   }
 
+#ifdef SO_REUSEPORT
+  /* Let the kernel distribute the packets over the sockets of all receiving
+   * threads. */
+  if (reuse_port) {
+    tmp = 1;
+    status = setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &tmp, sizeof(tmp));
+    if (status != 0) {
+      char errbuf[1024];
+      ERROR("pinba plugin: setsockopt(SO_REUSEPORT) failed: %s",
+            sstrerror(errno, errbuf, sizeof(errbuf)));
+      close(fd);
+      return 0;
+    }
+  }
+#else
+  assert(!reuse_port);
+#endif
+
   status = bind(fd, ai->ai_addr, ai->ai_addrlen);
   if (status != 0) {
     char errbuf[1024];
@@ -326,7 +501,8 @@ static int pb_add_socket(pinba_socket_t *s, /* {{{ */
 } /* }}} int pb_add_socket */
 
 static pinba_socket_t *pinba_socket_open(const char *node, /* {{{ */
-                                         const char *service) {
+                                         const char *service,
+                                         _Bool reuse_port) {
   pinba_socket_t *s;
   struct addrinfo *ai_list;
   int status;
@@ -357,7 +533,7 @@ static pinba_socket_t *pinba_socket_open(const char *node, /* {{{ */
 
   for (struct addrinfo *ai_ptr = ai_list; ai_ptr != NULL;
        ai_ptr = ai_ptr->ai_next) {
-    status = pb_add_socket(s, ai_ptr);
+    status = pb_add_socket(s, ai_ptr, reuse_port);
     if (status != 0)
       break;
   } /* for (ai_list) */
@@ -388,7 +564,8 @@ static void pinba_socket_free(pinba_socket_t *socket) /* {{{ */
   sfree(socket);
 } /* }}} void pinba_socket_free */
 
-static int pinba_process_stats_packet(const uint8_t *buffer, /* {{{ */
+static int pinba_process_stats_packet(pinba_receiver_t *r, /* {{{ */
+                                      const uint8_t *buffer,
                                       size_t buffer_size) {
   Pinba__Request *request;
 
@@ -397,14 +574,88 @@ static int pinba_process_stats_packet(const uint8_t *buffer, /* {{{ */
   if (!request)
     return -1;
 
-  service_process_request(request);
+  pthread_mutex_lock(&r->lock);
+  service_process_request(r->nodes, request);
+  pthread_mutex_unlock(&r->lock);
   pinba__request__free_unpacked(request, NULL);
 
   return 0;
 } /* }}} int pinba_process_stats_packet */
 
-static int pinba_udp_read_callback_fn(int sock) /* {{{ */
-{
+#if PINBA_HAVE_RECVMMSG
+/* Receives up to PINBA_RECV_BATCH packets with one system call and accounts
+ * all of them with one lock operation. "buffer" must hold PINBA_RECV_BATCH
+ * times PINBA_UDP_BUFFER_SIZE bytes. */
+static int pinba_udp_read_batch(pinba_receiver_t *r, int sock, /* {{{ */
+                                uint8_t *buffer) {
+  struct mmsghdr msgs[PINBA_RECV_BATCH];
+  struct iovec iov[PINBA_RECV_BATCH];
+  Pinba__Request *requests[PINBA_RECV_BATCH];
+  size_t requests_num = 0;
+  int status;
+
+  for (size_t i = 0; i < PINBA_RECV_BATCH; i++) {
+    iov[i] = (struct iovec){
+        .iov_base = buffer + (i * PINBA_UDP_BUFFER_SIZE),
+        .iov_len = PINBA_UDP_BUFFER_SIZE,
+    };
+    msgs[i] = (struct mmsghdr){
+        .msg_hdr = {.msg_iov = iov + i, .msg_iovlen = 1},
+    };
+  }
+
+  do {
+    status = recvmmsg(sock, msgs, PINBA_RECV_BATCH, MSG_DONTWAIT,
+                      /* timeout = */ NULL);
+  } while ((status < 0) && (errno == EINTR));
+
+  if (status < 0) {
+    char errbuf[1024];
+
+    if ((errno == EAGAIN)
+#ifdef EWOULDBLOCK
+        || (errno == EWOULDBLOCK)
+#endif
+            )
+      return 0;
+
+    WARNING("pinba plugin: recvmmsg(2) failed: %s",
+            sstrerror(errno, errbuf, sizeof(errbuf)));
+    return -1;
+  }
+
+  for (int i = 0; i < status; i++) {
+    if (msgs[i].msg_hdr.msg_flags & MSG_TRUNC) {
+      DEBUG("pinba plugin: Ignoring truncated packet.");
+      continue;
+    }
+
+    requests[requests_num] = pinba__request__unpack(
+        NULL, msgs[i].msg_len, buffer + (i * PINBA_UDP_BUFFER_SIZE));
+    if (requests[requests_num] == NULL) {
+      DEBUG("pinba plugin: Parsing packet failed.");
+      continue;
+    }
+    requests_num++;
+  }
+
+  if (requests_num == 0)
+    return 0;
+
+  pthread_mutex_lock(&r->lock);
+  for (size_t i = 0; i < requests_num; i++)
+    service_process_request(r->nodes, requests[i]);
+  pthread_mutex_unlock(&r->lock);
+
+  for (size_t i = 0; i < requests_num; i++)
+    pinba__request__free_unpacked(requests[i], NULL);
+
+  return 0;
+} /* }}} int pinba_udp_read_batch */
+#endif /* PINBA_HAVE_RECVMMSG */
+
+static int pinba_udp_read_callback_fn(pinba_receiver_t *r, /* {{{ */
+                                      int sock) {
   uint8_t buffer[PINBA_UDP_BUFFER_SIZE];
   size_t buffer_size;
   int status;
@@ -416,13 +667,15 @@ static int pinba_udp_read_callback_fn(int sock) /* {{{ */
     if (status < 0) {
       char errbuf[1024];
 
-      if ((errno == EINTR)
+      if (errno == EINTR)
+        continue;
+
+      if ((errno == EAGAIN)
 #ifdef EWOULDBLOCK
           || (errno == EWOULDBLOCK)
 #endif
-          || (errno == EAGAIN)) {
-        continue;
-      }
+              )
+        return 0;
 
       WARNING("pinba plugin: recvfrom(2) failed: %s",
               sstrerror(errno, errbuf, sizeof(errbuf)));
@@ -436,7 +689,7 @@ static int pinba_udp_read_callback_fn(int sock) /* {{{ */
       buffer_size = (size_t)status;
       buffer[buffer_size] = 0;
 
-      status = pinba_process_stats_packet(buffer, buffer_size);
+      status = pinba_process_stats_packet(r, buffer, buffer_size);
       if (status != 0)
         DEBUG("pinba plugin: Parsing packet failed.");
       return status;
@@ -448,16 +701,24 @@ static int pinba_udp_read_callback_fn(int sock) /* {{{ */
   return -1;
 } /* }}} void pinba_udp_read_callback_fn */
 
-static int receive_loop(void) /* {{{ */
+static int receive_loop(pinba_receiver_t *r) /* {{{ */
 {
   pinba_socket_t *s;
+  uint8_t *batch_buffer = NULL;
 
-  s = pinba_socket_open(conf_node, conf_service);
+  s = pinba_socket_open(conf_node, conf_service,
+                        /* reuse_port = */ receivers_num > 1);
   if (s == NULL) {
     ERROR("pinba plugin: Collector thread is exiting prematurely.");
     return -1;
   }
 
+#if PINBA_HAVE_RECVMMSG
+  batch_buffer = malloc(PINBA_RECV_BATCH * PINBA_UDP_BUFFER_SIZE);
+  if (batch_buffer == NULL)
+    WARNING("pinba plugin: malloc failed, receiving one packet at a time.");
+#endif
+
   while (!collector_thread_do_shutdown) {
     int status;
 
@@ -477,6 +738,7 @@ static int receive_loop(void) /* {{{ */
       ERROR("pinba plugin: poll(2) failed: %s",
             sstrerror(errno, errbuf, sizeof(errbuf)));
       pinba_socket_free(s);
+      sfree(batch_buffer);
       return -1;
     }
 
@@ -485,23 +747,28 @@ static int receive_loop(void) /* {{{ */
         pb_del_socket(s, i);
         i--;
       } else if (s->fd[i].revents & (POLLIN | POLLPRI)) {
-        pinba_udp_read_callback_fn(s->fd[i].fd);
+#if PINBA_HAVE_RECVMMSG
+        if (batch_buffer != NULL) {
+          pinba_udp_read_batch(r, s->fd[i].fd, batch_buffer);
+          continue;
+        }
+#endif
+        pinba_udp_read_callback_fn(r, s->fd[i].fd);
       }
     } /* for (s->fd) */
   }   /* while (!collector_thread_do_shutdown) */
 
   pinba_socket_free(s);
   s = NULL;
+  sfree(batch_buffer);
 
   return 0;
 } /* }}} int receive_loop */
 
 static void *collector_thread(void *arg) /* {{{ */
 {
-  receive_loop();
+  receive_loop(arg);
 
-  memset(&collector_thread_id, 0, sizeof(collector_thread_id));
-  collector_thread_running = 0;
   pthread_exit(NULL);
   return NULL;
 } /* }}} void *collector_thread */
@@ -563,6 +830,25 @@ static int plugin_config(oconfig_item_t *ci) /* {{{ */
       cf_util_get_string(child, &conf_node);
     else if (strcasecmp("Port", child->key) == 0)
       cf_util_get_service(child, &conf_service);
+    else if (strcasecmp("ReceiveThreads", child->key) == 0) {
+      int tmp = 0;
+
+      if (cf_util_get_int(child, &tmp) != 0)
+        continue;
+      if ((tmp < 1) || (tmp > PINBA_MAX_THREADS)) {
+        WARNING("pinba plugin: ReceiveThreads must be between 1 and %i.",
+                PINBA_MAX_THREADS);
+        continue;
+      }
+#ifndef SO_REUSEPORT
+      if (tmp > 1) {
+        WARNING("pinba plugin: ReceiveThreads requires SO_REUSEPORT, which "
+                "is not available on this system. Using one thread.");
+        tmp = 1;
+      }
+#endif
+      conf_threads = (size_t)tmp;
+    }
     else if (strcasecmp("View", child->key) == 0)
       pinba_config_view(child);
     else
@@ -576,8 +862,6 @@ static int plugin_config(oconfig_item_t *ci) /* {{{ */
 
 static int plugin_init(void) /* {{{ */
 {
-  int status;
-
   if (stat_nodes == NULL) {
     /* Collect the "total" data by default. */
     service_statnode_add("total",
@@ -586,41 +870,77 @@ static int plugin_init(void) /* {{{ */
                          /* script = */ NULL);
   }
 
-  if (collector_thread_running)
+  if (receivers != NULL)
     return 0;
 
-  status = plugin_thread_create(&collector_thread_id,
-                                /* attrs = */ NULL, collector_thread,
-                                /* args = */ NULL, "pinba collector");
-  if (status != 0) {
-    char errbuf[1024];
-    ERROR("pinba plugin: pthread_create(3) failed: %s",
-          sstrerror(errno, errbuf, sizeof(errbuf)));
+  receivers = calloc(conf_threads, sizeof(*receivers));
+  if (receivers == NULL) {
+    ERROR("pinba plugin: calloc failed.");
     return -1;
   }
-  collector_thread_running = 1;
+
+  for (size_t i = 0; i < conf_threads; i++) {
+    pinba_receiver_t *r = receivers + i;
+
+    r->nodes = calloc(stat_nodes_num, sizeof(*r->nodes));
+    if (r->nodes == NULL) {
+      ERROR("pinba plugin: calloc failed.");
+      return -1;
+    }
+    for (unsigned int j = 0; j < stat_nodes_num; j++)
+      r->nodes[j].mem_peak = NAN;
+
+    pthread_mutex_init(&r->lock, /* attr = */ NULL);
+    receivers_num++;
+  }
+
+  for (size_t i = 0; i < receivers_num; i++) {
+    pinba_receiver_t *r = receivers + i;
+    int status;
+
+    status = plugin_thread_create(&r->thread,
+                                  /* attrs = */ NULL, collector_thread,
+                                  /* args = */ r, "pinba collector");
+    if (status != 0) {
+      char errbuf[1024];
+      ERROR("pinba plugin: pthread_create(3) failed: %s",
+            sstrerror(errno, errbuf, sizeof(errbuf)));
+      return -1;
+    }
+    r->thread_started = 1;
+  }
 
   return 0;
 } /* }}} */
 
 static int plugin_shutdown(void) /* {{{ */
 {
-  if (collector_thread_running) {
+  DEBUG("pinba plugin: Shutting down collector threads.");
+  collector_thread_do_shutdown = 1;
+
+  for (size_t i = 0; i < receivers_num; i++) {
+    pinba_receiver_t *r = receivers + i;
     int status;
 
-    DEBUG("pinba plugin: Shutting down collector thread.");
-    collector_thread_do_shutdown = 1;
+    if (!r->thread_started)
+      continue;
 
-    status = pthread_join(collector_thread_id, /* retval = */ NULL);
+    status = pthread_join(r->thread, /* retval = */ NULL);
     if (status != 0) {
       char errbuf[1024];
       ERROR("pinba plugin: pthread_join(3) failed: %s",
             sstrerror(status, errbuf, sizeof(errbuf)));
     }
+    r->thread_started = 0;
+  }
 
-    collector_thread_running = 0;
-    collector_thread_do_shutdown = 0;
-  } /* if (collector_thread_running) */
+  for (size_t i = 0; i < receivers_num; i++) {
+    pthread_mutex_destroy(&receivers[i].lock);
+    sfree(receivers[i].nodes);
+  }
+  sfree(receivers);
+  receivers_num = 0;
+  collector_thread_do_shutdown = 0;
 
   return 0;
 } /* }}} int plugin_shutdown */
@@ -103,8 +103,23 @@ typedef struct {
   char *name;
   char *statement;
   _Bool store_rates;
+
+  /* COPY writers: rows are collected and streamed using this statement. */
+  char *copy_statement;
+  int batch_size;
+  cdtime_t batch_flush_timeout;
 } c_psql_writer_t;
 
+/* Rows collected for a COPY writer, in COPY's text format. */
+typedef struct {
+  char *buffer;
+  size_t buffer_size;
+  size_t buffer_fill;
+  int rows_num;
+  cdtime_t since;
+  _Bool flush;
+} c_psql_copy_t;
+
 typedef struct {
   PGconn *conn;
   c_complain_t conn_complaint;
@@ -125,6 +140,17 @@ typedef struct {
   /* make sure we don't access the database object in parallel */
   pthread_mutex_t db_lock;
 
+  /* Rows of COPY writers, indexed like "writers". They are queued by
+   * c_psql_write() and sent by a separate thread, so that the write threads
+   * don't have to wait for the database. */
+  c_psql_copy_t *copies;
+  size_t copy_writers_num;
+  pthread_mutex_t copy_lock;
+  pthread_cond_t copy_cond;
+  pthread_t copy_thread;
+  _Bool copy_thread_running;
+  _Bool copy_shutdown;
+
   cdtime_t interval;
 
   /* writer "caching" settings */
@@ -236,6 +262,13 @@ static c_psql_database_t *c_psql_database_new(const char *name) {
 
   pthread_mutex_init(&db->db_lock, /* attrs = */ NULL);
 
+  db->copies = NULL;
+  db->copy_writers_num = 0;
+  pthread_mutex_init(&db->copy_lock, /* attrs = */ NULL);
+  pthread_cond_init(&db->copy_cond, /* attrs = */ NULL);
+  db->copy_thread_running = 0;
+  db->copy_shutdown = 0;
+
   db->interval = 0;
 
   db->commit_interval = 0;
@@ -268,6 +301,17 @@ static void c_psql_database_delete(void *data) {
   if (db->ref_cnt > 0)
     return;
 
+  /* the copy thread sends all remaining rows before exiting */
+  if (db->copy_thread_running) {
+    pthread_mutex_lock(&db->copy_lock);
+    db->copy_shutdown = 1;
+    pthread_cond_broadcast(&db->copy_cond);
+    pthread_mutex_unlock(&db->copy_lock);
+
+    pthread_join(db->copy_thread, NULL);
+    db->copy_thread_running = 0;
+  }
+
   /* wait for the lock to be released by the last writer */
   pthread_mutex_lock(&db->db_lock);
 
@@ -285,12 +329,20 @@ static void c_psql_database_delete(void *data) {
   sfree(db->queries);
   db->queries_num = 0;
 
+  if (db->copies != NULL)
+    for (size_t i = 0; i < db->writers_num; ++i)
+      sfree(db->copies[i].buffer);
+  sfree(db->copies);
+  db->copy_writers_num = 0;
+
   sfree(db->writers);
   db->writers_num = 0;
 
   pthread_mutex_unlock(&db->db_lock);
 
   pthread_mutex_destroy(&db->db_lock);
+  pthread_mutex_destroy(&db->copy_lock);
+  pthread_cond_destroy(&db->copy_cond);
 
   sfree(db->database);
   sfree(db->host);
@@ -767,6 +819,230 @@ static char *values_to_sqlarray(const data_set_t *ds, const value_list_t *vl,
   return string;
 } /* values_to_sqlarray */
 
+/* Appends one field in COPY's text format, i.e. with backslash escapes, to
+ * "copy". NULL is encoded as "\N". */
+static int c_psql_copy_append_field(c_psql_copy_t *copy, const char *field,
+                                    char delim) {
+  size_t len = (field != NULL) ? strlen(field) : 0;
+
+  /* Worst case: every character is escaped. */
+  if (copy->buffer_size - copy->buffer_fill < 2 * len + 3) {
+    size_t size = (copy->buffer_size > 0) ? copy->buffer_size : 4096;
+    char *tmp;
+
+    while (size - copy->buffer_fill < 2 * len + 3)
+      size *= 2;
+
+    tmp = realloc(copy->buffer, size);
+    if (tmp == NULL) {
+      log_err("Out of memory.");
+      return -1;
+    }
+    copy->buffer = tmp;
+    copy->buffer_size = size;
+  }
+
+  if (field == NULL) {
+    copy->buffer[copy->buffer_fill++] = '\\';
+    copy->buffer[copy->buffer_fill++] = 'N';
+  }
+
+  for (size_t i = 0; i < len; i++) {
+    char c = field[i];
+
+    switch (c) {
+    case '\\':
+      break;
+    case '\t':
+      c = 't';
+      break;
+    case '\n':
+      c = 'n';
+      break;
+    case '\r':
+      c = 'r';
+      break;
+    default:
+      copy->buffer[copy->buffer_fill++] = c;
+      continue;
+    }
+
+    copy->buffer[copy->buffer_fill++] = '\\';
+    copy->buffer[copy->buffer_fill++] = c;
+  }
+
+  copy->buffer[copy->buffer_fill++] = delim;
+  return 0;
+} /* c_psql_copy_append_field */
+
+/* Queues one row for the COPY writer at index "idx" and wakes up the copy
+ * thread if the batch has been started or is complete. */
+static int c_psql_copy_queue(c_psql_database_t *db, size_t idx,
+                             const char *const *params, size_t params_num) {
+  c_psql_writer_t *writer = db->writers[idx];
+  c_psql_copy_t *copy = db->copies + idx;
+  size_t fill;
+  int status = 0;
+
+  pthread_mutex_lock(&db->copy_lock);
+
+  fill = copy->buffer_fill;
+  for (size_t i = 0; i < params_num; ++i) {
+    status = c_psql_copy_append_field(copy, params[i],
+                                      (i == params_num - 1) ? '\n' : '\t');
+    if (status != 0) {
+      /* don't leave a partial row behind */
+      copy->buffer_fill = fill;
+      break;
+    }
+  }
+
+  if (status == 0) {
+    if (copy->rows_num == 0)
+      copy->since = cdtime();
+    copy->rows_num++;
+
+    /* The first row of a batch sets a new deadline the copy thread may not be
+     * waiting for yet. */
+    if ((copy->rows_num == 1) || (copy->rows_num >= writer->batch_size))
+      pthread_cond_signal(&db->copy_cond);
+  }
+
+  pthread_mutex_unlock(&db->copy_lock);
+  return status;
+} /* c_psql_copy_queue */
+
+/* Streams "data" to the database using the writer's COPY statement. */
+static int c_psql_copy_send(c_psql_database_t *db, c_psql_writer_t *writer,
+                            const char *data, size_t data_len, int rows_num) {
+  PGresult *res;
+  int status = 0;
+
+  pthread_mutex_lock(&db->db_lock);
+
+  if (0 != c_psql_check_connection(db)) {
+    pthread_mutex_unlock(&db->db_lock);
+    log_err("Writer \"%s\": Dropping %d row(s).", writer->name, rows_num);
+    return -1;
+  }
+
+  if ((db->commit_interval > 0) && (db->next_commit == 0))
+    c_psql_begin(db);
+
+  res = PQexec(db->conn, writer->copy_statement);
+  if (PGRES_COPY_IN != PQresultStatus(res)) {
+    log_err("Failed to start COPY: %s", PQerrorMessage(db->conn));
+    log_info("SQL query was: '%s'", writer->copy_statement);
+    PQclear(res);
+
+    /* this will abort any current transaction -> restart */
+    if (db->next_commit > 0)
+      c_psql_commit(db);
+
+    pthread_mutex_unlock(&db->db_lock);
+    log_err("Writer \"%s\": Dropping %d row(s).", writer->name, rows_num);
+    return -1;
+  }
+  PQclear(res);
+
+  while (data_len > 0) {
+    /* PQputCopyData() takes an int */
+    int chunk = (data_len > 1048576) ? 1048576 : (int)data_len;
+
+    if (PQputCopyData(db->conn, data, chunk) != 1) {
+      status = -1;
+      break;
+    }
+    data += chunk;
+    data_len -= (size_t)chunk;
+  }
+
+  if (PQputCopyEnd(db->conn, (status == 0) ? NULL : "sending data failed") !=
+      1)
+    status = -1;
+
+  while ((res = PQgetResult(db->conn)) != NULL) {
+    if (PGRES_COMMAND_OK != PQresultStatus(res))
+      status = -1;
+    PQclear(res);
+  }
+
+  if (status != 0) {
+    log_err("Writer \"%s\": Failed to copy %d row(s): %s", writer->name,
+            rows_num, PQerrorMessage(db->conn));
+
+    if (db->next_commit > 0)
+      c_psql_commit(db);
+  } else if ((db->next_commit > 0) && (cdtime() > db->next_commit))
+    c_psql_commit(db);
+
+  pthread_mutex_unlock(&db->db_lock);
+  return status;
+} /* c_psql_copy_send */
+
+static void *c_psql_copy_thread(void *arg) {
+  c_psql_database_t *db = arg;
+
+  pthread_mutex_lock(&db->copy_lock);
+  while (42) {
+    cdtime_t now = cdtime();
+    cdtime_t next_due = 0;
+    c_psql_copy_t *due = NULL;
+    size_t idx = 0;
+
+    for (size_t i = 0; i < db->writers_num; ++i) {
+      c_psql_writer_t *writer = db->writers[i];
+      c_psql_copy_t *copy = db->copies + i;
+      cdtime_t deadline;
+
+      if ((writer->copy_statement == NULL) || (copy->rows_num == 0))
+        continue;
+
+      deadline = copy->since + writer->batch_flush_timeout;
+      if (db->copy_shutdown || copy->flush ||
+          (copy->rows_num >= writer->batch_size) || (deadline <= now)) {
+        due = copy;
+        idx = i;
+        break;
+      }
+
+      if ((next_due == 0) || (deadline < next_due))
+        next_due = deadline;
+    }
+
+    if (due != NULL) {
+      char *data = due->buffer;
+      size_t data_len = due->buffer_fill;
+      int rows_num = due->rows_num;
+
+      due->buffer = NULL;
+      due->buffer_size = 0;
+      due->buffer_fill = 0;
+      due->rows_num = 0;
+      due->flush = 0;
+
+      pthread_mutex_unlock(&db->copy_lock);
+      c_psql_copy_send(db, db->writers[idx], data, data_len, rows_num);
+      sfree(data);
+      pthread_mutex_lock(&db->copy_lock);
+      continue;
+    }
+
+    if (db->copy_shutdown)
+      break;
+
+    if (next_due == 0) {
+      pthread_cond_wait(&db->copy_cond, &db->copy_lock);
+    } else {
+      struct timespec ts = CDTIME_T_TO_TIMESPEC(next_due);
+      pthread_cond_timedwait(&db->copy_cond, &db->copy_lock, &ts);
+    }
+  }
+  pthread_mutex_unlock(&db->copy_lock);
+
+  return NULL;
+} /* c_psql_copy_thread */
+
 static int c_psql_write(const data_set_t *ds, const value_list_t *vl,
                         user_data_t *ud) {
   c_psql_database_t *db;
@@ -818,6 +1094,31 @@ static int c_psql_write(const data_set_t *ds, const value_list_t *vl,
     return 0;
   }
 
+  for (size_t i = 0; i < db->writers_num; ++i) {
+    c_psql_writer_t *writer = db->writers[i];
+
+    if (writer->copy_statement == NULL)
+      continue;
+
+    if (values_type_to_sqlarray(ds, values_type_str, sizeof(values_type_str),
+                                writer->store_rates) == NULL)
+      return -1;
+
+    if (values_to_sqlarray(ds, vl, values_str, sizeof(values_str),
+                           writer->store_rates) == NULL)
+      return -1;
+
+    params[7] = values_type_str;
+    params[8] = values_str;
+
+    if (c_psql_copy_queue(db, i, params, STATIC_ARRAY_SIZE(params)) != 0)
+      return -1;
+    success = 1;
+  }
+
+  if (db->copy_writers_num == db->writers_num)
+    return 0;
+
   pthread_mutex_lock(&db->db_lock);
 
   if (0 != c_psql_check_connection(db)) {
@@ -833,6 +1134,8 @@ static int c_psql_write(const data_set_t *ds, const value_list_t *vl,
     PGresult *res;
 
     writer = db->writers[i];
+    if (writer->copy_statement != NULL)
+      continue;
 
     if (values_type_to_sqlarray(ds, values_type_str, sizeof(values_type_str),
                                 writer->store_rates) == NULL) {
@@ -917,15 +1220,56 @@ static int c_psql_flush(cdtime_t timeout,
   for (size_t i = 0; i < dbs_num; ++i) {
     c_psql_database_t *db = dbs[i];
 
+    /* hand pending COPY rows which are older than the timeout to the copy
+     * thread */
+    if (db->copy_writers_num > 0) {
+      cdtime_t now = cdtime();
+
+      pthread_mutex_lock(&db->copy_lock);
+      for (size_t j = 0; j < db->writers_num; ++j) {
+        c_psql_copy_t *copy = db->copies + j;
+
+        if ((copy->rows_num > 0) &&
+            ((timeout == 0) || (copy->since + timeout <= now)))
+          copy->flush = 1;
+      }
+      pthread_cond_signal(&db->copy_cond);
+      pthread_mutex_unlock(&db->copy_lock);
+    }
+
     /* don't commit if the timeout is larger than the regular commit
      * interval as in that case all requested data has already been
      * committed */
-    if ((db->next_commit > 0) && (db->commit_interval > timeout))
-      c_psql_commit(db);
+    if ((db->next_commit > 0) && (db->commit_interval > timeout)) {
+      pthread_mutex_lock(&db->db_lock);
+      if (db->next_commit > 0)
+        c_psql_commit(db);
+      pthread_mutex_unlock(&db->db_lock);
+    }
   }
   return 0;
 } /* c_psql_flush */
 
+static int c_psql_init(void) {
+  for (size_t i = 0; i < databases_num; ++i) {
+    c_psql_database_t *db = databases[i];
+    int status;
+
+    if ((db->copy_writers_num == 0) || db->copy_thread_running)
+      continue;
+
+    status = plugin_thread_create(&db->copy_thread, /* attr = */ NULL,
+                                  c_psql_copy_thread, db, "postgresql copy");
+    if (status != 0) {
+      log_err("Database '%s': Starting the copy thread failed.",
+              db->database);
+      return -1;
+    }
+    db->copy_thread_running = 1;
+  }
+  return 0;
+} /* c_psql_init */
+
 static int c_psql_shutdown(void) {
   _Bool had_flush = 0;
 
@@ -1089,6 +1433,9 @@ static int c_psql_config_writer(oconfig_item_t *ci) {
   writer->name = sstrdup(ci->values[0].value.string);
   writer->statement = NULL;
   writer->store_rates = 1;
+  writer->copy_statement = NULL;
+  writer->batch_size = 1000;
+  writer->batch_flush_timeout = TIME_T_TO_CDTIME_T(1);
 
   for (int i = 0; i < ci->children_num; ++i) {
     oconfig_item_t *c = ci->children + i;
@@ -1097,11 +1444,34 @@ static int c_psql_config_writer(oconfig_item_t *ci) {
       status = cf_util_get_string(c, &writer->statement);
     else if (strcasecmp("StoreRates", c->key) == 0)
       status = cf_util_get_boolean(c, &writer->store_rates);
+    else if (strcasecmp("CopyStatement", c->key) == 0)
+      status = cf_util_get_string(c, &writer->copy_statement);
+    else if (strcasecmp("BatchSize", c->key) == 0)
+      status = cf_util_get_int(c, &writer->batch_size);
+    else if (strcasecmp("BatchFlushTimeout", c->key) == 0)
+      status = cf_util_get_cdtime(c, &writer->batch_flush_timeout);
     else
       log_warn("Ignoring unknown config key \"%s\".", c->key);
   }
 
+  if ((status == 0) &&
+      ((writer->statement == NULL) == (writer->copy_statement == NULL))) {
+    log_err("Writer \"%s\": Exactly one of `Statement' and "
+            "`CopyStatement' is required.",
+            writer->name);
+    status = -1;
+  }
+
+  if ((status == 0) && (writer->copy_statement != NULL) &&
+      ((writer->batch_size < 1) || (writer->batch_flush_timeout == 0))) {
+    log_err("Writer \"%s\": `BatchSize' and `BatchFlushTimeout' must be "
+            "positive.",
+            writer->name);
+    status = -1;
+  }
+
   if (status != 0) {
+    sfree(writer->copy_statement);
     sfree(writer->statement);
     sfree(writer->name);
     return status;
@@ -1194,6 +1564,19 @@ static int c_psql_config_database(oconfig_item_t *ci) {
     }
   }
 
+  if (db->writers_num > 0) {
+    db->copies = calloc(db->writers_num, sizeof(*db->copies));
+    if (db->copies == NULL) {
+      log_err("Out of memory.");
+      c_psql_database_delete(db);
+      return -1;
+    }
+
+    for (size_t i = 0; i < db->writers_num; ++i)
+      if (db->writers[i]->copy_statement != NULL)
+        db->copy_writers_num++;
+  }
+
   ssnprintf(cb_name, sizeof(cb_name), "postgresql-%s", db->instance);
 
   user_data_t ud = {.data = db, .free_func = c_psql_database_delete};
@@ -1262,5 +1645,6 @@ static int c_psql_config(oconfig_item_t *ci) {
 
 void module_register(void) {
   plugin_register_complex_config("postgresql", c_psql_config);
+  plugin_register_init("postgresql", c_psql_init);
   plugin_register_shutdown("postgresql", c_psql_shutdown);
 } /* module_register */
@@ -35,10 +35,22 @@
 
 #include "cpython.h"
 
+typedef struct cpy_write_batch_s {
+  pthread_mutex_t lock;
+  int refs;
+  size_t size;
+  cdtime_t timeout;
+  value_list_t *vls;
+  const data_set_t **ds;
+  size_t num;
+  cdtime_t first;
+} cpy_write_batch_t;
+
 typedef struct cpy_callback_s {
   char *name;
   PyObject *callback;
   PyObject *data;
+  cpy_write_batch_t *batch; /* Batched write callbacks only. */
   struct cpy_callback_s *next;
 } cpy_callback_t;
 
@@ -58,6 +70,15 @@ static char get_ds_doc[] =
     "        DS_TYPE_GAUGE, DS_TYPE_DERIVE or DS_TYPE_ABSOLUTE.\n"
     "    'min' and 'max' are either a float or None.";
 
+static char dispatch_many_doc[] =
+    "dispatch_many(values) -> None\n"
+    "\n"
+    "Dispatch a sequence of Values objects. This is equivalent to calling\n"
+    "dispatch() on every element, but converts all of them first and then\n"
+    "releases the GIL only once while handing them to the daemon.\n"
+    "'values' is a list or tuple of Values objects. If one of them cannot be\n"
+    "    converted, an exception is raised and nothing is dispatched.";
+
 static char flush_doc[] = "flush([plugin][, timeout][, identifier]) -> None\n"
                           "\n"
                           "Flushes the cache of another plugin.";
@@ -152,7 +173,8 @@ static char reg_read_doc[] =
     "data if it was supplied.";
 
 static char reg_write_doc[] =
-    "register_write(callback[, data][, name]) -> identifier\n"
+    "register_write(callback[, data][, name][, batch_size][, batch_timeout])"
+    " -> identifier\n"
     "\n"
     "Register a callback function to receive values dispatched by other "
     "plugins.\n"
@@ -167,8 +189,16 @@ static char reg_write_doc[] =
     "    to specify a name here.\n"
     "'identifier' is the full identifier assigned to this callback.\n"
     "\n"
+    "'batch_size' is an optional number of value lists to collect before\n"
+    "    calling the callback. If it is given, the callback receives a list\n"
+    "    of Values objects instead of a single one.\n"
+    "'batch_timeout' is the maximum age in seconds of a collected value list\n"
+    "    before the batch is passed on, even if it is not full. Defaults to\n"
+    "    the interval.\n"
+    "\n"
     "The callback function will be called with one or two parameters:\n"
-    "values: A Values object which is a copy of the dispatched values.\n"
+    "values: A Values object which is a copy of the dispatched values, or a\n"
+    "    list of such objects if 'batch_size' was given.\n"
     "data: The optional data parameter passed to the register function.\n"
     "    If the parameter was omitted it will be omitted here, too.";
 
@@ -384,18 +414,30 @@ static int cpy_read_callback(user_data_t *data) {
   return 0;
 }
 
-static int cpy_write_callback(const data_set_t *ds,
-                              const value_list_t *value_list,
-                              user_data_t *data) {
-  cpy_callback_t *c = data->data;
-  PyObject *ret, *list, *temp, *dict = NULL;
+/* Wrap an integer in one of the Signed and Unsigned types. Steals the
+ * reference to `value'. */
+static PyObject *cpy_long_subtype(PyTypeObject *type, PyObject *value) {
+  PyObject *ret;
+
+  if (value == NULL)
+    return NULL;
+  ret = PyObject_CallFunctionObjArgs((PyObject *)type, value,
+                                     (void *)0); /* New reference. */
+  Py_DECREF(value);
+  return ret;
+}
+
+/* Convert a value list to a new Values object. You must hold the GIL to call
+ * this function. Returns a new reference or NULL on error. */
+static PyObject *cpy_build_values(const data_set_t *ds,
+                                  const value_list_t *value_list) {
+  PyObject *list, *temp, *dict = NULL;
   Values *v;
 
-  CPY_LOCK_THREADS
   list = PyList_New(value_list->values_len); /* New reference. */
   if (list == NULL) {
     cpy_log_exception("write callback");
-    CPY_RETURN_FROM_THREADS 0;
+    return NULL;
   }
   for (size_t i = 0; i < value_list->values_len; ++i) {
     if (ds->ds[i].type == DS_TYPE_COUNTER) {
@@ -413,12 +455,12 @@ static int cpy_write_callback(const data_set_t *ds,
       Py_BEGIN_ALLOW_THREADS ERROR("cpy_write_callback: Unknown value type %d.",
                                    ds->ds[i].type);
       Py_END_ALLOW_THREADS Py_DECREF(list);
-      CPY_RETURN_FROM_THREADS 0;
+      return NULL;
     }
     if (PyErr_Occurred() != NULL) {
       cpy_log_exception("value building for write callback");
       Py_DECREF(list);
-      CPY_RETURN_FROM_THREADS 0;
+      return NULL;
     }
   }
   dict = PyDict_New(); /* New reference. */
@@ -446,17 +488,13 @@ static int cpy_write_callback(const data_set_t *ds,
       } else if (type == MD_TYPE_SIGNED_INT) {
         if (meta_data_get_signed_int(meta, table[i], &si))
           continue;
-        temp = PyObject_CallFunctionObjArgs((void *)&SignedType,
-                                            PyLong_FromLongLong(si),
-                                            (void *)0); /* New reference. */
+        temp = cpy_long_subtype(&SignedType, PyLong_FromLongLong(si));
         PyDict_SetItemString(dict, table[i], temp);
         Py_XDECREF(temp);
       } else if (type == MD_TYPE_UNSIGNED_INT) {
         if (meta_data_get_unsigned_int(meta, table[i], &ui))
           continue;
-        temp = PyObject_CallFunctionObjArgs((void *)&UnsignedType,
-                                            PyLong_FromUnsignedLongLong(ui),
-                                            (void *)0); /* New reference. */
+        temp = cpy_long_subtype(&UnsignedType, PyLong_FromUnsignedLongLong(ui));
         PyDict_SetItemString(dict, table[i], temp);
         Py_XDECREF(temp);
       } else if (type == MD_TYPE_DOUBLE) {
@@ -477,7 +515,16 @@ static int cpy_write_callback(const data_set_t *ds,
     }
     free(table);
   }
-  v = (Values *)Values_New(); /* New reference. */
+  /* Allocate the object directly: going through the type's constructor
+   * would parse an empty argument tuple and create a list and a dict only to
+   * throw them away again. */
+  v = (Values *)ValuesType.tp_alloc(&ValuesType, 0); /* New reference. */
+  if (v == NULL) {
+    cpy_log_exception("write callback");
+    Py_DECREF(list);
+    Py_XDECREF(dict);
+    return NULL;
+  }
   sstrncpy(v->data.host, value_list->host, sizeof(v->data.host));
   sstrncpy(v->data.type, value_list->type, sizeof(v->data.type));
   sstrncpy(v->data.type_instance, value_list->type_instance,
@@ -487,13 +534,25 @@ static int cpy_write_callback(const data_set_t *ds,
            sizeof(v->data.plugin_instance));
   v->data.time = CDTIME_T_TO_DOUBLE(value_list->time);
   v->interval = CDTIME_T_TO_DOUBLE(value_list->interval);
-  Py_CLEAR(v->values);
-  v->values = list;
-  Py_CLEAR(v->meta);
-  v->meta = dict; /* Steals a reference. */
+  v->values = list; /* Steals a reference. */
+  v->meta = dict;   /* Steals a reference. */
+  return (PyObject *)v;
+}
+
+static int cpy_write_callback(const data_set_t *ds,
+                              const value_list_t *value_list,
+                              user_data_t *data) {
+  cpy_callback_t *c = data->data;
+  PyObject *ret, *v;
+
+  CPY_LOCK_THREADS
+  v = cpy_build_values(ds, value_list); /* New reference. */
+  if (v == NULL) {
+    CPY_RETURN_FROM_THREADS 0;
+  }
   ret = PyObject_CallFunctionObjArgs(c->callback, v, c->data,
                                      (void *)0); /* New reference. */
-  Py_XDECREF(v);
+  Py_DECREF(v);
   if (ret == NULL) {
     cpy_log_exception("write callback");
   } else {
@@ -503,6 +562,148 @@ static int cpy_write_callback(const data_set_t *ds,
   return 0;
 }
 
+/* Hand the value lists in `vls' to a batched write callback as one list of
+ * Values objects and free them. Acquires the GIL. */
+static void cpy_write_batch_send(cpy_callback_t *c, const data_set_t **ds,
+                                 value_list_t *vls, size_t num) {
+  PyObject *ret, *list, *v;
+
+  CPY_LOCK_THREADS
+  list = PyList_New(0); /* New reference. */
+  if (list == NULL) {
+    cpy_log_exception("write callback");
+  } else {
+    for (size_t i = 0; i < num; ++i) {
+      v = cpy_build_values(ds[i], vls + i); /* New reference. */
+      if (v == NULL)
+        continue;
+      PyList_Append(list, v);
+      Py_DECREF(v);
+    }
+    ret = PyObject_CallFunctionObjArgs(c->callback, list, c->data,
+                                       (void *)0); /* New reference. */
+    Py_DECREF(list);
+    if (ret == NULL) {
+      cpy_log_exception("write callback");
+    } else {
+      Py_DECREF(ret);
+    }
+  }
+  CPY_RELEASE_THREADS
+
+  for (size_t i = 0; i < num; ++i) {
+    meta_data_destroy(vls[i].meta);
+    free(vls[i].values);
+  }
+  free(vls);
+  free(ds);
+}
+
+/* Take the queued value lists out of `b'. The caller must hold `b->lock'. */
+static size_t cpy_write_batch_take(cpy_write_batch_t *b,
+                                   const data_set_t ***ds,
+                                   value_list_t **vls) {
+  size_t num = b->num;
+
+  *ds = b->ds;
+  *vls = b->vls;
+  b->ds = NULL;
+  b->vls = NULL;
+  b->num = 0;
+  return num;
+}
+
+/* Queue a copy of the value list without touching the GIL. Python is only
+ * called once the batch is full or its oldest value list is too old. */
+static int cpy_write_batch_callback(const data_set_t *ds,
+                                    const value_list_t *value_list,
+                                    user_data_t *data) {
+  cpy_callback_t *c = data->data;
+  cpy_write_batch_t *b = c->batch;
+  const data_set_t **send_ds = NULL;
+  value_list_t *send_vls = NULL;
+  value_list_t *copy;
+  size_t send_num = 0;
+
+  pthread_mutex_lock(&b->lock);
+  if (b->vls == NULL) {
+    b->vls = calloc(b->size, sizeof(*b->vls));
+    b->ds = calloc(b->size, sizeof(*b->ds));
+    if ((b->vls == NULL) || (b->ds == NULL)) {
+      sfree(b->vls);
+      sfree(b->ds);
+      pthread_mutex_unlock(&b->lock);
+      ERROR("python plugin: cpy_write_batch_callback: calloc failed.");
+      return -1;
+    }
+  }
+
+  copy = b->vls + b->num;
+  memcpy(copy, value_list, sizeof(*copy));
+  copy->values = malloc(value_list->values_len * sizeof(*copy->values));
+  if (copy->values == NULL) {
+    pthread_mutex_unlock(&b->lock);
+    ERROR("python plugin: cpy_write_batch_callback: malloc failed.");
+    return -1;
+  }
+  memcpy(copy->values, value_list->values,
+         value_list->values_len * sizeof(*copy->values));
+  copy->meta = meta_data_clone(value_list->meta);
+  b->ds[b->num] = ds;
+
+  if (b->num == 0)
+    b->first = cdtime();
+  b->num++;
+
+  if ((b->num >= b->size) || ((cdtime() - b->first) >= b->timeout))
+    send_num = cpy_write_batch_take(b, &send_ds, &send_vls);
+  pthread_mutex_unlock(&b->lock);
+
+  if (send_num > 0)
+    cpy_write_batch_send(c, send_ds, send_vls, send_num);
+  return 0;
+}
+
+static int cpy_write_batch_flush(cdtime_t timeout, const char *identifier,
+                                 user_data_t *data) {
+  cpy_callback_t *c = data->data;
+  cpy_write_batch_t *b = c->batch;
+  const data_set_t **send_ds = NULL;
+  value_list_t *send_vls = NULL;
+  size_t send_num = 0;
+
+  pthread_mutex_lock(&b->lock);
+  if ((b->num > 0) && ((timeout == 0) || ((cdtime() - b->first) >= timeout)))
+    send_num = cpy_write_batch_take(b, &send_ds, &send_vls);
+  pthread_mutex_unlock(&b->lock);
+
+  if (send_num > 0)
+    cpy_write_batch_send(c, send_ds, send_vls, send_num);
+  return 0;
+}
+
+/* The write and the flush callback of a batched writer share one
+ * cpy_callback_t. It is freed when the second of the two is unregistered;
+ * queued value lists are delivered when the first one goes away. */
+static void cpy_write_batch_destroy(void *data) {
+  cpy_callback_t *c = data;
+  cpy_write_batch_t *b = c->batch;
+  _Bool last;
+
+  cpy_write_batch_flush(0, NULL, &(user_data_t){.data = c});
+
+  pthread_mutex_lock(&b->lock);
+  last = (--b->refs == 0);
+  pthread_mutex_unlock(&b->lock);
+  if (!last)
+    return;
+
+  pthread_mutex_destroy(&b->lock);
+  free(b);
+  c->batch = NULL;
+  cpy_destroy_user_data(c);
+}
+
 static int cpy_notification_callback(const notification_t *notification,
                                      user_data_t *data) {
   cpy_callback_t *c = data->data;
@@ -660,6 +861,62 @@ static PyObject *cpy_get_dataset(PyObject *self, PyObject *args) {
   return list;
 }
 
+static PyObject *cpy_dispatch_many(PyObject *self, PyObject *args) {
+  PyObject *seq, *values;
+  value_list_t *vls;
+  Py_ssize_t num;
+  int errors = 0;
+
+  if (PyArg_ParseTuple(args, "O", &values) == 0)
+    return NULL;
+  seq = PySequence_Fast(values, "values must be a sequence"); /* New reference. */
+  if (seq == NULL)
+    return NULL;
+  num = PySequence_Fast_GET_SIZE(seq);
+  if (num == 0) {
+    Py_DECREF(seq);
+    Py_RETURN_NONE;
+  }
+
+  vls = calloc((size_t)num, sizeof(*vls));
+  if (vls == NULL) {
+    Py_DECREF(seq);
+    return PyErr_NoMemory();
+  }
+  for (Py_ssize_t i = 0; i < num; ++i) {
+    vls[i] = (value_list_t)VALUE_LIST_INIT;
+    if (cpy_values_to_value_list(PySequence_Fast_GET_ITEM(seq, i),
+                                 vls + i) != 0) {
+      for (Py_ssize_t j = 0; j < i; ++j) {
+        meta_data_destroy(vls[j].meta);
+        free(vls[j].values);
+      }
+      free(vls);
+      Py_DECREF(seq);
+      return NULL;
+    }
+  }
+  Py_DECREF(seq);
+
+  Py_BEGIN_ALLOW_THREADS;
+  for (Py_ssize_t i = 0; i < num; ++i) {
+    if (plugin_dispatch_values(vls + i) != 0)
+      errors++;
+    meta_data_destroy(vls[i].meta);
+    free(vls[i].values);
+  }
+  Py_END_ALLOW_THREADS;
+  free(vls);
+
+  if (errors > 0) {
+    PyErr_Format(PyExc_RuntimeError,
+                 "error dispatching %d of %zd value lists, read the logs",
+                 errors, num);
+    return NULL;
+  }
+  Py_RETURN_NONE;
+}
+
 static PyObject *cpy_flush(PyObject *self, PyObject *args, PyObject *kwds) {
   int timeout = -1;
   char *plugin = NULL, *identifier = NULL;
@@ -777,8 +1034,83 @@ static PyObject *cpy_register_log(PyObject *self, PyObject *args,
 
 static PyObject *cpy_register_write(PyObject *self, PyObject *args,
                                     PyObject *kwds) {
-  return cpy_register_generic_userdata((void *)plugin_register_write,
-                                       (void *)cpy_write_callback, args, kwds);
+  char buf[512];
+  char flush_name[sizeof(buf) + 6];
+  cpy_callback_t *c = NULL;
+  int batch_size = 0;
+  double batch_timeout = 0;
+  char *name = NULL;
+  PyObject *callback = NULL, *data = NULL;
+  static char *kwlist[] = {"callback",   "data", "name", "batch_size",
+                           "batch_timeout", NULL};
+
+  if (PyArg_ParseTupleAndKeywords(args, kwds, "O|Oetid", kwlist, &callback,
+                                  &data, NULL, &name, &batch_size,
+                                  &batch_timeout) == 0)
+    return NULL;
+  if (PyCallable_Check(callback) == 0) {
+    PyMem_Free(name);
+    PyErr_SetString(PyExc_TypeError, "callback needs a be a callable object.");
+    return NULL;
+  }
+  cpy_build_name(buf, sizeof(buf), callback, name);
+  PyMem_Free(name);
+
+  c = calloc(1, sizeof(*c));
+  if (c == NULL)
+    return PyErr_NoMemory();
+
+  if (batch_size <= 0) {
+    Py_INCREF(callback);
+    Py_XINCREF(data);
+
+    c->name = strdup(buf);
+    c->callback = callback;
+    c->data = data;
+    c->next = NULL;
+
+    plugin_register_write(buf, cpy_write_callback,
+                          &(user_data_t){
+                              .data = c, .free_func = cpy_destroy_user_data,
+                          });
+
+    ++cpy_num_callbacks;
+    return cpy_string_to_unicode_or_bytes(buf);
+  }
+
+  c->batch = calloc(1, sizeof(*c->batch));
+  if (c->batch == NULL) {
+    free(c);
+    return PyErr_NoMemory();
+  }
+  pthread_mutex_init(&c->batch->lock, NULL);
+  c->batch->refs = 2;
+  c->batch->size = (size_t)batch_size;
+  c->batch->timeout = (batch_timeout > 0) ? DOUBLE_TO_CDTIME_T(batch_timeout)
+                                          : plugin_get_interval();
+
+  Py_INCREF(callback);
+  Py_XINCREF(data);
+
+  c->name = strdup(buf);
+  c->callback = callback;
+  c->data = data;
+  c->next = NULL;
+
+  /* The flush callback gets its own name, so it does not replace a flush
+   * callback registered by the module itself. */
+  snprintf(flush_name, sizeof(flush_name), "%s.batch", buf);
+  plugin_register_flush(flush_name, cpy_write_batch_flush,
+                        &(user_data_t){
+                            .data = c, .free_func = cpy_write_batch_destroy,
+                        });
+  plugin_register_write(buf, cpy_write_batch_callback,
+                        &(user_data_t){
+                            .data = c, .free_func = cpy_write_batch_destroy,
+                        });
+
+  ++cpy_num_callbacks;
+  return cpy_string_to_unicode_or_bytes(buf);
 }
 
 static PyObject *cpy_register_notification(PyObject *self, PyObject *args,
@@ -970,6 +1302,7 @@ static PyMethodDef cpy_methods[] = {
     {"error", cpy_error, METH_VARARGS, log_doc},
     {"get_dataset", (PyCFunction)cpy_get_dataset, METH_VARARGS, get_ds_doc},
     {"flush", (PyCFunction)cpy_flush, METH_VARARGS | METH_KEYWORDS, flush_doc},
+    {"dispatch_many", cpy_dispatch_many, METH_VARARGS, dispatch_many_doc},
     {"register_log", (PyCFunction)cpy_register_log,
      METH_VARARGS | METH_KEYWORDS, reg_log_doc},
     {"register_init", (PyCFunction)cpy_register_init,
@@ -55,13 +55,37 @@ struct rrd_queue_s {
 };
 typedef struct rrd_queue_s rrd_queue_t;
 
+/* Each writer thread owns the files whose names hash to its index, so that
+ * updates of one file are never executed concurrently. All members are
+ * protected by `queue_lock'. */
+struct rrd_writer_s {
+  pthread_t thread;
+  int thread_running;
+  pthread_cond_t cond;
+
+  rrd_queue_t *queue_head;
+  rrd_queue_t *queue_tail;
+  rrd_queue_t *flushq_head;
+  rrd_queue_t *flushq_tail;
+
+  /* Regular queue entries taken out of the queue and sorted by file name. */
+  rrd_queue_t **batch;
+  size_t batch_num;
+  size_t batch_pos;
+
+  size_t queue_length;
+  size_t flushq_length;
+};
+typedef struct rrd_writer_s rrd_writer_t;
+
 /*
  * Private variables
  */
 static const char *config_keys[] = {
     "CacheTimeout", "CacheFlush",      "CreateFilesAsync", "DataDir",
     "StepSize",     "HeartBeat",       "RRARows",          "RRATimespan",
-    "XFF",          "WritesPerSecond", "RandomTimeout"};
+    "XFF",          "WritesPerSecond", "RandomTimeout",    "WriteThreads",
+    "CollectStatistics"};
 static int config_keys_num = STATIC_ARRAY_SIZE(config_keys);
 
 /* If datadir is zero, the daemon's basedir is used. If stepsize or heartbeat
@@ -92,14 +116,17 @@ static cdtime_t cache_flush_last;
 static c_avl_tree_t *cache = NULL;
 static pthread_mutex_t cache_lock = PTHREAD_MUTEX_INITIALIZER;
 
-static rrd_queue_t *queue_head = NULL;
-static rrd_queue_t *queue_tail = NULL;
-static rrd_queue_t *flushq_head = NULL;
-static rrd_queue_t *flushq_tail = NULL;
-static pthread_t queue_thread;
-static int queue_thread_running = 1;
+static rrd_writer_t *writers = NULL;
+static size_t writers_num = 1;
 static pthread_mutex_t queue_lock = PTHREAD_MUTEX_INITIALIZER;
-static pthread_cond_t queue_cond = PTHREAD_COND_INITIALIZER;
+
+static _Bool collect_stats = 0;
+static pthread_mutex_t stats_lock = PTHREAD_MUTEX_INITIALIZER;
+static derive_t stats_updates = 0;
+static derive_t stats_values = 0;
+static cdtime_t stats_latency_sum = 0;
+static cdtime_t stats_latency_max = 0;
+static uint64_t stats_latency_num = 0;
 
 #if !HAVE_THREADSAFE_LIBRRD
 static pthread_mutex_t librrd_lock = PTHREAD_MUTEX_INITIALIZER;
@@ -283,9 +310,81 @@ static int value_list_to_filename(char *buffer, size_t buffer_size,
   return 0;
 } /* int value_list_to_filename */
 
-static void *rrd_queue_thread(void __attribute__((unused)) * data) {
+static rrd_writer_t *rrd_writer_get(const char *filename) {
+  uint32_t hash = 5381;
+
+  if (writers_num < 2)
+    return writers;
+
+  for (const char *ptr = filename; *ptr != 0; ptr++)
+    hash = ((hash << 5) + hash) + (uint32_t)(unsigned char)*ptr;
+
+  return writers + (hash % writers_num);
+} /* rrd_writer_t *rrd_writer_get */
+
+static int rrd_queue_compare(const void *a, const void *b) {
+  rrd_queue_t const *qa = *((rrd_queue_t *const *)a);
+  rrd_queue_t const *qb = *((rrd_queue_t *const *)b);
+
+  return strcmp(qa->filename, qb->filename);
+} /* int rrd_queue_compare */
+
+/* Move all entries of the regular queue to the writer's batch and sort them
+ * by file name. Files are thereby written in directory order rather than in
+ * the order in which their cache entries happened to expire, which turns much
+ * of the random I/O into sequential I/O.
+ * XXX: You must hold "queue_lock" when calling this function! */
+static int rrd_writer_fill_batch(rrd_writer_t *w) {
+  size_t num = 0;
+  rrd_queue_t **tmp;
+
+  for (rrd_queue_t *q = w->queue_head; q != NULL; q = q->next)
+    num++;
+
+  tmp = realloc(w->batch, num * sizeof(*w->batch));
+  if (tmp == NULL) {
+    ERROR("rrdtool plugin: realloc failed.");
+    return -1;
+  }
+  w->batch = tmp;
+
+  num = 0;
+  while (w->queue_head != NULL) {
+    w->batch[num] = w->queue_head;
+    w->queue_head = w->queue_head->next;
+    w->batch[num]->next = NULL;
+    num++;
+  }
+  w->queue_tail = NULL;
+
+  qsort(w->batch, num, sizeof(*w->batch), rrd_queue_compare);
+  w->batch_num = num;
+  w->batch_pos = 0;
+
+  return 0;
+} /* int rrd_writer_fill_batch */
+
+static void rrd_stats_update(int values_num, cdtime_t latency) {
+  if (!collect_stats)
+    return;
+
+  pthread_mutex_lock(&stats_lock);
+  stats_updates++;
+  stats_values += (derive_t)values_num;
+  stats_latency_sum += latency;
+  stats_latency_num++;
+  if (stats_latency_max < latency)
+    stats_latency_max = latency;
+  pthread_mutex_unlock(&stats_lock);
+} /* void rrd_stats_update */
+
+static void *rrd_queue_thread(void *data) {
+  rrd_writer_t *w = data;
   struct timeval tv_next_update;
   struct timeval tv_now;
+  /* With several writer threads, each of them has to honor its share of the
+   * configured "WritesPerSecond". */
+  double thread_write_rate = write_rate * (double)writers_num;
 
   gettimeofday(&tv_next_update, /* timezone = */ NULL);
 
@@ -295,6 +394,7 @@ static void *rrd_queue_thread(void __attribute__((unused)) * data) {
     char **values;
     int values_num;
     int status;
+    cdtime_t update_start;
 
     values = NULL;
     values_num = 0;
@@ -304,15 +404,16 @@ static void *rrd_queue_thread(void __attribute__((unused)) * data) {
     while (42) {
       struct timespec ts_wait;
 
-      while ((flushq_head == NULL) && (queue_head == NULL) &&
-             (do_shutdown == 0))
-        pthread_cond_wait(&queue_cond, &queue_lock);
+      while ((w->flushq_head == NULL) && (w->queue_head == NULL) &&
+             (w->batch_pos >= w->batch_num) && (do_shutdown == 0))
+        pthread_cond_wait(&w->cond, &queue_lock);
 
-      if ((flushq_head == NULL) && (queue_head == NULL))
+      if ((w->flushq_head == NULL) && (w->queue_head == NULL) &&
+          (w->batch_pos >= w->batch_num))
         break;
 
       /* Don't delay if there's something to flush */
-      if (flushq_head != NULL)
+      if (w->flushq_head != NULL)
         break;
 
       /* Don't delay if we're shutting down */
@@ -320,7 +421,7 @@ static void *rrd_queue_thread(void __attribute__((unused)) * data) {
         break;
 
       /* Don't delay if no delay was configured. */
-      if (write_rate <= 0.0)
+      if (thread_write_rate <= 0.0)
         break;
 
       gettimeofday(&tv_now, /* timezone = */ NULL);
@@ -335,7 +436,7 @@ static void *rrd_queue_thread(void __attribute__((unused)) * data) {
       ts_wait.tv_sec = tv_next_update.tv_sec;
       ts_wait.tv_nsec = 1000 * tv_next_update.tv_usec;
 
-      status = pthread_cond_timedwait(&queue_cond, &queue_lock, &ts_wait);
+      status = pthread_cond_timedwait(&w->cond, &queue_lock, &ts_wait);
       if (status == ETIMEDOUT)
         break;
     } /* while (42) */
@@ -344,26 +445,36 @@ static void *rrd_queue_thread(void __attribute__((unused)) * data) {
      * the same time, ALWAYS lock `cache_lock' first! */
 
     /* We're in the shutdown phase */
-    if ((flushq_head == NULL) && (queue_head == NULL)) {
+    if ((w->flushq_head == NULL) && (w->queue_head == NULL) &&
+        (w->batch_pos >= w->batch_num)) {
       pthread_mutex_unlock(&queue_lock);
       break;
     }
 
-    if (flushq_head != NULL) {
+    if (w->flushq_head != NULL) {
       /* Dequeue the first flush entry */
-      queue_entry = flushq_head;
-      if (flushq_head == flushq_tail)
-        flushq_head = flushq_tail = NULL;
-      else
-        flushq_head = flushq_head->next;
-    } else /* if (queue_head != NULL) */
-    {
-      /* Dequeue the first regular entry */
-      queue_entry = queue_head;
-      if (queue_head == queue_tail)
-        queue_head = queue_tail = NULL;
+      queue_entry = w->flushq_head;
+      if (w->flushq_head == w->flushq_tail)
+        w->flushq_head = w->flushq_tail = NULL;
       else
-        queue_head = queue_head->next;
+        w->flushq_head = w->flushq_head->next;
+      w->flushq_length--;
+    } else {
+      /* Take the next regular entry, in file name order */
+      if ((w->batch_pos >= w->batch_num) &&
+          (rrd_writer_fill_batch(w) != 0)) {
+        /* Out of memory: fall back to queue order. */
+        queue_entry = w->queue_head;
+        if (w->queue_head == w->queue_tail)
+          w->queue_head = w->queue_tail = NULL;
+        else
+          w->queue_head = w->queue_head->next;
+      } else {
+        queue_entry = w->batch[w->batch_pos];
+        w->batch[w->batch_pos] = NULL;
+        w->batch_pos++;
+      }
+      w->queue_length--;
     }
 
     /* Unlock the queue again */
@@ -386,26 +497,32 @@ static void *rrd_queue_thread(void __attribute__((unused)) * data) {
 
     pthread_mutex_unlock(&cache_lock);
 
-    if (status != 0) {
+    /* The values may already have been written, e.g. when the entry was
+     * moved to the flush queue while being part of a batch. */
+    if ((status != 0) || (values_num == 0)) {
+      sfree(values);
       sfree(queue_entry->filename);
       sfree(queue_entry);
       continue;
     }
 
     /* Update `tv_next_update' */
-    if (write_rate > 0.0) {
+    if (thread_write_rate > 0.0) {
       gettimeofday(&tv_now, /* timezone = */ NULL);
       tv_next_update.tv_sec = tv_now.tv_sec;
       tv_next_update.tv_usec =
-          tv_now.tv_usec + ((suseconds_t)(1000000 * write_rate));
+          tv_now.tv_usec + ((suseconds_t)(1000000 * thread_write_rate));
       while (tv_next_update.tv_usec > 1000000) {
         tv_next_update.tv_sec++;
         tv_next_update.tv_usec -= 1000000;
       }
     }
 
-    /* Write the values to the RRD-file */
+    /* Write the values to the RRD-file. All values queued for this file
+     * are passed to librrd in a single update. */
+    update_start = cdtime();
     srrd_update(queue_entry->filename, NULL, values_num, (const char **)values);
+    rrd_stats_update(values_num, cdtime() - update_start);
     DEBUG("rrdtool plugin: queue thread: Wrote %i value%s to %s", values_num,
           (values_num == 1) ? "" : "s", queue_entry->filename);
 
@@ -417,13 +534,17 @@ static void *rrd_queue_thread(void __attribute__((unused)) * data) {
     sfree(queue_entry);
   } /* while (42) */
 
+  sfree(w->batch);
+  w->batch_num = 0;
+  w->batch_pos = 0;
+
   pthread_exit((void *)0);
   return (void *)0;
 } /* void *rrd_queue_thread */
 
-static int rrd_queue_enqueue(const char *filename, rrd_queue_t **head,
-                             rrd_queue_t **tail) {
+static int rrd_queue_enqueue(const char *filename, _Bool flush) {
   rrd_queue_t *queue_entry;
+  rrd_writer_t *w;
 
   queue_entry = malloc(sizeof(*queue_entry));
   if (queue_entry == NULL)
@@ -439,27 +560,41 @@ static int rrd_queue_enqueue(const char *filename, rrd_queue_t **head,
 
   pthread_mutex_lock(&queue_lock);
 
-  if (*tail == NULL)
-    *head = queue_entry;
-  else
-    (*tail)->next = queue_entry;
-  *tail = queue_entry;
+  w = rrd_writer_get(filename);
+  if (flush) {
+    if (w->flushq_tail == NULL)
+      w->flushq_head = queue_entry;
+    else
+      w->flushq_tail->next = queue_entry;
+    w->flushq_tail = queue_entry;
+    w->flushq_length++;
+  } else {
+    if (w->queue_tail == NULL)
+      w->queue_head = queue_entry;
+    else
+      w->queue_tail->next = queue_entry;
+    w->queue_tail = queue_entry;
+    w->queue_length++;
+  }
 
-  pthread_cond_signal(&queue_cond);
+  pthread_cond_signal(&w->cond);
   pthread_mutex_unlock(&queue_lock);
 
   return 0;
 } /* int rrd_queue_enqueue */
 
-static int rrd_queue_dequeue(const char *filename, rrd_queue_t **head,
-                             rrd_queue_t **tail) {
+/* Remove `filename' from the regular queue. Entries which have already been
+ * moved to a writer's batch are not found. */
+static int rrd_queue_dequeue(const char *filename) {
   rrd_queue_t *this;
   rrd_queue_t *prev;
+  rrd_writer_t *w;
 
   pthread_mutex_lock(&queue_lock);
 
+  w = rrd_writer_get(filename);
   prev = NULL;
-  this = *head;
+  this = w->queue_head;
 
   while (this != NULL) {
     if (strcmp(this->filename, filename) == 0)
@@ -475,12 +610,13 @@ static int rrd_queue_dequeue(const char *filename, rrd_queue_t **head,
   }
 
   if (prev == NULL)
-    *head = this->next;
+    w->queue_head = this->next;
   else
     prev->next = this->next;
 
   if (this->next == NULL)
-    *tail = prev;
+    w->queue_tail = prev;
+  w->queue_length--;
 
   pthread_mutex_unlock(&queue_lock);
 
@@ -518,7 +654,7 @@ static void rrd_cache_flush(cdtime_t timeout) {
     else if (rc->values_num > 0) {
       int status;
 
-      status = rrd_queue_enqueue(key, &queue_head, &queue_tail);
+      status = rrd_queue_enqueue(key, /* flush = */ 0);
       if (status == 0)
         rc->flags = FLAG_QUEUED;
     } else /* ancient and no values -> waste of memory */
@@ -590,14 +726,14 @@ static int rrd_cache_flush_identifier(cdtime_t timeout,
   if (rc->flags == FLAG_FLUSHQ) {
     status = 0;
   } else if (rc->flags == FLAG_QUEUED) {
-    rrd_queue_dequeue(key, &queue_head, &queue_tail);
-    status = rrd_queue_enqueue(key, &flushq_head, &flushq_tail);
+    rrd_queue_dequeue(key);
+    status = rrd_queue_enqueue(key, /* flush = */ 1);
     if (status == 0)
       rc->flags = FLAG_FLUSHQ;
   } else if ((now - rc->first_value) < timeout) {
     status = 0;
   } else if (rc->values_num > 0) {
-    status = rrd_queue_enqueue(key, &flushq_head, &flushq_tail);
+    status = rrd_queue_enqueue(key, /* flush = */ 1);
     if (status == 0)
       rc->flags = FLAG_FLUSHQ;
   }
@@ -728,7 +864,7 @@ static int rrd_cache_insert(const char *filename, const char *value,
     if (rc->flags == FLAG_NONE) {
       int status;
 
-      status = rrd_queue_enqueue(filename, &queue_head, &queue_tail);
+      status = rrd_queue_enqueue(filename, /* flush = */ 0);
       if (status == 0)
         rc->flags = FLAG_QUEUED;
 
@@ -1005,37 +1141,140 @@ static int rrd_config(const char *key, const char *value) {
     } else {
       random_timeout = DOUBLE_TO_CDTIME_T(tmp);
     }
+  } else if (strcasecmp("WriteThreads", key) == 0) {
+    int tmp = atoi(value);
+    if (tmp < 1) {
+      fprintf(stderr, "rrdtool: `WriteThreads' must "
+                      "be greater than 0.\n");
+      ERROR("rrdtool: `WriteThreads' must "
+            "be greater than 0.");
+      return 1;
+    }
+    writers_num = (size_t)tmp;
+  } else if (strcasecmp("CollectStatistics", key) == 0) {
+    if (IS_TRUE(value))
+      collect_stats = 1;
+    else
+      collect_stats = 0;
   } else {
     return -1;
   }
   return 0;
 } /* int rrd_config */
 
+static int rrd_stats_read(void) {
+  value_list_t vl = VALUE_LIST_INIT;
+  size_t queue_length = 0;
+  size_t flushq_length = 0;
+  derive_t updates;
+  derive_t values;
+  cdtime_t latency_sum;
+  cdtime_t latency_max;
+  uint64_t latency_num;
+
+  pthread_mutex_lock(&queue_lock);
+  for (size_t i = 0; i < writers_num; i++) {
+    queue_length += writers[i].queue_length;
+    flushq_length += writers[i].flushq_length;
+  }
+  pthread_mutex_unlock(&queue_lock);
+
+  pthread_mutex_lock(&stats_lock);
+  updates = stats_updates;
+  values = stats_values;
+  latency_sum = stats_latency_sum;
+  latency_max = stats_latency_max;
+  latency_num = stats_latency_num;
+  stats_latency_sum = 0;
+  stats_latency_max = 0;
+  stats_latency_num = 0;
+  pthread_mutex_unlock(&stats_lock);
+
+  vl.values_len = 1;
+  sstrncpy(vl.plugin, "rrdtool", sizeof(vl.plugin));
+
+  vl.values = &(value_t){.gauge = (gauge_t)queue_length};
+  sstrncpy(vl.type, "queue_length", sizeof(vl.type));
+  sstrncpy(vl.type_instance, "regular", sizeof(vl.type_instance));
+  plugin_dispatch_values(&vl);
+
+  vl.values = &(value_t){.gauge = (gauge_t)flushq_length};
+  sstrncpy(vl.type_instance, "flush", sizeof(vl.type_instance));
+  plugin_dispatch_values(&vl);
+
+  vl.values = &(value_t){.derive = updates};
+  sstrncpy(vl.type, "operations", sizeof(vl.type));
+  sstrncpy(vl.type_instance, "updates", sizeof(vl.type_instance));
+  plugin_dispatch_values(&vl);
+
+  vl.values = &(value_t){.derive = values};
+  sstrncpy(vl.type_instance, "values", sizeof(vl.type_instance));
+  plugin_dispatch_values(&vl);
+
+  /* Latencies are reset on every read, i.e. they describe the updates
+   * performed during the last interval only. */
+  vl.values =
+      &(value_t){.gauge = (latency_num > 0)
+                              ? CDTIME_T_TO_DOUBLE(latency_sum) /
+                                    (gauge_t)latency_num
+                              : NAN};
+  sstrncpy(vl.type, "duration", sizeof(vl.type));
+  sstrncpy(vl.type_instance, "update-average", sizeof(vl.type_instance));
+  plugin_dispatch_values(&vl);
+
+  vl.values = &(value_t){.gauge = (latency_num > 0)
+                                      ? CDTIME_T_TO_DOUBLE(latency_max)
+                                      : NAN};
+  sstrncpy(vl.type_instance, "update-max", sizeof(vl.type_instance));
+  plugin_dispatch_values(&vl);
+
+  return 0;
+} /* int rrd_stats_read */
+
 static int rrd_shutdown(void) {
+  size_t queued = 0;
+  size_t running = 0;
+
   pthread_mutex_lock(&cache_lock);
   rrd_cache_flush(0);
   pthread_mutex_unlock(&cache_lock);
 
   pthread_mutex_lock(&queue_lock);
   do_shutdown = 1;
-  pthread_cond_signal(&queue_cond);
+  for (size_t i = 0; (writers != NULL) && (i < writers_num); i++) {
+    rrd_writer_t *w = writers + i;
+
+    if (!w->thread_running)
+      continue;
+
+    running++;
+    queued += w->queue_length + w->flushq_length;
+    pthread_cond_broadcast(&w->cond);
+  }
   pthread_mutex_unlock(&queue_lock);
 
-  if ((queue_thread_running != 0) &&
-      ((queue_head != NULL) || (flushq_head != NULL))) {
-    INFO("rrdtool plugin: Shutting down the queue thread. "
-         "This may take a while.");
-  } else if (queue_thread_running != 0) {
-    INFO("rrdtool plugin: Shutting down the queue thread.");
+  if ((running != 0) && (queued != 0)) {
+    INFO("rrdtool plugin: Shutting down the queue thread%s. "
+         "This may take a while.",
+         (running == 1) ? "" : "s");
+  } else if (running != 0) {
+    INFO("rrdtool plugin: Shutting down the queue thread%s.",
+         (running == 1) ? "" : "s");
   }
 
   /* Wait for all the values to be written to disk before returning. */
-  if (queue_thread_running != 0) {
-    pthread_join(queue_thread, NULL);
-    memset(&queue_thread, 0, sizeof(queue_thread));
-    queue_thread_running = 0;
-    DEBUG("rrdtool plugin: queue_thread exited.");
+  for (size_t i = 0; (writers != NULL) && (i < writers_num); i++) {
+    rrd_writer_t *w = writers + i;
+
+    if (w->thread_running) {
+      pthread_join(w->thread, NULL);
+      memset(&w->thread, 0, sizeof(w->thread));
+      w->thread_running = 0;
+      DEBUG("rrdtool plugin: queue thread #%zu exited.", i);
+    }
+    pthread_cond_destroy(&w->cond);
   }
+  sfree(writers);
 
   rrd_cache_destroy();
 
@@ -1053,6 +1292,16 @@ static int rrd_init(void) {
   if (rrdcreate_config.heartbeat <= 0)
     rrdcreate_config.heartbeat = 2 * rrdcreate_config.stepsize;
 
+#if !HAVE_THREADSAFE_LIBRRD
+  /* All calls into a non-thread-safe librrd are serialized anyway, so
+   * additional writer threads would only add overhead. */
+  if (writers_num > 1) {
+    WARNING("rrdtool plugin: The \"WriteThreads\" option requires a "
+            "thread-safe librrd. Using a single writer thread.");
+    writers_num = 1;
+  }
+#endif
+
   /* Set the cache up */
   pthread_mutex_lock(&cache_lock);
 
@@ -1071,20 +1320,41 @@ static int rrd_init(void) {
 
   pthread_mutex_unlock(&cache_lock);
 
-  status =
-      plugin_thread_create(&queue_thread, /* attr = */ NULL, rrd_queue_thread,
-                           /* args = */ NULL, "rrdtool queue");
-  if (status != 0) {
-    ERROR("rrdtool plugin: Cannot create queue-thread.");
+  writers = calloc(writers_num, sizeof(*writers));
+  if (writers == NULL) {
+    ERROR("rrdtool plugin: calloc failed.");
     return -1;
   }
-  queue_thread_running = 1;
+
+  for (size_t i = 0; i < writers_num; i++)
+    pthread_cond_init(&writers[i].cond, /* attr = */ NULL);
+
+  for (size_t i = 0; i < writers_num; i++) {
+    rrd_writer_t *w = writers + i;
+    char name[16];
+
+    if (writers_num == 1)
+      sstrncpy(name, "rrdtool queue", sizeof(name));
+    else
+      ssnprintf(name, sizeof(name), "rrdtool#%zu", i);
+
+    status = plugin_thread_create(&w->thread, /* attr = */ NULL,
+                                  rrd_queue_thread, /* args = */ w, name);
+    if (status != 0) {
+      ERROR("rrdtool plugin: Cannot create queue-thread.");
+      return -1;
+    }
+    w->thread_running = 1;
+  }
+
+  if (collect_stats)
+    plugin_register_read("rrdtool", rrd_stats_read);
 
   DEBUG("rrdtool plugin: rrd_init: datadir = %s; stepsize = %lu;"
-        " heartbeat = %i; rrarows = %i; xff = %lf;",
+        " heartbeat = %i; rrarows = %i; xff = %lf; write threads = %zu;",
         (datadir == NULL) ? "(null)" : datadir, rrdcreate_config.stepsize,
         rrdcreate_config.heartbeat, rrdcreate_config.rrarows,
-        rrdcreate_config.xff);
+        rrdcreate_config.xff, writers_num);
 
   return 0;
 } /* int rrd_init */
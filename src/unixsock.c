@@ -30,6 +30,7 @@
 #include "plugin.h"
 
 #include "utils_cmd_flush.h"
+#include "utils_cmd_gethistory.h"
 #include "utils_cmd_getthreshold.h"
 #include "utils_cmd_getval.h"
 #include "utils_cmd_listval.h"
@@ -41,18 +42,106 @@
 
 #include <grp.h>
 
+#if HAVE_SYS_EPOLL_H
+#include <sys/epoll.h>
+#define US_HAVE_EPOLL 1
+#else
+#define US_HAVE_EPOLL 0
+#endif
+
 #ifndef UNIX_PATH_MAX
 #define UNIX_PATH_MAX sizeof(((struct sockaddr_un *)0)->sun_path)
 #endif
 
 #define US_DEFAULT_PATH LOCALSTATEDIR "/run/" PACKAGE_NAME "-unixsock"
 
+/* Maximum length of a command line read by the thread-per-connection
+ * server. */
+#define US_LINE_SIZE 1024
+
+/* Size of a connection's input buffer, i.e. the maximum length of a command
+ * line read by the epoll server. */
+#define US_INPUT_SIZE 16384
+
+/* Commands are not handled while more than this many bytes of replies are
+ * waiting to be sent to the client. */
+#define US_OUTPUT_HIGH_WATER 65536
+
+#define US_EPOLL_EVENTS 64
+#define US_MAX_WORKERS 64
+
+enum {
+  US_CMD_GETVAL = 0,
+  US_CMD_GETTHRESHOLD,
+  US_CMD_PUTVAL,
+  US_CMD_LISTVAL,
+  US_CMD_PUTNOTIF,
+  US_CMD_FLUSH,
+  US_CMD_GETHISTORY,
+  US_CMD_UNKNOWN,
+  US_CMD_MAX
+};
+
+static const char *us_commands[US_CMD_MAX] = {
+    "getval", "getthreshold", "putval", "listval",
+    "putnotif", "flush", "gethistory", "unknown"};
+
+typedef struct {
+  uint64_t connections; /* currently open */
+  uint64_t accepted;
+  uint64_t rejected;
+  uint64_t throttled;
+  uint64_t octets_rx;
+  uint64_t octets_tx;
+  uint64_t commands[US_CMD_MAX];
+} us_stats_t;
+
+#if US_HAVE_EPOLL
+struct us_conn_s;
+typedef struct us_conn_s us_conn_t;
+
+/* A connection is only ever handled by the worker it was assigned to. */
+struct us_conn_s {
+  int fd;
+  uint32_t events; /* registered with epoll */
+
+  char in[US_INPUT_SIZE];
+  size_t in_len;
+  _Bool eof;
+
+  /* Replies are collected in "out_buf" through the "out" stream; the first
+   * "out_sent" bytes of it have been sent. */
+  FILE *out;
+  char *out_buf;
+  size_t out_size;
+  size_t out_sent;
+  _Bool throttled;
+
+  cmd_putval_parser_t *putval;
+
+  us_conn_t *prev;
+  us_conn_t *next;
+};
+
+typedef struct {
+  pthread_t thread;
+  _Bool running;
+  int epoll_fd;
+
+  /* Connections of this worker; "lock" protects the list, which is only
+   * modified when connections are added or closed. */
+  us_conn_t *conns;
+  pthread_mutex_t lock;
+} us_worker_t;
+#endif
+
 /*
  * Private variables
  */
 /* valid configuration file keys */
-static const char *config_keys[] = {"SocketFile", "SocketGroup", "SocketPerms",
-                                    "DeleteSocket"};
+static const char *config_keys[] = {
+    "SocketFile",    "SocketGroup",    "SocketPerms",      "DeleteSocket",
+    "WorkerThreads", "MaxConnections", "CollectStatistics"};
 static int config_keys_num = STATIC_ARRAY_SIZE(config_keys);
 
 static int loop = 0;
@@ -66,6 +155,21 @@ static _Bool delete_socket = 0;
 
 static pthread_t listen_thread = (pthread_t)0;
 
+/* server configuration */
+static int worker_threads = 2;
+static int max_connections = 0;
+static _Bool collect_stats = 0;
+
+static us_stats_t us_stats;
+
+#if US_HAVE_EPOLL
+static us_worker_t *workers = NULL;
+static size_t workers_num = 0;
+
+/* Written to on shutdown; the read end is registered with every worker. */
+static int shutdown_pipe[2] = {-1, -1};
+#endif
+
 /*
  * Functions
  */
@@ -120,7 +224,8 @@ static int us_open_socket(void) {
     return -1;
   }
 
-  status = listen(sock_fd, 8);
+  /* Many clients may connect at once, e.g. after a restart. */
+  status = listen(sock_fd, SOMAXCONN);
   if (status != 0) {
     char errbuf[1024];
     ERROR("unixsock plugin: listen failed: %s",
@@ -163,10 +268,487 @@ static int us_open_socket(void) {
   return 0;
 } /* int us_open_socket */
 
+/* Handles one command line, writing the reply to "fhout". Returns the
+ * command's index into us_commands, or -1 if the connection has to be
+ * closed. */
+static int us_handle_command(FILE *fhout, char *buffer, /* {{{ */
+                             cmd_putval_parser_t *putval) {
+  char buffer_copy[US_LINE_SIZE];
+  char *fields[128];
+  int fields_num;
+
+  /* Clients feeding values send little else; skip splitting the line. */
+  if ((strncasecmp("PUTVAL", buffer, strlen("PUTVAL")) == 0) &&
+      isspace((int)buffer[strlen("PUTVAL")])) {
+    cmd_putval_parser_handle(putval, fhout, buffer);
+    return US_CMD_PUTVAL;
+  }
+
+  sstrncpy(buffer_copy, buffer, sizeof(buffer_copy));
+
+  fields_num =
+      strsplit(buffer_copy, fields, sizeof(fields) / sizeof(fields[0]));
+  if (fields_num < 1) {
+    fprintf(fhout, "-1 Internal error\n");
+    return -1;
+  }
+
+  if (strcasecmp(fields[0], "getval") == 0) {
+    cmd_handle_getval(fhout, buffer);
+    return US_CMD_GETVAL;
+  } else if (strcasecmp(fields[0], "getthreshold") == 0) {
+    handle_getthreshold(fhout, buffer);
+    return US_CMD_GETTHRESHOLD;
+  } else if (strcasecmp(fields[0], "putval") == 0) {
+    cmd_putval_parser_handle(putval, fhout, buffer);
+    return US_CMD_PUTVAL;
+  } else if (strcasecmp(fields[0], "listval") == 0) {
+    cmd_handle_listval(fhout, buffer);
+    return US_CMD_LISTVAL;
+  } else if (strcasecmp(fields[0], "putnotif") == 0) {
+    handle_putnotif(fhout, buffer);
+    return US_CMD_PUTNOTIF;
+  } else if (strcasecmp(fields[0], "flush") == 0) {
+    cmd_handle_flush(fhout, buffer);
+    return US_CMD_FLUSH;
+  } else if (strcasecmp(fields[0], "gethistory") == 0) {
+    handle_gethistory(fhout, buffer);
+    return US_CMD_GETHISTORY;
+  }
+
+  if (fprintf(fhout, "-1 Unknown command: %s\n", fields[0]) < 0) {
+    char errbuf[1024];
+    WARNING("unixsock plugin: failed to write to socket #%i: %s",
+            fileno(fhout), sstrerror(errno, errbuf, sizeof(errbuf)));
+    return -1;
+  }
+  return US_CMD_UNKNOWN;
+} /* }}} int us_handle_command */
+
+static void us_stats_add(uint64_t *counter, uint64_t n) /* {{{ */
+{
+  __atomic_fetch_add(counter, n, __ATOMIC_RELAXED);
+} /* }}} void us_stats_add */
+
+#if US_HAVE_EPOLL
+static void us_conn_free(us_conn_t *conn) /* {{{ */
+{
+  if (conn == NULL)
+    return;
+
+  if (conn->fd >= 0)
+    close(conn->fd);
+  if (conn->out != NULL)
+    fclose(conn->out);
+  sfree(conn->out_buf);
+  cmd_putval_parser_destroy(conn->putval);
+  sfree(conn);
+} /* }}} void us_conn_free */
+
+static us_conn_t *us_conn_create(int fd) /* {{{ */
+{
+  us_conn_t *conn;
+
+  conn = calloc(1, sizeof(*conn));
+  if (conn == NULL)
+    return NULL;
+  conn->fd = fd;
+
+  /* The command handlers write to a FILE; collect their replies in memory
+   * and send them once the socket is writable. */
+  conn->out = open_memstream(&conn->out_buf, &conn->out_size);
+  conn->putval = cmd_putval_parser_create(/* opts = */ NULL);
+  if ((conn->out == NULL) || (conn->putval == NULL)) {
+    conn->fd = -1;
+    us_conn_free(conn);
+    return NULL;
+  }
+
+  return conn;
+} /* }}} us_conn_t *us_conn_create */
+
+/* Removes the connection from its worker and frees it. */
+static void us_conn_close(us_worker_t *w, us_conn_t *conn) /* {{{ */
+{
+  epoll_ctl(w->epoll_fd, EPOLL_CTL_DEL, conn->fd, NULL);
+
+  pthread_mutex_lock(&w->lock);
+  if (conn->prev != NULL)
+    conn->prev->next = conn->next;
+  else
+    w->conns = conn->next;
+  if (conn->next != NULL)
+    conn->next->prev = conn->prev;
+  pthread_mutex_unlock(&w->lock);
+
+  __atomic_fetch_sub(&us_stats.connections, 1, __ATOMIC_RELAXED);
+  us_conn_free(conn);
+} /* }}} void us_conn_close */
+
+/* Sends as much of the pending output as the socket accepts. Returns zero on
+ * success and -1 if the connection has to be closed. */
+static int us_conn_flush(us_conn_t *conn) /* {{{ */
+{
+  fflush(conn->out);
+
+  while (conn->out_sent < conn->out_size) {
+    ssize_t status = write(conn->fd, conn->out_buf + conn->out_sent,
+                           conn->out_size - conn->out_sent);
+    if (status < 0) {
+      if (errno == EINTR)
+        continue;
+      if ((errno == EAGAIN) || (errno == EWOULDBLOCK))
+        return 0;
+      if (errno != EPIPE) {
+        char errbuf[1024];
+        WARNING("unixsock plugin: failed to write to socket #%i: %s",
+                conn->fd, sstrerror(errno, errbuf, sizeof(errbuf)));
+      }
+      return -1;
+    }
+
+    conn->out_sent += (size_t)status;
+    us_stats_add(&us_stats.octets_tx, (uint64_t)status);
+  }
+
+  /* Everything has been sent: start over at the beginning of the buffer. */
+  fseeko(conn->out, 0, SEEK_SET);
+  fflush(conn->out);
+  conn->out_sent = 0;
+  return 0;
+} /* }}} int us_conn_flush */
+
+static size_t us_conn_pending(us_conn_t const *conn) /* {{{ */
+{
+  return conn->out_size - conn->out_sent;
+} /* }}} size_t us_conn_pending */
+
+/* Handles all complete lines in the input buffer, unless the client does not
+ * read its replies. Returns -1 if the connection has to be closed. */
+static int us_conn_handle_lines(us_conn_t *conn) /* {{{ */
+{
+  size_t offset = 0;
+  int status = 0;
+
+  while (offset < conn->in_len) {
+    char *line = conn->in + offset;
+    char *end = memchr(line, '\n', conn->in_len - offset);
+    size_t len;
+
+    /* Backpressure: stop handling commands until the replies have been
+     * sent. */
+    fflush(conn->out);
+    if (us_conn_pending(conn) >= US_OUTPUT_HIGH_WATER) {
+      if (!conn->throttled)
+        us_stats_add(&us_stats.throttled, 1);
+      conn->throttled = 1;
+      break;
+    }
+    conn->throttled = 0;
+
+    if (end == NULL) {
+      /* On EOF, a last line without newline is handled as well. */
+      if (!conn->eof)
+        break;
+      end = conn->in + conn->in_len;
+    }
+
+    *end = '\0';
+    offset = (size_t)(end - conn->in) + 1;
+
+    len = (size_t)(end - line);
+    while ((len > 0) && ((line[len - 1] == '\n') || (line[len - 1] == '\r')))
+      line[--len] = '\0';
+    if (len == 0)
+      continue;
+
+    int cmd = us_handle_command(conn->out, line, conn->putval);
+    if (cmd < 0) {
+      status = -1;
+      break;
+    }
+    us_stats_add(&us_stats.commands[cmd], 1);
+  }
+
+  if (offset > conn->in_len)
+    offset = conn->in_len;
+  if (offset > 0) {
+    memmove(conn->in, conn->in + offset, conn->in_len - offset);
+    conn->in_len -= offset;
+  }
+
+  return status;
+} /* }}} int us_conn_handle_lines */
+
+/* Reads what is available on the socket. Returns -1 if the connection has to
+ * be closed. */
+static int us_conn_read(us_conn_t *conn) /* {{{ */
+{
+  while (!conn->throttled && !conn->eof) {
+    ssize_t status;
+
+    if (conn->in_len >= sizeof(conn->in) - 1) {
+      fprintf(conn->out, "-1 Line too long.\n");
+      conn->eof = 1;
+      conn->in_len = 0;
+      break;
+    }
+
+    status = read(conn->fd, conn->in + conn->in_len,
+                  sizeof(conn->in) - 1 - conn->in_len);
+    if (status < 0) {
+      if (errno == EINTR)
+        continue;
+      if ((errno == EAGAIN) || (errno == EWOULDBLOCK))
+        return 0;
+      if (errno != ECONNRESET) {
+        char errbuf[1024];
+        WARNING("unixsock plugin: failed to read from socket #%i: %s",
+                conn->fd, sstrerror(errno, errbuf, sizeof(errbuf)));
+      }
+      return -1;
+    } else if (status == 0) {
+      conn->eof = 1;
+    } else {
+      conn->in_len += (size_t)status;
+      us_stats_add(&us_stats.octets_rx, (uint64_t)status);
+    }
+
+    if (us_conn_handle_lines(conn) != 0)
+      return -1;
+  }
+
+  return 0;
+} /* }}} int us_conn_read */
+
+/* Handles the events of one connection. Returns -1 if the connection has
+ * to be closed. */
+static int us_conn_handle(us_worker_t *w, us_conn_t *conn, /* {{{ */
+                          uint32_t revents) {
+  uint32_t events;
+
+  if (revents & (EPOLLIN | EPOLLHUP | EPOLLERR))
+    if (us_conn_read(conn) != 0)
+      return -1;
+
+  if (us_conn_flush(conn) != 0)
+    return -1;
+
+  /* Output has been drained below the mark: handle the commands which are
+   * already buffered, then continue reading. Afterwards, a throttled
+   * connection always has output pending, i.e. waits for EPOLLOUT. */
+  while (conn->throttled && (us_conn_pending(conn) < US_OUTPUT_HIGH_WATER)) {
+    conn->throttled = 0;
+    if ((us_conn_handle_lines(conn) != 0) || (us_conn_read(conn) != 0) ||
+        (us_conn_flush(conn) != 0))
+      return -1;
+  }
+
+  if (conn->eof && (conn->in_len == 0) && (us_conn_pending(conn) == 0))
+    return -1;
+
+  events = 0;
+  if (!conn->throttled && !conn->eof)
+    events |= EPOLLIN;
+  if (us_conn_pending(conn) > 0)
+    events |= EPOLLOUT;
+
+  if (events != conn->events) {
+    struct epoll_event ev = {.events = events, .data.ptr = conn};
+
+    if (epoll_ctl(w->epoll_fd, EPOLL_CTL_MOD, conn->fd, &ev) != 0) {
+      char errbuf[1024];
+      ERROR("unixsock plugin: epoll_ctl failed: %s",
+            sstrerror(errno, errbuf, sizeof(errbuf)));
+      return -1;
+    }
+    conn->events = events;
+  }
+
+  return 0;
+} /* }}} int us_conn_handle */
+
+static void *us_worker_thread(void *arg) /* {{{ */
+{
+  us_worker_t *w = arg;
+  struct epoll_event events[US_EPOLL_EVENTS];
+
+  while (42) {
+    int num = epoll_wait(w->epoll_fd, events, STATIC_ARRAY_SIZE(events), -1);
+
+    if (num < 0) {
+      char errbuf[1024];
+
+      if (errno == EINTR)
+        continue;
+
+      ERROR("unixsock plugin: epoll_wait failed: %s",
+            sstrerror(errno, errbuf, sizeof(errbuf)));
+      break;
+    }
+
+    for (int i = 0; i < num; i++) {
+      /* The read end of the shutdown pipe is registered with a NULL
+       * pointer. */
+      if (events[i].data.ptr == NULL)
+        goto out;
+
+      us_conn_t *conn = events[i].data.ptr;
+      if (us_conn_handle(w, conn, events[i].events) != 0)
+        us_conn_close(w, conn);
+    }
+  }
+
+out:
+  while (w->conns != NULL) {
+    us_conn_t *conn = w->conns;
+
+    /* Deliver the replies to the commands already handled, if possible. */
+    us_conn_flush(conn);
+    us_conn_close(w, conn);
+  }
+
+  return (void *)0;
+} /* }}} void *us_worker_thread */
+
+static void us_stop_workers(void) /* {{{ */
+{
+  if (shutdown_pipe[1] >= 0) {
+    /* The pipe stays readable, waking up all workers. */
+    if (write(shutdown_pipe[1], "", 1) != 1) {
+      char errbuf[1024];
+      ERROR("unixsock plugin: write to shutdown pipe failed: %s",
+            sstrerror(errno, errbuf, sizeof(errbuf)));
+    }
+  }
+
+  for (size_t i = 0; i < workers_num; i++) {
+    if (workers[i].running)
+      pthread_join(workers[i].thread, NULL);
+    if (workers[i].epoll_fd >= 0)
+      close(workers[i].epoll_fd);
+    pthread_mutex_destroy(&workers[i].lock);
+  }
+  sfree(workers);
+  workers_num = 0;
+
+  for (size_t i = 0; i < 2; i++) {
+    if (shutdown_pipe[i] >= 0)
+      close(shutdown_pipe[i]);
+    shutdown_pipe[i] = -1;
+  }
+} /* }}} void us_stop_workers */
+
+static int us_start_workers(void) /* {{{ */
+{
+  if (pipe(shutdown_pipe) != 0) {
+    char errbuf[1024];
+    ERROR("unixsock plugin: pipe failed: %s",
+          sstrerror(errno, errbuf, sizeof(errbuf)));
+    shutdown_pipe[0] = shutdown_pipe[1] = -1;
+    return -1;
+  }
+
+  workers = calloc((size_t)worker_threads, sizeof(*workers));
+  if (workers == NULL) {
+    ERROR("unixsock plugin: calloc failed.");
+    us_stop_workers();
+    return -1;
+  }
+
+  for (int i = 0; i < worker_threads; i++) {
+    us_worker_t *w = workers + workers_num;
+    struct epoll_event ev = {.events = EPOLLIN, .data.ptr = NULL};
+    char name[16];
+    int status;
+
+    w->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    pthread_mutex_init(&w->lock, NULL);
+    workers_num++;
+
+    if (w->epoll_fd < 0) {
+      char errbuf[1024];
+      ERROR("unixsock plugin: epoll_create1 failed: %s",
+            sstrerror(errno, errbuf, sizeof(errbuf)));
+      us_stop_workers();
+      return -1;
+    }
+
+    if (epoll_ctl(w->epoll_fd, EPOLL_CTL_ADD, shutdown_pipe[0], &ev) != 0) {
+      char errbuf[1024];
+      ERROR("unixsock plugin: epoll_ctl failed: %s",
+            sstrerror(errno, errbuf, sizeof(errbuf)));
+      us_stop_workers();
+      return -1;
+    }
+
+    snprintf(name, sizeof(name), "unixsock#%u", (unsigned)(i % 100));
+    status = plugin_thread_create(&w->thread, NULL, us_worker_thread, w, name);
+    if (status != 0) {
+      char errbuf[1024];
+      ERROR("unixsock plugin: pthread_create failed: %s",
+            sstrerror(errno, errbuf, sizeof(errbuf)));
+      us_stop_workers();
+      return -1;
+    }
+    w->running = 1;
+  }
+
+  return 0;
+} /* }}} int us_start_workers */
+
+/* Hands a newly accepted connection to the next worker. */
+static int us_add_client(int fd) /* {{{ */
+{
+  static size_t next_worker = 0;
+  us_worker_t *w = workers + (next_worker++ % workers_num);
+  struct epoll_event ev = {.events = EPOLLIN};
+  us_conn_t *conn;
+  int flags;
+
+  flags = fcntl(fd, F_GETFL);
+  if ((flags < 0) || (fcntl(fd, F_SETFL, flags | O_NONBLOCK) != 0)) {
+    char errbuf[1024];
+    WARNING("unixsock plugin: fcntl failed: %s",
+            sstrerror(errno, errbuf, sizeof(errbuf)));
+    close(fd);
+    return -1;
+  }
+
+  conn = us_conn_create(fd);
+  if (conn == NULL) {
+    WARNING("unixsock plugin: Allocating connection state failed.");
+    close(fd);
+    return -1;
+  }
+  conn->events = ev.events;
+  ev.data.ptr = conn;
+
+  /* Link the connection before the worker can see it. */
+  pthread_mutex_lock(&w->lock);
+  conn->next = w->conns;
+  if (w->conns != NULL)
+    w->conns->prev = conn;
+  w->conns = conn;
+  pthread_mutex_unlock(&w->lock);
+  __atomic_fetch_add(&us_stats.connections, 1, __ATOMIC_RELAXED);
+
+  if (epoll_ctl(w->epoll_fd, EPOLL_CTL_ADD, fd, &ev) != 0) {
+    char errbuf[1024];
+    WARNING("unixsock plugin: epoll_ctl failed: %s",
+            sstrerror(errno, errbuf, sizeof(errbuf)));
+    us_conn_close(w, conn);
+    return -1;
+  }
+
+  return 0;
+} /* }}} int us_add_client */
+#else  /* !US_HAVE_EPOLL */
 static void *us_handle_client(void *arg) {
   int fdin;
   int fdout;
   FILE *fhin, *fhout;
+  cmd_putval_parser_t *putval;
 
   fdin = *((int *)arg);
   free(arg);
@@ -180,6 +762,7 @@ static void *us_handle_client(void *arg) {
     ERROR("unixsock plugin: dup failed: %s",
           sstrerror(errno, errbuf, sizeof(errbuf)));
     close(fdin);
+    __atomic_fetch_sub(&us_stats.connections, 1, __ATOMIC_RELAXED);
     pthread_exit((void *)1);
   }
 
@@ -190,6 +773,7 @@ static void *us_handle_client(void *arg) {
           sstrerror(errno, errbuf, sizeof(errbuf)));
     close(fdin);
     close(fdout);
+    __atomic_fetch_sub(&us_stats.connections, 1, __ATOMIC_RELAXED);
     pthread_exit((void *)1);
     return (void *)1;
   }
@@ -201,6 +785,7 @@ static void *us_handle_client(void *arg) {
           sstrerror(errno, errbuf, sizeof(errbuf)));
     fclose(fhin); /* this closes fdin as well */
     close(fdout);
+    __atomic_fetch_sub(&us_stats.connections, 1, __ATOMIC_RELAXED);
     pthread_exit((void *)1);
     return (void *)1;
   }
@@ -212,16 +797,25 @@ static void *us_handle_client(void *arg) {
           sstrerror(errno, errbuf, sizeof(errbuf)));
     fclose(fhin);
     fclose(fhout);
+    __atomic_fetch_sub(&us_stats.connections, 1, __ATOMIC_RELAXED);
     pthread_exit((void *)1);
     return (void *)0;
   }
 
+  putval = cmd_putval_parser_create(/* opts = */ NULL);
+  if (putval == NULL) {
+    ERROR("unixsock plugin: cmd_putval_parser_create failed.");
+    fclose(fhin);
+    fclose(fhout);
+    __atomic_fetch_sub(&us_stats.connections, 1, __ATOMIC_RELAXED);
+    pthread_exit((void *)1);
+    return (void *)1;
+  }
+
   while (42) {
-    char buffer[1024];
-    char buffer_copy[1024];
-    char *fields[128];
-    int fields_num;
+    char buffer[US_LINE_SIZE];
     int len;
+    int cmd;
 
     errno = 0;
     if (fgets(buffer, sizeof(buffer), fhin) == NULL) {
@@ -237,6 +831,7 @@ static void *us_handle_client(void *arg) {
     }
 
     len = strlen(buffer);
+    us_stats_add(&us_stats.octets_rx, (uint64_t)len);
     while ((len > 0) &&
            ((buffer[len - 1] == '\n') || (buffer[len - 1] == '\r')))
       buffer[--len] = '\0';
@@ -244,57 +839,65 @@ static void *us_handle_client(void *arg) {
     if (len == 0)
       continue;
 
-    sstrncpy(buffer_copy, buffer, sizeof(buffer_copy));
-
-    fields_num =
-        strsplit(buffer_copy, fields, sizeof(fields) / sizeof(fields[0]));
-    if (fields_num < 1) {
-      fprintf(fhout, "-1 Internal error\n");
-      fclose(fhin);
-      fclose(fhout);
-      pthread_exit((void *)1);
-      return (void *)1;
-    }
-
-    if (strcasecmp(fields[0], "getval") == 0) {
-      cmd_handle_getval(fhout, buffer);
-    } else if (strcasecmp(fields[0], "getthreshold") == 0) {
-      handle_getthreshold(fhout, buffer);
-    } else if (strcasecmp(fields[0], "putval") == 0) {
-      cmd_handle_putval(fhout, buffer);
-    } else if (strcasecmp(fields[0], "listval") == 0) {
-      cmd_handle_listval(fhout, buffer);
-    } else if (strcasecmp(fields[0], "putnotif") == 0) {
-      handle_putnotif(fhout, buffer);
-    } else if (strcasecmp(fields[0], "flush") == 0) {
-      cmd_handle_flush(fhout, buffer);
-    } else {
-      if (fprintf(fhout, "-1 Unknown command: %s\n", fields[0]) < 0) {
-        char errbuf[1024];
-        WARNING("unixsock plugin: failed to write to socket #%i: %s",
-                fileno(fhout), sstrerror(errno, errbuf, sizeof(errbuf)));
-        break;
-      }
-    }
+    cmd = us_handle_command(fhout, buffer, putval);
+    if (cmd < 0)
+      break;
+    us_stats_add(&us_stats.commands[cmd], 1);
   } /* while (fgets) */
 
   DEBUG("unixsock plugin: us_handle_client: Exiting..");
+  cmd_putval_parser_destroy(putval);
   fclose(fhin);
   fclose(fhout);
+  __atomic_fetch_sub(&us_stats.connections, 1, __ATOMIC_RELAXED);
 
   pthread_exit((void *)0);
   return (void *)0;
 } /* void *us_handle_client */
 
-static void *us_server_thread(void __attribute__((unused)) * arg) {
-  int status;
-  int *remote_fd;
-  pthread_t th;
+static int us_add_client(int fd) /* {{{ */
+{
   pthread_attr_t th_attr;
+  pthread_t th;
+  int *remote_fd;
+  int status;
+
+  remote_fd = malloc(sizeof(*remote_fd));
+  if (remote_fd == NULL) {
+    char errbuf[1024];
+    WARNING("unixsock plugin: malloc failed: %s",
+            sstrerror(errno, errbuf, sizeof(errbuf)));
+    close(fd);
+    return -1;
+  }
+  *remote_fd = fd;
+
+  DEBUG("Spawning child to handle connection on fd #%i", *remote_fd);
 
   pthread_attr_init(&th_attr);
   pthread_attr_setdetachstate(&th_attr, PTHREAD_CREATE_DETACHED);
 
+  __atomic_fetch_add(&us_stats.connections, 1, __ATOMIC_RELAXED);
+  status = plugin_thread_create(&th, &th_attr, us_handle_client,
+                                (void *)remote_fd, "unixsock conn");
+  pthread_attr_destroy(&th_attr);
+  if (status != 0) {
+    char errbuf[1024];
+    WARNING("unixsock plugin: pthread_create failed: %s",
+            sstrerror(errno, errbuf, sizeof(errbuf)));
+    __atomic_fetch_sub(&us_stats.connections, 1, __ATOMIC_RELAXED);
+    close(*remote_fd);
+    free(remote_fd);
+    return -1;
+  }
+
+  return 0;
+} /* }}} int us_add_client */
+#endif /* !US_HAVE_EPOLL */
+
+static void *us_server_thread(void __attribute__((unused)) * arg) {
+  int status;
+
   if (us_open_socket() != 0)
     pthread_exit((void *)1);
 
@@ -311,37 +914,23 @@ static void *us_server_thread(void __attribute__((unused)) * arg) {
             sstrerror(errno, errbuf, sizeof(errbuf)));
       close(sock_fd);
       sock_fd = -1;
-      pthread_attr_destroy(&th_attr);
       pthread_exit((void *)1);
     }
 
-    remote_fd = malloc(sizeof(*remote_fd));
-    if (remote_fd == NULL) {
-      char errbuf[1024];
-      WARNING("unixsock plugin: malloc failed: %s",
-              sstrerror(errno, errbuf, sizeof(errbuf)));
+    if ((max_connections > 0) &&
+        (__atomic_load_n(&us_stats.connections, __ATOMIC_RELAXED) >=
+         (uint64_t)max_connections)) {
+      us_stats_add(&us_stats.rejected, 1);
       close(status);
       continue;
     }
-    *remote_fd = status;
 
-    DEBUG("Spawning child to handle connection on fd #%i", *remote_fd);
-
-    status = plugin_thread_create(&th, &th_attr, us_handle_client,
-                                  (void *)remote_fd, "unixsock conn");
-    if (status != 0) {
-      char errbuf[1024];
-      WARNING("unixsock plugin: pthread_create failed: %s",
-              sstrerror(errno, errbuf, sizeof(errbuf)));
-      close(*remote_fd);
-      free(remote_fd);
-      continue;
-    }
+    if (us_add_client(status) == 0)
+      us_stats_add(&us_stats.accepted, 1);
   } /* while (loop) */
 
   close(sock_fd);
   sock_fd = -1;
-  pthread_attr_destroy(&th_attr);
 
   status = unlink((sock_file != NULL) ? sock_file : US_DEFAULT_PATH);
   if (status != 0) {
@@ -354,6 +943,56 @@ static void *us_server_thread(void __attribute__((unused)) * arg) {
   return (void *)0;
 } /* void *us_server_thread */
 
+static void us_submit(const char *type, const char *type_instance, /* {{{ */
+                      value_t *values, size_t values_len) {
+  value_list_t vl = VALUE_LIST_INIT;
+
+  vl.values = values;
+  vl.values_len = values_len;
+  sstrncpy(vl.plugin, "unixsock", sizeof(vl.plugin));
+  sstrncpy(vl.type, type, sizeof(vl.type));
+  if (type_instance != NULL)
+    sstrncpy(vl.type_instance, type_instance, sizeof(vl.type_instance));
+
+  plugin_dispatch_values(&vl);
+} /* }}} void us_submit */
+
+static int us_read(void) /* {{{ */
+{
+  value_t octets[] = {
+      {.derive = (derive_t)__atomic_load_n(&us_stats.octets_rx,
+                                           __ATOMIC_RELAXED)},
+      {.derive = (derive_t)__atomic_load_n(&us_stats.octets_tx,
+                                           __ATOMIC_RELAXED)},
+  };
+
+  us_submit("current_connections", NULL,
+            &(value_t){.gauge = (gauge_t)__atomic_load_n(
+                           &us_stats.connections, __ATOMIC_RELAXED)},
+            1);
+  us_submit("total_connections", "accepted",
+            &(value_t){.derive = (derive_t)__atomic_load_n(
+                           &us_stats.accepted, __ATOMIC_RELAXED)},
+            1);
+  us_submit("total_connections", "rejected",
+            &(value_t){.derive = (derive_t)__atomic_load_n(
+                           &us_stats.rejected, __ATOMIC_RELAXED)},
+            1);
+  us_submit("derive", "throttled",
+            &(value_t){.derive = (derive_t)__atomic_load_n(
+                           &us_stats.throttled, __ATOMIC_RELAXED)},
+            1);
+  us_submit("if_octets", NULL, octets, STATIC_ARRAY_SIZE(octets));
+
+  for (size_t i = 0; i < US_CMD_MAX; i++)
+    us_submit("total_requests", us_commands[i],
+              &(value_t){.derive = (derive_t)__atomic_load_n(
+                             &us_stats.commands[i], __ATOMIC_RELAXED)},
+              1);
+
+  return 0;
+} /* }}} int us_read */
+
 static int us_config(const char *key, const char *val) {
   if (strcasecmp(key, "SocketFile") == 0) {
     char *new_sock_file = strdup(val);
@@ -376,6 +1015,26 @@ static int us_config(const char *key, const char *val) {
       delete_socket = 1;
     else
       delete_socket = 0;
+  } else if (strcasecmp(key, "WorkerThreads") == 0) {
+    int tmp = atoi(val);
+    if ((tmp < 1) || (tmp > US_MAX_WORKERS)) {
+      ERROR("unixsock plugin: WorkerThreads must be between 1 and %d.",
+            US_MAX_WORKERS);
+      return 1;
+    }
+    worker_threads = tmp;
+  } else if (strcasecmp(key, "MaxConnections") == 0) {
+    int tmp = atoi(val);
+    if (tmp < 0) {
+      ERROR("unixsock plugin: MaxConnections must not be negative.");
+      return 1;
+    }
+    max_connections = tmp;
+  } else if (strcasecmp(key, "CollectStatistics") == 0) {
+    if (IS_TRUE(val))
+      collect_stats = 1;
+    else
+      collect_stats = 0;
   } else {
     return -1;
   }
@@ -393,6 +1052,11 @@ static int us_init(void) {
     return 0;
   have_init = 1;
 
+#if US_HAVE_EPOLL
+  if (us_start_workers() != 0)
+    return -1;
+#endif
+
   loop = 1;
 
   status = plugin_thread_create(&listen_thread, NULL, us_server_thread, NULL,
@@ -401,9 +1065,15 @@ static int us_init(void) {
     char errbuf[1024];
     ERROR("unixsock plugin: pthread_create failed: %s",
           sstrerror(errno, errbuf, sizeof(errbuf)));
+#if US_HAVE_EPOLL
+    us_stop_workers();
+#endif
     return -1;
   }
 
+  if (collect_stats)
+    plugin_register_read("unixsock", us_read);
+
   return 0;
 } /* int us_init */
 
@@ -418,6 +1088,10 @@ static int us_shutdown(void) {
     listen_thread = (pthread_t)0;
   }
 
+#if US_HAVE_EPOLL
+  us_stop_workers();
+#endif
+
   plugin_unregister_init("unixsock");
   plugin_unregister_shutdown("unixsock");
 
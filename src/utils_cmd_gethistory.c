@@ -0,0 +1,195 @@
+/**
+ * collectd - src/utils_cmd_gethistory.c
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ **/
+
+#include "collectd.h"
+
+#include "common.h"
+#include "plugin.h"
+
+#include "utils_cache.h"
+#include "utils_cmd_gethistory.h"
+#include "utils_parse_option.h" /* for `parse_string' */
+
+#define print_to_socket(fh, ...)                                               \
+  if (fprintf(fh, __VA_ARGS__) < 0) {                                          \
+    char errbuf[1024];                                                         \
+    WARNING("handle_gethistory: failed to write to socket #%i: %s",            \
+            fileno(fh), sstrerror(errno, errbuf, sizeof(errbuf)));             \
+    return -1;                                                                 \
+  }
+
+static int print_gauge(FILE *fh, const char *prefix, gauge_t g) /* {{{ */
+{
+  if (isnan(g)) {
+    print_to_socket(fh, "%sNaN", prefix);
+  } else {
+    print_to_socket(fh, "%s%e", prefix, g);
+  }
+  return 0;
+} /* }}} int print_gauge */
+
+/* Prints one point per line: the time followed by "<ds>=<value>" for the raw
+ * tier and "<ds>=<min>:<avg>:<max>" for aggregated tiers. */
+static int print_points(FILE *fh, const data_set_t *ds, /* {{{ */
+                        _Bool aggregated, const cdtime_t *times,
+                        const gauge_t *values, size_t points_num) {
+  print_to_socket(fh, "%zu Point%s found\n", points_num,
+                  (points_num == 1) ? "" : "s");
+
+  for (size_t i = 0; i < points_num; i++) {
+    print_to_socket(fh, "%.3f", CDTIME_T_TO_DOUBLE(times[i]));
+
+    for (size_t j = 0; j < ds->ds_num; j++) {
+      const gauge_t *v = values + 3 * (i * ds->ds_num + j);
+
+      print_to_socket(fh, " %s", ds->ds[j].name);
+      if (print_gauge(fh, "=", v[0]) != 0)
+        return -1;
+      if (aggregated &&
+          ((print_gauge(fh, ":", v[1]) != 0) ||
+           (print_gauge(fh, ":", v[2]) != 0)))
+        return -1;
+    }
+
+    print_to_socket(fh, "\n");
+  }
+
+  return 0;
+} /* }}} int print_points */
+
+int handle_gethistory(FILE *fh, char *buffer) {
+  char *command;
+  char *identifier;
+  char *identifier_copy;
+  char *tier_str;
+
+  char *host;
+  char *plugin;
+  char *plugin_instance;
+  char *type;
+  char *type_instance;
+
+  const data_set_t *ds;
+  size_t tier = 0;
+  cdtime_t *times = NULL;
+  gauge_t *values = NULL;
+  size_t points_num = 0;
+
+  int status;
+
+  if ((fh == NULL) || (buffer == NULL))
+    return -1;
+
+  DEBUG("utils_cmd_gethistory: handle_gethistory (fh = %p, buffer = %s);",
+        (void *)fh, buffer);
+
+  command = NULL;
+  status = parse_string(&buffer, &command);
+  if (status != 0) {
+    print_to_socket(fh, "-1 Cannot parse command.\n");
+    return -1;
+  }
+  assert(command != NULL);
+
+  if (strcasecmp("GETHISTORY", command) != 0) {
+    print_to_socket(fh, "-1 Unexpected command: `%s'.\n", command);
+    return -1;
+  }
+
+  identifier = NULL;
+  status = parse_string(&buffer, &identifier);
+  if (status != 0) {
+    print_to_socket(fh, "-1 Cannot parse identifier.\n");
+    return -1;
+  }
+  assert(identifier != NULL);
+
+  /* The tier is optional and defaults to the raw points. */
+  if (*buffer != 0) {
+    char *endptr = NULL;
+
+    tier_str = NULL;
+    status = parse_string(&buffer, &tier_str);
+    if (status == 0) {
+      errno = 0;
+      tier = (size_t)strtoul(tier_str, &endptr, 10);
+    }
+    if ((status != 0) || (errno != 0) || (endptr == tier_str) ||
+        (*endptr != 0) || (uc_get_history_tier_info(tier, NULL, NULL) != 0)) {
+      print_to_socket(fh, "-1 Invalid tier.\n");
+      return -1;
+    }
+  }
+
+  if (*buffer != 0) {
+    print_to_socket(fh, "-1 Garbage after end of command: %s\n", buffer);
+    return -1;
+  }
+
+  /* parse_identifier() modifies its first argument,
+   * returning pointers into it */
+  identifier_copy = sstrdup(identifier);
+
+  status = parse_identifier(identifier_copy, &host, &plugin, &plugin_instance,
+                            &type, &type_instance,
+                            /* default_host = */ NULL);
+  if (status != 0) {
+    DEBUG("handle_gethistory: Cannot parse identifier `%s'.", identifier);
+    print_to_socket(fh, "-1 Cannot parse identifier `%s'.\n", identifier);
+    sfree(identifier_copy);
+    return -1;
+  }
+
+  value_list_t vl = {.values = NULL};
+  sstrncpy(vl.host, host, sizeof(vl.host));
+  sstrncpy(vl.plugin, plugin, sizeof(vl.plugin));
+  if (plugin_instance != NULL)
+    sstrncpy(vl.plugin_instance, plugin_instance, sizeof(vl.plugin_instance));
+  sstrncpy(vl.type, type, sizeof(vl.type));
+  if (type_instance != NULL)
+    sstrncpy(vl.type_instance, type_instance, sizeof(vl.type_instance));
+  sfree(identifier_copy);
+
+  ds = plugin_get_ds(vl.type);
+  if (ds == NULL) {
+    print_to_socket(fh, "-1 Type `%s' is unknown.\n", vl.type);
+    return -1;
+  }
+
+  status = uc_get_history_tier(ds, &vl, tier, &times, &values, &points_num);
+  if (status == -ENOENT) {
+    print_to_socket(fh, "-1 No history found for identifier %s\n",
+                    identifier);
+    return 0;
+  } else if (status != 0) {
+    print_to_socket(fh, "-1 Error while looking up history: %i\n", status);
+    return -1;
+  }
+
+  status = print_points(fh, ds, /* aggregated = */ (tier > 0), times, values,
+                        points_num);
+
+  sfree(times);
+  sfree(values);
+
+  return status;
+} /* int handle_gethistory */
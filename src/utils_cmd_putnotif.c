@@ -180,3 +180,115 @@ int handle_putnotif(FILE *fh, char *buffer) {
 
   return 0;
 } /* int handle_putnotif */
+
+/* Appends " key=value" to "ret", quoting the value if necessary. */
+static int putnotif_add(char *ret, size_t ret_len, size_t *offset, /* {{{ */
+                        const char *prefix, const char *key,
+                        const char *value) {
+  size_t pos = *offset;
+  _Bool quote = (value[0] == '\0') || (strpbrk(value, " \t\"\\") != NULL);
+  int status;
+
+  status = snprintf(ret + pos, ret_len - pos, " %s%s=%s", prefix, key,
+                    quote ? "\"" : "");
+  if ((status < 0) || ((size_t)status >= ret_len - pos))
+    return ENOBUFS;
+  pos += (size_t)status;
+
+  for (const char *c = value; *c != '\0'; c++) {
+    /* Room for an escaped character and the closing quote. */
+    if (pos + 3 >= ret_len)
+      return ENOBUFS;
+
+    if ((*c == '\n') || (*c == '\r')) {
+      ret[pos++] = ' ';
+      continue;
+    }
+    if (quote && ((*c == '"') || (*c == '\\')))
+      ret[pos++] = '\\';
+    ret[pos++] = *c;
+  }
+
+  if (quote)
+    ret[pos++] = '"';
+  ret[pos] = '\0';
+
+  *offset = pos;
+  return 0;
+} /* }}} int putnotif_add */
+
+int cmd_create_putnotif(char *ret, size_t ret_len, /* {{{ */
+                        const notification_t *n) {
+  const char *severity;
+  char buffer[64];
+  size_t offset;
+  int status;
+
+  if ((ret == NULL) || (n == NULL))
+    return EINVAL;
+
+  if (n->severity == NOTIF_FAILURE)
+    severity = "failure";
+  else if (n->severity == NOTIF_WARNING)
+    severity = "warning";
+  else
+    severity = "okay";
+
+  status = snprintf(ret, ret_len, "PUTNOTIF severity=%s time=%.3f", severity,
+                    CDTIME_T_TO_DOUBLE(n->time));
+  if ((status < 0) || ((size_t)status >= ret_len))
+    return ENOBUFS;
+  offset = (size_t)status;
+
+#define ADD_FIELD(key, value)                                                  \
+  do {                                                                         \
+    if (((value)[0] != '\0') &&                                                \
+        (putnotif_add(ret, ret_len, &offset, "", key, value) != 0))            \
+      return ENOBUFS;                                                          \
+  } while (0)
+
+  ADD_FIELD("host", n->host);
+  ADD_FIELD("plugin", n->plugin);
+  ADD_FIELD("plugin_instance", n->plugin_instance);
+  ADD_FIELD("type", n->type);
+  ADD_FIELD("type_instance", n->type_instance);
+
+#undef ADD_FIELD
+
+  for (notification_meta_t *meta = n->meta; meta != NULL; meta = meta->next) {
+    const char *value = buffer;
+
+    /* Names are parsed like the other option keys. */
+    if ((meta->name[0] == '\0') ||
+        (strspn(meta->name, "abcdefghijklmnopqrstuvwxyz"
+                            "ABCDEFGHIJKLMNOPQRSTUVWXYZ"
+                            "0123456789_") != strlen(meta->name)))
+      continue;
+
+    if (meta->type == NM_TYPE_STRING)
+      value = meta->nm_value.nm_string;
+    else if (meta->type == NM_TYPE_SIGNED_INT)
+      snprintf(buffer, sizeof(buffer), "%" PRIi64,
+               meta->nm_value.nm_signed_int);
+    else if (meta->type == NM_TYPE_UNSIGNED_INT)
+      snprintf(buffer, sizeof(buffer), "%" PRIu64,
+               meta->nm_value.nm_unsigned_int);
+    else if (meta->type == NM_TYPE_DOUBLE)
+      snprintf(buffer, sizeof(buffer), "%e", meta->nm_value.nm_double);
+    else if (meta->type == NM_TYPE_BOOLEAN)
+      sstrncpy(buffer, meta->nm_value.nm_boolean ? "true" : "false",
+               sizeof(buffer));
+    else
+      continue;
+
+    if (putnotif_add(ret, ret_len, &offset, "s:", meta->name, value) != 0)
+      return ENOBUFS;
+  }
+
+  /* handle_putnotif() insists on a message. */
+  if (putnotif_add(ret, ret_len, &offset, "", "message",
+                   (n->message[0] != '\0') ? n->message : "-") != 0)
+    return ENOBUFS;
+
+  return 0;
+} /* }}} int cmd_create_putnotif */
@@ -27,8 +27,16 @@
 #ifndef UTILS_CMD_PUTNOTIF_H
 #define UTILS_CMD_PUTNOTIF_H 1
 
+#include "plugin.h"
+
 #include <stdio.h>
 
 int handle_putnotif(FILE *fh, char *buffer);
 
+/* Formats "n" as a PUTNOTIF command, without trailing newline. Line breaks in
+ * the fields are replaced by spaces. Only meta data whose name can be parsed
+ * by handle_putnotif() is included, as a string. Returns zero on success and
+ * ENOBUFS if "ret" is too small. */
+int cmd_create_putnotif(char *ret, size_t ret_len, const notification_t *n);
+
 #endif /* UTILS_CMD_PUTNOTIF_H */
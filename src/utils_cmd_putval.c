@@ -283,3 +283,433 @@ int cmd_create_putval(char *ret, size_t ret_len, /* {{{ */
 
   return 0;
 } /* }}} int cmd_create_putval */
+
+/*
+ * streaming parser
+ */
+
+/* Number of identifiers cached per parser; must be a power of two. */
+#define PUTVAL_CACHE_SIZE 128
+
+typedef struct {
+  /* The identifier as sent by the client; empty if the entry is unused. */
+  char identifier[6 * DATA_MAX_NAME_LEN];
+  uint32_t hash;
+
+  /* The parsed identifier. Time, interval and values are set per line. */
+  value_list_t vl;
+
+  /* A copy of the data source types, so that the entry stays valid when the
+   * data set is replaced. */
+  int *ds_types;
+  size_t ds_num;
+  size_t ds_alloc;
+} putval_cache_entry_t;
+
+typedef struct {
+  cdtime_t time;
+  cdtime_t interval;
+} putval_set_t;
+
+struct cmd_putval_parser_s {
+  cmd_options_t opts;
+
+  putval_cache_entry_t *cache[PUTVAL_CACHE_SIZE];
+
+  /* Value lists of the current line; "values" holds "ds_num" values per
+   * set. Both only ever grow. */
+  putval_set_t *sets;
+  size_t sets_alloc;
+  value_t *values;
+  size_t values_alloc;
+};
+
+/* Splits the next white space separated field off "*ptr". Returns NULL if
+ * there are no more fields. */
+static char *putval_next_field(char **ptr) /* {{{ */
+{
+  char *field = *ptr;
+  char *end;
+
+  while (isspace((int)*field))
+    field++;
+  if (*field == '\0') {
+    *ptr = field;
+    return NULL;
+  }
+
+  end = field;
+  while ((*end != '\0') && !isspace((int)*end))
+    end++;
+  if (*end != '\0') {
+    *end = '\0';
+    end++;
+  }
+
+  *ptr = end;
+  return field;
+} /* }}} char *putval_next_field */
+
+/* FNV-1a */
+static uint32_t putval_hash(const char *str, size_t *ret_len) /* {{{ */
+{
+  uint32_t hash = 2166136261u;
+  const char *ptr;
+
+  for (ptr = str; *ptr != '\0'; ptr++) {
+    hash ^= (uint32_t)(unsigned char)*ptr;
+    hash *= 16777619u;
+  }
+
+  *ret_len = (size_t)(ptr - str);
+  return hash;
+} /* }}} uint32_t putval_hash */
+
+static putval_cache_entry_t *
+putval_cache_get(cmd_putval_parser_t *p, const char *identifier, /* {{{ */
+                 cmd_error_handler_t *err) {
+  putval_cache_entry_t *e;
+  char buffer[6 * DATA_MAX_NAME_LEN];
+  char *hostname;
+  char *plugin;
+  char *plugin_instance;
+  char *type;
+  char *type_instance;
+  const data_set_t *ds;
+  uint32_t hash;
+  size_t len;
+
+  hash = putval_hash(identifier, &len);
+  e = p->cache[hash & (PUTVAL_CACHE_SIZE - 1)];
+  if ((e != NULL) && (e->hash == hash) &&
+      (strcmp(e->identifier, identifier) == 0))
+    return e;
+
+  /* Even the longest valid identifier fits into the buffer. */
+  if (len >= sizeof(buffer)) {
+    cmd_error(CMD_PARSE_ERROR, err, "Identifier too long.");
+    return NULL;
+  }
+  memcpy(buffer, identifier, len + 1);
+
+  if (parse_identifier(buffer, &hostname, &plugin, &plugin_instance, &type,
+                       &type_instance, p->opts.identifier_default_host) != 0) {
+    cmd_error(CMD_PARSE_ERROR, err, "Cannot parse identifier `%s'.",
+              identifier);
+    return NULL;
+  }
+
+  if ((strlen(hostname) >= sizeof(e->vl.host)) ||
+      (strlen(plugin) >= sizeof(e->vl.plugin)) ||
+      ((plugin_instance != NULL) &&
+       (strlen(plugin_instance) >= sizeof(e->vl.plugin_instance))) ||
+      ((type_instance != NULL) &&
+       (strlen(type_instance) >= sizeof(e->vl.type_instance)))) {
+    cmd_error(CMD_PARSE_ERROR, err, "Identifier too long.");
+    return NULL;
+  }
+
+  ds = plugin_get_ds(type);
+  if (ds == NULL) {
+    cmd_error(CMD_PARSE_ERROR, err, "1 Type `%s' isn't defined.", type);
+    return NULL;
+  }
+
+  if (e == NULL) {
+    e = calloc(1, sizeof(*e));
+    if (e == NULL) {
+      cmd_error(CMD_ERROR, err, "calloc failed.");
+      return NULL;
+    }
+    p->cache[hash & (PUTVAL_CACHE_SIZE - 1)] = e;
+  }
+  /* Invalidate the entry until it has been filled in completely. */
+  e->identifier[0] = '\0';
+
+  if (e->ds_alloc < ds->ds_num) {
+    int *tmp = realloc(e->ds_types, ds->ds_num * sizeof(*e->ds_types));
+    if (tmp == NULL) {
+      cmd_error(CMD_ERROR, err, "realloc failed.");
+      return NULL;
+    }
+    e->ds_types = tmp;
+    e->ds_alloc = ds->ds_num;
+  }
+  for (size_t i = 0; i < ds->ds_num; i++)
+    e->ds_types[i] = ds->ds[i].type;
+  e->ds_num = ds->ds_num;
+
+  memset(&e->vl, 0, sizeof(e->vl));
+  sstrncpy(e->vl.host, hostname, sizeof(e->vl.host));
+  sstrncpy(e->vl.plugin, plugin, sizeof(e->vl.plugin));
+  sstrncpy(e->vl.type, type, sizeof(e->vl.type));
+  if (plugin_instance != NULL)
+    sstrncpy(e->vl.plugin_instance, plugin_instance,
+             sizeof(e->vl.plugin_instance));
+  if (type_instance != NULL)
+    sstrncpy(e->vl.type_instance, type_instance, sizeof(e->vl.type_instance));
+
+  e->hash = hash;
+  memcpy(e->identifier, identifier, len + 1);
+  return e;
+} /* }}} putval_cache_entry_t *putval_cache_get */
+
+/* Parses a "time:value[:value...]" field in place, accepting the same input as
+ * parse_values(). */
+static int putval_parse_values(char *buffer, /* {{{ */
+                               putval_cache_entry_t const *e, value_t *values,
+                               cdtime_t *ret_time) {
+  cdtime_t t = 0;
+  size_t i = 0;
+
+  memset(values, 0, e->ds_num * sizeof(*values));
+
+  while (42) {
+    char *field;
+
+    /* Like strtok(), ignore empty fields. */
+    while (*buffer == ':')
+      buffer++;
+    if (*buffer == '\0')
+      break;
+
+    field = buffer;
+    while ((*buffer != '\0') && (*buffer != ':'))
+      buffer++;
+    if (*buffer != '\0') {
+      *buffer = '\0';
+      buffer++;
+    }
+
+    if (i >= e->ds_num)
+      return -1;
+
+    if (t == 0) {
+      if (strcmp("N", field) == 0)
+        t = cdtime();
+      else {
+        char *endptr = NULL;
+        double tmp;
+
+        errno = 0;
+        tmp = strtod(field, &endptr);
+        if ((errno != 0) || (endptr == field) || (endptr == NULL) ||
+            (*endptr != '\0'))
+          return -1;
+
+        t = DOUBLE_TO_CDTIME_T(tmp);
+      }
+      continue;
+    }
+
+    if ((strcmp("U", field) == 0) && (e->ds_types[i] == DS_TYPE_GAUGE))
+      values[i].gauge = NAN;
+    else if (parse_value(field, &values[i], e->ds_types[i]) != 0)
+      return -1;
+
+    i++;
+  }
+
+  if (i == 0)
+    return -1;
+
+  *ret_time = t;
+  return 0;
+} /* }}} int putval_parse_values */
+
+/* Makes room for one more set of "ds_num" values. */
+static int putval_parser_grow(cmd_putval_parser_t *p, size_t sets_num, /* {{{ */
+                              size_t ds_num) {
+  if (sets_num >= p->sets_alloc) {
+    size_t alloc = (p->sets_alloc > 0) ? 2 * p->sets_alloc : 4;
+    putval_set_t *tmp = realloc(p->sets, alloc * sizeof(*p->sets));
+    if (tmp == NULL)
+      return ENOMEM;
+    p->sets = tmp;
+    p->sets_alloc = alloc;
+  }
+
+  if ((sets_num + 1) * ds_num > p->values_alloc) {
+    size_t alloc = (p->values_alloc > 0) ? p->values_alloc : 4;
+    value_t *tmp;
+
+    while (alloc < (sets_num + 1) * ds_num)
+      alloc *= 2;
+    tmp = realloc(p->values, alloc * sizeof(*p->values));
+    if (tmp == NULL)
+      return ENOMEM;
+    p->values = tmp;
+    p->values_alloc = alloc;
+  }
+
+  return 0;
+} /* }}} int putval_parser_grow */
+
+/* Lines with quoted fields are rare; leave the unquoting to cmd_parse(). */
+static cmd_status_t putval_parser_dispatch_quoted(cmd_putval_parser_t *p,
+                                                  char *line, /* {{{ */
+                                                  size_t *ret_num,
+                                                  cmd_error_handler_t *err) {
+  cmd_status_t status;
+  cmd_t cmd;
+
+  status = cmd_parse(line, &cmd, &p->opts, err);
+  if (status != CMD_OK)
+    return status;
+  if (cmd.type != CMD_PUTVAL) {
+    cmd_error(CMD_UNKNOWN_COMMAND, err, "Unexpected command: `%s'.",
+              CMD_TO_STRING(cmd.type));
+    cmd_destroy(&cmd);
+    return CMD_UNKNOWN_COMMAND;
+  }
+
+  for (size_t i = 0; i < cmd.cmd.putval.vl_num; ++i)
+    plugin_dispatch_values(&cmd.cmd.putval.vl[i]);
+
+  if (ret_num != NULL)
+    *ret_num = cmd.cmd.putval.vl_num;
+
+  cmd_destroy(&cmd);
+  return CMD_OK;
+} /* }}} cmd_status_t putval_parser_dispatch_quoted */
+
+cmd_putval_parser_t *cmd_putval_parser_create(const cmd_options_t *opts) {
+  cmd_putval_parser_t *p;
+
+  p = calloc(1, sizeof(*p));
+  if (p == NULL)
+    return NULL;
+
+  if ((opts != NULL) && (opts->identifier_default_host != NULL)) {
+    p->opts.identifier_default_host = strdup(opts->identifier_default_host);
+    if (p->opts.identifier_default_host == NULL) {
+      sfree(p);
+      return NULL;
+    }
+  }
+
+  return p;
+} /* cmd_putval_parser_t *cmd_putval_parser_create */
+
+void cmd_putval_parser_destroy(cmd_putval_parser_t *p) {
+  if (p == NULL)
+    return;
+
+  for (size_t i = 0; i < PUTVAL_CACHE_SIZE; i++) {
+    if (p->cache[i] == NULL)
+      continue;
+    sfree(p->cache[i]->ds_types);
+    sfree(p->cache[i]);
+  }
+
+  sfree(p->sets);
+  sfree(p->values);
+  sfree(p->opts.identifier_default_host);
+  sfree(p);
+} /* void cmd_putval_parser_destroy */
+
+cmd_status_t cmd_putval_parser_dispatch(cmd_putval_parser_t *p, char *line,
+                                        size_t *ret_num,
+                                        cmd_error_handler_t *err) {
+  putval_cache_entry_t *e;
+  char *command;
+  char *identifier;
+  char *field;
+  size_t sets_num = 0;
+
+  if ((p == NULL) || (line == NULL)) {
+    errno = EINVAL;
+    cmd_error(CMD_ERROR, err,
+              "Invalid arguments to cmd_putval_parser_dispatch.");
+    return CMD_ERROR;
+  }
+
+  if (ret_num != NULL)
+    *ret_num = 0;
+
+  if (strchr(line, '"') != NULL)
+    return putval_parser_dispatch_quoted(p, line, ret_num, err);
+
+  command = putval_next_field(&line);
+  if (command == NULL) {
+    cmd_error(CMD_ERROR, err, "Missing command.");
+    return CMD_ERROR;
+  }
+  if (strcasecmp("PUTVAL", command) != 0) {
+    cmd_error(CMD_UNKNOWN_COMMAND, err, "Unexpected command: `%s'.", command);
+    return CMD_UNKNOWN_COMMAND;
+  }
+
+  identifier = putval_next_field(&line);
+  while (isspace((int)*line))
+    line++;
+  if ((identifier == NULL) || (*line == '\0')) {
+    cmd_error(CMD_PARSE_ERROR, err, "Missing identifier and/or value-list.");
+    return CMD_PARSE_ERROR;
+  }
+
+  e = putval_cache_get(p, identifier, err);
+  if (e == NULL)
+    return CMD_PARSE_ERROR;
+
+  /* Parse the whole line before dispatching anything. */
+  e->vl.interval = 0;
+  while ((field = putval_next_field(&line)) != NULL) {
+    char *key = NULL;
+    char *value = NULL;
+    cmd_status_t status;
+
+    status = cmd_parse_option(field, &key, &value, err);
+    if (status == CMD_OK) {
+      set_option(&e->vl, key, value);
+      continue;
+    } else if (status != CMD_NO_OPTION) {
+      return status;
+    }
+
+    if (putval_parser_grow(p, sets_num, e->ds_num) != 0) {
+      cmd_error(CMD_ERROR, err, "realloc failed.");
+      return CMD_ERROR;
+    }
+
+    if (putval_parse_values(field, e, p->values + sets_num * e->ds_num,
+                            &p->sets[sets_num].time) != 0) {
+      cmd_error(CMD_PARSE_ERROR, err, "Parsing the values string failed.");
+      return CMD_PARSE_ERROR;
+    }
+    p->sets[sets_num].interval = e->vl.interval;
+    sets_num++;
+  }
+
+  for (size_t i = 0; i < sets_num; i++) {
+    e->vl.time = p->sets[i].time;
+    e->vl.interval = p->sets[i].interval;
+    e->vl.values = p->values + i * e->ds_num;
+    e->vl.values_len = e->ds_num;
+
+    plugin_dispatch_values(&e->vl);
+  }
+  e->vl.values = NULL;
+  e->vl.values_len = 0;
+
+  if (ret_num != NULL)
+    *ret_num = sets_num;
+  return CMD_OK;
+} /* cmd_status_t cmd_putval_parser_dispatch */
+
+cmd_status_t cmd_putval_parser_handle(cmd_putval_parser_t *p, FILE *fh,
+                                      char *buffer) {
+  cmd_error_handler_t err = {cmd_error_fh, fh};
+  cmd_status_t status;
+  size_t num = 0;
+
+  status = cmd_putval_parser_dispatch(p, buffer, &num, &err);
+  if (status != CMD_OK)
+    return status;
+
+  if (fh != stdout)
+    cmd_error(CMD_OK, &err, "Success: %i %s been dispatched.", (int)num,
+              (num == 1) ? "value has" : "values have");
+
+  return CMD_OK;
+} /* cmd_status_t cmd_putval_parser_handle */
@@ -44,4 +44,51 @@ void cmd_destroy_putval(cmd_putval_t *putval);
 int cmd_create_putval(char *ret, size_t ret_len, const data_set_t *ds,
                       const value_list_t *vl);
 
+/*
+ * NAME
+ *   cmd_putval_parser_t
+ *
+ * DESCRIPTION
+ *   Parser for streams of PUTVAL lines, e.g. the output of an exec program or
+ *   the commands of one unixsock client. Lines are split in place and the
+ *   parsed identifiers, together with the types of their data sources, are
+ *   cached per parser, so that once the parser has seen the identifiers of a
+ *   stream, handling a line does not allocate memory or look up the data set.
+ *   The accepted syntax is the same as that of cmd_parse(). A parser must only
+ *   be used by one thread at a time.
+ */
+struct cmd_putval_parser_s;
+typedef struct cmd_putval_parser_s cmd_putval_parser_t;
+
+/* If "opts" is NULL, the default options are used. The options are copied. */
+cmd_putval_parser_t *cmd_putval_parser_create(const cmd_options_t *opts);
+void cmd_putval_parser_destroy(cmd_putval_parser_t *p);
+
+/*
+ * NAME
+ *   cmd_putval_parser_dispatch
+ *
+ * DESCRIPTION
+ *   Parses a single PUTVAL line, without trailing newline, and dispatches all
+ *   of its value lists. As with cmd_parse(), nothing is dispatched if any part
+ *   of the line is invalid. "line" is modified in the process.
+ *
+ * PARAMETERS
+ *   `p'        The parser.
+ *   `line'     The line to parse.
+ *   `ret_num'  If not NULL, the number of dispatched value lists is stored
+ *              here.
+ *   `err'      An optional error handler to invoke on error.
+ *
+ * RETURN VALUE
+ *   CMD_OK on success or the respective error code otherwise.
+ */
+cmd_status_t cmd_putval_parser_dispatch(cmd_putval_parser_t *p, char *line,
+                                        size_t *ret_num,
+                                        cmd_error_handler_t *err);
+
+/* Like cmd_handle_putval(), but using the parser "p". */
+cmd_status_t cmd_putval_parser_handle(cmd_putval_parser_t *p, FILE *fh,
+                                      char *buffer);
+
 #endif /* UTILS_CMD_PUTVAL_H */
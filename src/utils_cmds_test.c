@@ -26,6 +26,9 @@
 
 #include "common.h"
 #include "testing.h"
+#include "utils_cmd_gethistory.h"
+#include "utils_cmd_putnotif.h"
+#include "utils_cmd_putval.h"
 #include "utils_cmds.h"
 
 static void error_cb(void *ud, cmd_status_t status, const char *format,
@@ -218,7 +221,182 @@ DEF_TEST(parse) {
   return test_result;
 }
 
+DEF_TEST(putval_parser) {
+  cmd_error_handler_t err = {error_cb, NULL};
+  cmd_putval_parser_t *p;
+  cmd_putval_parser_t *p_default_host;
+  int test_result = 0;
+
+  CHECK_NOT_NULL(p = cmd_putval_parser_create(NULL));
+  CHECK_NOT_NULL(p_default_host = cmd_putval_parser_create(&default_host_opts));
+
+  /* The parser has to agree with cmd_parse() on all PUTVAL commands. Run the
+   * table twice, so that the second round hits the identifier cache. */
+  for (int round = 0; round < 2; round++) {
+    for (size_t i = 0; i < STATIC_ARRAY_SIZE(parse_data); i++) {
+      char *input;
+      char description[1024];
+      cmd_status_t status;
+      cmd_status_t want;
+      size_t num = 0;
+      _Bool result;
+
+      if (strncmp("PUTVAL", parse_data[i].input, strlen("PUTVAL")) != 0)
+        continue;
+
+      input = strdup(parse_data[i].input);
+      status = cmd_putval_parser_dispatch(
+          (parse_data[i].opts != NULL) ? p_default_host : p, input, &num, &err);
+      want = parse_data[i].expected_status;
+
+      snprintf(description, sizeof(description),
+               "cmd_putval_parser_dispatch (\"%s\", opts=%p) = %d; want %d",
+               parse_data[i].input, parse_data[i].opts, status, want);
+      result = (status == want);
+      LOG(result, description);
+      if (!result)
+        test_result = -1;
+
+      free(input);
+    }
+  }
+
+  struct {
+    char *input;
+    cmd_status_t expected_status;
+    size_t expected_num;
+  } cases[] = {
+      {"PUTVAL myhost/magic/MAGIC N:42", CMD_OK, 1},
+      {"putval  myhost/magic/MAGIC\t1234:42  2345:23 ", CMD_OK, 2},
+      {"PUTVAL myhost/magic/MAGIC 1234:42 interval=5 2345:23 3456:1", CMD_OK,
+       3},
+      {"PUTVAL myhost/magic/MAGIC interval=10", CMD_OK, 0},
+      {"PUTVAL myhost/magic-instance/MAGIC-type 1234::42", CMD_OK, 1},
+      {"PUTVAL \"myhost/magic/MAGIC\" \"1234:42\"", CMD_OK, 1},
+      {"PUTVAL \"myhost/magic/MAGIC\" \"1234:A\"", CMD_PARSE_ERROR, 0},
+      {"GETVAL \"myhost/magic/MAGIC\"", CMD_UNKNOWN_COMMAND, 0},
+      {"GETVAL myhost/magic/MAGIC", CMD_UNKNOWN_COMMAND, 0},
+      {"", CMD_ERROR, 0},
+      {"PUTVAL myhost/magic/MAGIC ", CMD_PARSE_ERROR, 0},
+      /* All or nothing: the first value must not be dispatched. */
+      {"PUTVAL myhost/magic/MAGIC 1234:42 2345:A", CMD_PARSE_ERROR, 0},
+      {"PUTVAL myhost/magic/MAGIC 1234:42:23", CMD_PARSE_ERROR, 0},
+      /* The cached entry of a valid identifier survives a failed lookup. */
+      {"PUTVAL myhost/magic/UNKNOWN 1234:42", CMD_PARSE_ERROR, 0},
+      {"PUTVAL myhost/magic/MAGIC 1234:42", CMD_OK, 1},
+  };
+
+  for (size_t i = 0; i < STATIC_ARRAY_SIZE(cases); i++) {
+    char *input = strdup(cases[i].input);
+    size_t num = 42;
+
+    EXPECT_EQ_INT(cases[i].expected_status,
+                  cmd_putval_parser_dispatch(p, input, &num, &err));
+    EXPECT_EQ_UINT64(cases[i].expected_num, num);
+    free(input);
+  }
+
+  cmd_putval_parser_destroy(p);
+  cmd_putval_parser_destroy(p_default_host);
+  return test_result;
+}
+
+DEF_TEST(create_putnotif) {
+  notification_meta_t meta_count = {
+      .name = "count", .type = NM_TYPE_SIGNED_INT, .nm_value.nm_signed_int = -3};
+  notification_meta_t meta_path = {.name = "path",
+                                   .type = NM_TYPE_STRING,
+                                   .nm_value.nm_string = "C:\\tmp",
+                                   .next = &meta_count};
+  notification_t n = {
+      .severity = NOTIF_WARNING,
+      .time = TIME_T_TO_CDTIME_T(1480000000),
+      .message = "Disk \"/\" almost full\nreally",
+      .host = "example.com",
+      .plugin = "df",
+      .type = "percent_bytes",
+      .meta = &meta_path,
+  };
+  char buffer[1024];
+
+  CHECK_ZERO(cmd_create_putnotif(buffer, sizeof(buffer), &n));
+  EXPECT_EQ_STR("PUTNOTIF severity=warning time=1480000000.000 "
+                "host=example.com plugin=df type=percent_bytes "
+                "s:path=\"C:\\\\tmp\" s:count=-3 "
+                "message=\"Disk \\\"/\\\" almost full really\"",
+                buffer);
+
+  /* An empty message is replaced, PUTNOTIF requires one. */
+  n.message[0] = '\0';
+  n.meta = NULL;
+  n.severity = NOTIF_OKAY;
+  CHECK_ZERO(cmd_create_putnotif(buffer, sizeof(buffer), &n));
+  EXPECT_EQ_STR("PUTNOTIF severity=okay time=1480000000.000 "
+                "host=example.com plugin=df type=percent_bytes message=-",
+                buffer);
+
+  EXPECT_EQ_INT(ENOBUFS, cmd_create_putnotif(buffer, 40, &n));
+  EXPECT_EQ_INT(ENOBUFS, cmd_create_putnotif(buffer, strlen(buffer), &n));
+
+  return 0;
+}
+
+DEF_TEST(gethistory) {
+  struct {
+    char *input;
+    int expected_status;
+    char *expected_output;
+  } cases[] = {
+      {"GETHISTORY myhost/magic/MAGIC", 0,
+       "2 Points found\n"
+       "1480000000.000 value=1.000000e+00\n"
+       "1480000010.000 value=2.000000e+00\n"},
+      {"GETHISTORY \"myhost/magic/MAGIC\" 0", 0,
+       "2 Points found\n"
+       "1480000000.000 value=1.000000e+00\n"
+       "1480000010.000 value=2.000000e+00\n"},
+      /* Aggregated tiers print the minimum, average and maximum. */
+      {"GETHISTORY myhost/magic/MAGIC 1", 0,
+       "2 Points found\n"
+       "1480000000.000 value=1.000000e+00:2.000000e+00:3.000000e+00\n"
+       "1480000060.000 value=NaN:NaN:NaN\n"},
+      {"GETHISTORY myhost/magic/MAGIC 2", -1, "-1 Invalid tier.\n"},
+      {"GETHISTORY myhost/magic/MAGIC -1", -1, "-1 Invalid tier.\n"},
+      {"GETHISTORY myhost/magic/MAGIC one", -1, "-1 Invalid tier.\n"},
+      {"GETHISTORY myhost/magic/MAGIC 1 2", -1,
+       "-1 Garbage after end of command: 2\n"},
+      {"GETHISTORY otherhost/magic/MAGIC", 0,
+       "-1 No history found for identifier otherhost/magic/MAGIC\n"},
+      {"GETHISTORY myhost/magic/UNKNOWN", -1,
+       "-1 Type `UNKNOWN' is unknown.\n"},
+      {"GETHISTORY invalid", -1, "-1 Cannot parse identifier `invalid'.\n"},
+      {"GETHISTORY", -1, "-1 Cannot parse identifier.\n"},
+  };
+
+  for (size_t i = 0; i < STATIC_ARRAY_SIZE(cases); i++) {
+    char *input = strdup(cases[i].input);
+    char *output = NULL;
+    size_t output_size = 0;
+    FILE *fh;
+
+    printf("## Case %zu: %s\n", i, cases[i].input);
+
+    CHECK_NOT_NULL(fh = open_memstream(&output, &output_size));
+    EXPECT_EQ_INT(cases[i].expected_status, handle_gethistory(fh, input));
+    fclose(fh);
+    EXPECT_EQ_STR(cases[i].expected_output, output);
+
+    free(output);
+    free(input);
+  }
+
+  return 0;
+}
+
 int main(int argc, char **argv) {
   RUN_TEST(parse);
+  RUN_TEST(putval_parser);
+  RUN_TEST(create_putnotif);
+  RUN_TEST(gethistory);
   END_TEST;
 }
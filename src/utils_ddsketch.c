@@ -0,0 +1,292 @@
+/**
+ * collectd - src/utils_ddsketch.c
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ **/
+
+#include "collectd.h"
+
+#include "utils_ddsketch.h"
+
+#include <float.h>
+#include <math.h>
+
+/* Values with a smaller magnitude are counted as zero. */
+#define DDSKETCH_MIN_VALUE 1e-9
+
+/* Number of buckets added in addition to the one needed when a store has to
+ * grow, so that values slowly drifting upwards don't cause a copy each. */
+#define DDSKETCH_GROW 32
+
+/* Counts of consecutive buckets; counts[0] is the bucket with index
+ * "offset". */
+typedef struct {
+  uint64_t *counts;
+  int offset;
+  int num;
+} ddsketch_store_t;
+
+struct ddsketch_s {
+  double gamma;
+  double log_gamma;
+
+  ddsketch_store_t positive;
+  ddsketch_store_t negative; /* indexed by the absolute value */
+  uint64_t zero_count;
+
+  uint64_t count;
+  double min;
+  double max;
+};
+
+/* Bucket i holds the values in (gamma^(i-1), gamma^i]. */
+static int ddsketch_index(ddsketch_t const *s, double value) /* {{{ */
+{
+  if (value > DBL_MAX)
+    value = DBL_MAX;
+  return (int)ceil(log(value) / s->log_gamma);
+} /* }}} int ddsketch_index */
+
+/* Returns the value representing bucket "index", which is within the
+ * sketch's relative accuracy of every value in the bucket. */
+static double ddsketch_value(ddsketch_t const *s, int index) /* {{{ */
+{
+  return 2.0 * exp(((double)index) * s->log_gamma) / (s->gamma + 1.0);
+} /* }}} double ddsketch_value */
+
+static int store_add(ddsketch_store_t *st, int index, uint64_t n) /* {{{ */
+{
+  uint64_t *counts;
+  int req_lo, req_hi; /* range of indices that needs to be covered */
+  int lo, hi;
+
+  if ((st->num > 0) && (index >= st->offset) &&
+      (index < st->offset + st->num)) {
+    st->counts[index - st->offset] += n;
+    return 0;
+  }
+
+  if (st->num == 0) {
+    req_lo = index;
+    req_hi = index;
+    lo = index - DDSKETCH_GROW;
+    hi = index + DDSKETCH_GROW;
+  } else if (index < st->offset) {
+    req_lo = index;
+    req_hi = st->offset + st->num - 1;
+    lo = index - DDSKETCH_GROW;
+    hi = req_hi;
+  } else {
+    req_lo = st->offset;
+    req_hi = index;
+    lo = req_lo;
+    hi = index + DDSKETCH_GROW;
+  }
+
+  /* Limit the number of buckets: drop the surplus buckets first, then
+   * collapse the lowest buckets if the values span too wide a range. */
+  if ((hi - lo + 1) > DDSKETCH_MAX_BUCKETS) {
+    if (hi > req_lo + DDSKETCH_MAX_BUCKETS - 1)
+      hi = req_lo + DDSKETCH_MAX_BUCKETS - 1;
+    if (hi < req_hi)
+      hi = req_hi;
+    lo = hi - DDSKETCH_MAX_BUCKETS + 1;
+  }
+
+  counts = calloc((size_t)(hi - lo + 1), sizeof(*counts));
+  if (counts == NULL)
+    return ENOMEM;
+
+  for (int i = 0; i < st->num; i++) {
+    int idx = st->offset + i;
+    counts[((idx < lo) ? lo : idx) - lo] += st->counts[i];
+  }
+
+  free(st->counts);
+  st->counts = counts;
+  st->offset = lo;
+  st->num = hi - lo + 1;
+
+  if (index < lo)
+    index = lo;
+  st->counts[index - lo] += n;
+  return 0;
+} /* }}} int store_add */
+
+ddsketch_t *ddsketch_create(double relative_accuracy) /* {{{ */
+{
+  ddsketch_t *s;
+
+  if (!(relative_accuracy > 0.0) || !(relative_accuracy < 1.0))
+    return NULL;
+
+  s = calloc(1, sizeof(*s));
+  if (s == NULL)
+    return NULL;
+
+  s->gamma = (1.0 + relative_accuracy) / (1.0 - relative_accuracy);
+  s->log_gamma = log(s->gamma);
+  s->min = NAN;
+  s->max = NAN;
+
+  return s;
+} /* }}} ddsketch_t *ddsketch_create */
+
+void ddsketch_destroy(ddsketch_t *s) /* {{{ */
+{
+  if (s == NULL)
+    return;
+
+  free(s->positive.counts);
+  free(s->negative.counts);
+  free(s);
+} /* }}} void ddsketch_destroy */
+
+void ddsketch_reset(ddsketch_t *s) /* {{{ */
+{
+  if (s == NULL)
+    return;
+
+  /* Keep the buckets; the next interval likely needs the same ones. */
+  if (s->positive.num > 0)
+    memset(s->positive.counts, 0,
+           sizeof(*s->positive.counts) * (size_t)s->positive.num);
+  if (s->negative.num > 0)
+    memset(s->negative.counts, 0,
+           sizeof(*s->negative.counts) * (size_t)s->negative.num);
+  s->zero_count = 0;
+
+  s->count = 0;
+  s->min = NAN;
+  s->max = NAN;
+} /* }}} void ddsketch_reset */
+
+int ddsketch_add(ddsketch_t *s, double value) /* {{{ */
+{
+  int status = 0;
+
+  if (s == NULL)
+    return EINVAL;
+  if (isnan(value))
+    return 0;
+
+  if (value > DDSKETCH_MIN_VALUE)
+    status = store_add(&s->positive, ddsketch_index(s, value), 1);
+  else if (value < -DDSKETCH_MIN_VALUE)
+    status = store_add(&s->negative, ddsketch_index(s, -value), 1);
+  else
+    s->zero_count++;
+
+  if (status != 0)
+    return status;
+
+  s->count++;
+  if (isnan(s->min) || (s->min > value))
+    s->min = value;
+  if (isnan(s->max) || (s->max < value))
+    s->max = value;
+
+  return 0;
+} /* }}} int ddsketch_add */
+
+int ddsketch_merge(ddsketch_t *dst, ddsketch_t const *src) /* {{{ */
+{
+  if ((dst == NULL) || (src == NULL) || (dst->gamma != src->gamma))
+    return EINVAL;
+
+  for (int i = 0; i < src->positive.num; i++) {
+    if (src->positive.counts[i] == 0)
+      continue;
+    if (store_add(&dst->positive, src->positive.offset + i,
+                  src->positive.counts[i]) != 0)
+      return ENOMEM;
+  }
+
+  for (int i = 0; i < src->negative.num; i++) {
+    if (src->negative.counts[i] == 0)
+      continue;
+    if (store_add(&dst->negative, src->negative.offset + i,
+                  src->negative.counts[i]) != 0)
+      return ENOMEM;
+  }
+
+  dst->zero_count += src->zero_count;
+  dst->count += src->count;
+
+  if (!isnan(src->min) && (isnan(dst->min) || (dst->min > src->min)))
+    dst->min = src->min;
+  if (!isnan(src->max) && (isnan(dst->max) || (dst->max < src->max)))
+    dst->max = src->max;
+
+  return 0;
+} /* }}} int ddsketch_merge */
+
+uint64_t ddsketch_count(ddsketch_t const *s) /* {{{ */
+{
+  return (s != NULL) ? s->count : 0;
+} /* }}} uint64_t ddsketch_count */
+
+double ddsketch_quantile(ddsketch_t const *s, double q) /* {{{ */
+{
+  double rank;
+  double value;
+  uint64_t n = 0;
+
+  if ((s == NULL) || (s->count == 0) || !(q >= 0.0) || !(q <= 1.0))
+    return NAN;
+
+  /* The extremes are known exactly. */
+  if (q == 0.0)
+    return s->min;
+  if (q == 1.0)
+    return s->max;
+
+  rank = q * ((double)(s->count - 1));
+  value = s->max;
+
+  /* Negative values first, starting with the largest magnitude. */
+  for (int i = s->negative.num - 1; i >= 0; i--) {
+    n += s->negative.counts[i];
+    if (((double)n) > rank) {
+      value = -ddsketch_value(s, s->negative.offset + i);
+      goto found;
+    }
+  }
+
+  n += s->zero_count;
+  if (((double)n) > rank) {
+    value = 0.0;
+    goto found;
+  }
+
+  for (int i = 0; i < s->positive.num; i++) {
+    n += s->positive.counts[i];
+    if (((double)n) > rank) {
+      value = ddsketch_value(s, s->positive.offset + i);
+      goto found;
+    }
+  }
+
+found:
+  if (value < s->min)
+    value = s->min;
+  if (value > s->max)
+    value = s->max;
+  return value;
+} /* }}} double ddsketch_quantile */
@@ -0,0 +1,66 @@
+/**
+ * collectd - src/utils_ddsketch.h
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ **/
+
+#ifndef UTILS_DDSKETCH_H
+#define UTILS_DDSKETCH_H 1
+
+#include "collectd.h"
+
+/*
+ * Quantile sketch after "DDSketch: A Fast and Fully-Mergeable Quantile Sketch
+ * with Relative-Error Guarantees" (Masson, Rim, Lee; VLDB 2019).
+ *
+ * Values are counted in logarithmically sized buckets, so that every quantile
+ * is returned with a relative error of at most the accuracy the sketch was
+ * created with. Sketches with the same accuracy can be merged, e.g. to combine
+ * the sketches of several intervals. The number of buckets per sign is limited
+ * to DDSKETCH_MAX_BUCKETS; if values span a wider range, the lowest buckets
+ * are collapsed, i.e. only low quantiles lose accuracy.
+ */
+
+#ifndef DDSKETCH_MAX_BUCKETS
+#define DDSKETCH_MAX_BUCKETS 2048
+#endif
+
+struct ddsketch_s;
+typedef struct ddsketch_s ddsketch_t;
+
+/* Creates a sketch with the given relative accuracy, e.g. 0.01 for 1%. */
+ddsketch_t *ddsketch_create(double relative_accuracy);
+void ddsketch_destroy(ddsketch_t *s);
+
+void ddsketch_reset(ddsketch_t *s);
+
+/* Adds a value. NaN is ignored. Returns zero on success, ENOMEM otherwise. */
+int ddsketch_add(ddsketch_t *s, double value);
+
+/* Adds all values counted by "src" to "dst". Both sketches must have been
+ * created with the same accuracy, otherwise EINVAL is returned. */
+int ddsketch_merge(ddsketch_t *dst, ddsketch_t const *src);
+
+uint64_t ddsketch_count(ddsketch_t const *s);
+
+/* Returns the value at quantile "q" (0.0 <= q <= 1.0), or NaN if the sketch is
+ * empty or "q" is out of range. */
+double ddsketch_quantile(ddsketch_t const *s, double q);
+
+#endif /* UTILS_DDSKETCH_H */
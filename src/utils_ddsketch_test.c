@@ -0,0 +1,163 @@
+/**
+ * collectd - src/utils_ddsketch_test.c
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include "common.h" /* for STATIC_ARRAY_SIZE */
+#include "collectd.h"
+
+#include "testing.h"
+#include "utils_ddsketch.h"
+
+#define ACCURACY 0.01
+
+/* Checks that "got" is within the sketch's relative accuracy of "want". */
+#define EXPECT_WITHIN_ACCURACY(want, got)                                      \
+  do {                                                                         \
+    double want__ = (double)(want);                                            \
+    double got__ = (double)(got);                                              \
+    double err__ = fabs(got__ - want__);                                       \
+    if (isnan(got__) || (err__ > ACCURACY * fabs(want__) + 1e-9)) {            \
+      printf("not ok %i - %s = %.15g, want %.15g (+/- %g%%)\n",                \
+             ++check_count__, #got, got__, want__, 100.0 * ACCURACY);          \
+      return -1;                                                               \
+    }                                                                          \
+    printf("ok %i - %s = %.15g\n", ++check_count__, #got, got__);              \
+  } while (0)
+
+DEF_TEST(uniform) {
+  double quantiles[] = {0.01, 0.1, 0.25, 0.5, 0.75, 0.9, 0.95, 0.99};
+  ddsketch_t *s;
+
+  CHECK_NOT_NULL(s = ddsketch_create(ACCURACY));
+
+  EXPECT_EQ_UINT64(0, ddsketch_count(s));
+  EXPECT_EQ_DOUBLE(NAN, ddsketch_quantile(s, 0.5));
+
+  for (int i = 1; i <= 1000; i++)
+    CHECK_ZERO(ddsketch_add(s, (double)i));
+  /* NaN is ignored */
+  CHECK_ZERO(ddsketch_add(s, NAN));
+
+  EXPECT_EQ_UINT64(1000, ddsketch_count(s));
+  EXPECT_EQ_DOUBLE(1.0, ddsketch_quantile(s, 0.0));
+  EXPECT_EQ_DOUBLE(1000.0, ddsketch_quantile(s, 1.0));
+  EXPECT_EQ_DOUBLE(NAN, ddsketch_quantile(s, 1.5));
+
+  for (size_t i = 0; i < STATIC_ARRAY_SIZE(quantiles); i++) {
+    double want = 1.0 + floor(quantiles[i] * 999.0);
+    EXPECT_WITHIN_ACCURACY(want, ddsketch_quantile(s, quantiles[i]));
+  }
+
+  ddsketch_reset(s);
+  EXPECT_EQ_UINT64(0, ddsketch_count(s));
+  EXPECT_EQ_DOUBLE(NAN, ddsketch_quantile(s, 0.5));
+
+  CHECK_ZERO(ddsketch_add(s, 42.0));
+  EXPECT_EQ_DOUBLE(42.0, ddsketch_quantile(s, 0.5));
+
+  ddsketch_destroy(s);
+  return 0;
+}
+
+DEF_TEST(signs) {
+  ddsketch_t *s;
+
+  CHECK_NOT_NULL(s = ddsketch_create(ACCURACY));
+
+  /* -100 ... 100 */
+  for (int i = -100; i <= 100; i++)
+    CHECK_ZERO(ddsketch_add(s, (double)i));
+
+  EXPECT_EQ_UINT64(201, ddsketch_count(s));
+  EXPECT_EQ_DOUBLE(-100.0, ddsketch_quantile(s, 0.0));
+  EXPECT_WITHIN_ACCURACY(-50.0, ddsketch_quantile(s, 0.25));
+  EXPECT_EQ_DOUBLE(0.0, ddsketch_quantile(s, 0.5));
+  EXPECT_WITHIN_ACCURACY(50.0, ddsketch_quantile(s, 0.75));
+  EXPECT_EQ_DOUBLE(100.0, ddsketch_quantile(s, 1.0));
+
+  ddsketch_destroy(s);
+  return 0;
+}
+
+DEF_TEST(merge) {
+  ddsketch_t *a;
+  ddsketch_t *b;
+  ddsketch_t *other;
+
+  CHECK_NOT_NULL(a = ddsketch_create(ACCURACY));
+  CHECK_NOT_NULL(b = ddsketch_create(ACCURACY));
+  CHECK_NOT_NULL(other = ddsketch_create(0.05));
+
+  for (int i = 1; i <= 500; i++)
+    CHECK_ZERO(ddsketch_add(a, (double)i));
+  for (int i = 501; i <= 1000; i++)
+    CHECK_ZERO(ddsketch_add(b, (double)i));
+
+  EXPECT_EQ_INT(EINVAL, ddsketch_merge(a, other));
+
+  CHECK_ZERO(ddsketch_merge(a, b));
+  EXPECT_EQ_UINT64(1000, ddsketch_count(a));
+  EXPECT_EQ_UINT64(500, ddsketch_count(b));
+  EXPECT_EQ_DOUBLE(1.0, ddsketch_quantile(a, 0.0));
+  EXPECT_EQ_DOUBLE(1000.0, ddsketch_quantile(a, 1.0));
+  EXPECT_WITHIN_ACCURACY(500.0, ddsketch_quantile(a, 0.5));
+  EXPECT_WITHIN_ACCURACY(990.0, ddsketch_quantile(a, 0.99));
+
+  /* Merging an empty sketch changes nothing. */
+  ddsketch_reset(b);
+  CHECK_ZERO(ddsketch_merge(a, b));
+  EXPECT_EQ_UINT64(1000, ddsketch_count(a));
+  EXPECT_EQ_DOUBLE(1.0, ddsketch_quantile(a, 0.0));
+
+  ddsketch_destroy(other);
+  ddsketch_destroy(b);
+  ddsketch_destroy(a);
+  return 0;
+}
+
+DEF_TEST(wide_range) {
+  ddsketch_t *s;
+
+  CHECK_NOT_NULL(s = ddsketch_create(ACCURACY));
+
+  /* Values spanning 60 orders of magnitude need more buckets than available;
+   * the lowest buckets are collapsed but high quantiles stay accurate. */
+  for (int i = 0; i <= 60; i++)
+    for (int j = 0; j < 10; j++)
+      CHECK_ZERO(ddsketch_add(s, pow(10.0, (double)i)));
+
+  EXPECT_EQ_UINT64(610, ddsketch_count(s));
+  EXPECT_EQ_DOUBLE(1.0, ddsketch_quantile(s, 0.0));
+  EXPECT_WITHIN_ACCURACY(1e50, ddsketch_quantile(s, 0.83));
+  EXPECT_EQ_DOUBLE(1e60, ddsketch_quantile(s, 1.0));
+
+  ddsketch_destroy(s);
+  return 0;
+}
+
+int main(void) {
+  RUN_TEST(uniform);
+  RUN_TEST(signs);
+  RUN_TEST(merge);
+  RUN_TEST(wide_range);
+
+  END_TEST;
+}
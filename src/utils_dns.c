@@ -262,12 +262,14 @@ void dnstop_set_callback(void (*cb)(const rfc1035_header_t *)) {
 }
 
 #define RFC1035_MAXLABELSZ 63
+/* "loop_detect" is the number of compression pointers followed so far. It is
+ * passed along rather than kept in a static variable, because packets may be
+ * parsed by several threads at once. */
 static int rfc1035NameUnpack(const char *buf, size_t sz, off_t *off, char *name,
-                             size_t ns) {
+                             size_t ns, int loop_detect) {
   off_t no = 0;
   unsigned char c;
   size_t len;
-  static int loop_detect = 0;
   if (loop_detect > 2)
     return 4; /* compression loop */
   if (ns == 0)
@@ -293,9 +295,8 @@ static int rfc1035NameUnpack(const char *buf, size_t sz, off_t *off, char *name,
         return 2; /* bad compression ptr */
       if (ptr < DNS_MSG_HDR_SZ)
         return 2; /* bad compression ptr */
-      loop_detect++;
-      rc = rfc1035NameUnpack(buf, sz, &ptr, name + no, ns - no);
-      loop_detect--;
+      rc = rfc1035NameUnpack(buf, sz, &ptr, name + no, ns - no,
+                             loop_detect + 1);
       return rc;
     } else if (c > RFC1035_MAXLABELSZ) {
       /*
@@ -367,7 +368,8 @@ static int handle_dns(const char *buf, int len) {
 
   offset = DNS_MSG_HDR_SZ;
   memset(qh.qname, '\0', MAX_QNAME_SZ);
-  status = rfc1035NameUnpack(buf, len, &offset, qh.qname, MAX_QNAME_SZ);
+  status = rfc1035NameUnpack(buf, len, &offset, qh.qname, MAX_QNAME_SZ,
+                             /* loop_detect = */ 0);
   if (status != 0) {
     INFO("utils_dns: handle_dns: rfc1035NameUnpack failed "
          "with status %i.",
@@ -613,49 +615,57 @@ static int handle_linux_sll(const u_char *pkt, int len) {
 #endif /* DLT_LINUX_SLL */
 
 /* public function */
-void handle_pcap(u_char *udata, const struct pcap_pkthdr *hdr,
-                 const u_char *pkt) {
+int handle_packet(int datalink, const u_char *pkt, int len) {
   int status;
 
-  if (hdr->caplen < ETHER_HDR_LEN)
-    return;
+  /* Longer packets would overflow the buffers used while parsing. */
+  if (len > PCAP_SNAPLEN)
+    len = PCAP_SNAPLEN;
 
-  switch (pcap_datalink(pcap_obj)) {
+  switch (datalink) {
   case DLT_EN10MB:
-    status = handle_ether(pkt, hdr->caplen);
+    status = handle_ether(pkt, len);
     break;
 #if HAVE_NET_IF_PPP_H
   case DLT_PPP:
-    status = handle_ppp(pkt, hdr->caplen);
+    status = handle_ppp(pkt, len);
     break;
 #endif
 #ifdef DLT_LOOP
   case DLT_LOOP:
-    status = handle_loop(pkt, hdr->caplen);
+    status = handle_loop(pkt, len);
     break;
 #endif
 #ifdef DLT_RAW
   case DLT_RAW:
-    status = handle_raw(pkt, hdr->caplen);
+    status = handle_raw(pkt, len);
     break;
 #endif
 #ifdef DLT_LINUX_SLL
   case DLT_LINUX_SLL:
-    status = handle_linux_sll(pkt, hdr->caplen);
+    status = handle_linux_sll(pkt, len);
     break;
 #endif
   case DLT_NULL:
-    status = handle_null(pkt, hdr->caplen);
+    status = handle_null(pkt, len);
     break;
 
   default:
-    ERROR("handle_pcap: unsupported data link type %d",
-          pcap_datalink(pcap_obj));
+    ERROR("handle_packet: unsupported data link type %d", datalink);
     status = 0;
     break;
-  } /* switch (pcap_datalink(pcap_obj)) */
+  } /* switch (datalink) */
+
+  return status;
+} /* int handle_packet */
+
+/* public function */
+void handle_pcap(u_char *udata, const struct pcap_pkthdr *hdr,
+                 const u_char *pkt) {
+  if (hdr->caplen < ETHER_HDR_LEN)
+    return;
 
-  if (0 == status)
+  if (0 == handle_packet(pcap_datalink(pcap_obj), pkt, (int)hdr->caplen))
     return;
 
   query_count_intvl++;
@@ -82,6 +82,12 @@ void ignore_list_add_name(const char *name);
 #if HAVE_PCAP_H
 void handle_pcap(u_char *udata, const struct pcap_pkthdr *hdr,
                  const u_char *pkt);
+
+/* Parses one packet of the given data link type (DLT_*) and calls the
+ * callback for DNS messages. Unlike handle_pcap(), this does not depend on
+ * the pcap object and may be called from several threads at once. Returns
+ * non-zero if the packet was a DNS message. */
+int handle_packet(int datalink, const u_char *pkt, int len);
 #endif
 
 const char *qtype_str(int t);
@@ -0,0 +1,91 @@
+/**
+ * collectd - src/utils_format_bench.c
+ *
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include "collectd.h"
+
+#include "benchmark.h"
+#include "common.h"
+#include "utils_format_graphite.h"
+#include "utils_format_json.h"
+
+static data_source_t dsrc_if_octets[] = {
+    {"rx", DS_TYPE_DERIVE, 0.0, NAN}, {"tx", DS_TYPE_DERIVE, 0.0, NAN},
+};
+static data_set_t ds_if_octets = {"if_octets", 2, dsrc_if_octets};
+
+static value_t values_bench[] = {{.derive = 123456789}, {.derive = 987654}};
+
+static value_list_t vl_bench = {
+    .values = values_bench,
+    .values_len = 2,
+    .time = TIME_T_TO_CDTIME_T_STATIC(1480063672),
+    .interval = TIME_T_TO_CDTIME_T_STATIC(10),
+    .host = "host0042.example.com",
+    .plugin = "interface",
+    .plugin_instance = "eth0",
+    .type = "if_octets",
+    .type_instance = "",
+};
+
+/* Formats one value list as JSON; the buffer is reset once it is full, the
+ * way write_http does it. */
+DEF_BENCH(format_json_value_list) {
+  char buffer[16384];
+  size_t fill = 0;
+  size_t free_size = sizeof(buffer);
+
+  format_json_initialize(buffer, &fill, &free_size);
+  for (uint64_t i = 0; i < b->iterations; i++) {
+    if (format_json_value_list(buffer, &fill, &free_size, &ds_if_octets,
+                               &vl_bench, /* store_rates = */ 0) == 0)
+      continue;
+
+    format_json_initialize(buffer, &fill, &free_size);
+    if (format_json_value_list(buffer, &fill, &free_size, &ds_if_octets,
+                               &vl_bench, /* store_rates = */ 0) != 0) {
+      fprintf(stderr, "format_json_value_list failed on an empty buffer\n");
+      exit(EXIT_FAILURE);
+    }
+  }
+  BENCH_KEEP(fill);
+}
+
+DEF_BENCH(format_graphite) {
+  for (uint64_t i = 0; i < b->iterations; i++) {
+    char buffer[1024];
+
+    format_graphite(buffer, sizeof(buffer), &ds_if_octets, &vl_bench,
+                    /* prefix = */ "collectd.", /* postfix = */ NULL,
+                    /* escape_char = */ '_', GRAPHITE_SEPARATE_INSTANCES);
+    BENCH_KEEP(buffer[0]);
+  }
+}
+
+int main(void) {
+  RUN_BENCH(format_json_value_list, 1, NULL);
+  RUN_BENCH(format_json_value_list, BENCH_THREADS, NULL);
+  RUN_BENCH(format_graphite, 1, NULL);
+  RUN_BENCH(format_graphite, BENCH_THREADS, NULL);
+
+  return 0;
+}
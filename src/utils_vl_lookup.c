@@ -47,6 +47,16 @@ kstat_ctl_t *kc;
   } while (0)
 #endif
 
+/* Initial number of buckets of the hash tables; always a power of two. */
+#define LU_HASH_INITIAL_SIZE 64
+
+/* Upper bound for the number of memoized series. When it is reached, the memo
+ * is cleared and rebuilt from the series still seen, so that series which
+ * disappeared don't accumulate. */
+#ifndef LU_MEMO_MAX_ENTRIES
+#define LU_MEMO_MAX_ENTRIES (1 << 22)
+#endif
+
 /*
  * Types
  */
@@ -68,15 +78,6 @@ struct identifier_match_s {
 };
 typedef struct identifier_match_s identifier_match_t;
 
-struct lookup_s {
-  c_avl_tree_t *by_type_tree;
-
-  lookup_class_callback_t cb_user_class;
-  lookup_obj_callback_t cb_user_obj;
-  lookup_free_class_callback_t cb_free_class;
-  lookup_free_obj_callback_t cb_free_obj;
-};
-
 struct user_obj_s;
 typedef struct user_obj_s user_obj_t;
 struct user_obj_s {
@@ -84,6 +85,9 @@ struct user_obj_s {
   lookup_identifier_t ident;
 
   user_obj_t *next;
+
+  uint64_t hash; /* of the grouped fields, see lu_obj_hash() */
+  user_obj_t *hash_next;
 };
 
 struct user_class_s {
@@ -91,9 +95,51 @@ struct user_class_s {
   void *user_class;
   identifier_match_t match;
   user_obj_t *user_obj_list; /* list of user_obj */
+
+  /* user_obj_list, hashed by the grouped fields */
+  user_obj_t **obj_table;
+  size_t obj_table_size;
+  size_t obj_num;
 };
 typedef struct user_class_s user_class_t;
 
+/* A user class matching a series and the series' user object. */
+struct lu_match_s {
+  user_class_t *user_class;
+  user_obj_t *user_obj;
+};
+typedef struct lu_match_s lu_match_t;
+
+/* Memoized result of matching one series against all user classes. */
+struct lu_memo_entry_s;
+typedef struct lu_memo_entry_s lu_memo_entry_t;
+struct lu_memo_entry_s {
+  uint64_t hash;
+  lu_memo_entry_t *next;
+
+  lu_match_t *matches;
+  size_t matches_num;
+
+  size_t key_len;
+  char key[]; /* see lu_memo_key() */
+};
+
+struct lookup_s {
+  c_avl_tree_t *by_type_tree;
+
+  lookup_class_callback_t cb_user_class;
+  lookup_obj_callback_t cb_user_obj;
+  lookup_free_class_callback_t cb_free_class;
+  lookup_free_obj_callback_t cb_free_obj;
+
+  /* Series identifier -> matching user classes and objects. Cleared whenever
+   * a user class is added. */
+  pthread_rwlock_t memo_lock;
+  lu_memo_entry_t **memo_table;
+  size_t memo_table_size;
+  size_t memo_num;
+};
+
 struct user_class_list_s;
 typedef struct user_class_list_s user_class_list_t;
 struct user_class_list_s {
@@ -110,6 +156,32 @@ typedef struct by_type_entry_s by_type_entry_t;
 /*
  * Private functions
  */
+#define LU_HASH_INIT UINT64_C(14695981039346656037)
+
+/* FNV-1a, including the terminating null byte so that the concatenation of
+ * several strings is unambiguous. */
+static uint64_t lu_hash_string(uint64_t hash, char const *str) /* {{{ */
+{
+  do {
+    hash ^= (uint64_t)(unsigned char)*str;
+    hash *= UINT64_C(1099511628211);
+  } while (*(str++) != 0);
+
+  return hash;
+} /* }}} uint64_t lu_hash_string */
+
+static uint64_t lu_hash_buffer(char const *buf, size_t len) /* {{{ */
+{
+  uint64_t hash = LU_HASH_INIT;
+
+  for (size_t i = 0; i < len; i++) {
+    hash ^= (uint64_t)(unsigned char)buf[i];
+    hash *= UINT64_C(1099511628211);
+  }
+
+  return hash;
+} /* }}} uint64_t lu_hash_buffer */
+
 static _Bool lu_part_matches(part_match_t const *match, /* {{{ */
                              char const *str) {
   if (match->is_regex) {
@@ -186,6 +258,27 @@ static int lu_copy_ident_to_match(identifier_match_t *match, /* {{{ */
   return 0;
 } /* }}} int lu_copy_ident_to_match */
 
+/* Hashes the fields which distinguish the user objects of "user_class", i.e.
+ * the fields matched by a regular expression and grouped by. All other fields
+ * are the same for all user objects of the class. */
+static uint64_t lu_obj_hash(user_class_t const *user_class, /* {{{ */
+                            value_list_t const *vl) {
+  identifier_match_t const *m = &user_class->match;
+  uint64_t hash = LU_HASH_INIT;
+
+  if (m->host.is_regex && (m->group_by & LU_GROUP_BY_HOST))
+    hash = lu_hash_string(hash, vl->host);
+  if (m->plugin.is_regex && (m->group_by & LU_GROUP_BY_PLUGIN))
+    hash = lu_hash_string(hash, vl->plugin);
+  if (m->plugin_instance.is_regex &&
+      (m->group_by & LU_GROUP_BY_PLUGIN_INSTANCE))
+    hash = lu_hash_string(hash, vl->plugin_instance);
+  if (m->type_instance.is_regex && (m->group_by & LU_GROUP_BY_TYPE_INSTANCE))
+    hash = lu_hash_string(hash, vl->type_instance);
+
+  return hash;
+} /* }}} uint64_t lu_obj_hash */
+
 /* user_class->lock must be held when calling this function */
 static void *lu_create_user_obj(lookup_t *obj, /* {{{ */
                                 data_set_t const *ds, value_list_t const *vl,
@@ -224,6 +317,42 @@ static void *lu_create_user_obj(lookup_t *obj, /* {{{ */
 
 #undef COPY_FIELD
 
+  /* Grow the hash table when the load factor exceeds one. */
+  if (user_class->obj_num >= user_class->obj_table_size) {
+    size_t new_size = (user_class->obj_table_size == 0)
+                          ? LU_HASH_INITIAL_SIZE
+                          : 2 * user_class->obj_table_size;
+    user_obj_t **new_table = calloc(new_size, sizeof(*new_table));
+
+    if (new_table != NULL) {
+      for (user_obj_t *ptr = user_class->user_obj_list; ptr != NULL;
+           ptr = ptr->next) {
+        size_t idx = (size_t)(ptr->hash & (new_size - 1));
+        ptr->hash_next = new_table[idx];
+        new_table[idx] = ptr;
+      }
+      sfree(user_class->obj_table);
+      user_class->obj_table = new_table;
+      user_class->obj_table_size = new_size;
+    } else if (user_class->obj_table == NULL) {
+      ERROR("utils_vl_lookup: calloc failed.");
+      if (obj->cb_free_obj != NULL)
+        obj->cb_free_obj(user_obj->user_obj);
+      sfree(user_obj);
+      return NULL;
+    }
+    /* else: keep using the smaller table. */
+  }
+
+  user_obj->hash = lu_obj_hash(user_class, vl);
+  {
+    size_t idx =
+        (size_t)(user_obj->hash & (user_class->obj_table_size - 1));
+    user_obj->hash_next = user_class->obj_table[idx];
+    user_class->obj_table[idx] = user_obj;
+  }
+  user_class->obj_num++;
+
   if (user_class->user_obj_list == NULL) {
     user_class->user_obj_list = user_obj;
   } else {
@@ -240,8 +369,16 @@ static void *lu_create_user_obj(lookup_t *obj, /* {{{ */
 static user_obj_t *lu_find_user_obj(user_class_t *user_class, /* {{{ */
                                     value_list_t const *vl) {
   user_obj_t *ptr;
+  uint64_t hash;
+
+  if (user_class->obj_table == NULL)
+    return NULL;
 
-  for (ptr = user_class->user_obj_list; ptr != NULL; ptr = ptr->next) {
+  hash = lu_obj_hash(user_class, vl);
+  for (ptr = user_class->obj_table[hash & (user_class->obj_table_size - 1)];
+       ptr != NULL; ptr = ptr->hash_next) {
+    if (ptr->hash != hash)
+      continue;
     if (user_class->match.host.is_regex &&
         (user_class->match.group_by & LU_GROUP_BY_HOST) &&
         (strcmp(vl->host, ptr->ident.host) != 0))
@@ -265,11 +402,13 @@ static user_obj_t *lu_find_user_obj(user_class_t *user_class, /* {{{ */
   return NULL;
 } /* }}} user_obj_t *lu_find_user_obj */
 
-static int lu_handle_user_class(lookup_t *obj, /* {{{ */
-                                data_set_t const *ds, value_list_t const *vl,
-                                user_class_t *user_class) {
+/* Checks whether "vl" matches "user_class" and, if so, looks up or creates
+ * the user object. Returns zero on match, one if the value list does not
+ * match and less than zero on error. */
+static int lu_match_user_class(lookup_t *obj, /* {{{ */
+                               data_set_t const *ds, value_list_t const *vl,
+                               user_class_t *user_class, lu_match_t *ret) {
   user_obj_t *user_obj;
-  int status;
 
   assert(strcmp(vl->type, user_class->match.type.str) == 0);
   assert(user_class->match.plugin.is_regex ||
@@ -295,39 +434,200 @@ static int lu_handle_user_class(lookup_t *obj, /* {{{ */
   }
   pthread_mutex_unlock(&user_class->lock);
 
-  status = obj->cb_user_obj(ds, vl, user_class->user_class, user_obj->user_obj);
-  if (status != 0) {
-    ERROR("utils_vl_lookup: The user object callback failed with status %i.",
-          status);
-    /* Returning a negative value means: abort! */
+  ret->user_class = user_class;
+  ret->user_obj = user_obj;
+  return 0;
+} /* }}} int lu_match_user_class */
+
+/* Appends the matching user classes of "user_class_list" to "*matches". */
+static int lu_match_user_class_list(lookup_t *obj, /* {{{ */
+                                    data_set_t const *ds,
+                                    value_list_t const *vl,
+                                    user_class_list_t *user_class_list,
+                                    lu_match_t **matches,
+                                    size_t *matches_num) {
+  for (user_class_list_t *ptr = user_class_list; ptr != NULL;
+       ptr = ptr->next) {
+    lu_match_t m;
+    lu_match_t *tmp;
+    int status;
+
+    status = lu_match_user_class(obj, ds, vl, &ptr->entry, &m);
     if (status < 0)
       return status;
-    else
-      return 1;
+    else if (status != 0)
+      continue;
+
+    tmp = realloc(*matches, (*matches_num + 1) * sizeof(**matches));
+    if (tmp == NULL) {
+      ERROR("utils_vl_lookup: realloc failed.");
+      return -1;
+    }
+    *matches = tmp;
+    (*matches)[*matches_num] = m;
+    (*matches_num)++;
   }
 
   return 0;
-} /* }}} int lu_handle_user_class */
+} /* }}} int lu_match_user_class_list */
 
-static int lu_handle_user_class_list(lookup_t *obj, /* {{{ */
-                                     data_set_t const *ds,
-                                     value_list_t const *vl,
-                                     user_class_list_t *user_class_list) {
-  user_class_list_t *ptr;
+/* Calls the user object callback for each match. Returns the number of
+ * successful calls or less than zero if a callback asked to abort. */
+static int lu_handle_matches(lookup_t *obj, /* {{{ */
+                             data_set_t const *ds, value_list_t const *vl,
+                             lu_match_t const *matches, size_t matches_num) {
   int retval = 0;
 
-  for (ptr = user_class_list; ptr != NULL; ptr = ptr->next) {
-    int status;
-
-    status = lu_handle_user_class(obj, ds, vl, &ptr->entry);
-    if (status < 0)
-      return status;
-    else if (status == 0)
-      retval++;
+  for (size_t i = 0; i < matches_num; i++) {
+    int status = obj->cb_user_obj(ds, vl, matches[i].user_class->user_class,
+                                  matches[i].user_obj->user_obj);
+    if (status != 0) {
+      ERROR("utils_vl_lookup: The user object callback failed with status %i.",
+            status);
+      /* Returning a negative value means: abort! */
+      if (status < 0)
+        return status;
+      continue;
+    }
+    retval++;
   }
 
   return retval;
-} /* }}} int lu_handle_user_class_list */
+} /* }}} int lu_handle_matches */
+
+/* Serializes the identifier of "vl" into "buffer": the five fields, each
+ * followed by a null byte. Returns the number of bytes used. */
+static size_t lu_memo_key(value_list_t const *vl, /* {{{ */
+                          char *buffer, size_t buffer_size) {
+  char const *fields[] = {vl->host, vl->plugin, vl->plugin_instance, vl->type,
+                          vl->type_instance};
+  size_t len = 0;
+
+  for (size_t i = 0; i < STATIC_ARRAY_SIZE(fields); i++) {
+    size_t field_len = strnlen(fields[i], DATA_MAX_NAME_LEN - 1);
+
+    assert(len + field_len + 1 <= buffer_size);
+    memcpy(buffer + len, fields[i], field_len);
+    len += field_len;
+    buffer[len] = 0;
+    len++;
+  }
+
+  return len;
+} /* }}} size_t lu_memo_key */
+
+/* obj->memo_lock must be held when calling this function */
+static lu_memo_entry_t *lu_memo_find(lookup_t *obj, /* {{{ */
+                                     uint64_t hash, char const *key,
+                                     size_t key_len) {
+  if (obj->memo_table == NULL)
+    return NULL;
+
+  for (lu_memo_entry_t *e = obj->memo_table[hash & (obj->memo_table_size - 1)];
+       e != NULL; e = e->next) {
+    if ((e->hash == hash) && (e->key_len == key_len) &&
+        (memcmp(e->key, key, key_len) == 0))
+      return e;
+  }
+
+  return NULL;
+} /* }}} lu_memo_entry_t *lu_memo_find */
+
+/* obj->memo_lock must be held for writing when calling this function */
+static void lu_memo_clear(lookup_t *obj) /* {{{ */
+{
+  for (size_t i = 0; i < obj->memo_table_size; i++) {
+    lu_memo_entry_t *e = obj->memo_table[i];
+
+    while (e != NULL) {
+      lu_memo_entry_t *next = e->next;
+      sfree(e->matches);
+      sfree(e);
+      e = next;
+    }
+  }
+
+  sfree(obj->memo_table);
+  obj->memo_table_size = 0;
+  obj->memo_num = 0;
+} /* }}} void lu_memo_clear */
+
+/* Remembers the matches of a series. Failing to do so is not an error: the
+ * series will simply be matched again next time. */
+static void lu_memo_insert(lookup_t *obj, /* {{{ */
+                           uint64_t hash, char const *key, size_t key_len,
+                           lu_match_t const *matches, size_t matches_num) {
+  lu_memo_entry_t *e;
+  size_t idx;
+
+  e = calloc(1, sizeof(*e) + key_len);
+  if (e == NULL)
+    return;
+
+  if (matches_num > 0) {
+    e->matches = malloc(matches_num * sizeof(*e->matches));
+    if (e->matches == NULL) {
+      sfree(e);
+      return;
+    }
+    memcpy(e->matches, matches, matches_num * sizeof(*e->matches));
+  }
+  e->matches_num = matches_num;
+  e->hash = hash;
+  e->key_len = key_len;
+  memcpy(e->key, key, key_len);
+
+  pthread_rwlock_wrlock(&obj->memo_lock);
+
+  /* Another thread may have added this series in the meantime. */
+  if (lu_memo_find(obj, hash, key, key_len) != NULL) {
+    pthread_rwlock_unlock(&obj->memo_lock);
+    sfree(e->matches);
+    sfree(e);
+    return;
+  }
+
+  if (obj->memo_num >= LU_MEMO_MAX_ENTRIES) {
+    DEBUG("utils_vl_lookup: Memo is full (%zu entries), clearing it.",
+          obj->memo_num);
+    lu_memo_clear(obj);
+  }
+
+  /* Grow the hash table when the load factor exceeds one. */
+  if (obj->memo_num >= obj->memo_table_size) {
+    size_t new_size = (obj->memo_table_size == 0) ? LU_HASH_INITIAL_SIZE
+                                                   : 2 * obj->memo_table_size;
+    lu_memo_entry_t **new_table = calloc(new_size, sizeof(*new_table));
+
+    if (new_table != NULL) {
+      for (size_t i = 0; i < obj->memo_table_size; i++) {
+        lu_memo_entry_t *ptr = obj->memo_table[i];
+        while (ptr != NULL) {
+          lu_memo_entry_t *next = ptr->next;
+          idx = (size_t)(ptr->hash & (new_size - 1));
+          ptr->next = new_table[idx];
+          new_table[idx] = ptr;
+          ptr = next;
+        }
+      }
+      sfree(obj->memo_table);
+      obj->memo_table = new_table;
+      obj->memo_table_size = new_size;
+    } else if (obj->memo_table == NULL) {
+      pthread_rwlock_unlock(&obj->memo_lock);
+      sfree(e->matches);
+      sfree(e);
+      return;
+    }
+  }
+
+  idx = (size_t)(hash & (obj->memo_table_size - 1));
+  e->next = obj->memo_table[idx];
+  obj->memo_table[idx] = e;
+  obj->memo_num++;
+
+  pthread_rwlock_unlock(&obj->memo_lock);
+} /* }}} void lu_memo_insert */
 
 static by_type_entry_t *lu_search_by_type(lookup_t *obj, /* {{{ */
                                           char const *type,
@@ -477,6 +777,9 @@ static void lu_destroy_user_class_list(lookup_t *obj, /* {{{ */
 
     lu_destroy_user_obj(obj, user_class_list->entry.user_obj_list);
     user_class_list->entry.user_obj_list = NULL;
+    sfree(user_class_list->entry.obj_table);
+    user_class_list->entry.obj_table_size = 0;
+    user_class_list->entry.obj_num = 0;
     pthread_mutex_destroy(&user_class_list->entry.lock);
 
     sfree(user_class_list);
@@ -537,6 +840,8 @@ lookup_t *lookup_create(lookup_class_callback_t cb_user_class, /* {{{ */
   obj->cb_free_class = cb_free_class;
   obj->cb_free_obj = cb_free_obj;
 
+  pthread_rwlock_init(&obj->memo_lock, /* attr = */ NULL);
+
   return obj;
 } /* }}} lookup_t *lookup_create */
 
@@ -547,6 +852,12 @@ void lookup_destroy(lookup_t *obj) /* {{{ */
   if (obj == NULL)
     return;
 
+  /* The memo points into the user classes; free it first. */
+  pthread_rwlock_wrlock(&obj->memo_lock);
+  lu_memo_clear(obj);
+  pthread_rwlock_unlock(&obj->memo_lock);
+  pthread_rwlock_destroy(&obj->memo_lock);
+
   while (42) {
     char *type = NULL;
     by_type_entry_t *by_type = NULL;
@@ -572,6 +883,11 @@ int lookup_add(lookup_t *obj, /* {{{ */
   by_type_entry_t *by_type = NULL;
   user_class_list_t *user_class_obj;
 
+  /* Series may match the new class, so forget what is known about them. */
+  pthread_rwlock_wrlock(&obj->memo_lock);
+  lu_memo_clear(obj);
+  pthread_rwlock_unlock(&obj->memo_lock);
+
   by_type = lu_search_by_type(obj, ident->type, /* allocate = */ 1);
   if (by_type == NULL)
     return -1;
@@ -593,34 +909,60 @@ int lookup_add(lookup_t *obj, /* {{{ */
 /* returns the number of successful calls to the callback function */
 int lookup_search(lookup_t *obj, /* {{{ */
                   data_set_t const *ds, value_list_t const *vl) {
+  char key[5 * DATA_MAX_NAME_LEN];
+  size_t key_len;
+  uint64_t hash;
+  lu_memo_entry_t *memo;
   by_type_entry_t *by_type = NULL;
   user_class_list_t *user_class_list = NULL;
-  int retval = 0;
+  lu_match_t *matches = NULL;
+  size_t matches_num = 0;
   int status;
 
   if ((obj == NULL) || (ds == NULL) || (vl == NULL))
     return -EINVAL;
 
-  by_type = lu_search_by_type(obj, vl->type, /* allocate = */ 0);
-  if (by_type == NULL)
-    return 0;
+  key_len = lu_memo_key(vl, key, sizeof(key));
+  hash = lu_hash_buffer(key, key_len);
 
-  status =
-      c_avl_get(by_type->by_plugin_tree, vl->plugin, (void *)&user_class_list);
-  if (status == 0) {
-    status = lu_handle_user_class_list(obj, ds, vl, user_class_list);
-    if (status < 0)
-      return status;
-    retval += status;
+  /* Fast path: this series has been matched before. */
+  pthread_rwlock_rdlock(&obj->memo_lock);
+  memo = lu_memo_find(obj, hash, key, key_len);
+  if (memo != NULL) {
+    status = lu_handle_matches(obj, ds, vl, memo->matches, memo->matches_num);
+    pthread_rwlock_unlock(&obj->memo_lock);
+    return status;
   }
+  pthread_rwlock_unlock(&obj->memo_lock);
 
-  if (by_type->wildcard_plugin_list != NULL) {
-    status =
-        lu_handle_user_class_list(obj, ds, vl, by_type->wildcard_plugin_list);
-    if (status < 0)
-      return status;
-    retval += status;
+  by_type = lu_search_by_type(obj, vl->type, /* allocate = */ 0);
+  if (by_type != NULL) {
+    status = c_avl_get(by_type->by_plugin_tree, vl->plugin,
+                       (void *)&user_class_list);
+    if (status == 0) {
+      status = lu_match_user_class_list(obj, ds, vl, user_class_list,
+                                        &matches, &matches_num);
+      if (status < 0) {
+        sfree(matches);
+        return status;
+      }
+    }
+
+    if (by_type->wildcard_plugin_list != NULL) {
+      status = lu_match_user_class_list(obj, ds, vl,
+                                        by_type->wildcard_plugin_list,
+                                        &matches, &matches_num);
+      if (status < 0) {
+        sfree(matches);
+        return status;
+      }
+    }
   }
 
-  return retval;
+  /* Series that don't match anything are remembered, too. */
+  lu_memo_insert(obj, hash, key, key_len, matches, matches_num);
+
+  status = lu_handle_matches(obj, ds, vl, matches, matches_num);
+  sfree(matches);
+  return status;
 } /* }}} lookup_search */
@@ -0,0 +1,117 @@
+/**
+ * collectd - src/utils_vl_lookup_bench.c
+ *
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include "collectd.h"
+
+#include "benchmark.h"
+#include "common.h"
+#include "utils_vl_lookup.h"
+
+/* Number of distinct value lists looked up. */
+#define SERIES_NUM 10000
+
+static data_source_t dsrc_gauge = {"value", DS_TYPE_GAUGE, 0.0, NAN};
+static data_set_t const ds_gauge = {"gauge", 1, &dsrc_gauge};
+
+static value_list_t series[SERIES_NUM];
+
+static void *class_callback(data_set_t const *ds, value_list_t const *vl,
+                            void *user_class) {
+  return calloc(1, sizeof(uint64_t));
+}
+
+static int obj_callback(data_set_t const *ds, value_list_t const *vl,
+                        void *user_class, void *user_obj) {
+  return 0;
+}
+
+static void free_callback(void *ptr) { free(ptr); }
+
+/* Searches the lookup tree the way the aggregation plugin does for every
+ * value list. */
+static void search(bench_t *b) {
+  lookup_t *obj = b->arg;
+  size_t k = b->thread * (SERIES_NUM / b->threads_num);
+
+  for (uint64_t i = 0; i < b->iterations; i++) {
+    BENCH_KEEP(lookup_search(obj, &ds_gauge, series + k));
+    k = (k + 1) % SERIES_NUM;
+  }
+}
+
+/* One class matching everything, grouped by host and plugin instance. */
+DEF_BENCH(lookup_search_1_class) { search(b); }
+
+/* One class per plugin plus a catch-all class; each value list matches two
+ * classes. */
+DEF_BENCH(lookup_search_21_classes) { search(b); }
+
+static lookup_t *create_lookup(size_t classes) {
+  lookup_t *obj =
+      lookup_create(class_callback, obj_callback, free_callback, free_callback);
+
+  for (size_t i = 0; i < classes; i++) {
+    lookup_identifier_t ident = {.host = "/.*/", .type = "gauge"};
+
+    /* One class per plugin, the last one matching all plugins. */
+    if (i + 1 < classes)
+      snprintf(ident.plugin, sizeof(ident.plugin), "plugin%02zu", i);
+    else
+      sstrncpy(ident.plugin, "/.*/", sizeof(ident.plugin));
+    sstrncpy(ident.plugin_instance, "/.*/", sizeof(ident.plugin_instance));
+    sstrncpy(ident.type_instance, "/.*/", sizeof(ident.type_instance));
+
+    lookup_add(obj, &ident, LU_GROUP_BY_HOST | LU_GROUP_BY_PLUGIN_INSTANCE,
+               calloc(1, sizeof(uint64_t)));
+  }
+
+  return obj;
+}
+
+int main(void) {
+  lookup_t *one;
+  lookup_t *many;
+
+  for (size_t i = 0; i < SERIES_NUM; i++) {
+    value_list_t *vl = series + i;
+
+    *vl = (value_list_t)VALUE_LIST_INIT;
+    snprintf(vl->host, sizeof(vl->host), "host%04zu", i % 100);
+    snprintf(vl->plugin, sizeof(vl->plugin), "plugin%02zu", i % 20);
+    snprintf(vl->plugin_instance, sizeof(vl->plugin_instance), "%zu", i % 8);
+    sstrncpy(vl->type, "gauge", sizeof(vl->type));
+    snprintf(vl->type_instance, sizeof(vl->type_instance), "ti%zu", i);
+  }
+
+  one = create_lookup(1);
+  many = create_lookup(21);
+
+  RUN_BENCH(lookup_search_1_class, 1, one);
+  RUN_BENCH(lookup_search_1_class, BENCH_THREADS, one);
+  RUN_BENCH(lookup_search_21_classes, 1, many);
+  RUN_BENCH(lookup_search_21_classes, BENCH_THREADS, many);
+
+  lookup_destroy(one);
+  lookup_destroy(many);
+  return 0;
+}
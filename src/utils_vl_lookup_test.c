@@ -231,12 +231,66 @@ DEF_TEST(regex) {
   return 0;
 }
 
+DEF_TEST(many_objects) {
+  lookup_t *obj;
+  CHECK_NOT_NULL(obj = lookup_create(lookup_class_callback, lookup_obj_callback,
+                                     (void *)free, (void *)free));
+
+  checked_lookup_add(obj, "/.*/", "test", "/.*/", "test", "/.*/",
+                     LU_GROUP_BY_HOST | LU_GROUP_BY_TYPE_INSTANCE);
+
+  /* Enough objects and series to make the hash tables grow. */
+  for (int i = 0; i < 2; i++) {
+    for (int j = 0; j < 300; j++) {
+      char host[DATA_MAX_NAME_LEN];
+      snprintf(host, sizeof(host), "host%d", j);
+
+      EXPECT_EQ_INT(1, checked_lookup_search(obj, host, "test", "0", "test",
+                                             "ti", /* expect new = */ i == 0));
+      EXPECT_EQ_STR(host, last_obj_ident.host);
+      EXPECT_EQ_INT(1, checked_lookup_search(obj, host, "test", "1", "test",
+                                             "ti", /* expect new = */ 0));
+      EXPECT_EQ_STR(host, last_obj_ident.host);
+    }
+  }
+
+  lookup_destroy(obj);
+  return 0;
+}
+
+DEF_TEST(add_after_search) {
+  lookup_t *obj;
+  CHECK_NOT_NULL(obj = lookup_create(lookup_class_callback, lookup_obj_callback,
+                                     (void *)free, (void *)free));
+
+  checked_lookup_add(obj, "/.*/", "plugin0", "", "test", "/.*/",
+                     LU_GROUP_BY_HOST);
+
+  EXPECT_EQ_INT(0, checked_lookup_search(obj, "host0", "plugin1", "", "test",
+                                         "", /* expect new = */ 0));
+  EXPECT_EQ_INT(1, checked_lookup_search(obj, "host0", "plugin0", "", "test",
+                                         "", /* expect new = */ 1));
+
+  /* Previous results must not hide the new class. */
+  checked_lookup_add(obj, "/.*/", "/.*/", "", "test", "", LU_GROUP_BY_HOST);
+
+  EXPECT_EQ_INT(1, checked_lookup_search(obj, "host0", "plugin1", "", "test",
+                                         "", /* expect new = */ 1));
+  EXPECT_EQ_INT(2, checked_lookup_search(obj, "host0", "plugin0", "", "test",
+                                         "", /* expect new = */ 0));
+
+  lookup_destroy(obj);
+  return 0;
+}
+
 int main(int argc, char **argv) /* {{{ */
 {
   RUN_TEST(group_by_specific_host);
   RUN_TEST(group_by_any_host);
   RUN_TEST(multiple_lookups);
   RUN_TEST(regex);
+  RUN_TEST(many_objects);
+  RUN_TEST(add_after_search);
 
   END_TEST;
 } /* }}} int main */
@@ -38,6 +38,15 @@
 
 #include <mongoc.h>
 
+struct wm_batch_s {
+  char plugin[DATA_MAX_NAME_LEN];
+  mongoc_collection_t *collection;
+  mongoc_bulk_operation_t *bulk;
+  int records_num;
+  cdtime_t since;
+};
+typedef struct wm_batch_s wm_batch_t;
+
 struct wm_node_s {
   char name[DATA_MAX_NAME_LEN];
 
@@ -52,38 +61,32 @@ struct wm_node_s {
 
   _Bool store_rates;
   _Bool connected;
+  int batch_size;
+  cdtime_t batch_flush_timeout;
 
   mongoc_client_t *client;
   mongoc_database_t *database;
   pthread_mutex_t lock;
+
+  /* One pending bulk insert per collection, i.e. per plugin. */
+  wm_batch_t *batches;
+  size_t batches_num;
+
+  /* Reused for building the documents, to avoid allocating a buffer for
+   * every value list. */
+  bson_t *record;
 };
 typedef struct wm_node_s wm_node_t;
 
 /*
  * Functions
  */
-static bson_t *wm_create_bson(const data_set_t *ds, /* {{{ */
-                              const value_list_t *vl, _Bool store_rates) {
-  bson_t *ret;
+/* Fills "ret" with the document for "vl". "rates" must be non-NULL if
+ * "store_rates" is true. */
+static int wm_create_bson(bson_t *ret, const data_set_t *ds, /* {{{ */
+                          const value_list_t *vl, _Bool store_rates,
+                          gauge_t const *rates) {
   bson_t subarray;
-  gauge_t *rates;
-
-  ret = bson_new();
-  if (!ret) {
-    ERROR("write_mongodb plugin: bson_new failed.");
-    return NULL;
-  }
-
-  if (store_rates) {
-    rates = uc_get_rate(ds, vl);
-    if (rates == NULL) {
-      ERROR("write_mongodb plugin: uc_get_rate() failed.");
-      bson_free(ret);
-      return NULL;
-    }
-  } else {
-    rates = NULL;
-  }
 
   BSON_APPEND_DATE_TIME(ret, "timestamp", CDTIME_T_TO_MS(vl->time));
   BSON_APPEND_UTF8(ret, "host", vl->host);
@@ -111,8 +114,7 @@ static bson_t *wm_create_bson(const data_set_t *ds, /* {{{ */
     else {
       ERROR("write_mongodb plugin: Unknown ds_type %d for index %d",
             ds->ds[i].type, i);
-      bson_free(ret);
-      return NULL;
+      return -1;
     }
   }
   bson_append_array_end(ret, &subarray); /* }}} values */
@@ -139,18 +141,35 @@ static bson_t *wm_create_bson(const data_set_t *ds, /* {{{ */
   }
   bson_append_array_end(ret, &subarray); /* }}} dsnames */
 
-  sfree(rates);
-
   size_t error_location;
   if (!bson_validate(ret, BSON_VALIDATE_UTF8, &error_location)) {
     ERROR("write_mongodb plugin: Error in generated BSON document "
         "at byte %zu", error_location);
-    bson_free(ret);
-    return NULL;
+    return -1;
   }
 
-  return ret;
-} /* }}} bson *wm_create_bson */
+  return 0;
+} /* }}} int wm_create_bson */
+
+/* Drops all pending batches and the connection. */
+static void wm_disconnect(wm_node_t *node) /* {{{ */
+{
+  for (size_t i = 0; i < node->batches_num; i++) {
+    wm_batch_t *batch = node->batches + i;
+
+    if (batch->bulk != NULL)
+      mongoc_bulk_operation_destroy(batch->bulk);
+    mongoc_collection_destroy(batch->collection);
+  }
+  sfree(node->batches);
+  node->batches_num = 0;
+
+  mongoc_database_destroy(node->database);
+  mongoc_client_destroy(node->client);
+  node->database = NULL;
+  node->client = NULL;
+  node->connected = 0;
+} /* }}} void wm_disconnect */
 
 static int wm_initialize(wm_node_t *node) /* {{{ */
 {
@@ -231,68 +250,169 @@ static int wm_initialize(wm_node_t *node) /* {{{ */
   return 0;
 } /* }}} int wm_initialize */
 
+/* Returns the batch for the collection of "plugin", creating it if
+ * necessary. */
+static wm_batch_t *wm_get_batch(wm_node_t *node, /* {{{ */
+                                const char *plugin) {
+  wm_batch_t *batch;
+
+  for (size_t i = 0; i < node->batches_num; i++)
+    if (strcmp(node->batches[i].plugin, plugin) == 0)
+      return node->batches + i;
+
+  batch = realloc(node->batches, (node->batches_num + 1) * sizeof(*batch));
+  if (batch == NULL) {
+    ERROR("write_mongodb plugin: realloc failed.");
+    return NULL;
+  }
+  node->batches = batch;
+
+  batch = node->batches + node->batches_num;
+  memset(batch, 0, sizeof(*batch));
+  sstrncpy(batch->plugin, plugin, sizeof(batch->plugin));
+
+  batch->collection =
+      mongoc_client_get_collection(node->client, "collectd", plugin);
+  if (batch->collection == NULL) {
+    ERROR("write_mongodb plugin: error creating/getting collection");
+    return NULL;
+  }
+
+  node->batches_num++;
+  return batch;
+} /* }}} wm_batch_t *wm_get_batch */
+
+/* Executes the pending bulk insert of "batch". The caller must hold
+ * node->lock. On failure the connection is dropped. */
+static int wm_flush_batch(wm_node_t *node, wm_batch_t *batch) /* {{{ */
+{
+  bson_t reply;
+  bson_error_t error;
+  uint32_t status;
+
+  if (batch->bulk == NULL)
+    return 0;
+
+  status = mongoc_bulk_operation_execute(batch->bulk, &reply, &error);
+  bson_destroy(&reply);
+  mongoc_bulk_operation_destroy(batch->bulk);
+  batch->bulk = NULL;
+
+  if (!status) {
+    ERROR("write_mongodb plugin: error inserting %i record(s): %s",
+          batch->records_num, error.message);
+    batch->records_num = 0;
+    wm_disconnect(node);
+    return -1;
+  }
+
+  batch->records_num = 0;
+  return 0;
+} /* }}} int wm_flush_batch */
+
 static int wm_write(const data_set_t *ds, /* {{{ */
                     const value_list_t *vl, user_data_t *ud) {
   wm_node_t *node = ud->data;
-  mongoc_collection_t *collection = NULL;
-  bson_t *bson_record;
-  bson_error_t error;
+  gauge_t *rates = NULL;
+  wm_batch_t *batch;
+  cdtime_t now;
   int status;
 
-  bson_record = wm_create_bson(ds, vl, node->store_rates);
-  if (!bson_record) {
+  if (node->store_rates) {
+    rates = uc_get_rate(ds, vl);
+    if (rates == NULL) {
+      ERROR("write_mongodb plugin: uc_get_rate() failed.");
+      return -1;
+    }
+  }
+
+  pthread_mutex_lock(&node->lock);
+
+  bson_reinit(node->record);
+  status = wm_create_bson(node->record, ds, vl, node->store_rates, rates);
+  sfree(rates);
+  if (status != 0) {
     ERROR("write_mongodb plugin: error making insert bson");
+    pthread_mutex_unlock(&node->lock);
     return -1;
   }
 
-  pthread_mutex_lock(&node->lock);
   if (wm_initialize(node) < 0) {
     ERROR("write_mongodb plugin: error making connection to server");
     pthread_mutex_unlock(&node->lock);
-    bson_free(bson_record);
     return -1;
   }
 
-  collection =
-      mongoc_client_get_collection(node->client, "collectd", vl->plugin);
-  if (!collection) {
-    ERROR("write_mongodb plugin: error creating/getting collection");
-    mongoc_database_destroy(node->database);
-    mongoc_client_destroy(node->client);
-    node->database = NULL;
-    node->client = NULL;
-    node->connected = 0;
+  batch = wm_get_batch(node, vl->plugin);
+  if (batch == NULL) {
+    wm_disconnect(node);
     pthread_mutex_unlock(&node->lock);
-    bson_free(bson_record);
     return -1;
   }
 
-  status = mongoc_collection_insert(collection, MONGOC_INSERT_NONE, bson_record,
-                                    NULL, &error);
-
-  if (!status) {
-    ERROR("write_mongodb plugin: error inserting record: %s", error.message);
-    mongoc_database_destroy(node->database);
-    mongoc_client_destroy(node->client);
-    node->database = NULL;
-    node->client = NULL;
-    node->connected = 0;
-    pthread_mutex_unlock(&node->lock);
-    bson_free(bson_record);
-    mongoc_collection_destroy(collection);
-    return -1;
+  now = cdtime();
+  if (batch->bulk == NULL) {
+    /* Unordered, so that the server may apply the inserts in parallel and a
+     * failing document doesn't stop the rest of the batch. */
+#if MONGOC_CHECK_VERSION(1, 9, 0)
+    bson_t opts = BSON_INITIALIZER;
+    BSON_APPEND_BOOL(&opts, "ordered", false);
+    batch->bulk =
+        mongoc_collection_create_bulk_operation_with_opts(batch->collection,
+                                                          &opts);
+    bson_destroy(&opts);
+#else
+    batch->bulk = mongoc_collection_create_bulk_operation(
+        batch->collection, /* ordered = */ false, /* write_concern = */ NULL);
+#endif
+    if (batch->bulk == NULL) {
+      ERROR("write_mongodb plugin: error creating bulk operation");
+      pthread_mutex_unlock(&node->lock);
+      return -1;
+    }
+    batch->since = now;
   }
 
-  /* free our resource as not to leak memory */
-  mongoc_collection_destroy(collection);
+  /* The document is copied into the bulk operation's buffer. */
+  mongoc_bulk_operation_insert(batch->bulk, node->record);
+  batch->records_num++;
 
-  pthread_mutex_unlock(&node->lock);
+  status = 0;
+  if ((batch->records_num >= node->batch_size) ||
+      ((node->batch_flush_timeout != 0) &&
+       ((now - batch->since) >= node->batch_flush_timeout)))
+    status = wm_flush_batch(node, batch);
 
-  bson_free(bson_record);
+  pthread_mutex_unlock(&node->lock);
 
-  return 0;
+  return status;
 } /* }}} int wm_write */
 
+static int wm_flush(cdtime_t timeout, /* {{{ */
+                    const char __attribute__((unused)) * identifier,
+                    user_data_t *ud) {
+  wm_node_t *node = ud->data;
+  cdtime_t now = cdtime();
+  int status = 0;
+
+  pthread_mutex_lock(&node->lock);
+  /* wm_flush_batch() drops all batches when it fails. */
+  for (size_t i = 0; i < node->batches_num; i++) {
+    wm_batch_t *batch = node->batches + i;
+
+    if ((batch->bulk == NULL) ||
+        ((timeout != 0) && ((batch->since + timeout) > now)))
+      continue;
+
+    status = wm_flush_batch(node, batch);
+    if (status != 0)
+      break;
+  }
+  pthread_mutex_unlock(&node->lock);
+
+  return status;
+} /* }}} int wm_flush */
+
 static void wm_config_free(void *ptr) /* {{{ */
 {
   wm_node_t *node = ptr;
@@ -300,11 +420,13 @@ static void wm_config_free(void *ptr) /* {{{ */
   if (node == NULL)
     return;
 
-  mongoc_database_destroy(node->database);
-  mongoc_client_destroy(node->client);
-  node->database = NULL;
-  node->client = NULL;
-  node->connected = 0;
+  for (size_t i = 0; i < node->batches_num; i++)
+    if (wm_flush_batch(node, node->batches + i) != 0)
+      break;
+  wm_disconnect(node);
+
+  if (node->record != NULL)
+    bson_destroy(node->record);
 
   sfree(node->host);
   sfree(node);
@@ -321,11 +443,21 @@ static int wm_config_node(oconfig_item_t *ci) /* {{{ */
   mongoc_init();
   node->host = NULL;
   node->store_rates = 1;
+  node->batch_size = 1;
+  node->batch_flush_timeout = 0;
   pthread_mutex_init(&node->lock, /* attr = */ NULL);
 
+  node->record = bson_new();
+  if (node->record == NULL) {
+    ERROR("write_mongodb plugin: bson_new failed.");
+    sfree(node);
+    return ENOMEM;
+  }
+
   status = cf_util_get_string_buffer(ci, node->name, sizeof(node->name));
 
   if (status != 0) {
+    bson_destroy(node->record);
     sfree(node);
     return status;
   }
@@ -351,6 +483,14 @@ static int wm_config_node(oconfig_item_t *ci) /* {{{ */
       status = cf_util_get_string(child, &node->user);
     else if (strcasecmp("Password", child->key) == 0)
       status = cf_util_get_string(child, &node->passwd);
+    else if (strcasecmp("BatchSize", child->key) == 0) {
+      status = cf_util_get_int(child, &node->batch_size);
+      if ((status == 0) && (node->batch_size < 1)) {
+        WARNING("write_mongodb plugin: BatchSize must be at least 1.");
+        status = -1;
+      }
+    } else if (strcasecmp("BatchFlushTimeout", child->key) == 0)
+      status = cf_util_get_cdtime(child, &node->batch_flush_timeout);
     else
       WARNING("write_mongodb plugin: Ignoring unknown config option \"%s\".",
               child->key);
@@ -383,6 +523,11 @@ static int wm_config_node(oconfig_item_t *ci) /* {{{ */
                            });
     INFO("write_mongodb plugin: registered write plugin %s %d", cb_name,
          status);
+    if (status == 0)
+      plugin_register_flush(cb_name, wm_flush,
+                            &(user_data_t){
+                                .data = node,
+                            });
   }
 
   if (status != 0)
@@ -46,15 +46,89 @@ struct wr_node_s {
   int database;
   int max_set_size;
   _Bool store_rates;
+  int batch_size;
+  cdtime_t batch_flush_timeout;
 
   redisContext *conn;
   pthread_mutex_t lock;
+
+  /* Commands appended to the connection's output buffer whose replies have
+   * not been read yet, and the number of value lists they belong to. */
+  int pending_commands;
+  int pending_values;
+  cdtime_t pending_since;
 };
 typedef struct wr_node_s wr_node_t;
 
 /*
  * Functions
  */
+static int wr_connect(wr_node_t *node) /* {{{ */
+{
+  redisReply *rr;
+
+  node->conn =
+      redisConnectWithTimeout((char *)node->host, node->port, node->timeout);
+  if (node->conn == NULL) {
+    ERROR("write_redis plugin: Connecting to host \"%s\" (port %i) failed: "
+          "Unknown reason",
+          (node->host != NULL) ? node->host : "localhost",
+          (node->port != 0) ? node->port : 6379);
+    return -1;
+  } else if (node->conn->err) {
+    ERROR("write_redis plugin: Connecting to host \"%s\" (port %i) failed: %s",
+          (node->host != NULL) ? node->host : "localhost",
+          (node->port != 0) ? node->port : 6379, node->conn->errstr);
+    redisFree(node->conn);
+    node->conn = NULL;
+    return -1;
+  }
+
+  rr = redisCommand(node->conn, "SELECT %d", node->database);
+  if (rr == NULL)
+    WARNING("SELECT command error. database:%d message:%s", node->database,
+            node->conn->errstr);
+  else
+    freeReplyObject(rr);
+
+  return 0;
+} /* }}} int wr_connect */
+
+/* Sends all pipelined commands to the server and reads their replies. On
+ * connection errors the connection is closed and the pending values are
+ * lost. The caller must hold node->lock. */
+static int wr_flush_nolock(wr_node_t *node) /* {{{ */
+{
+  int status = 0;
+
+  if (node->pending_commands == 0)
+    return 0;
+
+  for (int i = 0; i < node->pending_commands; i++) {
+    redisReply *rr = NULL;
+
+    if (redisGetReply(node->conn, (void *)&rr) != REDIS_OK) {
+      ERROR("write_redis plugin: Node \"%s\": Sending %i value list(s) "
+            "failed: %s",
+            node->name, node->pending_values, node->conn->errstr);
+      redisFree(node->conn);
+      node->conn = NULL;
+      status = -1;
+      break;
+    }
+
+    if ((rr != NULL) && (rr->type == REDIS_REPLY_ERROR))
+      WARNING("write_redis plugin: Node \"%s\": Command failed: %s",
+              node->name, rr->str);
+    if (rr != NULL)
+      freeReplyObject(rr);
+  }
+
+  node->pending_commands = 0;
+  node->pending_values = 0;
+  return status;
+} /* }}} int wr_flush_nolock */
+
 static int wr_write(const data_set_t *ds, /* {{{ */
                     const value_list_t *vl, user_data_t *ud) {
   wr_node_t *node = ud->data;
@@ -64,8 +138,9 @@ static int wr_write(const data_set_t *ds, /* {{{ */
   char time[24];
   size_t value_size;
   char *value_ptr;
+  int pending_commands;
+  cdtime_t now;
   int status;
-  redisReply *rr;
 
   status = FORMAT_VL(ident, sizeof(ident), vl);
   if (status != 0)
@@ -83,66 +158,80 @@ static int wr_write(const data_set_t *ds, /* {{{ */
 
   pthread_mutex_lock(&node->lock);
 
-  if (node->conn == NULL) {
-    node->conn =
-        redisConnectWithTimeout((char *)node->host, node->port, node->timeout);
-    if (node->conn == NULL) {
-      ERROR("write_redis plugin: Connecting to host \"%s\" (port %i) failed: "
-            "Unknown reason",
-            (node->host != NULL) ? node->host : "localhost",
-            (node->port != 0) ? node->port : 6379);
-      pthread_mutex_unlock(&node->lock);
-      return -1;
-    } else if (node->conn->err) {
-      ERROR(
-          "write_redis plugin: Connecting to host \"%s\" (port %i) failed: %s",
-          (node->host != NULL) ? node->host : "localhost",
-          (node->port != 0) ? node->port : 6379, node->conn->errstr);
-      pthread_mutex_unlock(&node->lock);
-      return -1;
-    }
-
-    rr = redisCommand(node->conn, "SELECT %d", node->database);
-    if (rr == NULL)
-      WARNING("SELECT command error. database:%d message:%s", node->database,
-              node->conn->errstr);
-    else
-      freeReplyObject(rr);
+  if ((node->conn == NULL) && (wr_connect(node) != 0)) {
+    pthread_mutex_unlock(&node->lock);
+    return -1;
   }
 
-  rr = redisCommand(node->conn, "ZADD %s %s %s", key, time, value);
-  if (rr == NULL)
-    WARNING("ZADD command error. key:%s message:%s", key, node->conn->errstr);
+  pending_commands = node->pending_commands;
+
+  /* The commands are only appended to the output buffer here. They are sent
+   * and their replies are read in one go by wr_flush_nolock(), so that a batch
+   * of value lists costs one round trip instead of three per value list. */
+  if (redisAppendCommand(node->conn, "ZADD %s %s %s", key, time, value) ==
+      REDIS_OK)
+    node->pending_commands++;
   else
-    freeReplyObject(rr);
+    WARNING("ZADD command error. key:%s message:%s", key, node->conn->errstr);
 
   if (node->max_set_size >= 0) {
-    rr = redisCommand(node->conn, "ZREMRANGEBYRANK %s %d %d", key, 0,
-                      (-1 * node->max_set_size) - 1);
-    if (rr == NULL)
+    if (redisAppendCommand(node->conn, "ZREMRANGEBYRANK %s %d %d", key, 0,
+                           (-1 * node->max_set_size) - 1) == REDIS_OK)
+      node->pending_commands++;
+    else
       WARNING("ZREMRANGEBYRANK command error. key:%s message:%s", key,
               node->conn->errstr);
-    else
-      freeReplyObject(rr);
   }
 
   /* TODO(octo): This is more overhead than necessary. Use the cache and
    * metadata to determine if it is a new metric and call SADD only once for
    * each metric. */
-  rr = redisCommand(
-      node->conn, "SADD %svalues %s",
-      (node->prefix != NULL) ? node->prefix : REDIS_DEFAULT_PREFIX, ident);
-  if (rr == NULL)
+  if (redisAppendCommand(
+          node->conn, "SADD %svalues %s",
+          (node->prefix != NULL) ? node->prefix : REDIS_DEFAULT_PREFIX,
+          ident) == REDIS_OK)
+    node->pending_commands++;
+  else
     WARNING("SADD command error. ident:%s message:%s", ident,
             node->conn->errstr);
-  else
-    freeReplyObject(rr);
+
+  /* The value list is only pending if at least one command was appended. */
+  if (node->pending_commands == pending_commands) {
+    pthread_mutex_unlock(&node->lock);
+    return -1;
+  }
+
+  now = cdtime();
+  if (node->pending_values == 0)
+    node->pending_since = now;
+  node->pending_values++;
+
+  status = 0;
+  if ((node->pending_values >= node->batch_size) ||
+      ((node->batch_flush_timeout != 0) &&
+       ((now - node->pending_since) >= node->batch_flush_timeout)))
+    status = wr_flush_nolock(node);
 
   pthread_mutex_unlock(&node->lock);
 
-  return 0;
+  return status;
 } /* }}} int wr_write */
 
+static int wr_flush(cdtime_t timeout, /* {{{ */
+                    const char __attribute__((unused)) * identifier,
+                    user_data_t *ud) {
+  wr_node_t *node = ud->data;
+  int status = 0;
+
+  pthread_mutex_lock(&node->lock);
+  if ((node->pending_values > 0) &&
+      ((timeout == 0) || ((node->pending_since + timeout) <= cdtime())))
+    status = wr_flush_nolock(node);
+  pthread_mutex_unlock(&node->lock);
+
+  return status;
+} /* }}} int wr_flush */
+
 static void wr_config_free(void *ptr) /* {{{ */
 {
   wr_node_t *node = ptr;
@@ -151,6 +240,7 @@ static void wr_config_free(void *ptr) /* {{{ */
     return;
 
   if (node->conn != NULL) {
+    wr_flush_nolock(node);
     redisFree(node->conn);
     node->conn = NULL;
   }
@@ -177,6 +267,8 @@ static int wr_config_node(oconfig_item_t *ci) /* {{{ */
   node->database = 0;
   node->max_set_size = -1;
   node->store_rates = 1;
+  node->batch_size = 1;
+  node->batch_flush_timeout = 0;
   pthread_mutex_init(&node->lock, /* attr = */ NULL);
 
   status = cf_util_get_string_buffer(ci, node->name, sizeof(node->name));
@@ -208,6 +300,14 @@ static int wr_config_node(oconfig_item_t *ci) /* {{{ */
       status = cf_util_get_int(child, &node->max_set_size);
     } else if (strcasecmp("StoreRates", child->key) == 0) {
       status = cf_util_get_boolean(child, &node->store_rates);
+    } else if (strcasecmp("BatchSize", child->key) == 0) {
+      status = cf_util_get_int(child, &node->batch_size);
+      if ((status == 0) && (node->batch_size < 1)) {
+        WARNING("write_redis plugin: BatchSize must be at least 1.");
+        status = -1;
+      }
+    } else if (strcasecmp("BatchFlushTimeout", child->key) == 0) {
+      status = cf_util_get_cdtime(child, &node->batch_flush_timeout);
     } else
       WARNING("write_redis plugin: Ignoring unknown config option \"%s\".",
               child->key);
@@ -225,6 +325,11 @@ static int wr_config_node(oconfig_item_t *ci) /* {{{ */
         cb_name, wr_write, &(user_data_t){
                                .data = node, .free_func = wr_config_free,
                            });
+    if (status == 0)
+      plugin_register_flush(cb_name, wr_flush,
+                            &(user_data_t){
+                                .data = node,
+                            });
   }
 
   if (status != 0)